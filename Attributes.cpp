@@ -2,6 +2,10 @@
 //  History:    2015-06-19 Dwayne Robinson - Created
 //----------------------------------------------------------------------------
 #include "precomp.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <emmintrin.h>
+#endif
 
 
 MODULE(Attributes)
@@ -11,6 +15,149 @@ EXPORT_END
 
 ////////////////////////////////////////
 
+namespace
+{
+    // Count the ASCII digits at the start of the text.
+    size_t CountDigits(char16_t const* text, char16_t const* textEnd) noexcept
+    {
+        char16_t const* p = text;
+
+    #if defined(_M_IX86) || defined(_M_X64)
+        // Classify eight code units at a time. Offsetting by '0' maps digits
+        // to 0-9, and every other code unit to negative or 10 and above.
+        __m128i const zeroDigits = _mm_set1_epi16('0');
+        __m128i const minusOnes = _mm_set1_epi16(-1);
+        __m128i const tens = _mm_set1_epi16(10);
+        while (textEnd - p >= 8)
+        {
+            __m128i offsets = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)), zeroDigits);
+            __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi16(offsets, minusOnes), _mm_cmplt_epi16(offsets, tens));
+            uint32_t nonDigitMask = ~uint32_t(_mm_movemask_epi8(isDigit)) & 0xFFFF;
+            if (nonDigitMask != 0)
+            {
+                unsigned long byteIndex;
+                _BitScanForward(&byteIndex, nonDigitMask);
+                return (p - text) + byteIndex / sizeof(char16_t);
+            }
+            p += 8;
+        }
+    #endif
+
+        for (; p < textEnd && *p >= '0' && *p <= '9'; ++p)
+        { }
+        return p - text;
+    }
+
+
+    uint32_t ReadDigits(char16_t const* text, size_t digitCount) noexcept
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < digitCount; ++i)
+        {
+            value = value * 10 + (text[i] - '0');
+        }
+        return value;
+    }
+
+
+    bool IsArrayElementSeparator(char16_t ch) noexcept
+    {
+        return ch == ' ' || ch == ',' || ch == '\0';
+    }
+
+
+    // Read a plain decimal number: digits for integers, or digits with an
+    // optional fraction for floats, either optionally negated. This covers
+    // glyph ids, advances, and offsets, but anything fancier (exponents,
+    // hex, overlong values, trailing junk) is declined, leaving it to the
+    // general element parser. Whatever is accepted converts exactly as
+    // wcstoul/wcstof would, since integers are limited to 9 digits, and
+    // floats to 7 digits (exact in float, as are the powers of ten needed),
+    // making the single division correctly rounded.
+    bool ReadPlainNumber(
+        char16_t const* text,
+        char16_t const* textEnd,
+        bool isFloat,
+        _Out_ char16_t const** nextText,
+        _Out_ Attribute::Variant& data
+        ) noexcept
+    {
+        const static float powersOfTen[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f};
+
+        *nextText = text;
+        bool const isNegative = (*text == '-');
+        text += isNegative;
+
+        size_t const integerDigitCount = CountDigits(text, textEnd);
+        char16_t const* integerDigits = text;
+        text += integerDigitCount;
+
+        if (!isFloat)
+        {
+            if (integerDigitCount == 0 || integerDigitCount > 9 || !IsArrayElementSeparator(*text))
+                return false;
+
+            uint32_t value = ReadDigits(integerDigits, integerDigitCount);
+            data.ui32 = isNegative ? 0u - value : value;
+        }
+        else
+        {
+            size_t fractionDigitCount = 0;
+            char16_t const* fractionDigits = text;
+            if (*text == '.')
+            {
+                fractionDigits = ++text;
+                fractionDigitCount = CountDigits(text, textEnd);
+                text += fractionDigitCount;
+            }
+
+            size_t const totalDigitCount = integerDigitCount + fractionDigitCount;
+            if (totalDigitCount == 0 || totalDigitCount > 7 || !IsArrayElementSeparator(*text))
+                return false;
+
+            uint32_t mantissa = ReadDigits(integerDigits, integerDigitCount);
+            for (size_t i = 0; i < fractionDigitCount; ++i)
+            {
+                mantissa = mantissa * 10 + (fractionDigits[i] - '0');
+            }
+            float value = float(mantissa) / powersOfTen[fractionDigitCount];
+            data.f32 = isNegative ? -value : value;
+        }
+
+        *nextText = text;
+        return true;
+    }
+
+
+    bool IsPlainNumberArrayAttribute(Attribute const& attribute) noexcept
+    {
+        switch (Attribute::GetBaseType(attribute.type))
+        {
+        case Attribute::TypeInteger8:
+        case Attribute::TypeUInteger8:
+        case Attribute::TypeInteger16:
+        case Attribute::TypeUInteger16:
+        case Attribute::TypeInteger32:
+        case Attribute::TypeUInteger32:
+            // Named forms go through their own parsers.
+            switch (attribute.semantic)
+            {
+            case Attribute::SemanticEnum:
+            case Attribute::SemanticEnumExclusive:
+            case Attribute::SemanticColor:
+            case Attribute::SemanticCharacterTags:
+                return false;
+            }
+            return true;
+
+        case Attribute::TypeFloat32:
+            return true;
+        }
+        return false;
+    }
+}
+
+
 char16_t const* Attribute::PredefinedValue::GetName() const
 {
     return name != nullptr ? name : u"";
@@ -72,10 +219,28 @@ HRESULT Attribute::ParseString(
         Attribute::Variant buffer;
         size_t typeSize = GetTypeSizeof(this->type);
 
+        // Numbers can be thousands long (glyphs, advances, offsets), so read
+        // plain decimal elements directly before falling back to the general
+        // element parser, and reserve enough for the largest possible count
+        // (each element needs a character and a separator) to grow only once.
+        bool const isPlainNumberArray = IsPlainNumberArrayAttribute(*this);
+        bool const isFloat = (GetBaseType(this->type) == TypeFloat32);
+        size_t const stringLength = wcslen(ToWChar(stringValue));
+        char16_t const* const stringEnd = stringValue + stringLength;
+        data.reserve((stringLength + 1) / 2 * typeSize);
+
         while (stringValue[0] != '\0')
         {
             size_t dataOldSize = data.size();
-            IFR(ParseString(stringValue, OUT &stringValue, IN OUT buffer));
+            char16_t const* numberEnd = nullptr;
+            if (isPlainNumberArray && ReadPlainNumber(SkipSpaces(stringValue), stringEnd, isFloat, OUT &numberEnd, OUT buffer))
+            {
+                stringValue = SkipToNextWord(numberEnd);
+            }
+            else
+            {
+                IFR(ParseString(stringValue, OUT &stringValue, IN OUT buffer));
+            }
             data.resize(dataOldSize + typeSize);
             memcpy(&data[dataOldSize], buffer.buffer, typeSize);
         }
@@ -220,19 +385,131 @@ HRESULT Attribute::ParseString(
 }
 
 
+namespace
+{
+    // Hashed lookups of an attribute's predefined values by case-folded name
+    // and by integer, built once per table on first use. Attributes live in
+    // static tables, so their predefined values can be indexed by address,
+    // unlike the transient arrays passed to PredefinedValue::MapNameToValue.
+    // Small tables are scanned directly, which is as fast as hashing.
+    class PredefinedValueIndex
+    {
+    public:
+        static constexpr size_t minimumIndexedCount = 8;
+        static constexpr size_t maximumNameLength = 64; // Longer names are scanned.
+
+        explicit PredefinedValueIndex(array_ref<Attribute::PredefinedValue const> values)
+        {
+            uint32_t const valuesCount = uint32_t(values.size());
+            foldedNames_.resize(valuesCount);
+            valueIndices_.reserve(valuesCount);
+            nameIndices_.reserve(valuesCount);
+
+            for (uint32_t i = 0; i < valuesCount; ++i)
+            {
+                auto const& predefinedValue = values[i];
+                valueIndices_.emplace(predefinedValue.integerValue, i); // First match wins, as with scanning.
+
+                if (predefinedValue.name != nullptr)
+                {
+                    auto& foldedName = foldedNames_[i];
+                    foldedName = predefinedValue.name;
+                    FoldCase(foldedName.data(), foldedName.size());
+                    nameIndices_.emplace(foldedName, i);
+                }
+            }
+        }
+
+        static PredefinedValueIndex const* Get(array_ref<Attribute::PredefinedValue const> values)
+        {
+            if (values.size() < minimumIndexedCount)
+                return nullptr;
+
+            static std::mutex lock;
+            static std::unordered_map<Attribute::PredefinedValue const*, std::unique_ptr<PredefinedValueIndex const>> indices;
+
+            std::lock_guard<std::mutex> scopedLock(lock);
+            auto& index = indices[values.data()];
+            if (index == nullptr || index->foldedNames_.size() != values.size())
+            {
+                index.reset(new PredefinedValueIndex(values));
+            }
+            return index.get();
+        }
+
+        // Returns true if the name was short enough to look up, with the
+        // predefined value index or ~0 if absent.
+        bool FindName(_In_z_ char16_t const* name, _Out_ uint32_t& valueIndex) const
+        {
+            valueIndex = ~0u;
+
+            char16_t foldedName[maximumNameLength];
+            size_t nameLength = 0;
+            for (; name[nameLength] != '\0'; ++nameLength)
+            {
+                if (nameLength >= maximumNameLength)
+                    return false;
+                foldedName[nameLength] = name[nameLength];
+            }
+            FoldCase(foldedName, nameLength);
+
+            auto match = nameIndices_.find(std::u16string_view(foldedName, nameLength));
+            if (match != nameIndices_.end())
+                valueIndex = match->second;
+
+            return true;
+        }
+
+        bool FindValue(uint32_t value, _Out_ uint32_t& valueIndex) const
+        {
+            auto match = valueIndices_.find(value);
+            valueIndex = (match != valueIndices_.end()) ? match->second : ~0u;
+            return valueIndex != ~0u;
+        }
+
+    private:
+        // Lower case for matching like _wcsicmp.
+        static void FoldCase(_Inout_updates_(textLength) char16_t* text, size_t textLength) noexcept
+        {
+            for (size_t i = 0; i < textLength; ++i)
+            {
+                text[i] = char16_t(towlower(text[i]));
+            }
+        }
+
+        std::vector<std::u16string> foldedNames_; // Storage for the name keys, parallel to the values.
+        std::unordered_map<std::u16string_view, uint32_t> nameIndices_;
+        std::unordered_map<uint32_t, uint32_t> valueIndices_;
+    };
+}
+
+
 HRESULT Attribute::MapValueToName(_Out_ uint32_t enumValue, _Out_ std::u16string& stringValue) const
 {
     stringValue.clear();
 
     // Look for enum value.
-    for (uint32_t i = 0, ci = uint32_t(this->predefinedValues.size()); i < ci; ++i)
+    uint32_t valueIndex;
+    auto* index = PredefinedValueIndex::Get(this->predefinedValues);
+    if (index != nullptr)
     {
-        if (this->predefinedValues[i].integerValue == enumValue)
+        if (index->FindValue(enumValue, OUT valueIndex) && this->predefinedValues[valueIndex].name != nullptr)
         {
-            stringValue = this->predefinedValues[i].name;
+            stringValue = this->predefinedValues[valueIndex].name;
             return S_OK;
         }
     }
+    else
+    {
+        for (uint32_t i = 0, ci = uint32_t(this->predefinedValues.size()); i < ci; ++i)
+        {
+            if (this->predefinedValues[i].integerValue == enumValue)
+            {
+                stringValue = this->predefinedValues[i].name;
+                return S_OK;
+            }
+        }
+    }
 
     // Otherwise look for a numeric value, confirming that numeric value is
     // actually in the enumeration set.
@@ -269,7 +546,19 @@ HRESULT Attribute::PredefinedValue::MapNameToValue(
 
 HRESULT Attribute::MapNameToValue(_In_z_ char16_t const* stringValue, _Out_ uint32_t& value) const
 {
-    return PredefinedValue::MapNameToValue(this->predefinedValues, stringValue, OUT value);
+    uint32_t valueIndex;
+    auto* index = PredefinedValueIndex::Get(this->predefinedValues);
+    if (index == nullptr || !index->FindName(stringValue, OUT valueIndex))
+        return PredefinedValue::MapNameToValue(this->predefinedValues, stringValue, OUT value);
+
+    if (valueIndex == ~0u)
+    {
+        value = 0;
+        return HRESULT_FROM_WIN32(ERROR_UNMAPPED_SUBSTITUTION_STRING);
+    }
+
+    value = this->predefinedValues[valueIndex].integerValue;
+    return S_OK;
 }
 
 
@@ -622,11 +911,69 @@ HRESULT Attribute::GetPredefinedValueIndices(
 }
 
 
+namespace
+{
+    // Parsed arrays keyed by attribute address and string. Entries are weak
+    // so that the cache never keeps an array alive once no value uses it.
+    std::mutex g_dataArrayCacheLock;
+    std::unordered_map<std::u16string, std::weak_ptr<std::vector<uint8_t> const>> g_dataArrayCache;
+    size_t g_dataArrayCachePruneSize = 64;
+
+    HRESULT GetSharedDataArray(
+        Attribute const& attribute,
+        std::u16string const& stringValue,
+        _Out_ std::shared_ptr<std::vector<uint8_t> const>& dataArray
+        )
+    {
+        dataArray.reset();
+
+        uintptr_t attributeAddress = reinterpret_cast<uintptr_t>(&attribute);
+        std::u16string key;
+        key.reserve(sizeof(attributeAddress) / sizeof(char16_t) + stringValue.size());
+        key.append(reinterpret_cast<char16_t const*>(&attributeAddress), sizeof(attributeAddress) / sizeof(char16_t));
+        key.append(stringValue);
+
+        {
+            std::lock_guard<std::mutex> lock(g_dataArrayCacheLock);
+            auto match = g_dataArrayCache.find(key);
+            if (match != g_dataArrayCache.end())
+            {
+                dataArray = match->second.lock();
+                if (dataArray != nullptr)
+                    return S_OK;
+            }
+        }
+
+        // Parse outside the lock. If another thread races to parse the same
+        // string, both results are equal and the later one simply wins.
+        auto newDataArray = std::make_shared<std::vector<uint8_t>>();
+        IFR(attribute.ParseString(stringValue.c_str(), OUT *newDataArray));
+        dataArray = newDataArray;
+
+        std::lock_guard<std::mutex> lock(g_dataArrayCacheLock);
+
+        // Sweep out arrays nobody holds anymore whenever the cache doubles.
+        if (g_dataArrayCache.size() >= g_dataArrayCachePruneSize)
+        {
+            for (auto entry = g_dataArrayCache.begin(); entry != g_dataArrayCache.end(); )
+            {
+                entry = entry->second.expired() ? g_dataArrayCache.erase(entry) : std::next(entry);
+            }
+            g_dataArrayCachePruneSize = std::max(g_dataArrayCache.size() * 2, size_t(64));
+        }
+        g_dataArrayCache[std::move(key)] = dataArray;
+
+        return S_OK;
+    }
+}
+
+
 HRESULT AttributeValue::Set(Attribute const& attribute, _In_z_ char16_t const* newStringValue)
 {
-    // Increment the cookie value so that callers can know when the value is
-    // different lest they cached results.
-    ++this->cookieValue;
+    // Take a new cookie value so that callers can know when the value is
+    // different lest they cached results. They are unique across all values,
+    // so a value restored from a snapshot never matches what a cache saw since.
+    this->cookieValue = g_nextCookieValue++;
 
     size_t stringLength = wcslen(ToWChar(newStringValue));
 
@@ -649,15 +996,43 @@ HRESULT AttributeValue::Set(Attribute const& attribute, _In_z_ char16_t const* n
 
     this->stringValue.assign(newStringValue, stringLength);
 
+    return ParseStringValue(attribute);
+}
+
+
+HRESULT AttributeValue::Set(Attribute const& attribute, SharedString const& newStringValue)
+{
+    // File paths may need their quotes stripped, which needs a new string anyway.
+    if (attribute.semantic == attribute.SemanticFilePath)
+        return Set(attribute, newStringValue.c_str());
+
+    this->cookieValue = g_nextCookieValue++;
+    this->stringValue = newStringValue;
+
+    return ParseStringValue(attribute);
+}
+
+
+void AttributeValue::SetShared(AttributeValue const& other)
+{
+    *this = other;
+    this->cookieValue = g_nextCookieValue++;
+}
+
+
+HRESULT AttributeValue::ParseStringValue(Attribute const& attribute)
+{
     HRESULT hr;
     if (attribute.IsTypeArray())
     {
-        // If array type, initialize the variable length data.
-        hr = attribute.ParseString(this->stringValue.c_str(), OUT this->dataArray);
+        // If array type, initialize the variable length data, or share an
+        // identical array already parsed from the same string.
+        hr = GetSharedDataArray(attribute, this->stringValue.str(), OUT this->dataArray);
     }
     else
     {
         // Otherwise just copy a single value out to the single unit variant.
+        this->dataArray.reset();
         char16_t const* stringEnd = nullptr;
         hr = attribute.ParseString(this->stringValue.c_str(), OUT &stringEnd, OUT this->data);
     }
@@ -669,19 +1044,51 @@ HRESULT AttributeValue::Set(Attribute const& attribute, _In_z_ char16_t const* n
 }
 
 
-array_ref<uint8_t> AttributeValue::Get()
+array_ref<uint8_t> AttributeValue::Get() const
 {
     if (Attribute::IsTypeArray(data.type))
     {
-        // Return the array data directly.
-        return dataArray;
+        // Return the array data directly. It is shared, so callers only read it.
+        if (dataArray == nullptr)
+            return {};
+
+        return array_ref<uint8_t>(const_cast<uint8_t*>(dataArray->data()), dataArray->size());
     }
     else
     {
         // Return the single instance field (the data array is not allocated).
         auto byteSize = Attribute::GetTypeSizeof(data.type);
-        return byte_array_ref(&data.buffer[0], &data.buffer[byteSize]);
+        uint8_t* buffer = const_cast<uint8_t*>(&data.buffer[0]);
+        return byte_array_ref(buffer, buffer + byteSize);
+    }
+}
+
+
+AttributeValue const SparseAttributeValues::emptyValue_;
+std::atomic<uint32_t> AttributeValue::g_nextCookieValue(1);
+
+
+AttributeValue& SparseAttributeValues::GetForWrite(uint32_t id)
+{
+    ThrowIf(id >= maximumCount, "Attribute id exceeds the sparse value capacity!");
+
+    // Detach from any copies before writing.
+    if (values_ == nullptr)
+    {
+        values_ = std::make_shared<std::vector<AttributeValue>>();
+    }
+    else if (values_.use_count() > 1)
+    {
+        values_ = std::make_shared<std::vector<AttributeValue>>(*values_);
+    }
+
+    uint32_t const packedIndex = GetPackedIndex(id);
+    if (!(presentMask_ & (uint64_t(1) << id)))
+    {
+        values_->emplace(values_->begin() + packedIndex);
+        presentMask_ |= uint64_t(1) << id;
     }
+    return (*values_)[packedIndex];
 }
 
 
@@ -202,23 +202,143 @@ struct Attribute
 DEFINE_ENUM_FLAG_OPERATORS(Attribute::GetPredefinedValueFlags);
 
 
+// Immutable reference counted string, so copying an attribute value to other
+// objects shares one buffer rather than duplicating it (say, a 1MB text shown
+// by a hundred objects). Assigning allocates a new buffer rather than writing
+// into the shared one, leaving other holders unchanged (copy-on-write).
+class SharedString
+{
+public:
+    SharedString() = default;
+
+    SharedString(std::shared_ptr<std::u16string const> text) noexcept
+    :   text_(std::move(text))
+    {}
+
+    void assign(_In_reads_(length) char16_t const* s, size_t length)
+    {
+        text_ = std::make_shared<std::u16string>(s, length);
+    }
+
+    bool empty() const noexcept { return size() == 0; }
+    size_t size() const noexcept { return (text_ != nullptr) ? text_->size() : 0; }
+    char16_t const* c_str() const noexcept { return (text_ != nullptr) ? text_->c_str() : u""; }
+    char16_t const* data() const noexcept { return c_str(); }
+
+    // For callers needing an actual std::u16string.
+    std::u16string const& str() const noexcept
+    {
+        static std::u16string const emptyString;
+        return (text_ != nullptr) ? *text_ : emptyString;
+    }
+
+    // Reading the same buffer compares equal without looking at the contents.
+    bool operator==(SharedString const& other) const noexcept
+    {
+        return text_ == other.text_
+            || (size() == other.size() && memcmp(c_str(), other.c_str(), size() * sizeof(char16_t)) == 0);
+    }
+
+    bool operator!=(SharedString const& other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+private:
+    std::shared_ptr<std::u16string const> text_;
+};
+
+
 // Each attribute value has a string representation and a cached binary form.
-// Note the dataArray is empty if the data has a single element, small
-// enough to just fit in the variant.
+// Note the dataArray is null if the data has a single element, small
+// enough to just fit in the variant. Array data is interned by attribute
+// and string, so values holding the same string (for example, whenever an
+// edit is applied to many objects) parse once and share one immutable array.
 struct AttributeValue
 {
     Attribute::Variant data; // Room for one element, which is the common case.
-    std::vector<uint8_t> dataArray; // Variable length data in case the fixed size variant is too small.
-    std::u16string stringValue; // string representation, typed by user or read from data file.
-    uint32_t cookieValue = 0; // useful to compare for value changes, incremented each time.
+    std::shared_ptr<std::vector<uint8_t> const> dataArray; // Variable length data in case the fixed size variant is too small. Never modify it.
+    SharedString stringValue; // string representation, typed by user or read from data file. Copies share it.
+    uint32_t cookieValue = 0; // useful to compare for value changes, unique to each Set across all values.
 
-    array_ref<uint8_t> Get(); // Get the data.
+    array_ref<uint8_t> Get() const; // Get the data, which must not be written to.
     HRESULT Set(Attribute const& attribute, _In_z_ char16_t const* newStringValue);
+    HRESULT Set(Attribute const& attribute, SharedString const& newStringValue); // Shares the string buffer.
+
+    // Take another value's string and parsed data, which share their buffers,
+    // but still take a new cookie for this value so that it registers as changed.
+    void SetShared(AttributeValue const& other);
+
+    static std::atomic<uint32_t> g_nextCookieValue;
 
     AttributeValue()
     {
         data.type = Attribute::TypeNone;
     }
+
+private:
+    // Parse the current string into the data (or data array).
+    HRESULT ParseStringValue(Attribute const& attribute);
+};
+
+
+// Attribute values indexed by id, allocating only those ever written, since
+// most objects leave nearly all attributes at their default. Present values
+// are packed in id order, found by counting the present bits below the id.
+// Reading an id never written gives an empty value (no string, TypeNone),
+// which the attribute's default then stands in for. Written values are kept
+// even once emptied again, so their cookies only ever increase. Adding a new
+// value moves the others, so callers must not hold references across writes.
+//
+// Copies share the packed values until either is written (copy-on-write),
+// so copying a whole list of objects, such as for a snapshot, copies none.
+class SparseAttributeValues
+{
+public:
+    static constexpr uint32_t maximumCount = 64;
+
+    AttributeValue const& operator[](uint32_t id) const noexcept
+    {
+        if (id >= maximumCount || !(presentMask_ & (uint64_t(1) << id)))
+            return emptyValue_;
+        return (*values_)[GetPackedIndex(id)];
+    }
+
+    // Get the value to write, adding an empty one if not yet present.
+    AttributeValue& GetForWrite(uint32_t id);
+
+    bool IsPresent(uint32_t id) const noexcept
+    {
+        return id < maximumCount && (presentMask_ & (uint64_t(1) << id));
+    }
+
+    // Only the values present, in id order.
+    array_ref<AttributeValue const> GetPresentValues() const noexcept
+    {
+        if (values_ == nullptr)
+            return {};
+        return array_ref<AttributeValue const>(values_->data(), values_->size());
+    }
+
+    // True if neither was written since one was copied from the other.
+    bool IsSharedWith(SparseAttributeValues const& other) const noexcept
+    {
+        return values_ == other.values_;
+    }
+
+private:
+    uint32_t GetPackedIndex(uint32_t id) const noexcept
+    {
+        uint64_t bits = presentMask_ & ((uint64_t(1) << id) - 1);
+        bits = bits - ((bits >> 1) & 0x5555555555555555);
+        bits = (bits & 0x3333333333333333) + ((bits >> 2) & 0x3333333333333333);
+        bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0F;
+        return uint32_t((bits * 0x0101010101010101) >> 56);
+    }
+
+    uint64_t presentMask_ = 0;
+    std::shared_ptr<std::vector<AttributeValue>> values_; // Null until the first write.
+    static AttributeValue const emptyValue_;
 };
 
 
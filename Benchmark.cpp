@@ -0,0 +1,483 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Microbenchmarks of the drawable object rendering APIs.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "FileHelpers.h"
+#include "HeadlessRenderer.h"
+
+
+MODULE(Benchmark)
+EXPORT_BEGIN
+    #include "Benchmark.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    char16_t const* g_defaultBenchmarkText = u"The quick brown fox jumps over the lazy dog. 0123456789";
+
+    // Nearest rank percentile of the sorted samples.
+    double GetPercentile(array_ref<int64_t const> sortedTicks, uint32_t percent)
+    {
+        if (sortedTicks.empty())
+            return 0;
+
+        size_t index = (sortedTicks.size() * percent + 99) / 100;
+        index = std::min(std::max(index, size_t(1)), sortedTicks.size()) - 1;
+        return PerformanceCounterToMilliseconds(sortedTicks[index]);
+    }
+
+    double GetMean(array_ref<int64_t const> ticks)
+    {
+        if (ticks.empty())
+            return 0;
+
+        int64_t totalTicks = std::accumulate(ticks.begin(), ticks.end(), int64_t(0));
+        return PerformanceCounterToMilliseconds(totalTicks) / ticks.size();
+    }
+
+    // Split a semicolon separated list, as used by the /functions, /fonts, and
+    // /sizes options. Commas are accepted too unless the values may contain them.
+    void SplitList(
+        _In_z_ char16_t const* list,
+        bool allowCommas,
+        _Inout_ std::vector<std::u16string>& values
+        )
+    {
+        std::u16string value;
+        for (char16_t const* p = list; ; ++p)
+        {
+            char16_t ch = *p;
+            if (ch == ';' || ch == '\0' || (allowCommas && ch == ','))
+            {
+                TrimSpaces(IN OUT value);
+                if (!value.empty())
+                {
+                    values.push_back(value);
+                }
+                value.clear();
+                if (ch == '\0')
+                    break;
+            }
+            else
+            {
+                value.push_back(ch);
+            }
+        }
+    }
+
+    void AppendFormatted(_Inout_ std::u16string& text, _In_z_ char16_t const* formatString, ...)
+    {
+        wchar_t buffer[1024];
+        va_list argList;
+        va_start(argList, formatString);
+        StringCchVPrintfW(buffer, countof(buffer), ToWChar(formatString), argList);
+        va_end(argList);
+        text.append(ToChar16(buffer));
+    }
+
+    void AppendJsonString(_Inout_ std::u16string& text, std::u16string const& value)
+    {
+        text.push_back('"');
+        for (char16_t ch : value)
+        {
+            if (ch == '"' || ch == '\\')
+            {
+                text.push_back('\\');
+                text.push_back(ch);
+            }
+            else if (ch < 0x20)
+            {
+                AppendFormatted(IN OUT text, u"\\u%04X", ch);
+            }
+            else
+            {
+                text.push_back(ch);
+            }
+        }
+        text.push_back('"');
+    }
+
+    void AppendCsvString(_Inout_ std::u16string& text, std::u16string const& value)
+    {
+        text.push_back('"');
+        for (char16_t ch : value)
+        {
+            if (ch == '"')
+                text.push_back('"');
+            text.push_back(ch);
+        }
+        text.push_back('"');
+    }
+
+    void FormatResultsAsCsv(array_ref<BenchmarkResult const> results, _Out_ std::u16string& text)
+    {
+        text.assign(
+            u"function,font,size,textLength,iterations,layoutsPerSecond,codeUnitsPerSecond,"
+            u"layoutMs50,drawMs50,drawMs90,drawMs99,warmDrawMs50,totalMs50,totalMs90,totalMs99,hresult\r\n"
+            );
+
+        for (auto const& result : results)
+        {
+            AppendCsvString(IN OUT text, result.function);
+            text.push_back(',');
+            AppendCsvString(IN OUT text, result.fontFamily);
+            AppendFormatted(
+                IN OUT text,
+                u",%g,%u,%u,%.1f,%.1f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,0x%08X\r\n",
+                result.fontSize,
+                result.textLength,
+                result.iterations,
+                result.layoutsPerSecond,
+                result.codeUnitsPerSecond,
+                result.layoutMilliseconds50,
+                result.drawMilliseconds50,
+                result.drawMilliseconds90,
+                result.drawMilliseconds99,
+                result.warmDrawMilliseconds50,
+                result.totalMilliseconds50,
+                result.totalMilliseconds90,
+                result.totalMilliseconds99,
+                static_cast<uint32_t>(result.hr)
+                );
+        }
+    }
+
+    void FormatResultsAsJson(array_ref<BenchmarkResult const> results, _Out_ std::u16string& text)
+    {
+        text.assign(u"[\r\n");
+
+        for (size_t i = 0, count = results.size(); i < count; ++i)
+        {
+            auto const& result = results[i];
+            text.append(u"  {\"function\":");
+            AppendJsonString(IN OUT text, result.function);
+            text.append(u", \"font\":");
+            AppendJsonString(IN OUT text, result.fontFamily);
+            AppendFormatted(
+                IN OUT text,
+                u", \"size\":%g, \"textLength\":%u, \"iterations\":%u, \"layoutsPerSecond\":%.1f, \"codeUnitsPerSecond\":%.1f, "
+                u"\"layoutMs50\":%.4f, \"drawMs50\":%.4f, \"drawMs90\":%.4f, \"drawMs99\":%.4f, \"warmDrawMs50\":%.4f, "
+                u"\"totalMs50\":%.4f, \"totalMs90\":%.4f, \"totalMs99\":%.4f, \"hresult\":\"0x%08X\"}%s\r\n",
+                result.fontSize,
+                result.textLength,
+                result.iterations,
+                result.layoutsPerSecond,
+                result.codeUnitsPerSecond,
+                result.layoutMilliseconds50,
+                result.drawMilliseconds50,
+                result.drawMilliseconds90,
+                result.drawMilliseconds99,
+                result.warmDrawMilliseconds50,
+                result.totalMilliseconds50,
+                result.totalMilliseconds90,
+                result.totalMilliseconds99,
+                static_cast<uint32_t>(result.hr),
+                (i + 1 < count) ? L"," : L""
+                );
+        }
+
+        text.append(u"]\r\n");
+    }
+}
+
+
+HRESULT BenchmarkDrawableObject(
+    DrawableObjectAndValues& drawableObject,
+    DrawingCanvas& drawingCanvas,
+    uint32_t iterations,
+    _Out_ BenchmarkResult& result
+    )
+{
+    drawableObject.GetString(DrawableObjectAttributeFunction, OUT result.function);
+    drawableObject.GetString(DrawableObjectAttributeFontFamily, OUT result.fontFamily);
+    result.fontSize = drawableObject.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
+    result.textLength = uint32_t(drawableObject.GetString(DrawableObjectAttributeText).size());
+    result.iterations = iterations;
+    result.hr = S_OK;
+
+    auto drawableObjects = make_array_ref(&drawableObject, 1);
+
+    // Warm up once, which also sizes the canvas to fit the object.
+    IFR(drawingCanvas.CreateRenderTargetsOnDemand(nullptr, {1,1}));
+    drawableObject.Invalidate();
+    drawableObject.Update();
+    DrawableObjectAndValues::Arrange(drawableObjects, drawingCanvas);
+
+    RECT drawnRect;
+    drawableObject.GetDrawnRect(DrawingCanvas::g_identityMatrix, OUT drawnRect);
+    IFR(drawingCanvas.ResizeRenderTargets({std::max(drawnRect.right, 1L), std::max(drawnRect.bottom, 1L)}));
+    DrawableObjectAndValues::Draw(drawableObjects, drawingCanvas, DrawingCanvas::g_identityMatrix);
+    GdiFlush();
+
+    std::vector<int64_t> layoutTicks(iterations);
+    std::vector<int64_t> drawTicks(iterations);
+    std::vector<int64_t> warmDrawTicks(iterations);
+    std::vector<int64_t> totalTicks(iterations);
+
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        // Cold, recreating the object, its fonts, and its layout. The canvas
+        // would otherwise hand back the fonts and layouts it shares between
+        // objects, so clear them first (outside the timing).
+        drawingCanvas.ClearSharedResources();
+        int64_t startTicks = GetPerformanceCounter();
+        drawableObject.Invalidate();
+        drawableObject.Update();
+        DrawableObjectAndValues::Arrange(drawableObjects, drawingCanvas);
+        int64_t layoutEndTicks = GetPerformanceCounter();
+
+        drawingCanvas.ClearBackground(DrawableObject::defaultCanvasColor);
+        int64_t drawStartTicks = GetPerformanceCounter();
+        DrawableObjectAndValues::Draw(drawableObjects, drawingCanvas, DrawingCanvas::g_identityMatrix);
+        drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+        GdiFlush(); // Count batched GDI drawing too.
+        int64_t drawEndTicks = GetPerformanceCounter();
+
+        // Warm, with everything cached.
+        drawingCanvas.ClearBackground(DrawableObject::defaultCanvasColor);
+        int64_t warmDrawStartTicks = GetPerformanceCounter();
+        DrawableObjectAndValues::Draw(drawableObjects, drawingCanvas, DrawingCanvas::g_identityMatrix);
+        drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+        GdiFlush();
+        int64_t warmDrawEndTicks = GetPerformanceCounter();
+
+        layoutTicks[i] = layoutEndTicks - startTicks;
+        drawTicks[i] = drawEndTicks - drawStartTicks;
+        warmDrawTicks[i] = warmDrawEndTicks - warmDrawStartTicks;
+        totalTicks[i] = layoutTicks[i] + drawTicks[i];
+    }
+
+    double const meanLayoutMilliseconds = GetMean(layoutTicks);
+    double const meanDrawMilliseconds = GetMean(drawTicks);
+    result.layoutsPerSecond = (meanLayoutMilliseconds > 0) ? 1000.0 / meanLayoutMilliseconds : 0;
+    result.codeUnitsPerSecond = (meanDrawMilliseconds > 0) ? result.textLength * 1000.0 / meanDrawMilliseconds : 0;
+
+    std::sort(layoutTicks.begin(), layoutTicks.end());
+    std::sort(drawTicks.begin(), drawTicks.end());
+    std::sort(warmDrawTicks.begin(), warmDrawTicks.end());
+    std::sort(totalTicks.begin(), totalTicks.end());
+
+    result.layoutMilliseconds50     = GetPercentile(layoutTicks, 50);
+    result.drawMilliseconds50       = GetPercentile(drawTicks, 50);
+    result.drawMilliseconds90       = GetPercentile(drawTicks, 90);
+    result.drawMilliseconds99       = GetPercentile(drawTicks, 99);
+    result.warmDrawMilliseconds50   = GetPercentile(warmDrawTicks, 50);
+    result.totalMilliseconds50      = GetPercentile(totalTicks, 50);
+    result.totalMilliseconds90      = GetPercentile(totalTicks, 90);
+    result.totalMilliseconds99      = GetPercentile(totalTicks, 99);
+
+    drawingCanvas.RetireStaleSharedResources();
+
+    return S_OK;
+}
+
+
+int RunBenchmarkCommandLine(_In_z_ char16_t const* commandLine)
+{
+    AttachConsole(ATTACH_PARENT_PROCESS);
+
+    int argumentCount = 0;
+    wchar_t** arguments = CommandLineToArgvW(ToWChar(commandLine), OUT &argumentCount);
+    if (arguments == nullptr)
+    {
+        return 1;
+    }
+
+    uint32_t iterations = 100;
+    std::u16string outputFilePath;
+    std::u16string dwriteDllPath;
+    std::vector<std::u16string> functions;
+    std::vector<std::u16string> fontFamilies;
+    std::vector<std::u16string> fontSizes;
+    std::vector<std::u16string> texts;
+    std::vector<std::u16string> settingsFilePaths;
+    std::u16string text;
+
+    for (int i = 0; i < argumentCount; ++i)
+    {
+        char16_t const* argument = ToChar16(arguments[i]);
+        if (_wcsicmp(ToWChar(argument), L"/benchmark") == 0)
+        {
+            continue;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/iterations:", 12) == 0)
+        {
+            iterations = std::max(uint32_t(wcstoul(ToWChar(argument + 12), nullptr, 10)), 1u);
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/functions:", 11) == 0)
+        {
+            SplitList(argument + 11, /*allowCommas*/false, IN OUT functions);
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/fonts:", 7) == 0)
+        {
+            SplitList(argument + 7, /*allowCommas*/false, IN OUT fontFamilies);
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/sizes:", 7) == 0)
+        {
+            SplitList(argument + 7, /*allowCommas*/true, IN OUT fontSizes);
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/text:", 6) == 0)
+        {
+            texts.push_back(argument + 6);
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/textfile:", 10) == 0)
+        {
+            if (FAILED(ReadTextFile(argument + 10, OUT text)))
+            {
+                WriteConsoleLine(u"Could not read text file: %s", argument + 10);
+                LocalFree(arguments);
+                return 1;
+            }
+            texts.push_back(text);
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/dwrite:", 8) == 0)
+        {
+            dwriteDllPath = argument + 8;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/out:", 5) == 0)
+        {
+            outputFilePath = argument + 5;
+        }
+        else if (argument[0] == '/')
+        {
+            WriteConsoleLine(u"Unknown command line option: %s", argument);
+            LocalFree(arguments);
+            return 1;
+        }
+        else
+        {
+            settingsFilePaths.push_back(argument);
+        }
+    }
+    LocalFree(arguments);
+
+    ////////////////////
+    // Build the list of objects to benchmark.
+
+    std::vector<DrawableObjectAndValues> drawableObjects;
+    for (auto const& settingsFilePath : settingsFilePaths)
+    {
+        HRESULT hr = LoadSettingsFile(settingsFilePath.c_str(), IN OUT drawableObjects);
+        if (FAILED(hr))
+        {
+            WriteConsoleLine(u"Failed 0x%08X: %s", hr, settingsFilePath.c_str());
+            return 1;
+        }
+    }
+
+    if (settingsFilePaths.empty())
+    {
+        if (functions.empty())
+        {
+            for (auto const& function : DrawableObject::functions)
+            {
+                if (function.integerValue != DrawableObjectFunctionNop)
+                    functions.push_back(function.name);
+            }
+        }
+        if (fontFamilies.empty()) fontFamilies.push_back(u"Segoe UI");
+        if (fontSizes.empty())    fontSizes.push_back(u"18");
+        if (texts.empty())        texts.push_back(g_defaultBenchmarkText);
+
+        for (auto const& function : functions)
+        {
+            for (auto const& fontFamily : fontFamilies)
+            {
+                for (auto const& fontSize : fontSizes)
+                {
+                    for (auto const& benchmarkText : texts)
+                    {
+                        drawableObjects.emplace_back();
+                        auto& drawableObject = drawableObjects.back();
+                        drawableObject.Set(DrawableObjectAttributeFunction, function.c_str());
+                        drawableObject.Set(DrawableObjectAttributeFontFamily, fontFamily.c_str());
+                        drawableObject.Set(DrawableObjectAttributeFontSize, fontSize.c_str());
+                        drawableObject.Set(DrawableObjectAttributeText, benchmarkText.c_str());
+                    }
+                }
+            }
+        }
+    }
+
+    ////////////////////
+    // Prepare a canvas, optionally with a specific DWrite DLL.
+
+    ComPtr<DrawingCanvas> drawingCanvas(new DrawingCanvas());
+    HMODULE dwriteModule = nullptr;
+    if (!dwriteDllPath.empty())
+    {
+        ComPtr<IDWriteFactory> dwriteFactory;
+        HRESULT hr = LoadDWrite(ToWChar(dwriteDllPath.c_str()), DWRITE_FACTORY_TYPE_SHARED, OUT &dwriteFactory, OUT dwriteModule);
+        if (FAILED(hr))
+        {
+            WriteConsoleLine(u"Could not load DWrite 0x%08X: %s", hr, dwriteDllPath.c_str());
+            return 1;
+        }
+        drawingCanvas->SetDWriteFactory(dwriteFactory);
+    }
+
+    ////////////////////
+    // Run them all serially, since parallel runs would skew the timings.
+
+    std::vector<BenchmarkResult> results(drawableObjects.size());
+    for (size_t i = 0, count = drawableObjects.size(); i < count; ++i)
+    {
+        auto& result = results[i];
+        HRESULT hr = BenchmarkDrawableObject(drawableObjects[i], *drawingCanvas, iterations, OUT result);
+        result.hr = hr;
+        WriteConsoleLine(
+            u"%s, %s, %g: draw p50 %.4f ms, p99 %.4f ms, %.0f layouts/s, %.0f code units/s",
+            result.function.c_str(),
+            result.fontFamily.c_str(),
+            result.fontSize,
+            result.drawMilliseconds50,
+            result.drawMilliseconds99,
+            result.layoutsPerSecond,
+            result.codeUnitsPerSecond
+            );
+    }
+
+    ////////////////////
+    // Write the report.
+
+    std::u16string report;
+    auto* extension = FindFileNameExtension(outputFilePath);
+    if (_wcsicmp(ToWChar(extension), L"json") == 0)
+    {
+        FormatResultsAsJson(results, OUT report);
+    }
+    else
+    {
+        FormatResultsAsCsv(results, OUT report);
+    }
+
+    int exitCode = 0;
+    if (outputFilePath.empty())
+    {
+        // A line at a time, rather than the whole report as one huge line.
+        size_t lineStart = 0;
+        while (lineStart < report.size())
+        {
+            size_t lineEnd = report.find(u"\r\n", lineStart);
+            if (lineEnd == std::u16string::npos)
+                lineEnd = report.size();
+            WriteConsoleLine(u"%s", report.substr(lineStart, lineEnd - lineStart).c_str());
+            lineStart = lineEnd + 2;
+        }
+    }
+    else if (FAILED(WriteTextFile(outputFilePath.c_str(), report)))
+    {
+        WriteConsoleLine(u"Could not write results: %s", outputFilePath.c_str());
+        exitCode = 1;
+    }
+
+    drawableObjects.clear();
+    drawingCanvas.Clear();
+    // The DWrite module is intentionally left loaded, since factory objects may
+    // outlive the canvas until process exit.
+
+    return exitCode;
+}
@@ -0,0 +1,59 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Microbenchmarks of the drawable object rendering APIs.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import Common.ArrayRef;
+import Common.String;
+import DrawingCanvas;
+import DrawableObjectAndValues;
+#else
+#include "Common.ArrayRef.h"
+#include "Common.String.h"
+#include "DrawingCanvas.h"
+#include "DrawableObjectAndValues.h"
+#endif
+
+
+struct BenchmarkResult
+{
+    std::u16string function;
+    std::u16string fontFamily;
+    float fontSize;
+    uint32_t textLength;        // UTF-16 code units.
+    uint32_t iterations;
+    double layoutsPerSecond;    // Cold object creation, layout, and measurement.
+    double codeUnitsPerSecond;  // Cold drawing of the laid out text, by text length rather than shaped glyphs.
+    double layoutMilliseconds50;
+    double drawMilliseconds50;
+    double drawMilliseconds90;
+    double drawMilliseconds99;
+    double warmDrawMilliseconds50; // Drawing again with all cached resources intact.
+    double totalMilliseconds50;
+    double totalMilliseconds90;
+    double totalMilliseconds99;
+    HRESULT hr;
+};
+
+// Benchmark one drawable object, whose attributes define the function, font,
+// size, and text. Each iteration recreates the object from its attributes,
+// arranges it, and draws it (cold), then draws it again (warm).
+HRESULT BenchmarkDrawableObject(
+    DrawableObjectAndValues& drawableObject,
+    DrawingCanvas& drawingCanvas,
+    uint32_t iterations,
+    _Out_ BenchmarkResult& result
+    );
+
+// Run the /benchmark command line, returning the process exit code.
+//
+//      /benchmark [/iterations:N] [/functions:A;B] [/fonts:A;B] [/sizes:12;18]
+//                 [/text:Some text] [/textfile:Corpus.txt] [/dwrite:DWrite.dll]
+//                 [/out:Results.csv|Results.json] [SomeFile.TextLayoutSamplerSettings ...]
+//
+// Without settings files, every function is run over the cross product of the
+// fonts, sizes, and texts. With settings files, their objects are run as is.
+int RunBenchmarkCommandLine(_In_z_ char16_t const* commandLine);
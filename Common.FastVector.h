@@ -33,7 +33,8 @@
 // (1) avoids heap allocations when the element count fits within the fixed-size capacity.
 // (2) avoids unnecessarily initializing elements if ShouldInitializeElements == false.
 //     This is useful for large buffers which will just be overwritten soon anyway.
-// (3) supports most vector methods except insert/erase/emplace.
+// (3) supports most vector methods, with insert/erase using memmove for trivially
+//     copyable types, and moves steal the heap buffer rather than copying.
 //
 // Template parameters:
 // - DefaultArraySize - passing 0 means it is solely heap allocated. Passing > 0
@@ -382,16 +383,29 @@ public:
 
     void push_back(const T& newValue)
     {
-        reserve(size_ + 1);// 
-        new(static_cast<void*>(data_ + size_)) T(newValue);
-        ++size_;
+        emplace_back(newValue);
     }
 
     void push_back(T&& newValue)
     {
-        reserve(size_ + 1);
-        new(static_cast<void*>(data_ + size_)) T(std::move(newValue));
-        ++size_;
+        emplace_back(std::move(newValue));
+    }
+
+    template <typename... ArgumentTypes>
+    T& emplace_back(ArgumentTypes&&... arguments)
+    {
+        if (size_ >= capacity_)
+        {
+            // Construct a copy first, since the argument may live in this vector.
+            T newValue(std::forward<ArgumentTypes>(arguments)...);
+            reserve_at_least(size_ + 1);
+            new(static_cast<void*>(data_ + size_)) T(std::move(newValue));
+        }
+        else
+        {
+            new(static_cast<void*>(data_ + size_)) T(std::forward<ArgumentTypes>(arguments)...);
+        }
+        return data_[size_++];
     }
 
     void append(array_ref<const T> span)
@@ -407,55 +421,90 @@ public:
     void insert(size_t insertionOffset, const_iterator begin, const_iterator end)
     {
         assert(insertionOffset <= size_);
+        assert(end < data_ || begin >= data_ + capacity_ || begin == end); // No self insertion, since growing would free it.
 
-        // Grow array size.
-        size_t newSize = std::distance(begin, end) + size_;
-        if (newSize < size_)
+        size_t const insertionCount = std::distance(begin, end);
+        iterator gap = make_gap(insertionOffset, insertionCount);
+        if (std::is_trivially_copyable<T>::value)
         {
-            throw std::bad_alloc();
+            memcpy(static_cast<void*>(gap), begin, insertionCount * sizeof(T));
         }
-        reserve_at_least(newSize);
-
-        // Add empty elements to the end.
-        size_t oldSize = size_;
-        if (ShouldInitializeElements)
+        else
         {
-            std::uninitialized_value_construct<iterator>(data_ + size_, data_ + newSize);
+            std::copy(begin, end, /*out*/ gap);
         }
-        size_ = newSize;
+    }
+
+    void insert(const_iterator position, array_ref<const T> span)
+    {
+        insert(position - data_, span.begin(), span.end());
+    }
 
-        // Shift elements to the end to make more room.
-        std::move_backward(data_ + insertionOffset, data_ + oldSize, data_ + newSize);
+    iterator insert(const_iterator position, const T& newValue)
+    {
+        return emplace(position, newValue);
+    }
 
-        std::copy(begin, end, /*out*/ data_ + insertionOffset);
+    iterator insert(const_iterator position, T&& newValue)
+    {
+        return emplace(position, std::move(newValue));
     }
 
-    void insert(const_iterator position, array_ref<const T> span)
+    template <typename... ArgumentTypes>
+    iterator emplace(const_iterator position, ArgumentTypes&&... arguments)
     {
-        insert(position - begin(), span.begin(), span.end());
+        assert(position >= data_ && position <= data_ + size_);
+
+        // Construct first, since the arguments may refer to elements which move.
+        T newValue(std::forward<ArgumentTypes>(arguments)...);
+        iterator gap = make_gap(position - data_, 1);
+        *gap = std::move(newValue);
+        return gap;
     }
 
-    void erase(const_iterator begin, const_iterator end)
+    iterator erase(const_iterator begin, const_iterator end)
     {
         assert(end >= begin);
         assert(begin >= data_);
         assert(end <= data_ + size_);
 
-        // Shift elements to front.
-        size_t oldSize = size_;
-        std::copy(iterator(end), data_ + size_, iterator(begin));
-        size_ -= std::distance(begin, end);
+        size_t const eraseOffset = begin - data_;
+        size_t const eraseCount = std::distance(begin, end);
+        size_t const oldSize = size_;
+        size_t const newSize = size_ - eraseCount;
 
-        // Destroy elements at the end.
-        if (ShouldInitializeElements)
+        if (std::is_trivially_copyable<T>::value)
         {
-            std::destroy(data_ + size_, data_ + oldSize);
+            // Slide the tail down in one move, with nothing to destroy.
+            memmove(static_cast<void*>(data_ + eraseOffset), data_ + eraseOffset + eraseCount, (oldSize - eraseOffset - eraseCount) * sizeof(T));
         }
+        else
+        {
+            // Shift elements to front, then destroy the vacated ones at the end.
+            std::move(data_ + eraseOffset + eraseCount, data_ + oldSize, /*out*/ data_ + eraseOffset);
+            if (ShouldInitializeElements)
+            {
+                std::destroy(data_ + newSize, data_ + oldSize);
+            }
+        }
+        size_ = newSize;
+
+        return data_ + eraseOffset;
     }
 
-    void erase(const_iterator position)
+    iterator erase(const_iterator position)
     {
-        erase(position, position + 1);
+        return erase(position, position + 1);
+    }
+
+    void pop_back()
+    {
+        assert(size_ > 0);
+        --size_;
+        if (ShouldInitializeElements)
+        {
+            std::destroy_at(data_ + size_);
+        }
     }
 
     // Returns underlying malloc()'d memory block.
@@ -531,6 +580,45 @@ public:
     }
 
 protected:
+    // Open a gap of elements at the offset, returning it. The gap elements are
+    // constructed (or just raw memory for trivially copyable types, which are
+    // relocated with memmove rather than moved one at a time).
+    iterator make_gap(size_t gapOffset, size_t gapCount)
+    {
+        size_t const oldSize = size_;
+        size_t const newSize = oldSize + gapCount;
+        if (newSize < oldSize)
+        {
+            throw std::bad_alloc();
+        }
+        if (newSize > capacity_)
+        {
+            reserve_at_least(newSize);
+        }
+
+        if (std::is_trivially_copyable<T>::value)
+        {
+            memmove(static_cast<void*>(data_ + gapOffset + gapCount), data_ + gapOffset, (oldSize - gapOffset) * sizeof(T));
+            size_ = newSize;
+        }
+        else
+        {
+            // Move the tail into the uninitialized end, and then shift the rest
+            // back, leaving moved-from (but constructed) elements in the gap.
+            size_t const tailCount = oldSize - gapOffset;
+            size_t const uninitializedCount = std::min(gapCount, tailCount);
+            std::uninitialized_move(FASTVECTOR_MAKE_UNCHECKED(data_) + oldSize - uninitializedCount, FASTVECTOR_MAKE_UNCHECKED(data_) + oldSize, /*out*/ FASTVECTOR_MAKE_UNCHECKED(data_) + newSize - uninitializedCount);
+            if (gapCount > tailCount)
+            {
+                std::uninitialized_value_construct<iterator>(data_ + oldSize, data_ + gapOffset + gapCount);
+            }
+            size_ = newSize;
+            std::move_backward(data_ + gapOffset, data_ + oldSize - uninitializedCount, data_ + newSize - uninitializedCount);
+        }
+
+        return data_ + gapOffset;
+    }
+
     void ReallocateMemory(size_t newByteSize) // Throws std::bad_alloc if low on memory, or if T's move constructor fails.
     {
         assert(newByteSize >= size_ * sizeof(T)); // Shouldn't have been called otherwise, because it's wrong for size_ to be less than actual memory.
@@ -768,6 +856,172 @@ private:
     std::aligned_storage_t<sizeof(T), alignof(T)> fixedSizedArrayData_[DefaultArraySize];
 };
 
+// scratch_arena is a per-thread stack of memory for temporary buffers in hot
+// paths like drawing and measuring, so that a steady state paint reaches the
+// heap zero times. Allocations are released in reverse order by the frame
+// that made them (see scratch_arena_frame and scratch_vector).
+//
+// The arena keeps a single block. A request which does not fit returns an
+// empty array, leaving the caller to fall back to the heap, but the arena
+// remembers the peak and grows to fit it once every frame has ended, so the
+// next time the same work fits.
+class scratch_arena
+{
+public:
+    scratch_arena() = default;
+    scratch_arena(scratch_arena const&) = delete;
+    scratch_arena& operator=(scratch_arena const&) = delete;
+
+    // Each thread has its own arena, so no locking is needed.
+    static scratch_arena& get_thread_arena() noexcept
+    {
+        thread_local scratch_arena arena;
+        return arena;
+    }
+
+    // Return uninitialized memory for the elements, valid until the enclosing
+    // frame ends, or empty if the block lacks room.
+    template <typename T>
+    array_ref<T> allocate(size_t elementCount) noexcept
+    {
+        if (elementCount > SIZE_MAX / sizeof(T))
+            return {};
+
+        void* memory = allocate_bytes(elementCount * sizeof(T), alignof(T));
+        return array_ref<T>(reinterpret_cast<T*>(memory), memory != nullptr ? elementCount : 0);
+    }
+
+    size_t get_position() const noexcept { return used_; }
+    size_t capacity() const noexcept { return capacity_; }
+
+    // Release everything allocated after the position.
+    void rewind(size_t position) noexcept
+    {
+        assert(position <= used_);
+        used_ = position;
+
+        // Nothing is outstanding, so the block can be safely replaced.
+        if (used_ == 0 && peak_ > capacity_)
+        {
+            grow(peak_);
+        }
+    }
+
+    // Free the block, such as after an unusually large burst of work.
+    void release() noexcept
+    {
+        assert(used_ == 0);
+        memory_.reset();
+        capacity_ = 0;
+        peak_ = 0;
+    }
+
+private:
+    void* allocate_bytes(size_t byteSize, size_t alignment) noexcept
+    {
+        size_t const alignedStart = (used_ + alignment - 1) & ~(alignment - 1);
+        size_t const end = alignedStart + byteSize;
+        if (end < alignedStart)
+            return nullptr; // Overflowed.
+
+        peak_ = std::max(peak_, end + alignment);
+        if (end > capacity_)
+            return nullptr;
+
+        used_ = end;
+        return memory_.get() + alignedStart;
+    }
+
+    void grow(size_t minimumCapacity) noexcept
+    {
+        size_t newCapacity = std::max(capacity_, minimumBlockSize);
+        while (newCapacity < minimumCapacity && newCapacity <= SIZE_MAX / 2)
+        {
+            newCapacity *= 2;
+        }
+
+        // The block is aligned for any standard type, and larger alignments
+        // are padded within it (included in the peak).
+        std::unique_ptr<uint8_t[]> newMemory(new(std::nothrow) uint8_t[newCapacity]);
+        if (newMemory == nullptr)
+        {
+            peak_ = capacity_; // Keep the old block and try no further.
+            return;
+        }
+        memory_ = std::move(newMemory);
+        capacity_ = newCapacity;
+    }
+
+    constexpr static size_t minimumBlockSize = 65536;
+
+    std::unique_ptr<uint8_t[]> memory_;
+    size_t capacity_ = 0;   // In bytes.
+    size_t used_ = 0;       // In bytes, the current top of the stack.
+    size_t peak_ = 0;       // Largest top requested since the block last grew.
+};
+
+
+// Restores the arena on scope exit, releasing whatever was allocated within.
+// Frames must end in reverse order, which locals guarantee.
+class scratch_arena_frame
+{
+public:
+    scratch_arena_frame() noexcept
+    :   scratch_arena_frame(scratch_arena::get_thread_arena())
+    {
+    }
+
+    explicit scratch_arena_frame(scratch_arena& arena) noexcept
+    :   arena_(arena),
+        position_(arena.get_position())
+    {
+    }
+
+    scratch_arena_frame(scratch_arena_frame const&) = delete;
+    scratch_arena_frame& operator=(scratch_arena_frame const&) = delete;
+
+    ~scratch_arena_frame() noexcept
+    {
+        arena_.rewind(position_);
+    }
+
+    scratch_arena& arena() const noexcept { return arena_; }
+
+private:
+    scratch_arena& arena_;
+    size_t position_;
+};
+
+
+// A fast_vector whose initial capacity comes from the thread's scratch arena,
+// falling over to the heap like any fast_vector if it grows beyond that. It
+// is its own frame, so it can only be a local, never moved, member, or shared
+// with other threads beyond its lifetime.
+//
+// Example:
+//  scratch_vector<float, false> advances(glyphCount); // Uninitialized.
+template <typename T, bool ShouldInitializeElements = true>
+class scratch_vector : private scratch_arena_frame, public fast_vector<T, 0, ShouldInitializeElements>
+{
+public:
+    using BaseClass = fast_vector<T, 0, ShouldInitializeElements>;
+
+    explicit scratch_vector(size_t initialSize)
+    :   scratch_arena_frame(),
+        BaseClass(fast_vector_use_memory_buffer, arena().template allocate<T>(initialSize), initialSize)
+    {
+    }
+
+    scratch_vector(scratch_arena& arena, size_t initialSize)
+    :   scratch_arena_frame(arena),
+        BaseClass(fast_vector_use_memory_buffer, arena.template allocate<T>(initialSize), initialSize)
+    {
+    }
+
+    scratch_vector(scratch_vector const&) = delete;
+    scratch_vector& operator=(scratch_vector const&) = delete;
+};
+
 #ifdef USE_GSL_SPAN_INSTEAD_OF_ARRAY_REF
 #undef array_ref
 #endif
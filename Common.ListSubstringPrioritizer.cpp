@@ -4,6 +4,7 @@
 #include "precomp.h"
 #include <vector>
 #include <string>
+#include <array>
 
 
 MODULE(Common.ListSubstringPrioritizer)
@@ -31,6 +32,11 @@ ListSubstringPrioritizer::ListSubstringPrioritizer(
 }
 
 
+ListSubstringPrioritizer::ListSubstringPrioritizer()
+{
+}
+
+
 ListSubstringPrioritizer::WeightValue ListSubstringPrioritizer::GetStringWeight(array_ref<char16_t const> name)
 {
     // Early out if there is no filter.
@@ -43,20 +49,31 @@ ListSubstringPrioritizer::WeightValue ListSubstringPrioritizer::GetStringWeight(
     majusculeName_.assign(name.data(), name.size());
     ToUpperCase(IN OUT majusculeName_);
 
-    size_t minStringSize = std::min(majusculeName_.size(), filterString_.size());
+    return GetFoldedStringWeight(majusculeName_);
+}
+
 
-    if (wcsncmp(ToWChar(majusculeName_.c_str()), ToWChar(filterString_.c_str()), minStringSize) == 0)
+ListSubstringPrioritizer::WeightValue ListSubstringPrioritizer::GetFoldedStringWeight(array_ref<char16_t const> majusculeName) const
+{
+    if (filterString_.empty())
+    {
+        return IndexAndWeight::WeightValueStringPrefix;
+    }
+
+    size_t minStringSize = std::min(majusculeName.size(), filterString_.size());
+
+    if (std::equal(majusculeName.begin(), majusculeName.begin() + minStringSize, filterString_.begin()))
     {
         // Prefix matching has priority.
         return IndexAndWeight::WeightValueStringPrefix;
     }
     else
     {
-        auto searchIndex = majusculeName_.find(filterString_);
-        if (searchIndex != std::u16string::npos)
+        auto match = std::search(majusculeName.begin(), majusculeName.end(), filterString_.begin(), filterString_.end());
+        if (match != majusculeName.end())
         {
             // Substrings have next priority.
-            bool beginsWord = (searchIndex == 0 || majusculeName_[searchIndex - 1] == ' ');
+            bool beginsWord = (match == majusculeName.begin() || match[-1] == ' ');
             return beginsWord ? IndexAndWeight::WeightValueWordPrefix : IndexAndWeight::WeightValueSubstring;
         }
     }
@@ -76,19 +93,89 @@ void ListSubstringPrioritizer::SetItemWeight(uint32_t itemIndex, WeightValue wei
 array_ref<uint32_t> ListSubstringPrioritizer::GetItemIndices(_Out_ array_ref<uint32_t> items, bool excludeMismatches)
 {
     // Copy the array indices out after ordering them best to worst.
-    std::stable_sort(items_.begin(), items_.end());
+    // There are only a few weights, so count them rather than sort, only
+    // placing as many items as the output holds.
+    std::array<size_t, IndexAndWeight::WeightValueNoMatch + 1> weightOffsets = {};
+    for (auto& item : items_)
+    {
+        ++weightOffsets[item.weight];
+    }
+
+    size_t totalItemCount = excludeMismatches ? items_.size() - weightOffsets[IndexAndWeight::WeightValueNoMatch] : items_.size();
+    size_t itemCount = std::min(items.size(), totalItemCount);
 
-    size_t i = 0;
-    size_t itemCount = std::min(items.size(), items_.size());
+    size_t offset = 0;
+    for (auto& weightOffset : weightOffsets)
+    {
+        size_t weightCount = weightOffset;
+        weightOffset = offset;
+        offset += weightCount;
+    }
 
-    for (i = 0; i < itemCount; ++i)
+    for (auto& item : items_)
     {
-        auto& item = items_[i];
-        if (excludeMismatches && item.weight >= IndexAndWeight::WeightValueNoMatch)
-            break;
+        size_t& weightOffset = weightOffsets[item.weight];
+        if (weightOffset < itemCount)
+        {
+            items[weightOffset] = item.index;
+        }
+        ++weightOffset;
+    }
 
-        items[i] = item.index;
+    return array_ref<uint32_t>(items.data(), itemCount);
+}
+
+
+void ListSubstringPrioritizer::InvalidateFilter()
+{
+    isFilterValid_ = false;
+    filterString_.clear();
+    matchingItemIndices_.clear();
+}
+
+
+array_ref<uint32_t> ListSubstringPrioritizer::Filter(
+    array_ref<char16_t const> filterString,
+    _Out_ array_ref<uint32_t> items,
+    bool excludeMismatches
+    )
+{
+    std::u16string newFilterString(filterString.data(), filterString.size());
+    ToUpperCase(IN OUT newFilterString);
+
+    // Narrow the previous matches if the filter only grew, else start over.
+    bool const canNarrow = isFilterValid_
+                        && newFilterString.size() >= filterString_.size()
+                        && newFilterString.compare(0, filterString_.size(), filterString_) == 0;
+    uint32_t const itemCount = static_cast<uint32_t>(items_.size());
+    if (!canNarrow)
+    {
+        matchingItemIndices_.resize(itemCount);
+        std::iota(matchingItemIndices_.begin(), matchingItemIndices_.end(), 0);
+    }
+    filterString_ = std::move(newFilterString);
+    isFilterValid_ = true;
+
+    for (auto& item : items_)
+    {
+        item.weight = IndexAndWeight::WeightValueNoMatch;
+    }
+
+    size_t matchingItemCount = 0;
+    for (uint32_t itemIndex : matchingItemIndices_)
+    {
+        array_ref<char16_t const> majusculeName(
+            foldedNames_.data() + foldedNameOffsets_[itemIndex],
+            foldedNames_.data() + foldedNameOffsets_[itemIndex + 1]
+            );
+        auto weight = GetFoldedStringWeight(majusculeName);
+        items_[itemIndex].weight = weight;
+        if (weight != IndexAndWeight::WeightValueNoMatch)
+        {
+            matchingItemIndices_[matchingItemCount++] = itemIndex;
+        }
     }
+    matchingItemIndices_.resize(matchingItemCount);
 
-    return array_ref<uint32_t>(items.data(), i);
+    return GetItemIndices(OUT items, excludeMismatches);
 }
@@ -37,6 +37,8 @@ class ListSubstringPrioritizer
 public:
     using WeightValue = IndexAndWeight::WeightValue;
 
+    // One shot use: construct with the filter, weigh each item by name, and
+    // then read them back ordered.
     ListSubstringPrioritizer(
         array_ref<char16_t const> filterString,
         uint32_t itemCount
@@ -46,8 +48,58 @@ public:
     void SetItemWeight(uint32_t itemIndex, WeightValue weight);
     array_ref<uint32_t> GetItemIndices(_Out_ array_ref<uint32_t> items, bool excludeMismatches);
 
+    // Incremental use, for refiltering the same names on each keystroke:
+    // set the names once, which are case folded just then, and call Filter
+    // for each new filter string. If the filter extends the previous one,
+    // only the previous matches are weighed again, since anything that did
+    // not match cannot match a longer filter either.
+    ListSubstringPrioritizer();
+
+    template <typename GetNameFunction> // array_ref<char16_t const> GetName(uint32_t itemIndex)
+    void SetNames(uint32_t itemCount, GetNameFunction getName)
+    {
+        foldedNames_.clear();
+        foldedNameOffsets_.resize(itemCount + 1);
+        for (uint32_t itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+        {
+            array_ref<char16_t const> name = getName(itemIndex);
+            foldedNameOffsets_[itemIndex] = static_cast<uint32_t>(foldedNames_.size());
+            foldedNames_.append(name.data(), name.size());
+        }
+        foldedNameOffsets_[itemCount] = static_cast<uint32_t>(foldedNames_.size());
+        ToUpperCase(IN OUT foldedNames_);
+
+        items_.resize(itemCount);
+        for (uint32_t itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+        {
+            items_[itemIndex].index = itemIndex;
+        }
+        InvalidateFilter();
+    }
+
+    // Return the item indices ordered best match first, only as many as fit.
+    // Ties keep their original order.
+    array_ref<uint32_t> Filter(
+        array_ref<char16_t const> filterString,
+        _Out_ array_ref<uint32_t> items,
+        bool excludeMismatches
+        );
+
+    uint32_t GetItemCount() const noexcept { return static_cast<uint32_t>(items_.size()); }
+
+private:
+    WeightValue GetFoldedStringWeight(array_ref<char16_t const> majusculeName) const;
+    void InvalidateFilter();
+
 private:
     std::vector<IndexAndWeight> items_;
     std::u16string filterString_;
     std::u16string majusculeName_;
+
+    // Incremental state. Names are stored end to end, each item's name
+    // spanning foldedNameOffsets_[i] to foldedNameOffsets_[i + 1].
+    std::u16string foldedNames_;
+    std::vector<uint32_t> foldedNameOffsets_;
+    std::vector<uint32_t> matchingItemIndices_; // Items matching filterString_, in index order.
+    bool isFilterValid_ = false;
 };
@@ -12,7 +12,7 @@ template <typename T>
 class optional_value
 {
 public:
-    bool has_value() { return valueExists_; }
+    bool has_value() const { return valueExists_; }
     T& value() { return *reinterpret_cast<T*>(t_); }
     T const& value() const { return *reinterpret_cast<T const*>(t_); }
 
@@ -78,7 +78,7 @@ public:
 
     // Container compatible helpers to accomodate generic template algorithms,
     // treating std::optional like an std::vecto of size 0 or 1.
-    bool empty() { return !valueExists_; }
+    bool empty() const { return !valueExists_; }
     T* data() { return &value(); }
     T const* data() const { return &value(); }
     void clear() { reset(); }
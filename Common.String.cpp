@@ -5,6 +5,14 @@
 //----------------------------------------------------------------------------
 #include "precomp.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <intrin.h>
+#include <emmintrin.h>
+#define STRING_TRANSCODE_SSE2 1
+#else
+#define STRING_TRANSCODE_SSE2 0
+#endif
+
 MODULE(Common.String)
 EXPORT_BEGIN
     #include "Common.String.h"
@@ -231,6 +239,129 @@ void ToUpperCase(_Inout_ array_ref<char16_t> s)
 }
 
 
+namespace
+{
+    // Return the index of the first occurrence of ch, or the size if absent.
+    // Escape-free text is skipped eight code units at a time.
+    size_t FindCodeUnit(array_ref<char16_t const> text, char16_t ch) noexcept
+    {
+        char16_t const* source = text.data();
+        size_t const count = text.size();
+        size_t i = 0;
+#if STRING_TRANSCODE_SSE2
+        __m128i const pattern = _mm_set1_epi16(short(ch));
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i const units = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+            int const matchMask = _mm_movemask_epi8(_mm_cmpeq_epi16(units, pattern));
+            if (matchMask != 0)
+            {
+                unsigned long matchByteIndex;
+                _BitScanForward(OUT &matchByteIndex, matchMask);
+                return i + matchByteIndex / 2;
+            }
+        }
+#endif
+        for (; i < count && source[i] != ch; ++i)
+        { }
+        return i;
+    }
+
+
+    void AppendCodePoint(IN OUT std::u16string& text, char32_t ch)
+    {
+        if (IsCharacterBeyondBmp(ch))
+        {
+            text.push_back(GetLeadingSurrogate(ch));
+            text.push_back(GetTrailingSurrogate(ch));
+        }
+        else
+        {
+            text.push_back(char16_t(ch));
+        }
+    }
+
+
+    struct HtmlNamedCharacterReference
+    {
+        char name[7];
+        char32_t codePoint;
+    };
+
+    // The HTML 4 entities, sorted by ordinal name for binary search.
+    const static HtmlNamedCharacterReference g_htmlNamedCharacterReferences[] =
+    {
+        {"AElig",0x00C6}, {"Aacute",0x00C1}, {"Acirc",0x00C2}, {"Agrave",0x00C0}, {"Aring",0x00C5}, {"Atilde",0x00C3},
+        {"Auml",0x00C4}, {"Ccedil",0x00C7}, {"Dagger",0x2021}, {"ETH",0x00D0}, {"Eacute",0x00C9}, {"Ecirc",0x00CA},
+        {"Egrave",0x00C8}, {"Euml",0x00CB}, {"Iacute",0x00CD}, {"Icirc",0x00CE}, {"Igrave",0x00CC}, {"Iuml",0x00CF},
+        {"Ntilde",0x00D1}, {"OElig",0x0152}, {"Oacute",0x00D3}, {"Ocirc",0x00D4}, {"Ograve",0x00D2}, {"Oslash",0x00D8},
+        {"Otilde",0x00D5}, {"Ouml",0x00D6}, {"Prime",0x2033}, {"Scaron",0x0160}, {"THORN",0x00DE}, {"Uacute",0x00DA},
+        {"Ucirc",0x00DB}, {"Ugrave",0x00D9}, {"Uuml",0x00DC}, {"Yacute",0x00DD}, {"Yuml",0x0178}, {"aacute",0x00E1},
+        {"acirc",0x00E2}, {"acute",0x00B4}, {"aelig",0x00E6}, {"agrave",0x00E0}, {"amp",0x0026}, {"apos",0x0027},
+        {"aring",0x00E5}, {"atilde",0x00E3}, {"auml",0x00E4}, {"bdquo",0x201E}, {"brvbar",0x00A6}, {"bull",0x2022},
+        {"ccedil",0x00E7}, {"cedil",0x00B8}, {"cent",0x00A2}, {"circ",0x02C6}, {"copy",0x00A9}, {"curren",0x00A4},
+        {"dagger",0x2020}, {"darr",0x2193}, {"deg",0x00B0}, {"divide",0x00F7}, {"eacute",0x00E9}, {"ecirc",0x00EA},
+        {"egrave",0x00E8}, {"emsp",0x2003}, {"ensp",0x2002}, {"eth",0x00F0}, {"euml",0x00EB}, {"euro",0x20AC},
+        {"fnof",0x0192}, {"frac12",0x00BD}, {"frac14",0x00BC}, {"frac34",0x00BE}, {"frasl",0x2044}, {"ge",0x2265},
+        {"gt",0x003E}, {"harr",0x2194}, {"hellip",0x2026}, {"iacute",0x00ED}, {"icirc",0x00EE}, {"iexcl",0x00A1},
+        {"igrave",0x00EC}, {"infin",0x221E}, {"iquest",0x00BF}, {"iuml",0x00EF}, {"laquo",0x00AB}, {"larr",0x2190},
+        {"ldquo",0x201C}, {"le",0x2264}, {"loz",0x25CA}, {"lrm",0x200E}, {"lsaquo",0x2039}, {"lsquo",0x2018},
+        {"lt",0x003C}, {"macr",0x00AF}, {"mdash",0x2014}, {"micro",0x00B5}, {"middot",0x00B7}, {"minus",0x2212},
+        {"nbsp",0x00A0}, {"ndash",0x2013}, {"ne",0x2260}, {"not",0x00AC}, {"ntilde",0x00F1}, {"oacute",0x00F3},
+        {"ocirc",0x00F4}, {"oelig",0x0153}, {"ograve",0x00F2}, {"oline",0x203E}, {"ordf",0x00AA}, {"ordm",0x00BA},
+        {"oslash",0x00F8}, {"otilde",0x00F5}, {"ouml",0x00F6}, {"para",0x00B6}, {"permil",0x2030}, {"plusmn",0x00B1},
+        {"pound",0x00A3}, {"prime",0x2032}, {"quot",0x0022}, {"raquo",0x00BB}, {"rarr",0x2192}, {"rdquo",0x201D},
+        {"reg",0x00AE}, {"rlm",0x200F}, {"rsaquo",0x203A}, {"rsquo",0x2019}, {"sbquo",0x201A}, {"scaron",0x0161},
+        {"sect",0x00A7}, {"shy",0x00AD}, {"sup1",0x00B9}, {"sup2",0x00B2}, {"sup3",0x00B3}, {"szlig",0x00DF},
+        {"thinsp",0x2009}, {"thorn",0x00FE}, {"tilde",0x02DC}, {"times",0x00D7}, {"trade",0x2122}, {"uacute",0x00FA},
+        {"uarr",0x2191}, {"ucirc",0x00FB}, {"ugrave",0x00F9}, {"uml",0x00A8}, {"uuml",0x00FC}, {"yacute",0x00FD},
+        {"yen",0x00A5}, {"yuml",0x00FF}, {"zwj",0x200D}, {"zwnj",0x200C},
+    };
+
+    constexpr size_t g_htmlNamedCharacterReferenceMaxLength = 6;
+
+
+    int CompareHtmlReferenceName(char const* name, array_ref<char16_t const> otherName) noexcept
+    {
+        size_t i = 0;
+        for (; i < otherName.size(); ++i)
+        {
+            char16_t const ch = char16_t(uint8_t(name[i]));
+            if (ch != otherName[i])
+                return (ch < otherName[i]) ? -1 : 1;
+        }
+        return (name[i] != 0) ? 1 : 0;
+    }
+
+
+    // Return the code point for the given name (without '&' and ';'), or 0 if unknown.
+    char32_t LookUpHtmlNamedCharacterReference(array_ref<char16_t const> name) noexcept
+    {
+        auto const* references = std::begin(g_htmlNamedCharacterReferences);
+        auto const* referencesEnd = std::end(g_htmlNamedCharacterReferences);
+        auto const* match = std::lower_bound(
+            references,
+            referencesEnd,
+            name,
+            [](HtmlNamedCharacterReference const& reference, array_ref<char16_t const> name) noexcept -> bool
+            {
+                return CompareHtmlReferenceName(reference.name, name) < 0;
+            }
+        );
+        if (match == referencesEnd || CompareHtmlReferenceName(match->name, name) != 0)
+            return 0;
+
+        return match->codePoint;
+    }
+
+
+    inline bool IsAsciiAlphanumeric(char16_t ch) noexcept
+    {
+        return (ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
+    }
+}
+
+
 void UnescapeCppUniversalCharacterNames(
     array_ref<char16_t const> escapedText,
     OUT std::u16string& expandedText
@@ -241,11 +372,17 @@ void UnescapeCppUniversalCharacterNames(
 
     while (!escapedText.empty())
     {
-        char16_t ch = escapedText.front();
-        escapedText.pop_front();
+        // Append the run of ordinary code units before the next escape.
+        size_t const runLength = FindCodeUnit(escapedText, '\\');
+        expandedText.append(escapedText.data(), runLength);
+        escapedText.remove_prefix(runLength);
+        if (escapedText.empty())
+            break;
+
+        escapedText.pop_front(); // Skip the '\\'.
 
         // Check escape codes.
-        if (ch == '\\' && !escapedText.empty())
+        if (!escapedText.empty())
         {
             char32_t replacement = L'\\';
             char16_t code = escapedText.front();
@@ -290,19 +427,11 @@ void UnescapeCppUniversalCharacterNames(
             // Silly octal is not supported.
             }
 
-            if (IsCharacterBeyondBmp(replacement))
-            {
-                expandedText.push_back(GetLeadingSurrogate(replacement));
-                expandedText.push_back(GetTrailingSurrogate(replacement));
-            }
-            else
-            {
-                expandedText.push_back(char16_t(replacement));
-            }
+            AppendCodePoint(IN OUT expandedText, replacement);
         }
-        else // Just append ordinary code unit.
+        else // Trailing backslash.
         {
-            expandedText.push_back(ch);
+            expandedText.push_back('\\');
         }
     }
 }
@@ -315,58 +444,146 @@ void UnescapeHtmlNamedCharacterReferences(array_ref<char16_t const> escapedText,
 
     while (!escapedText.empty())
     {
-        char16_t ch = escapedText.front();
-        escapedText.pop_front();
+        // Append the run of ordinary code units before the next reference.
+        size_t const runLength = FindCodeUnit(escapedText, '&');
+        expandedText.append(escapedText.data(), runLength);
+        escapedText.remove_prefix(runLength);
+        if (escapedText.empty())
+            break;
 
-        // Check escape codes.
-        if (ch == '&' && !escapedText.empty())
-        {
-            char32_t replacement = L'&';
-            char16_t const* escapeStart = escapedText.data();
-            char16_t const* escapeEnd = escapeStart;
+        escapedText.pop_front(); // Skip the '&'.
+
+        // On any parse error, just the '&' is kept to preserve original text.
+        char32_t replacement = L'&';
 
-            // Only numeric escapes are supported: &#1234;&#x1A2B;
-            // Not named ones: &amp;
-            if (*escapeStart == '#')
+        if (!escapedText.empty() && escapedText.front() == '#')
+        {
+            // Numeric references: &#1234;&#x1A2B;
+            char16_t const* escapeStart = escapedText.data() + 1;
+            uint32_t radix = 10; // Assume decimal, unless 'x' follows.
+            if (escapeStart < escapedText.data_end() && *escapeStart == 'x')
             {
-                uint32_t radix = 10; // Assume decimal, unless 'x' follows.
+                radix = 16; // Hexadecimal.
                 ++escapeStart;
-                if (escapeStart < escapedText.data_end() && *escapeStart == 'x')
-                {
-                    radix = 16; // Hexadecimal.
-                    ++escapeStart;
-                }
+            }
 
-                // Parse the number, and replacing on error with just a '\' to preserve original text.
-                array_ref<char16_t const> digitSpan = {escapeStart, escapedText.end()};
-                replacement = ReadUnsignedNumericValue(IN OUT digitSpan, radix);
+            array_ref<char16_t const> digitSpan = {escapeStart, escapedText.end()};
+            char32_t numericValue = ReadUnsignedNumericValue(IN OUT digitSpan, radix);
 
-                // Successful if the digits were not empty and a semicolon was present.
-                if (digitSpan.begin() > escapedText.begin() && !digitSpan.empty() && digitSpan.front() == ';')
-                {
-                    escapedText.reset(digitSpan.begin() + 1, escapedText.end()); // After the semicolon.
-                }
-                else // Parse error. So restore '\' to preserve original text.
-                {
-                    replacement = L'\\';
-                }
+            // Successful if the digits were not empty and a semicolon was present.
+            if (digitSpan.begin() > escapeStart && !digitSpan.empty() && digitSpan.front() == ';')
+            {
+                replacement = numericValue;
+                escapedText.reset(digitSpan.begin() + 1, escapedText.end()); // After the semicolon.
             }
-
-            if (IsCharacterBeyondBmp(replacement))
+        }
+        else
+        {
+            // Named references: &amp;&nbsp;
+            size_t const nameLimit = std::min(escapedText.size(), g_htmlNamedCharacterReferenceMaxLength + 1);
+            size_t nameLength = 0;
+            while (nameLength < nameLimit && IsAsciiAlphanumeric(escapedText[nameLength]))
             {
-                expandedText.push_back(GetLeadingSurrogate(replacement));
-                expandedText.push_back(GetTrailingSurrogate(replacement));
+                ++nameLength;
             }
-            else
+
+            if (nameLength > 0 && nameLength < escapedText.size() && escapedText[nameLength] == ';')
             {
-                expandedText.push_back(char16_t(replacement));
+                char32_t codePoint = LookUpHtmlNamedCharacterReference({escapedText.data(), escapedText.data() + nameLength});
+                if (codePoint != 0)
+                {
+                    replacement = codePoint;
+                    escapedText.remove_prefix(nameLength + 1); // After the semicolon.
+                }
             }
         }
-        else // Just append ordinary code unit.
+
+        AppendCodePoint(IN OUT expandedText, replacement);
+    }
+}
+
+
+void IncrementalUnescaper::clear()
+{
+    unescapeFunction_ = nullptr;
+    escapedText_.clear();
+    unescapedText_.clear();
+    lineOffsets_.clear();
+}
+
+
+std::u16string const& IncrementalUnescaper::Update(
+    array_ref<char16_t const> escapedText,
+    UnescapeFunction unescapeFunction
+    )
+{
+    if (unescapeFunction != unescapeFunction_ || lineOffsets_.empty())
+    {
+        clear();
+        unescapeFunction_ = unescapeFunction;
+        lineOffsets_.push_back({0,0});
+    }
+
+    // Find the edited range as the part between the common prefix and suffix.
+    size_t const oldSize = escapedText_.size();
+    size_t const newSize = escapedText.size();
+    size_t const minSize = std::min(oldSize, newSize);
+    size_t prefixLength = 0;
+    while (prefixLength < minSize && escapedText_[prefixLength] == escapedText[prefixLength])
+    {
+        ++prefixLength;
+    }
+    size_t suffixLength = 0;
+    while (suffixLength < minSize - prefixLength && escapedText_[oldSize - 1 - suffixLength] == escapedText[newSize - 1 - suffixLength])
+    {
+        ++suffixLength;
+    }
+    if (prefixLength == oldSize && oldSize == newSize)
+        return unescapedText_; // Unchanged.
+
+    // Widen the edited range to whole lines. The first line is the one containing
+    // the prefix end, and the first line after starts after an unchanged line feed.
+    size_t const oldEditEnd = oldSize - suffixLength;
+    auto compareOffset = [](size_t offset, LineOffset const& lineOffset) noexcept -> bool { return offset < lineOffset.escapedOffset; };
+    size_t const firstLine = std::upper_bound(lineOffsets_.begin(), lineOffsets_.end(), prefixLength, compareOffset) - lineOffsets_.begin() - 1;
+    size_t const endLine   = std::upper_bound(lineOffsets_.begin(), lineOffsets_.end(), oldEditEnd,   compareOffset) - lineOffsets_.begin();
+
+    LineOffset const lineStart = lineOffsets_[firstLine];
+    LineOffset const oldLineEnd = (endLine < lineOffsets_.size()) ? lineOffsets_[endLine] : LineOffset{oldSize, unescapedText_.size()};
+    size_t const newLineEndEscapedOffset = oldLineEnd.escapedOffset + newSize - oldSize;
+
+    // Unescape just those lines of the new text.
+    std::u16string unescapedLines;
+    std::u16string unescapedLine;
+    std::vector<LineOffset> newLineOffsets;
+    for (size_t offset = lineStart.escapedOffset; offset < newLineEndEscapedOffset; )
+    {
+        auto remainingText = escapedText.get_slice(offset, newLineEndEscapedOffset);
+        size_t const lineLength = std::min(FindCodeUnit(remainingText, '\n') + 1, remainingText.size());
+        unescapeFunction_(remainingText.get_slice(0, lineLength), OUT unescapedLine);
+        unescapedLines += unescapedLine;
+        offset += lineLength;
+
+        if (offset < newLineEndEscapedOffset)
         {
-            expandedText.push_back(ch);
+            newLineOffsets.push_back({offset, lineStart.unescapedOffset + unescapedLines.size()});
         }
     }
+
+    // Splice the lines in, and shift the offsets of all lines after them.
+    size_t const oldUnescapedLinesLength = oldLineEnd.unescapedOffset - lineStart.unescapedOffset;
+    for (size_t i = endLine, lineCount = lineOffsets_.size(); i < lineCount; ++i)
+    {
+        lineOffsets_[i].escapedOffset += newSize - oldSize;
+        lineOffsets_[i].unescapedOffset += unescapedLines.size() - oldUnescapedLinesLength;
+    }
+    lineOffsets_.erase(lineOffsets_.begin() + firstLine + 1, lineOffsets_.begin() + endLine);
+    lineOffsets_.insert(lineOffsets_.begin() + firstLine + 1, newLineOffsets.begin(), newLineOffsets.end());
+
+    unescapedText_.replace(lineStart.unescapedOffset, oldUnescapedLinesLength, unescapedLines);
+    escapedText_.assign(escapedText.data(), escapedText.size());
+
+    return unescapedText_;
 }
 
 
@@ -441,64 +658,209 @@ void EscapeHtmlNamedCharacterReferences(
 }
 
 
-_Out_range_(0, utf32text.end_ - utf32text.begin_)
-size_t ConvertTextUtf16ToUtf32(
-    array_ref<char16_t const> utf16text,
-    OUT array_ref<char32_t> utf32text,
-    _Out_opt_ size_t* sourceCount
-    ) noexcept
+namespace
 {
-    // Convert all code points, substituting the replacement character for unpaired surrogates.
+    ////////////////////
+    // Transcoding kernels. Runs of ASCII (or BMP characters without
+    // surrogates) are converted a vector at a time, and only the remaining
+    // code units take the per code unit path. SSE2 is always present on x64
+    // and in the default x86 build, so there is no runtime dispatch.
+
+    // Copy the leading run of ASCII bytes to UTF-16, returning how many.
+    size_t WidenAsciiRun(_In_reads_(count) char const* source, size_t count, _Out_writes_(count) char16_t* dest) noexcept
+    {
+        size_t i = 0;
+#if STRING_TRANSCODE_SSE2
+        __m128i const zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+                break; // A byte >= 0x80 is part of a multibyte sequence.
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 0), _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+#endif
+        for (; i < count && uint8_t(source[i]) < 0x80; ++i)
+        {
+            dest[i] = source[i];
+        }
+        return i;
+    }
 
-    UnicodeCharacterReader reader(utf16text.data(), utf16text.data_end());
-    size_t utf32count = utf32text.size();
-    size_t utf32index = 0;
 
-    for (; !reader.IsAtEnd() && utf32index < utf32count; ++utf32index)
+    // Return the end of the non-ASCII stretch starting at begin, which is the
+    // start of the next block of ASCII long enough to be worth switching back
+    // for. Since ASCII bytes are never part of a sequence, the stretch can be
+    // passed to the OS converter alone with the same result as the whole.
+    size_t FindAsciiBlock(_In_reads_(count) char const* source, size_t begin, size_t count) noexcept
     {
-        char32_t ch = reader.ReadNext();
+        size_t i = begin;
+#if STRING_TRANSCODE_SSE2
+        while (i + 16 <= count)
+        {
+            int const mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i)));
+            if (mask == 0)
+                return i;
+
+            unsigned long lastNonAsciiIndex;
+            _BitScanReverse(OUT &lastNonAsciiIndex, mask);
+            i += lastNonAsciiIndex + 1;
+        }
+        return count;
+#else
+        for (; i < count && uint8_t(source[i]) >= 0x80; ++i)
+        { }
+        return i;
+#endif
+    }
 
-        if (IsSurrogate(ch))
+
+    // Copy the leading run of ASCII code units to UTF-8, returning how many.
+    size_t NarrowAsciiRun(_In_reads_(count) char16_t const* source, size_t count, _Out_writes_(count) char* dest) noexcept
+    {
+        size_t i = 0;
+#if STRING_TRANSCODE_SSE2
+        __m128i const nonAsciiBits = _mm_set1_epi16(short(0xFF80));
+        __m128i const zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16)
         {
-            // Illegal unpaired surrogate. Substitute with replacement char.
-            ch = UnicodeReplacementCharacter;
+            __m128i const low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i + 0));
+            __m128i const high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i + 8));
+            __m128i const isAscii = _mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(low, high), nonAsciiBits), zero);
+            if (_mm_movemask_epi8(isAscii) != 0xFFFF)
+                break;
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packus_epi16(low, high));
         }
-        utf32text[utf32index] = ch;
+#endif
+        for (; i < count && source[i] < 0x80; ++i)
+        {
+            dest[i] = char(source[i]);
+        }
+        return i;
     }
 
-    // Return how many UTF-16 code units and UTF-32 units were read/written.
-    // Might have more UTF16 code units than UTF32, but never the other way around.
 
-    if (sourceCount != nullptr)
-        *sourceCount = reader.size();
+    // UTF-16 counterpart of FindAsciiBlock. The returned position is always
+    // an ASCII code unit, so surrogate pairs are never split.
+    size_t FindAsciiBlock(_In_reads_(count) char16_t const* source, size_t begin, size_t count) noexcept
+    {
+        size_t i = begin;
+#if STRING_TRANSCODE_SSE2
+        __m128i const nonAsciiBits = _mm_set1_epi16(short(0xFF80));
+        __m128i const zero = _mm_setzero_si128();
+        while (i + 8 <= count)
+        {
+            __m128i const units = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+            int const nonAsciiMask = ~_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, nonAsciiBits), zero)) & 0xFFFF;
+            if (nonAsciiMask == 0)
+                return i;
+
+            unsigned long lastNonAsciiByte;
+            _BitScanReverse(OUT &lastNonAsciiByte, nonAsciiMask);
+            i += lastNonAsciiByte / 2 + 1;
+        }
+        return count;
+#else
+        for (; i < count && source[i] >= 0x80; ++i)
+        { }
+        return i;
+#endif
+    }
+
+
+    template <bool replaceUnpairedSurrogates>
+    size_t ConvertTextUtf16ToUtf32Implementation(
+        array_ref<char16_t const> utf16text,
+        OUT array_ref<char32_t> utf32text,
+        _Out_opt_ size_t* sourceCount
+        ) noexcept
+    {
+        char16_t const* source = utf16text.data();
+        char32_t* dest = utf32text.data();
+        size_t const sc = utf16text.size(), dc = utf32text.size();
+        size_t si = 0, di = 0;
+
+        // Read one code point, combining surrogate pairs like UnicodeCharacterReader.
+        auto readNext = [&]() -> char32_t
+        {
+            char32_t ch = source[si++];
+            if (IsLeadingSurrogate(ch) && si < sc && IsTrailingSurrogate(source[si]))
+            {
+                ch = MakeUnicodeCodePoint(ch, source[si++]);
+            }
+            else if (replaceUnpairedSurrogates && IsSurrogate(ch))
+            {
+                // Illegal unpaired surrogate. Substitute with replacement char.
+                ch = UnicodeReplacementCharacter;
+            }
+            return ch;
+        };
+
+#if STRING_TRANSCODE_SSE2
+        __m128i const surrogateMask = _mm_set1_epi16(short(0xF800));
+        __m128i const surrogateBits = _mm_set1_epi16(short(0xD800));
+        __m128i const zero = _mm_setzero_si128();
+        while (si + 8 <= sc && di + 8 <= dc)
+        {
+            __m128i const units = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + si));
+            int const surrogateByteMask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, surrogateMask), surrogateBits));
+            if (surrogateByteMask == 0)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + di + 0), _mm_unpacklo_epi16(units, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + di + 4), _mm_unpackhi_epi16(units, zero));
+                si += 8;
+                di += 8;
+                continue;
+            }
 
-    return utf32index;
+            // Copy the plain units before the first surrogate, then decode it.
+            unsigned long firstSurrogateByte;
+            _BitScanForward(OUT &firstSurrogateByte, surrogateByteMask);
+            for (size_t plainCount = firstSurrogateByte / 2; plainCount > 0; --plainCount)
+            {
+                dest[di++] = source[si++];
+            }
+            dest[di++] = readNext();
+        }
+#endif
+        for (; si < sc && di < dc; ++di)
+        {
+            dest[di] = readNext();
+        }
+
+        // Return how many UTF-16 code units were read and UTF-32 units written.
+        // Might have more UTF16 code units than UTF32, but never the other way around.
+        if (sourceCount != nullptr)
+            *sourceCount = si;
+
+        return di;
+    }
 }
 
 
 _Out_range_(0, utf32text.end_ - utf32text.begin_)
-size_t ConvertTextUtf16ToUtf32NoReplacement(
+size_t ConvertTextUtf16ToUtf32(
     array_ref<char16_t const> utf16text,
     OUT array_ref<char32_t> utf32text,
     _Out_opt_ size_t* sourceCount
     ) noexcept
 {
-    // Can have more UTF16 characters than UTF32,
-    // but never the other way around.
-
-    UnicodeCharacterReader reader(utf16text.data(), utf16text.data_end());
-    size_t const utf32count = utf32text.size();
-    size_t utf32index = 0;
-
-    for (; !reader.IsAtEnd() && utf32index < utf32count; ++utf32index)
-    {
-        utf32text[utf32index] = reader.ReadNext();
-    }
+    // Convert all code points, substituting the replacement character for unpaired surrogates.
+    return ConvertTextUtf16ToUtf32Implementation</*replaceUnpairedSurrogates*/ true>(utf16text, OUT utf32text, OUT sourceCount);
+}
 
-    if (sourceCount != nullptr)
-        *sourceCount = reader.size();
 
-    return utf32index;
+_Out_range_(0, utf32text.end_ - utf32text.begin_)
+size_t ConvertTextUtf16ToUtf32NoReplacement(
+    array_ref<char16_t const> utf16text,
+    OUT array_ref<char32_t> utf32text,
+    _Out_opt_ size_t* sourceCount
+    ) noexcept
+{
+    return ConvertTextUtf16ToUtf32Implementation</*replaceUnpairedSurrogates*/ false>(utf16text, OUT utf32text, OUT sourceCount);
 }
 
 
@@ -514,12 +876,9 @@ size_t ConvertUtf32ToUtf16(
     if (dc <= 0)
         return 0;
 
-    for ( ; si < sc; ++si)
+    auto writeNext = [&]()
     {
-        if (di >= dc)
-            break;
-
-        char32_t ch = utf32text[si];
+        char32_t ch = utf32text[si++];
 
         if (IsCharacterBeyondBmp(ch) && dc - di >= 2)
         {
@@ -535,6 +894,38 @@ size_t ConvertUtf32ToUtf16(
             utf16text[di + 0] = wchar_t(ch);
         }
         ++di;
+    };
+
+#if STRING_TRANSCODE_SSE2
+    // Narrow eight BMP characters at a time. SSE2 only has a signed 32 to 16
+    // bit pack, so bias the values into the signed range and back.
+    __m128i const bias32 = _mm_set1_epi32(0x8000);
+    __m128i const bias16 = _mm_set1_epi16(short(0x8000));
+    __m128i const zero = _mm_setzero_si128();
+    while (si + 8 <= sc && di + 8 <= dc)
+    {
+        __m128i const low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&utf32text[si + 0]));
+        __m128i const high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&utf32text[si + 4]));
+        __m128i const isBmp = _mm_cmpeq_epi32(_mm_srli_epi32(_mm_or_si128(low, high), 16), zero);
+        if (_mm_movemask_epi8(isBmp) != 0xFFFF)
+        {
+            for (size_t blockEnd = si + 8; si < blockEnd && di < dc; )
+            {
+                writeNext();
+            }
+            continue;
+        }
+
+        __m128i const packed = _mm_add_epi16(_mm_packs_epi32(_mm_sub_epi32(low, bias32), _mm_sub_epi32(high, bias32)), bias16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&utf16text[di]), packed);
+        si += 8;
+        di += 8;
+    }
+#endif
+
+    while (si < sc && di < dc)
+    {
+        writeNext();
     }
 
     return di;
@@ -547,6 +938,104 @@ namespace
 }
 
 
+size_t CountUtf8ToUtf16CodeUnits(array_ref<char const> utf8text) noexcept
+{
+    // Each sequence yields one code unit per lead byte, plus one more for the
+    // four byte sequences which become surrogate pairs. So count all bytes
+    // except continuation bytes (10xxxxxx), and count 4-byte leads twice.
+    char const* source = utf8text.data();
+    size_t const count = utf8text.size();
+    size_t unitCount = count;
+    size_t i = 0;
+
+#if STRING_TRANSCODE_SSE2
+    // Signed compares: continuation bytes are 0x80..0xBF = -128..-65, and
+    // four byte leads are 0xF0..0xF7 = -16..-9 (ASCII being non-negative
+    // must fall outside both). Each match subtracts one from (or adds one to)
+    // the byte counters, which are summed every 255 blocks before they can
+    // overflow.
+    __m128i const continuationLimit = _mm_set1_epi8(-64);
+    __m128i const fourByteLeadFirst = _mm_set1_epi8(-17);
+    __m128i const fourByteLeadLast = _mm_set1_epi8(-8);
+    __m128i const zero = _mm_setzero_si128();
+    while (i + 16 <= count)
+    {
+        __m128i continuationCounts = zero;
+        __m128i fourByteLeadCounts = zero;
+        for (size_t blockCount = 0; blockCount < 255 && i + 16 <= count; ++blockCount, i += 16)
+        {
+            __m128i const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+            continuationCounts = _mm_sub_epi8(continuationCounts, _mm_cmplt_epi8(bytes, continuationLimit));
+            __m128i const isFourByteLead = _mm_and_si128(_mm_cmpgt_epi8(bytes, fourByteLeadFirst), _mm_cmplt_epi8(bytes, fourByteLeadLast));
+            fourByteLeadCounts = _mm_sub_epi8(fourByteLeadCounts, isFourByteLead);
+        }
+        __m128i const continuationSums = _mm_sad_epu8(continuationCounts, zero);
+        __m128i const fourByteLeadSums = _mm_sad_epu8(fourByteLeadCounts, zero);
+        unitCount -= size_t(_mm_cvtsi128_si32(continuationSums)) + size_t(_mm_extract_epi16(continuationSums, 4));
+        unitCount += size_t(_mm_cvtsi128_si32(fourByteLeadSums)) + size_t(_mm_extract_epi16(fourByteLeadSums, 4));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        int8_t const byte = int8_t(source[i]);
+        if (byte < -64)
+            --unitCount;
+        else if (byte > -17 && byte < -8)
+            ++unitCount;
+    }
+
+    return unitCount;
+}
+
+
+_Out_range_(0, utf16text.end_ - utf16text.begin_)
+size_t ConvertTextUtf8ToUtf16(
+    array_ref<char const> utf8text,
+    OUT array_ref<char16_t> utf16text,
+    _Out_opt_ size_t* sourceCount
+    ) noexcept
+{
+    char const* source = utf8text.data();
+    char16_t* dest = utf16text.data();
+    size_t const sc = utf8text.size(), dc = utf16text.size();
+    size_t si = 0, di = 0;
+
+    // Copy ASCII runs directly, and convert each stretch between them with
+    // the OS, which substitutes U+FFFD for invalid sequences.
+    while (si < sc && di < dc)
+    {
+        size_t const asciiCount = WidenAsciiRun(source + si, std::min(sc - si, dc - di), OUT dest + di);
+        si += asciiCount;
+        di += asciiCount;
+        if (si >= sc || di >= dc)
+            break;
+
+        size_t const stretchEnd = FindAsciiBlock(source, si, sc);
+        int32_t charsConverted =
+            MultiByteToWideChar(
+            CP_UTF8,
+            0, // no flags for UTF8 (we allow invalid characters for testing)
+            source + si,
+            int32_t(stretchEnd - si),
+            OUT ToWChar(dest + di),
+            int32_t(std::min(dc - di, size_t(INT32_MAX)))
+            );
+        if (charsConverted <= 0)
+            break; // Insufficient buffer for the stretch.
+
+        si = stretchEnd;
+        di += charsConverted;
+    }
+
+    // Return how many UTF-8 bytes were read and UTF-16 code units written.
+    if (sourceCount != nullptr)
+        *sourceCount = si;
+
+    return di;
+}
+
+
 void ConvertTextUtf8ToUtf16(
     array_ref<char const> utf8text,
     OUT std::u16string& utf16text
@@ -556,25 +1045,18 @@ void ConvertTextUtf8ToUtf16(
     // If utf16text is already reserve()'d, no exception will happen.
 
     // Skip byte-order-mark.
-    int32_t startingOffset = 0;
+    size_t startingOffset = 0;
     if (utf8text.size() >= std::size(utf8bom)
     &&  memcmp(utf8text.data(), utf8bom, std::size(utf8bom)) == 0)
     {
         startingOffset = ARRAYSIZE(utf8bom);
     }
+    utf8text.remove_prefix(startingOffset);
 
+    // Never more UTF-16 code units than UTF-8 bytes.
     utf16text.resize(utf8text.size());
-
-    // Convert UTF-8 to UTF-16.
-    int32_t charsConverted =
-        MultiByteToWideChar(
-        CP_UTF8,
-        0, // no flags for UTF8 (we allow invalid characters for testing)
-        (LPCSTR)&utf8text[startingOffset],
-        int32_t(utf8text.size() - startingOffset),
-        OUT ToWChar(const_cast<char16_t*>(utf16text.data())), // workaround issue http://www.open-std.org/jtc1/sc22/wg21/docs/lwg-active.html#2391
-        int32_t(utf16text.size())
-        );
+    array_ref<char16_t> dest(const_cast<char16_t*>(utf16text.data()), utf16text.size()); // workaround issue http://www.open-std.org/jtc1/sc22/wg21/docs/lwg-active.html#2391
+    size_t const charsConverted = ConvertTextUtf8ToUtf16(utf8text, OUT dest, nullptr);
 
     // Shrink to actual size.
     utf16text.resize(charsConverted);
@@ -588,40 +1070,57 @@ void ConvertTextUtf16ToUtf8(
 {
     utf8text.clear();
 
-    // Convert UTF-8 to UTF-16.
-    int32_t charsConverted =
-        WideCharToMultiByte(
-        CP_UTF8,
-        0, // no flags for UTF8 (we allow invalid characters for testing)
-        ToWChar(utf16text.data()),
-        int32_t(utf16text.size()),
-        nullptr, // null destination buffer the first time to get estimate.
-        0,
-        nullptr, // defaultChar
-        nullptr // usedDefaultChar
-        );
-
-    // If no characters were converted (or if overflow), return empty string.
-    if (charsConverted <= 0)
+    // If there is no text, return empty string (without byte order mark).
+    if (utf16text.empty())
         return;
-    auto const bomCount = countof(utf8bom);
-    auto totalLength = charsConverted + bomCount;
-    if (uint32_t(charsConverted) <= bomCount)
+
+    utf8text.assign(utf8bom, utf8bom + countof(utf8bom));
+    AppendTextUtf16ToUtf8(utf16text, IN OUT utf8text);
+}
+
+
+void AppendTextUtf16ToUtf8(
+    array_ref<char16_t const> utf16text,
+    IN OUT std::string& utf8text
+    )
+{
+    if (utf16text.empty())
         return;
 
-    utf8text.reserve(totalLength);
-    utf8text.append(&utf8bom[0], bomCount);
-    utf8text.resize(totalLength);
-
-    // Convert UTF-8 to UTF-16.
-    WideCharToMultiByte(
-        CP_UTF8,
-        0, // no flags for UTF8 (we allow invalid characters for testing)
-        ToWChar(utf16text.data()),
-        int32_t(utf16text.size()),
-        OUT &utf8text[bomCount],
-        int32_t(utf8text.size() - bomCount),
-        nullptr, // defaultChar
-        nullptr // usedDefaultChar
-        );
+    // Each UTF-16 code unit becomes at most three bytes (a surrogate pair
+    // becomes four bytes for two units).
+    size_t const initialCount = utf8text.size();
+    size_t const sourceCount = utf16text.size();
+    size_t const destCount = sourceCount * 3;
+    utf8text.resize(initialCount + destCount);
+
+    char16_t const* source = utf16text.data();
+    char* dest = &utf8text[initialCount];
+    size_t si = 0, di = 0;
+
+    while (si < sourceCount)
+    {
+        size_t const asciiCount = NarrowAsciiRun(source + si, sourceCount - si, OUT dest + di);
+        si += asciiCount;
+        di += asciiCount;
+        if (si >= sourceCount)
+            break;
+
+        size_t const stretchEnd = FindAsciiBlock(source, si, sourceCount);
+        int32_t charsConverted =
+            WideCharToMultiByte(
+            CP_UTF8,
+            0, // no flags for UTF8 (we allow invalid characters for testing)
+            ToWChar(source + si),
+            int32_t(stretchEnd - si),
+            OUT dest + di,
+            int32_t(destCount - di),
+            nullptr, // defaultChar
+            nullptr // usedDefaultChar
+            );
+        si = stretchEnd;
+        di += std::max(charsConverted, 0);
+    }
+
+    utf8text.resize(initialCount + di);
 }
@@ -97,6 +97,19 @@ size_t ConvertUtf32ToUtf16(
     OUT array_ref<char16_t> utf16text
     ) noexcept;
 
+// Returns the exact UTF-16 length for well-formed UTF-8, for sizing buffers
+// before conversion. Ill-formed input may need more (one U+FFFD per bad byte).
+size_t CountUtf8ToUtf16CodeUnits(array_ref<char const> utf8text) noexcept;
+
+// Converts as much as fits, without consuming a byte order mark, so a large
+// text can be converted in pieces. sourceCount receives the bytes consumed.
+_Out_range_(0, utf16text.end_ - utf16text.begin_)
+size_t ConvertTextUtf8ToUtf16(
+    array_ref<char const> utf8text,
+    OUT array_ref<char16_t> utf16text,
+    _Out_opt_ size_t* sourceCount
+    ) noexcept;
+
 // Consumes the byte order mark.
 void ConvertTextUtf8ToUtf16(
     array_ref<char const> utf8text,
@@ -109,6 +122,13 @@ void ConvertTextUtf16ToUtf8(
     OUT std::string& utf8text
     );
 
+// Appends onto any existing text, without a byte order mark, such as for
+// writing a file in pieces.
+void AppendTextUtf16ToUtf8(
+    array_ref<char16_t const> utf16text,
+    IN OUT std::string& utf8text
+    );
+
 void GetFormattedString(_Inout_ std::u16string& returnString, bool shouldConcatenate, _In_z_ const char16_t* formatString, va_list vargs);
 void GetFormattedString(_Out_ std::u16string& returnString, _In_z_ const char16_t* formatString, ...);
 void AppendFormattedString(_Inout_ std::u16string& returnString, _In_z_ const char16_t* formatString, ...);
@@ -177,3 +197,28 @@ struct UnicodeCharacterReader : public array_ref<char16_t const>
         return ch;
     }
 };
+
+// Caches the unescaped form of edited text, so that after an edit only the
+// changed lines are unescaped again. This relies on no escape sequence (nor
+// its lookahead) spanning a line feed, which holds for all the unescapers above.
+class IncrementalUnescaper
+{
+public:
+    using UnescapeFunction = void (*)(array_ref<char16_t const> escapedText, OUT std::u16string& expandedText);
+
+    // Update to the new escaped text, returning the complete unescaped text.
+    std::u16string const& Update(array_ref<char16_t const> escapedText, UnescapeFunction unescapeFunction);
+    void clear();
+
+private:
+    struct LineOffset
+    {
+        size_t escapedOffset;
+        size_t unescapedOffset;
+    };
+
+    UnescapeFunction unescapeFunction_ = nullptr;
+    std::u16string escapedText_;
+    std::u16string unescapedText_;
+    std::vector<LineOffset> lineOffsets_; // Start of each line, beginning with {0,0}.
+};
@@ -24,6 +24,74 @@ bool ThrowIf(bool value, _In_opt_z_ char const* message)
 }
 
 
+int64_t GetPerformanceCounter() noexcept
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(OUT &counter);
+    return counter.QuadPart;
+}
+
+
+double PerformanceCounterToMilliseconds(int64_t ticks) noexcept
+{
+    static int64_t const frequency = []() -> int64_t
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(OUT &frequency);
+        return frequency.QuadPart;
+    }();
+    return double(ticks) * 1000.0 / double(frequency);
+}
+
+
+// The pool's threads persist between calls rather than being created and
+// destroyed for every paint or scan.
+void RunWorkers(uint32_t workerCount, std::function<void(uint32_t workerIndex)> const& worker)
+{
+    struct WorkContext
+    {
+        WorkContext(std::function<void(uint32_t)> const& worker) : worker(worker), nextWorkerIndex(1) {}
+
+        std::function<void(uint32_t)> const& worker;
+        std::atomic<uint32_t> nextWorkerIndex;
+    };
+
+    WorkContext context(worker);
+    PTP_WORK work = nullptr;
+    if (workerCount > 1)
+    {
+        work = CreateThreadpoolWork(
+            [](PTP_CALLBACK_INSTANCE, void* parameter, PTP_WORK) -> void
+            {
+                auto& context = *static_cast<WorkContext*>(parameter);
+                context.worker(context.nextWorkerIndex++);
+            },
+            &context,
+            nullptr
+            );
+    }
+
+    if (work == nullptr)
+    {
+        // Workers take their items from a shared counter, so the first
+        // one alone still does everything, with the rest finding nothing.
+        for (uint32_t workerIndex = 0; workerIndex < workerCount; ++workerIndex)
+        {
+            worker(workerIndex);
+        }
+        return;
+    }
+
+    for (uint32_t workerIndex = 1; workerIndex < workerCount; ++workerIndex)
+    {
+        SubmitThreadpoolWork(work);
+    }
+    worker(0);
+    WaitForThreadpoolWorkCallbacks(work, /*cancelPendingCallbacks*/false);
+    CloseThreadpoolWork(work);
+}
+
+
 bool TestBit(void const* memoryBase, uint32_t bitIndex) noexcept
 {
     return _bittest( reinterpret_cast<long const*>(memoryBase), bitIndex) != 0;
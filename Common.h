@@ -102,6 +102,28 @@ template <typename FunctorType>
 DismissableCleanupType<FunctorType> inline DismissableCleanup(FunctorType const& f) { return DismissableCleanupType<FunctorType>(f); }
 
 
+// High resolution timing, in performance counter ticks.
+int64_t GetPerformanceCounter() noexcept;
+double PerformanceCounterToMilliseconds(int64_t ticks) noexcept;
+
+// Run the worker on the given number of workers at once, passing each its
+// own index, and wait for them all. The calling thread is worker zero, and
+// the rest run on the process thread pool rather than on new threads.
+void RunWorkers(uint32_t workerCount, std::function<void(uint32_t workerIndex)> const& worker);
+
+// Adds the ticks elapsed during its lifetime onto the given total.
+struct ScopedPerformanceTimer
+{
+public:
+    explicit ScopedPerformanceTimer(int64_t& totalTicks) : totalTicks_(totalTicks), startTicks_(GetPerformanceCounter()) {}
+    ~ScopedPerformanceTimer() { totalTicks_ += GetPerformanceCounter() - startTicks_; }
+
+private:
+    int64_t& totalTicks_;
+    int64_t startTicks_;
+};
+
+
 // Range of iterators that can be used in a ranged for loop.
 template<typename ForwardIteratorType>
 class iterator_range
@@ -17,8 +17,11 @@
 
 #include <windows.h>
 #include <Dwrite_3.h>
+#include "Common.FastVector.h"
+#include "Tracing.h"
 
 #pragma comment(lib, "DWrite.lib")
+#pragma comment(lib, "Version.lib")
 
 MODULE(DWritEx)
 EXPORT_BEGIN
@@ -160,6 +163,43 @@ HRESULT LoadDWrite(
 }
 
 
+HRESULT GetModuleFileVersion(
+    HMODULE moduleHandle,
+    _Out_ uint64_t& fileVersion
+    ) noexcept
+{
+    fileVersion = 0;
+
+    wchar_t modulePath[MAX_PATH];
+    DWORD modulePathLength = GetModuleFileName(moduleHandle, OUT modulePath, ARRAYSIZE(modulePath));
+    if (modulePathLength == 0 || modulePathLength >= ARRAYSIZE(modulePath))
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    DWORD ignoredHandle;
+    DWORD versionInfoSize = GetFileVersionInfoSize(modulePath, OUT &ignoredHandle);
+    if (versionInfoSize == 0)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    std::unique_ptr<uint8_t[]> versionInfo(new(std::nothrow) uint8_t[versionInfoSize]);
+    if (versionInfo == nullptr)
+        return E_OUTOFMEMORY;
+
+    if (!GetFileVersionInfo(modulePath, 0, versionInfoSize, OUT versionInfo.get()))
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    VS_FIXEDFILEINFO* fixedFileInfo = nullptr;
+    UINT fixedFileInfoSize = 0;
+    if (!VerQueryValue(versionInfo.get(), L"\\", OUT reinterpret_cast<void**>(&fixedFileInfo), OUT &fixedFileInfoSize)
+    ||  fixedFileInfoSize < sizeof(VS_FIXEDFILEINFO))
+    {
+        return HRESULT_FROM_WIN32(ERROR_RESOURCE_TYPE_NOT_FOUND);
+    }
+
+    fileVersion = (uint64_t(fixedFileInfo->dwFileVersionMS) << 32) | fixedFileInfo->dwFileVersionLS;
+    return S_OK;
+}
+
+
 #if 0
 // Helper to return multiple supported interfaces.
 //
@@ -519,6 +559,33 @@ private:
 CustomFontCollectionLoader CustomFontCollectionLoader::singleton_;
 
 
+HRESULT CreateFontSet(
+    _In_ IDWriteFactory* factory,
+    IDWriteFontFileEnumerator* fontFileEnumerator,
+    _COM_Outptr_ IDWriteFontSet** fontSet
+    ) noexcept
+{
+    *fontSet = nullptr;
+
+    // Adding whole files to a set needs IDWriteFontSetBuilder1 (Windows 10 Creators Update).
+    ComPtr<IDWriteFactory5> factory5;
+    factory->QueryInterface(OUT &factory5);
+    if (factory5 == nullptr)
+        return E_NOINTERFACE;
+
+    ComPtr<IDWriteFontSetBuilder1> fontSetBuilder;
+    IFR(factory5->CreateFontSetBuilder(OUT &fontSetBuilder));
+    BOOL hasCurrentFile = false;
+    while (SUCCEEDED(fontFileEnumerator->MoveNext(OUT &hasCurrentFile)) && hasCurrentFile)
+    {
+        ComPtr<IDWriteFontFile> fontFile;
+        IFR(fontFileEnumerator->GetCurrentFontFile(OUT &fontFile));
+        IFR(fontSetBuilder->AddFontFile(fontFile));
+    }
+    return fontSetBuilder->CreateFontSet(OUT fontSet);
+}
+
+
 HRESULT CreateFontCollection(
     _In_ IDWriteFactory* factory,
     DWRITE_FONT_FAMILY_MODEL fontFamilyModel,
@@ -535,17 +602,8 @@ HRESULT CreateFontCollection(
     if (factory6 != nullptr)
     {
         ComPtr<IDWriteFontSet> fontSet;
-        ComPtr<IDWriteFontSetBuilder1> fontSetBuilder;
-        IFR(factory6->CreateFontSetBuilder(OUT &fontSetBuilder));
-        BOOL hasCurrentFile = false;
-        while (SUCCEEDED(fontFileEnumerator->MoveNext(OUT &hasCurrentFile)) && hasCurrentFile)
-        {
-            ComPtr<IDWriteFontFile> fontFile;
-            IFR(fontFileEnumerator->GetCurrentFontFile(OUT &fontFile));
-            IFR(fontSetBuilder->AddFontFile(fontFile));
-        }
-        IFR(fontSetBuilder->CreateFontSet(OUT &fontSet));
-        IFR(factory6->CreateFontCollectionFromFontSet(fontSet, fontFamilyModel, OUT reinterpret_cast<IDWriteFontCollection2**>(fontCollection)));
+        IFR(CreateFontSet(factory, fontFileEnumerator, OUT &fontSet));
+        IFR(CreateFontCollectionFromFontSet(factory, fontSet, fontFamilyModel, OUT fontCollection));
     }
     else
     {
@@ -596,12 +654,62 @@ HRESULT CreateFontCollection(
 }
 
 
+HRESULT CreateFontSet(
+    _In_ IDWriteFactory* factory,
+    _In_reads_(fontFileNamesSize) const wchar_t* fontFileNames, // Each file name null terminated.
+    _In_ uint32_t fontFileNamesSize, // Number of wchar_t's, not number file name count
+    _COM_Outptr_ IDWriteFontSet** fontSet
+    ) noexcept
+{
+    *fontSet = nullptr;
+
+    CustomCollectionLocalFontFileEnumerator enumerator;
+    IFR(enumerator.Initialize(factory, fontFileNames, fontFileNamesSize));
+    auto* enumeratorAddress = static_cast<IDWriteFontFileEnumerator*>(&enumerator);
+    enumeratorAddress->AddRef();
+
+    return CreateFontSet(factory, enumeratorAddress, OUT fontSet);
+}
+
+
+HRESULT CreateFontCollectionFromFontSet(
+    _In_ IDWriteFactory* factory,
+    _In_ IDWriteFontSet* fontSet,
+    DWRITE_FONT_FAMILY_MODEL fontFamilyModel,
+    _COM_Outptr_ IDWriteFontCollection** fontCollection
+    ) noexcept
+{
+    *fontCollection = nullptr;
+
+    ComPtr<IDWriteFactory6> factory6;
+    factory->QueryInterface(OUT &factory6);
+    if (factory6 != nullptr)
+    {
+        return factory6->CreateFontCollectionFromFontSet(fontSet, fontFamilyModel, OUT reinterpret_cast<IDWriteFontCollection2**>(fontCollection));
+    }
+
+    // Older factories only group families by weight/stretch/style.
+    ComPtr<IDWriteFactory3> factory3;
+    factory->QueryInterface(OUT &factory3);
+    if (factory3 == nullptr || fontFamilyModel != DWRITE_FONT_FAMILY_MODEL_WEIGHT_STRETCH_STYLE)
+        return E_NOINTERFACE;
+
+    return factory3->CreateFontCollectionFromFontSet(fontSet, OUT reinterpret_cast<IDWriteFontCollection1**>(fontCollection));
+}
+
+
+// Font file stream backed by a memory mapped file, so that only the pages
+// DWrite actually touches are read from disk.
 class LocalFontFileStream : public IDWriteFontFileStream
 {
 public:
-    LocalFontFileStream(_Inout_ std::vector<uint8_t>& streamData)
+    LocalFontFileStream()
+    {
+    }
+
+    HRESULT Initialize(_In_z_ const char16_t* filePath)
     {
-        streamData_.swap(streamData);
+        return mappedFile_.Open(filePath);
     }
 
     IFACEMETHODIMP_(HRESULT) QueryInterface(IID const& iid, void** object)
@@ -644,11 +752,12 @@ public:
         __deref_out void** fragmentContext
         )
     {
-        uint64_t streamByteCount_ = streamData_.size();
+        auto streamData = mappedFile_.GetBytes();
+        uint64_t streamByteCount_ = streamData.size();
         if ((fileOffset <= streamByteCount_) && 
             (fragmentSize <= streamByteCount_ - fileOffset))
         {
-            *fragmentStart = streamData_.data() + static_cast<size_t>(fileOffset);
+            *fragmentStart = streamData.data() + static_cast<size_t>(fileOffset);
             *fragmentContext = nullptr;
         }
         else
@@ -670,7 +779,7 @@ public:
         __out uint64_t* fileSize
         )
     {
-        *fileSize = streamData_.size();
+        *fileSize = mappedFile_.GetBytes().size();
         return S_OK;
     }
 
@@ -678,22 +787,22 @@ public:
         __out uint64_t* lastWriteTime
         )
     {
-        *lastWriteTime = 0;
+        *lastWriteTime = mappedFile_.GetLastWriteTime();
         return S_OK;
     }
 
     bool IsInitialized()
     {
-        return !streamData_.empty();
+        return !mappedFile_.GetBytes().empty();
     }
 
 private:
     ULONG refCount_ = 0;
-    std::vector<uint8_t> streamData_;
+    MappedFile mappedFile_;
 };
 
 
-// Dumb file loader that just reads byte contents from a file.
+// Dumb file loader that just maps the byte contents of a file.
 class LocalFontFileLoader : public IDWriteFontFileLoader
 {
 public:
@@ -743,9 +852,8 @@ public:
 
         auto* filePath = reinterpret_cast<wchar_t const*>(fontFileReferenceKey);
         auto filePathSize = fontFileReferenceKeySize / sizeof(wchar_t);
-        std::vector<uint8_t> fileBytes;
-        IFR(ReadBinaryFile(ToChar16(filePath), OUT fileBytes));
-        ComPtr<IDWriteFontFileStream> stream(new LocalFontFileStream(IN OUT fileBytes));
+        ComPtr<LocalFontFileStream> stream(new LocalFontFileStream());
+        IFR(stream->Initialize(ToChar16(filePath)));
         *fontFileStream = stream.Detach();
 
         return S_OK;
@@ -766,6 +874,11 @@ HRESULT CreateFontFaceFromFile(
     _COM_Outptr_ IDWriteFontFace** fontFace
     ) noexcept
 {
+    TRACE_LOGGING_ACTIVITY(activity, "LoadDWriteFontFile",
+        TraceLoggingWideString(fontFilePath, "FilePath"),
+        TraceLoggingUInt32(fontFaceIndex, "FaceIndex")
+        );
+
     ComPtr<IDWriteFontFile> fontFile;
 
     // Create a dummy local file loader to work around the issue that DWrite
@@ -918,6 +1031,21 @@ HRESULT RecreateFontFace(
 
     if (!fontAxisValues.empty())
     {
+        // Create the instance from the face's own font resource when possible,
+        // which shares the parsed font file among all the instances.
+        ComPtr<IDWriteFontFace5> fontFace5;
+        ComPtr<IDWriteFontResource> fontResource;
+        if (SUCCEEDED(originalFontFace->QueryInterface(OUT &fontFace5))
+        &&  SUCCEEDED(fontFace5->GetFontResource(OUT &fontResource)))
+        {
+            return fontResource->CreateFontFace(
+                fontSimulations,
+                fontAxisValues.data(),
+                static_cast<uint32_t>(fontAxisValues.size()),
+                OUT reinterpret_cast<IDWriteFontFace5**>(newFontFace)
+                );
+        }
+
         ComPtr<IDWriteFactory6> factory6;
         if SUCCEEDED(factory->QueryInterface(OUT &factory6))
         {
@@ -1055,7 +1183,7 @@ HRESULT GetFontFaceDesignAdvances(
     // else using slower DWRITE_GLYPH_METRICS approach for Windows 7.
     else
     {
-        std::vector<DWRITE_GLYPH_METRICS> glyphMetricsBuffer(glyphIds.size());
+        scratch_vector<DWRITE_GLYPH_METRICS, false> glyphMetricsBuffer(glyphIds.size());
         switch (measuringMode)
         {
         case DWRITE_MEASURING_MODE_GDI_CLASSIC:
@@ -1098,14 +1226,14 @@ HRESULT GetFontFaceAdvances(
     _Out_ array_ref<float> glyphAdvances
     ) noexcept
 {
-    std::vector<int32_t> glyphAdvancesBuffer(glyphIds.size());
+    scratch_vector<int32_t, false> glyphAdvancesBuffer(glyphIds.size());
     IFR(GetFontFaceDesignAdvances(
         fontFace,
         fontEmSize,
         glyphIds,
         measuringMode,
         isSideways,
-        OUT glyphAdvancesBuffer
+        OUT glyphAdvancesBuffer.data_span()
         ));
 
     uint32_t glyphCount = static_cast<uint32_t>(glyphIds.size());
@@ -1122,6 +1250,300 @@ HRESULT GetFontFaceAdvances(
 }
 
 
+namespace
+{
+    // Stack local source and sink for script analysis of a single paragraph
+    // with one locale and no number substitution.
+    class TextScriptAnalysis : public IDWriteTextAnalysisSource, public IDWriteTextAnalysisSink
+    {
+    public:
+        TextScriptAnalysis(
+            array_ref<char16_t const> text,
+            _In_z_ char16_t const* localeName,
+            DWRITE_READING_DIRECTION readingDirection,
+            std::vector<TextScriptRun>& scriptRuns
+            )
+        :   text_(text),
+            localeName_(localeName),
+            readingDirection_(readingDirection),
+            scriptRuns_(scriptRuns)
+        { }
+
+        // IDWriteTextAnalysisSource
+        HRESULT STDMETHODCALLTYPE GetTextAtPosition(uint32_t textPosition, _Outptr_result_buffer_(*textLength) WCHAR const** textString, _Out_ uint32_t* textLength) noexcept override
+        {
+            uint32_t const totalLength = static_cast<uint32_t>(text_.size());
+            *textString = (textPosition < totalLength) ? ToWChar(text_.data() + textPosition) : nullptr;
+            *textLength = (textPosition < totalLength) ? totalLength - textPosition : 0;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetTextBeforePosition(uint32_t textPosition, _Outptr_result_buffer_(*textLength) WCHAR const** textString, _Out_ uint32_t* textLength) noexcept override
+        {
+            bool const isInText = (textPosition > 0 && textPosition <= text_.size());
+            *textString = isInText ? ToWChar(text_.data()) : nullptr;
+            *textLength = isInText ? textPosition : 0;
+            return S_OK;
+        }
+
+        DWRITE_READING_DIRECTION STDMETHODCALLTYPE GetParagraphReadingDirection() noexcept override
+        {
+            return readingDirection_;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetLocaleName(uint32_t textPosition, _Out_ uint32_t* textLength, _Outptr_result_z_ WCHAR const** localeName) noexcept override
+        {
+            *localeName = ToWChar(localeName_);
+            *textLength = GetRemainingLength(textPosition);
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetNumberSubstitution(uint32_t textPosition, _Out_ uint32_t* textLength, _COM_Outptr_ IDWriteNumberSubstitution** numberSubstitution) noexcept override
+        {
+            *numberSubstitution = nullptr;
+            *textLength = GetRemainingLength(textPosition);
+            return S_OK;
+        }
+
+        // IDWriteTextAnalysisSink
+        HRESULT STDMETHODCALLTYPE SetScriptAnalysis(uint32_t textPosition, uint32_t textLength, _In_ DWRITE_SCRIPT_ANALYSIS const* scriptAnalysis) noexcept override
+        {
+            try
+            {
+                scriptRuns_.push_back({textPosition, textLength, *scriptAnalysis});
+            }
+            catch (...)
+            {
+                return E_OUTOFMEMORY;
+            }
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE SetLineBreakpoints(uint32_t, uint32_t, _In_reads_(textLength) DWRITE_LINE_BREAKPOINT const*) noexcept override
+        {
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE SetBidiLevel(uint32_t, uint32_t, uint8_t, uint8_t) noexcept override
+        {
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE SetNumberSubstitution(uint32_t, uint32_t, _In_ IDWriteNumberSubstitution*) noexcept override
+        {
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+        {
+            if (iid == __uuidof(IDWriteTextAnalysisSource) || iid == __uuidof(IUnknown))
+            {
+                *object = static_cast<IDWriteTextAnalysisSource*>(this);
+                return S_OK;
+            }
+            if (iid == __uuidof(IDWriteTextAnalysisSink))
+            {
+                *object = static_cast<IDWriteTextAnalysisSink*>(this);
+                return S_OK;
+            }
+            *object = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        unsigned long STDMETHODCALLTYPE AddRef() noexcept override
+        {
+            return 1; // Static stack class
+        }
+
+        unsigned long STDMETHODCALLTYPE Release() noexcept override
+        {
+            return 1; // Static stack class
+        }
+
+    protected:
+        uint32_t GetRemainingLength(uint32_t textPosition) const noexcept
+        {
+            uint32_t const totalLength = static_cast<uint32_t>(text_.size());
+            return (textPosition < totalLength) ? totalLength - textPosition : 0;
+        }
+
+        array_ref<char16_t const> text_;
+        char16_t const* localeName_;
+        DWRITE_READING_DIRECTION readingDirection_;
+        std::vector<TextScriptRun>& scriptRuns_;
+    };
+}
+
+
+HRESULT AnalyzeTextScripts(
+    IDWriteTextAnalyzer* textAnalyzer,
+    array_ref<char16_t const> text,
+    _In_z_ char16_t const* localeName,
+    bool isRightToLeft,
+    _Out_ std::vector<TextScriptRun>& scriptRuns
+    )
+{
+    scriptRuns.clear();
+    uint32_t const textLength = static_cast<uint32_t>(text.size());
+    if (textLength == 0)
+        return S_OK;
+
+    TextScriptAnalysis textScriptAnalysis(
+        text,
+        localeName,
+        isRightToLeft ? DWRITE_READING_DIRECTION_RIGHT_TO_LEFT : DWRITE_READING_DIRECTION_LEFT_TO_RIGHT,
+        IN OUT scriptRuns
+        );
+    IFR(textAnalyzer->AnalyzeScript(&textScriptAnalysis, 0, textLength, &textScriptAnalysis));
+
+    // The analyzer reports runs in order in practice, but nothing promises it.
+    std::sort(
+        scriptRuns.begin(),
+        scriptRuns.end(),
+        [](auto const& a, auto const& b) { return a.textPosition < b.textPosition; }
+        );
+    return S_OK;
+}
+
+
+HRESULT ShapeTextScriptRun(
+    IDWriteTextAnalyzer* textAnalyzer,
+    IDWriteFontFace* fontFace,
+    float fontEmSize,
+    DWRITE_MEASURING_MODE measuringMode,
+    bool isSideways,
+    bool isRightToLeft,
+    DWRITE_SCRIPT_ANALYSIS const& scriptAnalysis,
+    _In_z_ char16_t const* localeName,
+    array_ref<DWRITE_FONT_FEATURE const> features,
+    array_ref<char16_t const> text,
+    _Out_ std::vector<uint16_t>& glyphIndices,
+    _Out_ std::vector<float>& glyphAdvances,
+    _Out_ std::vector<DWRITE_GLYPH_OFFSET>& glyphOffsets
+    )
+{
+    glyphIndices.clear();
+    glyphAdvances.clear();
+    glyphOffsets.clear();
+
+    uint32_t const textLength = static_cast<uint32_t>(text.size());
+    if (textLength == 0)
+        return S_OK;
+
+    // The features apply to the whole run.
+    DWRITE_TYPOGRAPHIC_FEATURES typographicFeatures = {const_cast<DWRITE_FONT_FEATURE*>(features.data()), static_cast<uint32_t>(features.size())};
+    DWRITE_TYPOGRAPHIC_FEATURES const* typographicFeaturesPointer = &typographicFeatures;
+    uint32_t const featureRangeCount = features.empty() ? 0 : 1;
+    DWRITE_TYPOGRAPHIC_FEATURES const** featureRanges = features.empty() ? nullptr : &typographicFeaturesPointer;
+    uint32_t const* featureRangeLengths = features.empty() ? nullptr : &textLength;
+
+    std::vector<uint16_t> clusterMap(textLength);
+    std::vector<DWRITE_SHAPING_TEXT_PROPERTIES> textProperties(textLength);
+    std::vector<DWRITE_SHAPING_GLYPH_PROPERTIES> glyphProperties;
+
+    // Start from the documented estimate, growing it for complex scripts
+    // which need more glyphs than that.
+    uint32_t maxGlyphCount = textLength * 3 / 2 + 16;
+    uint32_t actualGlyphCount = 0;
+    HRESULT hr;
+    for (;;)
+    {
+        glyphIndices.resize(maxGlyphCount);
+        glyphProperties.resize(maxGlyphCount);
+        hr = textAnalyzer->GetGlyphs(
+            ToWChar(text.data()),
+            textLength,
+            fontFace,
+            isSideways,
+            isRightToLeft,
+            &scriptAnalysis,
+            ToWChar(localeName),
+            nullptr, // numberSubstitution
+            featureRanges,
+            featureRangeLengths,
+            featureRangeCount,
+            maxGlyphCount,
+            OUT clusterMap.data(),
+            OUT textProperties.data(),
+            OUT glyphIndices.data(),
+            OUT glyphProperties.data(),
+            OUT &actualGlyphCount
+            );
+        if (hr != E_NOT_SUFFICIENT_BUFFER)
+            break;
+
+        maxGlyphCount *= 2;
+    }
+    if (FAILED(hr))
+    {
+        glyphIndices.clear();
+        return hr;
+    }
+    glyphIndices.resize(actualGlyphCount);
+
+    glyphAdvances.resize(actualGlyphCount);
+    glyphOffsets.resize(actualGlyphCount);
+    if (measuringMode == DWRITE_MEASURING_MODE_NATURAL)
+    {
+        hr = textAnalyzer->GetGlyphPlacements(
+            ToWChar(text.data()),
+            clusterMap.data(),
+            textProperties.data(),
+            textLength,
+            glyphIndices.data(),
+            glyphProperties.data(),
+            actualGlyphCount,
+            fontFace,
+            fontEmSize,
+            isSideways,
+            isRightToLeft,
+            &scriptAnalysis,
+            ToWChar(localeName),
+            featureRanges,
+            featureRangeLengths,
+            featureRangeCount,
+            OUT glyphAdvances.data(),
+            OUT glyphOffsets.data()
+            );
+    }
+    else
+    {
+        hr = textAnalyzer->GetGdiCompatibleGlyphPlacements(
+            ToWChar(text.data()),
+            clusterMap.data(),
+            textProperties.data(),
+            textLength,
+            glyphIndices.data(),
+            glyphProperties.data(),
+            actualGlyphCount,
+            fontFace,
+            fontEmSize,
+            1.0f, // pixelsPerDip
+            nullptr, // transform
+            measuringMode == DWRITE_MEASURING_MODE_GDI_NATURAL,
+            isSideways,
+            isRightToLeft,
+            &scriptAnalysis,
+            ToWChar(localeName),
+            featureRanges,
+            featureRangeLengths,
+            featureRangeCount,
+            OUT glyphAdvances.data(),
+            OUT glyphOffsets.data()
+            );
+    }
+    if (FAILED(hr))
+    {
+        glyphIndices.clear();
+        glyphAdvances.clear();
+        glyphOffsets.clear();
+        return hr;
+    }
+
+    return S_OK;
+}
+
+
 HRESULT PlacementsToAbsolutePoints(
     IDWriteFontFace* fontFace,
     float fontEmSize,
@@ -1173,7 +1595,7 @@ HRESULT PlacementsToAbsoluteOffsets(
 
     DWRITE_FONT_METRICS fontMetrics = {};
     fontMetrics.designUnitsPerEm = 2048; // Set a default to avoid division by zero
-    std::vector<int32_t> designGlyphAdvances(glyphCount);
+    scratch_vector<int32_t> designGlyphAdvances(glyphCount); // Zeroed in case there is no font face.
 
     if (fontFace != nullptr)
     {
@@ -1185,7 +1607,7 @@ HRESULT PlacementsToAbsoluteOffsets(
             {glyphIndices, glyphIndices + glyphCount},
             DWRITE_MEASURING_MODE_NATURAL, // measuringMode
             isSideways,
-            OUT designGlyphAdvances
+            OUT designGlyphAdvances.data_span()
             );
     }
 
@@ -1659,6 +2081,7 @@ bool IsKnownFontFileExtension(_In_z_ const wchar_t* fileExtension) noexcept
     return (_wcsicmp(fileExtension, L".otf") == 0
         ||  _wcsicmp(fileExtension, L".ttf") == 0
         ||  _wcsicmp(fileExtension, L".ttc") == 0
+        ||  _wcsicmp(fileExtension, L".otc") == 0
         ||  _wcsicmp(fileExtension, L".tte") == 0
             );
 }
@@ -1710,14 +2133,18 @@ public:
         IDWriteRenderingParams* renderingParams,
         COLORREF textColor = 0x00000000,
         uint32_t colorPaletteIndex = 0xFFFFFFFF,
-        bool enablePixelSnapping = true
+        bool enablePixelSnapping = true,
+        BitmapRenderTargetGlyphRunDrawer const* glyphRunDrawer = nullptr,
+        ColorGlyphLayerCache* colorGlyphLayerCache = nullptr
         )
     :   dwriteFactory_(dwriteFactory),
         renderTarget_(renderTarget),
         renderingParams_(renderingParams),
         textColor_(textColor),
         colorPaletteIndex_(colorPaletteIndex),
-        enablePixelSnapping_(enablePixelSnapping)
+        enablePixelSnapping_(enablePixelSnapping),
+        glyphRunDrawer_(glyphRunDrawer),
+        colorGlyphLayerCache_(colorGlyphLayerCache)
     { }
 
     class TransformSetter
@@ -1828,7 +2255,9 @@ public:
             baselineOriginY,
             renderingParams_,
             textColor_,
-            colorPaletteIndex_
+            colorPaletteIndex_,
+            (glyphRunDrawer_ != nullptr) ? *glyphRunDrawer_ : nullptr,
+            colorGlyphLayerCache_
             );
         #endif
 
@@ -2045,6 +2474,8 @@ public:
     COLORREF textColor_;
     uint32_t colorPaletteIndex_;
     bool enablePixelSnapping_;
+    BitmapRenderTargetGlyphRunDrawer const* glyphRunDrawer_; // optional
+    ColorGlyphLayerCache* colorGlyphLayerCache_; // optional
 };
 
 
@@ -2057,13 +2488,24 @@ HRESULT DrawTextLayout(
     float y,
     COLORREF textColor,
     uint32_t colorPaletteIndex,
-    bool enablePixelSnapping
+    bool enablePixelSnapping,
+    BitmapRenderTargetGlyphRunDrawer const& glyphRunDrawer,
+    _In_opt_ ColorGlyphLayerCache* colorGlyphLayerCache
     ) noexcept
 {
     if (renderTarget == nullptr || renderingParams == nullptr || textLayout == nullptr)
         return E_INVALIDARG;
 
-    BitmapRenderTargetTextRenderer textRenderer(dwriteFactory, renderTarget, renderingParams, textColor, colorPaletteIndex, enablePixelSnapping);
+    BitmapRenderTargetTextRenderer textRenderer(
+        dwriteFactory,
+        renderTarget,
+        renderingParams,
+        textColor,
+        colorPaletteIndex,
+        enablePixelSnapping,
+        glyphRunDrawer ? &glyphRunDrawer : nullptr,
+        colorGlyphLayerCache
+        );
     return textLayout->Draw(nullptr, &textRenderer, x, y);
 }
 
@@ -2143,46 +2585,287 @@ namespace
         }
         return hr;
     }
-}
 
+    HRESULT DrawBitmapRenderTargetGlyphRun(
+        IDWriteBitmapRenderTarget* renderTarget,
+        BitmapRenderTargetGlyphRunDrawer const& glyphRunDrawer,
+        float baselineOriginX,
+        float baselineOriginY,
+        DWRITE_MEASURING_MODE measuringMode,
+        DWRITE_GLYPH_RUN const& glyphRun,
+        IDWriteRenderingParams* renderingParams,
+        COLORREF textColor
+        )
+    {
+        if (glyphRunDrawer)
+        {
+            HRESULT hr = glyphRunDrawer(baselineOriginX, baselineOriginY, measuringMode, glyphRun, renderingParams, textColor);
+            if (hr != S_FALSE)
+                return hr;
+        }
 
-HRESULT DrawColorGlyphRun(
-    IDWriteFactory* dwriteFactory,
-    IDWriteBitmapRenderTarget* renderTarget,
-    DWRITE_GLYPH_RUN const& glyphRun,
-    DWRITE_MATRIX const& transform,
-    DWRITE_MEASURING_MODE measuringMode,
-    float baselineOriginX,
-    float baselineOriginY,
-    IDWriteRenderingParams* renderingParams,
-    COLORREF textColor,
-    uint32_t colorPalette // 0xFFFFFFFF if none
-    ) noexcept
-{
-    textColor &= 0x00FFFFFF; // GDI may render nothing in outline mode if alpha byte is set.
+        return renderTarget->DrawGlyphRun(
+            baselineOriginX,
+            baselineOriginY,
+            measuringMode,
+            &glyphRun,
+            renderingParams,
+            textColor,
+            nullptr // don't need blackBoxRect
+            );
+    }
 
-    ComPtr<IDWriteColorGlyphRunEnumerator> colorEnumerator;
-    auto hr = GetColorGlyphRunEnumerator(
-        dwriteFactory,
-        glyphRun,
-        transform,
-        baselineOriginX,
-        baselineOriginY,
-        colorPalette,
-        OUT &colorEnumerator
-        );
 
-    if (hr == DWRITE_E_NOCOLOR)
+    // Draw a horizontal left-to-right run using the cached color layers of
+    // each glyph. Consecutive glyphs without color are drawn together as one
+    // run in the text color, and each layer of a color glyph is drawn as its
+    // own single glyph run. Returns S_FALSE if the run should be translated
+    // directly instead.
+    HRESULT DrawCachedColorGlyphLayers(
+        IDWriteFactory* dwriteFactory,
+        ColorGlyphLayerCache& colorGlyphLayerCache,
+        DWRITE_GLYPH_RUN const& glyphRun,
+        DWRITE_MEASURING_MODE measuringMode,
+        float baselineOriginX,
+        float baselineOriginY,
+        uint32_t colorPalette,
+        std::function<HRESULT(float x, float y, DWRITE_GLYPH_RUN const& run, _In_opt_ DWRITE_COLOR_F const* runColor)> const& drawRun
+        )
     {
-        // No color information; draw the top line with no color translation.
-        IFR(renderTarget->DrawGlyphRun(
-                baselineOriginX,
-                baselineOriginY,
+        if (glyphRun.isSideways || (glyphRun.bidiLevel & 1) || colorPalette == 0xFFFFFFFF)
+            return S_FALSE;
+
+        ComPtr<IDWriteFontFace2> fontFace2;
+        if (FAILED(glyphRun.fontFace->QueryInterface(OUT &fontFace2)) || !fontFace2->IsColorFont())
+        {
+            return drawRun(baselineOriginX, baselineOriginY, glyphRun, nullptr);
+        }
+
+        // Fall back to the default palette if the current palette index is out of range.
+        if (colorPalette >= fontFace2->GetColorPaletteCount())
+            colorPalette = 0;
+
+        float const* glyphAdvances = glyphRun.glyphAdvances;
+        scratch_vector<float, false> glyphAdvancesBuffer((glyphAdvances == nullptr) ? glyphRun.glyphCount : 0);
+        if (glyphAdvances == nullptr)
+        {
+            IFR(GetFontFaceAdvances(
+                glyphRun.fontFace,
+                glyphRun.fontEmSize,
+                { glyphRun.glyphIndices, glyphRun.glyphCount },
                 measuringMode,
-                &glyphRun,
-                renderingParams,
-                textColor,
-                nullptr // don't need blackBoxRect
+                /*isSideways*/ false,
+                OUT glyphAdvancesBuffer.data_span()
+                ));
+            glyphAdvances = glyphAdvancesBuffer.data();
+        }
+
+        DWRITE_GLYPH_RUN partialGlyphRun = glyphRun;
+        partialGlyphRun.glyphAdvances = glyphAdvances;
+        uint32_t plainGlyphStart = 0;
+        float plainGlyphX = baselineOriginX;
+        float glyphX = baselineOriginX;
+
+        auto drawPlainGlyphs = [&](uint32_t plainGlyphEnd) -> HRESULT
+        {
+            if (plainGlyphEnd <= plainGlyphStart)
+                return S_OK;
+
+            partialGlyphRun.glyphCount = plainGlyphEnd - plainGlyphStart;
+            partialGlyphRun.glyphIndices = glyphRun.glyphIndices + plainGlyphStart;
+            partialGlyphRun.glyphAdvances = glyphAdvances + plainGlyphStart;
+            partialGlyphRun.glyphOffsets = (glyphRun.glyphOffsets != nullptr) ? glyphRun.glyphOffsets + plainGlyphStart : nullptr;
+            return drawRun(plainGlyphX, baselineOriginY, partialGlyphRun, nullptr);
+        };
+
+        for (uint32_t i = 0; i < glyphRun.glyphCount; ++i)
+        {
+            array_ref<ColorGlyphLayerCache::Layer const> layers;
+            IFR(colorGlyphLayerCache.GetLayers(dwriteFactory, glyphRun.fontFace, colorPalette, glyphRun.glyphIndices[i], OUT layers));
+
+            if (!layers.empty())
+            {
+                IFR(drawPlainGlyphs(i));
+
+                partialGlyphRun.glyphCount = 1;
+                partialGlyphRun.glyphAdvances = &glyphAdvances[i];
+                partialGlyphRun.glyphOffsets = (glyphRun.glyphOffsets != nullptr) ? &glyphRun.glyphOffsets[i] : nullptr;
+                for (auto const& layer : layers)
+                {
+                    partialGlyphRun.glyphIndices = &layer.glyphId;
+                    IFR(drawRun(glyphX, baselineOriginY, partialGlyphRun, (layer.paletteIndex == 0xFFFF) ? nullptr : &layer.runColor));
+                }
+
+                plainGlyphStart = i + 1;
+                plainGlyphX = glyphX + glyphAdvances[i];
+            }
+            glyphX += glyphAdvances[i];
+        }
+
+        return drawPlainGlyphs(glyphRun.glyphCount);
+    }
+}
+
+
+HRESULT ColorGlyphLayerCache::GetLayers(
+    IDWriteFactory* dwriteFactory,
+    IDWriteFontFace* fontFace,
+    uint32_t colorPalette,
+    uint16_t glyphId,
+    _Out_ array_ref<Layer const>& layers
+    )
+{
+    layers.clear();
+
+    Key key = { fontFace, colorPalette, glyphId };
+    auto match = entries_.find(key);
+    if (match == entries_.end())
+    {
+        if (layers_.size() >= maximumLayerCount)
+        {
+            Clear();
+        }
+
+        // Translate the lone glyph at the origin. The size is arbitrary since
+        // only outline layers are kept, which are all positioned at the origin.
+        float const glyphAdvance = 0;
+        DWRITE_GLYPH_RUN const glyphRun = { fontFace, 16.0f, 1, &glyphId, &glyphAdvance, nullptr, false, 0 };
+        DWRITE_MATRIX const identityTransform = { 1, 0, 0, 1, 0, 0 };
+
+        ComPtr<IDWriteColorGlyphRunEnumerator> colorEnumerator;
+        HRESULT hr = GetColorGlyphRunEnumerator(dwriteFactory, glyphRun, identityTransform, 0, 0, colorPalette, OUT &colorEnumerator);
+        if (FAILED(hr) && hr != DWRITE_E_NOCOLOR)
+            return hr;
+
+        Entry entry = { uint32_t(layers_.size()), 0 };
+        if (hr != DWRITE_E_NOCOLOR)
+        {
+            ComPtr<IDWriteColorGlyphRunEnumerator1> colorEnumerator1;
+            colorEnumerator->QueryInterface(OUT &colorEnumerator1);
+
+            for (;;)
+            {
+                BOOL haveRun;
+                IFR(colorEnumerator->MoveNext(OUT &haveRun));
+                if (!haveRun)
+                    break;
+
+                DWRITE_COLOR_GLYPH_RUN const* colorRun = nullptr;
+                if (colorEnumerator1 != nullptr)
+                {
+                    DWRITE_COLOR_GLYPH_RUN1 const* colorRun1 = nullptr;
+                    IFR(colorEnumerator1->GetCurrentRun(OUT &colorRun1));
+                    if (!(colorRun1->glyphImageFormat & (DWRITE_GLYPH_IMAGE_FORMATS_TRUETYPE | DWRITE_GLYPH_IMAGE_FORMATS_CFF | DWRITE_GLYPH_IMAGE_FORMATS_COLR)))
+                        continue; // Bitmap layers are not drawn here either.
+                    colorRun = colorRun1;
+                }
+                else
+                {
+                    IFR(colorEnumerator->GetCurrentRun(OUT &colorRun));
+                }
+
+                for (uint32_t i = 0; i < colorRun->glyphRun.glyphCount; ++i)
+                {
+                    layers_.push_back({ colorRun->glyphRun.glyphIndices[i], colorRun->paletteIndex, colorRun->runColor });
+                }
+            }
+            entry.layerCount = uint32_t(layers_.size()) - entry.layerOffset;
+
+            // A color font returns its monochrome glyphs as a single layer in
+            // the text color, which is the same as no color.
+            if (entry.layerCount == 1 && layers_.back().glyphId == glyphId && layers_.back().paletteIndex == 0xFFFF)
+            {
+                layers_.pop_back();
+                entry.layerCount = 0;
+            }
+        }
+
+        auto& heldFontFace = fontFaces_[fontFace];
+        if (heldFontFace == nullptr)
+        {
+            heldFontFace = fontFace;
+        }
+        match = entries_.emplace(key, entry).first;
+    }
+
+    Entry const& entry = match->second;
+    if (entry.layerCount > 0)
+    {
+        layers.reset(layers_.data() + entry.layerOffset, layers_.data() + entry.layerOffset + entry.layerCount);
+    }
+    return S_OK;
+}
+
+
+void ColorGlyphLayerCache::Clear()
+{
+    entries_.clear();
+    layers_.clear();
+    fontFaces_.clear();
+}
+
+
+size_t ColorGlyphLayerCache::GetByteSize() const noexcept
+{
+    return sizeof(*this)
+        + entries_.size() * (sizeof(Key) + sizeof(Entry))
+        + layers_.size() * sizeof(Layer)
+        + fontFaces_.size() * sizeof(void*) * 2;
+}
+
+
+HRESULT DrawColorGlyphRun(
+    IDWriteFactory* dwriteFactory,
+    IDWriteBitmapRenderTarget* renderTarget,
+    DWRITE_GLYPH_RUN const& glyphRun,
+    DWRITE_MATRIX const& transform,
+    DWRITE_MEASURING_MODE measuringMode,
+    float baselineOriginX,
+    float baselineOriginY,
+    IDWriteRenderingParams* renderingParams,
+    COLORREF textColor,
+    uint32_t colorPalette, // 0xFFFFFFFF if none
+    BitmapRenderTargetGlyphRunDrawer const& glyphRunDrawer,
+    _In_opt_ ColorGlyphLayerCache* colorGlyphLayerCache
+    ) noexcept
+{
+    textColor &= 0x00FFFFFF; // GDI may render nothing in outline mode if alpha byte is set.
+
+    if (colorGlyphLayerCache != nullptr)
+    {
+        auto drawRun = [&](float x, float y, DWRITE_GLYPH_RUN const& run, _In_opt_ DWRITE_COLOR_F const* runColor) -> HRESULT
+        {
+            COLORREF const color = (runColor == nullptr) ? textColor : ToCOLORREF(*runColor);
+            return DrawBitmapRenderTargetGlyphRun(renderTarget, glyphRunDrawer, x, y, measuringMode, run, renderingParams, color);
+        };
+        HRESULT hr = DrawCachedColorGlyphLayers(dwriteFactory, *colorGlyphLayerCache, glyphRun, measuringMode, baselineOriginX, baselineOriginY, colorPalette, drawRun);
+        if (hr != S_FALSE)
+            return hr;
+    }
+
+    ComPtr<IDWriteColorGlyphRunEnumerator> colorEnumerator;
+    auto hr = GetColorGlyphRunEnumerator(
+        dwriteFactory,
+        glyphRun,
+        transform,
+        baselineOriginX,
+        baselineOriginY,
+        colorPalette,
+        OUT &colorEnumerator
+        );
+
+    if (hr == DWRITE_E_NOCOLOR)
+    {
+        // No color information; draw the top line with no color translation.
+        IFR(DrawBitmapRenderTargetGlyphRun(
+                renderTarget,
+                glyphRunDrawer,
+                baselineOriginX,
+                baselineOriginY,
+                measuringMode,
+                glyphRun,
+                renderingParams,
+                textColor
                 ));
         hr = S_OK;
     }
@@ -2224,14 +2907,15 @@ HRESULT DrawColorGlyphRun(
             case uint32_t(DWRITE_GLYPH_IMAGE_FORMATS_CFF)|uint32_t(DWRITE_GLYPH_IMAGE_FORMATS_COLR):
             case uint32_t(DWRITE_GLYPH_IMAGE_FORMATS_TRUETYPE)|uint32_t(DWRITE_GLYPH_IMAGE_FORMATS_CFF):
             case DWRITE_GLYPH_IMAGE_FORMATS_CFF:
-                IFR(renderTarget->DrawGlyphRun(
+                IFR(DrawBitmapRenderTargetGlyphRun(
+                    renderTarget,
+                    glyphRunDrawer,
                     colorRun->baselineOriginX,
                     colorRun->baselineOriginY,
                     measuringMode,
-                    &colorRun->glyphRun,
+                    colorRun->glyphRun,
                     renderingParams,
-                    runColor,
-                    nullptr // don't need blackBoxRect
+                    runColor
                     ));
             case DWRITE_GLYPH_IMAGE_FORMATS_PNG:
                 // todo:::
@@ -2253,9 +2937,33 @@ HRESULT DrawColorGlyphRun(
     float baselineOriginX,
     float baselineOriginY,
     ID2D1Brush* brush,
-    uint32_t colorPalette // 0xFFFFFFFF if none
+    uint32_t colorPalette, // 0xFFFFFFFF if none
+    _In_opt_ ColorGlyphLayerCache* colorGlyphLayerCache
     ) noexcept
 {
+    if (colorGlyphLayerCache != nullptr)
+    {
+        ComPtr<ID2D1SolidColorBrush> layerBrush;
+        auto drawRun = [&](float x, float y, DWRITE_GLYPH_RUN const& run, _In_opt_ DWRITE_COLOR_F const* runColor) -> HRESULT
+        {
+            auto* currentBrush = brush;
+            if (runColor != nullptr)
+            {
+                if (layerBrush == nullptr)
+                {
+                    IFR(renderTarget->CreateSolidColorBrush(*runColor, OUT &layerBrush));
+                }
+                layerBrush->SetColor(*runColor);
+                currentBrush = layerBrush;
+            }
+            renderTarget->DrawGlyphRun({ x, y }, &run, currentBrush, measuringMode);
+            return S_OK;
+        };
+        HRESULT hr = DrawCachedColorGlyphLayers(dwriteFactory, *colorGlyphLayerCache, glyphRun, measuringMode, baselineOriginX, baselineOriginY, colorPalette, drawRun);
+        if (hr != S_FALSE)
+            return hr;
+    }
+
     ComPtr<IDWriteColorGlyphRunEnumerator> colorLayers;
     auto hr = GetColorGlyphRunEnumerator(
             dwriteFactory,
@@ -2313,75 +3021,624 @@ HRESULT DrawColorGlyphRun(
 }
 
 
+// Records the outline commands into a GlyphRunOutline. It lives on the stack
+// for the duration of GetGlyphRunOutline, so the reference count is unused.
+class GlyphRunOutlineRecorder : public ComBase<ID2D1SimplifiedGeometrySink, RefCountBaseStatic>
+{
+public:
+    explicit GlyphRunOutlineRecorder(GlyphRunOutline& outline) noexcept
+    :   outline_(outline)
+    { }
+
+    IFACEMETHODIMP QueryInterface(IID const& iid, __out void** object) override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, ID2D1SimplifiedGeometrySink, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    IFACEMETHODIMP_(void) SetFillMode(D2D1_FILL_MODE fillMode) override
+    {
+        outline_.fillMode_ = fillMode;
+    }
+
+    IFACEMETHODIMP_(void) SetSegmentFlags(D2D1_PATH_SEGMENT vertexFlags) override
+    { }
+
+    IFACEMETHODIMP_(void) BeginFigure(D2D1_POINT_2F startPoint, D2D1_FIGURE_BEGIN figureBegin) override
+    {
+        auto type = (figureBegin == D2D1_FIGURE_BEGIN_FILLED) ? GlyphRunOutline::CommandTypeBeginFigureFilled : GlyphRunOutline::CommandTypeBeginFigureHollow;
+        outline_.commands_.push_back({ type, 1 });
+        outline_.points_.push_back(startPoint);
+    }
+
+    IFACEMETHODIMP_(void) AddLines(_In_reads_(pointsCount) D2D1_POINT_2F const* points, UINT32 pointsCount) override
+    {
+        outline_.commands_.push_back({ GlyphRunOutline::CommandTypeAddLines, pointsCount });
+        outline_.points_.insert(outline_.points_.end(), points, points + pointsCount);
+    }
+
+    IFACEMETHODIMP_(void) AddBeziers(_In_reads_(beziersCount) D2D1_BEZIER_SEGMENT const* beziers, UINT32 beziersCount) override
+    {
+        static_assert(sizeof(D2D1_BEZIER_SEGMENT) == sizeof(D2D1_POINT_2F) * 3, "Bezier segments are expected to be three points.");
+        auto* points = reinterpret_cast<D2D1_POINT_2F const*>(beziers);
+        outline_.commands_.push_back({ GlyphRunOutline::CommandTypeAddBeziers, beziersCount * 3 });
+        outline_.points_.insert(outline_.points_.end(), points, points + beziersCount * 3);
+    }
+
+    IFACEMETHODIMP_(void) EndFigure(D2D1_FIGURE_END figureEnd) override
+    {
+        auto type = (figureEnd == D2D1_FIGURE_END_CLOSED) ? GlyphRunOutline::CommandTypeEndFigureClosed : GlyphRunOutline::CommandTypeEndFigureOpen;
+        outline_.commands_.push_back({ type, 0 });
+    }
+
+    IFACEMETHODIMP Close() override
+    {
+        return S_OK;
+    }
+
+protected:
+    GlyphRunOutline& outline_;
+};
+
+
+HRESULT GlyphRunOutline::Record(
+    IDWriteFontFace* fontFace,
+    float fontEmSize,
+    array_ref<uint16_t const> glyphIndices,
+    array_ref<float const> glyphAdvances,
+    bool isSideways,
+    bool isRightToLeft
+    ) noexcept
+{
+    Clear();
+
+    if (!glyphAdvances.empty() && glyphAdvances.size() < glyphIndices.size())
+        return E_INVALIDARG;
+
+    if (glyphIndices.empty())
+        return S_OK;
+
+    GlyphRunOutlineRecorder recorder(*this);
+    HRESULT hr = fontFace->GetGlyphRunOutline(
+        fontEmSize,
+        glyphIndices.data(),
+        glyphAdvances.empty() ? nullptr : glyphAdvances.data(),
+        nullptr, // glyphOffsets
+        static_cast<uint32_t>(glyphIndices.size()),
+        isSideways,
+        isRightToLeft,
+        &recorder
+        );
+
+    if (FAILED(hr))
+    {
+        Clear();
+    }
+
+    return hr;
+}
+
+
+void GlyphRunOutline::Replay(ID2D1SimplifiedGeometrySink* geometrySink) const noexcept
+{
+    geometrySink->SetFillMode(fillMode_);
+
+    D2D1_POINT_2F const* points = points_.data();
+    for (auto const& command : commands_)
+    {
+        switch (command.type)
+        {
+        case CommandTypeBeginFigureFilled: geometrySink->BeginFigure(points[0], D2D1_FIGURE_BEGIN_FILLED); break;
+        case CommandTypeBeginFigureHollow: geometrySink->BeginFigure(points[0], D2D1_FIGURE_BEGIN_HOLLOW); break;
+        case CommandTypeAddLines:          geometrySink->AddLines(points, command.pointCount); break;
+        case CommandTypeAddBeziers:        geometrySink->AddBeziers(reinterpret_cast<D2D1_BEZIER_SEGMENT const*>(points), command.pointCount / 3); break;
+        case CommandTypeEndFigureOpen:     geometrySink->EndFigure(D2D1_FIGURE_END_OPEN); break;
+        case CommandTypeEndFigureClosed:   geometrySink->EndFigure(D2D1_FIGURE_END_CLOSED); break;
+        }
+        points += command.pointCount;
+    }
+}
+
+
+HRESULT GlyphRunOutline::CreatePathGeometry(
+    ID2D1Factory* d2dFactory,
+    _COM_Outptr_ ID2D1PathGeometry** pathGeometry
+    ) const noexcept
+{
+    *pathGeometry = nullptr;
+
+    ComPtr<ID2D1PathGeometry> newPathGeometry;
+    ComPtr<ID2D1GeometrySink> geometrySink;
+    IFR(d2dFactory->CreatePathGeometry(OUT &newPathGeometry));
+    IFR(newPathGeometry->Open(OUT &geometrySink));
+    Replay(geometrySink);
+    IFR(geometrySink->Close());
+
+    *pathGeometry = newPathGeometry.Detach();
+    return S_OK;
+}
+
+
+void GlyphRunOutline::Clear() noexcept
+{
+    commands_.clear();
+    points_.clear();
+    fillMode_ = D2D1_FILL_MODE_WINDING;
+}
+
+
+size_t GlyphRunOutline::GetByteSize() const noexcept
+{
+    return sizeof(*this)
+        + commands_.size() * sizeof(commands_[0])
+        + points_.size() * sizeof(points_[0]);
+}
+
+
+namespace
+{
+    using CharacterRanges = FontCharacterRangesCache::CharacterRanges;
+
+
+    void AppendCharacterRange(IN OUT CharacterRanges& ranges, char32_t first, char32_t last)
+    {
+        // Callers append in ascending order, so coalesce with the previous range when adjacent.
+        if (!ranges.empty() && ranges.back().last + 1 >= first)
+        {
+            ranges.back().last = std::max(ranges.back().last, last);
+            return;
+        }
+        ranges.push_back({first, last});
+    }
+
+
+    uint32_t ReadBigEndianUint16(array_ref<uint8_t const> data, size_t offset) noexcept
+    {
+        if (offset + 2 > data.size())
+            return 0;
+        return (uint32_t(data[offset]) << 8) | data[offset + 1];
+    }
+
+
+    uint32_t ReadBigEndianUint32(array_ref<uint8_t const> data, size_t offset) noexcept
+    {
+        if (offset + 4 > data.size())
+            return 0;
+        return (uint32_t(data[offset]) << 24) | (uint32_t(data[offset + 1]) << 16) | (uint32_t(data[offset + 2]) << 8) | data[offset + 3];
+    }
+
+
+    void ReadCmapFormat4Ranges(array_ref<uint8_t const> subtable, IN OUT CharacterRanges& ranges)
+    {
+        uint32_t const segmentCount = ReadBigEndianUint16(subtable, 6) / 2;
+        size_t const endCodesOffset = 14;
+        size_t const startCodesOffset = endCodesOffset + segmentCount * 2 + 2; // Skip reservedPad.
+        size_t const idDeltasOffset = startCodesOffset + segmentCount * 2;
+        size_t const idRangeOffsetsOffset = idDeltasOffset + segmentCount * 2;
+
+        for (uint32_t i = 0; i < segmentCount; ++i)
+        {
+            uint32_t const startCode = ReadBigEndianUint16(subtable, startCodesOffset + i * 2);
+            uint32_t const endCode = ReadBigEndianUint16(subtable, endCodesOffset + i * 2);
+            uint32_t const idDelta = ReadBigEndianUint16(subtable, idDeltasOffset + i * 2);
+            size_t const idRangeOffsetOffset = idRangeOffsetsOffset + i * 2;
+            uint32_t const idRangeOffset = ReadBigEndianUint16(subtable, idRangeOffsetOffset);
+
+            for (uint32_t ch = startCode; ch <= endCode && ch < 0xFFFF; ++ch)
+            {
+                uint32_t glyphId;
+                if (idRangeOffset == 0)
+                {
+                    glyphId = (ch + idDelta) & 0xFFFF;
+                }
+                else
+                {
+                    // The offset is relative to the idRangeOffset entry itself.
+                    glyphId = ReadBigEndianUint16(subtable, idRangeOffsetOffset + idRangeOffset + (ch - startCode) * 2);
+                    if (glyphId != 0)
+                        glyphId = (glyphId + idDelta) & 0xFFFF;
+                }
+
+                if (glyphId != 0)
+                    AppendCharacterRange(IN OUT ranges, ch, ch);
+            }
+        }
+    }
+
+
+    void ReadCmapFormat12Ranges(array_ref<uint8_t const> subtable, IN OUT CharacterRanges& ranges)
+    {
+        uint32_t const groupCount = ReadBigEndianUint32(subtable, 12);
+        size_t const groupsOffset = 16;
+        size_t const groupSize = 12;
+
+        if (groupCount > (subtable.size() - std::min(subtable.size(), groupsOffset)) / groupSize)
+            return; // Truncated table.
+
+        for (uint32_t i = 0; i < groupCount; ++i)
+        {
+            size_t const groupOffset = groupsOffset + i * groupSize;
+            char32_t first = ReadBigEndianUint32(subtable, groupOffset + 0);
+            char32_t last = std::min(ReadBigEndianUint32(subtable, groupOffset + 4), uint32_t(UnicodeTotal - 1));
+            uint32_t const startGlyphId = ReadBigEndianUint32(subtable, groupOffset + 8);
+
+            if (first > last)
+                continue;
+
+            // Only the first character of a group starting at glyph 0 maps to .notdef.
+            if (startGlyphId == 0)
+            {
+                if (first == last)
+                    continue;
+                ++first;
+            }
+
+            AppendCharacterRange(IN OUT ranges, first, last);
+        }
+    }
+
+
+    // Read the covered characters straight from the best Unicode cmap
+    // subtable, cheaper than querying the glyph of every code point. Returns
+    // S_FALSE if the font has no Unicode subtable (like symbol fonts, which
+    // DWrite remaps), to let the caller fall back to GetGlyphIndices.
+    HRESULT GetCmapCharacterRanges(IDWriteFontFace* fontFace, OUT CharacterRanges& ranges)
+    {
+        ranges.clear();
+
+        void const* tableData = nullptr;
+        uint32_t tableSize = 0;
+        void* tableContext = nullptr;
+        BOOL exists = false;
+
+        IFR(fontFace->TryGetFontTable(DWRITE_MAKE_OPENTYPE_TAG('c', 'm', 'a', 'p'), OUT &tableData, OUT &tableSize, OUT &tableContext, OUT &exists));
+        if (!exists)
+            return S_FALSE;
+
+        auto tableCleanup = DeferCleanup([&] { fontFace->ReleaseFontTable(tableContext); });
+        array_ref<uint8_t const> table(reinterpret_cast<uint8_t const*>(tableData), tableSize);
+
+        // Prefer a full repertoire format 12 subtable over a BMP only format 4 one.
+        uint32_t const subtableCount = ReadBigEndianUint16(table, 2);
+        uint32_t bestSubtableOffset = 0;
+        uint32_t bestSubtableFormat = 0;
+
+        for (uint32_t i = 0; i < subtableCount; ++i)
+        {
+            size_t const recordOffset = 4 + i * 8;
+            uint32_t const platformId = ReadBigEndianUint16(table, recordOffset + 0);
+            uint32_t const encodingId = ReadBigEndianUint16(table, recordOffset + 2);
+            uint32_t const subtableOffset = ReadBigEndianUint32(table, recordOffset + 4);
+            uint32_t const format = ReadBigEndianUint16(table, subtableOffset);
+
+            bool const isUnicode = (platformId == 0) || (platformId == 3 && (encodingId == 1 || encodingId == 10));
+            if (!isUnicode || subtableOffset >= tableSize)
+                continue;
+
+            if ((format == 12 && bestSubtableFormat != 12) || (format == 4 && bestSubtableFormat == 0))
+            {
+                bestSubtableOffset = subtableOffset;
+                bestSubtableFormat = format;
+            }
+        }
+
+        auto subtable = table.get_slice(bestSubtableOffset, tableSize);
+        switch (bestSubtableFormat)
+        {
+        case 4:  ReadCmapFormat4Ranges(subtable, IN OUT ranges); break;
+        case 12: ReadCmapFormat12Ranges(subtable, IN OUT ranges); break;
+        default: return S_FALSE;
+        }
+
+        return S_OK;
+    }
+
+
+    HRESULT GetGlyphIndicesCharacterRanges(IDWriteFontFace* fontFace, OUT CharacterRanges& ranges)
+    {
+        ranges.clear();
+
+        // Query in blocks rather than allocating for the whole Unicode range at once.
+        constexpr uint32_t blockSize = 0x10000;
+        std::vector<uint32_t> characters(blockSize);
+        std::vector<uint16_t> glyphIds(blockSize);
+
+        for (uint32_t blockStart = 0; blockStart < UnicodeTotal; blockStart += blockSize)
+        {
+            std::iota(characters.begin(), characters.end(), blockStart);
+            IFR(fontFace->GetGlyphIndices(characters.data(), blockSize, OUT glyphIds.data()));
+
+            for (uint32_t i = 0; i < blockSize; ++i)
+            {
+                if (glyphIds[i] != 0)
+                    AppendCharacterRange(IN OUT ranges, blockStart + i, blockStart + i);
+            }
+        }
+
+        return S_OK;
+    }
+
+
+    // Keep only the characters whose glyphs have color data.
+    HRESULT FilterColorCharacterRanges(IDWriteFontFace* fontFace, IN OUT CharacterRanges& ranges)
+    {
+        ComPtr<IDWriteFontFace4> fontFace4;
+        IFR(fontFace->QueryInterface(OUT &fontFace4));
+
+        CharacterRanges colorRanges;
+        if (!(fontFace4->GetGlyphImageFormats() & g_allColorGlyphImageFormats))
+        {
+            ranges.swap(colorRanges);
+            return S_OK;
+        }
+
+        // Many characters can share a glyph, so remember each glyph's answer.
+        enum GlyphColorState : uint8_t { GlyphColorStateUnknown, GlyphColorStateColor, GlyphColorStateNotColor };
+        std::vector<uint8_t> glyphColorStates(fontFace->GetGlyphCount(), GlyphColorStateUnknown);
+        std::vector<uint32_t> characters;
+        std::vector<uint16_t> glyphIds;
+
+        for (auto& range : ranges)
+        {
+            uint32_t const rangeSize = range.last - range.first + 1;
+            characters.resize(rangeSize);
+            glyphIds.resize(rangeSize);
+            std::iota(characters.begin(), characters.end(), range.first);
+            IFR(fontFace->GetGlyphIndices(characters.data(), rangeSize, OUT glyphIds.data()));
+
+            for (uint32_t i = 0; i < rangeSize; ++i)
+            {
+                uint16_t const glyphId = glyphIds[i];
+                if (glyphId >= glyphColorStates.size())
+                    continue;
+
+                if (glyphColorStates[glyphId] == GlyphColorStateUnknown)
+                {
+                    DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormats = DWRITE_GLYPH_IMAGE_FORMATS_NONE;
+                    IFR(fontFace4->GetGlyphImageFormats(glyphId, 0, UINT32_MAX, OUT &glyphImageFormats));
+                    glyphColorStates[glyphId] = (glyphImageFormats & g_allColorGlyphImageFormats) ? GlyphColorStateColor : GlyphColorStateNotColor;
+                }
+
+                if (glyphColorStates[glyphId] == GlyphColorStateColor)
+                    AppendCharacterRange(IN OUT colorRanges, characters[i], characters[i]);
+            }
+        }
+
+        ranges.swap(colorRanges);
+        return S_OK;
+    }
+
+
+    HRESULT GetCharacterCoverageCacheKey(IDWriteFontFace* fontFace, bool getOnlyColorFontCharacters, OUT std::u16string& key)
+    {
+        FILETIME fileTime;
+        IFR(GetFilePath(fontFace, OUT key));
+        IFR(GetFileModifiedDate(fontFace, OUT fileTime));
+
+        wchar_t suffix[64];
+        swprintf_s(
+            OUT suffix,
+            L"|%u|%08X%08X|%u",
+            fontFace->GetIndex(),
+            fileTime.dwHighDateTime,
+            fileTime.dwLowDateTime,
+            getOnlyColorFontCharacters ? 1 : 0
+            );
+        key += ToChar16(suffix);
+
+        return S_OK;
+    }
+
+
+    HRESULT GetFontFaceCharacterRanges(
+        IDWriteFontFace* fontFace,
+        bool getOnlyColorFontCharacters,
+        _Inout_opt_ FontCharacterRangesCache* cache,
+        _Out_ std::shared_ptr<CharacterRanges const>& coverage
+        )
+    {
+        coverage.reset();
+
+        // Fonts not backed by a local file (e.g. in memory) are simply not cached.
+        std::u16string cacheKey;
+        if (cache != nullptr && SUCCEEDED(GetCharacterCoverageCacheKey(fontFace, getOnlyColorFontCharacters, OUT cacheKey)))
+        {
+            coverage = cache->Find(cacheKey);
+            if (coverage != nullptr)
+                return S_OK;
+        }
+
+        auto ranges = std::make_shared<CharacterRanges>();
+        HRESULT hr = GetCmapCharacterRanges(fontFace, OUT *ranges);
+        if (hr == S_FALSE)
+        {
+            hr = GetGlyphIndicesCharacterRanges(fontFace, OUT *ranges);
+        }
+        IFR(hr);
+
+        if (getOnlyColorFontCharacters)
+        {
+            IFR(FilterColorCharacterRanges(fontFace, IN OUT *ranges));
+        }
+
+        coverage = ranges;
+
+        if (!cacheKey.empty())
+        {
+            cache->Add(cacheKey, coverage);
+        }
+
+        return S_OK;
+    }
+
+
+    inline void IncrementCoverageCount(IN OUT uint16_t& count) noexcept
+    {
+        if (count < UINT16_MAX)
+            ++count;
+    }
+
+
+    bool IsCharacterInRanges(CharacterRanges const& ranges, char32_t ch) noexcept
+    {
+        auto match = std::upper_bound(
+            ranges.begin(),
+            ranges.end(),
+            ch,
+            [](char32_t value, CharacterRange const& range) { return value < range.first; }
+            );
+        return match != ranges.begin() && ch <= (match - 1)->last;
+    }
+}
+
+
+std::shared_ptr<FontCharacterRangesCache::CharacterRanges const> FontCharacterRangesCache::Find(std::u16string const& key) const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    auto match = entries_.find(key);
+    return (match != entries_.end()) ? match->second : nullptr;
+}
+
+
+void FontCharacterRangesCache::Add(std::u16string const& key, std::shared_ptr<CharacterRanges const> const& ranges)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    if (entries_.size() >= maximumEntries)
+    {
+        entries_.clear();
+        byteSize_ = 0;
+    }
+
+    auto& entry = entries_[key];
+    if (entry == nullptr)
+    {
+        byteSize_ += key.size() * sizeof(key[0]) + ranges->size() * sizeof(CharacterRange);
+    }
+    entry = ranges;
+}
+
+
+void FontCharacterRangesCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    entries_.clear();
+    byteSize_ = 0;
+}
+
+
+size_t FontCharacterRangesCache::GetByteSize() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return byteSize_;
+}
+
+
+HRESULT GetFontCharacterRanges(
+    IDWriteFontFace* fontFace,
+    bool getOnlyColorFontCharacters,
+    _Inout_opt_ FontCharacterRangesCache* cache,
+    _Out_ std::vector<CharacterRange>& characterRanges
+    )
+{
+    characterRanges.clear();
+
+    std::shared_ptr<CharacterRanges const> ranges;
+    IFR(GetFontFaceCharacterRanges(fontFace, getOnlyColorFontCharacters, cache, OUT ranges));
+    characterRanges = *ranges;
+
+    return S_OK;
+}
+
+
 // Return a per-character (0..UnicodeTotal-1) coverage count for all the
 // font faces, where the array index corresponds to each Unicode code point
 // and is incremented once for each font that supports it. If a specific
 // string of characters is passed, the counts for each character are returned.
+//
+// Coverage is read from each font's cmap, cached per file and modified date
+// if a cache is given, and the font faces are scanned in parallel on the
+// thread pool.
 HRESULT GetFontCharacterCoverageCounts(
     array_ref<IDWriteFontFace* const> fontFaces,
     array_ref<char32_t const> unicodeCharactersIn,
     bool getOnlyColorFontCharacters,
+    _Inout_opt_ FontCharacterRangesCache* cache,
     std::function<void(uint32_t i, uint32_t total)> progress,
     _Out_ std::vector<uint16_t>& coverageCounts
     ) // todo: make noexcept.
 {
     coverageCounts.clear();
 
-    uint32_t unicodeCharactersCount = static_cast<char32_t>(unicodeCharactersIn.size());
-    char32_t const* unicodeCharacters = unicodeCharactersIn.data();
-    const bool useEntireUnicodeRange = (unicodeCharactersCount == 0);
-    if (useEntireUnicodeRange)
-    {
-        unicodeCharactersCount = UnicodeTotal; // All Unicode characters.
-    }
+    const bool useEntireUnicodeRange = unicodeCharactersIn.empty();
+    uint32_t const countsSize = useEntireUnicodeRange ? uint32_t(UnicodeTotal) : static_cast<uint32_t>(unicodeCharactersIn.size());
+    uint32_t const fontFacesCount = static_cast<uint32_t>(fontFaces.size());
+    coverageCounts.resize(countsSize);
 
-    coverageCounts.resize(unicodeCharactersCount);
-    std::vector<char32_t> allUnicodeCharacters;
-    std::vector<uint16_t> glyphIds(unicodeCharactersCount);
+    uint32_t const threadCount = std::max(std::min(std::thread::hardware_concurrency(), fontFacesCount), 1u);
+    std::atomic<uint32_t> nextFontFaceIndex(0);
+    std::atomic<uint32_t> completedFontFaceCount(0);
+    std::atomic<HRESULT> firstFailure(S_OK);
 
-    if (useEntireUnicodeRange)
-    {
-        // No list of characters given, so return the whole Unicode array.
-        allUnicodeCharacters.resize(unicodeCharactersCount);
-        std::iota(allUnicodeCharacters.begin(), allUnicodeCharacters.end(), 0);
-        unicodeCharacters = allUnicodeCharacters.data();
-    }
+    // Each worker sums into its own counts (worker 0 directly into the
+    // output), merged afterward. Only worker 0, the calling thread, reports
+    // progress, since the callback may touch UI.
+    std::vector<std::vector<uint16_t>> threadCoverageCounts(threadCount - 1);
 
-    // Get all the glyphs the font faces support, and increment for each covered character.
-    uint32_t fontFacesCount = static_cast<uint32_t>(fontFaces.size());
-    for (uint32_t i = 0; i < fontFacesCount; ++i)
+    auto countCoverage = [&](uint32_t threadIndex)
     {
-        ComPtr<IDWriteFontFace4> fontFace4;
-        auto* counts = coverageCounts.data();
-        auto* fontFace = fontFaces[i];
+        std::vector<uint16_t>& counts = (threadIndex == 0) ? coverageCounts : threadCoverageCounts[threadIndex - 1];
+        counts.resize(countsSize);
 
-        IFR(fontFace->GetGlyphIndices(reinterpret_cast<uint32_t const*>(unicodeCharacters), unicodeCharactersCount, glyphIds.data()));
-        if (getOnlyColorFontCharacters)
+        for (;;)
         {
-            IFR(fontFace->QueryInterface(OUT &fontFace4));
-        }
-        
-        for (char32_t ch = 0; ch < unicodeCharactersCount; ++ch)
-        {
-            if (glyphIds[ch] == 0)
-                continue;
+            uint32_t fontFaceIndex = nextFontFaceIndex++;
+            if (fontFaceIndex >= fontFacesCount || FAILED(firstFailure))
+                break;
+
+            std::shared_ptr<CharacterRanges const> ranges;
+            HRESULT hr = GetFontFaceCharacterRanges(fontFaces[fontFaceIndex], getOnlyColorFontCharacters, cache, OUT ranges);
+            if (FAILED(hr))
+            {
+                HRESULT noFailure = S_OK;
+                firstFailure.compare_exchange_strong(IN OUT noFailure, hr);
+                break;
+            }
 
-            if (getOnlyColorFontCharacters)
+            if (useEntireUnicodeRange)
             {
-                DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormats = DWRITE_GLYPH_IMAGE_FORMATS_NONE;
-                IFR(fontFace4->GetGlyphImageFormats(glyphIds[ch], 0, UINT32_MAX, OUT &glyphImageFormats));
-                if (!(glyphImageFormats & g_allColorGlyphImageFormats))
+                for (auto& range : *ranges)
                 {
-                    continue;
+                    for (char32_t ch = range.first; ch <= range.last; ++ch)
+                    {
+                        IncrementCoverageCount(IN OUT counts[ch]);
+                    }
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i < countsSize; ++i)
+                {
+                    if (IsCharacterInRanges(*ranges, unicodeCharactersIn[i]))
+                        IncrementCoverageCount(IN OUT counts[i]);
                 }
             }
 
-            // Found another character supported by the font.
-            if (++counts[ch] == 0)
-                counts[ch] = UINT16_MAX;
+            uint32_t completedCount = ++completedFontFaceCount;
+            if (threadIndex == 0)
+                progress(completedCount - 1, fontFacesCount);
         }
+    };
+
+    RunWorkers(threadCount, countCoverage); // This thread is worker 0.
+    IFR(firstFailure);
 
-        progress(i, fontFacesCount);
+    for (auto& counts : threadCoverageCounts)
+    {
+        for (uint32_t i = 0; i < countsSize; ++i)
+        {
+            coverageCounts[i] = uint16_t(std::min(uint32_t(coverageCounts[i]) + counts[i], uint32_t(UINT16_MAX)));
+        }
     }
 
     return S_OK;
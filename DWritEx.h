@@ -52,6 +52,14 @@ HRESULT LoadDWrite(
     _Out_ HMODULE& moduleHandle
     ) noexcept;
 
+// Get the file version of a loaded module, packed major to revision from the
+// high word down, such as a DLL from LoadDWrite or the process's dwrite.dll
+// (via GetModuleHandle).
+HRESULT GetModuleFileVersion(
+    HMODULE moduleHandle,
+    _Out_ uint64_t& fileVersion
+    ) noexcept;
+
 HRESULT CreateFontFaceFromFile(
     IDWriteFactory* factory,
     _In_z_ const wchar_t* fontFilePath,
@@ -103,6 +111,24 @@ HRESULT CreateFontCollection(
     _COM_Outptr_ IDWriteFontCollection** fontCollection
     ) noexcept;
 
+// Create a font set from the same kind of list, enumerating the files just
+// once for any number of collections derived from it. Returns E_NOINTERFACE
+// before Windows 10 Creators Update, where CreateFontCollection still works.
+HRESULT CreateFontSet(
+    _In_ IDWriteFactory* factory,
+    _In_reads_(fontFileNamesSize) const wchar_t* fontFileNames, // Each file name null terminated.
+    _In_ uint32_t fontFileNamesSize, // Number of wchar_t's, not number file name count
+    _COM_Outptr_ IDWriteFontSet** fontSet
+    ) noexcept;
+
+// Returns E_NOINTERFACE for the typographic family model before IDWriteFactory6.
+HRESULT CreateFontCollectionFromFontSet(
+    _In_ IDWriteFactory* factory,
+    _In_ IDWriteFontSet* fontSet,
+    DWRITE_FONT_FAMILY_MODEL fontFamilyModel,
+    _COM_Outptr_ IDWriteFontCollection** fontCollection
+    ) noexcept;
+
 HRESULT GetFilePath(
     IDWriteFontFile* fontFile,
     OUT std::u16string& filePath
@@ -172,6 +198,41 @@ HRESULT GetFontFaceDesignAdvances(
     _Out_ array_ref<int32_t> glyphAdvances
     ) noexcept;
 
+// Run of text in a single script, from IDWriteTextAnalyzer::AnalyzeScript.
+struct TextScriptRun
+{
+    uint32_t textPosition;
+    uint32_t textLength;
+    DWRITE_SCRIPT_ANALYSIS scriptAnalysis;
+};
+
+// Split the text into script runs, in text order, for shaping each separately.
+HRESULT AnalyzeTextScripts(
+    IDWriteTextAnalyzer* textAnalyzer,
+    array_ref<char16_t const> text,
+    _In_z_ char16_t const* localeName,
+    bool isRightToLeft,
+    _Out_ std::vector<TextScriptRun>& scriptRuns
+    );
+
+// Shape one script run into glyphs, with advances and offsets for the
+// measuring mode. The GDI modes are placed at one pixel per DIP.
+HRESULT ShapeTextScriptRun(
+    IDWriteTextAnalyzer* textAnalyzer,
+    IDWriteFontFace* fontFace,
+    float fontEmSize,
+    DWRITE_MEASURING_MODE measuringMode,
+    bool isSideways,
+    bool isRightToLeft,
+    DWRITE_SCRIPT_ANALYSIS const& scriptAnalysis,
+    _In_z_ char16_t const* localeName,
+    array_ref<DWRITE_FONT_FEATURE const> features,
+    array_ref<char16_t const> text,
+    _Out_ std::vector<uint16_t>& glyphIndices,
+    _Out_ std::vector<float>& glyphAdvances,
+    _Out_ std::vector<DWRITE_GLYPH_OFFSET>& glyphOffsets
+    );
+
 HRESULT GetLocalizedStringLanguage(
     IDWriteLocalizedStrings* strings,
     uint32_t stringIndex,
@@ -250,6 +311,80 @@ float GetFontAxisValue(
 
 bool IsKnownFontFileExtension(_In_z_ const wchar_t* fileExtension) noexcept;
 
+// Optional replacement for IDWriteBitmapRenderTarget::DrawGlyphRun, such as
+// drawing from cached glyph rasterizations. Returns S_FALSE if it can't draw
+// the run, in which case the render target draws it instead.
+using BitmapRenderTargetGlyphRunDrawer = std::function<HRESULT(
+    float baselineOriginX,
+    float baselineOriginY,
+    DWRITE_MEASURING_MODE measuringMode,
+    DWRITE_GLYPH_RUN const& glyphRun,
+    IDWriteRenderingParams* renderingParams,
+    COLORREF textColor
+    )>;
+
+// Color layers of individual glyphs, as given by TranslateColorGlyphRun, so
+// that DrawColorGlyphRun only translates each glyph once rather than every
+// run on every draw. Layers are independent of size and position in COLR
+// fonts, and so the key is just face, palette, and glyph. Not thread safe.
+class ColorGlyphLayerCache
+{
+public:
+    struct Layer
+    {
+        uint16_t glyphId;
+        uint16_t paletteIndex; // 0xFFFF means the text color.
+        DWRITE_COLOR_F runColor;
+    };
+
+    // Get the layers of the glyph, bottom first. Glyphs without color get an
+    // empty list.
+    HRESULT GetLayers(
+        IDWriteFactory* dwriteFactory,
+        IDWriteFontFace* fontFace,
+        uint32_t colorPalette,
+        uint16_t glyphId,
+        _Out_ array_ref<Layer const>& layers
+        );
+
+    void Clear();
+    size_t GetByteSize() const noexcept;
+
+    // The cache is cleared once it holds this many layers.
+    static constexpr size_t maximumLayerCount = 1u << 16;
+
+protected:
+    struct Key
+    {
+        IDWriteFontFace* fontFace;
+        uint32_t colorPalette;
+        uint16_t glyphId;
+
+        bool operator==(Key const& other) const noexcept
+        {
+            return fontFace == other.fontFace && colorPalette == other.colorPalette && glyphId == other.glyphId;
+        }
+    };
+
+    struct KeyHasher
+    {
+        size_t operator()(Key const& key) const noexcept
+        {
+            return (reinterpret_cast<size_t>(key.fontFace) * 0x9E3779B1u) ^ (key.colorPalette << 16) ^ key.glyphId;
+        }
+    };
+
+    struct Entry
+    {
+        uint32_t layerOffset; // Index into layers_.
+        uint32_t layerCount;
+    };
+
+    std::unordered_map<Key, Entry, KeyHasher> entries_;
+    std::vector<Layer> layers_;
+    std::unordered_map<IDWriteFontFace*, ComPtr<IDWriteFontFace>> fontFaces_; // Held since their pointers are in the keys.
+};
+
 // Draw a text layout to a bitmap render target.
 HRESULT DrawTextLayout(
     IDWriteFactory* dwriteFactory, // Needed for TranslateColorGlyphRun.
@@ -260,7 +395,9 @@ HRESULT DrawTextLayout(
     float y,
     COLORREF textColor = 0,
     uint32_t colorPaletteIndex = 0, // Use 0xFFFFFFFF if no palette (monochrome)
-    bool enablePixelSnapping = true
+    bool enablePixelSnapping = true,
+    BitmapRenderTargetGlyphRunDrawer const& glyphRunDrawer = nullptr,
+    _In_opt_ ColorGlyphLayerCache* colorGlyphLayerCache = nullptr
     ) noexcept;
 
 HRESULT DrawColorGlyphRun(
@@ -273,7 +410,9 @@ HRESULT DrawColorGlyphRun(
     float baselineOriginY,
     IDWriteRenderingParams* renderingParams,
     COLORREF textColor = 0x00000000,
-    uint32_t paletteIndex = 0 // Use 0xFFFFFFFF if no palette (monochrome)
+    uint32_t paletteIndex = 0, // Use 0xFFFFFFFF if no palette (monochrome)
+    BitmapRenderTargetGlyphRunDrawer const& glyphRunDrawer = nullptr,
+    _In_opt_ ColorGlyphLayerCache* colorGlyphLayerCache = nullptr
     ) noexcept;
 
 HRESULT DrawColorGlyphRun(
@@ -285,13 +424,107 @@ HRESULT DrawColorGlyphRun(
     float baselineOriginX,
     float baselineOriginY,
     ID2D1Brush* brush,
-    uint32_t colorPalette // 0xFFFFFFFF if none
+    uint32_t colorPalette, // 0xFFFFFFFF if none
+    _In_opt_ ColorGlyphLayerCache* colorGlyphLayerCache = nullptr
     ) noexcept;
 
+// Outline of a glyph run recorded from IDWriteFontFace::GetGlyphRunOutline,
+// for replaying into a geometry sink of any Direct2D factory without asking
+// the font again. Distinct outlines may be recorded on different threads.
+class GlyphRunOutline
+{
+public:
+    HRESULT Record(
+        IDWriteFontFace* fontFace,
+        float fontEmSize,
+        array_ref<uint16_t const> glyphIndices,
+        array_ref<float const> glyphAdvances, // Empty for the font's own advances.
+        bool isSideways,
+        bool isRightToLeft
+        ) noexcept;
+
+    void Replay(ID2D1SimplifiedGeometrySink* geometrySink) const noexcept;
+
+    // Create a path geometry of the outline in the given factory.
+    HRESULT CreatePathGeometry(
+        ID2D1Factory* d2dFactory,
+        _COM_Outptr_ ID2D1PathGeometry** pathGeometry
+        ) const noexcept;
+
+    void Clear() noexcept;
+    size_t GetByteSize() const noexcept;
+
+protected:
+    friend class GlyphRunOutlineRecorder;
+
+    enum CommandType : uint8_t
+    {
+        CommandTypeBeginFigureFilled,
+        CommandTypeBeginFigureHollow,
+        CommandTypeAddLines,
+        CommandTypeAddBeziers,
+        CommandTypeEndFigureOpen,
+        CommandTypeEndFigureClosed,
+    };
+
+    struct Command
+    {
+        CommandType type;
+        uint32_t pointCount; // Three per Bezier segment.
+    };
+
+    std::vector<Command> commands_;
+    std::vector<D2D1_POINT_2F> points_;
+    D2D1_FILL_MODE fillMode_ = D2D1_FILL_MODE_WINDING;
+};
+
+// Inclusive range of code points, sorted and non-overlapping within a list.
+struct CharacterRange
+{
+    char32_t first;
+    char32_t last;
+};
+
+// Character ranges of font faces, keyed by font file path, face index, file
+// modified time, and color filter, so repeated scans of the same fonts skip
+// the cmap. The owner (such as a canvas, through its shared resources)
+// decides how long it lives. Scanning a whole font folder would otherwise
+// keep every face's ranges, so it starts over once it reaches the limit.
+// Safe to use from several threads at once.
+class FontCharacterRangesCache
+{
+public:
+    using CharacterRanges = std::vector<CharacterRange>;
+
+    // Returns null for fonts not backed by a local file (e.g. in memory),
+    // which are simply not cached.
+    std::shared_ptr<CharacterRanges const> Find(std::u16string const& key) const;
+    void Add(std::u16string const& key, std::shared_ptr<CharacterRanges const> const& ranges);
+    void Clear();
+    size_t GetByteSize() const; // Approximate, for memory accounting.
+
+    static constexpr size_t maximumEntries = 1024;
+
+private:
+    mutable std::mutex lock_;
+    std::unordered_map<std::u16string, std::shared_ptr<CharacterRanges const>> entries_;
+    size_t byteSize_ = 0;
+};
+
+// Return the characters the font face maps to glyphs, read from its cmap, and
+// cached per font file and modified date if a cache is given.
+HRESULT GetFontCharacterRanges(
+    IDWriteFontFace* fontFace,
+    bool getOnlyColorFontCharacters,
+    _Inout_opt_ FontCharacterRangesCache* cache,
+    _Out_ std::vector<CharacterRange>& characterRanges
+    );
+
 HRESULT GetFontCharacterCoverageCounts(
     array_ref<IDWriteFontFace* const> fontFaces,
     array_ref<char32_t const> unicodeCharactersIn,
     bool getOnlyColorFontCharacters,
+    _Inout_opt_ FontCharacterRangesCache* cache,
     std::function<void(uint32_t i, uint32_t total)> progress,
     _Out_ std::vector<uint16_t>& coverageCounts
     );
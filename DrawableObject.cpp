@@ -6,6 +6,7 @@
 //                  AttributeSource as needed.
 //----------------------------------------------------------------------------
 #include "precomp.h"
+#include "Tracing.h"
 
 
 MODULE(DrawableObject)
@@ -26,6 +27,21 @@ const uint32_t DrawableObject::defaultLayoutColor = 0xFF7FFFD4;
 const uint32_t DrawableObject::defaultBackColor = 0xFFFFFFFF;
 const uint32_t DrawableObject::defaultCanvasColor = 0xFF6495ED;
 
+thread_local int64_t g_cachedResourceCreationTicks = 0;
+thread_local uint32_t g_cachedResourceCreationDepth = 0;
+
+namespace
+{
+    // Rough sizes of the system objects held by the caches, for memory
+    // accounting only. A layout keeps the text and per character analysis,
+    // clusters, and glyphs, so it grows mostly with the text length.
+    size_t constexpr g_estimatedRenderingParamsByteSize = 128;
+    size_t constexpr g_estimatedTextFormatByteSize = 2048;
+    size_t constexpr g_estimatedTextLayoutByteSize = 4096;
+    size_t constexpr g_estimatedTextLayoutBytesPerCharacter = 64;
+    size_t constexpr g_estimatedGdiPlusObjectByteSize = 1024;
+}
+
 
 const Attribute DrawableObject::attributeList[DrawableObjectAttributeTotal] =
 {
@@ -51,6 +67,7 @@ const Attribute DrawableObject::attributeList[DrawableObjectAttributeTotal] =
     {Attribute::TypeArrayFloat32,   Attribute::SemanticNone,         0            , DrawableObjectAttributePosition, u"position", u"Position X Y", u"0 0",{} },
     {Attribute::TypeArrayFloat32,   Attribute::SemanticNone,         0            , DrawableObjectAttributeTransform, u"transform", u"Transform", u"1 0 0 1 0 0", transforms },
     {Attribute::TypeUInteger32,     Attribute::SemanticNone,         0            , DrawableObjectAttributePixelZoom, u"pixel_zoom", u"Pixel zoom", u"1", pixelZooms },
+    {Attribute::TypeUInteger32,     Attribute::SemanticColor,        0            , DrawableObjectAttributePixelGridColor, u"pixel_grid_color", u"Pixel grid color", u"", textColors, u"Grid between zoomed pixels, as #FFFFFFFF, 255 128 0, or name" },
     {Attribute::TypeUInteger32,     Attribute::SemanticEnumExclusive,CategoryLight, DrawableObjectAttributeReadingDirection, u"reading_direction", u"Reading direction", u"LTR TTB", readingDirections },
     {Attribute::TypeUInteger32,     Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeColumnAlignment, u"column_alignment", u"Column alignment", u"leading", alignments },
     {Attribute::TypeUInteger32,     Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeRowAlignment, u"row_alignment", u"Row alignment", u"leading", alignments },
@@ -73,6 +90,7 @@ const Attribute DrawableObject::attributeList[DrawableObjectAttributeTotal] =
     {Attribute::TypeBool8,          Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeUnderline, u"underline", u"Underline", u"off", enabledValues },
     {Attribute::TypeBool8,          Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeStrikethrough, u"strikethrough", u"Strikethrough", u"off", enabledValues },
     {Attribute::TypeBool8,          Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeFontFallback, u"font_fallback", u"Font fallback", u"on", enabledValues },
+    {Attribute::TypeString16,       Attribute::SemanticNone,         0            , DrawableObjectAttributeFontFallbackFamilies, u"font_fallback_families", u"Font fallback families", u"", fontFallbackFamilies, u"Families tried before the system fallback, separated by semicolons" },
     {Attribute::TypeFloat32,        Attribute::SemanticNone,         0            , DrawableObjectAttributeTabWidth, u"tab_width", u"Tab width", u"40",{} },
     {Attribute::TypeUInteger32,     Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeHotkeyMode, u"hotkey_mode", u"Hotkey mode", u"None", hotkeyDisplays },
     {Attribute::TypeUInteger32,     Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeTrimmingGranularity, u"trimming_granularity", u"Trimming granularity", u"40", trimmingGranularities },
@@ -80,10 +98,12 @@ const Attribute DrawableObject::attributeList[DrawableObjectAttributeTotal] =
     {Attribute::TypeCharacter32,    Attribute::SemanticNone,         0            , DrawableObjectAttributeTrimmingDelimiter, u"trimming_delimiter", u"Trimming delimiter", u"", trimmingDelimiters },
     {Attribute::TypeBool8,          Attribute::SemanticNone,         0            , DrawableObjectAttributeUser32DrawTextAsEditControl, u"user32_drawtext_edit_control", u"User32 DrawText DT_EDITCONTROL", u"", enabledValues },
     {Attribute::TypeArrayUInteger32,Attribute::SemanticCharacterTags,0            , DrawableObjectAttributeAxisTags, u"axis_tags", u"Axis tags", u"", axisValues },
-    {Attribute::TypeArrayFloat32,   Attribute::SemanticNone,         0            , DrawableObjectAttributeAxisValues, u"axis_values", u"Axis values", u"", {} },
+    {Attribute::TypeArrayFloat32,   Attribute::SemanticNone,         0            , DrawableObjectAttributeAxisValues, u"axis_values", u"Axis values", u"", {}, u"One value per axis tag, or first last count per axis for D2D axis sweep" },
     {Attribute::TypeUInteger32,     Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeDWriteFontFamilyModel, u"dwrite_font_family_model", u"DWrite font family model", u"Weight Style Stretch", dwriteFontFamilyModels },
+    {Attribute::TypeBool8,          Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeGlyphShaping, u"glyph_shaping", u"Glyph shaping", u"off", enabledValues, u"Without glyphs, shape the text with its font, features, and language rather than mapping the cmap" },
+    {Attribute::TypeBool8,          Attribute::SemanticEnumExclusive,0            , DrawableObjectAttributeGlyphGeometries, u"glyph_geometries", u"Glyph geometries", u"off", enabledValues, u"Fill cached glyph outlines for rotated and skewed D2D glyph runs rather than calling DrawGlyphRun" },
 };
-static_assert(DrawableObjectAttributeTotal == 53, "A new attribute enum has been added. Update this table.");
+static_assert(DrawableObjectAttributeTotal == 57, "A new attribute enum has been added. Update this table.");
 
 
 const Attribute::PredefinedValue DrawableObject::functions[] = {
@@ -95,6 +115,8 @@ const Attribute::PredefinedValue DrawableObject::functions[] = {
     { DrawableObjectFunctionDirect2DDrawGlyphRun, u"D2D DrawGlyphRun" },
     { DrawableObjectFunctionDrawColorBitmapGlyphRun, u"D2D DrawColorBitmapGlyphRun" },
     { DrawableObjectFunctionDrawSvgGlyphRun, u"D2D DrawSvgGlyphRun" },
+    { DrawableObjectFunctionDirect2DDrawAxisSweep, u"D2D axis sweep" },
+    { DrawableObjectFunctionReferenceRasterizerDrawGlyphRun, u"Reference rasterizer DrawGlyphRun" },
     { DrawableObjectFunctionUser32DrawText, u"User32 DrawText" },
     { DrawableObjectFunctionGdiTextOut, u"GDI ExtTextOut" },
     { DrawableObjectFunctionGdiPlusDrawString, u"GDIPlus DrawString" },
@@ -796,6 +818,13 @@ const Attribute::PredefinedValue DrawableObject::languages[] = {
     {0, u"الْعَرَبيّة Arabic Iraq", u"ar-IQ" },
 };
 
+const Attribute::PredefinedValue DrawableObject::fontFallbackFamilies[] = {
+    {0, u"None", u"" },
+    {0, u"Segoe UI Emoji", u"Segoe UI Emoji" },
+    {0, u"Segoe UI Symbol", u"Segoe UI Symbol" },
+    {0, u"Segoe UI Emoji;Segoe UI Symbol;Segoe UI Historic", u"Segoe UI Emoji;Segoe UI Symbol;Segoe UI Historic" },
+};
+
 const Attribute::PredefinedValue DrawableObject::fontSimulations[] = {
     {uint32_t(DWRITE_FONT_SIMULATIONS_NONE), u"none" },
     {uint32_t(DWRITE_FONT_SIMULATIONS_BOLD), u"bold" },
@@ -905,7 +934,7 @@ const Attribute::PredefinedValue DrawableObject::trimmingDelimiters[] = {
 bool DrawableObject::IsGdiOrGdiPlusFunction(DrawableObjectFunction functionType) noexcept
 {
     // Check whether it's a GDI/GDI+ or DWrite based function.
-    static_assert(DrawableObjectFunctionTotal == 12, "Update this switch statement.");
+    static_assert(DrawableObjectFunctionTotal == 14, "Update this switch statement.");
     switch (functionType)
     {
     case DrawableObjectFunctionGdiTextOut:
@@ -966,6 +995,8 @@ DrawableObject* DrawableObject::Create(DrawableObjectFunction functionType)
     case DrawableObjectFunctionGdiPlusDrawDriverString: return new DrawableObjectGdiPlusDrawDriverString();
     case DrawableObjectFunctionDrawColorBitmapGlyphRun: return new DrawableObjectDirect2DDrawColorBitmapGlyphRun();
     case DrawableObjectFunctionDrawSvgGlyphRun: return new DrawableObjectDirect2DDrawSvgGlyphRun();
+    case DrawableObjectFunctionDirect2DDrawAxisSweep: return new DrawableObjectDirect2DDrawAxisSweep();
+    case DrawableObjectFunctionReferenceRasterizerDrawGlyphRun: return new DrawableObjectReferenceRasterizerDrawGlyphRun();
     }
 }
 
@@ -1058,6 +1089,7 @@ void DrawableObject::GenerateLabel(IAttributeSource& attributeSource, _Out_ std:
             case DrawableObjectAttributeHeight:
             case DrawableObjectAttributePadding:
             case DrawableObjectAttributePixelZoom:
+            case DrawableObjectAttributePixelGridColor:
             case DrawableObjectAttributeBackColor:
             case DrawableObjectAttributeLayoutColor:
                 continue;
@@ -1068,8 +1100,10 @@ void DrawableObject::GenerateLabel(IAttributeSource& attributeSource, _Out_ std:
             case DrawableObjectAttributeUnderline:
             case DrawableObjectAttributeStrikethrough:
             case DrawableObjectAttributeFontFallback:
+            case DrawableObjectAttributeFontFallbackFamilies:
             case DrawableObjectAttributeTrimmingSign:
             case DrawableObjectAttributeUser32DrawTextAsEditControl:
+            case DrawableObjectAttributeGlyphGeometries:
                 prefix = DrawableObject::attributeList[attributeIndex].name;
                 break;
             }
@@ -1201,6 +1235,246 @@ DWRITE_GLYPH_IMAGE_FORMATS const c_imageDataFormats =
     // Exclude TrueType, CFF, COLR
 
 
+namespace
+{
+    char16_t const* GetGlyphImageFileNameExtension(DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormat)
+    {
+        switch (glyphImageFormat)
+        {
+        case DWRITE_GLYPH_IMAGE_FORMATS_SVG:  return u".svg";
+        case DWRITE_GLYPH_IMAGE_FORMATS_PNG:  return u".png";
+        case DWRITE_GLYPH_IMAGE_FORMATS_JPEG: return u".jpeg";
+        case DWRITE_GLYPH_IMAGE_FORMATS_TIFF: return u".tiff";
+        default: return u".bin"; // Including DWRITE_GLYPH_IMAGE_FORMATS_PREMULTIPLIED_B8G8R8A8.
+        }
+    }
+
+
+    // One glyph image to export, holding its data until written.
+    struct GlyphImageExportEntry
+    {
+        uint32_t glyphId;
+        DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormat;
+        uint32_t crc;
+        DWRITE_GLYPH_IMAGE_DATA glyphData;
+        void* glyphDataContext;
+    };
+
+
+    uint32_t ComputeCrc32(_In_reads_bytes_(dataSize) void const* data, size_t dataSize) noexcept
+    {
+        static std::array<uint32_t, 256> const crcTable = []()
+        {
+            std::array<uint32_t, 256> table;
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t crc = i;
+                for (uint32_t bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+                }
+                table[i] = crc;
+            }
+            return table;
+        }();
+
+        uint32_t crc = 0xFFFFFFFF;
+        for (auto* p = static_cast<uint8_t const*>(data), *pEnd = p + dataSize; p < pEnd; ++p)
+        {
+            crc = crcTable[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+
+    // Minimal writer for an uncompressed (stored) zip archive. Glyph images
+    // are already compressed, so deflating them would gain little, and this
+    // way each image is written straight from the font's memory. Output is
+    // gathered into large writes rather than one per entry.
+    class StoredZipArchiveWriter
+    {
+    public:
+        HRESULT Open(_In_z_ char16_t const* filePath)
+        {
+            HANDLE file = CreateFile(
+                ToWChar(filePath),
+                GENERIC_WRITE,
+                FILE_SHARE_DELETE | FILE_SHARE_READ,
+                nullptr,
+                CREATE_ALWAYS,
+                FILE_FLAG_SEQUENTIAL_SCAN,
+                nullptr
+                );
+            if (file == INVALID_HANDLE_VALUE)
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            file_.Set(file);
+            return S_OK;
+        }
+
+        HRESULT AddFile(array_ref<char16_t const> fileName, _In_reads_bytes_(dataSize) void const* data, uint32_t dataSize, uint32_t crc)
+        {
+            // Entries and offsets past the 16-bit and 32-bit limits would need zip64.
+            if (entryCount_ >= 0xFFFF || fileOffset_ + pendingOutput_.size() + dataSize + 0x10000 > UINT32_MAX)
+                return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+
+            char utf8FileName[MAX_PATH * 3];
+            int utf8FileNameSize = WideCharToMultiByte(CP_UTF8, 0, ToWChar(fileName.data()), int(fileName.size()), OUT utf8FileName, int(std::size(utf8FileName)), nullptr, nullptr);
+            if (utf8FileNameSize <= 0)
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            uint32_t const localHeaderOffset = uint32_t(fileOffset_ + pendingOutput_.size());
+
+            AppendUint32(pendingOutput_, 0x04034B50); // Local file header signature.
+            AppendEntryFields(pendingOutput_, dataSize, crc, utf8FileNameSize);
+            pendingOutput_.insert(pendingOutput_.end(), utf8FileName, utf8FileName + utf8FileNameSize);
+
+            AppendUint32(centralDirectory_, 0x02014B50); // Central directory header signature.
+            AppendUint16(centralDirectory_, 20); // Version made by.
+            AppendEntryFields(centralDirectory_, dataSize, crc, utf8FileNameSize);
+            AppendUint16(centralDirectory_, 0); // Comment length.
+            AppendUint16(centralDirectory_, 0); // Disk number.
+            AppendUint16(centralDirectory_, 0); // Internal attributes.
+            AppendUint32(centralDirectory_, 0); // External attributes.
+            AppendUint32(centralDirectory_, localHeaderOffset);
+            centralDirectory_.insert(centralDirectory_.end(), utf8FileName, utf8FileName + utf8FileNameSize);
+
+            ++entryCount_;
+
+            // Small images are copied behind the header, whereas large ones
+            // are written directly after flushing what is pending.
+            if (dataSize < pendingOutputFlushSize)
+            {
+                auto* bytes = static_cast<uint8_t const*>(data);
+                pendingOutput_.insert(pendingOutput_.end(), bytes, bytes + dataSize);
+                if (pendingOutput_.size() >= pendingOutputFlushSize)
+                {
+                    IFR(FlushPendingOutput());
+                }
+                return S_OK;
+            }
+
+            IFR(FlushPendingOutput());
+            return Write(data, dataSize);
+        }
+
+        HRESULT Close()
+        {
+            uint32_t const centralDirectoryOffset = uint32_t(fileOffset_ + pendingOutput_.size());
+            uint32_t const centralDirectorySize = uint32_t(centralDirectory_.size());
+
+            AppendUint32(centralDirectory_, 0x06054B50); // End of central directory signature.
+            AppendUint16(centralDirectory_, 0); // Disk number.
+            AppendUint16(centralDirectory_, 0); // Disk with the central directory.
+            AppendUint16(centralDirectory_, uint16_t(entryCount_));
+            AppendUint16(centralDirectory_, uint16_t(entryCount_));
+            AppendUint32(centralDirectory_, centralDirectorySize);
+            AppendUint32(centralDirectory_, centralDirectoryOffset);
+            AppendUint16(centralDirectory_, 0); // Comment length.
+
+            IFR(FlushPendingOutput());
+            IFR(Write(centralDirectory_.data(), uint32_t(centralDirectory_.size())));
+            file_.Clear();
+            return S_OK;
+        }
+
+    private:
+        static void AppendUint16(IN OUT std::vector<uint8_t>& output, uint32_t value)
+        {
+            output.push_back(uint8_t(value));
+            output.push_back(uint8_t(value >> 8));
+        }
+
+        static void AppendUint32(IN OUT std::vector<uint8_t>& output, uint32_t value)
+        {
+            AppendUint16(output, value);
+            AppendUint16(output, value >> 16);
+        }
+
+        // Fields shared by the local header and central directory entry.
+        static void AppendEntryFields(IN OUT std::vector<uint8_t>& output, uint32_t dataSize, uint32_t crc, uint32_t fileNameSize)
+        {
+            AppendUint16(output, 20);       // Version needed to extract.
+            AppendUint16(output, 0x0800);   // Flags: UTF-8 file name.
+            AppendUint16(output, 0);        // Compression method: stored.
+            AppendUint16(output, 0);        // Modification time.
+            AppendUint16(output, 0x21);     // Modification date: 1980-01-01.
+            AppendUint32(output, crc);
+            AppendUint32(output, dataSize); // Compressed size.
+            AppendUint32(output, dataSize); // Uncompressed size.
+            AppendUint16(output, fileNameSize);
+            AppendUint16(output, 0);        // Extra field length.
+        }
+
+        HRESULT FlushPendingOutput()
+        {
+            IFR(Write(pendingOutput_.data(), uint32_t(pendingOutput_.size())));
+            pendingOutput_.clear();
+            return S_OK;
+        }
+
+        HRESULT Write(_In_reads_bytes_(dataSize) void const* data, uint32_t dataSize)
+        {
+            unsigned long bytesWritten;
+            if (dataSize > 0 && !WriteFile(file_, data, dataSize, OUT &bytesWritten, nullptr))
+                return HRESULT_FROM_WIN32(GetLastError());
+
+            fileOffset_ += dataSize;
+            return S_OK;
+        }
+
+        constexpr static size_t pendingOutputFlushSize = 1 << 20;
+
+        FileHandle file_;
+        std::vector<uint8_t> pendingOutput_;
+        std::vector<uint8_t> centralDirectory_;
+        uint64_t fileOffset_ = 0;
+        uint32_t entryCount_ = 0;
+    };
+}
+
+
+// Font character coverage, shared via the canvas so repeated character
+// queries over the same fonts skip the cmap. Being a shared resource, it is
+// released with the canvas's others, and tile canvases have their own.
+class DECLSPEC_UUID("2F6B9D14-8A3E-4C71-B5E0-9D4C7A12E863") SharedFontCharacterRangesCache : public ComObject
+{
+public:
+    // Get the cache of the canvas, creating it if needed.
+    static HRESULT Get(DrawingCanvas& drawingCanvas, _Out_ ComPtr<SharedFontCharacterRangesCache>& cache)
+    {
+        cache.clear();
+        if (FAILED(drawingCanvas.GetSharedResource<SharedFontCharacterRangesCache>(sharedResourceName, OUT &cache)))
+        {
+            cache.Set(new SharedFontCharacterRangesCache());
+            drawingCanvas.SetSharedResource<SharedFontCharacterRangesCache>(sharedResourceName, cache, sizeof(SharedFontCharacterRangesCache));
+        }
+        return S_OK;
+    }
+
+    // Record any growth since Get against the canvas's resource budget.
+    void UpdateByteSize(DrawingCanvas& drawingCanvas)
+    {
+        drawingCanvas.SetSharedResource<SharedFontCharacterRangesCache>(sharedResourceName, this, sizeof(*this) + ranges.GetByteSize());
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedFontCharacterRangesCache, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    FontCharacterRangesCache ranges;
+
+    static constexpr char16_t const* sharedResourceName = u"FontCharacterRangesCache";
+};
+
+
+// Exports every SVG/PNG/JPEG/TIFF/BGRA glyph image in the font, either as
+// individual files starting with the given path prefix, or into one stored
+// zip archive if the path ends in ".zip". The images are fetched (and for
+// files, written) in parallel since DWrite font faces are free threaded.
 HRESULT DrawableObject::ExportFontGlyphData(
     IAttributeSource& attributeSource,
     DrawingCanvas& drawingCanvas,
@@ -1213,7 +1487,6 @@ HRESULT DrawableObject::ExportFontGlyphData(
 
     IFR(GetDWriteFontFace(attributeSource, drawingCanvas, OUT &fontFace));
 
-    std::map<uint32_t, uint32_t> glyphToUnicodeCodepoint;
     IFR(fontFace->QueryInterface(OUT &fontFace4));
     fontFace->GetMetrics(OUT &fontMetrics);
 
@@ -1222,30 +1495,47 @@ HRESULT DrawableObject::ExportFontGlyphData(
     if ((glyphImageFormats & c_imageDataFormats) == DWRITE_GLYPH_IMAGE_FORMATS_NONE)
         return S_FALSE;
 
-    // Map every glyph in the font to a Unicode character for the file naming.
+    uint32_t const glyphCount = fontFace->GetGlyphCount();
+
+    // Map every glyph in the font to its lowest Unicode character for the
+    // file naming, only querying the characters the cmap covers.
+    std::vector<char32_t> glyphToUnicodeCodepoint(glyphCount);
     {
-        std::vector<uint32_t> unicodeCharacters(UnicodeTotal);
-        std::vector<uint16_t> glyphIds(UnicodeTotal);
-        std::iota(unicodeCharacters.data(), unicodeCharacters.data() + UnicodeTotal, 0);
-        IFR(fontFace->GetGlyphIndices(unicodeCharacters.data(), UnicodeTotal, glyphIds.data()));
-        for (uint32_t ch = 0; ch < UnicodeTotal; ++ch)
+        std::vector<CharacterRange> characterRanges;
+        ComPtr<SharedFontCharacterRangesCache> rangesCache;
+        IFR(SharedFontCharacterRangesCache::Get(drawingCanvas, OUT rangesCache));
+        IFR(GetFontCharacterRanges(fontFace, /*getOnlyColorFontCharacters*/ false, &rangesCache->ranges, OUT characterRanges));
+        rangesCache->UpdateByteSize(drawingCanvas);
+
+        constexpr uint32_t blockSize = 4096;
+        uint32_t unicodeCharacters[blockSize];
+        uint16_t glyphIds[blockSize];
+        for (auto const& characterRange : characterRanges)
         {
-            auto glyphId = glyphIds[ch];
-            if (glyphId != 0)
-                glyphToUnicodeCodepoint.insert({glyphId, ch});
+            for (char32_t blockStart = characterRange.first; blockStart <= characterRange.last; blockStart += blockSize)
+            {
+                uint32_t const characterCount = std::min(uint32_t(characterRange.last - blockStart + 1), blockSize);
+                std::iota(unicodeCharacters, unicodeCharacters + characterCount, uint32_t(blockStart));
+                IFR(fontFace->GetGlyphIndices(unicodeCharacters, characterCount, OUT glyphIds));
+                for (uint32_t i = 0; i < characterCount; ++i)
+                {
+                    uint32_t const glyphId = glyphIds[i];
+                    if (glyphId != 0 && glyphId < glyphCount && glyphToUnicodeCodepoint[glyphId] == 0)
+                        glyphToUnicodeCodepoint[glyphId] = unicodeCharacters[i];
+                }
+            }
         }
     }
 
-    std::u16string filePath(filePathPrefix.data(), filePathPrefix.data_end());
-
-    for (uint32_t glyphId = 0, glyphCount = fontFace->GetGlyphCount(); glyphId < glyphCount; ++glyphId)
+    // Enumerate all the image formats found for each glyph.
+    std::vector<GlyphImageExportEntry> entries;
+    for (uint32_t glyphId = 0; glyphId < glyphCount; ++glyphId)
     {
         fontFace4->GetGlyphImageFormats(glyphId, 0, UINT32_MAX, OUT &glyphImageFormats);
 
         // Mask out any unknown formats (or monochrome outline formats like TrueType and CFF).
         glyphImageFormats &= c_imageDataFormats;
 
-        // Enumerate all the image formats found for this glyph.
         for (DWRITE_GLYPH_IMAGE_FORMATS currentGlyphImageFormat = DWRITE_GLYPH_IMAGE_FORMATS(1);
              glyphImageFormats >= currentGlyphImageFormat;
              currentGlyphImageFormat = DWRITE_GLYPH_IMAGE_FORMATS(currentGlyphImageFormat << 1))
@@ -1253,46 +1543,112 @@ HRESULT DrawableObject::ExportFontGlyphData(
             if (glyphImageFormats & currentGlyphImageFormat)
             {
                 glyphImageFormats &= ~currentGlyphImageFormat;
+                entries.push_back({glyphId, currentGlyphImageFormat, 0, {}, nullptr});
+            }
+        }
+    }
 
-                // Generate the filename: base + glyphid + [unicode] extension.
-                char16_t const* filenameExtension = u".bin";
-                switch (currentGlyphImageFormat)
+    // Generate the filename: base + glyphid + [unicode] extension.
+    auto getFileName = [&](GlyphImageExportEntry const& entry, array_ref<char16_t const> baseFileName, OUT std::u16string& fileName)
+    {
+        fileName.assign(baseFileName.data(), baseFileName.data_end());
+        AppendNumber(IN OUT fileName, u"g%05d", entry.glyphId);
+        uint32_t unicodeCharacter = glyphToUnicodeCodepoint[entry.glyphId];
+        if (unicodeCharacter != 0)
+        {
+            fileName.append(u"_U+", 3);
+            AppendNumber(IN OUT fileName, u"%04X", unicodeCharacter);
+        }
+        fileName += GetGlyphImageFileNameExtension(entry.glyphImageFormat);
+    };
+
+    auto const* fileExtension = FindFileNameExtension(filePathPrefix);
+    bool const isArchive = filePathPrefix.data_end() - fileExtension == 4 && _wcsnicmp(ToWChar(fileExtension), L".zip", 4) == 0;
+
+    // Archived images must stay alive until written in order after the
+    // workers finish, whereas loose files are released straight after.
+    auto glyphDataCleanup = DeferCleanup([&]
+    {
+        for (auto& entry : entries)
+        {
+            if (entry.glyphDataContext != nullptr)
+                fontFace4->ReleaseGlyphImageData(entry.glyphDataContext);
+        }
+    });
+
+    std::atomic<uint32_t> nextEntryIndex(0);
+    std::atomic<HRESULT> firstFailure(S_OK);
+
+    auto exportEntries = [&]()
+    {
+        std::u16string filePath;
+
+        for (;;)
+        {
+            uint32_t entryIndex = nextEntryIndex++;
+            if (entryIndex >= entries.size() || FAILED(firstFailure))
+                break;
+
+            auto& entry = entries[entryIndex];
+            HRESULT hr = fontFace4->GetGlyphImageData(
+                entry.glyphId,
+                fontMetrics.designUnitsPerEm,
+                entry.glyphImageFormat,
+                OUT &entry.glyphData,
+                OUT &entry.glyphDataContext
+                );
+
+            if (SUCCEEDED(hr))
+            {
+                if (isArchive)
                 {
-                case DWRITE_GLYPH_IMAGE_FORMATS_SVG:  filenameExtension = u".svg";  break;
-                case DWRITE_GLYPH_IMAGE_FORMATS_PNG:  filenameExtension = u".png";  break;
-                case DWRITE_GLYPH_IMAGE_FORMATS_JPEG: filenameExtension = u".jpeg"; break;
-                case DWRITE_GLYPH_IMAGE_FORMATS_TIFF: filenameExtension = u".tiff"; break;
-                // case DWRITE_GLYPH_IMAGE_FORMATS_PREMULTIPLIED_B8G8R8A8: keep .bin
+                    entry.crc = ComputeCrc32(entry.glyphData.imageData, entry.glyphData.imageDataSize);
                 }
-
-                filePath.resize(filePathPrefix.size());
-                AppendNumber(IN OUT filePath, u"g%05d", glyphId);
-                uint32_t unicodeCharacter = glyphToUnicodeCodepoint[glyphId];
-                if (unicodeCharacter != 0)
+                else
                 {
-                    filePath.append(u"_U+", 3);
-                    AppendNumber(IN OUT filePath, u"%04X", unicodeCharacter);
+                    getFileName(entry, filePathPrefix, OUT filePath);
+                    hr = WriteBinaryFile(filePath.c_str(), entry.glyphData.imageData, entry.glyphData.imageDataSize);
+                    fontFace4->ReleaseGlyphImageData(entry.glyphDataContext);
+                    entry.glyphDataContext = nullptr;
                 }
-                filePath += filenameExtension;
+            }
+
+            if (FAILED(hr))
+            {
+                entry.glyphDataContext = nullptr;
+                HRESULT noFailure = S_OK;
+                firstFailure.compare_exchange_strong(IN OUT noFailure, hr);
+            }
+        }
+    };
 
-                // Write the image data to a file.
-                DWRITE_GLYPH_IMAGE_DATA glyphData;
-                void* glyphDataContext = nullptr;
-                fontFace4->GetGlyphImageData(
-                    glyphId,
-                    fontMetrics.designUnitsPerEm,
-                    currentGlyphImageFormat,
-                    OUT &glyphData,
-                    OUT &glyphDataContext
-                    );
+    uint32_t const threadCount = std::max(std::min(std::thread::hardware_concurrency(), uint32_t(entries.size())), 1u);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(exportEntries);
+    }
+    exportEntries(); // This thread is worker 0.
 
-                HRESULT hr = WriteBinaryFile(filePath.c_str(), glyphData.imageData, glyphData.imageDataSize);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
 
-                fontFace4->ReleaseGlyphImageData(glyphDataContext);
+    IFR(firstFailure.load());
 
-                IFR(hr);
-            }
+    if (isArchive)
+    {
+        std::u16string archiveFilePath(filePathPrefix.data(), filePathPrefix.data_end());
+        std::u16string fileName;
+        StoredZipArchiveWriter archiveWriter;
+        IFR(archiveWriter.Open(archiveFilePath.c_str()));
+        for (auto const& entry : entries)
+        {
+            getFileName(entry, {}, OUT fileName);
+            IFR(archiveWriter.AddFile(fileName, entry.glyphData.imageData, entry.glyphData.imageDataSize, entry.crc));
         }
+        IFR(archiveWriter.Close());
     }
 
     return S_OK;
@@ -1306,17 +1662,42 @@ HRESULT DrawableObject::GetFontCharacters(
     _Out_ std::u16string& characters
     )
 {
-    ComPtr<IDWriteFontFace> fontFace;
-    IFR(GetDWriteFontFace(attributeSource, drawingCanvas, OUT &fontFace));
+    IAttributeSource* attributeSources[] = { &attributeSource };
+    return GetFontCharacters(attributeSources, drawingCanvas, getOnlyColorFontCharacters, OUT characters);
+}
+
+
+// Return the union of characters supported by all the objects' fonts.
+HRESULT DrawableObject::GetFontCharacters(
+    array_ref<IAttributeSource* const> attributeSources,
+    DrawingCanvas& drawingCanvas,
+    bool getOnlyColorFontCharacters,
+    _Out_ std::u16string& characters
+    )
+{
+    characters.clear();
+
+    std::vector<ComPtr<IDWriteFontFace>> fontFaces(attributeSources.size());
+    std::vector<IDWriteFontFace*> fontFacePointers(attributeSources.size());
+    for (size_t i = 0, ci = attributeSources.size(); i < ci; ++i)
+    {
+        IFR(GetDWriteFontFace(*attributeSources[i], drawingCanvas, OUT &fontFaces[i]));
+        fontFacePointers[i] = fontFaces[i];
+    }
+
+    ComPtr<SharedFontCharacterRangesCache> rangesCache;
+    IFR(SharedFontCharacterRangesCache::Get(drawingCanvas, OUT rangesCache));
 
     std::vector<uint16_t> characterCounts;
     IFR(GetFontCharacterCoverageCounts(
-        { &fontFace, 1 },
+        fontFacePointers,
         { },
         getOnlyColorFontCharacters,
+        &rangesCache->ranges,
         [&](uint32_t i, uint32_t total) {;},
         OUT characterCounts
         ));
+    rangesCache->UpdateByteSize(drawingCanvas);
 
     IFR(GetStringFromCoverageCount(characterCounts, 1, UINT32_MAX, OUT characters));
 
@@ -1363,8 +1744,99 @@ public:
 };
 
 
+// Fonts by LOGFONT, for SharedGdiFont::Get.
+class DECLSPEC_UUID("6A0D3C85-E2F4-4B17-9C58-1B47E6A2D90F") SharedGdiFontCache : public ComObject
+{
+public:
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedGdiFontCache, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    struct LogFontKey
+    {
+        LOGFONT logFont; // Face name zero filled after the terminator, so the whole struct compares.
+
+        bool operator==(LogFontKey const& other) const noexcept
+        {
+            return memcmp(&logFont, &other.logFont, sizeof(logFont)) == 0;
+        }
+    };
+
+    struct LogFontKeyHasher
+    {
+        size_t operator()(LogFontKey const& key) const noexcept
+        {
+            // FNV-1a over the bytes.
+            uint8_t const* bytes = reinterpret_cast<uint8_t const*>(&key.logFont);
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < sizeof(key.logFont); ++i)
+            {
+                hash = (hash ^ bytes[i]) * 16777619u;
+            }
+            return hash;
+        }
+    };
+
+    std::unordered_map<LogFontKey, ComPtr<SharedGdiFont>, LogFontKeyHasher> fonts;
+
+    static constexpr char16_t const* sharedResourceName = u"GdiFontCache";
+
+    // Forget them all beyond this many, which only releases those no object still holds.
+    static constexpr size_t maximumFontCount = 1024;
+};
+
+
+HRESULT SharedGdiFont::Get(DrawingCanvas& drawingCanvas, LOGFONT const& logFont, _Out_ ComPtr<SharedGdiFont>& sharedFont)
+{
+    sharedFont.clear();
+
+    ComPtr<SharedGdiFontCache> cache;
+    if (FAILED(drawingCanvas.GetSharedResource<SharedGdiFontCache>(SharedGdiFontCache::sharedResourceName, OUT &cache)))
+    {
+        cache.Set(new SharedGdiFontCache());
+        drawingCanvas.SetSharedResource<SharedGdiFontCache>(SharedGdiFontCache::sharedResourceName, cache, sizeof(SharedGdiFontCache));
+    }
+
+    SharedGdiFontCache::LogFontKey key = {logFont};
+    size_t faceNameLength = wcsnlen(key.logFont.lfFaceName, LF_FACESIZE);
+    std::fill(key.logFont.lfFaceName + faceNameLength, key.logFont.lfFaceName + LF_FACESIZE, L'\0');
+
+    auto match = cache->fonts.find(key);
+    TRACE_LOGGING_EVENT("GdiFontCacheLookup",
+        TraceLoggingWideString(key.logFont.lfFaceName, "FaceName"),
+        TraceLoggingInt32(key.logFont.lfHeight, "Height"),
+        TraceLoggingBool(match != cache->fonts.end(), "IsHit")
+        );
+    if (match != cache->fonts.end())
+    {
+        sharedFont = match->second;
+        return S_OK;
+    }
+
+    ComPtr<SharedGdiFont> newSharedFont;
+    newSharedFont.Set(new SharedGdiFont());
+    newSharedFont->font_ = CreateFontIndirect(&key.logFont);
+    if (newSharedFont->font_.IsNull())
+        return DWRITE_E_NOFONT; // Does GetLastError work with CreateFontIndirect? Otherwise use the DWrite error, which is close.
+
+    if (cache->fonts.size() >= SharedGdiFontCache::maximumFontCount)
+    {
+        cache->fonts.clear();
+    }
+    cache->fonts.emplace(key, newSharedFont);
+    sharedFont = std::move(newSharedFont);
+
+    return S_OK;
+}
+
+
 HRESULT CachedGdiFont::EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas)
 {
+    ScopedCachedResourceTimer timer;
+
     float fontSize = attributeSource.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
 
     array_ref<char16_t const> familyName = attributeSource.GetString(DrawableObjectAttributeFontFamily);
@@ -1374,6 +1846,7 @@ HRESULT CachedGdiFont::EnsureCached(IAttributeSource& attributeSource, DrawingCa
     ComPtr<GdiAddedFontResource> gdiAddedFontResource;
     if (!customFontFilePath.empty() && drawingCanvas.GetSharedResource(customFontFilePath.data(), OUT &gdiAddedFontResource) == E_NOT_SET)
     {
+        TRACE_LOGGING_ACTIVITY(activity, "LoadGdiFontFile", TraceLoggingWideString(ToWChar(customFontFilePath.data()), "FilePath"));
         gdiAddedFontResource.Set(new GdiAddedFontResource(customFontFilePath));
         drawingCanvas.SetSharedResource(customFontFilePath.data(), gdiAddedFontResource.Get());
     }
@@ -1409,71 +1882,295 @@ HRESULT CachedGdiFont::EnsureCached(IAttributeSource& attributeSource, DrawingCa
         logFont.lfFaceName[0] = '@';
     }
 
-    font = CreateFontIndirect(&logFont);
+    // Reuse the current font unless the attributes now map to another.
+    if (sharedFont != nullptr && memcmp(&logFont, &this->logFont, sizeof(logFont)) == 0)
+        return S_OK;
 
-    if (font.IsNull())
-        return DWRITE_E_NOFONT; // Does GetLastError work with CreateFontIndirect? Otherwise use the DWrite error, which is close.
+    Invalidate();
+    IFR(SharedGdiFont::Get(drawingCanvas, logFont, OUT sharedFont));
+    font = sharedFont->GetHandle();
+    this->logFont = logFont;
 
     return S_OK;
 }
 
 
-HRESULT DrawableObjectGdiTextOut::GetBounds(
-    IAttributeSource& attributeSource,
-    DrawingCanvas& drawingCanvas,
-    _Out_ D2D_RECT_F& layoutBounds,
-    _Out_ D2D_RECT_F& contentBounds
-    )
+namespace
 {
-    layoutBounds = emptyRect;
-    array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
-    array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
-    uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, 0ui32);
+    // End an ExtTextOut run starting at textPosition no further than
+    // maximumRunLength, preferring just after a space in its latter half, and
+    // never between a surrogate pair. The runs continue on the same line, so
+    // any split point only changes where measuring and drawing resume.
+    size_t GetGdiTextRunEnd(array_ref<char16_t const> text, size_t textPosition, size_t textEnd, bool isGlyphIndices)
+    {
+        if (textEnd - textPosition <= CachedGdiTextRuns::maximumRunLength)
+            return textEnd;
 
-    font_.EnsureCached(attributeSource, drawingCanvas);
-    HDC hdc = drawingCanvas.GetHDC();
+        size_t runEnd = textPosition + CachedGdiTextRuns::maximumRunLength;
+        if (isGlyphIndices)
+            return runEnd;
 
-    SIZE integerSize = {};
-    HFONT previousFont = SelectFont(hdc, font_.font);
+        for (size_t i = runEnd; i > textPosition + CachedGdiTextRuns::maximumRunLength / 2; --i)
+        {
+            if (text[i - 1] == ' ')
+                return i;
+        }
+        if (IsTrailingSurrogate(text[runEnd]))
+        {
+            --runEnd;
+        }
+        return runEnd;
+    }
 
-    // There is a bug in GetTextExtentPoint32 that if the text is too simple,
-    // it doesn't measure line feeds correctly (or at least, inconsistently
-    // with what ExtTextOut actually draws). Inserting any complex character
-    // like an LRM or fallback characters triggers the correct measurement.
-    GetTextExtentPoint32(hdc, ToWChar(text.data()), int(text.size()), OUT &integerSize);
-    SelectFont(hdc, previousFont);
 
-    if (!glyphs.empty() || !attributeSource.GetString(DrawableObjectAttributeGlyphs).empty())
+    // The clip box is in logical coordinates, already accounting for the
+    // world transform. Draw everything if it can't be read.
+    RECT GetGdiClipBox(HDC hdc)
     {
-        float layoutWidth = attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth);
-        integerSize.cx = LONG(floor(layoutWidth)); // todo::: measure actual glyph advances.
+        RECT clipRect;
+        if (GetClipBox(hdc, OUT &clipRect) == ERROR)
+        {
+            clipRect = {LONG_MIN, LONG_MIN, LONG_MAX, LONG_MAX};
+        }
+        return clipRect;
     }
+}
 
-    contentBounds.left = 0;
-    contentBounds.top = 0;
-    contentBounds.right = static_cast<float>(integerSize.cx);
-    contentBounds.bottom = static_cast<float>(integerSize.cy);
 
-    if (readingDirection & 1) // Swap for RTL.
+bool CachedGdiTextRuns::IsCurrent(HFONT font, array_ref<char16_t const> text, LONG layoutWidth, uint32_t flags) const noexcept
+{
+    return font_ != nullptr
+        && font_ == font
+        && textData_ == text.data()
+        && textLength_ == text.size()
+        && layoutWidth_ == layoutWidth
+        && flags_ == flags;
+}
+
+
+void CachedGdiTextRuns::SetCurrent(HFONT font, array_ref<char16_t const> text, LONG layoutWidth, uint32_t flags) noexcept
+{
+    font_ = font;
+    textData_ = text.data();
+    textLength_ = text.size();
+    layoutWidth_ = layoutWidth;
+    flags_ = flags;
+}
+
+
+// The font must already be selected into the HDC.
+HRESULT CachedGdiTextRuns::EnsureCachedTextOutRuns(HDC hdc, HFONT font, array_ref<char16_t const> text, bool isGlyphIndices)
+{
+    if (IsCurrent(font, text, /*layoutWidth*/0, isGlyphIndices))
+        return S_OK;
+
+    ScopedCachedResourceTimer timer;
+    Invalidate();
+
+    TEXTMETRIC textMetrics = {};
+    GetTextMetrics(hdc, OUT &textMetrics);
+    lineHeight = textMetrics.tmHeight;
+
+    int32_t offset = 0;
+    for (size_t textPosition = 0, textLength = text.size(); textPosition < textLength; )
     {
-        contentBounds.left = -contentBounds.right;
-        contentBounds.right = 0;
+        size_t runEnd = GetGdiTextRunEnd(text, textPosition, textLength, isGlyphIndices);
+        uint32_t runLength = static_cast<uint32_t>(runEnd - textPosition);
+        SIZE runSize = {};
+        BOOL succeeded = isGlyphIndices
+            ? GetTextExtentPointI(hdc, const_cast<WORD*>(reinterpret_cast<WORD const*>(text.data() + textPosition)), runLength, OUT &runSize)
+            : GetTextExtentPoint32(hdc, ToWChar(text.data() + textPosition), runLength, OUT &runSize);
+        if (!succeeded)
+        {
+            runs.clear();
+            return E_FAIL;
+        }
+        runs.push_back({static_cast<uint32_t>(textPosition), runLength, offset, runSize.cx});
+        offset += runSize.cx;
+        textPosition = runEnd;
     }
+    totalExtent = offset;
 
+    SetCurrent(font, text, /*layoutWidth*/0, isGlyphIndices);
     return S_OK;
 }
 
 
-HRESULT DrawableObjectGdiTextOut::Draw(
-    IAttributeSource& attributeSource,
-    DrawingCanvas& drawingCanvas,
-    float x,
-    float y,
-    DX_MATRIX_3X2F const& transform
-    )
+// The font must already be selected into the HDC.
+HRESULT CachedGdiTextRuns::EnsureCachedDrawTextLines(HDC hdc, HFONT font, array_ref<char16_t const> text, LONG layoutWidth, uint32_t drawTextFlags)
 {
-    array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
-    array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
+    if (IsCurrent(font, text, layoutWidth, drawTextFlags))
+        return S_OK;
+
+    ScopedCachedResourceTimer timer;
+    Invalidate();
+
+    TEXTMETRIC textMetrics = {};
+    GetTextMetrics(hdc, OUT &textMetrics);
+    lineHeight = textMetrics.tmHeight;
+
+    DRAWTEXTPARAMS drawTextParams = {sizeof(drawTextParams)};
+
+    int32_t offset = 0;
+    for (size_t textPosition = 0, textLength = text.size(); textPosition < textLength; )
+    {
+        // Each line ends at a CR, LF, or CR LF, which the next line skips.
+        size_t lineEnd = textPosition;
+        while (lineEnd < textLength && text[lineEnd] != '\r' && text[lineEnd] != '\n')
+        {
+            ++lineEnd;
+        }
+        size_t nextLinePosition = lineEnd;
+        if (nextLinePosition < textLength)
+        {
+            nextLinePosition += (text[nextLinePosition] == '\r' && nextLinePosition + 1 < textLength && text[nextLinePosition + 1] == '\n') ? 2 : 1;
+        }
+
+        // Paragraphs stay whole, even long ones. Splitting one would force a
+        // line break where DrawText would not have wrapped, and DrawText
+        // itself draws each wrapped line separately, within ExtTextOut's limit.
+        int32_t lineExtent = lineHeight; // Blank lines measure as empty.
+        if (lineEnd > textPosition)
+        {
+            RECT lineRect = {0, 0, layoutWidth, 0};
+            DrawTextEx(
+                hdc,
+                const_cast<wchar_t*>(ToWChar(text.data() + textPosition)),
+                static_cast<int>(lineEnd - textPosition),
+                IN OUT &lineRect,
+                drawTextFlags | DT_CALCRECT,
+                &drawTextParams
+                );
+            lineExtent = lineRect.bottom - lineRect.top;
+        }
+        runs.push_back({static_cast<uint32_t>(textPosition), static_cast<uint32_t>(lineEnd - textPosition), offset, lineExtent});
+        offset += lineExtent;
+        textPosition = nextLinePosition;
+    }
+    totalExtent = offset;
+
+    SetCurrent(font, text, layoutWidth, drawTextFlags);
+    return S_OK;
+}
+
+
+void CachedGdiTextRuns::DrawTextOutRuns(HDC hdc, int x, int y, uint32_t textOutFlags, array_ref<char16_t const> text) const
+{
+    RECT rect = {x, y, x + totalExtent, y + lineHeight};
+    RECT clipRect = GetGdiClipBox(hdc);
+
+    // Allow a line height of overhang beyond each run, for italics and stacked marks.
+    if (clipRect.bottom <= rect.top - lineHeight || clipRect.top >= rect.bottom + lineHeight)
+        return;
+
+    for (auto const& run : runs)
+    {
+        int runLeft = x + run.offset;
+        if (runLeft + run.extent + lineHeight <= clipRect.left)
+            continue;
+        if (runLeft - lineHeight >= clipRect.right)
+            break;
+
+        ExtTextOut(hdc, runLeft, y, textOutFlags, &rect, ToWChar(text.data() + run.textPosition), run.textLength, nullptr);
+    }
+}
+
+
+void CachedGdiTextRuns::DrawDrawTextLines(HDC hdc, RECT const& rect, uint32_t drawTextFlags, array_ref<char16_t const> text) const
+{
+    RECT clipRect = GetGdiClipBox(hdc);
+    bool const isClipped = !(drawTextFlags & DT_NOCLIP);
+    if (isClipped)
+    {
+        clipRect.top = std::max(clipRect.top, rect.top);
+        clipRect.bottom = std::min(clipRect.bottom, rect.bottom);
+    }
+
+    DRAWTEXTPARAMS drawTextParams = {sizeof(drawTextParams)};
+    for (auto const& run : runs)
+    {
+        LONG lineTop = rect.top + run.offset;
+        if (lineTop + run.extent + lineHeight <= clipRect.top)
+            continue;
+        if (lineTop - lineHeight >= clipRect.bottom)
+            break;
+
+        RECT lineRect = {rect.left, lineTop, rect.right, isClipped ? rect.bottom : lineTop + run.extent};
+        DrawTextEx(
+            hdc,
+            const_cast<wchar_t*>(ToWChar(text.data() + run.textPosition)),
+            static_cast<int>(run.textLength),
+            IN OUT &lineRect,
+            drawTextFlags,
+            &drawTextParams
+            );
+    }
+}
+
+
+HRESULT DrawableObjectGdiTextOut::Update(IAttributeSource& attributeSource)
+{
+    textRuns_.Invalidate();
+    return S_OK;
+}
+
+
+HRESULT DrawableObjectGdiTextOut::GetBounds(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    _Out_ D2D_RECT_F& layoutBounds,
+    _Out_ D2D_RECT_F& contentBounds
+    )
+{
+    layoutBounds = emptyRect;
+    array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
+    array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
+    uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, 0ui32);
+
+    font_.EnsureCached(attributeSource, drawingCanvas);
+    HDC hdc = drawingCanvas.GetHDC();
+
+    SIZE integerSize = {};
+    HFONT previousFont = SelectFont(hdc, font_.font);
+
+    // There is a bug in GetTextExtentPoint32 that if the text is too simple,
+    // it doesn't measure line feeds correctly (or at least, inconsistently
+    // with what ExtTextOut actually draws). Inserting any complex character
+    // like an LRM or fallback characters triggers the correct measurement.
+    GetTextExtentPoint32(hdc, ToWChar(text.data()), int(text.size()), OUT &integerSize);
+    SelectFont(hdc, previousFont);
+
+    if (!glyphs.empty() || !attributeSource.GetString(DrawableObjectAttributeGlyphs).empty())
+    {
+        float layoutWidth = attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth);
+        integerSize.cx = LONG(floor(layoutWidth)); // todo::: measure actual glyph advances.
+    }
+
+    contentBounds.left = 0;
+    contentBounds.top = 0;
+    contentBounds.right = static_cast<float>(integerSize.cx);
+    contentBounds.bottom = static_cast<float>(integerSize.cy);
+
+    if (readingDirection & 1) // Swap for RTL.
+    {
+        contentBounds.left = -contentBounds.right;
+        contentBounds.right = 0;
+    }
+
+    return S_OK;
+}
+
+
+HRESULT DrawableObjectGdiTextOut::Draw(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    float x,
+    float y,
+    DX_MATRIX_3X2F const& transform
+    )
+{
+    array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
+    array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
 
     font_.EnsureCached(attributeSource, drawingCanvas);
     HDC hdc = drawingCanvas.GetHDC();
@@ -1508,23 +2205,46 @@ HRESULT DrawableObjectGdiTextOut::Draw(
     //          fixes the issue.
     SetWorldTransform(hdc, &transform.gdi);
 
-    SIZE integerSize = {};
-    GetTextExtentPoint32(hdc, ToWChar(text.data()), int(text.size()), OUT &integerSize);
-    RECT rect = { int(x), int(y), int(x) + integerSize.cx, int(y) + integerSize.cy };
-
-    if (!glyphs.empty() || !attributeSource.GetString(DrawableObjectAttributeGlyphs).empty())
+    array_ref<char16_t const> drawnText = text;
+    bool const isGlyphIndices = !glyphs.empty() || !attributeSource.GetString(DrawableObjectAttributeGlyphs).empty();
+    if (isGlyphIndices)
     {
-        text.reset(glyphs.reinterpret_as<char16_t const>());
+        drawnText.reset(glyphs.reinterpret_as<char16_t const>());
         textOutFlags |= ETO_GLYPH_INDEX;
         // todo::: Pass glyph advances if non-empty. ETO_PDY
     }
 
-    ExtTextOut(hdc, int(x), int(y), textOutFlags, &rect, ToWChar(text.data()), uint32_t(text.size()), nullptr);
+    // Draw long LTR text a run at a time, skipping any outside the clip.
+    // RTL is left whole, since the runs would reorder.
+    HRESULT hr = S_OK;
+    if (drawnText.size() >= CachedGdiTextRuns::minimumTextLength && !(readingDirection & 1))
+    {
+        hr = textRuns_.EnsureCachedTextOutRuns(hdc, font_.font, drawnText, isGlyphIndices);
+        if (SUCCEEDED(hr))
+        {
+            textRuns_.DrawTextOutRuns(hdc, int(x), int(y), textOutFlags, drawnText);
+        }
+    }
+    else
+    {
+        SIZE integerSize = {};
+        GetTextExtentPoint32(hdc, ToWChar(text.data()), int(text.size()), OUT &integerSize);
+        RECT rect = { int(x), int(y), int(x) + integerSize.cx, int(y) + integerSize.cy };
+
+        ExtTextOut(hdc, int(x), int(y), textOutFlags, &rect, ToWChar(drawnText.data()), uint32_t(drawnText.size()), nullptr);
+    }
 
     SetWorldTransform(hdc, &DrawableObject::identityTransform.gdi);
     SetTextAlign(hdc, oldTextAlignment);
     SelectFont(hdc, previousFont);
 
+    return hr;
+}
+
+
+HRESULT DrawableObjectUser32DrawText::Update(IAttributeSource& attributeSource)
+{
+    textRuns_.Invalidate();
     return S_OK;
 }
 
@@ -1715,34 +2435,54 @@ HRESULT DrawableObjectUser32DrawText::DrawInternal(
     // Cast away the constness because DrawTextEx unwisely took the input string as non-const.
     wchar_t* wcharText = const_cast<wchar_t*>(ToWChar(text.data()));
 
-    // Since DT_VCENTER actually works really poorly, just do it ourselves.
-    // DrawText returns a rectangle with a correct bottom edge and a zeroed top,
-    // which is not useful. Additionally, it doesn't work if you have more than
-    // one line of text.
-    #ifdef USE_DRAWTEXT_DT_VCENTER
-    if (std::none_of(text.begin(), text.end(), [](wchar_t ch)->bool {return ch == 0x000A || ch == 0x000D; }))
-    {
-        drawTextFlags |= DT_SINGLELINE;
-        drawTextFlags |=
-            (rowAlignment == DrawableObjectAlignmentModeCenter) ? DT_VCENTER :
-            (rowAlignment == DrawableObjectAlignmentModeTrailing) ? DT_BOTTOM :
-            DT_TOP;
-    }
-    #else
-    if (rowAlignment != DrawableObjectAlignmentModeLeading)
+    // Draw long text a line at a time, skipping any outside the clip. Trimming
+    // and edit control emulation depend on the whole text, so leave those be,
+    // along with measurement.
+    bool const isLineCulled = text.size() >= CachedGdiTextRuns::minimumTextLength
+                           && contentBounds == nullptr
+                           && !(drawTextFlags & (DT_END_ELLIPSIS | DT_WORD_ELLIPSIS | DT_PATH_ELLIPSIS | DT_EDITCONTROL))
+                           && SUCCEEDED(textRuns_.EnsureCachedDrawTextLines(hdc, font_.font, text, rect.right - rect.left, drawTextFlags));
+    if (isLineCulled)
     {
-        RECT contentRect = rect;
-        DrawTextEx(hdc, wcharText, static_cast<uint32_t>(text.size()), IN OUT &contentRect, drawTextFlags | DT_CALCRECT, &drawTextParams);
-        auto contentHeight = contentRect.bottom - contentRect.top;
+        auto contentHeight = textRuns_.totalExtent;
         switch (rowAlignment)
         {
         case DrawableObjectAlignmentModeTrailing: rect.top = rect.bottom - contentHeight; break;
         case DrawableObjectAlignmentModeCenter: rect.top = (intLayoutHeight - contentHeight) / 2; break;
         }
+        textRuns_.DrawDrawTextLines(hdc, rect, drawTextFlags, text);
     }
-    #endif
+    else
+    {
+        // Since DT_VCENTER actually works really poorly, just do it ourselves.
+        // DrawText returns a rectangle with a correct bottom edge and a zeroed top,
+        // which is not useful. Additionally, it doesn't work if you have more than
+        // one line of text.
+        #ifdef USE_DRAWTEXT_DT_VCENTER
+        if (std::none_of(text.begin(), text.end(), [](wchar_t ch)->bool {return ch == 0x000A || ch == 0x000D; }))
+        {
+            drawTextFlags |= DT_SINGLELINE;
+            drawTextFlags |=
+                (rowAlignment == DrawableObjectAlignmentModeCenter) ? DT_VCENTER :
+                (rowAlignment == DrawableObjectAlignmentModeTrailing) ? DT_BOTTOM :
+                DT_TOP;
+        }
+        #else
+        if (rowAlignment != DrawableObjectAlignmentModeLeading)
+        {
+            RECT contentRect = rect;
+            DrawTextEx(hdc, wcharText, static_cast<uint32_t>(text.size()), IN OUT &contentRect, drawTextFlags | DT_CALCRECT, &drawTextParams);
+            auto contentHeight = contentRect.bottom - contentRect.top;
+            switch (rowAlignment)
+            {
+            case DrawableObjectAlignmentModeTrailing: rect.top = rect.bottom - contentHeight; break;
+            case DrawableObjectAlignmentModeCenter: rect.top = (intLayoutHeight - contentHeight) / 2; break;
+            }
+        }
+        #endif
 
-    DrawTextEx(hdc, wcharText, static_cast<uint32_t>(text.size()), IN OUT &rect, drawTextFlags, &drawTextParams);
+        DrawTextEx(hdc, wcharText, static_cast<uint32_t>(text.size()), IN OUT &rect, drawTextFlags, &drawTextParams);
+    }
 
     SetWorldTransform(hdc, &DrawableObject::identityTransform.gdi);
     SetTextAlign(hdc, oldTextAlignment);
@@ -1824,40 +2564,81 @@ void GetFontAxisValues(
 }
 
 
-HRESULT CachedDWriteFontFace::Update(
+// Build a key uniquely identifying the font face from the attributes that
+// affect its creation, so that objects using the same face can share it.
+// Font files are identified by content rather than path, so identical copies
+// of a font in different folders share one face too.
+void GetFontFaceKey(
     IAttributeSource& attributeSource,
-    DrawingCanvas& drawingCanvas
+    array_ref<DWRITE_FONT_AXIS_VALUE const> fontAxisValues,
+    _Out_ std::u16string& fontFaceKey
     )
 {
-    // Invalidate the cached face.
-    if (attributeSource.IsCookieSame(DrawableObjectAttributeFontFilePath, IN OUT cookieFontFilePath)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeFontFamily, IN OUT cookieFamilyName)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeWeight, IN OUT cookieWeight)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeStretch, IN OUT cookieStretch)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeSlope, IN OUT cookieSlope)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeFontSimulations, IN OUT cookieFontSimulations)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeFontFaceIndex, IN OUT cookieFontFaceIndex)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeDWriteFontFaceType, IN OUT cookieDWriteFontFaceType)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeAxisTags, IN OUT cookieAxisTags)
-    &   attributeSource.IsCookieSame(DrawableObjectAttributeAxisValues, IN OUT cookieAxisValues)
-    &   (fontFace != nullptr)
-        )
+    wchar_t buffer[100];
+    array_ref<char16_t const> customFontFilePath = attributeSource.GetString(DrawableObjectAttributeFontFilePath);
+    auto fontSimulations = attributeSource.GetValue(DrawableObjectAttributeFontSimulations, DWRITE_FONT_SIMULATIONS_NONE);
+
+    if (!customFontFilePath.empty())
     {
-        return S_OK;
+        auto fontFaceIndex = attributeSource.GetValue(DrawableObjectAttributeFontFaceIndex, 0ui32);
+        auto fontFaceType = attributeSource.GetValue(DrawableObjectAttributeDWriteFontFaceType, DWRITE_FONT_FACE_TYPE_UNKNOWN);
+        FileContentIdentity fileIdentity;
+        if (SUCCEEDED(GetFileContentIdentity(customFontFilePath.data(), OUT fileIdentity)))
+        {
+            swprintf_s(buffer, L"content:%016llX-%llu", fileIdentity.hash, fileIdentity.size);
+            fontFaceKey.assign(ToChar16(buffer));
+        }
+        else // Missing files still get a key, though creation will fail.
+        {
+            fontFaceKey.assign(u"file:");
+            fontFaceKey.append(customFontFilePath.data());
+        }
+        swprintf_s(buffer, L"|%u|%u|%u", fontFaceIndex, fontFaceType, fontSimulations);
     }
+    else
+    {
+        array_ref<char16_t const> fontFamilyName = attributeSource.GetString(DrawableObjectAttributeFontFamily);
+        auto fontWeight = attributeSource.GetValue(DrawableObjectAttributeWeight, DWRITE_FONT_WEIGHT_NORMAL);
+        auto fontStretch = attributeSource.GetValue(DrawableObjectAttributeStretch, DWRITE_FONT_STRETCH_NORMAL);
+        auto fontStyle = attributeSource.GetValue(DrawableObjectAttributeSlope, DWRITE_FONT_STYLE_NORMAL);
+        fontFaceKey.assign(u"family:");
+        fontFaceKey.append(fontFamilyName.data());
+        swprintf_s(buffer, L"|%u|%u|%u|%u", fontWeight, fontStretch, fontStyle, fontSimulations);
+    }
+    fontFaceKey.append(ToChar16(buffer));
 
-    std::vector<DWRITE_FONT_AXIS_VALUE> fontAxisValues;
-    GetFontAxisValues(attributeSource, OUT fontAxisValues);
+    for (auto const& fontAxisValue : fontAxisValues)
+    {
+        swprintf_s(buffer, L"|%08X=%g", fontAxisValue.axisTag, fontAxisValue.value);
+        fontFaceKey.append(ToChar16(buffer));
+    }
+}
 
-    fontFace.clear();
+
+HRESULT CreateFontFaceFromAttributes(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    array_ref<DWRITE_FONT_AXIS_VALUE> fontAxisValues,
+    _COM_Outptr_ IDWriteFontFace** fontFace
+    )
+{
+    *fontFace = nullptr;
 
     array_ref<char16_t const> customFontFilePath = attributeSource.GetString(DrawableObjectAttributeFontFilePath);
+    TRACE_LOGGING_ACTIVITY(activity, "CreateFontFace",
+        TraceLoggingWideString(ToWChar(customFontFilePath.data()), "FilePath"),
+        TraceLoggingWideString(ToWChar(attributeSource.GetString(DrawableObjectAttributeFontFamily).data()), "FamilyName")
+        );
 
     // Use either filename or family name.
     // todo: Consider whether to search for a name inside a custom font collection rather than faceIndex.
     if (!customFontFilePath.empty())
     {
-        if (GetFileAttributes(ToWChar(customFontFilePath.data())) == -1)
+        // Load through the first path seen with the same content, so that
+        // DWrite maps one font file for all the copies.
+        FileContentIdentity fileIdentity;
+        std::u16string canonicalFontFilePath;
+        if (FAILED(GetFileContentIdentity(customFontFilePath.data(), OUT fileIdentity, OUT &canonicalFontFilePath)))
             return DWRITE_E_FILENOTFOUND;
 
         auto fontSimulations = attributeSource.GetValue(DrawableObjectAttributeFontSimulations, DWRITE_FONT_SIMULATIONS_NONE);
@@ -1865,12 +2646,12 @@ HRESULT CachedDWriteFontFace::Update(
         auto fontFaceType = attributeSource.GetValue(DrawableObjectAttributeDWriteFontFaceType, DWRITE_FONT_FACE_TYPE_UNKNOWN);
         return CreateFontFaceFromFile(
             drawingCanvas.GetDWriteFactoryWeakRef(),
-            ToWChar(customFontFilePath.data()),
+            ToWChar(canonicalFontFilePath.c_str()),
             fontFaceIndex,
             fontFaceType,
             fontSimulations,
             fontAxisValues,
-            OUT &this->fontFace
+            OUT fontFace
             );
     }
     else // Use family name in collection.
@@ -1882,6 +2663,7 @@ HRESULT CachedDWriteFontFace::Update(
         DWRITE_FONT_STRETCH fontStretch = attributeSource.GetValue(DrawableObjectAttributeStretch, DWRITE_FONT_STRETCH_NORMAL);
         DWRITE_FONT_STYLE fontStyle = attributeSource.GetValue(DrawableObjectAttributeSlope, DWRITE_FONT_STYLE_NORMAL);
 
+        ComPtr<IDWriteFontFace> newFontFace;
         IDWriteFactory* factory = drawingCanvas.GetDWriteFactoryWeakRef();
         ComPtr<IDWriteFontCollection> systemFontCollection;
         IFR(factory->GetSystemFontCollection(OUT &systemFontCollection));
@@ -1891,7 +2673,7 @@ HRESULT CachedDWriteFontFace::Update(
             fontWeight,
             fontStretch,
             fontStyle,
-            OUT &this->fontFace
+            OUT &newFontFace
             ));
 
         // If fontSimulations are set, recreate it using them instead.
@@ -1900,15 +2682,62 @@ HRESULT CachedDWriteFontFace::Update(
             ComPtr<IDWriteFontFace> simulatedFontFace;
             IFR(RecreateFontFace(
                 drawingCanvas.GetDWriteFactoryWeakRef(),
-                this->fontFace,
+                newFontFace,
                 fontSimulations,
                 fontAxisValues,
                 &simulatedFontFace
                 ));
-            std::swap(simulatedFontFace, this->fontFace);
+            std::swap(simulatedFontFace, newFontFace);
         }
+
+        *fontFace = newFontFace.Detach();
+    }
+
+    return S_OK;
+}
+
+
+HRESULT CachedDWriteFontFace::Update(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas
+    )
+{
+    // Invalidate the cached face.
+    if (attributeSource.IsCookieSame(DrawableObjectAttributeFontFilePath, IN OUT cookieFontFilePath)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeFontFamily, IN OUT cookieFamilyName)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeWeight, IN OUT cookieWeight)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeStretch, IN OUT cookieStretch)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeSlope, IN OUT cookieSlope)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeFontSimulations, IN OUT cookieFontSimulations)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeFontFaceIndex, IN OUT cookieFontFaceIndex)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeDWriteFontFaceType, IN OUT cookieDWriteFontFaceType)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeAxisTags, IN OUT cookieAxisTags)
+    &   attributeSource.IsCookieSame(DrawableObjectAttributeAxisValues, IN OUT cookieAxisValues)
+    &   (fontFace != nullptr)
+        )
+    {
+        return S_OK;
+    }
+
+    ScopedCachedResourceTimer timer;
+
+    std::vector<DWRITE_FONT_AXIS_VALUE> fontAxisValues;
+    GetFontAxisValues(attributeSource, OUT fontAxisValues);
+
+    fontFace.clear();
+
+    // Objects sharing the same font identity share the same face from the
+    // canvas, rather than each reparsing the font file.
+    std::u16string fontFaceKey;
+    GetFontFaceKey(attributeSource, fontAxisValues, OUT fontFaceKey);
+    if (SUCCEEDED(drawingCanvas.GetSharedResource<IDWriteFontFace>(fontFaceKey.c_str(), OUT &this->fontFace)))
+    {
+        return S_OK;
     }
 
+    IFR(CreateFontFaceFromAttributes(attributeSource, drawingCanvas, fontAxisValues, OUT &this->fontFace));
+    drawingCanvas.SetSharedResource<IDWriteFontFace>(fontFaceKey.c_str(), this->fontFace);
+
     return S_OK;
 }
 
@@ -1949,68 +2778,956 @@ HRESULT CachedDWriteRenderingParams::Update(IAttributeSource& attributeSource, D
 }
 
 
-// This probably should only exist on the stack within Draw or GetSize calls,
-// and not in a class definition since it contains pointers to data structures
-// that exist transiently.
-class CachedDWriteGlyphRun : public DWRITE_GLYPH_RUN
+size_t CachedDWriteRenderingParams::GetByteSize() const noexcept
 {
-public:
-    HRESULT Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, _In_ IDWriteFontFace* fontFace);
-    HRESULT GetGlyphAdvancesIfNull(); // Call Update first.
+    return (renderingParams != nullptr) ? g_estimatedRenderingParamsByteSize : 0;
+}
 
-protected:
-    std::vector<uint16_t> glyphBuffer_; // only used for nominal glyphs if attribute source returned none.
-    std::vector<float> glyphAdvances_; // only used if null glyph advances, and they are desired.
-    std::vector<DWRITE_GLYPH_OFFSET> glyphOffsets_;
+
+// Inputs to shaping besides the face, size, and measuring mode (see
+// DrawableObjectAttributeGlyphShaping).
+struct GlyphShapingOptions
+{
+    bool isRightToLeft = false;
+    char16_t const* localeName = u"";
+    std::vector<DWRITE_FONT_FEATURE> features;
+
+    void Initialize(IAttributeSource& attributeSource);
+    uint32_t GetHash() const noexcept;
 };
 
 
-HRESULT CachedDWriteGlyphRun::Update(
-    IAttributeSource& attributeSource,
-    DrawingCanvas& drawingCanvas,
-    _In_ IDWriteFontFace* newFontFace // weak reference
-    )
+void GlyphShapingOptions::Initialize(IAttributeSource& attributeSource)
 {
-    array_ref<DWRITE_GLYPH_OFFSET const> glyphOffsets;
-    array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
-    array_ref<float const> glyphAdvances = attributeSource.GetValues<float>(DrawableObjectAttributeAdvances);
-    array_ref<float const> glyphOffsetFloats = attributeSource.GetValues<float>(DrawableObjectAttributeOffsets);
-    float fontSize = attributeSource.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
     uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, 0ui32);
-
-    // If no glyphs were given, but text was, then read the text to get nominal glyph id's via the cmap.
-    if (glyphs.empty() && attributeSource.GetString(DrawableObjectAttributeGlyphs).empty())
+    isRightToLeft = !!(readingDirection & 1);
+    auto languageList = attributeSource.GetString(DrawableObjectAttributeLanguageList);
+    localeName = languageList.empty() ? u"" : languageList.data(); // Strings are stored nul-terminated.
+
+    array_ref<uint32_t const> featureTags;
+    attributeSource.GetValues(DrawableObjectAttributeTypographicFeatures, OUT featureTags);
+    features.clear();
+    for (auto featureTag : featureTags)
     {
-        array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
-        if (!text.empty())
-        {
-            fast_vector<char32_t, 120, false> utf32text;
-            utf32text.resize(text.size());
-
-            size_t convertedLength = static_cast<uint32_t>(ConvertTextUtf16ToUtf32NoReplacement(
-                text,
-                OUT utf32text,
-                nullptr // sourceCount
-                ));
-            utf32text.resize(convertedLength);
-            glyphBuffer_.resize(convertedLength);
-
-            uint32_t* codePoints = reinterpret_cast<uint32_t*>(utf32text.data());
-            IFR(newFontFace->GetGlyphIndices(codePoints, uint32_t(convertedLength), OUT glyphBuffer_.data()));
-            glyphs = glyphBuffer_;
-        }
+        features.push_back({DWRITE_FONT_FEATURE_TAG(featureTag), 1});
     }
+}
 
-    glyphOffsets_.clear();
 
-    // Recast the dx/dy float pairs to DWRITE_GLYPH_OFFSET's.
-    // If there aren't enough offsets for the number of glyphs, copy the first entries to an array,
-    // leaving the others as zeroes.
-    if (glyphOffsetFloats.size() >= glyphs.size() * 2U)
+uint32_t GlyphShapingOptions::GetHash() const noexcept
+{
+    // FNV-1a hash of the direction, locale, and features.
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ uint32_t(isRightToLeft)) * 16777619u;
+    for (char16_t const* unit = localeName; *unit != '\0'; ++unit)
     {
-        glyphOffsets.reset(glyphOffsetFloats.reinterpret_as<DWRITE_GLYPH_OFFSET const>());
+        hash = (hash ^ *unit) * 16777619u;
     }
-    else
+    for (auto const& feature : features)
+    {
+        hash = (hash ^ uint32_t(feature.nameTag)) * 16777619u;
+        hash = (hash ^ feature.parameter) * 16777619u;
+    }
+    return hash;
+}
+
+
+// Glyphs shaped from one script run of a text. It is shared via the canvas,
+// and kept there while any text containing it is drawn, so that editing one
+// part of a mixed script text only reshapes the runs the edit touched.
+class DECLSPEC_UUID("C3A91F52-0B7E-4D18-A6E4-5F2D8B07C936") SharedShapedTextRun : public ComObject
+{
+public:
+    bool IsSameSource(array_ref<char16_t const> sourceText) const noexcept
+    {
+        return sourceText.size() == text.size() && std::equal(sourceText.begin(), sourceText.end(), text.begin());
+    }
+
+    size_t GetByteSize() const noexcept
+    {
+        return sizeof(*this)
+            + text.size() * sizeof(text[0])
+            + glyphIndices.size() * sizeof(glyphIndices[0])
+            + glyphAdvances.size() * sizeof(glyphAdvances[0])
+            + glyphOffsets.size() * sizeof(glyphOffsets[0]);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedShapedTextRun, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    std::u16string text;
+    std::vector<uint16_t> glyphIndices;
+    std::vector<float> glyphAdvances;
+    std::vector<DWRITE_GLYPH_OFFSET> glyphOffsets;
+};
+
+
+void GetShapedTextRunKey(
+    _In_ IDWriteFontFace* fontFace,
+    float fontEmSize,
+    DWRITE_MEASURING_MODE measuringMode,
+    bool isSideways,
+    DWRITE_SCRIPT_ANALYSIS const& scriptAnalysis,
+    uint32_t shapingHash,
+    array_ref<char16_t const> text,
+    _Out_ std::u16string& shapedRunKey
+    )
+{
+    uint32_t hash = 2166136261u;
+    for (char16_t unit : text)
+    {
+        hash = (hash ^ unit) * 16777619u;
+    }
+
+    wchar_t buffer[120];
+    swprintf_s(
+        buffer,
+        L"shapedrun:%p|%08X|%u|%u|%u|%u|%08X|%zu|%08X",
+        fontFace,
+        reinterpret_cast<uint32_t const&>(fontEmSize),
+        measuringMode,
+        isSideways,
+        scriptAnalysis.script,
+        scriptAnalysis.shapes,
+        shapingHash,
+        text.size(),
+        hash
+        );
+    shapedRunKey.assign(ToChar16(buffer));
+}
+
+
+HRESULT GetSharedTextAnalyzer(DrawingCanvas& drawingCanvas, _COM_Outptr_ IDWriteTextAnalyzer** textAnalyzer)
+{
+    if (SUCCEEDED(drawingCanvas.GetSharedResource<IDWriteTextAnalyzer>(u"TextAnalyzer", OUT textAnalyzer)))
+        return S_OK;
+
+    IFR(drawingCanvas.GetDWriteFactoryWeakRef()->CreateTextAnalyzer(OUT textAnalyzer));
+    drawingCanvas.SetSharedResource<IDWriteTextAnalyzer>(u"TextAnalyzer", *textAnalyzer);
+    return S_OK;
+}
+
+
+// Glyph data depending only on the face, size, measuring mode, and glyphs
+// (or the text mapped to nominal glyphs, or shaped). It is shared via the
+// canvas, so all the glyph run objects of a comparison row drawn across
+// different APIs look up the cmap, advances, and metrics once rather than
+// each separately.
+class DECLSPEC_UUID("5B0E2C61-7A4D-4E38-9C0F-3D61A8B7E24F") SharedGlyphRunAnalysis : public ComObject
+{
+public:
+    HRESULT Initialize(
+        _In_ IDWriteFontFace* fontFace,
+        float fontEmSize,
+        DWRITE_MEASURING_MODE measuringMode,
+        bool isSideways,
+        bool isFromText,
+        array_ref<uint16_t const> sourceUnits
+        );
+
+    // Shape the text a script run at a time, reusing any runs the canvas
+    // already has shaped with the same face, size, and options.
+    HRESULT InitializeShaped(
+        DrawingCanvas& drawingCanvas,
+        _In_ IDWriteFontFace* fontFace,
+        float fontEmSize,
+        DWRITE_MEASURING_MODE measuringMode,
+        bool isSideways,
+        GlyphShapingOptions const& shapingOptions,
+        array_ref<char16_t const> text
+        );
+
+    // Keep the shaped runs in the canvas for as long as this is drawn, since
+    // the canvas would otherwise release them as unused.
+    void RetainShapedRuns(DrawingCanvas& drawingCanvas);
+
+    // Returns true if this analysis was built from the same source, since the
+    // key only contains a hash of the glyphs or text.
+    bool IsSameSource(bool isFromText, array_ref<uint16_t const> sourceUnits) const noexcept;
+
+    size_t GetByteSize() const noexcept;
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedGlyphRunAnalysis, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    ComPtr<IDWriteFontFace> fontFace; // Held so that a new face can never reuse the address in the key.
+    DWRITE_FONT_METRICS fontMetrics = {};
+    std::vector<uint16_t> glyphIndices;
+    std::vector<float> glyphAdvances; // Font advances for the measuring mode, or the shaped advances.
+    std::vector<DWRITE_GLYPH_OFFSET> glyphOffsets; // Only for shaped text, else empty.
+
+protected:
+    bool isFromText_ = false;
+    std::vector<uint16_t> sourceUnits_; // Either the glyph ids or UTF-16 text.
+    std::vector<std::pair<std::u16string, ComPtr<SharedShapedTextRun>>> shapedRuns_; // Keys and runs, if shaped.
+};
+
+
+HRESULT SharedGlyphRunAnalysis::Initialize(
+    _In_ IDWriteFontFace* newFontFace,
+    float fontEmSize,
+    DWRITE_MEASURING_MODE measuringMode,
+    bool isSideways,
+    bool isFromText,
+    array_ref<uint16_t const> sourceUnits
+    )
+{
+    fontFace = newFontFace;
+    isFromText_ = isFromText;
+    sourceUnits_.assign(sourceUnits.begin(), sourceUnits.end());
+
+    if (isFromText)
+    {
+        // Read the text to get nominal glyph id's via the cmap.
+        array_ref<char16_t const> text = sourceUnits.reinterpret_as<char16_t const>();
+        scratch_vector<char32_t, false> utf32text(text.size());
+
+        size_t convertedLength = static_cast<uint32_t>(ConvertTextUtf16ToUtf32NoReplacement(
+            text,
+            OUT utf32text,
+            nullptr // sourceCount
+            ));
+        utf32text.resize(convertedLength);
+        glyphIndices.resize(convertedLength);
+
+        uint32_t* codePoints = reinterpret_cast<uint32_t*>(utf32text.data());
+        IFR(fontFace->GetGlyphIndices(codePoints, uint32_t(convertedLength), OUT glyphIndices.data()));
+    }
+    else
+    {
+        glyphIndices = sourceUnits_;
+    }
+
+    IFR(GetFontFaceMetrics(fontFace, fontEmSize, measuringMode, OUT &fontMetrics));
+
+    glyphAdvances.resize(glyphIndices.size());
+    IFR(GetFontFaceAdvances(
+        fontFace,
+        fontEmSize,
+        glyphIndices,
+        measuringMode,
+        isSideways,
+        OUT glyphAdvances
+        ));
+
+    return S_OK;
+}
+
+
+HRESULT SharedGlyphRunAnalysis::InitializeShaped(
+    DrawingCanvas& drawingCanvas,
+    _In_ IDWriteFontFace* newFontFace,
+    float fontEmSize,
+    DWRITE_MEASURING_MODE measuringMode,
+    bool isSideways,
+    GlyphShapingOptions const& shapingOptions,
+    array_ref<char16_t const> text
+    )
+{
+    fontFace = newFontFace;
+    isFromText_ = true;
+    array_ref<uint16_t const> sourceUnits = text.reinterpret_as<uint16_t const>();
+    sourceUnits_.assign(sourceUnits.begin(), sourceUnits.end());
+
+    IFR(GetFontFaceMetrics(fontFace, fontEmSize, measuringMode, OUT &fontMetrics));
+
+    ComPtr<IDWriteTextAnalyzer> textAnalyzer;
+    IFR(GetSharedTextAnalyzer(drawingCanvas, OUT &textAnalyzer));
+
+    std::vector<TextScriptRun> scriptRuns;
+    IFR(AnalyzeTextScripts(textAnalyzer, text, shapingOptions.localeName, shapingOptions.isRightToLeft, OUT scriptRuns));
+
+    uint32_t const shapingHash = shapingOptions.GetHash();
+    std::u16string shapedRunKey;
+    for (auto const& scriptRun : scriptRuns)
+    {
+        auto runText = text.get_slice(scriptRun.textPosition, scriptRun.textPosition + scriptRun.textLength);
+        GetShapedTextRunKey(fontFace, fontEmSize, measuringMode, isSideways, scriptRun.scriptAnalysis, shapingHash, runText, OUT shapedRunKey);
+
+        ComPtr<SharedShapedTextRun> shapedRun;
+        if (FAILED(drawingCanvas.GetSharedResource<SharedShapedTextRun>(shapedRunKey.c_str(), OUT &shapedRun))
+        ||  !shapedRun->IsSameSource(runText))
+        {
+            shapedRun.clear();
+            shapedRun.Set(new SharedShapedTextRun());
+            shapedRun->text.assign(runText.begin(), runText.end());
+            IFR(ShapeTextScriptRun(
+                textAnalyzer,
+                fontFace,
+                fontEmSize,
+                measuringMode,
+                isSideways,
+                shapingOptions.isRightToLeft,
+                scriptRun.scriptAnalysis,
+                shapingOptions.localeName,
+                shapingOptions.features,
+                runText,
+                OUT shapedRun->glyphIndices,
+                OUT shapedRun->glyphAdvances,
+                OUT shapedRun->glyphOffsets
+                ));
+            drawingCanvas.SetSharedResource<SharedShapedTextRun>(shapedRunKey.c_str(), shapedRun, shapedRun->GetByteSize());
+        }
+
+        glyphIndices.insert(glyphIndices.end(), shapedRun->glyphIndices.begin(), shapedRun->glyphIndices.end());
+        glyphAdvances.insert(glyphAdvances.end(), shapedRun->glyphAdvances.begin(), shapedRun->glyphAdvances.end());
+        glyphOffsets.insert(glyphOffsets.end(), shapedRun->glyphOffsets.begin(), shapedRun->glyphOffsets.end());
+        shapedRuns_.push_back({shapedRunKey, std::move(shapedRun)});
+    }
+
+    return S_OK;
+}
+
+
+void SharedGlyphRunAnalysis::RetainShapedRuns(DrawingCanvas& drawingCanvas)
+{
+    for (auto const& shapedRun : shapedRuns_)
+    {
+        // Getting it counts as a use. Put back any already released.
+        ComPtr<SharedShapedTextRun> existingShapedRun;
+        if (FAILED(drawingCanvas.GetSharedResource<SharedShapedTextRun>(shapedRun.first.c_str(), OUT &existingShapedRun)))
+        {
+            drawingCanvas.SetSharedResource<SharedShapedTextRun>(shapedRun.first.c_str(), shapedRun.second, shapedRun.second->GetByteSize());
+        }
+    }
+}
+
+
+bool SharedGlyphRunAnalysis::IsSameSource(bool isFromText, array_ref<uint16_t const> sourceUnits) const noexcept
+{
+    return isFromText == isFromText_
+        && sourceUnits.size() == sourceUnits_.size()
+        && std::equal(sourceUnits.begin(), sourceUnits.end(), sourceUnits_.begin());
+}
+
+
+size_t SharedGlyphRunAnalysis::GetByteSize() const noexcept
+{
+    // The shaped runs are counted separately in the canvas.
+    return sizeof(*this)
+        + sourceUnits_.size() * sizeof(sourceUnits_[0])
+        + glyphIndices.size() * sizeof(glyphIndices[0])
+        + glyphAdvances.size() * sizeof(glyphAdvances[0])
+        + glyphOffsets.size() * sizeof(glyphOffsets[0])
+        + shapedRuns_.size() * sizeof(shapedRuns_[0]);
+}
+
+
+// Build a key identifying the shared glyph run analysis. The face pointer is
+// unique among live faces, which the analysis keeps alive.
+void GetGlyphRunAnalysisKey(
+    _In_ IDWriteFontFace* fontFace,
+    float fontEmSize,
+    DWRITE_MEASURING_MODE measuringMode,
+    bool isSideways,
+    bool isFromText,
+    _In_opt_ GlyphShapingOptions const* shapingOptions, // Null unless shaping the text.
+    array_ref<uint16_t const> sourceUnits,
+    _Out_ std::u16string& glyphRunKey
+    )
+{
+    // FNV-1a hash of the glyphs or text.
+    uint32_t hash = 2166136261u;
+    for (uint16_t unit : sourceUnits)
+    {
+        hash = (hash ^ unit) * 16777619u;
+    }
+
+    wchar_t buffer[120];
+    swprintf_s(
+        buffer,
+        L"glyphrun:%p|%08X|%u|%u|%u|%u|%08X|%zu|%08X",
+        fontFace,
+        reinterpret_cast<uint32_t const&>(fontEmSize),
+        measuringMode,
+        isSideways,
+        isFromText,
+        shapingOptions != nullptr,
+        (shapingOptions != nullptr) ? shapingOptions->GetHash() : 0,
+        sourceUnits.size(),
+        hash
+        );
+    glyphRunKey.assign(ToChar16(buffer));
+}
+
+
+// Color glyph layers and decoded color bitmap glyphs, shared via the canvas so
+// that emoji are decomposed and decoded once rather than on every draw. Since
+// it is a shared resource, it is released along with the canvas's other
+// resources once a paint passes without using it.
+class DECLSPEC_UUID("8E4D27B3-61C0-4F5A-B9D2-0A7C3E58F146") SharedColorGlyphCache : public ComObject
+{
+public:
+    struct BitmapGlyph
+    {
+        ComPtr<ID2D1Bitmap> bitmap; // Null if the glyph has no image in the format.
+        D2D_POINT_2L horizontalLeftOrigin; // Pen position within the image, in pixels.
+        uint32_t pixelsPerEm; // Of the strike actually used.
+    };
+
+    // Get the cache of the canvas, creating it if needed.
+    static HRESULT Get(DrawingCanvas& drawingCanvas, _Out_ ComPtr<SharedColorGlyphCache>& cache);
+
+    // Record any growth since Get against the canvas's resource budget.
+    void UpdateByteSize(DrawingCanvas& drawingCanvas);
+
+    HRESULT GetBitmapGlyph(
+        ID2D1RenderTarget* renderTarget,
+        IWICImagingFactory* wicFactory,
+        IDWriteFontFace4* fontFace,
+        DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormat,
+        uint32_t pixelsPerEm,
+        uint16_t glyphId,
+        _Out_ BitmapGlyph const** bitmapGlyph
+        );
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedColorGlyphCache, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    ColorGlyphLayerCache layerCache;
+
+    static constexpr char16_t const* sharedResourceName = u"ColorGlyphCache";
+
+    // Bitmaps are released once their pixels exceed this budget.
+    static constexpr size_t maximumBitmapGlyphByteSize = 32u << 20;
+
+protected:
+    struct BitmapGlyphKey
+    {
+        IDWriteFontFace4* fontFace;
+        DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormat;
+        uint32_t pixelsPerEm;
+        uint16_t glyphId;
+
+        bool operator==(BitmapGlyphKey const& other) const noexcept
+        {
+            return fontFace == other.fontFace
+                && glyphImageFormat == other.glyphImageFormat
+                && pixelsPerEm == other.pixelsPerEm
+                && glyphId == other.glyphId;
+        }
+    };
+
+    struct BitmapGlyphKeyHasher
+    {
+        size_t operator()(BitmapGlyphKey const& key) const noexcept
+        {
+            size_t hash = reinterpret_cast<size_t>(key.fontFace) * 0x9E3779B1u;
+            return hash ^ (size_t(key.glyphImageFormat) << 24) ^ (size_t(key.pixelsPerEm) << 16) ^ key.glyphId;
+        }
+    };
+
+    void ClearBitmapGlyphs();
+
+    ComPtr<ID2D1RenderTarget> bitmapRenderTarget_; // Device the bitmaps belong to.
+    std::unordered_map<BitmapGlyphKey, BitmapGlyph, BitmapGlyphKeyHasher> bitmapGlyphs_;
+    std::unordered_map<IDWriteFontFace4*, ComPtr<IDWriteFontFace4>> bitmapFontFaces_; // Held since their pointers are in the keys.
+    size_t bitmapGlyphByteSize_ = 0;
+};
+
+
+HRESULT SharedColorGlyphCache::Get(DrawingCanvas& drawingCanvas, _Out_ ComPtr<SharedColorGlyphCache>& cache)
+{
+    cache.clear();
+    if (FAILED(drawingCanvas.GetSharedResource<SharedColorGlyphCache>(sharedResourceName, OUT &cache)))
+    {
+        cache.Set(new SharedColorGlyphCache());
+        drawingCanvas.SetSharedResource<SharedColorGlyphCache>(sharedResourceName, cache, sizeof(SharedColorGlyphCache));
+    }
+    return S_OK;
+}
+
+
+void SharedColorGlyphCache::UpdateByteSize(DrawingCanvas& drawingCanvas)
+{
+    size_t byteSize = layerCache.GetByteSize() + bitmapGlyphByteSize_ + bitmapGlyphs_.size() * (sizeof(BitmapGlyphKey) + sizeof(BitmapGlyph));
+    drawingCanvas.SetSharedResource<SharedColorGlyphCache>(sharedResourceName, this, byteSize);
+}
+
+
+void SharedColorGlyphCache::ClearBitmapGlyphs()
+{
+    bitmapGlyphs_.clear();
+    bitmapFontFaces_.clear();
+    bitmapGlyphByteSize_ = 0;
+}
+
+
+HRESULT SharedColorGlyphCache::GetBitmapGlyph(
+    ID2D1RenderTarget* renderTarget,
+    IWICImagingFactory* wicFactory,
+    IDWriteFontFace4* fontFace,
+    DWRITE_GLYPH_IMAGE_FORMATS glyphImageFormat,
+    uint32_t pixelsPerEm,
+    uint16_t glyphId,
+    _Out_ BitmapGlyph const** bitmapGlyph
+    )
+{
+    *bitmapGlyph = nullptr;
+
+    // Bitmaps only work with the render target which created them.
+    if (bitmapRenderTarget_ != renderTarget)
+    {
+        ClearBitmapGlyphs();
+        bitmapRenderTarget_ = renderTarget;
+    }
+
+    BitmapGlyphKey key = { fontFace, glyphImageFormat, pixelsPerEm, glyphId };
+    auto match = bitmapGlyphs_.find(key);
+    if (match != bitmapGlyphs_.end())
+    {
+        *bitmapGlyph = &match->second;
+        return S_OK;
+    }
+
+    if (bitmapGlyphByteSize_ > maximumBitmapGlyphByteSize)
+    {
+        ClearBitmapGlyphs();
+    }
+
+    ScopedCachedResourceTimer timer;
+
+    DWRITE_GLYPH_IMAGE_DATA glyphData = {};
+    void* glyphDataContext = nullptr;
+    IFR(fontFace->GetGlyphImageData(glyphId, pixelsPerEm, glyphImageFormat, OUT &glyphData, OUT &glyphDataContext));
+    auto releaseGlyphData = DeferCleanup([&]() { fontFace->ReleaseGlyphImageData(glyphDataContext); });
+
+    BitmapGlyph newBitmapGlyph = { nullptr, glyphData.horizontalLeftOrigin, glyphData.pixelsPerEm };
+    D2D1_BITMAP_PROPERTIES const bitmapProperties = D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED));
+
+    if (glyphData.imageData == nullptr || glyphData.imageDataSize == 0)
+    {
+        // Nothing to draw for this glyph.
+    }
+    else if (glyphImageFormat == DWRITE_GLYPH_IMAGE_FORMATS_PREMULTIPLIED_B8G8R8A8)
+    {
+        IFR(renderTarget->CreateBitmap(
+            glyphData.pixelSize,
+            glyphData.imageData,
+            glyphData.pixelSize.width * sizeof(uint32_t),
+            &bitmapProperties,
+            OUT &newBitmapGlyph.bitmap
+            ));
+    }
+    else // PNG, JPEG, TIFF
+    {
+        ComPtr<IWICStream> stream;
+        ComPtr<IWICBitmapDecoder> decoder;
+        ComPtr<IWICBitmapFrameDecode> source;
+        ComPtr<IWICFormatConverter> converter;
+
+        IFR(wicFactory->CreateStream(OUT &stream));
+        IFR(stream->InitializeFromMemory(const_cast<BYTE*>(reinterpret_cast<BYTE const*>(glyphData.imageData)), glyphData.imageDataSize));
+        IFR(wicFactory->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnLoad, OUT &decoder));
+        IFR(decoder->GetFrame(0, OUT &source));
+        IFR(wicFactory->CreateFormatConverter(OUT &converter));
+        IFR(converter->Initialize(source, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, nullptr, 0.f, WICBitmapPaletteTypeMedianCut));
+        IFR(renderTarget->CreateBitmapFromWicBitmap(converter, &bitmapProperties, OUT &newBitmapGlyph.bitmap));
+    }
+
+    if (newBitmapGlyph.bitmap != nullptr)
+    {
+        D2D1_SIZE_U bitmapSize = newBitmapGlyph.bitmap->GetPixelSize();
+        bitmapGlyphByteSize_ += size_t(bitmapSize.width) * bitmapSize.height * sizeof(uint32_t);
+    }
+
+    auto& heldFontFace = bitmapFontFaces_[fontFace];
+    if (heldFontFace == nullptr)
+    {
+        heldFontFace = fontFace;
+    }
+
+    *bitmapGlyph = &bitmapGlyphs_.emplace(key, std::move(newBitmapGlyph)).first->second;
+    return S_OK;
+}
+
+
+// Glyph outlines as D2D path geometries, shared via the canvas so that
+// rotated and skewed runs with glyph_geometries on fill the same geometry under each new transform
+// rather than D2D outlining and tessellating each glyph on every draw. On
+// device contexts, the tessellation itself is kept as a realization, which
+// is reused until a transform needs a finer flattening tolerance.
+class DECLSPEC_UUID("4B1794FC-7299-49F9-A3E5-70E14E8D37B1") SharedGlyphGeometryCache : public ComObject
+{
+public:
+    // Get the cache of the canvas, creating it if needed.
+    static HRESULT Get(DrawingCanvas& drawingCanvas, _Out_ ComPtr<SharedGlyphGeometryCache>& cache);
+
+    // Record any growth since Get against the canvas's resource budget.
+    void UpdateByteSize(DrawingCanvas& drawingCanvas);
+
+    // Fill a horizontal left-to-right glyph run, which must have advances,
+    // leaving the render target's transform as given.
+    HRESULT DrawGlyphRun(
+        ID2D1RenderTarget* renderTarget,
+        ID2D1Factory* d2dFactory,
+        DWRITE_GLYPH_RUN const& glyphRun,
+        float x,
+        float y,
+        DX_MATRIX_3X2F const& transform,
+        ID2D1Brush* brush
+        );
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedGlyphGeometryCache, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    static constexpr char16_t const* sharedResourceName = u"GlyphGeometryCache";
+
+    // Geometries are released once their estimated size exceeds this budget.
+    static constexpr size_t maximumGeometryByteSize = 16u << 20;
+
+protected:
+    struct GlyphGeometry
+    {
+        ComPtr<ID2D1PathGeometry> geometry; // Null if the glyph has no outline, like a space.
+        ComPtr<ID2D1GeometryRealization> realization; // Null until drawn on a device context.
+        float realizationTolerance;
+    };
+
+    struct GlyphGeometryKey
+    {
+        IDWriteFontFace* fontFace;
+        float fontEmSize;
+        uint16_t glyphId;
+
+        bool operator==(GlyphGeometryKey const& other) const noexcept
+        {
+            return fontFace == other.fontFace
+                && fontEmSize == other.fontEmSize
+                && glyphId == other.glyphId;
+        }
+    };
+
+    struct GlyphGeometryKeyHasher
+    {
+        size_t operator()(GlyphGeometryKey const& key) const noexcept
+        {
+            size_t hash = reinterpret_cast<size_t>(key.fontFace) * 0x9E3779B1u;
+            return hash ^ (size_t(reinterpret_cast<uint32_t const&>(key.fontEmSize)) << 16) ^ key.glyphId;
+        }
+    };
+
+    HRESULT GetGlyphGeometry(
+        ID2D1Factory* d2dFactory,
+        IDWriteFontFace* fontFace,
+        float fontEmSize,
+        uint16_t glyphId,
+        _Out_ GlyphGeometry** glyphGeometry
+        );
+
+    void ClearGlyphGeometries();
+    void ClearRealizations();
+
+    ComPtr<ID2D1Factory> geometryFactory_; // Factory the geometries belong to.
+    ComPtr<ID2D1DeviceContext1> realizationDeviceContext_; // Device the realizations belong to.
+    std::unordered_map<GlyphGeometryKey, GlyphGeometry, GlyphGeometryKeyHasher> glyphGeometries_;
+    std::unordered_map<IDWriteFontFace*, ComPtr<IDWriteFontFace>> fontFaces_; // Held since their pointers are in the keys.
+    size_t geometryByteSize_ = 0;
+    size_t realizationByteSize_ = 0;
+};
+
+
+HRESULT SharedGlyphGeometryCache::Get(DrawingCanvas& drawingCanvas, _Out_ ComPtr<SharedGlyphGeometryCache>& cache)
+{
+    cache.clear();
+    if (FAILED(drawingCanvas.GetSharedResource<SharedGlyphGeometryCache>(sharedResourceName, OUT &cache)))
+    {
+        cache.Set(new SharedGlyphGeometryCache());
+        drawingCanvas.SetSharedResource<SharedGlyphGeometryCache>(sharedResourceName, cache, sizeof(SharedGlyphGeometryCache));
+    }
+    return S_OK;
+}
+
+
+void SharedGlyphGeometryCache::UpdateByteSize(DrawingCanvas& drawingCanvas)
+{
+    size_t byteSize = geometryByteSize_ + realizationByteSize_ + glyphGeometries_.size() * (sizeof(GlyphGeometryKey) + sizeof(GlyphGeometry));
+    drawingCanvas.SetSharedResource<SharedGlyphGeometryCache>(sharedResourceName, this, byteSize);
+}
+
+
+void SharedGlyphGeometryCache::ClearGlyphGeometries()
+{
+    glyphGeometries_.clear();
+    fontFaces_.clear();
+    geometryByteSize_ = 0;
+    realizationByteSize_ = 0;
+}
+
+
+void SharedGlyphGeometryCache::ClearRealizations()
+{
+    for (auto& glyphGeometry : glyphGeometries_)
+    {
+        glyphGeometry.second.realization.clear();
+    }
+    realizationByteSize_ = 0;
+}
+
+
+HRESULT SharedGlyphGeometryCache::GetGlyphGeometry(
+    ID2D1Factory* d2dFactory,
+    IDWriteFontFace* fontFace,
+    float fontEmSize,
+    uint16_t glyphId,
+    _Out_ GlyphGeometry** glyphGeometry
+    )
+{
+    *glyphGeometry = nullptr;
+
+    // Geometries only work with the factory which created them.
+    if (geometryFactory_ != d2dFactory)
+    {
+        ClearGlyphGeometries();
+        geometryFactory_ = d2dFactory;
+    }
+
+    GlyphGeometryKey key = { fontFace, fontEmSize, glyphId };
+    auto match = glyphGeometries_.find(key);
+    if (match != glyphGeometries_.end())
+    {
+        *glyphGeometry = &match->second;
+        return S_OK;
+    }
+
+    if (geometryByteSize_ + realizationByteSize_ > maximumGeometryByteSize)
+    {
+        ClearGlyphGeometries();
+    }
+
+    ScopedCachedResourceTimer timer;
+
+    ComPtr<ID2D1PathGeometry> geometry;
+    ComPtr<ID2D1GeometrySink> geometrySink;
+    IFR(d2dFactory->CreatePathGeometry(OUT &geometry));
+    IFR(geometry->Open(OUT &geometrySink));
+    IFR(fontFace->GetGlyphRunOutline(
+        fontEmSize,
+        &glyphId,
+        nullptr, // glyphAdvances
+        nullptr, // glyphOffsets
+        1,
+        false, // isSideways
+        false, // isRightToLeft
+        geometrySink
+        ));
+    IFR(geometrySink->Close());
+
+    UINT32 segmentCount = 0;
+    geometry->GetSegmentCount(OUT &segmentCount);
+    if (segmentCount == 0)
+    {
+        geometry.clear();
+    }
+    geometryByteSize_ += segmentCount * sizeof(D2D1_BEZIER_SEGMENT);
+
+    auto& heldFontFace = fontFaces_[fontFace];
+    if (heldFontFace == nullptr)
+    {
+        heldFontFace = fontFace;
+    }
+
+    GlyphGeometry newGlyphGeometry = { std::move(geometry), nullptr, 0 };
+    *glyphGeometry = &glyphGeometries_.emplace(key, std::move(newGlyphGeometry)).first->second;
+    return S_OK;
+}
+
+
+HRESULT SharedGlyphGeometryCache::DrawGlyphRun(
+    ID2D1RenderTarget* renderTarget,
+    ID2D1Factory* d2dFactory,
+    DWRITE_GLYPH_RUN const& glyphRun,
+    float x,
+    float y,
+    DX_MATRIX_3X2F const& transform,
+    ID2D1Brush* brush
+    )
+{
+    DEBUG_ASSERT(glyphRun.glyphAdvances != nullptr || glyphRun.glyphCount == 0);
+    DEBUG_ASSERT(!glyphRun.isSideways && !(glyphRun.bidiLevel & 1));
+
+    // Realizations only work with the device context which created them.
+    ComPtr<ID2D1DeviceContext1> deviceContext;
+    renderTarget->QueryInterface(OUT &deviceContext);
+    if (realizationDeviceContext_ != deviceContext)
+    {
+        ClearRealizations();
+        realizationDeviceContext_ = deviceContext;
+    }
+
+    float dpiX, dpiY;
+    renderTarget->GetDpi(OUT &dpiX, OUT &dpiY);
+    float const tolerance = D2D1::ComputeFlatteningTolerance(transform.d2d, dpiX, dpiY);
+
+    float penX = x;
+    for (uint32_t i = 0; i < glyphRun.glyphCount; ++i)
+    {
+        float glyphX = penX;
+        float glyphY = y;
+        if (glyphRun.glyphOffsets != nullptr)
+        {
+            glyphX += glyphRun.glyphOffsets[i].advanceOffset;
+            glyphY -= glyphRun.glyphOffsets[i].ascenderOffset;
+        }
+        penX += glyphRun.glyphAdvances[i];
+
+        GlyphGeometry* glyphGeometry;
+        IFR(GetGlyphGeometry(d2dFactory, glyphRun.fontFace, glyphRun.fontEmSize, glyphRun.glyphIndices[i], OUT &glyphGeometry));
+        if (glyphGeometry->geometry == nullptr)
+            continue;
+
+        DX_MATRIX_3X2F const glyphOrigin = { 1, 0, 0, 1, glyphX, glyphY };
+        DX_MATRIX_3X2F glyphTransform;
+        CombineMatrix(glyphOrigin, transform, OUT glyphTransform);
+        renderTarget->SetTransform(&glyphTransform.d2d);
+
+        if (deviceContext != nullptr)
+        {
+            // Any realization at least as fine as this transform needs will do.
+            if (glyphGeometry->realization == nullptr || glyphGeometry->realizationTolerance > tolerance)
+            {
+                glyphGeometry->realization.clear();
+                IFR(deviceContext->CreateFilledGeometryRealization(glyphGeometry->geometry, tolerance, OUT &glyphGeometry->realization));
+                glyphGeometry->realizationTolerance = tolerance;
+
+                UINT32 segmentCount = 0;
+                glyphGeometry->geometry->GetSegmentCount(OUT &segmentCount);
+                realizationByteSize_ += segmentCount * sizeof(D2D1_TRIANGLE) * 4; // Rough, since the tessellation is opaque.
+            }
+            deviceContext->DrawGeometryRealization(glyphGeometry->realization, brush);
+        }
+        else
+        {
+            renderTarget->FillGeometry(glyphGeometry->geometry, brush);
+        }
+    }
+
+    renderTarget->SetTransform(&transform.d2d);
+    return S_OK;
+}
+
+
+// This probably should only exist on the stack within Draw or GetSize calls,
+// and not in a class definition since it contains pointers to data structures
+// that exist transiently.
+class CachedDWriteGlyphRun : public DWRITE_GLYPH_RUN
+{
+public:
+    HRESULT Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, _In_ IDWriteFontFace* fontFace);
+    HRESULT GetGlyphAdvancesIfNull(); // Call Update first.
+    DWRITE_FONT_METRICS const& GetFontMetrics() const { return analysis_->fontMetrics; } // Call Update first.
+
+protected:
+    ComPtr<SharedGlyphRunAnalysis> analysis_; // shared nominal glyphs, advances, and metrics.
+    std::vector<float> glyphAdvances_; // only used if fewer advances than glyphs were given.
+    std::vector<DWRITE_GLYPH_OFFSET> glyphOffsets_;
+};
+
+
+HRESULT CachedDWriteGlyphRun::Update(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    _In_ IDWriteFontFace* newFontFace // weak reference
+    )
+{
+    array_ref<DWRITE_GLYPH_OFFSET const> glyphOffsets;
+    array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
+    array_ref<float const> glyphAdvances = attributeSource.GetValues<float>(DrawableObjectAttributeAdvances);
+    array_ref<float const> glyphOffsetFloats = attributeSource.GetValues<float>(DrawableObjectAttributeOffsets);
+    float fontSize = attributeSource.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
+    uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, 0ui32);
+    DWRITE_MEASURING_MODE measuringMode = attributeSource.GetValue(DrawableObjectAttributeDWriteMeasuringMode, DWRITE_MEASURING_MODE_NATURAL);
+    bool const isSideways = !!(readingDirection & 4);
+
+    if (newFontFace == nullptr)
+        return DWRITE_E_NOFONT;
+
+    // If no glyphs were given, but text was, then use the nominal glyph id's of
+    // the text, or shape it if asked.
+    bool isFromText = false;
+    array_ref<uint16_t const> sourceUnits = glyphs;
+    if (glyphs.empty() && attributeSource.GetString(DrawableObjectAttributeGlyphs).empty())
+    {
+        isFromText = true;
+        sourceUnits = attributeSource.GetString(DrawableObjectAttributeText).reinterpret_as<uint16_t const>();
+    }
+    bool const isShaped = isFromText && attributeSource.GetValue(DrawableObjectAttributeGlyphShaping, false);
+
+    GlyphShapingOptions shapingOptions;
+    if (isShaped)
+    {
+        shapingOptions.Initialize(attributeSource);
+    }
+
+    // Reuse the analysis of another object with the same glyphs and face, or
+    // create it for the next ones.
+    std::u16string glyphRunKey;
+    GetGlyphRunAnalysisKey(newFontFace, fontSize, measuringMode, isSideways, isFromText, isShaped ? &shapingOptions : nullptr, sourceUnits, OUT glyphRunKey);
+    analysis_.clear();
+    if (FAILED(drawingCanvas.GetSharedResource<SharedGlyphRunAnalysis>(glyphRunKey.c_str(), OUT &analysis_))
+    ||  !analysis_->IsSameSource(isFromText, sourceUnits))
+    {
+        ScopedCachedResourceTimer timer;
+
+        analysis_.clear();
+        analysis_.Set(new SharedGlyphRunAnalysis());
+        if (isShaped)
+        {
+            auto text = sourceUnits.reinterpret_as<char16_t const>();
+            IFR(analysis_->InitializeShaped(drawingCanvas, newFontFace, fontSize, measuringMode, isSideways, shapingOptions, text));
+        }
+        else
+        {
+            IFR(analysis_->Initialize(newFontFace, fontSize, measuringMode, isSideways, isFromText, sourceUnits));
+        }
+        drawingCanvas.SetSharedResource<SharedGlyphRunAnalysis>(glyphRunKey.c_str(), analysis_, analysis_->GetByteSize());
+    }
+    else if (isShaped)
+    {
+        analysis_->RetainShapedRuns(drawingCanvas);
+    }
+    glyphs = analysis_->glyphIndices;
+
+    // Shaped text has its own advances and offsets, which any given explicitly override.
+    if (isShaped)
+    {
+        if (glyphAdvances.empty())
+        {
+            glyphAdvances = analysis_->glyphAdvances;
+        }
+        if (glyphOffsetFloats.empty())
+        {
+            auto const& shapedOffsets = analysis_->glyphOffsets;
+            glyphOffsetFloats.reset(reinterpret_cast<float const*>(shapedOffsets.data()), shapedOffsets.size() * 2);
+        }
+    }
+
+    glyphOffsets_.clear();
+
+    // Recast the dx/dy float pairs to DWRITE_GLYPH_OFFSET's.
+    // If there aren't enough offsets for the number of glyphs, copy the first entries to an array,
+    // leaving the others as zeroes.
+    if (glyphOffsetFloats.size() >= glyphs.size() * 2U)
+    {
+        glyphOffsets.reset(glyphOffsetFloats.reinterpret_as<DWRITE_GLYPH_OFFSET const>());
+    }
+    else
     {
         glyphOffsets_.resize(glyphs.size());
         memcpy(glyphOffsets_.data(), glyphOffsetFloats.data(), glyphOffsetFloats.size_in_bytes());
@@ -2041,7 +3758,7 @@ HRESULT CachedDWriteGlyphRun::Update(
         glyphs.data(),
         glyphAdvances.size() < glyphs.size() ? nullptr : glyphAdvances.data(),
         glyphOffsets.size()  < glyphs.size() ? nullptr : glyphOffsets.data(),
-        !!(readingDirection & 4), // isSideways
+        isSideways,
         readingDirection & 1 // bidiLevel
     };
 
@@ -2058,35 +3775,8 @@ HRESULT CachedDWriteGlyphRun::GetGlyphAdvancesIfNull()
     if (glyphRun.glyphAdvances != nullptr || glyphRun.glyphCount == 0)
         return S_OK;
 
-    // todo: Replace with 
-    //IFR(GetFontFaceAdvances(
-    //    cachedGlyphRun.fontFace,
-    //    cachedGlyphRun.fontEmSize,
-    //    { cachedGlyphRun.glyphIndices, cachedGlyphRun.glyphCount },
-    //    measuringMode,
-    //    !!cachedGlyphRun.isSideways,
-    //    OUT glyphAdvancesBuffer
-    //    ));
-    //glyphAdvances = glyphAdvancesBuffer.data();
-
-    fast_vector<int32_t, 120, false> glyphAdvances(glyphRun.glyphCount);
-    ComPtr<IDWriteFontFace1> fontFace1;
-    if (SUCCEEDED(fontFace->QueryInterface(OUT &fontFace1)))
-    {
-        fontFace1->GetDesignGlyphAdvances(glyphRun.glyphCount, glyphRun.glyphIndices, OUT glyphAdvances.data(), glyphRun.isSideways);
-    }
-
-    // Scale glyph advances down.
-    DWRITE_FONT_METRICS fontMetrics;
-    fontFace->GetMetrics(OUT &fontMetrics);
-    glyphAdvances_.resize(glyphRun.glyphCount);
-    for (uint32_t i = 0; i < glyphRun.glyphCount; ++i)
-    {
-        glyphAdvances_[i] = glyphRun.fontEmSize * glyphAdvances[i] / fontMetrics.designUnitsPerEm;
-    }
-
-    // Update the glyph run.
-    glyphRun.glyphAdvances = glyphAdvances_.data();
+    // Use the font advances already computed for the measuring mode.
+    glyphRun.glyphAdvances = analysis_->glyphAdvances.data();
 
     return S_OK;
 }
@@ -2114,29 +3804,261 @@ const static DWRITE_FLOW_DIRECTION g_dwriteFlowDirectionValues[8] = {
 };
 
 
-HRESULT CachedDWriteTextFormat::EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas)
+// Attributes which require a new text format when changed.
+const static DrawableObjectAttribute g_dwriteTextFormatAttributes[] = {
+    DrawableObjectAttributeFontFamily,
+    DrawableObjectAttributeFontFilePath,
+    DrawableObjectAttributeLanguageList,
+    DrawableObjectAttributeFontSize,
+    DrawableObjectAttributeWeight,
+    DrawableObjectAttributeStretch,
+    DrawableObjectAttributeSlope,
+    DrawableObjectAttributeReadingDirection,
+    DrawableObjectAttributeTrimmingGranularity,
+    DrawableObjectAttributeTrimmingDelimiter,
+    DrawableObjectAttributeTrimmingSign,
+    DrawableObjectAttributeFontFallback,
+    DrawableObjectAttributeFontFallbackFamilies,
+    DrawableObjectAttributeDWriteVerticalGlyphOrientation,
+    DrawableObjectAttributeDWriteFontFamilyModel,
+};
+
+
+// Paragraph attributes which both IDWriteTextFormat and IDWriteTextLayout
+// can change in place.
+const static DrawableObjectAttribute g_dwriteParagraphAttributes[] = {
+    DrawableObjectAttributeColumnAlignment,
+    DrawableObjectAttributeRowAlignment,
+    DrawableObjectAttributeJustification,
+    DrawableObjectAttributeLineWrappingMode,
+    DrawableObjectAttributeTabWidth,
+};
+
+
+// Attributes which require a new text layout when changed, aside from the
+// text format itself.
+const static DrawableObjectAttribute g_dwriteTextLayoutAttributes[] = {
+    DrawableObjectAttributeFunction,
+    DrawableObjectAttributeText,
+    DrawableObjectAttributeDWriteMeasuringMode,
+};
+
+
+// Returns the sum of the attribute cookies, which changes whenever any of
+// them does since each modification increments the attribute's own cookie.
+uint32_t GetCombinedCookie(IAttributeSource& attributeSource, array_ref<DrawableObjectAttribute const> attributeIds)
+{
+    uint32_t combinedCookie = 0;
+    for (auto attributeId : attributeIds)
+    {
+        uint32_t cookie = 0;
+        attributeSource.GetCookie(attributeId, OUT cookie);
+        combinedCookie += cookie;
+    }
+    return combinedCookie;
+}
+
+
+void SetDWriteParagraphProperties(IAttributeSource& attributeSource, _In_ IDWriteTextFormat* textFormat)
+{
+    DWRITE_TEXT_ALIGNMENT columnAlignment = attributeSource.GetValue(DrawableObjectAttributeColumnAlignment, DWRITE_TEXT_ALIGNMENT_LEADING);
+    DWRITE_PARAGRAPH_ALIGNMENT rowAlignment = attributeSource.GetValue(DrawableObjectAttributeRowAlignment, DWRITE_PARAGRAPH_ALIGNMENT_NEAR);
+    DrawableObjectLineWrappingMode wrappingMode = attributeSource.GetValue(DrawableObjectAttributeLineWrappingMode, LineWrappingModeWordCharacter);
+    DWRITE_WORD_WRAPPING dwriteWrappingMode = static_cast<DWRITE_WORD_WRAPPING>(wrappingMode + 1);
+    DrawableObjectJustificationMode justification = attributeSource.GetValue(DrawableObjectAttributeJustification, DrawableObjectJustificationModeUnjustified);
+
+    textFormat->SetTextAlignment((justification == DrawableObjectJustificationModeUnjustified) ? columnAlignment : DWRITE_TEXT_ALIGNMENT_JUSTIFIED);
+    textFormat->SetParagraphAlignment(rowAlignment);
+    if (FAILED(textFormat->SetWordWrapping(dwriteWrappingMode)))
+    {
+        textFormat->SetWordWrapping(DWRITE_WORD_WRAPPING_WRAP); // If run on Windows 7, which does not support the newer enums.
+    };
+
+    // Without an explicit tab width, restore DWrite's default of 4 ems, since
+    // an existing format may have had one previously.
+    array_ref<float const> tabWidths = attributeSource.GetValues<float>(DrawableObjectAttributeTabWidth);
+    textFormat->SetIncrementalTabStop(tabWidths.empty() ? textFormat->GetFontSize() * 4 : tabWidths[0]);
+}
+
+
+// Return the font fallback for the given chain, built once per canvas and
+// shared by every text format using it, so neither the builder nor the system
+// fallback query runs per format, and the mappings each fallback caches
+// internally survive across formats. Null means the default system fallback.
+HRESULT GetSharedFontFallback(
+    DrawingCanvas& drawingCanvas,
+    bool useSystemFontFallback,
+    array_ref<char16_t const> fallbackFamilyNames, // Semicolon separated, tried in order.
+    _COM_Outptr_result_maybenull_ IDWriteFontFallback** fontFallback
+    )
+{
+    *fontFallback = nullptr;
+
+    if (useSystemFontFallback && fallbackFamilyNames.empty())
+        return S_OK;
+
+    std::u16string name(useSystemFontFallback ? u"+" : u"-");
+    name.append(fallbackFamilyNames.data(), fallbackFamilyNames.size());
+
+    ComPtr<IDWriteFontFallback> sharedFontFallback;
+    if (FAILED(drawingCanvas.GetSharedResource(name.c_str(), OUT &sharedFontFallback)))
+    {
+        ComPtr<IDWriteFactory2> factory2;
+        ComPtr<IDWriteFontFallbackBuilder> fontFallbackBuilder;
+        IFR(drawingCanvas.GetDWriteFactoryWeakRef()->QueryInterface(OUT &factory2));
+        IFR(factory2->CreateFontFallbackBuilder(OUT &fontFallbackBuilder));
+
+        // Map the whole Unicode range to the given families, in order.
+        std::vector<std::u16string> familyNames;
+        std::vector<wchar_t const*> familyNamePointers;
+        for (char16_t const* familyName = fallbackFamilyNames.data(), *familyNamesEnd = fallbackFamilyNames.data_end(); familyName < familyNamesEnd;)
+        {
+            char16_t const* familyNameEnd = std::find(familyName, familyNamesEnd, ';');
+            std::u16string trimmedName(familyName, familyNameEnd);
+            TrimSpaces(IN OUT trimmedName);
+            if (!trimmedName.empty())
+                familyNames.push_back(std::move(trimmedName));
+            familyName = familyNameEnd + (familyNameEnd < familyNamesEnd ? 1 : 0);
+        }
+        for (auto const& familyName : familyNames)
+        {
+            familyNamePointers.push_back(ToWChar(familyName.c_str()));
+        }
+        if (!familyNamePointers.empty())
+        {
+            DWRITE_UNICODE_RANGE const unicodeRange = { 0, UnicodeTotal - 1 };
+            IFR(fontFallbackBuilder->AddMapping(
+                &unicodeRange,
+                1,
+                familyNamePointers.data(),
+                static_cast<uint32_t>(familyNamePointers.size())
+                ));
+        }
+
+        // Then whatever those don't cover goes to the system fallback.
+        if (useSystemFontFallback)
+        {
+            ComPtr<IDWriteFontFallback> systemFontFallback;
+            IFR(factory2->GetSystemFontFallback(OUT &systemFontFallback));
+            IFR(fontFallbackBuilder->AddMappings(systemFontFallback));
+        }
+
+        IFR(fontFallbackBuilder->CreateFontFallback(OUT &sharedFontFallback));
+        drawingCanvas.SetSharedResource(name.c_str(), sharedFontFallback.Get());
+    }
+
+    *fontFallback = sharedFontFallback.Detach();
+    return S_OK;
+}
+
+
+// Return the custom collection for the given font files in the given family
+// model. The files are enumerated into one font set per canvas, keyed by the
+// sorted list so that reorderings share it, and each family model's
+// collection is derived from that set rather than from the files again.
+HRESULT GetSharedFontCollection(
+    DrawingCanvas& drawingCanvas,
+    array_ref<char16_t const> fontFilePaths, // Each nul terminated, possibly with wildcards.
+    DWRITE_FONT_FAMILY_MODEL fontFamilyModel,
+    _COM_Outptr_ IDWriteFontCollection** fontCollection
+    )
+{
+    *fontCollection = nullptr;
+
+    std::vector<std::u16string> sortedFilePaths;
+    for (char16_t const* filePath = fontFilePaths.data(), *filePathsEnd = fontFilePaths.data() + fontFilePaths.size();
+        filePath < filePathsEnd && *filePath != '\0';
+        filePath += wcslen(ToWChar(filePath)) + 1)
+    {
+        sortedFilePaths.push_back(filePath);
+    }
+    if (sortedFilePaths.empty())
+        return S_OK;
+
+    std::sort(sortedFilePaths.begin(), sortedFilePaths.end());
+
+    // Nul separated like the attribute, but as one key string, '|' being
+    // invalid in file names.
+    std::u16string fileNames;
+    std::u16string fontSetKey;
+    for (auto const& filePath : sortedFilePaths)
+    {
+        fileNames.append(filePath);
+        fileNames.push_back('\0');
+        if (!fontSetKey.empty())
+            fontSetKey.push_back('|');
+        fontSetKey.append(filePath);
+    }
+
+    std::u16string collectionKey(fontSetKey);
+    AppendFormattedString(IN OUT collectionKey, u"|%u", uint32_t(fontFamilyModel));
+
+    ComPtr<IDWriteFontCollection> sharedFontCollection;
+    if (SUCCEEDED(drawingCanvas.GetSharedResource(collectionKey.c_str(), OUT &sharedFontCollection)))
+    {
+        *fontCollection = sharedFontCollection.Detach();
+        return S_OK;
+    }
+
+    if (GetFileAttributes(ToWChar(fontFilePaths.data())) == -1)
+        return DWRITE_E_FILENOTFOUND;
+
+    auto* factory = drawingCanvas.GetDWriteFactoryWeakRef();
+    ComPtr<IDWriteFontSet> fontSet;
+    HRESULT hr = drawingCanvas.GetSharedResource(fontSetKey.c_str(), OUT &fontSet);
+    if (FAILED(hr))
+    {
+        hr = CreateFontSet(factory, ToWChar(fileNames.data()), static_cast<uint32_t>(fileNames.size()), OUT &fontSet);
+        if (SUCCEEDED(hr))
+        {
+            drawingCanvas.SetSharedResource(fontSetKey.c_str(), fontSet.Get());
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateFontCollectionFromFontSet(factory, fontSet, fontFamilyModel, OUT &sharedFontCollection);
+    }
+
+    // Before font sets, enumerate the files through the custom loader.
+    if (hr == E_NOINTERFACE)
+    {
+        hr = CreateFontCollection(factory, fontFamilyModel, ToWChar(fileNames.data()), static_cast<uint32_t>(fileNames.size()), OUT &sharedFontCollection);
+    }
+    IFR(hr);
+
+    drawingCanvas.SetSharedResource(collectionKey.c_str(), sharedFontCollection.Get());
+    *fontCollection = sharedFontCollection.Detach();
+    return S_OK;
+}
+
+
+HRESULT CachedDWriteTextFormat::Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas)
 {
-    if (!textFormat.IsNull())
+    uint32_t newCookieFormat = GetCombinedCookie(attributeSource, g_dwriteTextFormatAttributes);
+    uint32_t newCookieParagraph = GetCombinedCookie(attributeSource, g_dwriteParagraphAttributes);
+
+    if (!textFormat.IsNull() && newCookieFormat == cookieFormat)
     {
+        if (newCookieParagraph != cookieParagraph)
+        {
+            SetDWriteParagraphProperties(attributeSource, textFormat);
+            cookieParagraph = newCookieParagraph;
+        }
         return S_OK;
     }
 
+    ScopedCachedResourceTimer timer;
+
     auto* factory = drawingCanvas.GetDWriteFactoryWeakRef();
 
     array_ref<char16_t const> fontFamilyName = attributeSource.GetString(DrawableObjectAttributeFontFamily);
     array_ref<char16_t const> customFontFilePath = attributeSource.GetString(DrawableObjectAttributeFontFilePath);
     array_ref<char16_t const> languageTag = attributeSource.GetString(DrawableObjectAttributeLanguageList);
     float fontSize = attributeSource.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
-    float tabWidth = attributeSource.GetValue(DrawableObjectAttributeTabWidth, DrawableObject::defaultTabWidth);
 
     DWRITE_FONT_WEIGHT fontWeight = attributeSource.GetValue(DrawableObjectAttributeWeight, OUT DWRITE_FONT_WEIGHT_NORMAL);
     DWRITE_FONT_STRETCH fontStretch = attributeSource.GetValue(DrawableObjectAttributeStretch, OUT DWRITE_FONT_STRETCH_NORMAL);
     DWRITE_FONT_STYLE fontStyle = attributeSource.GetValue(DrawableObjectAttributeSlope, OUT DWRITE_FONT_STYLE_NORMAL);
-    DWRITE_TEXT_ALIGNMENT columnAlignment = attributeSource.GetValue(DrawableObjectAttributeColumnAlignment, DWRITE_TEXT_ALIGNMENT_LEADING);
-    DWRITE_PARAGRAPH_ALIGNMENT rowAlignment = attributeSource.GetValue(DrawableObjectAttributeRowAlignment, DWRITE_PARAGRAPH_ALIGNMENT_NEAR);
-    DrawableObjectLineWrappingMode wrappingMode = attributeSource.GetValue(DrawableObjectAttributeLineWrappingMode, LineWrappingModeWordCharacter);
-    DWRITE_WORD_WRAPPING dwriteWrappingMode = static_cast<DWRITE_WORD_WRAPPING>(wrappingMode + 1);
-    DrawableObjectJustificationMode justification = attributeSource.GetValue(DrawableObjectAttributeJustification, DrawableObjectJustificationModeUnjustified);
     DrawableObjectTrimmingGranularity trimmingGranularity = attributeSource.GetValue(DrawableObjectAttributeTrimmingGranularity, DrawableObjectTrimmingGranularityNone);
     DWRITE_FONT_FAMILY_MODEL fontFamilyModel = attributeSource.GetValue(DrawableObjectAttributeDWriteFontFamilyModel, DWRITE_FONT_FAMILY_MODEL_WEIGHT_STRETCH_STYLE);
     char32_t trimmingDelimiter = attributeSource.GetValue(DrawableObjectAttributeTrimmingDelimiter, '\0');
@@ -2144,20 +4066,12 @@ HRESULT CachedDWriteTextFormat::EnsureCached(IAttributeSource& attributeSource,
 
     // Support custom font collection from file path.
     ComPtr<IDWriteFontCollection> fontCollection;
-    if (!customFontFilePath.empty() && drawingCanvas.GetSharedResource(customFontFilePath.data(), OUT &fontCollection) == E_NOT_SET)
+    if (!customFontFilePath.empty())
     {
-        if (GetFileAttributes(ToWChar(customFontFilePath.data())) == -1)
-            return DWRITE_E_FILENOTFOUND;
-
-        CreateFontCollection(
-            factory,
-            fontFamilyModel,
-            ToWChar(customFontFilePath.data()),
-            static_cast<uint32_t>(customFontFilePath.size()),
-            OUT &fontCollection
-            );
-
-        drawingCanvas.SetSharedResource(customFontFilePath.data(), fontCollection.Get());
+        // Other failures just leave the system collection, as before.
+        HRESULT hr = GetSharedFontCollection(drawingCanvas, customFontFilePath, fontFamilyModel, OUT &fontCollection);
+        if (hr == DWRITE_E_FILENOTFOUND)
+            return hr;
     }
 
     if (fontCollection == nullptr && fontFamilyModel != DWRITE_FONT_FAMILY_MODEL_WEIGHT_STRETCH_STYLE)
@@ -2189,12 +4103,7 @@ HRESULT CachedDWriteTextFormat::EnsureCached(IAttributeSource& attributeSource,
     uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, OUT 0ui32);
     textFormat->SetReadingDirection(g_dwriteReadingDirectionValues[readingDirection & 7]);
     textFormat->SetFlowDirection(g_dwriteFlowDirectionValues[readingDirection & 7]);
-    textFormat->SetTextAlignment((justification == DrawableObjectJustificationModeUnjustified) ? columnAlignment : DWRITE_TEXT_ALIGNMENT_JUSTIFIED);
-    textFormat->SetParagraphAlignment(rowAlignment);
-    if (FAILED(textFormat->SetWordWrapping(dwriteWrappingMode)))
-    {
-        textFormat->SetWordWrapping(DWRITE_WORD_WRAPPING_WRAP); // If run on Windows 7, which does not support the newer enums.
-    };
+    SetDWriteParagraphProperties(attributeSource, textFormat);
 
     DWRITE_TRIMMING trimming;
     trimming.delimiter = trimmingDelimiter;
@@ -2211,30 +4120,19 @@ HRESULT CachedDWriteTextFormat::EnsureCached(IAttributeSource& attributeSource,
     }
     textFormat->SetTrimming(&trimming, trimmingSign);
 
-    array_ref<float const> tabWidths = attributeSource.GetValues<float>(DrawableObjectAttributeTabWidth);
-    if (!tabWidths.empty())
-    {
-        textFormat->SetIncrementalTabStop(tabWidths[0]);
-    }
-
     ComPtr<IDWriteTextFormat1> textFormat1;
     textFormat->QueryInterface(OUT &textFormat1);
 
     // There isn't a simple switch to turn off fallback in IDWriteTextFormat,
-    // but you can just create an empty font fallback definition.
+    // but you can just set an empty font fallback definition.
     bool useFontFallback = attributeSource.GetValue(DrawableObjectAttributeFontFallback, true);
-    if (!useFontFallback)
+    array_ref<char16_t const> fallbackFamilyNames = attributeSource.GetString(DrawableObjectAttributeFontFallbackFamilies);
+    ComPtr<IDWriteFontFallback> fontFallback;
+    if (textFormat1 != nullptr
+    &&  SUCCEEDED(GetSharedFontFallback(drawingCanvas, useFontFallback, fallbackFamilyNames, OUT &fontFallback))
+    &&  fontFallback != nullptr)
     {
-        ComPtr<IDWriteFactory2> factory2;
-        ComPtr<IDWriteFontFallbackBuilder> fontFallbackBuilder;
-        ComPtr<IDWriteFontFallback> fontFallback;
-        if (textFormat1 != nullptr
-        &&  SUCCEEDED(factory->QueryInterface(OUT &factory2))
-        &&  SUCCEEDED(factory2->CreateFontFallbackBuilder(OUT &fontFallbackBuilder))
-        &&  SUCCEEDED(fontFallbackBuilder->CreateFontFallback(OUT &fontFallback)))
-        {
-            textFormat1->SetFontFallback(fontFallback);
-        }
+        textFormat1->SetFontFallback(fontFallback);
     }
 
     DWRITE_VERTICAL_GLYPH_ORIENTATION verticalGlyphOrientation = attributeSource.GetValue(DrawableObjectAttributeDWriteVerticalGlyphOrientation, DWRITE_VERTICAL_GLYPH_ORIENTATION_DEFAULT);
@@ -2243,54 +4141,83 @@ HRESULT CachedDWriteTextFormat::EnsureCached(IAttributeSource& attributeSource,
         textFormat1->SetVerticalGlyphOrientation(verticalGlyphOrientation);
     }
 
+    cookieFormat = newCookieFormat;
+    cookieParagraph = newCookieParagraph;
+
     return S_OK;
 };
 
 
-HRESULT CachedDWriteTextLayout::EnsureCached(
+size_t CachedDWriteTextFormat::GetByteSize() const noexcept
+{
+    return (textFormat != nullptr) ? g_estimatedTextFormatByteSize : 0;
+}
+
+
+HRESULT CachedDWriteTextLayout::Update(
     IAttributeSource& attributeSource,
     DrawingCanvas& drawingCanvas,
-    _In_ IDWriteTextFormat* textFormat
+    _In_ IDWriteTextFormat* newTextFormat
     )
 {
-    if (textFormat == nullptr)
+    if (newTextFormat == nullptr)
         return E_INVALIDARG;
 
-    if (!textLayout.IsNull())
-        return S_OK;
+    // Only time the update once something turns out to have changed, so that
+    // cache hits add nothing.
+    ScopedCachedResourceTimer timer(/*isStarted*/false);
+    bool hasChanged = false;
+    auto markChanged = [&]()
+    {
+        timer.Start();
+        hasChanged = true;
+    };
 
     auto* factory = drawingCanvas.GetDWriteFactoryWeakRef();
 
-    DrawableObjectFunction function = attributeSource.GetValue(DrawableObjectAttributeFunction, DrawableObjectFunctionNop);
-    array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
-    float layoutWidth = attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth);
-    float layoutHeight = attributeSource.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight);
-    DWRITE_MEASURING_MODE measuringMode = attributeSource.GetValue(DrawableObjectAttributeDWriteMeasuringMode, DWRITE_MEASURING_MODE_NATURAL);
-    if (function == DrawableObjectFunctionDirect2DDrawText)
+    // Reuse the existing layout unless the text itself or how it is shaped
+    // changed. Holding a reference to the format it was created from also
+    // ensures a recreated format can never be mistaken for the old one.
+    uint32_t newCookieLayout = GetCombinedCookie(attributeSource, g_dwriteTextLayoutAttributes);
+    uint32_t newCookieParagraph = GetCombinedCookie(attributeSource, g_dwriteParagraphAttributes);
+    bool const isNewLayout = textLayout.IsNull() || newTextFormat != textFormat || newCookieLayout != cookieLayout;
+
+    if (isNewLayout)
     {
-        // Special case for D2D DrawText which ignores the measuring mode,
-        // since there is no way for the API to pass it forward.
-        measuringMode = DWRITE_MEASURING_MODE_NATURAL;
+        markChanged();
+        IFR(CreateLayout(attributeSource, factory, newTextFormat));
+        cookieParagraph = newCookieParagraph; // The layout inherits the current paragraph properties from the format.
+    }
+    else
+    {
+        if (!attributeSource.IsCookieSame(DrawableObjectAttributeWidth, IN OUT cookieWidth))
+        {
+            textLayout->SetMaxWidth(attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth));
+            markChanged();
+        }
+        if (!attributeSource.IsCookieSame(DrawableObjectAttributeHeight, IN OUT cookieHeight))
+        {
+            textLayout->SetMaxHeight(attributeSource.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight));
+            markChanged();
+        }
+        if (newCookieParagraph != cookieParagraph)
+        {
+            SetDWriteParagraphProperties(attributeSource, textLayout);
+            cookieParagraph = newCookieParagraph;
+            markChanged();
+        }
     }
 
-    textLayout.clear();
-    IFR(CreateTextLayout(
-        factory,
-        ToWChar(text.data()),
-        static_cast<uint32_t>(text.size()),
-        textFormat,
-        layoutWidth,
-        layoutHeight,
-        measuringMode,
-        OUT &textLayout
-        ));
-
-    array_ref<uint32_t const> features;
-    attributeSource.GetValues(DrawableObjectAttributeTypographicFeatures, OUT features);
-    if (!features.empty())
+    // Apply the properties lacking a setter on IDWriteTextFormat, either to
+    // the new layout or to the existing one when they changed.
+    if (!attributeSource.IsCookieSame(DrawableObjectAttributeTypographicFeatures, IN OUT cookieTypographicFeatures) || isNewLayout)
     {
+        array_ref<uint32_t const> features;
+        attributeSource.GetValues(DrawableObjectAttributeTypographicFeatures, OUT features);
+
+        // An existing layout needs an empty typography to clear old features.
         ComPtr<IDWriteTypography> typography;
-        if (SUCCEEDED(factory->CreateTypography(OUT &typography)))
+        if ((!features.empty() || !isNewLayout) && SUCCEEDED(factory->CreateTypography(OUT &typography)))
         {
             for (auto const& featureTag : features)
             {
@@ -2299,38 +4226,99 @@ HRESULT CachedDWriteTextLayout::EnsureCached(
             }
 
             textLayout->SetTypography(typography, { 0, UINT32_MAX });
+            markChanged();
         }
     }
 
-    // The IDWriteTextFormat is missing a few setters. So set the other
-    // properties after the IDWriteTextLayout is created.
-    if (attributeSource.GetValue(DrawableObjectAttributeUnderline, false))
+    if (!attributeSource.IsCookieSame(DrawableObjectAttributeUnderline, IN OUT cookieUnderline) || isNewLayout)
     {
-        textLayout->SetUnderline(true, { 0, UINT32_MAX });
+        textLayout->SetUnderline(attributeSource.GetValue(DrawableObjectAttributeUnderline, false), { 0, UINT32_MAX });
+        markChanged();
     }
-    if (attributeSource.GetValue(DrawableObjectAttributeStrikethrough, false))
+    if (!attributeSource.IsCookieSame(DrawableObjectAttributeStrikethrough, IN OUT cookieStrikethrough) || isNewLayout)
     {
-        textLayout->SetStrikethrough(true, { 0, UINT32_MAX });
+        textLayout->SetStrikethrough(attributeSource.GetValue(DrawableObjectAttributeStrikethrough, false), { 0, UINT32_MAX });
+        markChanged();
     }
 
-    std::vector<DWRITE_FONT_AXIS_VALUE> fontAxisValues;
-    GetFontAxisValues(attributeSource, OUT fontAxisValues);
+    // Evaluate both cookies so neither is left stale.
+    if (!(attributeSource.IsCookieSame(DrawableObjectAttributeAxisTags, IN OUT cookieAxisTags)
+        & attributeSource.IsCookieSame(DrawableObjectAttributeAxisValues, IN OUT cookieAxisValues))
+    ||  isNewLayout)
+    {
+        std::vector<DWRITE_FONT_AXIS_VALUE> fontAxisValues;
+        GetFontAxisValues(attributeSource, OUT fontAxisValues);
+
+        ComPtr<IDWriteTextLayout4> textLayout4;
+        textLayout->QueryInterface(OUT &textLayout4);
+        if (textLayout4 != nullptr)
+        {
+            textLayout4->SetFontAxisValues(fontAxisValues.data(), uint32_t(fontAxisValues.size()), DWRITE_TEXT_RANGE{ 0, UINT32_MAX });
+            markChanged();
+        }
+    }
+
+    // Ensure lazy evaluation is defeated, so the cost is attributed here
+    // rather than to the first measure or draw.
+    if (hasChanged)
+    {
+        DWRITE_TEXT_METRICS textMetrics;
+        textLayout->GetMetrics(OUT &textMetrics);
+    }
+
+    return S_OK;
+};
 
-    ComPtr<IDWriteTextLayout4> textLayout4;
-    textLayout->QueryInterface(OUT &textLayout4);
-    if (textLayout4 != nullptr)
+
+HRESULT CachedDWriteTextLayout::CreateLayout(
+    IAttributeSource& attributeSource,
+    _In_ IDWriteFactory* factory,
+    _In_ IDWriteTextFormat* newTextFormat
+    )
+{
+    DrawableObjectFunction function = attributeSource.GetValue(DrawableObjectAttributeFunction, DrawableObjectFunctionNop);
+    array_ref<char16_t const> text = attributeSource.GetString(DrawableObjectAttributeText);
+    float layoutWidth = attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth);
+    float layoutHeight = attributeSource.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight);
+    DWRITE_MEASURING_MODE measuringMode = attributeSource.GetValue(DrawableObjectAttributeDWriteMeasuringMode, DWRITE_MEASURING_MODE_NATURAL);
+    if (function == DrawableObjectFunctionDirect2DDrawText)
     {
-        textLayout4->SetFontAxisValues(fontAxisValues.data(), uint32_t(fontAxisValues.size()), DWRITE_TEXT_RANGE{ 0, UINT32_MAX });
+        // Special case for D2D DrawText which ignores the measuring mode,
+        // since there is no way for the API to pass it forward.
+        measuringMode = DWRITE_MEASURING_MODE_NATURAL;
     }
 
-    // Ensure lazy evaluation is defeated.
-    DWRITE_TEXT_METRICS textMetrics;
-    textLayout->GetMetrics(OUT &textMetrics);
+    Invalidate();
+    IFR(CreateTextLayout(
+        factory,
+        ToWChar(text.data()),
+        static_cast<uint32_t>(text.size()),
+        newTextFormat,
+        layoutWidth,
+        layoutHeight,
+        measuringMode,
+        OUT &textLayout
+        ));
+
+    textFormat = newTextFormat;
+    textLength = static_cast<uint32_t>(text.size());
+    cookieLayout = GetCombinedCookie(attributeSource, g_dwriteTextLayoutAttributes);
+    attributeSource.GetCookie(DrawableObjectAttributeWidth, OUT cookieWidth);
+    attributeSource.GetCookie(DrawableObjectAttributeHeight, OUT cookieHeight);
 
     return S_OK;
 };
 
 
+size_t CachedDWriteTextLayout::GetByteSize() const noexcept
+{
+    if (textLayout == nullptr)
+        return 0;
+
+    return g_estimatedTextLayoutByteSize + size_t(textLength) * g_estimatedTextLayoutBytesPerCharacter;
+}
+
+
 HRESULT DrawableObjectDWriteGlyphRun::GetBounds(
     IAttributeSource& attributeSource,
     DrawingCanvas& drawingCanvas,
@@ -2346,36 +4334,14 @@ HRESULT DrawableObjectDWriteGlyphRun::GetBounds(
     IFR(cachedGlyphRun.Update(attributeSource, drawingCanvas, fontFace_.fontFace));
 
     uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, OUT 0ui32);
-    DWRITE_MEASURING_MODE measuringMode = attributeSource.GetValue(DrawableObjectAttributeDWriteMeasuringMode, DWRITE_MEASURING_MODE_NATURAL);
 
     // Get the font metrics to determine glyph run width & height.
-    DWRITE_FONT_METRICS fontMetrics = {};
-    GetFontFaceMetrics(
-        cachedGlyphRun.fontFace,
-        cachedGlyphRun.fontEmSize,
-        measuringMode,
-        OUT &fontMetrics
-        );
+    DWRITE_FONT_METRICS const& fontMetrics = cachedGlyphRun.GetFontMetrics();
 
-    // Calculate content width.
-    float width = 0;
+    // Calculate content width, using advance widths from font face if none were given.
+    IFR(cachedGlyphRun.GetGlyphAdvancesIfNull());
     float const* glyphAdvances = cachedGlyphRun.glyphAdvances;
-    fast_vector<float, 120, false> glyphAdvancesBuffer(cachedGlyphRun.glyphCount);
-
-    // Get advance widths from font face if none were given.
-    if (cachedGlyphRun.glyphAdvances == nullptr)
-    {
-        IFR(GetFontFaceAdvances(
-            cachedGlyphRun.fontFace,
-            cachedGlyphRun.fontEmSize,
-            { cachedGlyphRun.glyphIndices, cachedGlyphRun.glyphCount },
-            measuringMode,
-            !!cachedGlyphRun.isSideways,
-            OUT glyphAdvancesBuffer
-            ));
-        glyphAdvances = glyphAdvancesBuffer.data();
-    }
-    width = std::accumulate(glyphAdvances, glyphAdvances + cachedGlyphRun.glyphCount, 0.0f);
+    float width = std::accumulate(glyphAdvances, glyphAdvances + cachedGlyphRun.glyphCount, 0.0f);
 
     // Calculate content height.
     int32_t ascent = fontMetrics.ascent;
@@ -2428,9 +4394,13 @@ HRESULT DrawableObjectDWriteBitmapRenderTargetDrawGlyphRun::Draw(
     if (!enableColorFonts)
         colorPaletteIndex = 0xFFFFFFFF;
 
-    HRESULT hr = S_OK;
+    auto glyphRunDrawer = drawingCanvas.GetGlyphRunDrawer();
+
+    HRESULT hr = S_FALSE;
     if (enableColorFonts)
     {
+        ComPtr<SharedColorGlyphCache> colorGlyphCache;
+        IFR(SharedColorGlyphCache::Get(drawingCanvas, OUT colorGlyphCache));
         hr = DrawColorGlyphRun(
             drawingCanvas.GetDWriteFactoryWeakRef(),
             renderTarget,
@@ -2441,25 +4411,62 @@ HRESULT DrawableObjectDWriteBitmapRenderTargetDrawGlyphRun::Draw(
             y,
             renderingParams_.renderingParams,
             ToColorRef(bgraTextColor),
-            colorPaletteIndex
+            colorPaletteIndex,
+            glyphRunDrawer,
+            &colorGlyphCache->layerCache
             );
+        colorGlyphCache->UpdateByteSize(drawingCanvas);
     }
     else
     {
-        hr = renderTarget->DrawGlyphRun(
-            x,
-            y,
-            measuringMode,
-            &cachedGlyphRun,
-            renderingParams_.renderingParams,
-            ToColorRef(bgraTextColor),
-            nullptr
-            );
+        if (glyphRunDrawer != nullptr)
+        {
+            hr = glyphRunDrawer(x, y, measuringMode, cachedGlyphRun, renderingParams_.renderingParams, ToColorRef(bgraTextColor));
+        }
+        if (hr == S_FALSE) // No atlas, or the atlas declined the run.
+        {
+            hr = renderTarget->DrawGlyphRun(
+                x,
+                y,
+                measuringMode,
+                &cachedGlyphRun,
+                renderingParams_.renderingParams,
+                ToColorRef(bgraTextColor),
+                nullptr
+                );
+        }
     }
 
-    renderTarget->SetCurrentTransform(&DrawableObject::identityTransform.dwrite);
+    renderTarget->SetCurrentTransform(&DrawableObject::identityTransform.dwrite);
+
+    return hr;
+}
+
+
+HRESULT DrawableObjectReferenceRasterizerDrawGlyphRun::Draw(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    float x,
+    float y,
+    DX_MATRIX_3X2F const& transform
+    )
+{
+    IFR(fontFace_.Update(attributeSource, drawingCanvas));
+    CachedDWriteGlyphRun cachedGlyphRun;
+    IFR(cachedGlyphRun.Update(attributeSource, drawingCanvas, fontFace_.fontFace));
+
+    uint32_t bgraTextColor = attributeSource.GetValue(DrawableObjectAttributeTextColor, defaultFontColor);
 
-    return hr;
+    DrawingCanvas::RawPixels rawPixels = drawingCanvas.GetRawPixels();
+    RECT const clipRect = { 0, 0, LONG(rawPixels.width), LONG(rawPixels.height) };
+
+    rasterizer_.Reset(clipRect);
+    rasterizer_.SetTransform(transform);
+    IFR(rasterizer_.AddGlyphRun(x, y, cachedGlyphRun));
+
+    RECT bounds;
+    rasterizer_.Rasterize(OUT bounds, OUT coverage_);
+    return drawingCanvas.BlendCoverage(bounds, coverage_, ToColorRef(bgraTextColor));
 }
 
 
@@ -2487,10 +4494,22 @@ HRESULT DrawableObjectDirect2DDrawGlyphRun::Draw(
     if (!enableColorFonts)
         colorPaletteIndex = 0xFFFFFFFF;
 
+    // When asked, rotated and skewed runs fill cached glyph geometries, since
+    // D2D would otherwise outline and tessellate every glyph again on each
+    // draw. That is a different rendering path, so it is opt in, and color
+    // glyphs, vertical, and RTL runs still go through D2D.
+    bool useGlyphGeometries = false;
+    if (attributeSource.GetValue(DrawableObjectAttributeGlyphGeometries, false)
+        && (transform.xy != 0 || transform.yx != 0) && cachedGlyphRun.fontFace != nullptr && !cachedGlyphRun.isSideways && !(cachedGlyphRun.bidiLevel & 1))
+    {
+        ComPtr<IDWriteFontFace2> fontFace2;
+        useGlyphGeometries = !enableColorFonts || FAILED(cachedGlyphRun.fontFace->QueryInterface(OUT &fontFace2)) || !fontFace2->IsColorFont();
+    }
+
     auto* d2dRenderTarget = drawingCanvas.GetD2DRenderTargetWeakRef();
     d2dRenderTarget->SetTextRenderingParams(renderingParams_.renderingParams);
     d2dRenderTarget->SetTransform(&transform.d2d);
-    d2dRenderTarget->BeginDraw();
+    drawingCanvas.BeginDrawD2D();
 
     // debugging hack to draw rects behind glyphs.
     #if 0
@@ -2540,8 +4559,10 @@ HRESULT DrawableObjectDirect2DDrawGlyphRun::Draw(
     }
     #endif
 
-    if (enableColorFonts)
+    if (enableColorFonts && !useGlyphGeometries)
     {
+        ComPtr<SharedColorGlyphCache> colorGlyphCache;
+        IFR(SharedColorGlyphCache::Get(drawingCanvas, OUT colorGlyphCache));
         DrawColorGlyphRun(
             drawingCanvas.GetDWriteFactoryWeakRef(),
             d2dRenderTarget,
@@ -2551,8 +4572,26 @@ HRESULT DrawableObjectDirect2DDrawGlyphRun::Draw(
             x,
             y,
             brush,
-            colorPaletteIndex
+            colorPaletteIndex,
+            &colorGlyphCache->layerCache
             );
+        colorGlyphCache->UpdateByteSize(drawingCanvas);
+    }
+    else if (useGlyphGeometries)
+    {
+        ComPtr<SharedGlyphGeometryCache> glyphGeometryCache;
+        IFR(SharedGlyphGeometryCache::Get(drawingCanvas, OUT glyphGeometryCache));
+        IFR(cachedGlyphRun.GetGlyphAdvancesIfNull());
+        IFR(glyphGeometryCache->DrawGlyphRun(
+            d2dRenderTarget,
+            drawingCanvas.GetD2DFactoryWeakRef(),
+            cachedGlyphRun,
+            x,
+            y,
+            transform,
+            brush
+            ));
+        glyphGeometryCache->UpdateByteSize(drawingCanvas);
     }
     else
     {
@@ -2564,7 +4603,7 @@ HRESULT DrawableObjectDirect2DDrawGlyphRun::Draw(
             );
     }
 
-    d2dRenderTarget->EndDraw();
+    drawingCanvas.EndDrawD2D();
     d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
 
     return S_OK;
@@ -2618,20 +4657,77 @@ HRESULT DrawableObjectDirect2DDrawColorBitmapGlyphRun::Draw(
     ComPtr<ID2D1DeviceContext4> d2dRenderTarget4;
     IFR(d2dRenderTarget->QueryInterface(OUT &d2dRenderTarget4));
 
+    // Draw horizontal runs from decoded glyph images held by the canvas, so
+    // each image is decoded once rather than on every draw.
+    ComPtr<SharedColorGlyphCache> colorGlyphCache;
+    if (actualGlyphDataFormat != DWRITE_GLYPH_IMAGE_FORMATS_NONE && !cachedGlyphRun.isSideways && !(cachedGlyphRun.bidiLevel & 1))
+    {
+        IFR(SharedColorGlyphCache::Get(drawingCanvas, OUT colorGlyphCache));
+    }
+
     d2dRenderTarget->SetTransform(&transform.d2d);
-    d2dRenderTarget->BeginDraw();
+    drawingCanvas.BeginDrawD2D();
 
-    //d2dRenderTarget4->SetDpi(96*2, 96*2);
-    d2dRenderTarget4->DrawColorBitmapGlyphRun(
-        actualGlyphDataFormat,
-        { x, y },
-        &cachedGlyphRun,
-        measuringMode,
-        enablePixelSnapping ? D2D1_COLOR_BITMAP_GLYPH_SNAP_OPTION_DEFAULT : D2D1_COLOR_BITMAP_GLYPH_SNAP_OPTION_DISABLE
-        );
-    //d2dRenderTarget4->SetDpi(96, 96);
+    if (colorGlyphCache != nullptr)
+    {
+        // Pick the strike for the device size.
+        float dpiX, dpiY;
+        d2dRenderTarget->GetDpi(OUT &dpiX, OUT &dpiY);
+        D2D_MATRIX_3X2_F const& m = transform.d2d;
+        float const deviceScale = sqrtf(fabsf(m._11 * m._22 - m._12 * m._21)) * dpiX / 96.0f;
+        uint32_t const pixelsPerEm = std::max(uint32_t(ceilf(cachedGlyphRun.fontEmSize * deviceScale)), 1u);
+        bool const shouldSnap = enablePixelSnapping && m._11 == 1 && m._12 == 0 && m._21 == 0 && m._22 == 1 && dpiX == 96 && dpiY == 96;
+
+        float penX = x;
+        for (uint32_t i = 0; i < cachedGlyphRun.glyphCount; ++i)
+        {
+            float glyphX = penX;
+            float glyphY = y;
+            if (cachedGlyphRun.glyphOffsets != nullptr)
+            {
+                glyphX += cachedGlyphRun.glyphOffsets[i].advanceOffset;
+                glyphY -= cachedGlyphRun.glyphOffsets[i].ascenderOffset;
+            }
+            penX += cachedGlyphRun.glyphAdvances[i];
+
+            SharedColorGlyphCache::BitmapGlyph const* bitmapGlyph;
+            if (FAILED(colorGlyphCache->GetBitmapGlyph(d2dRenderTarget, wicFactory, fontFace4, actualGlyphDataFormat, pixelsPerEm, cachedGlyphRun.glyphIndices[i], OUT &bitmapGlyph))
+            ||  bitmapGlyph->bitmap == nullptr)
+            {
+                continue; // Missing or undecodable images draw nothing, like DrawColorBitmapGlyphRun.
+            }
+
+            if (shouldSnap)
+            {
+                glyphX = floorf(glyphX + m._31 + 0.5f) - m._31;
+                glyphY = floorf(glyphY + m._32 + 0.5f) - m._32;
+            }
+
+            float const imageScale = cachedGlyphRun.fontEmSize / std::max(bitmapGlyph->pixelsPerEm, 1u);
+            D2D1_SIZE_U const pixelSize = bitmapGlyph->bitmap->GetPixelSize();
+            D2D_RECT_F destRect;
+            destRect.left   = glyphX - bitmapGlyph->horizontalLeftOrigin.x * imageScale;
+            destRect.top    = glyphY - bitmapGlyph->horizontalLeftOrigin.y * imageScale;
+            destRect.right  = destRect.left + pixelSize.width * imageScale;
+            destRect.bottom = destRect.top + pixelSize.height * imageScale;
+            d2dRenderTarget->DrawBitmap(bitmapGlyph->bitmap, &destRect, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, nullptr);
+        }
+        colorGlyphCache->UpdateByteSize(drawingCanvas);
+    }
+    else
+    {
+        //d2dRenderTarget4->SetDpi(96*2, 96*2);
+        d2dRenderTarget4->DrawColorBitmapGlyphRun(
+            actualGlyphDataFormat,
+            { x, y },
+            &cachedGlyphRun,
+            measuringMode,
+            enablePixelSnapping ? D2D1_COLOR_BITMAP_GLYPH_SNAP_OPTION_DEFAULT : D2D1_COLOR_BITMAP_GLYPH_SNAP_OPTION_DISABLE
+            );
+        //d2dRenderTarget4->SetDpi(96, 96);
+    }
 
-    d2dRenderTarget->EndDraw();
+    drawingCanvas.EndDrawD2D();
     d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
 
     return S_OK;
@@ -2673,7 +4769,7 @@ HRESULT DrawableObjectDirect2DDrawSvgGlyphRun::Draw(
     auto* d2dRenderTarget = drawingCanvas.GetD2DRenderTargetWeakRef();
     IFR(d2dRenderTarget->QueryInterface(OUT &d2dRenderTarget4));
     d2dRenderTarget->SetTransform(&transform.d2d);
-    d2dRenderTarget->BeginDraw();
+    drawingCanvas.BeginDrawD2D();
 
     //d2dRenderTarget4->SetDpi(96*2, 96*2);
     d2dRenderTarget4->DrawSvgGlyphRun(
@@ -2686,7 +4782,307 @@ HRESULT DrawableObjectDirect2DDrawSvgGlyphRun::Draw(
         );
     //d2dRenderTarget4->SetDpi(96, 96);
 
-    d2dRenderTarget->EndDraw();
+    drawingCanvas.EndDrawD2D();
+    d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
+
+    return S_OK;
+}
+
+
+// Attributes affecting the instances of an axis sweep, rather than just where
+// or in what color they are drawn.
+const static DrawableObjectAttribute g_axisSweepAttributes[] = {
+    DrawableObjectAttributeText,
+    DrawableObjectAttributeGlyphs,
+    DrawableObjectAttributeFontSize,
+    DrawableObjectAttributeFontFamily,
+    DrawableObjectAttributeWeight,
+    DrawableObjectAttributeStretch,
+    DrawableObjectAttributeSlope,
+    DrawableObjectAttributeFontFilePath,
+    DrawableObjectAttributeFontFaceIndex,
+    DrawableObjectAttributeFontSimulations,
+    DrawableObjectAttributeDWriteFontFaceType,
+    DrawableObjectAttributeReadingDirection,
+    DrawableObjectAttributeDWriteMeasuringMode,
+    DrawableObjectAttributeAxisTags,
+    DrawableObjectAttributeAxisValues,
+};
+
+
+HRESULT DrawableObjectDirect2DDrawAxisSweep::EnsureInstances(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas
+    )
+{
+    uint32_t newCookieSweep = GetCombinedCookie(attributeSource, g_axisSweepAttributes);
+    if (newCookieSweep == cookieSweep_)
+        return S_OK;
+
+    ScopedCachedResourceTimer timer;
+
+    instances_.clear();
+    cookieSweep_ = ~0u; // Stays stale if anything fails, to try again next time.
+
+    ////////////////////
+    // Read the sweep, a first, last, and count triple per axis tag.
+
+    struct SweepAxis
+    {
+        DWRITE_FONT_AXIS_TAG axisTag;
+        float first;
+        float last;
+        uint32_t count;
+    };
+
+    array_ref<uint32_t const> axisTags;
+    array_ref<float const> axisRanges;
+    attributeSource.GetValues(DrawableObjectAttributeAxisTags, OUT axisTags);
+    attributeSource.GetValues(DrawableObjectAttributeAxisValues, OUT axisRanges);
+
+    std::vector<SweepAxis> sweepAxes;
+    uint32_t instanceCount = 1;
+    for (size_t i = 0, ci = std::min(axisTags.size(), (axisRanges.size() + 2) / 3); i < ci; ++i)
+    {
+        SweepAxis sweepAxis = { DWRITE_FONT_AXIS_TAG(axisTags[i]), axisRanges[i * 3], axisRanges[i * 3], 1 };
+        if (i * 3 + 1 < axisRanges.size())
+        {
+            sweepAxis.last = axisRanges[i * 3 + 1];
+            sweepAxis.count = (sweepAxis.last != sweepAxis.first) ? 2 : 1;
+        }
+        if (i * 3 + 2 < axisRanges.size())
+        {
+            float count = axisRanges[i * 3 + 2];
+            if (!(count <= maximumInstanceCount)) // Also rejects NaN.
+                return E_INVALIDARG;
+            sweepAxis.count = std::max(uint32_t(count), 1u);
+        }
+        if (sweepAxis.count > maximumInstanceCount / instanceCount)
+            return E_INVALIDARG;
+
+        instanceCount *= sweepAxis.count;
+        sweepAxes.push_back(sweepAxis);
+    }
+
+    ////////////////////
+    // Get the base face and its glyphs, which every instance shares.
+
+    float fontSize = attributeSource.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
+    uint32_t readingDirection = attributeSource.GetValue(DrawableObjectAttributeReadingDirection, 0ui32);
+    DWRITE_MEASURING_MODE measuringMode = attributeSource.GetValue(DrawableObjectAttributeDWriteMeasuringMode, DWRITE_MEASURING_MODE_NATURAL);
+    bool const isRightToLeft = !!(readingDirection & 1);
+
+    ComPtr<IDWriteFontFace> baseFontFace;
+    IFR(CreateFontFaceFromAttributes(attributeSource, drawingCanvas, {}, OUT &baseFontFace));
+
+    array_ref<uint16_t const> sourceUnits = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
+    bool const isFromText = sourceUnits.empty() && attributeSource.GetString(DrawableObjectAttributeGlyphs).empty();
+    if (isFromText)
+    {
+        sourceUnits = attributeSource.GetString(DrawableObjectAttributeText).reinterpret_as<uint16_t const>();
+    }
+
+    ComPtr<SharedGlyphRunAnalysis> analysis;
+    analysis.Set(new SharedGlyphRunAnalysis());
+    IFR(analysis->Initialize(baseFontFace, fontSize, measuringMode, /*isSideways*/false, isFromText, sourceUnits));
+    array_ref<uint16_t const> glyphIndices = analysis->glyphIndices;
+
+    DWRITE_FONT_METRICS const& fontMetrics = analysis->fontMetrics;
+    float const designScale = fontSize / std::max(fontMetrics.designUnitsPerEm, uint16_t(1));
+    cellAscent_ = ceil(fontMetrics.ascent * designScale);
+    cellHeight_ = std::max(cellAscent_ + ceil((fontMetrics.descent + fontMetrics.lineGap) * designScale), 1.0f);
+
+    ////////////////////
+    // Create each instance and record its outline, spread across threads.
+
+    instances_.resize(instanceCount);
+    IDWriteFactory* factory = drawingCanvas.GetDWriteFactoryWeakRef();
+    DWRITE_FONT_SIMULATIONS const fontSimulations = baseFontFace->GetSimulations();
+    std::atomic<uint32_t> nextInstanceIndex(0);
+    std::atomic<HRESULT> firstFailure(S_OK);
+
+    auto createInstances = [&]() -> void
+    {
+        std::vector<DWRITE_FONT_AXIS_VALUE> fontAxisValues(sweepAxes.size());
+        std::vector<float> glyphAdvances(glyphIndices.size());
+
+        for (uint32_t i; (i = nextInstanceIndex++) < instanceCount; )
+        {
+            // Split the instance index into a step along each axis.
+            uint32_t remainingIndex = i;
+            for (size_t axisIndex = 0; axisIndex < sweepAxes.size(); ++axisIndex)
+            {
+                SweepAxis const& sweepAxis = sweepAxes[axisIndex];
+                uint32_t step = remainingIndex % sweepAxis.count;
+                remainingIndex /= sweepAxis.count;
+                float fraction = (sweepAxis.count > 1) ? float(step) / (sweepAxis.count - 1) : 0.0f;
+                fontAxisValues[axisIndex] = { sweepAxis.axisTag, sweepAxis.first + (sweepAxis.last - sweepAxis.first) * fraction };
+            }
+
+            Instance& instance = instances_[i];
+            ComPtr<IDWriteFontFace> instanceFontFace;
+            HRESULT hr = RecreateFontFace(factory, baseFontFace, fontSimulations, fontAxisValues, OUT &instanceFontFace);
+            if (SUCCEEDED(hr))
+            {
+                hr = GetFontFaceAdvances(instanceFontFace, fontSize, glyphIndices, measuringMode, /*isSideways*/false, OUT glyphAdvances);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = instance.outline.Record(instanceFontFace, fontSize, glyphIndices, glyphAdvances, /*isSideways*/false, isRightToLeft);
+            }
+            if (FAILED(hr))
+            {
+                HRESULT expected = S_OK;
+                firstFailure.compare_exchange_strong(IN OUT expected, hr);
+                continue;
+            }
+            instance.advance = std::accumulate(glyphAdvances.begin(), glyphAdvances.end(), 0.0f);
+        }
+    };
+
+    uint32_t const threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), instanceCount);
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (uint32_t threadIndex = 1; threadIndex < threadCount; ++threadIndex)
+    {
+        threads.emplace_back(createInstances);
+    }
+    createInstances(); // This thread is worker 0.
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (FAILED(firstFailure))
+    {
+        instances_.clear();
+        return firstFailure;
+    }
+
+    // Every cell fits the widest instance, with a little room between them.
+    float widestAdvance = 0;
+    for (auto const& instance : instances_)
+    {
+        widestAdvance = std::max(widestAdvance, instance.advance);
+    }
+    cellWidth_ = ceil(widestAdvance + fontSize / 4);
+
+    geometryFactory_.clear();
+    cookieSweep_ = newCookieSweep;
+
+    return S_OK;
+}
+
+
+void DrawableObjectDirect2DDrawAxisSweep::GetGridSize(
+    IAttributeSource& attributeSource,
+    _Out_ uint32_t& columnCount,
+    _Out_ uint32_t& rowCount
+    ) const
+{
+    uint32_t const instanceCount = uint32_t(instances_.size());
+    float layoutWidth = attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth);
+    columnCount = (layoutWidth >= cellWidth_) ? uint32_t(layoutWidth / cellWidth_) : 1;
+    columnCount = std::max(std::min(columnCount, instanceCount), 1u);
+    rowCount = (instanceCount + columnCount - 1) / columnCount;
+}
+
+
+size_t DrawableObjectDirect2DDrawAxisSweep::GetCachedByteSize() const
+{
+    // The path geometries are counted at about the size of their outlines.
+    size_t byteSize = instances_.capacity() * sizeof(Instance);
+    for (auto const& instance : instances_)
+    {
+        size_t const outlineByteSize = instance.outline.GetByteSize();
+        byteSize += outlineByteSize;
+        if (instance.pathGeometry != nullptr)
+        {
+            byteSize += outlineByteSize;
+        }
+    }
+    return byteSize;
+}
+
+
+HRESULT DrawableObjectDirect2DDrawAxisSweep::GetBounds(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    _Out_ D2D_RECT_F& layoutBounds,
+    _Out_ D2D_RECT_F& contentBounds
+    )
+{
+    float layoutWidth = attributeSource.GetValue(DrawableObjectAttributeWidth, DrawableObject::defaultWidth);
+    float layoutHeight = attributeSource.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight);
+    layoutBounds = {0, 0, layoutWidth, layoutHeight};
+    contentBounds = emptyRect;
+
+    IFR(EnsureInstances(attributeSource, drawingCanvas));
+
+    uint32_t columnCount, rowCount;
+    GetGridSize(attributeSource, OUT columnCount, OUT rowCount);
+    contentBounds.right = columnCount * cellWidth_;
+    contentBounds.bottom = rowCount * cellHeight_;
+
+    return S_OK;
+}
+
+
+HRESULT DrawableObjectDirect2DDrawAxisSweep::Draw(
+    IAttributeSource& attributeSource,
+    DrawingCanvas& drawingCanvas,
+    float x,
+    float y,
+    DX_MATRIX_3X2F const& transform
+    )
+{
+    IFR(EnsureInstances(attributeSource, drawingCanvas));
+
+    // Geometries only draw in the factory they came from, which differs
+    // between the main canvas and the tile canvases of parallel drawing.
+    ID2D1Factory* d2dFactory = drawingCanvas.GetD2DFactoryWeakRef();
+    if (geometryFactory_ != d2dFactory)
+    {
+        for (auto& instance : instances_)
+        {
+            instance.pathGeometry.clear();
+        }
+        geometryFactory_ = d2dFactory;
+    }
+
+    auto* brush = drawingCanvas.GetD2DBrushWeakRef();
+    uint32_t bgraTextColor = attributeSource.GetValue(DrawableObjectAttributeTextColor, defaultFontColor);
+    brush->SetColor(ToD2DColor(bgraTextColor));
+    bool const isRightToLeft = !!(attributeSource.GetValue(DrawableObjectAttributeReadingDirection, 0ui32) & 1);
+
+    uint32_t columnCount, rowCount;
+    GetGridSize(attributeSource, OUT columnCount, OUT rowCount);
+
+    auto* d2dRenderTarget = drawingCanvas.GetD2DRenderTargetWeakRef();
+    drawingCanvas.BeginDrawD2D();
+
+    for (uint32_t i = 0, ci = uint32_t(instances_.size()); i < ci; ++i)
+    {
+        Instance& instance = instances_[i];
+        if (instance.pathGeometry == nullptr)
+        {
+            if (FAILED(instance.outline.CreatePathGeometry(d2dFactory, OUT &instance.pathGeometry)))
+                continue;
+        }
+
+        // Right-to-left outlines extend leftward from the origin.
+        float cellX = x + (i % columnCount) * cellWidth_ + (isRightToLeft ? instance.advance : 0);
+        float cellY = y + (i / columnCount) * cellHeight_ + cellAscent_;
+        DX_MATRIX_3X2F cellTransform = transform;
+        cellTransform.dx += cellX * transform.xx + cellY * transform.yx;
+        cellTransform.dy += cellX * transform.xy + cellY * transform.yy;
+
+        d2dRenderTarget->SetTransform(&cellTransform.d2d);
+        d2dRenderTarget->FillGeometry(instance.pathGeometry, brush);
+    }
+
+    drawingCanvas.EndDrawD2D();
     d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
 
     return S_OK;
@@ -2697,9 +5093,8 @@ HRESULT DrawableObjectDWriteTextLayout::Update(
     IAttributeSource& attributeSource
     )
 {
-    // Clear cached values.
-    textFormat_.Invalidate();
-    textLayout_.Invalidate();
+    // The cached format and layout compare attribute cookies themselves when
+    // next measured or drawn, recreating only what the changes require.
     return S_OK;
 }
 
@@ -2716,8 +5111,8 @@ HRESULT DrawableObjectDWriteTextLayout::GetBounds(
     float layoutHeight = attributeSource.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight);
     layoutBounds = {0, 0, layoutWidth, layoutHeight};
 
-    IFR(textFormat_.EnsureCached(attributeSource, drawingCanvas));
-    IFR(textLayout_.EnsureCached(attributeSource, drawingCanvas, textFormat_.textFormat));
+    IFR(textFormat_.Update(attributeSource, drawingCanvas));
+    IFR(textLayout_.Update(attributeSource, drawingCanvas, textFormat_.textFormat));
 
     DWRITE_TEXT_METRICS1 textMetrics = {};
     ComPtr<IDWriteTextLayout2> textLayout2;
@@ -2749,8 +5144,8 @@ HRESULT DrawableObjectDWriteBitmapRenderTargetLayoutDraw::Draw(
     DX_MATRIX_3X2F const& transform
     )
 {
-    IFR(textFormat_.EnsureCached(attributeSource, drawingCanvas));
-    IFR(textLayout_.EnsureCached(attributeSource, drawingCanvas, textFormat_.textFormat));
+    IFR(textFormat_.Update(attributeSource, drawingCanvas));
+    IFR(textLayout_.Update(attributeSource, drawingCanvas, textFormat_.textFormat));
     IFR(renderingParams_.Update(attributeSource, drawingCanvas));
 
     // Set color.
@@ -2764,6 +5159,9 @@ HRESULT DrawableObjectDWriteBitmapRenderTargetLayoutDraw::Draw(
     auto* renderTarget = drawingCanvas.GetDWriteBitmapRenderTargetWeakRef();
     renderTarget->SetCurrentTransform(&transform.dwrite);
 
+    ComPtr<SharedColorGlyphCache> colorGlyphCache;
+    IFR(SharedColorGlyphCache::Get(drawingCanvas, OUT colorGlyphCache));
+
     auto hr = DrawTextLayout(
         drawingCanvas.GetDWriteFactoryWeakRef(),
         renderTarget,
@@ -2773,8 +5171,11 @@ HRESULT DrawableObjectDWriteBitmapRenderTargetLayoutDraw::Draw(
         y,
         ToColorRef(bgraTextColor),
         colorPaletteIndex,
-        enablePixelSnapping
+        enablePixelSnapping,
+        drawingCanvas.GetGlyphRunDrawer(),
+        &colorGlyphCache->layerCache
         );
+    colorGlyphCache->UpdateByteSize(drawingCanvas);
 
     renderTarget->SetCurrentTransform(&DrawableObject::identityTransform.dwrite);
 
@@ -2796,7 +5197,7 @@ HRESULT DrawableObjectDirect2DDrawText::Draw(
     DX_MATRIX_3X2F const& transform
     )
 {
-    IFR(textFormat_.EnsureCached(attributeSource, drawingCanvas));
+    IFR(textFormat_.Update(attributeSource, drawingCanvas));
     IFR(renderingParams_.Update(attributeSource, drawingCanvas));
 
     // Set color.
@@ -2806,7 +5207,7 @@ HRESULT DrawableObjectDirect2DDrawText::Draw(
 
     if (shouldCreateTextLayout_)
     {
-        IFR(textLayout_.EnsureCached(attributeSource, drawingCanvas, textFormat_.textFormat));
+        IFR(textLayout_.Update(attributeSource, drawingCanvas, textFormat_.textFormat));
     }
 
     bool enableColorFonts = attributeSource.GetValue(DrawableObjectAttributeColorFont, true);
@@ -2839,7 +5240,7 @@ HRESULT DrawableObjectDirect2DDrawText::Draw(
 
     d2dRenderTarget->SetTextRenderingParams(renderingParams_.renderingParams);
     d2dRenderTarget->SetTransform(&transform.d2d);
-    d2dRenderTarget->BeginDraw();
+    drawingCanvas.BeginDrawD2D();
 
     if (shouldCreateTextLayout_)
     {
@@ -2872,7 +5273,7 @@ HRESULT DrawableObjectDirect2DDrawText::Draw(
             );
     }
 
-    d2dRenderTarget->EndDraw();
+    drawingCanvas.EndDrawD2D();
     d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
 
     return S_OK;
@@ -2924,14 +5325,26 @@ HRESULT MapGdiPlusStatusToHResult(Gdiplus::Status status)
 
 HRESULT CachedGdiPlusStartup::EnsureCached()
 {
-    if (gdiplusToken == 0)
+    if (gdiplusToken != nullptr)
+        return S_OK;
+
+    // Tile threads may race to start it.
+    static std::mutex mutex;
+    static std::weak_ptr<GdiPlusStartupAutoResource> sharedGdiplusToken;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    gdiplusToken = sharedGdiplusToken.lock();
+    if (gdiplusToken == nullptr)
     {
+        auto newGdiplusToken = std::make_shared<GdiPlusStartupAutoResource>();
         Gdiplus::GdiplusStartupInputEx gdiplusStartupInput(Gdiplus::GdiplusStartupDefault);
-        auto status = Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, nullptr);
-        if (gdiplusToken == 0)
+        auto status = Gdiplus::GdiplusStartup(&*newGdiplusToken, &gdiplusStartupInput, nullptr);
+        if (*newGdiplusToken == 0)
         {
             return MapGdiPlusStatusToHResult(status);
         }
+        sharedGdiplusToken = newGdiplusToken;
+        gdiplusToken = std::move(newGdiplusToken);
     }
     return S_OK;
 }
@@ -2939,7 +5352,7 @@ HRESULT CachedGdiPlusStartup::EnsureCached()
 
 void CachedGdiPlusStartup::Invalidate()
 {
-    gdiplusToken.Clear();
+    gdiplusToken.reset();
 }
 
 
@@ -3049,9 +5462,112 @@ HRESULT CachedGdiPlusStringFormat::EnsureCached(IAttributeSource& attributeSourc
 };
 
 
+// A GDI+ private font collection for one font file, shared through the canvas
+// so that objects using the same file load it only once. GDI+ objects are not
+// thread safe, so parallel drawing and measuring take turns with the objects
+// using it (see IsGdiOrGdiPlusObject in DrawableObjectAndValues.cpp).
+class DECLSPEC_UUID("C4A1F2D7-3B58-4E96-A0C3-7D2E915B6F48") SharedGdiPlusFontCollection : public ComObject
+{
+public:
+    // Get the collection for the file, loading it if needed.
+    static HRESULT Get(
+        DrawingCanvas& drawingCanvas,
+        array_ref<char16_t const> filePath,
+        _Out_ ComPtr<SharedGdiPlusFontCollection>& fontCollection
+        );
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedGdiPlusFontCollection, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    CachedGdiPlusStartup cachedStartup; // Outlives the collection.
+    Gdiplus::PrivateFontCollection fontCollection;
+
+    // Family names in collection order, to map face indices to families.
+    std::vector<std::u16string> familyNames;
+};
+
+
+HRESULT SharedGdiPlusFontCollection::Get(
+    DrawingCanvas& drawingCanvas,
+    array_ref<char16_t const> filePath,
+    _Out_ ComPtr<SharedGdiPlusFontCollection>& fontCollection
+    )
+{
+    fontCollection.clear();
+
+    // Share by content, loading copies of a font through its first seen path.
+    std::u16string canonicalFilePath;
+    FileContentIdentity fileIdentity;
+    if (FAILED(GetFileContentIdentity(filePath.data(), OUT fileIdentity, OUT &canonicalFilePath)))
+    {
+        canonicalFilePath.assign(filePath.data());
+    }
+    if (SUCCEEDED(drawingCanvas.GetSharedResource<SharedGdiPlusFontCollection>(canonicalFilePath.c_str(), OUT &fontCollection)))
+        return S_OK;
+
+    // The startup must precede constructing any GDI+ object, including the collection.
+    CachedGdiPlusStartup cachedStartup;
+    IFR(cachedStartup.EnsureCached());
+
+    TRACE_LOGGING_ACTIVITY(activity, "LoadGdiPlusFontFile", TraceLoggingWideString(ToWChar(canonicalFilePath.c_str()), "FilePath"));
+
+    ComPtr<SharedGdiPlusFontCollection> newFontCollection;
+    newFontCollection.Set(new SharedGdiPlusFontCollection());
+    newFontCollection->cachedStartup = std::move(cachedStartup);
+    auto& privateFontCollection = newFontCollection->fontCollection;
+    IFR(MapGdiPlusStatusToHResult(privateFontCollection.AddFontFile(ToWChar(canonicalFilePath.c_str()))));
+
+    // Can't use std::vector sadly because FontFamily lacks a copy constructor -_-.
+    int32_t familiesCount = privateFontCollection.GetFamilyCount();
+    std::unique_ptr<Gdiplus::FontFamily[]> fontFamilies(new Gdiplus::FontFamily[familiesCount]);
+    IFR(MapGdiPlusStatusToHResult(privateFontCollection.GetFamilies(familiesCount, OUT fontFamilies.get(), OUT &familiesCount)));
+
+    for (int32_t i = 0; i < familiesCount; ++i)
+    {
+        WCHAR familyName[LF_FACESIZE] = {};
+        fontFamilies[i].GetFamilyName(OUT familyName);
+        newFontCollection->familyNames.push_back(ToChar16(familyName));
+    }
+
+    drawingCanvas.SetSharedResource<SharedGdiPlusFontCollection>(canonicalFilePath.c_str(), newFontCollection);
+    fontCollection = std::move(newFontCollection);
+    return S_OK;
+}
+
+
+size_t CachedGdiPlusStringFormat::GetByteSize() const noexcept
+{
+    return stringFormat.empty() ? 0 : sizeof(Gdiplus::StringFormat) + g_estimatedGdiPlusObjectByteSize;
+}
+
+
 CachedGdiPlusFont::~CachedGdiPlusFont()
 {
-    delete[] fontFamilies;
+    Invalidate();
+}
+
+
+void CachedGdiPlusFont::Invalidate()
+{
+    // Release in reverse order of dependency.
+    font.clear();
+    fontFamily.clear();
+    fontCollection.clear();
+}
+
+
+size_t CachedGdiPlusFont::GetByteSize() const noexcept
+{
+    size_t byteSize = 0;
+    if (!fontFamily.empty())
+        byteSize += sizeof(Gdiplus::FontFamily) + g_estimatedGdiPlusObjectByteSize;
+    if (!font.empty())
+        byteSize += sizeof(Gdiplus::Font) + g_estimatedGdiPlusObjectByteSize;
+    return byteSize;
 }
 
 
@@ -3060,6 +5576,8 @@ HRESULT CachedGdiPlusFont::EnsureCached(IAttributeSource& attributeSource, Drawi
     if (!font.empty())
         return S_OK;
 
+    ScopedCachedResourceTimer timer;
+
     bool hasUnderline = attributeSource.GetValue(DrawableObjectAttributeUnderline, false);
     bool hasStrikethrough = attributeSource.GetValue(DrawableObjectAttributeStrikethrough, false);
     float fontSize = attributeSource.GetValue(DrawableObjectAttributeFontSize, DrawableObject::defaultFontSize);
@@ -3077,46 +5595,32 @@ HRESULT CachedGdiPlusFont::EnsureCached(IAttributeSource& attributeSource, Drawi
     if (fontWeight >= DWRITE_FONT_WEIGHT_BOLD)  fontStyle |= Gdiplus::FontStyleBold;
     if (fontSlope != DWRITE_FONT_STYLE_NORMAL)  fontStyle |= Gdiplus::FontStyleItalic;
 
-    Gdiplus::FontFamily* activeFontFamily = nullptr; // Must be set by branch below.
-
     // Use either a custom font or system font.
     array_ref<char16_t const> customFontFilePath = attributeSource.GetString(DrawableObjectAttributeFontFilePath);
     if (!customFontFilePath.empty())
     {
         auto fontFaceIndex = attributeSource.GetValue(DrawableObjectAttributeFontFaceIndex, 0ui32);
 
-        // Add the custom font file to a private font collection.
-        fontCollection.emplace(); // Clear it to the default constructor.
-        IFR(MapGdiPlusStatusToHResult(fontCollection->AddFontFile(ToWChar(customFontFilePath.data()))));
+        // Get the private font collection with the custom font file.
+        IFR(SharedGdiPlusFontCollection::Get(drawingCanvas, customFontFilePath, OUT fontCollection));
 
         if (familyName.empty()) // Use face index if no family name specified.
         {
-            int32_t familiesCount = fontCollection->GetFamilyCount();
-            if (fontFaceIndex >= uint32_t(familiesCount))
+            if (fontFaceIndex >= fontCollection->familyNames.size())
             {
                 return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
             }
-
-            // Allocate families array.
-            delete[] fontFamilies;
-            fontFamilies = nullptr;
-            fontFamilies = new Gdiplus::FontFamily[familiesCount];
-            IFR(MapGdiPlusStatusToHResult(fontCollection->GetFamilies(familiesCount, OUT fontFamilies, OUT &familiesCount)));
-            activeFontFamily = &fontFamilies[fontFaceIndex];
-        }
-        else
-        {
-            fontFamily.emplace(ToWChar(familyName.data()), &*fontCollection);
-            activeFontFamily = &*fontFamily;
+            familyName = fontCollection->familyNames[fontFaceIndex];
         }
+        fontFamily.emplace(ToWChar(familyName.data()), &fontCollection->fontCollection);
     }
     else
     {
+        fontCollection.clear();
         fontFamily.emplace(ToWChar(familyName.data()));
-        activeFontFamily = &*fontFamily;
     }
 
-    font.emplace(activeFontFamily, fontSize, fontStyle, Gdiplus::UnitPixel);
+    font.emplace(&*fontFamily, fontSize, fontStyle, Gdiplus::UnitPixel);
 
     return MapGdiPlusStatusToHResult(font->GetLastStatus());
 };
@@ -3282,11 +5786,46 @@ HRESULT DrawableObjectGdiPlusDrawDriverString::Draw(
     array_ref<uint16_t const> glyphs = attributeSource.GetValues<uint16_t>(DrawableObjectAttributeGlyphs);
 
     Gdiplus::DriverStringOptions drawDriverStringFlags = Gdiplus::DriverStringOptionsRealizedAdvance;
-    if (readingDirection & 4)
+    bool const isVertical = !!(readingDirection & 4);
+    if (isVertical)
     {
         drawDriverStringFlags |= Gdiplus::DriverStringOptionsVertical;
     }
-    if (glyphs.empty() && attributeSource.GetString(DrawableObjectAttributeGlyphs).empty())
+
+    // GDI+ has no shaping of its own, so borrow the shaped glyphs, and for
+    // horizontal text their positions, from the same shared analysis the
+    // DWrite objects use.
+    CachedDWriteGlyphRun shapedGlyphRun;
+    std::vector<D2D_POINT_2F> glyphPositions;
+    bool const isFromText = glyphs.empty() && attributeSource.GetString(DrawableObjectAttributeGlyphs).empty();
+    if (isFromText && attributeSource.GetValue(DrawableObjectAttributeGlyphShaping, false))
+    {
+        ComPtr<IDWriteFontFace> fontFace;
+        IFR(GetDWriteFontFace(attributeSource, drawingCanvas, OUT &fontFace));
+        IFR(shapedGlyphRun.Update(attributeSource, drawingCanvas, fontFace));
+        glyphs.reset(shapedGlyphRun.glyphIndices, shapedGlyphRun.glyphCount);
+
+        if (!isVertical)
+        {
+            IFR(shapedGlyphRun.GetGlyphAdvancesIfNull());
+            glyphPositions.resize(glyphs.size());
+            IFR(PlacementsToAbsolutePoints(
+                fontFace,
+                shapedGlyphRun.fontEmSize,
+                x,
+                y,
+                /*isSideways*/false,
+                !!(shapedGlyphRun.bidiLevel & 1),
+                shapedGlyphRun.glyphCount,
+                shapedGlyphRun.glyphIndices,
+                shapedGlyphRun.glyphAdvances,
+                shapedGlyphRun.glyphOffsets,
+                OUT glyphPositions.data()
+                ));
+            drawDriverStringFlags = Gdiplus::DriverStringOptions(drawDriverStringFlags & ~Gdiplus::DriverStringOptionsRealizedAdvance);
+        }
+    }
+    else if (isFromText)
     {
         drawDriverStringFlags |= Gdiplus::DriverStringOptionsCmapLookup;
         glyphs.reset(text.reinterpret_as<uint16_t const>());
@@ -3305,12 +5844,13 @@ HRESULT DrawableObjectGdiPlusDrawDriverString::Draw(
         );
     gdiPlusGraphics.SetTransform(&gdiPlusTransform);
 
+    static_assert(sizeof(Gdiplus::PointF) == sizeof(D2D_POINT_2F), "The glyph positions are passed directly as GDI+ points.");
     gdiPlusGraphics.DrawDriverString(
         glyphs.data(),
         int(glyphs.size()),
         &cachedFont_.font.value(),
         &solidBrush,
-        &origin,
+        glyphPositions.empty() ? &origin : reinterpret_cast<Gdiplus::PointF const*>(glyphPositions.data()),
         drawDriverStringFlags,
         nullptr // transform
         );
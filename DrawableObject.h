@@ -14,6 +14,7 @@ import FileHelpers;
 import Attributes;
 import DrawingCanvas;
 import DWritEx;
+import PolygonRasterizer;
 #else
 #include "Common.ArrayRef.h"
 #include "Common.String.h"
@@ -24,6 +25,7 @@ import DWritEx;
 #include "Attributes.h"
 #include "DrawingCanvas.h"
 #include "DWritEx.h"
+#include "PolygonRasterizer.h"
 #endif
 
 
@@ -55,6 +57,7 @@ enum DrawableObjectAttribute : uint32_t
     DrawableObjectAttributePosition,
     DrawableObjectAttributeTransform,
     DrawableObjectAttributePixelZoom,
+    DrawableObjectAttributePixelGridColor,
     DrawableObjectAttributeReadingDirection,
     DrawableObjectAttributeColumnAlignment,
     DrawableObjectAttributeRowAlignment,
@@ -77,6 +80,7 @@ enum DrawableObjectAttribute : uint32_t
     DrawableObjectAttributeUnderline,
     DrawableObjectAttributeStrikethrough,
     DrawableObjectAttributeFontFallback,
+    DrawableObjectAttributeFontFallbackFamilies,
     DrawableObjectAttributeTabWidth,
     DrawableObjectAttributeHotkeyMode,
     DrawableObjectAttributeTrimmingGranularity,
@@ -86,6 +90,8 @@ enum DrawableObjectAttribute : uint32_t
     DrawableObjectAttributeAxisTags,
     DrawableObjectAttributeAxisValues,
     DrawableObjectAttributeDWriteFontFamilyModel,
+    DrawableObjectAttributeGlyphShaping,
+    DrawableObjectAttributeGlyphGeometries,
     DrawableObjectAttributeTotal,
 };
 
@@ -104,6 +110,8 @@ enum DrawableObjectFunction : uint32_t
     DrawableObjectFunctionGdiPlusDrawDriverString,
     DrawableObjectFunctionDrawColorBitmapGlyphRun,
     DrawableObjectFunctionDrawSvgGlyphRun,
+    DrawableObjectFunctionDirect2DDrawAxisSweep,
+    DrawableObjectFunctionReferenceRasterizerDrawGlyphRun,
     DrawableObjectFunctionTotal,
 #if 0
     GDI GetCharacterPlacement
@@ -192,6 +200,16 @@ public:
         DX_MATRIX_3X2F const& transform
         );
 
+    // The API which Draw uses, so that consecutive objects drawn with the
+    // same one can share a single drawing session on the canvas. Objects
+    // returning CurrentRenderingApiAny get an idle canvas.
+    virtual DrawingCanvas::CurrentRenderingApi GetRenderingApi() const { return DrawingCanvas::CurrentRenderingApiAny; }
+
+    // Approximate memory held by the object's cached fonts, formats, layouts,
+    // and outlines, for memory accounting. Anything shared through the canvas
+    // is counted there instead (see DrawingCanvas::GetSharedResourceUsage).
+    virtual size_t GetCachedByteSize() const { return 0; }
+
     ////////////////////
     // Helpers
     static DrawableObject* Create(DrawableObjectFunction functionId);
@@ -200,10 +218,11 @@ public:
     static HRESULT SaveFontFile(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, char16_t const* filePath);
     static HRESULT ExportFontGlyphData(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, array_ref<char16_t const> filePath);
     static HRESULT GetFontCharacters(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, bool getOnlyColorFontCharacters, _Out_ std::u16string& characters);
+    static HRESULT GetFontCharacters(array_ref<IAttributeSource* const> attributeSources, DrawingCanvas& drawingCanvas, bool getOnlyColorFontCharacters, _Out_ std::u16string& characters);
     static bool IsGdiOrGdiPlusFunction(DrawableObjectFunction functionType) noexcept;
 
     static const Attribute attributeList[DrawableObjectAttributeTotal];
-    static const Attribute::PredefinedValue functions[12];
+    static const Attribute::PredefinedValue functions[14];
     static const Attribute::PredefinedValue visibilities[2];
     static const Attribute::PredefinedValue enabledValues[2];
     static const Attribute::PredefinedValue labelDefaults[2];
@@ -214,6 +233,7 @@ public:
     static const Attribute::PredefinedValue layoutSizes[13];
     static const Attribute::PredefinedValue typographicFeatures[5];
     static const Attribute::PredefinedValue languages[14];
+    static const Attribute::PredefinedValue fontFallbackFamilies[4];
     static const Attribute::PredefinedValue fontSimulations[4];
     static const Attribute::PredefinedValue textColors[152];
     static const Attribute::PredefinedValue colorPaletteIndices[2];
@@ -266,6 +286,58 @@ public:
 // current attributes, since object creation is fairly light. So the caller
 // must call Invalidate from its Update, then may lazily call EnsureCached
 // before measuring or drawing.
+//
+// GetByteSize estimates the memory each holds for memory accounting, where
+// the sizes of the system's COM objects are guesses from their content.
+
+// Total time spent creating cached data on the current thread, which callers
+// may sample before and after a call to attribute the cost to an object.
+extern thread_local int64_t g_cachedResourceCreationTicks;
+extern thread_local uint32_t g_cachedResourceCreationDepth;
+
+// Adds the time spent creating a cached resource onto the total above. Only
+// the outermost of nested timers counts, so a resource created while creating
+// another (a face for a format, say) is not counted twice. A timer constructed
+// unstarted counts nothing until Start, for updates that find nothing changed.
+class ScopedCachedResourceTimer
+{
+public:
+    explicit ScopedCachedResourceTimer(bool isStarted = true) noexcept
+    {
+        if (isStarted)
+            Start();
+    }
+
+    ~ScopedCachedResourceTimer()
+    {
+        if (!isStarted_)
+            return;
+
+        if (isOutermost_)
+            g_cachedResourceCreationTicks += GetPerformanceCounter() - startTicks_;
+        --g_cachedResourceCreationDepth;
+    }
+
+    void Start() noexcept
+    {
+        if (isStarted_)
+            return;
+
+        isStarted_ = true;
+        isOutermost_ = (g_cachedResourceCreationDepth++ == 0);
+        if (isOutermost_)
+            startTicks_ = GetPerformanceCounter();
+    }
+
+    ScopedCachedResourceTimer(ScopedCachedResourceTimer const&) = delete;
+    ScopedCachedResourceTimer& operator=(ScopedCachedResourceTimer const&) = delete;
+
+private:
+    int64_t startTicks_ = 0;
+    bool isStarted_ = false;
+    bool isOutermost_ = false;
+};
+
 
 struct CachedDWriteFontFace
 {
@@ -283,6 +355,7 @@ struct CachedDWriteFontFace
 
     HRESULT Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
     void Invalidate() { fontFace.clear(); }
+    size_t GetByteSize() const noexcept { return 0; } // Shared through the canvas.
 };
 
 
@@ -293,33 +366,124 @@ struct CachedDWriteRenderingParams
 
     HRESULT Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
     void Invalidate() { renderingParams.clear(); }
+    size_t GetByteSize() const noexcept;
 };
 
 
+// The paragraph properties (alignment, wrapping, tab width) are applied in
+// place to an existing format, whereas font and trimming changes recreate it.
 struct CachedDWriteTextFormat
 {
     ComPtr<IDWriteTextFormat> textFormat;
+    uint32_t cookieFormat = ~0u;    // Combined cookie of attributes requiring a new format.
+    uint32_t cookieParagraph = ~0u; // Combined cookie of the paragraph attributes.
 
-    HRESULT EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
+    HRESULT Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
     void Invalidate() { textFormat.clear(); }
+    size_t GetByteSize() const noexcept;
 };
 
 
+// The layout is only recreated when the text, measuring mode, or text format
+// changes. Size, decorations, typography, axes, and paragraph properties are
+// applied in place via the layout's setters, keeping the shaped text.
 struct CachedDWriteTextLayout
 {
     ComPtr<IDWriteTextLayout> textLayout;
+    ComPtr<IDWriteTextFormat> textFormat; // Format the layout was created from.
+    uint32_t cookieLayout = ~0u;    // Combined cookie of attributes requiring a new layout.
+    uint32_t cookieParagraph = ~0u; // Combined cookie of the paragraph attributes.
+    uint32_t cookieWidth = ~0u;
+    uint32_t cookieHeight = ~0u;
+    uint32_t cookieTypographicFeatures = ~0u;
+    uint32_t cookieUnderline = ~0u;
+    uint32_t cookieStrikethrough = ~0u;
+    uint32_t cookieAxisTags = ~0u;
+    uint32_t cookieAxisValues = ~0u;
+    uint32_t textLength = 0;        // Of the layout, for estimating its size.
+
+    HRESULT Update(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, _In_ IDWriteTextFormat* textFormat);
+    void Invalidate() { textLayout.clear(); textFormat.clear(); }
+    size_t GetByteSize() const noexcept;
+
+private:
+    HRESULT CreateLayout(IAttributeSource& attributeSource, _In_ IDWriteFactory* factory, _In_ IDWriteTextFormat* newTextFormat);
+};
+
+
+// GDI font shared through the canvas by every object and label using the same
+// LOGFONT, so that paints avoid the font mapper. Each holder keeps it alive.
+class DECLSPEC_UUID("2F7B9E40-5C1A-4D83-8E6B-A93D0C4F1172") SharedGdiFont : public ComObject
+{
+public:
+    // Get the font for the LOGFONT, creating it if needed.
+    static HRESULT Get(DrawingCanvas& drawingCanvas, LOGFONT const& logFont, _Out_ ComPtr<SharedGdiFont>& sharedFont);
+
+    HFONT GetHandle() const noexcept { return font_; }
+
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) noexcept override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, SharedGdiFont, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
 
-    HRESULT EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, _In_ IDWriteTextFormat* textFormat);
-    void Invalidate() { textLayout.clear(); }
+protected:
+    GdiFontHandle font_;
 };
 
 
 struct CachedGdiFont
 {
-    GdiFontHandle font;
+    HFONT font = nullptr; // Owned by sharedFont.
+    ComPtr<SharedGdiFont> sharedFont;
+    LOGFONT logFont = {}; // Of sharedFont.
 
     HRESULT EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
-    void Invalidate() { font.clear(); }
+    void Invalidate() { font = nullptr; sharedFont.clear(); }
+    size_t GetByteSize() const noexcept { return 0; } // Shared through the canvas.
+};
+
+
+// Long text split into runs GDI can draw separately, each with its offset
+// along the flow, so that only the runs intersecting the clip are submitted.
+// For ExtTextOut these are pieces of the single line, and for DrawText whole
+// paragraphs, however long, so they wrap just as when drawn in one call.
+// Shorter text is drawn whole as before.
+struct CachedGdiTextRuns
+{
+    struct Run
+    {
+        uint32_t textPosition;
+        uint32_t textLength;
+        int32_t offset;         // Left for ExtTextOut, top for DrawText, relative to the first run.
+        int32_t extent;         // Width for ExtTextOut, height for DrawText.
+    };
+
+    std::vector<Run> runs;
+    int32_t totalExtent = 0;
+    int32_t lineHeight = 0;
+
+    HRESULT EnsureCachedTextOutRuns(HDC hdc, HFONT font, array_ref<char16_t const> text, bool isGlyphIndices);
+    HRESULT EnsureCachedDrawTextLines(HDC hdc, HFONT font, array_ref<char16_t const> text, LONG layoutWidth, uint32_t drawTextFlags);
+    void DrawTextOutRuns(HDC hdc, int x, int y, uint32_t textOutFlags, array_ref<char16_t const> text) const;
+    void DrawDrawTextLines(HDC hdc, RECT const& rect, uint32_t drawTextFlags, array_ref<char16_t const> text) const;
+    void Invalidate() { runs.clear(); font_ = nullptr; }
+    size_t GetByteSize() const noexcept { return runs.capacity() * sizeof(runs[0]); }
+
+    static constexpr size_t minimumTextLength = 4096;
+    static constexpr size_t maximumRunLength = 8192; // ExtTextOut's documented string limit.
+
+protected:
+    bool IsCurrent(HFONT font, array_ref<char16_t const> text, LONG layoutWidth, uint32_t flags) const noexcept;
+    void SetCurrent(HFONT font, array_ref<char16_t const> text, LONG layoutWidth, uint32_t flags) noexcept;
+
+    // What the runs were measured with.
+    HFONT font_ = nullptr;
+    char16_t const* textData_ = nullptr;
+    size_t textLength_ = 0;
+    LONG layoutWidth_ = 0;
+    uint32_t flags_ = 0;
 };
 
 
@@ -339,34 +503,42 @@ struct CachedGdiPlusStringFormat
 
     HRESULT EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
     void Invalidate() { stringFormat.clear(); }
+    size_t GetByteSize() const noexcept;
 };
 
 
+class SharedGdiPlusFontCollection;
+
 struct CachedGdiPlusFont
 {
+    // Private collection when a specific file is given, shared through the
+    // canvas by all objects using that file. Declared first so it outlives
+    // the family and font made from it.
+    ComPtr<SharedGdiPlusFontCollection> fontCollection;
+
     // Wrap the font in an optional to get around the lack of a default constructor for Font.
-    optional_value<Gdiplus::Font> font;
+    // Each object keeps its own family and font, since GDI+ objects are not
+    // safe to use from multiple threads at once, as parallel tiles would.
     optional_value<Gdiplus::FontFamily> fontFamily;
-    optional_value<Gdiplus::PrivateFontCollection> fontCollection;
-
-    // Array of font families for custom font collections when a specific file is given.
-    // Can't use std::vector sadly because FontFamily lacks a copy constructor -_-.
-    Gdiplus::FontFamily* fontFamilies = nullptr;
+    optional_value<Gdiplus::Font> font;
 
     operator Gdiplus::Font&() { return font.value(); } // Assumes !stringFormat.empty()
 
     ~CachedGdiPlusFont();
     HRESULT EnsureCached(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas, bool isDriverString);
-    void Invalidate() { fontFamily.clear(); font.clear(); }
+    void Invalidate();
+    size_t GetByteSize() const noexcept; // Only the family and font, since the collection is shared.
 };
 
 
 struct CachedGdiPlusStartup
 {
-    GdiPlusStartupAutoResource gdiplusToken;
+    // One startup shared by all objects, shut down once the last releases it.
+    std::shared_ptr<GdiPlusStartupAutoResource> gdiplusToken;
 
     HRESULT EnsureCached();
     void Invalidate();
+    size_t GetByteSize() const noexcept { return 0; } // One for the whole process.
 };
 
 
@@ -392,8 +564,12 @@ public:
         DX_MATRIX_3X2F const& transform
         ) override;
 
+    virtual HRESULT Update(IAttributeSource& attributeSource) override;
+    virtual size_t GetCachedByteSize() const override { return font_.GetByteSize() + textRuns_.GetByteSize(); }
+
 protected:
     CachedGdiFont font_;
+    CachedGdiTextRuns textRuns_;
 };
 
 
@@ -415,6 +591,9 @@ public:
         DX_MATRIX_3X2F const& transform
         ) override;
 
+    virtual HRESULT Update(IAttributeSource& attributeSource) override;
+    virtual size_t GetCachedByteSize() const override { return font_.GetByteSize() + textRuns_.GetByteSize(); }
+
 protected:
     HRESULT DrawInternal(
         IAttributeSource& attributeSource,
@@ -427,6 +606,7 @@ protected:
         );
 
     CachedGdiFont font_;
+    CachedGdiTextRuns textRuns_;
 };
 
 
@@ -441,6 +621,8 @@ public:
         _Out_ D2D_RECT_F& contentBounds
         ) override;
 
+    virtual size_t GetCachedByteSize() const override { return fontFace_.GetByteSize() + renderingParams_.GetByteSize(); }
+
 protected:
     CachedDWriteFontFace fontFace_;
     CachedDWriteRenderingParams renderingParams_;
@@ -460,6 +642,30 @@ public:
 };
 
 
+// Fills the glyph outlines with the PolygonRasterizer rather than any system
+// rasterizer, as a reproducible baseline for the others.
+class DrawableObjectReferenceRasterizerDrawGlyphRun : public DrawableObjectDWriteGlyphRun
+{
+public:
+    virtual HRESULT Draw(
+        IAttributeSource& attributeSource,
+        DrawingCanvas& drawingCanvas,
+        float x,
+        float y,
+        DX_MATRIX_3X2F const& transform
+        ) override;
+
+    virtual size_t GetCachedByteSize() const override
+    {
+        return DrawableObjectDWriteGlyphRun::GetCachedByteSize() + coverage_.capacity() * sizeof(uint32_t);
+    }
+
+protected:
+    PolygonRasterizer rasterizer_;
+    std::vector<uint32_t> coverage_; // Reused between draws.
+};
+
+
 class DrawableObjectDirect2DDrawGlyphRun : public DrawableObjectDWriteGlyphRun
 {
 public:
@@ -470,6 +676,8 @@ public:
         float y,
         DX_MATRIX_3X2F const& transform
         ) override;
+
+    virtual DrawingCanvas::CurrentRenderingApi GetRenderingApi() const override { return DrawingCanvas::CurrentRenderingApiD2D; }
 };
 
 
@@ -483,6 +691,8 @@ public:
         float y,
         DX_MATRIX_3X2F const& transform
         ) override;
+
+    virtual DrawingCanvas::CurrentRenderingApi GetRenderingApi() const override { return DrawingCanvas::CurrentRenderingApiD2D; }
 };
 
 
@@ -496,6 +706,58 @@ public:
         float y,
         DX_MATRIX_3X2F const& transform
         ) override;
+
+    virtual DrawingCanvas::CurrentRenderingApi GetRenderingApi() const override { return DrawingCanvas::CurrentRenderingApiD2D; }
+};
+
+
+// Grid of the glyph run drawn at many instances of a variable font, sweeping
+// each axis of axis_tags over a first, last, and count triple in axis_values.
+// The first axis varies fastest, and rows wrap at the layout width. Every
+// instance is created from the base face's one font resource, in parallel,
+// and keeps its outline until the font, text, size, or sweep changes.
+class DrawableObjectDirect2DDrawAxisSweep : public DrawableObject
+{
+public:
+    virtual HRESULT GetBounds(
+        IAttributeSource& attributeSource,
+        DrawingCanvas& drawingCanvas,
+        _Out_ D2D_RECT_F& layoutBounds,
+        _Out_ D2D_RECT_F& contentBounds
+        ) override;
+
+    virtual HRESULT Draw(
+        IAttributeSource& attributeSource,
+        DrawingCanvas& drawingCanvas,
+        float x,
+        float y,
+        DX_MATRIX_3X2F const& transform
+        ) override;
+
+    virtual DrawingCanvas::CurrentRenderingApi GetRenderingApi() const override { return DrawingCanvas::CurrentRenderingApiD2D; }
+
+    virtual size_t GetCachedByteSize() const override;
+
+    // Upper limit on the instances of a sweep, across all its axes.
+    static constexpr uint32_t maximumInstanceCount = 4096;
+
+protected:
+    struct Instance
+    {
+        GlyphRunOutline outline;
+        ComPtr<ID2D1PathGeometry> pathGeometry; // Created lazily in geometryFactory_.
+        float advance = 0; // Total advance of the glyph run.
+    };
+
+    HRESULT EnsureInstances(IAttributeSource& attributeSource, DrawingCanvas& drawingCanvas);
+    void GetGridSize(IAttributeSource& attributeSource, _Out_ uint32_t& columnCount, _Out_ uint32_t& rowCount) const;
+
+    std::vector<Instance> instances_;
+    ComPtr<ID2D1Factory> geometryFactory_; // Factory of the instance geometries, which can't be drawn in others.
+    uint32_t cookieSweep_ = ~0u;
+    float cellWidth_ = 1;
+    float cellHeight_ = 1;
+    float cellAscent_ = 0;
 };
 
 
@@ -512,6 +774,11 @@ public:
         _Out_ D2D_RECT_F& contentBounds
         ) override;
 
+    virtual size_t GetCachedByteSize() const override
+    {
+        return textFormat_.GetByteSize() + textLayout_.GetByteSize() + renderingParams_.GetByteSize();
+    }
+
 protected:
     CachedDWriteTextFormat textFormat_;
     CachedDWriteTextLayout textLayout_;
@@ -545,6 +812,8 @@ public:
         DX_MATRIX_3X2F const& transform
         ) override;
 
+    virtual DrawingCanvas::CurrentRenderingApi GetRenderingApi() const override { return DrawingCanvas::CurrentRenderingApiD2D; }
+
 protected:
     bool shouldCreateTextLayout_ = false;
 };
@@ -570,6 +839,11 @@ public:
         DX_MATRIX_3X2F const& transform
         ) override;
 
+    virtual size_t GetCachedByteSize() const override
+    {
+        return cachedStartup_.GetByteSize() + cachedStringFormat_.GetByteSize() + cachedFont_.GetByteSize();
+    }
+
     CachedGdiPlusStartup cachedStartup_;
     CachedGdiPlusStringFormat cachedStringFormat_;
     CachedGdiPlusFont cachedFont_;
@@ -596,6 +870,8 @@ public:
         DX_MATRIX_3X2F const& transform
         ) override;
 
+    virtual size_t GetCachedByteSize() const override { return cachedStartup_.GetByteSize() + cachedFont_.GetByteSize(); }
+
     CachedGdiPlusStartup cachedStartup_;
     CachedGdiPlusFont cachedFont_;
 };
@@ -3,6 +3,7 @@
 //  Description:    Generic drawable object instance with attribute values.
 //----------------------------------------------------------------------------
 #include "precomp.h"
+#include "Tracing.h"
 
 
 MODULE(DrawableObjectAndValues)
@@ -33,59 +34,248 @@ namespace
 
     static const COLORREF s_defaultLabelTextColor = 0x00FFFFFF;
     static const COLORREF s_defaultErrorTextColor = 0x004040FF;
+
+    // Get the label font shared through the canvas, rather than creating it
+    // for every paint. The reference keeps the handle alive.
+    HFONT GetLabelFont(DrawingCanvas& drawingCanvas, _Out_ ComPtr<SharedGdiFont>& labelFont)
+    {
+        SharedGdiFont::Get(drawingCanvas, s_defaultLabelLogFont, OUT labelFont);
+        return (labelFont != nullptr) ? labelFont->GetHandle() : nullptr;
+    }
+
+
+    // Split at line breaks like DrawText would, so the lines can all be drawn
+    // with a single PolyTextOut. A lone space label shows nothing.
+    void GetLabelLines(std::u16string const& label, _Out_ std::vector<DrawableObjectAndValues::LabelLine>& labelLines)
+    {
+        labelLines.clear();
+        if (label.empty() || label.compare(u" ") == 0)
+            return;
+
+        uint32_t const labelLength = uint32_t(label.size());
+        uint32_t lineStart = 0;
+        for (uint32_t i = 0; i <= labelLength; ++i)
+        {
+            if (i < labelLength && label[i] != '\r' && label[i] != '\n')
+                continue;
+
+            labelLines.push_back({lineStart, i - lineStart});
+            if (i + 1 < labelLength && label[i] == '\r' && label[i + 1] == '\n')
+                ++i;
+            lineStart = i + 1;
+        }
+    }
 }
 
 
-void DrawableObjectAndValues::Draw(
-    array_ref<DrawableObjectAndValues> drawableObjects,
-    DrawingCanvas& drawingCanvas,
-    DX_MATRIX_3X2F const& canvasTransform
-    )
+namespace
 {
-    size_t const totalDrawableObjects = drawableObjects.size();
+    std::atomic<uint32_t> g_timingsGeneration(0);
 
-    HDC hdc = drawingCanvas.GetHDC();
-    HBRUSH gdiDcBrush = static_cast<HBRUSH>(GetStockObject(DC_BRUSH));
-    GdiFontHandle labelFont = CreateFontIndirect(&s_defaultLabelLogFont);
-    SetGraphicsMode(hdc, GM_ADVANCED);
 
-    DX_MATRIX_3X2F finalTransform;
-    ComPtr<DrawingCanvas> spareDrawingCanvas;
+    // Records the duration of its lifetime, including how much of it went to
+    // creating cached resources on this thread.
+    class ScopedTimingRecorder
+    {
+    public:
+        explicit ScopedTimingRecorder(DrawableObjectAndValues::Timing& timing)
+        :   timing_(timing),
+            startTicks_(GetPerformanceCounter()),
+            startCachedResourceTicks_(g_cachedResourceCreationTicks)
+        { }
+
+        ~ScopedTimingRecorder()
+        {
+            timing_.totalTicks = GetPerformanceCounter() - startTicks_;
+            timing_.cachedResourceTicks = g_cachedResourceCreationTicks - startCachedResourceTicks_;
+            ++g_timingsGeneration;
+        }
 
-    ////////////////////
-    // Draw background colors and objects.
+    private:
+        DrawableObjectAndValues::Timing& timing_;
+        int64_t startTicks_;
+        int64_t startCachedResourceTicks_;
+    };
 
-    for (auto& objectAndValues : drawableObjects)
+
+    // Get (or create) the spare canvas used for zoomed objects, with at least
+    // the given unzoomed size, but no larger than the given canvas, since the
+    // zoomed pixels beyond it would be clipped anyway. It grows in whole tiles
+    // rather than to each object's exact size, so that it is rarely resized.
+    void GetSpareDrawingCanvas(
+        DrawingCanvas& drawingCanvas,
+        SIZE unzoomedSize,
+        IN OUT ComPtr<DrawingCanvas>& spareDrawingCanvas
+        )
     {
-        if (!objectAndValues.IsVisible())
-            continue;
+        bool isSpareCanvasChanged = false;
+        if (spareDrawingCanvas == nullptr)
+        {
+            // MODULE BUG: 'no GUID has been associated with this object'
+            // if (drawingCanvas.GetSharedResource(u"SpareDrawingCanvas", OUT &spareDrawingCanvas) == E_NOT_SET)
+
+            if (drawingCanvas.GetSharedResource(DrawingCanvas::g_guid, u"SpareDrawingCanvas", OUT reinterpret_cast<IUnknown**>(&spareDrawingCanvas)) == E_NOT_SET)
+            {
+                drawingCanvas.Clone(OUT &spareDrawingCanvas);
+                // MODULE BUG: 'no GUID has been associated with this object'
+                // drawingCanvas.SetSharedResource(u"SpareDrawingCanvas", spareDrawingCanvas.Get());
+
+                drawingCanvas.SetSharedResource(DrawingCanvas::g_guid, u"SpareDrawingCanvas", OUT spareDrawingCanvas.Get());
+                isSpareCanvasChanged = true;
+            }
+            spareDrawingCanvas->SetGlyphAtlasEnabled(drawingCanvas.IsGlyphAtlasEnabled());
+        }
+
+        SIZE const canvasSize = drawingCanvas.GetRenderTargetSize();
+
+        LONG const tileSize = LONG(DrawingCanvas::tileSize);
+        SIZE size = {
+            std::max(std::min((unzoomedSize.cx + tileSize - 1) / tileSize * tileSize, canvasSize.cx), 1L),
+            std::max(std::min((unzoomedSize.cy + tileSize - 1) / tileSize * tileSize, canvasSize.cy), 1L),
+        };
+        spareDrawingCanvas->CreateRenderTargetsOnDemand(drawingCanvas.GetHDC(), size);
+
+        SIZE currentSize = spareDrawingCanvas->GetRenderTargetSize();
+        if (currentSize.cx < size.cx || currentSize.cy < size.cy)
+        {
+            currentSize = {std::max(currentSize.cx, size.cx), std::max(currentSize.cy, size.cy)};
+            spareDrawingCanvas->ResizeRenderTargets(currentSize);
+            isSpareCanvasChanged = true;
+        }
+
+        // Record the spare canvas's pixel cost against the memory budget.
+        if (isSpareCanvasChanged)
+        {
+            size_t byteSize = size_t(currentSize.cx) * currentSize.cy * sizeof(uint32_t);
+            drawingCanvas.SetSharedResource(DrawingCanvas::g_guid, u"SpareDrawingCanvas", spareDrawingCanvas.Get(), byteSize);
+        }
+    }
+
+
+    // Measure the label and object, and transform the object bounds into the
+    // unpositioned object rect, for the first pass of Arrange.
+    HRESULT MeasureObject(
+        DrawableObjectAndValues& objectAndValues,
+        DrawingCanvas& drawingCanvas,
+        HDC hdc,
+        HFONT font
+        )
+    {
+        auto& arrangedBounds = objectAndValues.arrangedBounds_;
+        arrangedBounds.labelSize = {};
+        objectAndValues.layoutBounds_ = { 0,0, DrawableObject::defaultWidth, DrawableObject::defaultHeight };
+        objectAndValues.contentBounds_ = DrawableObject::emptyRect;
+
+        // Measure the label.
+        if (!objectAndValues.label_.empty())
+        {
+            HFONT previousFont = SelectFont(hdc, font);
+            GetTextExtentPoint32(hdc, ToWChar(objectAndValues.label_.data()), int(objectAndValues.label_.size()), OUT &arrangedBounds.labelSize);
+            SelectFont(hdc, previousFont);
+        }
+
+        // Measure the object in layout space, creating it on first use.
+        HRESULT hr = E_NOT_VALID_STATE;
+        if (objectAndValues.EnsureDrawableObject())
+        {
+            ScopedTimingRecorder timingRecorder(OUT objectAndValues.timings_.bounds);
+            hr = objectAndValues.drawableObject_->GetBounds(
+                objectAndValues, // attributeSource
+                drawingCanvas,
+                OUT objectAndValues.layoutBounds_,
+                OUT objectAndValues.contentBounds_
+                );
+        }
+
+        // If measurement failed, keep bounds at least as large as will be
+        // needed to display an error label.
+        if (FAILED(hr))
+        {
+            objectAndValues.layoutBounds_.bottom = std::max(objectAndValues.layoutBounds_.bottom, float(s_defaultLabelLogFont.lfHeight));
+            objectAndValues.contentBounds_ = DrawableObject::emptyRect;
+        }
+        arrangedBounds.contentBounds = objectAndValues.contentBounds_;
+
+        // Translate layout coordinates to world coordinates.
+        auto const& drawValues = objectAndValues.GetDrawValues();
+        if (drawValues.hasPosition)
+        {
+            TranslateRect(drawValues.position, IN OUT objectAndValues.layoutBounds_);
+            TranslateRect(drawValues.position, IN OUT objectAndValues.contentBounds_);
+        }
+
+        // Transform both content and layout rectangles, taking the max of them both.
+        // This gives the actual hit-testable bounds of the object.
+        objectAndValues.transform_.Update(objectAndValues);
+        auto const& transform = objectAndValues.transform_.transform.d2d;
+        D2D_RECT_F objectRect;
+        if (memcmp(&transform, &DrawingCanvas::g_identityMatrix.d2d, sizeof(transform)) == 0)
+        {
+            // Simple if identity - already transformed.
+            objectRect = objectAndValues.layoutBounds_;
+            UnionRect(objectAndValues.contentBounds_, IN OUT objectRect);
+        }
+        else
+        {
+            // Transform both layout and content bounds.
+            TransformRect(transform, objectAndValues.layoutBounds_, OUT objectRect);
+            D2D_RECT_F transformedContentBounds;
+            TransformRect(transform, objectAndValues.contentBounds_, OUT transformedContentBounds);
+            UnionRect(transformedContentBounds, IN OUT objectRect);
+        }
+
+        // Apply pixel zoom.
+        PixelAlignRect(IN OUT objectRect);
+        objectAndValues.origin_.x = -objectRect.left;
+        objectAndValues.origin_.y = -objectRect.top;
+        uint32_t pixelZoom = drawValues.pixelZoom;
+        if (pixelZoom > 0)
+        {
+            objectRect.left   *= pixelZoom;
+            objectRect.right  *= pixelZoom;
+            objectRect.top    *= pixelZoom;
+            objectRect.bottom *= pixelZoom;
+        }
+        arrangedBounds.objectRect = objectRect;
+
+        return hr;
+    }
+
+
+    bool IsWholePixelTranslation(DX_MATRIX_3X2F const& transform)
+    {
+        return transform.xx == 1 && transform.xy == 0
+            && transform.yx == 0 && transform.yy == 1
+            && transform.dx == floor(transform.dx)
+            && transform.dy == floor(transform.dy);
+    }
+
+
+    // Draw the background and content of a single object (not the label).
+    void DrawObject(
+        DrawableObjectAndValues& objectAndValues,
+        DrawingCanvas& drawingCanvas,
+        IN OUT ComPtr<DrawingCanvas>& spareDrawingCanvas,
+        DX_MATRIX_3X2F const& canvasTransform,
+        HFONT labelFont
+        )
+    {
+        HDC hdc = drawingCanvas.GetHDC();
+        DX_MATRIX_3X2F finalTransform;
 
         ////////////////////
         // Create a spare drawing canvas if we need to zoom into the pixels.
 
+        LONG const width = LONG(objectAndValues.objectRect_.right - objectAndValues.objectRect_.left);
+        LONG const height = LONG(objectAndValues.objectRect_.bottom - objectAndValues.objectRect_.top);
+
         DrawingCanvas* currentCanvas = &drawingCanvas;
-        uint32_t pixelZoom = objectAndValues.GetValue(DrawableObjectAttributePixelZoom, 0);
+        auto const& drawValues = objectAndValues.GetDrawValues();
+        uint32_t pixelZoom = drawValues.pixelZoom;
         if (pixelZoom > 0)
         {
-            if (spareDrawingCanvas == nullptr)
-            {
-                // MODULE BUG: 'no GUID has been associated with this object'
-                // if (drawingCanvas.GetSharedResource(u"SpareDrawingCanvas", OUT &spareDrawingCanvas) == E_NOT_SET)
-
-                if (drawingCanvas.GetSharedResource(DrawingCanvas::g_guid, u"SpareDrawingCanvas", OUT reinterpret_cast<IUnknown**>(&spareDrawingCanvas)) == E_NOT_SET)
-                {
-                    drawingCanvas.Clone(OUT &spareDrawingCanvas);
-                    // MODULE BUG: 'no GUID has been associated with this object'
-                    // drawingCanvas.SetSharedResource(u"SpareDrawingCanvas", spareDrawingCanvas.Get());
-
-                    drawingCanvas.SetSharedResource(DrawingCanvas::g_guid, u"SpareDrawingCanvas", OUT spareDrawingCanvas.Get());
-                }
-                auto* renderTarget = drawingCanvas.GetDWriteBitmapRenderTargetWeakRef();
-                SIZE size = {};
-                renderTarget->GetSize(OUT &size);
-                spareDrawingCanvas->CreateRenderTargetsOnDemand(hdc, size);
-                spareDrawingCanvas->ResizeRenderTargets(size);
-            }
+            SIZE unzoomedSize = {LONG((width + pixelZoom - 1) / pixelZoom), LONG((height + pixelZoom - 1) / pixelZoom)};
+            GetSpareDrawingCanvas(drawingCanvas, unzoomedSize, IN OUT spareDrawingCanvas);
 
             if (spareDrawingCanvas != nullptr)
                 currentCanvas = spareDrawingCanvas;
@@ -96,7 +286,7 @@ void DrawableObjectAndValues::Draw(
         ////////////////////
         // Calculate object position and transform.
 
-        D2D_POINT_2F position = objectAndValues.GetValue(DrawableObjectAttributePosition, D2D_POINT_2F{0,0});
+        D2D_POINT_2F position = drawValues.position;
         DX_MATRIX_3X2F objectTransform = objectAndValues.transform_;
 
         if (pixelZoom > 0)
@@ -117,43 +307,63 @@ void DrawableObjectAndValues::Draw(
 
         if (pixelZoom > 0)
         {
-            currentCanvas->ClearBackground(DrawableObject::defaultCanvasColor);
+            // Only the object's unzoomed area is enlarged, so the rest may stay stale.
+            RECT unzoomedRect = {0, 0, LONG((width + pixelZoom - 1) / pixelZoom), LONG((height + pixelZoom - 1) / pixelZoom)};
+            currentCanvas->ClearBackground(DrawableObject::defaultCanvasColor, unzoomedRect);
         }
 
         ////////////////////
         // Draw background colors.
 
-        uint32_t bgraLayoutColor = objectAndValues.GetValue(DrawableObjectAttributeLayoutColor, DrawableObject::defaultLayoutColor);
-        uint32_t bgraBackColor = objectAndValues.GetValue(DrawableObjectAttributeBackColor, DrawableObject::defaultBackColor);
+        uint32_t bgraLayoutColor = drawValues.layoutColor;
+        uint32_t bgraBackColor = drawValues.backColor;
 
         auto* d2dRenderTarget = currentCanvas->GetD2DRenderTargetWeakRef();
         auto* d2dBrush = currentCanvas->GetD2DBrushWeakRef();
         HDC currentHdc = currentCanvas->GetHDC();
 
-        d2dRenderTarget->BeginDraw();
-
-        d2dRenderTarget->SetTransform(&finalTransform.d2d);
-        if (bgraLayoutColor & 0xFF000000)
+        // Skip the D2D session entirely when there is nothing to fill, so
+        // objects drawn with other APIs don't break up a batch.
+        if ((bgraLayoutColor | bgraBackColor) & 0xFF000000)
         {
-            d2dBrush->SetColor(ToD2DColor(bgraLayoutColor));
-            d2dRenderTarget->FillRectangle(&objectAndValues.layoutBounds_, d2dBrush);
-        }
+            currentCanvas->BeginDrawD2D();
 
-        if (bgraBackColor & 0xFF000000)
-        {
-            d2dBrush->SetColor(ToD2DColor(bgraBackColor));
-            d2dRenderTarget->FillRectangle(&objectAndValues.contentBounds_, d2dBrush);
+            d2dRenderTarget->SetTransform(&finalTransform.d2d);
+            if (bgraLayoutColor & 0xFF000000)
+            {
+                d2dBrush->SetColor(ToD2DColor(bgraLayoutColor));
+                d2dRenderTarget->FillRectangle(&objectAndValues.layoutBounds_, d2dBrush);
+            }
+
+            if (bgraBackColor & 0xFF000000)
+            {
+                d2dBrush->SetColor(ToD2DColor(bgraBackColor));
+                d2dRenderTarget->FillRectangle(&objectAndValues.contentBounds_, d2dBrush);
+            }
+            d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
+            currentCanvas->EndDrawD2D();
         }
-        d2dRenderTarget->SetTransform(&DrawableObject::identityTransform.d2d);
-        d2dRenderTarget->EndDraw();
 
         ////////////////////
         // Draw object.
 
-        HRESULT hr = objectAndValues.drawableObject_->Draw(objectAndValues, *currentCanvas, position.x, position.y, finalTransform);
+        // Stay in the current D2D session if the object draws with D2D too.
+        currentCanvas->SwitchRenderingAPI(objectAndValues.drawableObject_->GetRenderingApi());
+
+        HRESULT hr;
+        {
+            auto functionId = DrawableObjectFunction(objectAndValues.GetTypedValue<DrawableObjectAttributeFunction>(DrawableObjectFunctionNop));
+            TRACE_LOGGING_ACTIVITY(objectActivity, "DrawObject",
+                TraceLoggingUInt32(static_cast<uint32_t>(functionId), "Function"),
+                TraceLoggingWideString(ToWChar(objectAndValues.label_.c_str()), "Label")
+                );
+            ScopedTimingRecorder timingRecorder(OUT objectAndValues.timings_.draw);
+            hr = objectAndValues.drawableObject_->Draw(objectAndValues, *currentCanvas, position.x, position.y, finalTransform);
+        }
 
         if (FAILED(hr))
         {
+            currentCanvas->SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiGdi);
             std::u16string errorString;
             GetFormattedString(OUT errorString, u"Error drawing object: 0x%08X", hr);
             RECT errorRect = {LONG(position.x), LONG(position.y), LONG(position.x), LONG(position.y)};
@@ -167,12 +377,22 @@ void DrawableObjectAndValues::Draw(
             SetWorldTransform(currentHdc, &DrawableObject::identityTransform.gdi);
         }
 
-        if (pixelZoom > 0)
+        if (pixelZoom > 0 && IsWholePixelTranslation(canvasTransform))
         {
-            // Stretch the new pixels to the final display.
+            // Enlarge the new pixels directly into the final display.
+            spareDrawingCanvas->SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+            drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+            LONG const left = LONG(objectAndValues.objectRect_.left + canvasTransform.dx);
+            LONG const top = LONG(objectAndValues.objectRect_.top + canvasTransform.dy);
+            RECT destRect = {left, top, left + width, top + height};
+            drawingCanvas.DrawZoomedPixels(spareDrawingCanvas->GetRawPixels(), destRect, pixelZoom, drawValues.pixelGridColor);
+        }
+        else if (pixelZoom > 0)
+        {
+            // Stretch the new pixels to the final display, which is scaled or rotated.
+            spareDrawingCanvas->SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+            drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiGdi);
             HDC spareHdc = spareDrawingCanvas->GetHDC();
-            LONG width = LONG(objectAndValues.objectRect_.right - objectAndValues.objectRect_.left);
-            LONG height = LONG(objectAndValues.objectRect_.bottom - objectAndValues.objectRect_.top);
 
             SetWorldTransform(hdc, &canvasTransform.gdi);
             StretchBlt(
@@ -192,176 +412,587 @@ void DrawableObjectAndValues::Draw(
         }
     }
 
-    ////////////////////
-    // Draw labels.
 
-    drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiGdi);
-    SetWorldTransform(hdc, &canvasTransform.gdi);
-    for (auto& objectAndValues : drawableObjects)
+    // Copy a block of 32-bit pixels from one canvas to another, clipping to
+    // both bitmaps. GDI must already be flushed for both.
+    void CopyRawPixels(
+        DrawingCanvas::RawPixels const& sourcePixels,
+        int32_t sourceX,
+        int32_t sourceY,
+        DrawingCanvas::RawPixels const& destPixels,
+        int32_t destX,
+        int32_t destY,
+        int32_t width,
+        int32_t height
+        )
     {
-        if (!objectAndValues.IsVisible())
-            continue;
-
-        // Draw label.
-        if (!objectAndValues.label_.empty() && objectAndValues.label_.compare(u" ") != 0)
+        if (sourcePixels.bitsPerPixel != 32 || destPixels.bitsPerPixel != 32)
+            return;
+
+        // Clip the rectangle to the source and destination.
+        if (destX < 0)   { width  += destX; sourceX -= destX; destX = 0; }
+        if (destY < 0)   { height += destY; sourceY -= destY; destY = 0; }
+        if (sourceX < 0) { width  += sourceX; destX -= sourceX; sourceX = 0; }
+        if (sourceY < 0) { height += sourceY; destY -= sourceY; sourceY = 0; }
+        width  = std::min(width,  std::min(int32_t(destPixels.width)   - destX, int32_t(sourcePixels.width)  - sourceX));
+        height = std::min(height, std::min(int32_t(destPixels.height)  - destY, int32_t(sourcePixels.height) - sourceY));
+        if (width <= 0 || height <= 0)
+            return;
+
+        auto* sourceRow = PtrAddByteOffset(reinterpret_cast<uint32_t const*>(sourcePixels.pixels), sourceY * sourcePixels.byteStride);
+        auto* destRow   = PtrAddByteOffset(reinterpret_cast<uint32_t*>(destPixels.pixels), destY * destPixels.byteStride);
+        for (int32_t y = 0; y < height; ++y)
         {
-            HFONT previousFont = SelectFont(hdc, labelFont);
-            SetTextColor(hdc, s_defaultLabelTextColor);
-            SetBkMode(hdc, TRANSPARENT);
-            DrawText(hdc, ToWChar(objectAndValues.label_.data()), int(objectAndValues.label_.size()), &objectAndValues.labelRect_, DT_NOCLIP | DT_NOPREFIX);
-            SelectFont(hdc, previousFont);
+            memcpy(destRow + destX, sourceRow + sourceX, width * sizeof(uint32_t));
+            sourceRow = PtrAddByteOffset(sourceRow, sourcePixels.byteStride);
+            destRow   = PtrAddByteOffset(destRow, destPixels.byteStride);
         }
     }
-    SetWorldTransform(hdc, &DrawableObject::identityTransform.gdi);
-    drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
 
-    #if 0 // todo::: delete hack
-    DrawingCanvas::RawPixels rawPixels = drawingCanvas.GetRawPixels();
-    std::vector<Edge> edges = {{0,1},{1,2},{2,3},{3,4},{4,5},{5,6},{6,7},{7,0},  {8,9},{9,10},{10,11},{11,8},  {12,13},{13,14},{14,15},{15,12}};
-    std::vector<PointI> points = {{100,100},{150,0},{250,150},{250,0},{300,100},{250,200},{150,50},{150,200},  {400,150},{600,200},{350,350},{300,250},  {400,200},{450,250},{400,275},{350,250}};
-    FillPolyline(rawPixels, canvasTransform, points, IN OUT edges, 0xFFE080C0);
-    //DrawLineTransformed(
-    //    rawPixels,
-    //    canvasTransform,
-    //    100,
-    //    100,
-    //    100,
-    //    200,
-    //    0xFFE080C0
-    //    );
-    #endif
-}
 
+    // Get (or create) a tile canvas per worker thread, each at least the given
+    // size. They are kept in the canvas shared resources between calls.
+    HRESULT GetTileCanvases(
+        DrawingCanvas& drawingCanvas,
+        uint32_t threadCount,
+        SIZE tileSize,
+        _Out_ std::vector<ComPtr<DrawingCanvas>>& tileCanvases
+        )
+    {
+        tileCanvases.clear();
+        tileCanvases.resize(threadCount);
+        HDC hdc = drawingCanvas.GetHDC();
+        for (uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            char16_t tileName[32];
+            swprintf_s(ToWChar(tileName), countof(tileName), L"TileDrawingCanvas%u", threadIndex);
 
-void DrawableObjectAndValues::Arrange(
-    array_ref<DrawableObjectAndValues> drawableObjects,
-    DrawingCanvas& drawingCanvas
-    )
-{
-    size_t const totalDrawableObjects = drawableObjects.size();
+            auto& tileCanvas = tileCanvases[threadIndex];
+            bool isTileCanvasChanged = false;
+            if (drawingCanvas.GetSharedResource(DrawingCanvas::g_guid, tileName, OUT reinterpret_cast<IUnknown**>(&tileCanvas)) == E_NOT_SET)
+            {
+                drawingCanvas.Clone(OUT &tileCanvas, DrawingCanvas::FactoryIsolationPerThreadD2D);
+                isTileCanvasChanged = true;
+            }
+            tileCanvas->SetGlyphAtlasEnabled(drawingCanvas.IsGlyphAtlasEnabled());
+            IFR(tileCanvas->CreateRenderTargetsOnDemand(hdc, tileSize));
 
-    float y = 0;
-    float defaultPadding = 8;
-    float previousPadding = defaultPadding;
+            SIZE currentTileSize = tileCanvas->GetRenderTargetSize();
+            if (currentTileSize.cx < tileSize.cx || currentTileSize.cy < tileSize.cy)
+            {
+                currentTileSize = {std::max(currentTileSize.cx, tileSize.cx), std::max(currentTileSize.cy, tileSize.cy)};
+                IFR(tileCanvas->ResizeRenderTargets(currentTileSize));
+                isTileCanvasChanged = true;
+            }
 
-    GdiFontHandle font = CreateFontIndirect(&s_defaultLabelLogFont);
-    HDC hdc = drawingCanvas.GetHDC();
-    LONG widestLabelWidth = 0;
-    float leftmostBounds = 0, rightmostBounds = 0;
+            // Record the tile's pixel cost against the memory budget.
+            if (isTileCanvasChanged)
+            {
+                size_t tileByteSize = size_t(currentTileSize.cx) * currentTileSize.cy * sizeof(uint32_t);
+                drawingCanvas.SetSharedResource(DrawingCanvas::g_guid, tileName, tileCanvas.Get(), tileByteSize);
+            }
+        }
 
-    ////////////////////
-    // First pass is just to get the sizes of the label and object.
+        return S_OK;
+    }
 
-    for (size_t drawableObjectIndex = 0; drawableObjectIndex < drawableObjects.size(); ++drawableObjectIndex)
+
+    // GDI+ objects are not safe to use from several threads at once, yet their
+    // fonts and private font collections are shared through the canvas by
+    // every object using the same file, and cached objects keep theirs across
+    // calls made on different workers' canvases. So the workers take turns
+    // with GDI and GDI+ objects, while DWrite and D2D ones run freely.
+    bool IsGdiOrGdiPlusObject(DrawableObjectAndValues& objectAndValues)
     {
-        auto& objectAndValues = drawableObjects[drawableObjectIndex];
-        if (!objectAndValues.IsVisible())
-            continue;
+        return DrawableObject::IsGdiOrGdiPlusFunction(objectAndValues.GetValue(DrawableObjectAttributeFunction, DrawableObjectFunctionNop));
+    }
 
-        ZeroStructure(objectAndValues.labelRect_);
-        objectAndValues.layoutBounds_ = { 0,0, DrawableObject::defaultWidth, DrawableObject::defaultHeight };
-        objectAndValues.contentBounds_ = DrawableObject::emptyRect;
 
-        // Measure the label.
-        if (!objectAndValues.label_.empty())
+    // Whether any visible objects' rects, inflated by the overhang margin, overlap.
+    // Tiles are opaque, so one overlapping another would cover its neighbor's
+    // ink, and the workers copying them would race on the shared pixels.
+    bool DoObjectTilesOverlap(array_ref<DrawableObjectAndValues> drawableObjects, float overhang)
+    {
+        std::vector<D2D_RECT_F> tileRects;
+        tileRects.reserve(drawableObjects.size());
+        for (auto const& objectAndValues : drawableObjects)
         {
-            SIZE& labelSize = *reinterpret_cast<SIZE*>(&objectAndValues.labelRect_.right);
-            HFONT previousFont = SelectFont(hdc, font);
-            GetTextExtentPoint32(hdc, ToWChar(objectAndValues.label_.data()), int(objectAndValues.label_.size()), OUT &labelSize);
-            SelectFont(hdc, previousFont);
-            widestLabelWidth = std::max(widestLabelWidth, labelSize.cx);
+            D2D_RECT_F const& objectRect = objectAndValues.objectRect_;
+            if (!objectAndValues.IsVisible() || objectRect.right <= objectRect.left || objectRect.bottom <= objectRect.top)
+                continue;
+
+            tileRects.push_back({objectRect.left - overhang, objectRect.top - overhang, objectRect.right + overhang, objectRect.bottom + overhang});
         }
 
-        // Measure the object in layout space.
-        auto hr = objectAndValues.drawableObject_->GetBounds(
-            objectAndValues, // attributeSource
-            drawingCanvas,
-            OUT objectAndValues.layoutBounds_,
-            OUT objectAndValues.contentBounds_
-            );
+        // Sweep left to right, only comparing rects which overlap horizontally.
+        std::sort(tileRects.begin(), tileRects.end(), [](D2D_RECT_F const& a, D2D_RECT_F const& b) { return a.left < b.left; });
+        for (size_t i = 0, ci = tileRects.size(); i < ci; ++i)
+        {
+            for (size_t j = i + 1; j < ci && tileRects[j].left < tileRects[i].right; ++j)
+            {
+                if (tileRects[j].top < tileRects[i].bottom && tileRects[j].bottom > tileRects[i].top)
+                    return true;
+            }
+        }
 
-        // If measurement failed, keep bounds at least as large as will be
-        // needed to display an error label.
-        if (FAILED(hr))
+        return false;
+    }
+
+
+    // Draws each object into a tile canvas, compositing the tiles directly into
+    // the canvas pixels. With DrawFlagsParallel, the objects are split across
+    // worker threads. Each worker owns a tile canvas with its own D2D factory
+    // (which is single threaded), and the tiles persist in the canvas shared
+    // resources between paints. With DrawFlagsCachePixels, each object keeps a
+    // copy of its tile, which is copied straight back next time if the object
+    // is unchanged, such as when just panning the view.
+    //
+    // Returns S_FALSE if the objects can't be safely drawn as tiles, such as
+    // when the view is scaled or rotated, or when objects are explicitly
+    // positioned or padded too closely for their tiles not to overlap, in
+    // which case the caller should draw them directly.
+    HRESULT DrawObjectsInTiles(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        array_ref<uint32_t const> drawableObjectIndices,
+        DrawingCanvas& drawingCanvas,
+        DX_MATRIX_3X2F const& canvasTransform,
+        DrawableObjectAndValues::DrawFlags drawFlags,
+        HFONT labelFont
+        )
+    {
+        // Only whole pixel translations can be composited as a simple copy.
+        if (!IsWholePixelTranslation(canvasTransform))
         {
-            objectAndValues.layoutBounds_.bottom = std::max(objectAndValues.layoutBounds_.bottom, float(s_defaultLabelLogFont.lfHeight));
-            objectAndValues.contentBounds_ = DrawableObject::emptyRect;
-            
+            return S_FALSE;
         }
 
-        // Translate layout coordinates to world coordinates.
-        optional_value<D2D_POINT_2F> optionalPosition = objectAndValues.GetOptionalValue<D2D_POINT_2F>(DrawableObjectAttributePosition);
-        if (!optionalPosition.empty())
+        DrawingCanvas::RawPixels canvasPixels = drawingCanvas.GetRawPixels();
+        if (canvasPixels.bitsPerPixel != 32)
         {
-            TranslateRect(optionalPosition.value(), IN OUT objectAndValues.layoutBounds_);
-            TranslateRect(optionalPosition.value(), IN OUT objectAndValues.contentBounds_);
+            return S_FALSE;
         }
 
-        // Transform both content and layout rectangles, taking the max of them both.
-        // This gives the actual hit-testable bounds of the object.
-        objectAndValues.transform_.Update(objectAndValues);
-        auto const& transform = objectAndValues.transform_.transform.d2d;
-        D2D_RECT_F objectRect;
-        if (memcmp(&transform, &DrawingCanvas::g_identityMatrix.d2d, sizeof(transform)) == 0)
+        // Explicitly positioned objects may overlap others, which opaque tiles would cover.
+        for (uint32_t objectIndex : drawableObjectIndices)
         {
-            // Simple if identity - already transformed.
-            objectRect = objectAndValues.layoutBounds_;
-            UnionRect(objectAndValues.contentBounds_, IN OUT objectRect);
+            if (drawableObjects[objectIndex].GetDrawValues().hasPosition)
+                return S_FALSE;
         }
-        else
+
+        // Nor may arranged objects closer than twice the overhang, since a
+        // tile includes the overhang margins on every side.
+        LONG const overhang = DrawableObjectAndValues::drawnRectOverhang;
+        if (DoObjectTilesOverlap(drawableObjects, float(overhang)))
         {
-            // Transform both layout and content bounds.
-            TransformRect(transform, objectAndValues.layoutBounds_, OUT objectRect);
-            D2D_RECT_F transformedContentBounds;
-            TransformRect(transform, objectAndValues.contentBounds_, OUT transformedContentBounds);
-            UnionRect(transformedContentBounds, IN OUT objectRect);
+            return S_FALSE;
         }
 
-        // Apply pixel zoom.
-        PixelAlignRect(IN OUT objectRect);
-        objectAndValues.origin_.x = -objectRect.left;
-        objectAndValues.origin_.y = -objectRect.top;
-        uint32_t pixelZoom = objectAndValues.GetValue(DrawableObjectAttributePixelZoom, 0);
-        if (pixelZoom > 0)
+        bool const shouldCachePixels = (drawFlags & DrawableObjectAndValues::DrawFlagsCachePixels) != 0;
+        uint32_t const maximumThreadCount = (drawFlags & DrawableObjectAndValues::DrawFlagsParallel)
+            ? std::min(uint32_t(std::thread::hardware_concurrency()), DrawableObjectAndValues::maximumDrawingThreads)
+            : 1;
+
+        if (!shouldCachePixels && maximumThreadCount <= 1)
         {
-            objectRect.left   *= pixelZoom;
-            objectRect.right  *= pixelZoom;
-            objectRect.top    *= pixelZoom;
-            objectRect.bottom *= pixelZoom;
+            return S_FALSE; // Not worth the overhead.
         }
-        objectAndValues.objectRect_ = objectRect;
 
-        // Record largest accumulated bounds for left and right edges so far of all objects.
-        leftmostBounds  = std::min(leftmostBounds,  objectRect.left);
-        rightmostBounds = std::max(rightmostBounds, objectRect.right);
-    }
+        // Flush anything already drawn to the canvas before writing to its pixels.
+        drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+        GdiFlush();
 
-    leftmostBounds  = floor(leftmostBounds);
-    rightmostBounds = floor(rightmostBounds);
+        // Gather the visible objects that intersect the canvas, copying any
+        // already cached, and get the largest object size, which all the tiles
+        // share.
+        std::vector<uint32_t> objectIndices;
+        SIZE tileSize = {1, 1};
+        for (uint32_t objectIndex : drawableObjectIndices)
+        {
+            auto& objectAndValues = drawableObjects[objectIndex];
 
-    ////////////////////
-    // Second pass sets the positions for the label and object.
+            D2D_RECT_F const& objectRect = objectAndValues.objectRect_;
+            if (objectRect.right  + canvasTransform.dx <= 0
+            ||  objectRect.bottom + canvasTransform.dy <= 0
+            ||  objectRect.left   + canvasTransform.dx >= canvasPixels.width
+            ||  objectRect.top    + canvasTransform.dy >= canvasPixels.height)
+            {
+                continue; // Entirely off the canvas.
+            }
 
-    for (size_t drawableObjectIndex = 0; drawableObjectIndex < drawableObjects.size(); ++drawableObjectIndex)
-    {
-        auto& objectAndValues = drawableObjects[drawableObjectIndex];
-        if (!objectAndValues.IsVisible())
-            continue;
+            // Tiles include the margin where the ink may overhang the object
+            // rect, which neighbors' tiles were checked not to overlap above.
+            LONG width = LONG(objectRect.right - objectRect.left) + overhang * 2;
+            LONG height = LONG(objectRect.bottom - objectRect.top) + overhang * 2;
+            auto& cachedPixels = objectAndValues.cachedPixels_;
+            if (shouldCachePixels && cachedPixels.IsCurrent(objectAndValues.GetCombinedCookie(), width, height))
+            {
+                DrawingCanvas::RawPixels sourcePixels = cachedPixels.GetRawPixels();
+                CopyRawPixels(
+                    sourcePixels,
+                    0,
+                    0,
+                    canvasPixels,
+                    int32_t(objectRect.left + canvasTransform.dx) - overhang,
+                    int32_t(objectRect.top + canvasTransform.dy) - overhang,
+                    width,
+                    height
+                    );
+                continue;
+            }
 
-        float x = defaultPadding;
-        float labelY = y;
-        float labelX = defaultPadding;
+            tileSize.cx = std::max(tileSize.cx, width);
+            tileSize.cy = std::max(tileSize.cy, height);
+            objectIndices.push_back(objectIndex);
+        }
 
-        // Skip arrangement of any explicitly positioned objects.
-        if (objectAndValues.HasValue<D2D_POINT_2F>(DrawableObjectAttributePosition))
+        uint32_t const threadCount = std::min(maximumThreadCount, uint32_t(objectIndices.size()));
+        if (threadCount == 0)
         {
-            labelX = objectAndValues.objectRect_.right + defaultPadding;
-            labelY = objectAndValues.objectRect_.top;
+            return S_OK; // Everything was cached or off the canvas.
         }
-        else
+
+        // Get a tile canvas for each thread.
+        std::vector<ComPtr<DrawingCanvas>> tileCanvases;
+        IFR(GetTileCanvases(drawingCanvas, threadCount, tileSize, OUT tileCanvases));
+
+        // Each worker takes the next undrawn object, draws it into its tile,
+        // and copies the tile into the canvas. Since arranged objects never
+        // overlap, and were checked above to be padded apart by at least their
+        // overhang margins, the copies touch disjoint pixels and need no locking.
+        std::atomic<uint32_t> nextObjectIndex(0);
+        std::mutex gdiObjectsLock;
+        auto drawTiles = [&](uint32_t workerIndex) -> void
         {
-            // Move down, leaving some padding between the previous object.
-            float padding = objectAndValues.GetValue(DrawableObjectAttributePadding, defaultPadding);
+            DrawingCanvas& tileCanvas = *tileCanvases[workerIndex].Get();
+            ComPtr<DrawingCanvas> spareDrawingCanvas;
+            DrawingCanvas::RawPixels tilePixels = tileCanvas.GetRawPixels();
+            HDC tileHdc = tileCanvas.GetHDC();
+            SetGraphicsMode(tileHdc, GM_ADVANCED);
+
+            for (uint32_t i; (i = nextObjectIndex++) < objectIndices.size(); )
+            {
+                auto& objectAndValues = drawableObjects[objectIndices[i]];
+                D2D_RECT_F const& objectRect = objectAndValues.objectRect_;
+                DX_MATRIX_3X2F tileTransform = DrawingCanvas::g_identityMatrix;
+                tileTransform.dx = float(overhang) - objectRect.left;
+                tileTransform.dy = float(overhang) - objectRect.top;
+
+                tileCanvas.ClearBackground(DrawableObject::defaultCanvasColor);
+                {
+                    // GDI and GDI+ objects draw one at a time (see IsGdiOrGdiPlusObject).
+                    std::unique_lock<std::mutex> gdiObjectLock(gdiObjectsLock, std::defer_lock);
+                    if (IsGdiOrGdiPlusObject(objectAndValues))
+                    {
+                        gdiObjectLock.lock();
+                    }
+                    DrawObject(objectAndValues, tileCanvas, IN OUT spareDrawingCanvas, tileTransform, labelFont);
+                    tileCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+                    GdiFlush();
+                }
+
+                LONG width = LONG(objectRect.right - objectRect.left) + overhang * 2;
+                LONG height = LONG(objectRect.bottom - objectRect.top) + overhang * 2;
+                CopyRawPixels(
+                    tilePixels,
+                    0,
+                    0,
+                    canvasPixels,
+                    int32_t(objectRect.left + canvasTransform.dx) - overhang,
+                    int32_t(objectRect.top + canvasTransform.dy) - overhang,
+                    width,
+                    height
+                    );
+
+                if (shouldCachePixels)
+                {
+                    objectAndValues.cachedPixels_.Store(tilePixels, objectAndValues.GetCombinedCookie(), width, height);
+                }
+            }
+
+            tileCanvas.RetireStaleSharedResources();
+        };
+
+        RunWorkers(threadCount, drawTiles);
+
+        return S_OK;
+    }
+}
+
+
+void DrawableObjectAndValues::Draw(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    DX_MATRIX_3X2F const& canvasTransform,
+    DrawFlags drawFlags,
+    _In_opt_ RECT const* updateRect
+    )
+{
+    TRACE_LOGGING_ACTIVITY(activity, "DrawObjects", TraceLoggingUInt32(static_cast<uint32_t>(drawableObjects.size()), "ObjectCount"));
+
+    HDC hdc = drawingCanvas.GetHDC();
+    ComPtr<SharedGdiFont> labelFontReference;
+    HFONT labelFont = GetLabelFont(drawingCanvas, OUT labelFontReference);
+    SetGraphicsMode(hdc, GM_ADVANCED);
+    drawingCanvas.SetGlyphAtlasEnabled((drawFlags & DrawFlagsGlyphAtlas) != 0);
+
+    ////////////////////
+    // Determine which objects need drawing, recording what was drawn where
+    // for the next GetInvalidatedRect.
+
+    // Objects wholly outside the canvas, such as when zoomed into one corner
+    // of a large sheet, are still recorded but skip drawing.
+    DrawingCanvas::RawPixels canvasPixels = drawingCanvas.GetRawPixels();
+    RECT const canvasRect = {0, 0, LONG(canvasPixels.width), LONG(canvasPixels.height)};
+    bool const cullToCanvas = !IsRectEmpty(&canvasRect);
+
+    std::vector<uint32_t> drawableObjectIndices;
+    for (uint32_t objectIndex = 0, objectCount = uint32_t(drawableObjects.size()); objectIndex < objectCount; ++objectIndex)
+    {
+        auto& objectAndValues = drawableObjects[objectIndex];
+        RECT drawnRect = {};
+        RECT intersection;
+
+        // Normally Arrange already created the object when measuring it, but
+        // if not, do it here rather than racing to in the tile threads.
+        if (objectAndValues.IsVisible() && objectAndValues.EnsureDrawableObject())
+        {
+            objectAndValues.GetDrawnRect(canvasTransform, OUT drawnRect);
+        }
+        if (updateRect != nullptr
+        && !IntersectRect(OUT &intersection, updateRect, &drawnRect)
+        && !IntersectRect(OUT &intersection, updateRect, &objectAndValues.drawnRect_))
+        {
+            continue; // Nothing to draw or erase within the update rect.
+        }
+
+        objectAndValues.drawnRect_ = drawnRect;
+        objectAndValues.drawnCookie_ = objectAndValues.GetCombinedCookie();
+        if (!IsRectEmpty(&drawnRect)
+        &&  (!cullToCanvas || IntersectRect(OUT &intersection, &canvasRect, &drawnRect)))
+        {
+            drawableObjectIndices.push_back(objectIndex);
+        }
+    }
+
+    ////////////////////
+    // Draw background colors and objects.
+
+    HRESULT hr = S_FALSE;
+    if (drawFlags & (DrawFlagsParallel | DrawFlagsCachePixels))
+    {
+        hr = DrawObjectsInTiles(drawableObjects, drawableObjectIndices, drawingCanvas, canvasTransform, drawFlags, labelFont);
+    }
+
+    if (hr != S_OK)
+    {
+        ComPtr<DrawingCanvas> spareDrawingCanvas;
+
+        // Consecutive D2D objects share one BeginDraw/EndDraw, ending only
+        // when an object drawn with another API comes next.
+        drawingCanvas.BeginD2DBatch();
+        for (uint32_t objectIndex : drawableObjectIndices)
+        {
+            DrawObject(drawableObjects[objectIndex], drawingCanvas, IN OUT spareDrawingCanvas, canvasTransform, labelFont);
+        }
+        drawingCanvas.EndD2DBatch();
+    }
+
+    ////////////////////
+    // Draw labels.
+
+    // All the labels go in one PolyTextOut, with the font and colors set just
+    // once, since on dense sheets the per label DrawText calls and state
+    // changes costed more than the text itself.
+    drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiGdi);
+    SetWorldTransform(hdc, &canvasTransform.gdi);
+    HFONT previousFont = SelectFont(hdc, labelFont);
+    TEXTMETRIC textMetrics = {};
+    GetTextMetrics(hdc, OUT &textMetrics);
+
+    std::vector<POLYTEXTW> labelTexts;
+    for (uint32_t objectIndex : drawableObjectIndices)
+    {
+        auto const& objectAndValues = drawableObjects[objectIndex];
+        RECT const& labelRect = objectAndValues.labelRect_;
+        LONG lineY = labelRect.top;
+
+        for (auto const& labelLine : objectAndValues.labelLines_)
+        {
+            if (labelLine.textLength > 0)
+            {
+                POLYTEXTW labelText = {};
+                labelText.x = labelRect.left;
+                labelText.y = lineY;
+                labelText.n = labelLine.textLength;
+                labelText.lpstr = ToWChar(objectAndValues.label_.data()) + labelLine.textOffset;
+                labelText.rcl = labelRect;
+                labelTexts.push_back(labelText);
+            }
+            lineY += textMetrics.tmHeight;
+        }
+    }
+
+    if (!labelTexts.empty())
+    {
+        SetTextColor(hdc, s_defaultLabelTextColor);
+        SetBkMode(hdc, TRANSPARENT);
+        UINT const previousTextAlign = SetTextAlign(hdc, TA_LEFT | TA_TOP | TA_NOUPDATECP);
+        PolyTextOutW(hdc, labelTexts.data(), int(labelTexts.size()));
+        SetTextAlign(hdc, previousTextAlign);
+    }
+    SelectFont(hdc, previousFont);
+    SetWorldTransform(hdc, &DrawableObject::identityTransform.gdi);
+    drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+}
+
+
+uint32_t DrawableObjectAndValues::GetTimingsGeneration() noexcept
+{
+    return g_timingsGeneration;
+}
+
+
+bool DrawableObjectAndValues::GetInvalidatedRect(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    DX_MATRIX_3X2F const& canvasTransform,
+    _Out_ RECT& invalidatedRect
+    )
+{
+    ZeroStructure(invalidatedRect);
+
+    for (auto& objectAndValues : drawableObjects)
+    {
+        RECT drawnRect = {};
+        if (objectAndValues.IsVisible())
+        {
+            objectAndValues.GetDrawnRect(canvasTransform, OUT drawnRect);
+        }
+
+        // Both where the object was and where it is now need repainting, if
+        // it moved, changed, or was hidden since last drawn.
+        if (objectAndValues.drawnCookie_ != objectAndValues.GetCombinedCookie()
+        ||  !EqualRect(&objectAndValues.drawnRect_, &drawnRect))
+        {
+            UnionRect(OUT &invalidatedRect, &invalidatedRect, &objectAndValues.drawnRect_);
+            UnionRect(OUT &invalidatedRect, &invalidatedRect, &drawnRect);
+        }
+    }
+
+    return !IsRectEmpty(&invalidatedRect);
+}
+
+
+void DrawableObjectAndValues::ExpandInvalidatedRect(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    DX_MATRIX_3X2F const& canvasTransform,
+    _Inout_ RECT& invalidatedRect
+    )
+{
+    // Objects are redrawn whole, since drawing over the partially cleared
+    // remains of one would double up antialiased edges. So expand the rect
+    // until it contains every object it touches, which may then touch more.
+    bool expanded;
+    do
+    {
+        expanded = false;
+        for (auto& objectAndValues : drawableObjects)
+        {
+            if (!objectAndValues.IsVisible())
+                continue;
+
+            RECT drawnRect, intersection, unionRect;
+            objectAndValues.GetDrawnRect(canvasTransform, OUT drawnRect);
+            if (IntersectRect(OUT &intersection, &invalidatedRect, &drawnRect))
+            {
+                UnionRect(OUT &unionRect, &invalidatedRect, &drawnRect);
+                if (!EqualRect(&unionRect, &invalidatedRect))
+                {
+                    invalidatedRect = unionRect;
+                    expanded = true;
+                }
+            }
+        }
+    } while (expanded);
+}
+
+
+void DrawableObjectAndValues::Arrange(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    _Inout_opt_ SpatialIndex* spatialIndex
+    )
+{
+    TRACE_LOGGING_ACTIVITY(activity, "ArrangeObjects", TraceLoggingUInt32(static_cast<uint32_t>(drawableObjects.size()), "ObjectCount"));
+
+    size_t const totalDrawableObjects = drawableObjects.size();
+
+    float y = 0;
+    float defaultPadding = 8;
+    float previousPadding = defaultPadding;
+
+    ComPtr<SharedGdiFont> fontReference;
+    HFONT font = GetLabelFont(drawingCanvas, OUT fontReference);
+    HDC hdc = drawingCanvas.GetHDC();
+    LONG widestLabelWidth = 0;
+    float leftmostBounds = 0, rightmostBounds = 0;
+
+    ////////////////////
+    // First pass is just to get the sizes of the label and object.
+
+    for (size_t drawableObjectIndex = 0; drawableObjectIndex < drawableObjects.size(); ++drawableObjectIndex)
+    {
+        auto& objectAndValues = drawableObjects[drawableObjectIndex];
+        if (!objectAndValues.IsVisible())
+            continue;
+
+        // Reuse the last measurements if nothing has changed since, which
+        // spares the full text layout of each untouched object.
+        auto& arrangedBounds = objectAndValues.arrangedBounds_;
+        uint32_t const cookie = objectAndValues.GetCombinedCookie();
+        if (arrangedBounds.cookie != cookie)
+        {
+            // Failures are measured again next time, in case they were transient.
+            HRESULT hr = MeasureObject(objectAndValues, drawingCanvas, hdc, font);
+            arrangedBounds.cookie = SUCCEEDED(hr) ? cookie : ~0u;
+        }
+
+        ZeroStructure(objectAndValues.labelRect_);
+        objectAndValues.labelRect_.right = arrangedBounds.labelSize.cx;
+        objectAndValues.labelRect_.bottom = arrangedBounds.labelSize.cy;
+        objectAndValues.objectRect_ = arrangedBounds.objectRect;
+        widestLabelWidth = std::max(widestLabelWidth, arrangedBounds.labelSize.cx);
+
+        // Record largest accumulated bounds for left and right edges so far of all objects.
+        leftmostBounds  = std::min(leftmostBounds,  arrangedBounds.objectRect.left);
+        rightmostBounds = std::max(rightmostBounds, arrangedBounds.objectRect.right);
+    }
+
+    leftmostBounds  = floor(leftmostBounds);
+    rightmostBounds = floor(rightmostBounds);
+
+    ////////////////////
+    // Second pass sets the positions for the label and object.
+
+    for (size_t drawableObjectIndex = 0; drawableObjectIndex < drawableObjects.size(); ++drawableObjectIndex)
+    {
+        auto& objectAndValues = drawableObjects[drawableObjectIndex];
+        if (!objectAndValues.IsVisible())
+            continue;
+
+        float x = defaultPadding;
+        float labelY = y;
+        float labelX = defaultPadding;
+
+        // Skip arrangement of any explicitly positioned objects.
+        if (objectAndValues.GetDrawValues().hasPosition)
+        {
+            labelX = objectAndValues.objectRect_.right + defaultPadding;
+            labelY = objectAndValues.objectRect_.top;
+        }
+        else
+        {
+            // Move down, leaving some padding between the previous object.
+            float padding = objectAndValues.GetTypedValue<DrawableObjectAttributePadding>(defaultPadding);
             y = ceil(y + std::max(padding, previousPadding));
             previousPadding = padding;
             labelY = y;
@@ -402,11 +1033,149 @@ void DrawableObjectAndValues::Arrange(
         objectAndValues.labelRect_.top    += int(labelY);
         objectAndValues.labelRect_.bottom += int(labelY);
     }
+
+    if (spatialIndex != nullptr)
+    {
+        spatialIndex->Build(drawableObjects);
+    }
+}
+
+
+namespace
+{
+    // Look up names by view straight from the tree, rather than copying each key.
+    using AttributeNameMap = std::unordered_map<std::u16string_view, uint32_t>;
+
+    AttributeNameMap const& GetAttributeNameMap()
+    {
+        static AttributeNameMap const attributeNameMap = []()
+        {
+            AttributeNameMap map;
+            for (auto const& attribute : DrawableObject::attributeList)
+            {
+                map[attribute.name] = attribute.id;
+            }
+            return map;
+        }();
+        return attributeNameMap;
+    }
+}
+
+
+namespace
+{
+    // Values repeated by several objects, like one long sample text or font
+    // file path across part of a sheet, which the settings file stores just
+    // once in its "values" list for objects to reference by index (in their
+    // "valueIds"). Values common to all objects are already factored into the
+    // shared object, and short values would cost about as much as their id.
+    class RepeatedValueDictionary
+    {
+    public:
+        static constexpr size_t minimumValueLength = 32;
+
+        void Initialize(
+            array_ref<DrawableObjectAndValues> drawableObjects,
+            DrawableObjectAndValues const& sharedDrawableObject
+            );
+
+        // Returns the index of the value in the list, or ~0u if not listed.
+        uint32_t Find(SharedString const& value) const;
+
+        array_ref<SharedString const> GetValues() const noexcept { return values_; }
+
+    private:
+        // Views into the objects' own strings, valid while storing them.
+        std::unordered_map<std::u16string_view, uint32_t> indices_;
+        std::vector<SharedString> values_;
+    };
+
+
+    void RepeatedValueDictionary::Initialize(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        DrawableObjectAndValues const& sharedDrawableObject
+        )
+    {
+        // Count each distinct value, then list those seen more than once in
+        // the order first seen, so the file is stable across saves.
+        std::unordered_map<std::u16string_view, uint32_t> counts;
+        auto forEachCandidate = [&](auto&& callback)
+        {
+            for (auto const& drawableObject : drawableObjects)
+            {
+                for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+                {
+                    SharedString const& value = drawableObject.values_[attributeId].stringValue;
+                    if (value.size() >= minimumValueLength
+                    &&  sharedDrawableObject.values_[attributeId].stringValue != value)
+                    {
+                        callback(value);
+                    }
+                }
+            }
+        };
+
+        forEachCandidate([&](SharedString const& value) { ++counts[std::u16string_view(value.data(), value.size())]; });
+        forEachCandidate([&](SharedString const& value)
+        {
+            std::u16string_view view(value.data(), value.size());
+            if (counts[view] >= 2 && indices_.try_emplace(view, static_cast<uint32_t>(values_.size())).second)
+            {
+                values_.push_back(value);
+            }
+        });
+    }
+
+
+    uint32_t RepeatedValueDictionary::Find(SharedString const& value) const
+    {
+        if (value.size() < minimumValueLength)
+            return ~0u;
+
+        auto it = indices_.find(std::u16string_view(value.data(), value.size()));
+        return (it != indices_.end()) ? it->second : ~0u;
+    }
+
+
+    array_ref<char16_t const> FormatValueId(uint32_t valueId, _Out_ char16_t (&valueText)[12])
+    {
+        auto valueTextEnd = valueText + countof(valueText);
+        auto p = valueTextEnd;
+        do
+        {
+            --p;
+            *p = (valueId % 10) + '0';
+            valueId /= 10;
+        }
+        while (valueId > 0);
+
+        return {p, valueTextEnd};
+    }
+
+
+    // Returns ~0u if not a plain decimal number.
+    uint32_t ParseValueId(array_ref<char16_t const> valueText) noexcept
+    {
+        if (valueText.empty() || valueText.size() > 9)
+            return ~0u;
+
+        uint32_t valueId = 0;
+        for (char16_t ch : valueText)
+        {
+            if (ch < '0' || ch > '9')
+                return ~0u;
+            valueId = valueId * 10 + (ch - '0');
+        }
+        return valueId;
+    }
+
+    char16_t const g_valueIdsKeyName[] = u"valueIds";
 }
 
 
 void DrawableObjectAndValues::Load(
     TextTree::NodePointer objectsNode,
+    array_ref<SharedString const> sharedValues,
     _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
     )
 {
@@ -414,48 +1183,68 @@ void DrawableObjectAndValues::Load(
     bool isFirstObject = true;
 
     // The node points to the beginning of the objects list.
+    for (TextTree::NodePointer objectNode = objectsNode.begin(), objectNodeEnd = objectsNode.end(); objectNode != objectNodeEnd; ++objectNode)
+    {
+        LoadObject(objectNode, isFirstObject, IN OUT sharedDrawableObject, sharedValues, IN OUT drawableObjects);
+        isFirstObject = false;
+    }
+}
 
-    std::map<std::u16string, uint32_t> attributeNameMap;
-    for (auto const& attribute : DrawableObject::attributeList)
+
+void DrawableObjectAndValues::LoadObject(
+    TextTree::NodePointer objectNode,
+    bool isSharedObject,
+    _Inout_ DrawableObjectAndValues& sharedDrawableObject,
+    array_ref<SharedString const> sharedValues,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+    )
+{
+    // The very first object definition in the file is actually a shared object that factors
+    // out all common attributes between objects (to avoid repeating them every time in each
+    // object that uses them). So if reading the first object, just update the shared object,
+    // otherwise the first real drawable object is the second object in the file.
+    if (!isSharedObject)
     {
-        attributeNameMap[attribute.name] = attribute.id;
+        drawableObjects.push_back(sharedDrawableObject);
     }
-    auto attributeNameMapEnd = attributeNameMap.end();
+    DrawableObjectAndValues& drawableObject = isSharedObject ? sharedDrawableObject : drawableObjects.back();
 
-    size_t oldDrawableObjectsSize = drawableObjects.size();
+    AttributeNameMap const& attributeNameMap = GetAttributeNameMap();
+    auto attributeNameMapEnd = attributeNameMap.end();
+    std::u16string value; // Reused for each value's nul-terminated copy.
 
-    for (TextTree::NodePointer objectNode = objectsNode.begin(), objectNodeEnd = objectsNode.end(); objectNode != objectNodeEnd; ++objectNode)
+    // Read all key value pairs, setting new object properties.
+    for (TextTree::NodePointer node = objectNode.begin(), nodeEnd = objectNode.end(); node != nodeEnd; ++node)
     {
-        // The very first object definition in the file is actually a shared object that factors
-        // out all common attributes between objects (to avoid repeating them every time in each
-        // object that uses them). So if reading the first object, just update the shared object,
-        // otherwise the first real drawable object is the second object in the file.
-        if (!isFirstObject)
+        array_ref<char16_t const> text = node.GetTextView();
+
+        std::u16string_view name(text.data(), text.size());
+        auto nameMapResult = attributeNameMap.find(name);
+        if (nameMapResult != attributeNameMapEnd)
         {
-            drawableObjects.push_back(sharedDrawableObject);
+            array_ref<char16_t const> valueText = node.GetSubvalueView();
+            value.assign(valueText.data(), valueText.size());
+            auto id = DrawableObjectAttribute(nameMapResult->second);
+            drawableObject.Set(id, value.c_str());
         }
-        DrawableObjectAndValues& drawableObject = isFirstObject ? sharedDrawableObject : drawableObjects.back();
-        isFirstObject = false;
-
-        // Read all key value pairs, setting new object properties.
-        for (TextTree::NodePointer node = objectNode.begin(), nodeEnd = objectNode.end(); node != nodeEnd; ++node)
+        else if (name == g_valueIdsKeyName)
         {
-            std::u16string text = node.GetText();
-            std::u16string value = node.GetSubvalue();
-
-            auto nameMapResult = attributeNameMap.find(text);
-            if (nameMapResult != attributeNameMapEnd)
+            // Share the listed string rather than copying it into each object.
+            for (TextTree::NodePointer idNode = node.begin(), idNodeEnd = node.end(); idNode != idNodeEnd; ++idNode)
             {
-                auto id = DrawableObjectAttribute(nameMapResult->second);
-                drawableObject.Set(id, value.c_str());
+                array_ref<char16_t const> idName = idNode.GetTextView();
+                auto idNameMapResult = attributeNameMap.find(std::u16string_view(idName.data(), idName.size()));
+                uint32_t valueId = ParseValueId(idNode.GetSubvalueView());
+                if (idNameMapResult != attributeNameMapEnd && valueId < sharedValues.size())
+                {
+                    drawableObject.Set(DrawableObjectAttribute(idNameMapResult->second), sharedValues[valueId]);
+                }
             }
         }
     }
 
-    size_t newDrawableObjectsSize = drawableObjects.size();
-
-    // Update all the newly created objects, now that their attribute strings have been set.
-    for (auto& drawableObject : make_iterator_range(drawableObjects.data(), oldDrawableObjectsSize, newDrawableObjectsSize))
+    // Update the newly created object, now that its attribute strings have been set.
+    if (!isSharedObject)
     {
         drawableObject.Invalidate();
         drawableObject.Update();
@@ -474,9 +1263,10 @@ void DrawableObjectAndValues::Merge(
         if (newValue.stringValue.empty())
             continue;
 
+        // The values were already parsed by the same attribute, so share them.
         for (auto& drawableObject : drawableObjects)
         {
-            drawableObject.Set(DrawableObjectAttribute(attributeId), newValue.stringValue.c_str());
+            drawableObject.Set(DrawableObjectAttribute(attributeId), newValue);
         }
     }
 
@@ -488,115 +1278,469 @@ void DrawableObjectAndValues::Merge(
 }
 
 
-void StoreDrawableObject(
-    DrawableObjectAndValues const& drawableObject,
-    _In_opt_ DrawableObjectAndValues const* sharedDrawableObject,
-    TextTree::NodePointer objectNode
+// Returns whether to store the attribute, skipping empty strings and values
+// identical to the shared object.
+bool ShouldStoreDrawableObjectAttribute(
+    DrawableObjectAndValues const& drawableObject,
+    _In_opt_ DrawableObjectAndValues const* sharedDrawableObject,
+    uint32_t attributeId
+    )
+{
+    AttributeValue const& value = drawableObject.values_[attributeId];
+    if (value.stringValue.empty())
+        return false; // Don't store empty strings in the settings file.
+
+    if (sharedDrawableObject != nullptr
+    &&  sharedDrawableObject->values_[attributeId].stringValue == value.stringValue)
+    {
+        return false; // Skip this attribute since it's identical to the shared object.
+    }
+
+    return true;
+}
+
+
+void StoreDrawableObject(
+    DrawableObjectAndValues const& drawableObject,
+    _In_opt_ DrawableObjectAndValues const* sharedDrawableObject,
+    _In_opt_ RepeatedValueDictionary const* repeatedValues,
+    TextTree::NodePointer objectNode
+    )
+{
+    bool hasValueIds = false;
+
+    for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+    {
+        if (!ShouldStoreDrawableObjectAttribute(drawableObject, sharedDrawableObject, attributeId))
+            continue;
+
+        AttributeValue const& value = drawableObject.values_[attributeId];
+        if (repeatedValues != nullptr && repeatedValues->Find(value.stringValue) != ~0u)
+        {
+            hasValueIds = true;
+            continue; // Referenced by id below instead.
+        }
+
+        Attribute const& attribute = DrawableObject::attributeList[attributeId];
+        objectNode.SetKeyValue(
+            attribute.name,
+            value.stringValue.c_str(),
+            static_cast<uint32_t>(value.stringValue.size())
+            );
+    }
+
+    if (!hasValueIds)
+        return;
+
+    auto valueIdsNode = objectNode.AppendChild(TextTree::Node::TypeObject, g_valueIdsKeyName, uint32_t(countof(g_valueIdsKeyName) - 1));
+    for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+    {
+        if (!ShouldStoreDrawableObjectAttribute(drawableObject, sharedDrawableObject, attributeId))
+            continue;
+
+        uint32_t valueId = repeatedValues->Find(drawableObject.values_[attributeId].stringValue);
+        if (valueId == ~0u)
+            continue;
+
+        char16_t valueIdBuffer[12];
+        auto valueIdText = FormatValueId(valueId, OUT valueIdBuffer);
+        Attribute const& attribute = DrawableObject::attributeList[attributeId];
+        auto keyNode = valueIdsNode.AppendChild(TextTree::Node::TypeAttribute, attribute.name, TextTreeWriter::GetTextLength(attribute.name));
+        keyNode.AppendChild(TextTree::Node::TypeNumber, valueIdText.data(), static_cast<uint32_t>(valueIdText.size()));
+    }
+}
+
+
+HRESULT StoreDrawableObject(
+    DrawableObjectAndValues const& drawableObject,
+    _In_opt_ DrawableObjectAndValues const* sharedDrawableObject,
+    _In_opt_ RepeatedValueDictionary const* repeatedValues,
+    TextTreeWriter& writer
+    )
+{
+    // Write the same nodes TextTreeWriter::WriteNodes would for the tree.
+    IFR(writer.WriteNode(TextTree::Node::TypeObject, u"", 0));
+    IFR(writer.EnterNode());
+
+    bool hasValueIds = false;
+
+    for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+    {
+        if (!ShouldStoreDrawableObjectAttribute(drawableObject, sharedDrawableObject, attributeId))
+            continue;
+
+        AttributeValue const& value = drawableObject.values_[attributeId];
+        if (repeatedValues != nullptr && repeatedValues->Find(value.stringValue) != ~0u)
+        {
+            hasValueIds = true;
+            continue; // Referenced by id below instead.
+        }
+
+        Attribute const& attribute = DrawableObject::attributeList[attributeId];
+        IFR(writer.WriteNode(TextTree::Node::TypeAttribute, attribute.name, TextTreeWriter::GetTextLength(attribute.name)));
+        IFR(writer.EnterNode());
+        IFR(writer.WriteNode(TextTree::Node::TypeValue, value.stringValue.c_str(), static_cast<uint32_t>(value.stringValue.size())));
+        IFR(writer.ExitNode());
+    }
+
+    if (hasValueIds)
+    {
+        IFR(writer.WriteNode(TextTree::Node::TypeObject, g_valueIdsKeyName, uint32_t(countof(g_valueIdsKeyName) - 1)));
+        IFR(writer.EnterNode());
+        for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+        {
+            if (!ShouldStoreDrawableObjectAttribute(drawableObject, sharedDrawableObject, attributeId))
+                continue;
+
+            uint32_t valueId = repeatedValues->Find(drawableObject.values_[attributeId].stringValue);
+            if (valueId == ~0u)
+                continue;
+
+            char16_t valueIdBuffer[12];
+            auto valueIdText = FormatValueId(valueId, OUT valueIdBuffer);
+            Attribute const& attribute = DrawableObject::attributeList[attributeId];
+            IFR(writer.WriteNode(TextTree::Node::TypeAttribute, attribute.name, TextTreeWriter::GetTextLength(attribute.name)));
+            IFR(writer.EnterNode());
+            IFR(writer.WriteNode(TextTree::Node::TypeNumber, valueIdText.data(), static_cast<uint32_t>(valueIdText.size())));
+            IFR(writer.ExitNode());
+        }
+        IFR(writer.ExitNode());
+    }
+
+    return writer.ExitNode();
+}
+
+
+// Copy the values identical across all the objects onto the empty shared object.
+void GetSharedDrawableObject(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    _Inout_ DrawableObjectAndValues& sharedDrawableObject
+    )
+{
+    if (!drawableObjects.empty())
+    {
+        for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+        {
+            // Find all attributes that are shared between drawable objects.
+            // That way we can store them just once in the settings file.
+            // Values still sharing one string compare without reading it.
+            SharedString const* previousValueData = nullptr;
+            for (auto& drawableObject : drawableObjects)
+            {
+                SharedString const& valueData = drawableObject.values_[attributeId].stringValue;
+                if (previousValueData == nullptr)
+                {
+                    // Keep track if the first time.
+                    if (valueData.empty())
+                        break;
+                    previousValueData = &valueData;
+                }
+                // Compare to previous value.
+                else if (valueData != *previousValueData)
+                {
+                    previousValueData = nullptr; // Attribute values differ.
+                    break;
+                }
+            }
+
+            // If the attribute had an identical value between all drawable objects,
+            // copy it to the shared settings.
+            if (previousValueData != nullptr)
+            {
+                sharedDrawableObject.values_.GetForWrite(attributeId) = drawableObjects[0].values_[attributeId];
+            }
+        }
+    }
+}
+
+
+void DrawableObjectAndValues::Store(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    TextTree::NodePointer settingsNode
+    )
+{
+    DrawableObjectAndValues sharedDrawableObject;
+    GetSharedDrawableObject(drawableObjects, IN OUT sharedDrawableObject);
+
+    RepeatedValueDictionary repeatedValues;
+    repeatedValues.Initialize(drawableObjects, sharedDrawableObject);
+
+    // The values precede the objects, so loaders can resolve ids as each
+    // object is read.
+    if (!repeatedValues.GetValues().empty())
+    {
+        auto valuesNode = settingsNode.AppendChild(TextTree::Node::TypeArray, u"values", uint32_t(countof(u"values") - 1));
+        for (auto const& value : repeatedValues.GetValues())
+        {
+            valuesNode.AppendChild(TextTree::Node::TypeValue, value.c_str(), static_cast<uint32_t>(value.size()));
+        }
+    }
+
+    auto objectsNode = settingsNode.AppendChild(TextTree::Node::TypeArray, u"objects", uint32_t(countof(u"objects") - 1));
+    auto sharedObjectNode = objectsNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
+    StoreDrawableObject(sharedDrawableObject, nullptr, nullptr, sharedObjectNode);
+    for (auto const& drawableObject : drawableObjects)
+    {
+        auto node = objectsNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
+        StoreDrawableObject(drawableObject, &sharedDrawableObject, &repeatedValues, node);
+    }
+}
+
+
+HRESULT DrawableObjectAndValues::Store(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    TextTreeWriter& writer
+    )
+{
+    DrawableObjectAndValues sharedDrawableObject;
+    GetSharedDrawableObject(drawableObjects, IN OUT sharedDrawableObject);
+
+    RepeatedValueDictionary repeatedValues;
+    repeatedValues.Initialize(drawableObjects, sharedDrawableObject);
+
+    if (!repeatedValues.GetValues().empty())
+    {
+        IFR(writer.WriteNode(TextTree::Node::TypeArray, u"values", uint32_t(countof(u"values") - 1)));
+        IFR(writer.EnterNode());
+        for (auto const& value : repeatedValues.GetValues())
+        {
+            IFR(writer.WriteNode(TextTree::Node::TypeValue, value.c_str(), static_cast<uint32_t>(value.size())));
+        }
+        IFR(writer.ExitNode());
+    }
+
+    IFR(writer.WriteNode(TextTree::Node::TypeArray, u"objects", uint32_t(countof(u"objects") - 1)));
+    IFR(writer.EnterNode());
+    IFR(StoreDrawableObject(sharedDrawableObject, nullptr, nullptr, writer));
+    for (auto const& drawableObject : drawableObjects)
+    {
+        IFR(StoreDrawableObject(drawableObject, &sharedDrawableObject, &repeatedValues, writer));
+    }
+
+    return writer.ExitNode();
+}
+
+
+void DrawableObjectAndValues::Update()
+{
+    // Defer the drawable object until it is measured or drawn. Hidden objects
+    // release theirs, along with any fonts and layouts it had cached.
+    bool const isVisible = GetDrawValues().isVisible;
+    if (!isVisible)
+    {
+        drawableObject_.clear();
+    }
+    isDrawableObjectPending_ = isVisible;
+
+    // The label depends only on the attributes, so regenerate it just when
+    // they change.
+    uint32_t const cookie = GetCombinedCookie();
+    if (labelCookie_ != cookie)
+    {
+        DrawableObject::GenerateLabel(*this, IN OUT label_);
+        GetLabelLines(label_, OUT labelLines_);
+        labelCookie_ = cookie;
+    }
+    arrangedBounds_.cookie = ~0u; // The object may measure differently, even with the same attributes.
+}
+
+
+bool DrawableObjectAndValues::EnsureDrawableObject()
+{
+    if (isDrawableObjectPending_)
+    {
+        isDrawableObjectPending_ = false;
+        auto functionId = DrawableObjectFunction(GetTypedValue<DrawableObjectAttributeFunction>(DrawableObjectFunctionNop));
+        TRACE_LOGGING_ACTIVITY(activity, "UpdateObject", TraceLoggingUInt32(static_cast<uint32_t>(functionId), "Function"));
+
+        if (drawableObject_ == nullptr)
+        {
+            drawableObject_ = DrawableObject::Create(functionId);
+        }
+
+        if (drawableObject_ != nullptr)
+        {
+            ScopedTimingRecorder timingRecorder(OUT timings_.update);
+            drawableObject_->Update(*this);
+        }
+    }
+
+    return drawableObject_ != nullptr;
+}
+
+
+void DrawableObjectAndValues::Update(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    array_ref<uint32_t const> drawableObjectsIndices
+    )
+{
+    TRACE_LOGGING_ACTIVITY(activity, "UpdateObjects", TraceLoggingUInt32(static_cast<uint32_t>(drawableObjectsIndices.size()), "ObjectCount"));
+
+    size_t const totalDrawableObjects = drawableObjects.size();
+    for (uint32_t i : drawableObjectsIndices)
+    {
+        ThrowIf(i >= totalDrawableObjects, "Drawing object index is not consistent with internal array size!");
+        drawableObjects[i].Update();
+    }
+}
+
+
+DrawableObjectAndValues::Snapshot DrawableObjectAndValues::TakeSnapshot(array_ref<DrawableObjectAndValues> drawableObjects)
+{
+    // The cached pixels are not copied, since they may be megabytes.
+    return std::make_shared<std::vector<DrawableObjectAndValues>>(drawableObjects.begin(), drawableObjects.end());
+}
+
+
+uint32_t DrawableObjectAndValues::RestoreSnapshot(
+    Snapshot const& snapshot,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
     )
 {
-    for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+    if (snapshot == nullptr)
+        return 0;
+
+    drawableObjects.resize(snapshot->size());
+
+    uint32_t restoredCount = 0;
+    for (size_t i = 0, count = snapshot->size(); i < count; ++i)
     {
-        AttributeValue const& value = drawableObject.values_[attributeId];
-        if (value.stringValue.empty())
-            continue; // Don't store empty strings in the settings file.
+        auto const& snapshotObject = (*snapshot)[i];
+        auto& drawableObject = drawableObjects[i];
 
-        if (sharedDrawableObject != nullptr
-        &&  sharedDrawableObject->values_[attributeId].stringValue == value.stringValue)
+        // Nothing set since the snapshot (or since restoring it), so keep it
+        // as is, along with its measurements and cached pixels.
+        if (drawableObject.values_.IsSharedWith(snapshotObject.values_)
+        &&  drawableObject.drawableObject_ == snapshotObject.drawableObject_)
         {
-            continue; // Skip this attribute since it's identical to the shared object.
+            continue;
         }
 
-        Attribute const& attribute = DrawableObject::attributeList[attributeId];
-        objectNode.SetKeyValue(
-            attribute.name,
-            value.stringValue.c_str(),
-            static_cast<uint32_t>(value.stringValue.size())
-            );
+        // The drawable object may have cached resources for other values
+        // since, which its Update compares by cookie and rebuilds as needed.
+        // What was last drawn stays that of the live object though, so the
+        // next partial repaint still invalidates where it was drawn.
+        RECT const drawnRect = drawableObject.drawnRect_;
+        uint32_t const drawnCookie = drawableObject.drawnCookie_;
+        drawableObject = snapshotObject;
+        drawableObject.drawnRect_ = drawnRect;
+        drawableObject.drawnCookie_ = drawnCookie;
+        drawableObject.Update();
+        ++restoredCount;
     }
+
+    return restoredCount;
 }
 
 
-void DrawableObjectAndValues::Store(
+HRESULT DrawableObjectAndValues::MeasureContent(
     array_ref<DrawableObjectAndValues> drawableObjects,
-    TextTree::NodePointer objectsNode
+    array_ref<uint32_t const> drawableObjectsIndices,
+    DrawingCanvas& drawingCanvas,
+    _Out_ std::vector<D2D_RECT_F>& contentBounds
     )
 {
-    DrawableObjectAndValues sharedDrawableObject;
-    bool isFirstObject = true;
+    size_t const totalDrawableObjects = drawableObjects.size();
+    contentBounds.assign(drawableObjectsIndices.size(), DrawableObject::emptyRect);
 
-    if (!drawableObjects.empty())
+    // Objects unchanged since the last Arrange already have their content
+    // measured, which leaves only the changed ones needing any layout.
+    std::vector<uint32_t> unmeasuredIndices; // Positions within drawableObjectsIndices.
+    for (uint32_t i = 0, ci = uint32_t(drawableObjectsIndices.size()); i < ci; ++i)
     {
-        for (uint32_t attributeId = 0; attributeId < countof(DrawableObject::attributeList); ++attributeId)
+        uint32_t objectIndex = drawableObjectsIndices[i];
+        ThrowIf(objectIndex >= totalDrawableObjects, "Drawing object index is not consistent with internal array size!");
+
+        auto const& objectAndValues = drawableObjects[objectIndex];
+        if (objectAndValues.arrangedBounds_.cookie == objectAndValues.GetCombinedCookie())
         {
-            // Find all attributes that are shared between drawable objects.
-            // That way we can store them just once in the settings file.
-            array_ref<char16_t> previousValueData;
-            for (auto& drawableObject : drawableObjects)
+            contentBounds[i] = objectAndValues.arrangedBounds_.contentBounds;
+        }
+        else if (objectAndValues.EnsureDrawableObject())
+        {
+            unmeasuredIndices.push_back(i);
+        }
+    }
+
+    // Each worker takes the next unmeasured object. Objects own their formats
+    // and layouts, but their fonts and collections come from the canvas shared
+    // resources, which several workers may use at once. DWrite ones are thread
+    // safe, but GDI+ ones are not, so GDI and GDI+ objects measure one at a
+    // time (see IsGdiOrGdiPlusObject).
+    std::atomic<uint32_t> nextIndex(0);
+    std::mutex gdiObjectsLock;
+    auto measureObjects = [&](DrawingCanvas& canvas) -> void
+    {
+        for (uint32_t i; (i = nextIndex++) < unmeasuredIndices.size(); )
+        {
+            uint32_t const boundsIndex = unmeasuredIndices[i];
+            auto& objectAndValues = drawableObjects[drawableObjectsIndices[boundsIndex]];
+
+            std::unique_lock<std::mutex> gdiObjectLock(gdiObjectsLock, std::defer_lock);
+            if (IsGdiOrGdiPlusObject(objectAndValues))
             {
-                array_ref<char16_t> valueData = drawableObject.values_[attributeId].stringValue;
-                if (previousValueData.empty())
-                {
-                    // Keep track if the first time.
-                    if (valueData.empty())
-                        break;
-                    previousValueData = valueData;
-                }
-                // Compare to previous value.
-                else if (valueData.size() != previousValueData.size()
-                      || memcmp(valueData.data(), previousValueData.data(), valueData.size_in_bytes()) != 0)
-                {
-                    previousValueData.clear(); // Attribute values differ.
-                    break;
-                }
+                gdiObjectLock.lock();
             }
 
-            // If the attribute had an identical value between all drawable objects,
-            // copy it to the shared settings.
-            if (!previousValueData.empty())
+            D2D_RECT_F layoutBounds;
+            ScopedTimingRecorder timingRecorder(OUT objectAndValues.timings_.bounds);
+            if (FAILED(objectAndValues.drawableObject_->GetBounds(objectAndValues, canvas, OUT layoutBounds, OUT contentBounds[boundsIndex])))
             {
-                sharedDrawableObject.values_[attributeId] = drawableObjects[0].values_[attributeId];
+                contentBounds[boundsIndex] = DrawableObject::emptyRect;
             }
         }
-    }
+    };
 
-    auto sharedObjectNode = objectsNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
-    StoreDrawableObject(sharedDrawableObject, nullptr, sharedObjectNode);
-    for (auto const& drawableObject : drawableObjects)
+    // GDI based objects need a device context per thread, so the workers
+    // measure on the tile canvases that parallel drawing uses.
+    uint32_t threadCount = std::min(uint32_t(std::thread::hardware_concurrency()), maximumDrawingThreads);
+    threadCount = std::min(threadCount, uint32_t(unmeasuredIndices.size()));
+    std::vector<ComPtr<DrawingCanvas>> tileCanvases;
+    if (threadCount <= 1 || FAILED(GetTileCanvases(drawingCanvas, threadCount, SIZE{1, 1}, OUT tileCanvases)))
     {
-        auto node = objectsNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
-        StoreDrawableObject(drawableObject, &sharedDrawableObject, node);
+        measureObjects(drawingCanvas);
+        return S_OK;
     }
+
+    RunWorkers(threadCount, [&](uint32_t workerIndex) { measureObjects(*tileCanvases[workerIndex].Get()); });
+
+    return S_OK;
 }
 
 
-void DrawableObjectAndValues::Update()
+namespace
 {
-    // Create the drawable object on demand.
-    if (drawableObject_ == nullptr)
+    // Return the string shared by all the given objects, or null if mixed.
+    // Objects sharing one buffer, as after any edit, compare without reading
+    // the text, so even megabyte texts across many objects check quickly.
+    SharedString const* GetCommonStringValue(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        array_ref<uint32_t> drawableObjectIndices,
+        uint32_t attributeIndex
+        )
     {
-        auto functionId = GetValue(DrawableObjectAttributeFunction, DrawableObjectFunctionNop);
-        drawableObject_ = DrawableObject::Create(functionId);
-    }
+        ThrowIf(attributeIndex >= countof(DrawableObject::attributeList), "attributeIndex is greater than attributeList.size()!");
 
-    DrawableObject::GenerateLabel(*this, IN OUT label_);
+        static SharedString const emptyString;
+        SharedString const* previousString = nullptr;
 
-    if (drawableObject_ != nullptr)
-    {
-        drawableObject_->Update(*this);
-    }
-}
+        for (auto drawableObjectIndex : drawableObjectIndices)
+        {
+            if (drawableObjectIndex >= drawableObjects.size())
+                continue;
 
+            SharedString const& currentString = drawableObjects[drawableObjectIndex].values_[attributeIndex].stringValue;
+            if (previousString == nullptr || previousString->empty())
+            {
+                previousString = &currentString;
+            }
+            else if (currentString != *previousString)
+            {
+                return nullptr;
+            }
+        }
 
-void DrawableObjectAndValues::Update(
-    array_ref<DrawableObjectAndValues> drawableObjects,
-    array_ref<uint32_t const> drawableObjectsIndices
-    )
-{
-    size_t const totalDrawableObjects = drawableObjects.size();
-    for (uint32_t i : drawableObjectsIndices)
-    {
-        ThrowIf(i >= totalDrawableObjects, "Drawing object index is not consistent with internal array size!");
-        drawableObjects[i].Update();
+        return (previousString != nullptr) ? previousString : &emptyString;
     }
 }
 
@@ -608,33 +1752,33 @@ char16_t const* DrawableObjectAndValues::GetStringValue(
     _In_z_ char16_t const* defaultStringIfMixedValues
     )
 {
-    ThrowIf(attributeIndex >= countof(DrawableObject::attributeList), "attributeIndex is greater than attributeList.size()!");
+    SharedString const* stringValue = GetCommonStringValue(drawableObjects, drawableObjectIndices, attributeIndex);
+    return (stringValue != nullptr) ? stringValue->c_str() : defaultStringIfMixedValues; // e.g. u"<mixed values>"
+}
 
-    array_ref<char16_t const> previousString;
-    char16_t const* stringValue = u"";
 
-    for (auto drawableObjectIndex : drawableObjectIndices)
-    {
-        if (drawableObjectIndex >= drawableObjects.size())
-            continue;
+SharedString DrawableObjectAndValues::GetSharedStringValue(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    array_ref<uint32_t> drawableObjectIndices,
+    uint32_t attributeIndex
+    )
+{
+    SharedString const* stringValue = GetCommonStringValue(drawableObjects, drawableObjectIndices, attributeIndex);
+    return (stringValue != nullptr) ? *stringValue : SharedString();
+}
 
-        auto const& drawableObject = drawableObjects[drawableObjectIndex];
-        auto const& objectValue = drawableObject.values_[attributeIndex];
-        array_ref<char16_t const> currentString = objectValue.stringValue;
-        if (previousString.empty())
-        {
-            previousString = currentString;
-            stringValue = currentString.data();
-        }
-        else if (currentString.size() != previousString.size()
-              || memcmp(currentString.data(), previousString.data(), currentString.size_in_bytes()) != 0)
-        {
-            stringValue = defaultStringIfMixedValues; // e.g. u"<mixed values>"
-            break;
-        }
-    }
 
-    return stringValue;
+void DrawableObjectAndValues::Set(
+    array_ref<DrawableObjectAndValues> drawableObjects,
+    array_ref<uint32_t const> drawableObjectsIndices,
+    uint32_t attributeIndex,
+    std::u16string const& newText
+    )
+{
+    if (drawableObjectsIndices.empty())
+        return;
+
+    Set(drawableObjects, drawableObjectsIndices, attributeIndex, SharedString(std::make_shared<std::u16string const>(newText)));
 }
 
 
@@ -642,7 +1786,7 @@ void DrawableObjectAndValues::Set(
     array_ref<DrawableObjectAndValues> drawableObjects,
     array_ref<uint32_t const> drawableObjectsIndices,
     uint32_t attributeIndex,
-    std::u16string const& newText
+    SharedString const& newText
     )
 {
     ThrowIf(attributeIndex >= countof(DrawableObject::attributeList), "attributeIndex is greater than attributeList.size()!");
@@ -654,7 +1798,7 @@ void DrawableObjectAndValues::Set(
     uint32_t const firstMatchingIndex = drawableObjectsIndices[0];
     ThrowIf(firstMatchingIndex >= totalDrawableObjects, "drawableObjectsIndices is greater than drawableObjects.size()!");
 
-    auto& firstObjectValue = drawableObjects[firstMatchingIndex].values_[attributeIndex];
+    auto& firstObjectValue = drawableObjects[firstMatchingIndex].values_.GetForWrite(attributeIndex);
 
     for (uint32_t i : drawableObjectsIndices)
     {
@@ -664,14 +1808,14 @@ void DrawableObjectAndValues::Set(
         if (i == firstMatchingIndex)
         {
             // If the first index, set the new text and cache the numeric values too.
-            firstObjectValue.Set(DrawableObject::attributeList[attributeIndex], newText.c_str());
+            firstObjectValue.Set(DrawableObject::attributeList[attributeIndex], newText);
         }
         else
         {
-            // Otherwise just copy what we already have.
-            auto& objectValue = drawableObjectAndValues.values_[attributeIndex];
-            objectValue = firstObjectValue;
+            // Otherwise just share what we already have, which copies no text.
+            drawableObjectAndValues.values_.GetForWrite(attributeIndex).SetShared(firstObjectValue);
         }
+        drawableObjectAndValues.areDrawValuesStale_ = true;
 
         // If the drawing function is being changed, then clear the old object.
         if (attributeIndex == DrawableObjectAttributeFunction)
@@ -682,17 +1826,29 @@ void DrawableObjectAndValues::Set(
 }
 
 
+DrawableObjectAndValues::DrawValues const& DrawableObjectAndValues::GetDrawValues() const
+{
+    if (areDrawValuesStale_)
+    {
+        drawValues_.isVisible   = GetTypedValue<DrawableObjectAttributeVisibility>(true);
+        drawValues_.hasPosition = HasTypedValue<DrawableObjectAttributePosition>();
+        drawValues_.position    = GetTypedValue<DrawableObjectAttributePosition>(D2D_POINT_2F{0,0});
+        drawValues_.pixelZoom   = GetTypedValue<DrawableObjectAttributePixelZoom>(0);
+        drawValues_.pixelGridColor = GetTypedValue<DrawableObjectAttributePixelGridColor>(0);
+        drawValues_.layoutColor = GetTypedValue<DrawableObjectAttributeLayoutColor>(DrawableObject::defaultLayoutColor);
+        drawValues_.backColor   = GetTypedValue<DrawableObjectAttributeBackColor>(DrawableObject::defaultBackColor);
+        areDrawValuesStale_ = false;
+    }
+    return drawValues_;
+}
+
+
 bool DrawableObjectAndValues::IsVisible() const
 {
-    if (drawableObject_ == nullptr)
+    if (drawableObject_ == nullptr && !isDrawableObjectPending_)
         return false;
 
-    auto& mutableThis = const_cast<DrawableObjectAndValues&>(*this);
-    array_ref<uint8_t> data = mutableThis.values_[DrawableObjectAttributeVisibility].Get();
-    if (data.empty())
-        return true;
-    
-    return data[0] != 0;
+    return GetDrawValues().isVisible;
 }
 
 
@@ -700,9 +1856,13 @@ HRESULT DrawableObjectAndValues::Set(DrawableObjectAttribute attributeIndex, _In
 {
     // Set a single attribute's value, parsing the string according to attribute data type.
 
-    static_assert(_countof(DrawableObjectAndValues::values_) == countof(DrawableObject::attributeList), "Attribute and value arrays differ in size.");
-    if (attributeIndex >= countof(values_))
-        E_INVALIDARG;
+    static_assert(DrawableObjectAttributeTotal <= SparseAttributeValues::maximumCount, "Too many attributes for the sparse values.");
+    if (attributeIndex >= DrawableObjectAttributeTotal)
+        return E_INVALIDARG;
+
+    // Clearing a value never set has nothing to store.
+    if (stringValue[0] == '\0' && !values_.IsPresent(attributeIndex))
+        return S_OK;
 
     // If the drawing function is being changed, then clear the old object.
     if (attributeIndex == DrawableObjectAttributeFunction)
@@ -710,7 +1870,45 @@ HRESULT DrawableObjectAndValues::Set(DrawableObjectAttribute attributeIndex, _In
         drawableObject_.clear();
     }
 
-    return values_[attributeIndex].Set(DrawableObject::attributeList[attributeIndex], stringValue);
+    areDrawValuesStale_ = true;
+    return values_.GetForWrite(attributeIndex).Set(DrawableObject::attributeList[attributeIndex], stringValue);
+}
+
+
+HRESULT DrawableObjectAndValues::Set(DrawableObjectAttribute attributeIndex, SharedString const& stringValue)
+{
+    if (attributeIndex >= DrawableObjectAttributeTotal)
+        return E_INVALIDARG;
+
+    if (stringValue.empty() && !values_.IsPresent(attributeIndex))
+        return S_OK;
+
+    if (attributeIndex == DrawableObjectAttributeFunction)
+    {
+        drawableObject_.clear();
+    }
+
+    areDrawValuesStale_ = true;
+    return values_.GetForWrite(attributeIndex).Set(DrawableObject::attributeList[attributeIndex], stringValue);
+}
+
+
+HRESULT DrawableObjectAndValues::Set(DrawableObjectAttribute attributeIndex, AttributeValue const& value)
+{
+    if (attributeIndex >= DrawableObjectAttributeTotal)
+        return E_INVALIDARG;
+
+    if (value.stringValue.empty() && !values_.IsPresent(attributeIndex))
+        return S_OK;
+
+    if (attributeIndex == DrawableObjectAttributeFunction)
+    {
+        drawableObject_.clear();
+    }
+
+    areDrawValuesStale_ = true;
+    values_.GetForWrite(attributeIndex).SetShared(value);
+    return S_OK;
 }
 
 
@@ -725,6 +1923,82 @@ HRESULT DrawableObjectAndValues::Set(DrawableObjectAttribute attributeIndex, _In
 void DrawableObjectAndValues::Invalidate()
 {
     drawableObject_.clear();
+    isDrawableObjectPending_ = false;
+    arrangedBounds_.cookie = ~0u;
+}
+
+
+namespace
+{
+    size_t GetStringValueByteSize(AttributeValue const& value) noexcept
+    {
+        return value.stringValue.empty() ? 0 : (value.stringValue.size() + 1) * sizeof(char16_t);
+    }
+
+    size_t GetDataArrayByteSize(AttributeValue const& value) noexcept
+    {
+        return (value.dataArray == nullptr) ? 0 : value.dataArray->capacity();
+    }
+}
+
+
+DrawableObjectAndValues::MemoryUsage DrawableObjectAndValues::GetMemoryUsage() const
+{
+    MemoryUsage usage;
+    if (drawableObject_ != nullptr)
+    {
+        usage.drawableObject = drawableObject_->GetCachedByteSize();
+    }
+    usage.cachedPixels = cachedPixels_.pixels.capacity() * sizeof(uint32_t);
+
+    auto presentValues = values_.GetPresentValues();
+    usage.values = presentValues.size() * sizeof(AttributeValue);
+    for (auto const& value : presentValues)
+    {
+        usage.values += GetStringValueByteSize(value) + GetDataArrayByteSize(value);
+    }
+    return usage;
+}
+
+
+size_t DrawableObjectAndValues::GetValuesByteSize(array_ref<DrawableObjectAndValues const> drawableObjects)
+{
+    // Count each string and data array buffer once, however many objects
+    // share it, identifying them by address.
+    std::vector<std::pair<void const*, size_t>> buffers;
+    size_t byteSize = 0;
+    for (auto const& drawableObject : drawableObjects)
+    {
+        auto presentValues = drawableObject.values_.GetPresentValues();
+        byteSize += presentValues.size() * sizeof(AttributeValue);
+        for (auto const& value : presentValues)
+        {
+            if (!value.stringValue.empty())
+                buffers.push_back({value.stringValue.c_str(), GetStringValueByteSize(value)});
+            if (value.dataArray != nullptr)
+                buffers.push_back({value.dataArray.get(), GetDataArrayByteSize(value)});
+        }
+    }
+
+    std::sort(buffers.begin(), buffers.end());
+    buffers.erase(std::unique(buffers.begin(), buffers.end()), buffers.end());
+    for (auto const& buffer : buffers)
+    {
+        byteSize += buffer.second;
+    }
+    return byteSize;
+}
+
+
+void DrawableObjectAndValues::ReleaseCaches()
+{
+    if (drawableObject_ != nullptr)
+    {
+        drawableObject_.clear();
+        isDrawableObjectPending_ = true;
+    }
+    cachedPixels_.Clear();
+    cachedPixels_.pixels.shrink_to_fit(); // Clear keeps the capacity for the next store.
 }
 
 
@@ -738,14 +2012,195 @@ bool DrawableObjectAndValues::IsPointInside(float x, float y) const
 }
 
 
+void DrawableObjectAndValues::SpatialIndex::Clear()
+{
+    bounds_ = {};
+    columnCount_ = 0;
+    rowCount_ = 0;
+    cellOffsets_.clear();
+    cellObjectIndices_.clear();
+}
+
+
+void DrawableObjectAndValues::SpatialIndex::Build(array_ref<DrawableObjectAndValues const> drawableObjects)
+{
+    Clear();
+
+    // Gather the hit-testable rect of each visible object, as in IsPointInside.
+    std::vector<std::pair<uint32_t, D2D_RECT_F>> objectRects;
+    for (uint32_t objectIndex = 0, objectCount = uint32_t(drawableObjects.size()); objectIndex < objectCount; ++objectIndex)
+    {
+        auto const& objectAndValues = drawableObjects[objectIndex];
+        if (!objectAndValues.IsVisible())
+            continue;
+
+        D2D_RECT_F unionRect = objectAndValues.objectRect_;
+        D2D_RECT_F floatLabelRect;
+        ConvertRect(objectAndValues.labelRect_, OUT floatLabelRect);
+        UnionRect(floatLabelRect, IN OUT unionRect);
+        if (unionRect.left >= unionRect.right || unionRect.top >= unionRect.bottom)
+            continue;
+
+        if (objectRects.empty())
+            bounds_ = unionRect;
+        else
+            UnionRect(unionRect, IN OUT bounds_);
+        objectRects.push_back({objectIndex, unionRect});
+    }
+    if (objectRects.empty())
+        return;
+
+    // Aim for about one cell per object, which keeps the cells few enough to
+    // build quickly yet small enough that each holds only a few objects.
+    float const width = bounds_.right - bounds_.left;
+    float const height = bounds_.bottom - bounds_.top;
+    cellSize_ = std::max(sqrt(width * height / float(objectRects.size())), 1.0f);
+    columnCount_ = std::max(uint32_t(ceil(width / cellSize_)), 1u);
+    rowCount_ = std::max(uint32_t(ceil(height / cellSize_)), 1u);
+
+    auto forEachCell = [&](D2D_RECT_F const& rect, auto&& function)
+    {
+        uint32_t const left   = std::min(uint32_t((rect.left   - bounds_.left) / cellSize_), columnCount_ - 1);
+        uint32_t const right  = std::min(uint32_t((rect.right  - bounds_.left) / cellSize_), columnCount_ - 1);
+        uint32_t const top    = std::min(uint32_t((rect.top    - bounds_.top)  / cellSize_), rowCount_ - 1);
+        uint32_t const bottom = std::min(uint32_t((rect.bottom - bounds_.top)  / cellSize_), rowCount_ - 1);
+        for (uint32_t row = top; row <= bottom; ++row)
+        {
+            for (uint32_t column = left; column <= right; ++column)
+            {
+                function(row * columnCount_ + column);
+            }
+        }
+    };
+
+    // Count each cell's objects, then fill the cells in object order so each
+    // cell's run stays in ascending index order.
+    cellOffsets_.assign(size_t(columnCount_) * rowCount_ + 1, 0);
+    for (auto const& objectRect : objectRects)
+    {
+        forEachCell(objectRect.second, [&](uint32_t cellIndex) { ++cellOffsets_[cellIndex + 1]; });
+    }
+    for (size_t i = 1; i < cellOffsets_.size(); ++i)
+    {
+        cellOffsets_[i] += cellOffsets_[i - 1];
+    }
+
+    cellObjectIndices_.resize(cellOffsets_.back());
+    std::vector<uint32_t> cellFills(cellOffsets_.begin(), cellOffsets_.end() - 1);
+    for (auto const& objectRect : objectRects)
+    {
+        forEachCell(objectRect.second, [&](uint32_t cellIndex) { cellObjectIndices_[cellFills[cellIndex]++] = objectRect.first; });
+    }
+}
+
+
+uint32_t DrawableObjectAndValues::SpatialIndex::HitTest(array_ref<DrawableObjectAndValues const> drawableObjects, float x, float y) const
+{
+    if (cellOffsets_.empty() || !IsPointInRect(bounds_, x, y))
+        return ~0u;
+
+    uint32_t const column = std::min(uint32_t((x - bounds_.left) / cellSize_), columnCount_ - 1);
+    uint32_t const row = std::min(uint32_t((y - bounds_.top) / cellSize_), rowCount_ - 1);
+    uint32_t const cellIndex = row * columnCount_ + column;
+
+    // The objects may have changed since the last Arrange, so check each again.
+    for (uint32_t i = cellOffsets_[cellIndex], end = cellOffsets_[cellIndex + 1]; i < end; ++i)
+    {
+        uint32_t objectIndex = cellObjectIndices_[i];
+        if (objectIndex < drawableObjects.size() && drawableObjects[objectIndex].IsPointInside(x, y))
+            return objectIndex;
+    }
+    return ~0u;
+}
+
+
+bool DrawableObjectAndValues::CachedPixels::IsCurrent(uint32_t currentCookie, uint32_t currentWidth, uint32_t currentHeight) const
+{
+    return !pixels.empty()
+        && cookie == currentCookie
+        && width == currentWidth
+        && height == currentHeight;
+}
+
+
+void DrawableObjectAndValues::CachedPixels::Store(DrawingCanvas::RawPixels const& sourcePixels, uint32_t newCookie, uint32_t newWidth, uint32_t newHeight)
+{
+    Clear();
+    if (sourcePixels.bitsPerPixel != 32
+    ||  newWidth > sourcePixels.width
+    ||  newHeight > sourcePixels.height
+    ||  size_t(newWidth) * newHeight > maximumPixelCount)
+    {
+        return; // Too large to be worth keeping, or the source is unexpected.
+    }
+
+    pixels.resize(size_t(newWidth) * newHeight);
+    auto* sourceRow = reinterpret_cast<uint32_t const*>(sourcePixels.pixels);
+    for (uint32_t y = 0; y < newHeight; ++y)
+    {
+        memcpy(&pixels[size_t(y) * newWidth], sourceRow, newWidth * sizeof(uint32_t));
+        sourceRow = PtrAddByteOffset(sourceRow, sourcePixels.byteStride);
+    }
+
+    cookie = newCookie;
+    width = newWidth;
+    height = newHeight;
+}
+
+
+void DrawableObjectAndValues::CachedPixels::Clear()
+{
+    pixels.clear();
+    cookie = ~0u;
+    width = 0;
+    height = 0;
+}
+
+
+DrawingCanvas::RawPixels DrawableObjectAndValues::CachedPixels::GetRawPixels()
+{
+    return DrawingCanvas::RawPixels{pixels.data(), width, height, 32, width * sizeof(uint32_t)};
+}
+
+
+void DrawableObjectAndValues::GetDrawnRect(DX_MATRIX_3X2F const& canvasTransform, _Out_ RECT& drawnRect) const
+{
+    D2D_RECT_F unionRect = objectRect_;
+    D2D_RECT_F floatLabelRect;
+    ConvertRect(labelRect_, OUT floatLabelRect);
+    UnionRect(floatLabelRect, IN OUT unionRect);
+
+    // Inflate a little for antialiasing which spills past the edges.
+    D2D_RECT_F transformedRect;
+    TransformRect(canvasTransform.d2d, unionRect, OUT transformedRect);
+    ConvertRect(transformedRect, OUT drawnRect);
+    InflateRect(&drawnRect, drawnRectOverhang, drawnRectOverhang);
+}
+
+
+uint32_t DrawableObjectAndValues::GetCombinedCookie() const
+{
+    // Every Set increments its attribute's cookie, so the sum changes
+    // whenever any value changes.
+    uint32_t combinedCookie = 0;
+    for (auto const& value : values_.GetPresentValues())
+    {
+        combinedCookie += value.cookieValue;
+    }
+    return combinedCookie;
+}
+
+
 HRESULT DrawableObjectAndValues::GetString(uint32_t id, _Out_ array_ref<char16_t>& value)
 {
     value.clear();
 
-    if (id >= countof(values_))
+    if (id >= DrawableObjectAttributeTotal)
         E_INVALIDARG;
 
-    value = values_[id].stringValue;
+    // The string is shared by other values, so callers must only read it.
+    auto const& stringValue = values_[id].stringValue;
+    value.reset(const_cast<char16_t*>(stringValue.data()), stringValue.size());
 
     return S_OK;
 }
@@ -760,10 +2215,10 @@ HRESULT DrawableObjectAndValues::GetValueData(uint32_t id, _Out_ Attribute::Type
 
     value.clear();
 
-    if (id >= countof(values_))
+    if (id >= DrawableObjectAttributeTotal)
         E_INVALIDARG;
 
-    auto& v = values_[id];
+    auto const& v = values_[id];
     type = v.data.type;
     value = v.Get();
 
@@ -775,7 +2230,7 @@ HRESULT DrawableObjectAndValues::GetCookie(uint32_t id, _Inout_ uint32_t& cookie
 {
     cookieValue = 0;
 
-    if (id >= countof(values_))
+    if (id >= DrawableObjectAttributeTotal)
         E_INVALIDARG;
 
     cookieValue = values_[id].cookieValue;
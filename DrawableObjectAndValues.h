@@ -31,19 +31,158 @@ import TextTreeParser;
 //interface AttributeSource;
 //class DrawableObject; // causes - fatal error C1001: An internal error has occurred in the compiler.
 
+
+// Compile time mapping of attributes to their value types, which must match
+// the types in DrawableObject::attributeList. Only the attributes read while
+// arranging and drawing are mapped. Add more as needed.
+template <DrawableObjectAttribute id>
+struct DrawableObjectAttributeType;
+
+#define DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(id, valueType, attributeTypeValue) \
+    template <> struct DrawableObjectAttributeType<id> \
+    { \
+        using Type = valueType; \
+        static constexpr Attribute::Type attributeType = attributeTypeValue; \
+    };
+
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributeFunction,    uint32_t,     Attribute::TypeUInteger32)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributeVisibility,  bool,         Attribute::TypeBool8)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributePadding,     float,        Attribute::TypeFloat32)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributePosition,    D2D_POINT_2F, Attribute::TypeArrayFloat32)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributePixelZoom,   uint32_t,     Attribute::TypeUInteger32)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributePixelGridColor, uint32_t,   Attribute::TypeUInteger32)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributeBackColor,   uint32_t,     Attribute::TypeUInteger32)
+DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE(DrawableObjectAttributeLayoutColor, uint32_t,     Attribute::TypeUInteger32)
+
+#undef DEFINE_DRAWABLE_OBJECT_ATTRIBUTE_TYPE
+
 // Combination of the drawable object and its associated attribute values.
 struct DrawableObjectAndValues : public IAttributeSource
 {
+public:
+    // Copy of the object's last drawn pixels, for DrawFlagsCachePixels.
+    // Labels are not included, since they are cheap to redraw.
+    struct CachedPixels
+    {
+        std::vector<uint32_t> pixels;
+        uint32_t cookie = ~0u;  // Combined attribute cookie of the object when drawn.
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        // Largest object kept, so that huge objects don't hold tens of megabytes each.
+        static constexpr size_t maximumPixelCount = 2048 * 2048;
+
+        // Copies (undo snapshots, duplicated objects) start empty rather than
+        // duplicating the pixels, while moves keep them.
+        CachedPixels() = default;
+        CachedPixels(CachedPixels const&) noexcept {}
+        CachedPixels(CachedPixels&&) = default;
+        CachedPixels& operator=(CachedPixels const&) noexcept { Clear(); return *this; }
+        CachedPixels& operator=(CachedPixels&&) = default;
+
+        bool IsCurrent(uint32_t currentCookie, uint32_t currentWidth, uint32_t currentHeight) const;
+        void Store(DrawingCanvas::RawPixels const& sourcePixels, uint32_t newCookie, uint32_t newWidth, uint32_t newHeight);
+        void Clear();
+        DrawingCanvas::RawPixels GetRawPixels();
+    };
+
+    // Uniform grid over the arranged objects' rectangles (object and label, in
+    // world coordinates), so hit testing only visits the objects sharing the
+    // point's cell rather than every object. Arrange rebuilds it.
+    class SpatialIndex
+    {
+    public:
+        void Build(array_ref<DrawableObjectAndValues const> drawableObjects);
+        void Clear();
+
+        // Returns the lowest index of the visible object containing the point,
+        // or ~0u if none.
+        uint32_t HitTest(array_ref<DrawableObjectAndValues const> drawableObjects, float x, float y) const;
+
+    protected:
+        D2D_RECT_F bounds_ = {};
+        float cellSize_ = 1;
+        uint32_t columnCount_ = 0;
+        uint32_t rowCount_ = 0;
+        std::vector<uint32_t> cellOffsets_;         // Start of each cell's run in cellObjectIndices_, plus the final end.
+        std::vector<uint32_t> cellObjectIndices_;   // Ascending within each cell.
+    };
+
+    // Duration of the most recent call, in performance counter ticks.
+    struct Timing
+    {
+        int64_t totalTicks = 0;
+        int64_t cachedResourceTicks = 0; // Portion spent creating cached fonts, formats, and layouts.
+    };
+
+    struct Timings
+    {
+        Timing update;
+        Timing bounds;
+        Timing draw;
+    };
+
+    // Approximate memory held by the object, in bytes (see GetMemoryUsage).
+    struct MemoryUsage
+    {
+        size_t drawableObject = 0;  // Cached fonts, formats, layouts, and outlines.
+        size_t cachedPixels = 0;
+        size_t values = 0;          // Attribute strings and data arrays, which copies share.
+
+        size_t GetTotal() const noexcept { return drawableObject + cachedPixels + values; }
+    };
+
+    // Measurements from the first pass of the last Arrange, reused until the
+    // attributes change or the object is updated.
+    struct ArrangedBounds
+    {
+        uint32_t cookie = ~0u;      // Combined attribute cookie when measured, or ~0u if stale.
+        D2D_RECT_F objectRect = {}; // Object rect before being positioned on the sheet.
+        D2D_RECT_F contentBounds = {}; // From GetBounds, in layout space.
+        SIZE labelSize = {};
+    };
+
+    // Line of the label text, split once when the label is generated rather
+    // than by DrawText on every paint.
+    struct LabelLine
+    {
+        uint32_t textOffset;
+        uint32_t textLength;
+    };
+
+    // Values read for every object each draw, resolved once after changes
+    // into plain fields.
+    struct DrawValues
+    {
+        bool isVisible = true;
+        bool hasPosition = false;
+        D2D_POINT_2F position = {};
+        uint32_t pixelZoom = 0;
+        uint32_t pixelGridColor = 0;
+        uint32_t layoutColor = 0;
+        uint32_t backColor = 0;
+    };
+
 public:
     ComPtr<DrawableObject> drawableObject_;
-    AttributeValue values_[DrawableObjectAttributeTotal];
+    SparseAttributeValues values_; // Only the attributes ever set, the rest read as empty.
     std::u16string label_;
+    uint32_t labelCookie_ = ~0u;// Combined attribute cookie when the label was generated.
+    std::vector<LabelLine> labelLines_; // Empty if the label is blank, so nothing is drawn.
     RECT labelRect_;            // Label rectangle in post-transform canvas coordinates.
     D2D_RECT_F objectRect_;     // Object rectangle in post-transform canvas coordinates. Best rounded to whole pixel.
     D2D_RECT_F layoutBounds_;   // Extents of layout boundary, in pre-transform world coordinates.
     D2D_RECT_F contentBounds_;  // Actual content boundary, in pre-transform world coordinates.
     CachedTransform transform_; // Transform from world coordinates to 
     D2D_POINT_2F origin_;       // Offset from <0,0>. May be non-zero if rotation exists or content is larger than layout.
+    RECT drawnRect_ = {};       // Object and label rectangle in canvas pixels when last drawn. Empty if not drawn.
+    uint32_t drawnCookie_ = ~0u;// Combined attribute cookie when last drawn.
+    CachedPixels cachedPixels_;
+    Timings timings_;           // Cost of the drawable object's Update, GetBounds, and Draw.
+    ArrangedBounds arrangedBounds_;
+    mutable DrawValues drawValues_;
+    mutable bool areDrawValuesStale_ = true; // Any Set makes them stale.
+    bool isDrawableObjectPending_ = false; // Updated, but the drawable object waits for its first measure or draw.
 
 public:
     // IAttributeSource implementation.
@@ -56,34 +195,125 @@ public:
 
 public:
     //////////
+    // Read the parsed value directly, without the virtual GetValueData or
+    // runtime type dispatch. Returns the default if empty or unparseable.
+    template <DrawableObjectAttribute id>
+    typename DrawableObjectAttributeType<id>::Type GetTypedValue(typename DrawableObjectAttributeType<id>::Type defaultValue) const
+    {
+        using T = typename DrawableObjectAttributeType<id>::Type;
+        constexpr Attribute::Type attributeType = DrawableObjectAttributeType<id>::attributeType;
+
+        AttributeValue const& value = values_[id];
+        if (value.data.type != attributeType)
+            return defaultValue;
+
+        T typedValue;
+        if constexpr ((attributeType & Attribute::TypeArray) != 0)
+        {
+            if (value.dataArray == nullptr || value.dataArray->size() < sizeof(T))
+                return defaultValue;
+            memcpy(&typedValue, value.dataArray->data(), sizeof(T));
+        }
+        else
+        {
+            static_assert(sizeof(T) <= sizeof(value.data.buffer), "Type is too large for the variant.");
+            memcpy(&typedValue, &value.data.buffer[0], sizeof(T));
+        }
+        return typedValue;
+    }
+
+    template <DrawableObjectAttribute id>
+    bool HasTypedValue() const
+    {
+        constexpr Attribute::Type attributeType = DrawableObjectAttributeType<id>::attributeType;
+        AttributeValue const& value = values_[id];
+        if (value.data.type != attributeType)
+            return false;
+
+        if constexpr ((attributeType & Attribute::TypeArray) != 0)
+        {
+            return value.dataArray != nullptr && value.dataArray->size() >= sizeof(typename DrawableObjectAttributeType<id>::Type);
+        }
+        return true;
+    }
+
+    // Get the values read while drawing, refreshing them if any were set
+    // since. Draw resolves them for every object before drawing in parallel,
+    // so the tile threads only ever read them.
+    DrawValues const& GetDrawValues() const;
+
     bool IsVisible() const;
 
     HRESULT Set(DrawableObjectAttribute attributeIndex, _In_z_ char16_t const* stringValue);
 
+    // Share the string (and parsed value) rather than copying, such as one long text across many objects.
+    HRESULT Set(DrawableObjectAttribute attributeIndex, SharedString const& stringValue);
+    HRESULT Set(DrawableObjectAttribute attributeIndex, AttributeValue const& value);
+
     HRESULT Set(DrawableObjectAttribute attributeIndex, _In_z_ uint32_t value);
 
     // Call after setting string values (not every single set call, but before Draw).
-    // This creates the drawableObject if not already created and forwards the call
-    // to the internal drawableObject::Update.
+    // This only refreshes the values needed to list and arrange the object.
+    // The drawableObject itself is created, and the call forwarded to the
+    // internal drawableObject::Update, on its first measure or draw (see
+    // EnsureDrawableObject), so hidden objects never create one.
     void Update();
 
+    // Create and update the drawable object if Update left it pending.
+    // Returns false if the object is not visible or could not be created.
+    bool EnsureDrawableObject();
+
     // Call when copying from an existing one.
     void Invalidate();
 
+    // Memory accounting for the object. The values count in full, even where
+    // other objects share the same buffers, so use GetValuesByteSize to total
+    // them across objects.
+    MemoryUsage GetMemoryUsage() const;
+    static size_t GetValuesByteSize(array_ref<DrawableObjectAndValues const> drawableObjects);
+
+    // Release the drawable object (with its caches) and the cached pixels.
+    // A visible object recreates them when next measured or drawn.
+    void ReleaseCaches();
+
     bool IsPointInside(float x, float y) const;
 
+    // Get the object and label rectangle in canvas pixels, after the view transform.
+    void GetDrawnRect(DX_MATRIX_3X2F const& canvasTransform, _Out_ RECT& drawnRect) const;
+
+    // Sum of all the attribute value cookies, which changes after any Set.
+    uint32_t GetCombinedCookie() const;
+
+    //////////
+    // Drawing options
+
+    enum DrawFlags : uint32_t
+    {
+        DrawFlagsNone = 0,
+        DrawFlagsParallel = 1, // Draw objects into tiles across multiple threads.
+        DrawFlagsCachePixels = 2, // Keep each object's drawn pixels to copy back until it changes.
+        DrawFlagsGlyphAtlas = 4, // Blend bitmap render target glyphs from cached coverage (see DrawingCanvas::SetGlyphAtlasEnabled).
+    };
+
+    // Upper limit on worker threads for DrawFlagsParallel, regardless of core count.
+    static constexpr uint32_t maximumDrawingThreads = 16;
+    static constexpr LONG drawnRectOverhang = 2; // Pixels antialiased ink may spill past the object rect.
+
     //////////
     // Static helpers
 
     // Arrange all the objects onto where they belong on the canvas.
     // This should be called at least once before Draw and then after
-    // attribute changes, which will affect where the objects fit.
+    // attribute changes, which will affect where the objects fit. Only
+    // objects changed or updated since the last call are measured again.
     // Hidden objects will be skipped, where DrawableObjectAttributeVisibility == false.
     // Objects with fixed positions will be drawn at their locations. Others
     // will use the padding and be laid out sequentially based on size.
+    // The optional spatial index is rebuilt to match the new arrangement.
     static void Arrange(
         array_ref<DrawableObjectAndValues> drawableObjects,
-        DrawingCanvas& drawingCanvas
+        DrawingCanvas& drawingCanvas,
+        _Inout_opt_ SpatialIndex* spatialIndex = nullptr
         );
 
     // Set the string value for the given attribute across the drawable objects.
@@ -94,14 +324,51 @@ public:
         std::u16string const& newText
         );
 
+    // Same, with all the objects holding the given string's buffer.
+    static void Set(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        array_ref<uint32_t const> drawableObjectsIndices,
+        uint32_t attributeIndex,
+        SharedString const& newText
+        );
+
     // Draw all drawable objects.
     // Arrange should have already been called. Otherwise objects will be drawn
     // at the default position <0,0> and overlap each other.
-    // Hidden objects will be skipped, where DrawableObjectAttributeVisibility == false.
+    // Hidden objects will be skipped, where DrawableObjectAttributeVisibility == false,
+    // as will objects lying wholly outside the canvas.
+    // With DrawFlagsParallel, each object is drawn into its own tile by a pool of
+    // threads, falling back to serial drawing when the view is not a whole pixel
+    // translation or explicitly positioned objects might overlap. DrawFlagsCachePixels
+    // has the same limits.
     static void Draw(
         array_ref<DrawableObjectAndValues> drawableObjects,
         DrawingCanvas& drawingCanvas,
-        DX_MATRIX_3X2F const& canvasTransform
+        DX_MATRIX_3X2F const& canvasTransform,
+        DrawFlags drawFlags = DrawFlagsNone,
+        _In_opt_ RECT const* updateRect = nullptr // Only draw objects touching this rect, or all if null.
+        );
+
+    // Incremented whenever any object's timings are recorded, such as by Draw
+    // actually drawing (rather than copying cached pixels), so callers can tell
+    // whether the shown timings are stale.
+    static uint32_t GetTimingsGeneration() noexcept;
+
+    // Get the canvas pixels needing a repaint since the last Draw, where objects
+    // have changed attributes, moved, or were hidden. Arrange should have already
+    // been called. Returns false if nothing changed.
+    static bool GetInvalidatedRect(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        DX_MATRIX_3X2F const& canvasTransform,
+        _Out_ RECT& invalidatedRect
+        );
+
+    // Expand the rect to wholly contain any objects it partially covers, since
+    // objects are always drawn whole. Clear this rect before passing it to Draw.
+    static void ExpandInvalidatedRect(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        DX_MATRIX_3X2F const& canvasTransform,
+        _Inout_ RECT& invalidatedRect
         );
 
     // Update the given drawable objects. This is usually called after a series
@@ -111,6 +378,35 @@ public:
         array_ref<uint32_t const> drawableObjectsIndices
         );
 
+    // Immutable copy of a drawable objects list, for undo or for switching
+    // between alternative configurations. The copied objects share their
+    // attribute values (copy-on-write) and their drawable objects, with any
+    // cached fonts and layouts, with the list they came from. So taking one
+    // copies no strings, and restoring one leaves alone any object unchanged
+    // since, while the changed ones keep whatever caches still match.
+    using Snapshot = std::shared_ptr<std::vector<DrawableObjectAndValues> const>;
+
+    // Cached pixels are left out of the snapshot.
+    static Snapshot TakeSnapshot(array_ref<DrawableObjectAndValues> drawableObjects);
+
+    // Returns the number of objects restored, which were updated and need
+    // arranging again. The others were untouched.
+    static uint32_t RestoreSnapshot(
+        Snapshot const& snapshot,
+        _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+        );
+
+    // Get the content bounds of the given objects in layout space, one per
+    // index, without changing any attributes. Objects unchanged since the last
+    // Arrange reuse its measurements, and the rest are measured across threads.
+    // Objects failing to measure get empty bounds.
+    static HRESULT MeasureContent(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        array_ref<uint32_t const> drawableObjectsIndices,
+        DrawingCanvas& drawingCanvas,
+        _Out_ std::vector<D2D_RECT_F>& contentBounds
+        );
+
     // Get the appropriate string value for the given attribute index across
     // multiple objects. If the values are consistent across all interested
     // objects, return that value. Otherwise return the default string.
@@ -121,8 +417,33 @@ public:
         _In_z_ char16_t const* defaultStringIfMixedValues // What to return if values are mixed between the objects.
         );
 
+    // Same, but returning the shared string itself, or an empty string if
+    // mixed. Callers can compare buffers to tell whether the value changed.
+    static SharedString GetSharedStringValue(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        array_ref<uint32_t> drawableObjectIndices,
+        uint32_t attributeIndex
+        );
+
+    // Load the objects list, given the settings "values" list which objects
+    // may reference by id.
     static void Load(
         TextTree::NodePointer node,
+        array_ref<SharedString const> sharedValues,
+        _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+        );
+
+    // Load a single object of the objects list, for streaming readers that
+    // see one object at a time. The first object in the list is the shared
+    // object, which just initializes sharedDrawableObject, whereas later ones
+    // are appended to drawableObjects and updated. Values the object lists in
+    // its "valueIds" are shared from sharedValues, read beforehand from the
+    // settings "values" list.
+    static void LoadObject(
+        TextTree::NodePointer objectNode,
+        bool isSharedObject,
+        _Inout_ DrawableObjectAndValues& sharedDrawableObject,
+        array_ref<SharedString const> sharedValues,
         _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
         );
 
@@ -131,8 +452,20 @@ public:
         _Inout_ array_ref<DrawableObjectAndValues> drawableObjects
         );
 
+    // Append the "objects" list to the settings object, preceded by the
+    // "values" list if any long values repeat across some of the objects,
+    // which reference them by id rather than storing them again.
     static void Store(
         array_ref<DrawableObjectAndValues> drawableObjects,
-        TextTree::NodePointer objectsNode
+        TextTree::NodePointer settingsNode
+        );
+
+    // Same, but writing the lists (positioned inside the settings object)
+    // straight to the writer, without building a tree.
+    static HRESULT Store(
+        array_ref<DrawableObjectAndValues> drawableObjects,
+        TextTreeWriter& writer
         );
 };
+
+DEFINE_ENUM_FLAG_OPERATORS(DrawableObjectAndValues::DrawFlags);
@@ -13,6 +13,12 @@
 #pragma comment(lib, "D2D1.lib")
 #pragma comment(lib, "GdiPlus.lib")
 #pragma comment(lib, "WindowsCodecs.lib")
+#pragma comment(lib, "D3D11.lib")
+
+#include <intrin.h>
+#include <immintrin.h>
+#include "Common.FastVector.h"
+#include "Tracing.h"
 
 MODULE(DrawingCanvas)
 EXPORT_BEGIN
@@ -31,6 +37,439 @@ extern "C"
 }
 
 
+namespace
+{
+    ////////////////////
+    // Pixel kernels with runtime CPU dispatch. The AVX2 versions use intrinsics
+    // directly, which MSVC permits without /arch:AVX2, so they are only called
+    // once the CPU and OS are known to support them.
+
+    enum class SimdLevel
+    {
+        None,   // Plain C++, only for exotic x86 builds without SSE2.
+        Sse2,
+        Avx2,
+    };
+
+    SimdLevel DetectSimdLevel()
+    {
+        int cpuInfo[4] = {};
+        __cpuid(cpuInfo, 0);
+        int const maximumFunction = cpuInfo[0];
+
+        __cpuid(cpuInfo, 1);
+        bool const hasSse2 = (cpuInfo[3] & (1 << 26)) != 0;
+        bool const hasOsXsave = (cpuInfo[2] & (1 << 27)) != 0;
+        bool const hasAvx = (cpuInfo[2] & (1 << 28)) != 0;
+
+        if (hasOsXsave && hasAvx && maximumFunction >= 7)
+        {
+            // The OS must save the upper halves of the YMM registers.
+            if ((_xgetbv(0) & 0x6) == 0x6)
+            {
+                __cpuidex(cpuInfo, 7, 0);
+                if (cpuInfo[1] & (1 << 5))
+                    return SimdLevel::Avx2;
+            }
+        }
+        return hasSse2 ? SimdLevel::Sse2 : SimdLevel::None;
+    }
+
+    SimdLevel GetSimdLevel()
+    {
+        static SimdLevel const simdLevel = DetectSimdLevel();
+        return simdLevel;
+    }
+
+    void FillPixelsAvx2(_Out_writes_(count) uint32_t* pixels, uint32_t count, uint32_t color)
+    {
+        __m256i const colors = _mm256_set1_epi32(color);
+        uint32_t x = 0;
+        for (; x + 8 <= count; x += 8)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&pixels[x]), colors);
+        }
+        _mm256_zeroupper();
+        for (; x < count; ++x)
+        {
+            pixels[x] = color;
+        }
+    }
+
+    void FillPixelsSse2(_Out_writes_(count) uint32_t* pixels, uint32_t count, uint32_t color)
+    {
+        __m128i const colors = _mm_set1_epi32(color);
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixels[x]), colors);
+        }
+        for (; x < count; ++x)
+        {
+            pixels[x] = color;
+        }
+    }
+
+    void FillPixels(_Out_writes_(count) uint32_t* pixels, uint32_t count, uint32_t color)
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::Avx2: FillPixelsAvx2(pixels, count, color); break;
+        case SimdLevel::Sse2: FillPixelsSse2(pixels, count, color); break;
+        default:
+            for (uint32_t x = 0; x < count; ++x)
+            {
+                pixels[x] = color;
+            }
+        }
+    }
+
+    inline uint32_t DuplicateAlphaPixel(uint32_t pixel)
+    {
+        uint32_t alpha = (pixel >> 24);
+        return (alpha<<0) | (alpha<<8) | (alpha<<16) | (alpha<<24);
+    }
+
+    // Duplicates the alpha channel in the other three color channels.
+    void DuplicateAlphaAvx2(_Inout_updates_(count) uint32_t* pixels, uint32_t count)
+    {
+        uint32_t x = 0;
+        for (; x + 8 <= count; x += 8)
+        {
+            __m256i* p = reinterpret_cast<__m256i*>(&pixels[x]);
+            __m256i alphas = _mm256_srli_epi32(_mm256_loadu_si256(p), 24);
+            alphas = _mm256_or_si256(alphas, _mm256_slli_epi32(alphas, 8));
+            alphas = _mm256_or_si256(alphas, _mm256_slli_epi32(alphas, 16));
+            _mm256_storeu_si256(p, alphas);
+        }
+        _mm256_zeroupper();
+        for (; x < count; ++x)
+        {
+            pixels[x] = DuplicateAlphaPixel(pixels[x]);
+        }
+    }
+
+    void DuplicateAlphaSse2(_Inout_updates_(count) uint32_t* pixels, uint32_t count)
+    {
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i* p = reinterpret_cast<__m128i*>(&pixels[x]);
+            __m128i alphas = _mm_srli_epi32(_mm_loadu_si128(p), 24);
+            alphas = _mm_or_si128(alphas, _mm_slli_epi32(alphas, 8));
+            alphas = _mm_or_si128(alphas, _mm_slli_epi32(alphas, 16));
+            _mm_storeu_si128(p, alphas);
+        }
+        for (; x < count; ++x)
+        {
+            pixels[x] = DuplicateAlphaPixel(pixels[x]);
+        }
+    }
+
+    void DuplicateAlpha(_Inout_updates_(count) uint32_t* pixels, uint32_t count)
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::Avx2: DuplicateAlphaAvx2(pixels, count); break;
+        case SimdLevel::Sse2: DuplicateAlphaSse2(pixels, count); break;
+        default:
+            for (uint32_t x = 0; x < count; ++x)
+            {
+                pixels[x] = DuplicateAlphaPixel(pixels[x]);
+            }
+        }
+    }
+
+    // Blends the color into the pixel by each channel's coverage:
+    // pixel = (pixel * (255 - coverage) + color * coverage) / 255, rounded.
+    // The coverage alpha byte is zero, leaving the pixel alpha unchanged.
+    inline uint32_t BlendCoveragePixel(uint32_t pixel, uint32_t coverage, uint32_t color)
+    {
+        uint32_t result = 0;
+        for (uint32_t shift = 0; shift < 32; shift += 8)
+        {
+            uint32_t p = (pixel >> shift) & 0xFF;
+            uint32_t c = (color >> shift) & 0xFF;
+            uint32_t a = (coverage >> shift) & 0xFF;
+            uint32_t t = p * (255 - a) + c * a + 128;
+            result |= (((t + (t >> 8)) >> 8) & 0xFF) << shift;
+        }
+        return result;
+    }
+
+    void BlendCoveragePixelsSse2(
+        _Inout_updates_(count) uint32_t* pixels,
+        _In_reads_(count) uint32_t const* coverages,
+        uint32_t count,
+        uint32_t color
+        )
+    {
+        // The products fit in unsigned 16-bit lanes, since 255 * 255 + 255 * 0 + 128 < 65536.
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const maximum = _mm_set1_epi16(255);
+        __m128i const half = _mm_set1_epi16(128);
+        __m128i const colors = _mm_unpacklo_epi8(_mm_set1_epi32(color), zero);
+
+        auto blend = [&](__m128i p, __m128i a) -> __m128i
+        {
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(p, _mm_sub_epi16(maximum, a)), _mm_mullo_epi16(colors, a));
+            t = _mm_add_epi16(t, half);
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        };
+
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i* p = reinterpret_cast<__m128i*>(&pixels[x]);
+            __m128i const pixels4 = _mm_loadu_si128(p);
+            __m128i const coverages4 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&coverages[x]));
+            __m128i const low = blend(_mm_unpacklo_epi8(pixels4, zero), _mm_unpacklo_epi8(coverages4, zero));
+            __m128i const high = blend(_mm_unpackhi_epi8(pixels4, zero), _mm_unpackhi_epi8(coverages4, zero));
+            _mm_storeu_si128(p, _mm_packus_epi16(low, high));
+        }
+        for (; x < count; ++x)
+        {
+            pixels[x] = BlendCoveragePixel(pixels[x], coverages[x], color);
+        }
+    }
+
+    void BlendCoveragePixels(
+        _Inout_updates_(count) uint32_t* pixels,
+        _In_reads_(count) uint32_t const* coverages,
+        uint32_t count,
+        uint32_t color
+        )
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::Avx2: // Glyphs are too narrow to benefit from wider vectors.
+        case SimdLevel::Sse2: BlendCoveragePixelsSse2(pixels, coverages, count, color); break;
+        default:
+            for (uint32_t x = 0; x < count; ++x)
+            {
+                pixels[x] = BlendCoveragePixel(pixels[x], coverages[x], color);
+            }
+        }
+    }
+
+    // Repeats each source pixel zoom times horizontally.
+    void ZoomPixelsSse2(
+        _Out_writes_(count * zoom) uint32_t* pixels,
+        _In_reads_(count) uint32_t const* sourcePixels,
+        uint32_t count,
+        uint32_t zoom
+        )
+    {
+        uint32_t x = 0;
+        if (zoom == 2)
+        {
+            for (; x + 4 <= count; x += 4)
+            {
+                __m128i const pixels4 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&sourcePixels[x]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixels[x * 2 + 0]), _mm_unpacklo_epi32(pixels4, pixels4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixels[x * 2 + 4]), _mm_unpackhi_epi32(pixels4, pixels4));
+            }
+        }
+        else if (zoom >= 4)
+        {
+            for (; x < count; ++x)
+            {
+                FillPixelsSse2(&pixels[x * zoom], zoom, sourcePixels[x]);
+            }
+        }
+        for (; x < count; ++x)
+        {
+            for (uint32_t i = 0; i < zoom; ++i)
+            {
+                pixels[x * zoom + i] = sourcePixels[x];
+            }
+        }
+    }
+
+    void ZoomPixels(
+        _Out_writes_(count * zoom) uint32_t* pixels,
+        _In_reads_(count) uint32_t const* sourcePixels,
+        uint32_t count,
+        uint32_t zoom
+        )
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::Avx2: // Each run is at most a few vectors long.
+        case SimdLevel::Sse2: ZoomPixelsSse2(pixels, sourcePixels, count, zoom); break;
+        default:
+            for (uint32_t x = 0; x < count; ++x)
+            {
+                for (uint32_t i = 0; i < zoom; ++i)
+                {
+                    pixels[x * zoom + i] = sourcePixels[x];
+                }
+            }
+        }
+    }
+
+    // Return the index of the first pixel differing from the color (under the
+    // mask), or the count if all match.
+    uint32_t FindDifferentPixelAvx2(_In_reads_(count) uint32_t const* pixels, uint32_t count, uint32_t color, uint32_t mask)
+    {
+        __m256i const colors = _mm256_set1_epi32(color & mask);
+        __m256i const masks = _mm256_set1_epi32(mask);
+        uint32_t x = 0;
+        for (; x + 8 <= count; x += 8)
+        {
+            __m256i const maskedPixels = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(&pixels[x])), masks);
+            uint32_t const equalBits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(maskedPixels, colors)));
+            if (equalBits != 0xFF)
+            {
+                _mm256_zeroupper();
+                unsigned long index;
+                _BitScanForward(OUT &index, ~equalBits & 0xFF);
+                return x + index;
+            }
+        }
+        _mm256_zeroupper();
+        for (; x < count && (pixels[x] & mask) == (color & mask); ++x)
+        { }
+        return x;
+    }
+
+    uint32_t FindDifferentPixelSse2(_In_reads_(count) uint32_t const* pixels, uint32_t count, uint32_t color, uint32_t mask)
+    {
+        __m128i const colors = _mm_set1_epi32(color & mask);
+        __m128i const masks = _mm_set1_epi32(mask);
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i const maskedPixels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(&pixels[x])), masks);
+            uint32_t const equalBits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(maskedPixels, colors)));
+            if (equalBits != 0xF)
+            {
+                unsigned long index;
+                _BitScanForward(OUT &index, ~equalBits & 0xF);
+                return x + index;
+            }
+        }
+        for (; x < count && (pixels[x] & mask) == (color & mask); ++x)
+        { }
+        return x;
+    }
+
+    uint32_t FindDifferentPixel(_In_reads_(count) uint32_t const* pixels, uint32_t count, uint32_t color, uint32_t mask)
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::Avx2: return FindDifferentPixelAvx2(pixels, count, color, mask);
+        case SimdLevel::Sse2: return FindDifferentPixelSse2(pixels, count, color, mask);
+        default:
+            uint32_t x = 0;
+            for (; x < count && (pixels[x] & mask) == (color & mask); ++x)
+            { }
+            return x;
+        }
+    }
+
+    // Return one past the index of the last pixel differing from the color
+    // (under the mask), or zero if all match.
+    uint32_t FindLastDifferentPixelAvx2(_In_reads_(count) uint32_t const* pixels, uint32_t count, uint32_t color, uint32_t mask)
+    {
+        __m256i const colors = _mm256_set1_epi32(color & mask);
+        __m256i const masks = _mm256_set1_epi32(mask);
+        uint32_t x = count;
+        for (; x >= 8; x -= 8)
+        {
+            __m256i const maskedPixels = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(&pixels[x - 8])), masks);
+            uint32_t const equalBits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(maskedPixels, colors)));
+            if (equalBits != 0xFF)
+            {
+                _mm256_zeroupper();
+                unsigned long index;
+                _BitScanReverse(OUT &index, ~equalBits & 0xFF);
+                return x - 8 + index + 1;
+            }
+        }
+        _mm256_zeroupper();
+        for (; x > 0 && (pixels[x - 1] & mask) == (color & mask); --x)
+        { }
+        return x;
+    }
+
+    uint32_t FindLastDifferentPixelSse2(_In_reads_(count) uint32_t const* pixels, uint32_t count, uint32_t color, uint32_t mask)
+    {
+        __m128i const colors = _mm_set1_epi32(color & mask);
+        __m128i const masks = _mm_set1_epi32(mask);
+        uint32_t x = count;
+        for (; x >= 4; x -= 4)
+        {
+            __m128i const maskedPixels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(&pixels[x - 4])), masks);
+            uint32_t const equalBits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(maskedPixels, colors)));
+            if (equalBits != 0xF)
+            {
+                unsigned long index;
+                _BitScanReverse(OUT &index, ~equalBits & 0xF);
+                return x - 4 + index + 1;
+            }
+        }
+        for (; x > 0 && (pixels[x - 1] & mask) == (color & mask); --x)
+        { }
+        return x;
+    }
+
+    uint32_t FindLastDifferentPixel(_In_reads_(count) uint32_t const* pixels, uint32_t count, uint32_t color, uint32_t mask)
+    {
+        switch (GetSimdLevel())
+        {
+        case SimdLevel::Avx2: return FindLastDifferentPixelAvx2(pixels, count, color, mask);
+        case SimdLevel::Sse2: return FindLastDifferentPixelSse2(pixels, count, color, mask);
+        default:
+            uint32_t x = count;
+            for (; x > 0 && (pixels[x - 1] & mask) == (color & mask); --x)
+            { }
+            return x;
+        }
+    }
+
+    // Calls the function over bands of scanlines [top, bottom), splitting large
+    // areas across thread pool workers since a 4K canvas outpaces a single
+    // core's memory bandwidth. Small areas, like most object clears, stay on
+    // this thread.
+    void ForEachScanlineBand(
+        uint32_t top,
+        uint32_t bottom,
+        uint32_t width,
+        std::function<void(uint32_t bandTop, uint32_t bandBottom)> const& function
+        )
+    {
+        constexpr uint32_t minimumPixelsPerThread = 1u << 19;
+        constexpr uint32_t maximumThreadCount = 8;
+
+        uint32_t const height = bottom - top;
+        uint64_t const pixelCount = uint64_t(width) * height;
+        uint32_t threadCount = std::min(
+            std::min(uint32_t(std::thread::hardware_concurrency()), maximumThreadCount),
+            uint32_t(std::min(pixelCount / minimumPixelsPerThread, uint64_t(height)))
+            );
+
+        if (threadCount <= 1)
+        {
+            function(top, bottom);
+            return;
+        }
+
+        // This thread, as worker zero, takes the first band.
+        uint32_t const bandHeight = (height + threadCount - 1) / threadCount;
+        RunWorkers(threadCount, [&](uint32_t workerIndex)
+        {
+            uint32_t bandTop = std::min(top + bandHeight * workerIndex, bottom);
+            uint32_t bandBottom = std::min(bandTop + bandHeight, bottom);
+            if (bandTop < bandBottom)
+            {
+                function(bandTop, bandBottom);
+            }
+        });
+    }
+}
+
+
 const DX_MATRIX_3X2F DrawingCanvas::g_identityMatrix = {1,0,0,1,0,0};
 const GUID DrawingCanvas::g_guid = { 0x74868E11, 0xF1CF, 0x461A, 0xAE,0xAF,0x17,0x52,0x16,0xDF,0xF0,0xBA };
 
@@ -193,22 +632,63 @@ void DrawingCanvas::UninitializeForRendering()
     gdiInterop_.Clear();
     dwriteFactory_.Clear();
     d2dFactory_.Clear();
-    gdiplusToken_.Clear();
     wicFactory_.Clear();
+    ClearGlyphAtlas();
+    ReleaseHardwareRenderTargets();
+    targetSize_ = {};
+    ResetTiles({0, 0});
 }
 
 
-void DrawingCanvas::Clone(_COM_Outptr_ DrawingCanvas** newDrawingCanvas)
+void DrawingCanvas::Clone(_COM_Outptr_ DrawingCanvas** newDrawingCanvas, FactoryIsolation factoryIsolation)
 {
     auto* drawingCanvas = new DrawingCanvas();
 
     // Copy over selected items to reduce cost,
     // but not unshareable state like render targets.
+    // Any factories not shared are created on first use.
     drawingCanvas->AddRef();
-    drawingCanvas->d2dFactory_ = d2dFactory_;
-    drawingCanvas->dwriteFactory_ = dwriteFactory_;
-    drawingCanvas->renderingParams_ = renderingParams_;
-    drawingCanvas->gdiInterop_ = gdiInterop_;
+    drawingCanvas->wicFactory_ = wicFactory_;
+    drawingCanvas->isGlyphAtlasEnabled_ = isGlyphAtlasEnabled_;
+
+    switch (factoryIsolation)
+    {
+    case FactoryIsolationNone:
+        drawingCanvas->d2dFactory_ = d2dFactory_;
+        drawingCanvas->d2dFactoryType_ = d2dFactoryType_;
+        break;
+
+    case FactoryIsolationPerThreadD2D:
+    case FactoryIsolationPerThread:
+        break;
+
+    case FactoryIsolationMultithreadedD2D:
+        {
+            // Share the factory only if it is already multithreaded.
+            ComPtr<ID2D1Multithread> multithread;
+            if (d2dFactory_ != nullptr
+            &&  SUCCEEDED(d2dFactory_->QueryInterface(OUT &multithread))
+            &&  multithread->GetMultithreadProtected())
+            {
+                drawingCanvas->d2dFactory_ = d2dFactory_;
+            }
+            drawingCanvas->d2dFactoryType_ = D2D1_FACTORY_TYPE_MULTI_THREADED;
+        }
+        break;
+    }
+
+    if (factoryIsolation == FactoryIsolationPerThread)
+    {
+        // The rendering params and interop belong to the DWrite factory.
+        drawingCanvas->dwriteFactoryType_ = DWRITE_FACTORY_TYPE_ISOLATED;
+    }
+    else
+    {
+        drawingCanvas->dwriteFactoryType_ = dwriteFactoryType_;
+        drawingCanvas->dwriteFactory_ = dwriteFactory_;
+        drawingCanvas->renderingParams_ = renderingParams_;
+        drawingCanvas->gdiInterop_ = gdiInterop_;
+    }
 
     *newDrawingCanvas = drawingCanvas;
 }
@@ -232,6 +712,73 @@ void DrawingCanvas::SetWicFactory(IWICImagingFactory* factory)
 }
 
 
+DrawingCanvasPool::DrawingCanvasPool(DrawingCanvas::FactoryIsolation factoryIsolation, _In_opt_ DrawingCanvas* prototype)
+:   prototype_(prototype),
+    factoryIsolation_(factoryIsolation)
+{
+    // Without a prototype, clone an empty canvas, whose factories are all
+    // created on demand.
+    if (prototype_ == nullptr)
+    {
+        prototype_.Set(new DrawingCanvas());
+    }
+}
+
+
+HRESULT DrawingCanvasPool::Acquire(_COM_Outptr_ DrawingCanvas** drawingCanvas)
+{
+    *drawingCanvas = nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!freeCanvases_.empty())
+    {
+        *drawingCanvas = freeCanvases_.back().Detach();
+        freeCanvases_.pop_back();
+        return S_OK;
+    }
+
+    ComPtr<DrawingCanvas> newDrawingCanvas;
+    prototype_->Clone(OUT &newDrawingCanvas, factoryIsolation_);
+
+    if (factoryIsolation_ == DrawingCanvas::FactoryIsolationMultithreadedD2D)
+    {
+        // Create the one factory for the pool, unless the prototype had it.
+        if (multithreadedD2DFactory_ == nullptr)
+        {
+            if (newDrawingCanvas->GetD2DFactoryWeakRef() != nullptr)
+            {
+                multithreadedD2DFactory_.Set(newDrawingCanvas->GetD2DFactoryWeakRef());
+            }
+            else
+            {
+                IFR(D2D1CreateFactory(D2D1_FACTORY_TYPE_MULTI_THREADED, OUT &multithreadedD2DFactory_));
+            }
+        }
+        newDrawingCanvas->SetD2DFactory(multithreadedD2DFactory_);
+    }
+
+    *drawingCanvas = newDrawingCanvas.Detach();
+    return S_OK;
+}
+
+
+void DrawingCanvasPool::Return(DrawingCanvas* drawingCanvas)
+{
+    if (drawingCanvas == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    freeCanvases_.emplace_back(drawingCanvas);
+}
+
+
+void DrawingCanvasPool::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    freeCanvases_.clear();
+}
+
+
 ////////////////////////////////////////
 // Drawing related
 
@@ -272,7 +819,7 @@ bool DrawingCanvas::PaintFinish(HDC displayHdc, RECT const& rect)
     BitBlt(
         displayHdc,
         rect.left, rect.top,
-        rect.right, rect.bottom,
+        rect.right - rect.left, rect.bottom - rect.top,
         memoryHdc,
         rect.left, rect.top,
         SRCCOPY
@@ -288,7 +835,7 @@ HRESULT DrawingCanvas::InitializeRendering()
     if (dwriteFactory_ == nullptr)
     {
         IFR(DWriteCreateFactory(
-            DWRITE_FACTORY_TYPE_SHARED,
+            dwriteFactoryType_,
             __uuidof(IDWriteFactory),
             reinterpret_cast<IUnknown**>(OUT &dwriteFactory_)
             ));
@@ -318,37 +865,40 @@ HRESULT DrawingCanvas::InitializeRendering()
     if (d2dFactory_ == nullptr)
     {
         IFR(D2D1CreateFactory(
-            D2D1_FACTORY_TYPE_SINGLE_THREADED,
+            d2dFactoryType_,
             &d2dFactory_
             ));
     }
 
-    if (wicFactory_ == nullptr)
-    {
-        IFR(WICCreateImagingFactory_Proxy(WINCODEC_SDK_VERSION1, OUT &wicFactory_));
-    }
+    // WIC is created on first use (GetWicFactoryWeakRef), and GDI+ by the
+    // objects drawing with it, so painting a sheet without them starts neither.
+
+    return S_OK;
+}
+
 
-    if (gdiplusToken_ == NULL)
+IWICImagingFactory* DrawingCanvas::GetWicFactoryWeakRef()
+{
+    if (wicFactory_ == nullptr)
     {
-        Gdiplus::GdiplusStartupInputEx gdiplusStartupInput(Gdiplus::GdiplusStartupDefault);
-        Gdiplus::GdiplusStartup(OUT &gdiplusToken_, &gdiplusStartupInput, nullptr);
-        if (gdiplusToken_ == NULL)
-        {
-            return E_FAIL;
-        }
+        WICCreateImagingFactory_Proxy(WINCODEC_SDK_VERSION1, OUT &wicFactory_);
     }
-
-    return S_OK;
+    return wicFactory_;
 }
 
 
 HRESULT DrawingCanvas::CreateRenderTargetsOnDemand(_In_opt_ HDC templateHdc, SIZE size)
 {
-    if (target_ != nullptr && targetD2D_ != nullptr)
+    if (target_ != nullptr && targetD2D_ != nullptr && (targetD2DHardware_ != nullptr || !isD2DHardwareEnabled_))
     {
         return S_OK;
     }
 
+    if (target_ != nullptr)
+    {
+        target_->GetSize(OUT &size); // Keep the existing capacity for any new D2D target.
+    }
+
     // Get dimensions of window and layout to test.
     size.cx = std::max<int>(size.cx, 1);
     size.cy = std::max<int>(size.cy, 1);
@@ -362,6 +912,8 @@ HRESULT DrawingCanvas::CreateRenderTargetsOnDemand(_In_opt_ HDC templateHdc, SIZ
         // Don't let this additional factor complicate everything from hit-testing to drawing.
         // Fold this scaling into the transform.
         target_->SetPixelsPerDip(1.0);
+        targetSize_ = size;
+        ResetTiles(size);
     }
 
     if (targetD2D_ == nullptr)
@@ -400,195 +952,1116 @@ HRESULT DrawingCanvas::CreateRenderTargetsOnDemand(_In_opt_ HDC templateHdc, SIZ
     // each new color.
     if (brush_ == nullptr)
     {
-        IFR(targetD2D_->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::White), &brush_));
+        IFR(targetD2D_->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::White), &brush_));
+    }
+
+    if (isD2DHardwareEnabled_ && targetD2DHardware_ == nullptr)
+    {
+        // Keep using the DC render target if there's no usable GPU.
+        if (FAILED(CreateHardwareRenderTargets(size)))
+        {
+            ReleaseHardwareRenderTargets();
+            isD2DHardwareEnabled_ = false;
+        }
+    }
+
+    return S_OK;
+}
+
+
+HRESULT DrawingCanvas::CreateHardwareRenderTargets(SIZE size)
+{
+    ComPtr<ID2D1Factory1> d2dFactory1;
+    IFR(d2dFactory_->QueryInterface(OUT &d2dFactory1));
+
+    if (d3dDevice_ == nullptr)
+    {
+        IFR(D3D11CreateDevice(
+            nullptr, // default adapter
+            D3D_DRIVER_TYPE_HARDWARE,
+            nullptr,
+            D3D11_CREATE_DEVICE_BGRA_SUPPORT, // Needed by D2D.
+            nullptr, // default feature levels
+            0,
+            D3D11_SDK_VERSION,
+            OUT &d3dDevice_,
+            nullptr,
+            nullptr
+            ));
+    }
+
+    ComPtr<IDXGIDevice> dxgiDevice;
+    ComPtr<ID2D1Device> d2dDevice;
+    IFR(d3dDevice_->QueryInterface(OUT &dxgiDevice));
+    IFR(d2dFactory1->CreateDevice(dxgiDevice, OUT &d2dDevice));
+    IFR(d2dDevice->CreateDeviceContext(D2D1_DEVICE_CONTEXT_OPTIONS_NONE, OUT &targetD2DHardware_));
+
+    // Same as the DC render target, which folds any scaling into transforms.
+    targetD2DHardware_->SetDpi(96.0, 96.0);
+    targetD2DHardware_->SetTextRenderingParams(renderingParams_);
+
+    IFR(CreateHardwareTargetBitmaps(size));
+    IFR(targetD2DHardware_->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::White), OUT &brushHardware_));
+
+    return S_OK;
+}
+
+
+HRESULT DrawingCanvas::CreateHardwareTargetBitmaps(SIZE size)
+{
+    targetD2DHardware_->SetTarget(nullptr);
+    targetD2DHardwareBitmap_.Clear();
+    targetD2DReadbackBitmap_.Clear();
+
+    // Matches the DIB's layout, so the pixels copy directly between them.
+    D2D1_SIZE_U const pixelSize = { uint32_t(std::max<LONG>(size.cx, 1)), uint32_t(std::max<LONG>(size.cy, 1)) };
+    D2D1_PIXEL_FORMAT const pixelFormat = D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED);
+    D2D1_BITMAP_PROPERTIES1 const targetProperties = D2D1::BitmapProperties1(D2D1_BITMAP_OPTIONS_TARGET, pixelFormat, 96.0f, 96.0f);
+    D2D1_BITMAP_PROPERTIES1 const readbackProperties = D2D1::BitmapProperties1(D2D1_BITMAP_OPTIONS_CPU_READ | D2D1_BITMAP_OPTIONS_CANNOT_DRAW, pixelFormat, 96.0f, 96.0f);
+
+    IFR(targetD2DHardware_->CreateBitmap(pixelSize, nullptr, 0, &targetProperties, OUT &targetD2DHardwareBitmap_));
+    IFR(targetD2DHardware_->CreateBitmap(pixelSize, nullptr, 0, &readbackProperties, OUT &targetD2DReadbackBitmap_));
+    targetD2DHardware_->SetTarget(targetD2DHardwareBitmap_);
+
+    return S_OK;
+}
+
+
+void DrawingCanvas::ReleaseHardwareRenderTargets()
+{
+    brushHardware_.Clear();
+    targetD2DReadbackBitmap_.Clear();
+    targetD2DHardwareBitmap_.Clear();
+    targetD2DHardware_.Clear();
+    d3dDevice_.Clear();
+}
+
+
+void DrawingCanvas::SetD2DHardwareEnabled(bool isEnabled)
+{
+    isD2DHardwareEnabled_ = isEnabled;
+    if (!isEnabled)
+    {
+        ReleaseHardwareRenderTargets();
+    }
+    // Otherwise the next CreateRenderTargetsOnDemand creates them.
+}
+
+
+void DrawingCanvas::BeginDrawD2D()
+{
+    SwitchRenderingAPI(CurrentRenderingApiD2D);
+}
+
+
+HRESULT DrawingCanvas::EndDrawD2D()
+{
+    if (isD2DBatchActive_ || currentRenderingApi_ != CurrentRenderingApiD2D)
+        return S_OK; // Left open for the next object in the batch.
+
+    currentRenderingApi_ = CurrentRenderingApiAny;
+    return EndD2DSession();
+}
+
+
+void DrawingCanvas::BeginD2DBatch()
+{
+    isD2DBatchActive_ = true;
+}
+
+
+void DrawingCanvas::EndD2DBatch()
+{
+    isD2DBatchActive_ = false;
+    if (currentRenderingApi_ == CurrentRenderingApiD2D)
+    {
+        SwitchRenderingAPI(CurrentRenderingApiAny);
+    }
+}
+
+
+void DrawingCanvas::BeginD2DSession()
+{
+    if (targetD2DHardware_ == nullptr)
+    {
+        if (targetD2D_ != nullptr)
+        {
+            targetD2D_->BeginDraw();
+        }
+        return;
+    }
+
+    // Start from the current pixels, which GDI or DWrite may have drawn.
+    GdiFlush();
+    RawPixels rawPixels = GetRawPixels();
+    D2D1_SIZE_U const targetSize = targetD2DHardwareBitmap_->GetPixelSize();
+    if (rawPixels.bitsPerPixel == 32)
+    {
+        D2D1_RECT_U const copyRect = {0, 0, std::min(rawPixels.width, targetSize.width), std::min(rawPixels.height, targetSize.height)};
+        targetD2DHardwareBitmap_->CopyFromMemory(&copyRect, rawPixels.pixels, rawPixels.byteStride);
+    }
+
+    targetD2DHardware_->BeginDraw();
+}
+
+
+HRESULT DrawingCanvas::EndD2DSession()
+{
+    if (targetD2DHardware_ == nullptr)
+    {
+        return (targetD2D_ != nullptr) ? targetD2D_->EndDraw() : S_OK;
+    }
+
+    // Copy the drawn pixels back into the DIB for GDI, DWrite, and display.
+    HRESULT hr = targetD2DHardware_->EndDraw();
+    if (SUCCEEDED(hr))
+    {
+        hr = targetD2DReadbackBitmap_->CopyFromBitmap(nullptr, targetD2DHardwareBitmap_, nullptr);
+    }
+
+    D2D1_MAPPED_RECT mappedRect = {};
+    if (SUCCEEDED(hr))
+    {
+        hr = targetD2DReadbackBitmap_->Map(D2D1_MAP_OPTIONS_READ, OUT &mappedRect);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        RawPixels rawPixels = GetRawPixels();
+        D2D1_SIZE_U const targetSize = targetD2DReadbackBitmap_->GetPixelSize();
+        if (rawPixels.bitsPerPixel == 32)
+        {
+            uint32_t const rowByteCount = std::min(rawPixels.width, targetSize.width) * sizeof(uint32_t);
+            uint32_t const rowCount = std::min(rawPixels.height, targetSize.height);
+            for (uint32_t y = 0; y < rowCount; ++y)
+            {
+                memcpy(
+                    AddBitmapByteOffset(rawPixels.pixels, y * rawPixels.byteStride),
+                    AddBitmapByteOffset(mappedRect.bits, y * mappedRect.pitch),
+                    rowByteCount
+                    );
+            }
+        }
+        targetD2DReadbackBitmap_->Unmap();
+    }
+
+    if (hr == D2DERR_RECREATE_TARGET)
+    {
+        // The device was lost. The next CreateRenderTargetsOnDemand creates a new one.
+        ReleaseHardwareRenderTargets();
+    }
+
+    return hr;
+}
+
+
+HRESULT DrawingCanvas::ResizeRenderTargets(SIZE size)
+{
+    if (target_ == nullptr || targetD2D_ == nullptr)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    size.cx = std::max<LONG>(size.cx, 1);
+    size.cy = std::max<LONG>(size.cy, 1);
+
+    // Only reallocate when growing past the current capacity, and then with
+    // some slack, so that dragging a window edge reallocates every so often
+    // rather than on every WM_SIZE. Smaller sizes draw into the top left of
+    // the larger surface until TrimRenderTargets gives the excess back.
+    SIZE capacity = {};
+    target_->GetSize(OUT &capacity);
+    if (size.cx > capacity.cx || size.cy > capacity.cy)
+    {
+        auto growCapacity = [](LONG neededLength, LONG currentLength) -> LONG
+        {
+            if (neededLength <= currentLength)
+                return currentLength;
+            LONG length = std::max(neededLength, currentLength + currentLength / 4);
+            return (length + renderTargetGranularity - 1) / renderTargetGranularity * renderTargetGranularity;
+        };
+        capacity.cx = growCapacity(size.cx, capacity.cx);
+        capacity.cy = growCapacity(size.cy, capacity.cy);
+        IFR(ReallocateRenderTargets(capacity));
+    }
+
+    targetSize_ = size;
+    ResetTiles(size);
+    return S_OK;
+}
+
+
+HRESULT DrawingCanvas::TrimRenderTargets()
+{
+    if (target_ == nullptr || targetD2D_ == nullptr)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    SIZE capacity = {};
+    target_->GetSize(OUT &capacity);
+    if (capacity.cx == targetSize_.cx && capacity.cy == targetSize_.cy)
+    {
+        return S_FALSE;
+    }
+
+    // The pixels are undefined after reallocating, so every tile is dirty.
+    IFR(ReallocateRenderTargets(targetSize_));
+    ResetTiles(targetSize_);
+    return S_OK;
+}
+
+
+HRESULT DrawingCanvas::ReallocateRenderTargets(SIZE capacity)
+{
+    IFR(target_->Resize(capacity.cx, capacity.cy));
+    RECT bindRect = {0,0,capacity.cx, capacity.cy};
+    targetD2D_->BindDC(target_->GetMemoryDC(), &bindRect);
+
+    if (targetD2DHardware_ != nullptr && FAILED(CreateHardwareTargetBitmaps(capacity)))
+    {
+        ReleaseHardwareRenderTargets();
+        isD2DHardwareEnabled_ = false;
+    }
+    return S_OK;
+}
+
+
+void DrawingCanvas::ResetTiles(SIZE size)
+{
+    tiledPixelSize_ = size;
+    tileGridSize_.cx = LONG((uint32_t(std::max(size.cx, 0L)) + tileSize - 1) / tileSize);
+    tileGridSize_.cy = LONG((uint32_t(std::max(size.cy, 0L)) + tileSize - 1) / tileSize);
+    dirtyTiles_.assign(size_t(tileGridSize_.cx) * tileGridSize_.cy, true);
+}
+
+
+bool DrawingCanvas::GetTileRange(RECT const& rect, _Out_ RECT& tileRange) const
+{
+    // Tiles touching the rect, as column and row indices, end exclusive.
+    tileRange.left   = std::max(rect.left, 0L) / LONG(tileSize);
+    tileRange.top    = std::max(rect.top, 0L) / LONG(tileSize);
+    tileRange.right  = std::min((std::max(rect.right, 0L) + LONG(tileSize) - 1) / LONG(tileSize), tileGridSize_.cx);
+    tileRange.bottom = std::min((std::max(rect.bottom, 0L) + LONG(tileSize) - 1) / LONG(tileSize), tileGridSize_.cy);
+    return tileRange.left < tileRange.right && tileRange.top < tileRange.bottom;
+}
+
+
+void DrawingCanvas::InvalidateTiles(_In_opt_ RECT const* rect)
+{
+    if (rect == nullptr)
+    {
+        std::fill(dirtyTiles_.begin(), dirtyTiles_.end(), uint8_t(true));
+        return;
+    }
+
+    RECT tileRange;
+    if (!GetTileRange(*rect, OUT tileRange))
+        return;
+
+    for (LONG row = tileRange.top; row < tileRange.bottom; ++row)
+    {
+        auto* dirtyRow = &dirtyTiles_[size_t(row) * tileGridSize_.cx];
+        std::fill(dirtyRow + tileRange.left, dirtyRow + tileRange.right, uint8_t(true));
+    }
+}
+
+
+void DrawingCanvas::ValidateTiles(RECT const& rect)
+{
+    RECT tileRange;
+    if (!GetTileRange(rect, OUT tileRange))
+        return;
+
+    // Tiles cut by the canvas edge only need their part within the canvas covered.
+    for (LONG row = tileRange.top; row < tileRange.bottom; ++row)
+    {
+        LONG const tileTop = row * LONG(tileSize);
+        LONG const tileBottom = std::min(tileTop + LONG(tileSize), tiledPixelSize_.cy);
+        if (tileTop < rect.top || tileBottom > rect.bottom)
+            continue;
+
+        auto* dirtyRow = &dirtyTiles_[size_t(row) * tileGridSize_.cx];
+        for (LONG column = tileRange.left; column < tileRange.right; ++column)
+        {
+            LONG const tileLeft = column * LONG(tileSize);
+            LONG const tileRight = std::min(tileLeft + LONG(tileSize), tiledPixelSize_.cx);
+            if (tileLeft >= rect.left && tileRight <= rect.right)
+            {
+                dirtyRow[column] = false;
+            }
+        }
+    }
+}
+
+
+bool DrawingCanvas::GetDirtyTileRect(RECT const& rect, _Out_ RECT& dirtyRect) const
+{
+    dirtyRect = {};
+
+    // Everything is dirty before the render targets exist.
+    if (dirtyTiles_.empty())
+    {
+        dirtyRect = rect;
+        return !IsRectEmpty(&rect);
+    }
+
+    RECT tileRange;
+    if (!GetTileRange(rect, OUT tileRange))
+        return false;
+
+    RECT dirtyTileRange = {tileRange.right, tileRange.bottom, tileRange.left, tileRange.top};
+    for (LONG row = tileRange.top; row < tileRange.bottom; ++row)
+    {
+        auto const* dirtyRow = &dirtyTiles_[size_t(row) * tileGridSize_.cx];
+        for (LONG column = tileRange.left; column < tileRange.right; ++column)
+        {
+            if (dirtyRow[column])
+            {
+                dirtyTileRange.left   = std::min(dirtyTileRange.left, column);
+                dirtyTileRange.top    = std::min(dirtyTileRange.top, row);
+                dirtyTileRange.right  = std::max(dirtyTileRange.right, column + 1);
+                dirtyTileRange.bottom = std::max(dirtyTileRange.bottom, row + 1);
+            }
+        }
+    }
+    if (dirtyTileRange.left >= dirtyTileRange.right)
+        return false;
+
+    dirtyRect.left   = dirtyTileRange.left * LONG(tileSize);
+    dirtyRect.top    = dirtyTileRange.top * LONG(tileSize);
+    dirtyRect.right  = std::min(dirtyTileRange.right * LONG(tileSize), tiledPixelSize_.cx);
+    dirtyRect.bottom = std::min(dirtyTileRange.bottom * LONG(tileSize), tiledPixelSize_.cy);
+    return true;
+}
+
+
+void DrawingCanvas::SwitchRenderingAPI(CurrentRenderingApi currentRenderingApi)
+{
+    if (currentRenderingApi == currentRenderingApi_)
+        return;
+
+    switch (currentRenderingApi_)
+    {
+    case CurrentRenderingApiD2D:
+        EndD2DSession();
+        break;
+
+    case CurrentRenderingApiGdi:
+    case CurrentRenderingApiGdiPlus:
+        GdiFlush();
+        break;
+
+    default:
+        break; // No other API's currently have special Begin/End needs.
+    }
+
+    currentRenderingApi_ = currentRenderingApi;
+
+    switch (currentRenderingApi)
+    {
+    case CurrentRenderingApiD2D:
+        BeginD2DSession();
+        break;
+
+    default:
+        break; // No other API's currently have special Begin/End needs.
+    }
+}
+
+
+void DrawingCanvas::SetDirectWriteRenderingParams(IDWriteRenderingParams* renderingParams)
+{
+    renderingParams_.Set(renderingParams);
+
+    if (targetD2DHardware_ != nullptr)
+    {
+        targetD2DHardware_->SetTextRenderingParams(renderingParams_);
+    }
+    if (targetD2D_ != nullptr)
+    {
+        targetD2D_->SetTextRenderingParams(renderingParams_);
+    }
+}
+
+
+uint32_t DrawingCanvas::GetSharedResourceNameId(
+    _In_z_ char16_t const* name,
+    bool shouldAdd
+    )
+{
+    auto match = sharedResourceNameIds_.find(std::u16string_view(name));
+    if (match != sharedResourceNameIds_.end())
+    {
+        return match->second;
+    }
+
+    if (!shouldAdd)
+    {
+        return ~0u;
+    }
+
+    uint32_t nameId;
+    if (!freeSharedResourceNameIds_.empty())
+    {
+        nameId = freeSharedResourceNameIds_.back();
+        freeSharedResourceNameIds_.pop_back();
+        sharedResourceNames_[nameId] = name;
+    }
+    else
+    {
+        nameId = uint32_t(sharedResourceNames_.size());
+        sharedResourceNames_.emplace_back(name);
+    }
+    sharedResourceNameIds_.emplace(std::u16string_view(sharedResourceNames_[nameId]), nameId);
+    return nameId;
+}
+
+
+void DrawingCanvas::ReleaseUnusedSharedResourceNames()
+{
+    std::vector<bool> isNameUsed(sharedResourceNames_.size());
+    for (auto const& sharedResource : sharedResources_)
+    {
+        isNameUsed[sharedResource.first.nameId] = true;
+    }
+
+    for (auto nameId = sharedResourceNameIds_.begin(); nameId != sharedResourceNameIds_.end(); )
+    {
+        if (isNameUsed[nameId->second])
+        {
+            ++nameId;
+            continue;
+        }
+
+        // Free the text too, but only after its view leaves the map.
+        uint32_t const freedNameId = nameId->second;
+        nameId = sharedResourceNameIds_.erase(nameId);
+        std::u16string().swap(sharedResourceNames_[freedNameId]);
+        freeSharedResourceNameIds_.push_back(freedNameId);
+    }
+}
+
+
+HRESULT DrawingCanvas::GetSharedResource(
+    UUID const& typeUuid,
+    _In_z_ char16_t const* name,
+    _COM_Outptr_ IUnknown** resource
+    )
+{
+    uint32_t nameId = GetSharedResourceNameId(name, /*shouldAdd*/false);
+    auto match = (nameId != ~0u) ? sharedResources_.find({typeUuid, nameId}) : sharedResources_.end();
+    bool const isHit = (match != sharedResources_.end() && match->second.resource != nullptr);
+
+    // Fonts, font collections, and glyph caches are all looked up here by
+    // name (such as the file path), making this the one place to count hits.
+    TRACE_LOGGING_EVENT("SharedResourceLookup",
+        TraceLoggingWideString(ToWChar(name), "Name"),
+        TraceLoggingGuid(typeUuid, "Type"),
+        TraceLoggingBool(isHit, "IsHit")
+        );
+
+    if (!isHit)
+    {
+        return E_NOT_SET;
+    }
+
+    SharedResource& sharedResource = match->second;
+    auto hr = sharedResource.resource->QueryInterface(typeUuid, OUT reinterpret_cast<void**>(resource));
+    if (*resource != nullptr)
+    {
+        sharedResource.lastUsedGeneration = sharedResourceGeneration_;
+    }
+    return hr;
+}
+
+
+HRESULT DrawingCanvas::SetSharedResource(
+    UUID const& typeUuid,
+    _In_z_ char16_t const* name,
+    IUnknown* resource,
+    size_t byteSize
+    )
+{
+    uint32_t nameId = GetSharedResourceNameId(name, /*shouldAdd*/resource != nullptr);
+    if (nameId == ~0u)
+    {
+        return S_OK; // Nothing was set. Return early.
+    }
+
+    SharedResourceKey key = {typeUuid, nameId};
+    auto match = sharedResources_.find(key);
+
+    // Clearing a resource removes it entirely.
+    if (resource == nullptr)
+    {
+        if (match != sharedResources_.end())
+        {
+            sharedResourceTotalByteSize_ -= match->second.byteSize;
+            sharedResources_.erase(match);
+        }
+        return S_OK;
+    }
+
+    // No existing resource was found.
+    if (match == sharedResources_.end())
+    {
+        match = sharedResources_.emplace(key, SharedResource{0, 0}).first;
+    }
+
+    SharedResource& sharedResource = match->second;
+    sharedResourceTotalByteSize_ += byteSize - sharedResource.byteSize;
+    sharedResource.byteSize = byteSize;
+    sharedResource.lastUsedGeneration = sharedResourceGeneration_;
+    sharedResource.resource.Set(resource);
+
+    return S_OK;
+}
+
+
+HRESULT DrawingCanvas::ClearSharedResources()
+{
+    sharedResources_.clear();
+    sharedResourceNameIds_.clear();
+    sharedResourceNames_.clear();
+    freeSharedResourceNameIds_.clear();
+    sharedResourceTotalByteSize_ = 0;
+    ClearGlyphAtlas();
+    return S_OK;
+}
+
+
+HRESULT DrawingCanvas::RetireStaleSharedResources()
+{
+    uint32_t const currentGeneration = sharedResourceGeneration_;
+    ++sharedResourceGeneration_;
+
+    // Release anything not used recently.
+    for (auto sharedResource = sharedResources_.begin(); sharedResource != sharedResources_.end(); )
+    {
+        if (sharedResourceGeneration_ - sharedResource->second.lastUsedGeneration > maximumSharedResourceIdleGenerations)
+        {
+            sharedResourceTotalByteSize_ -= sharedResource->second.byteSize;
+            sharedResource = sharedResources_.erase(sharedResource);
+        }
+        else
+        {
+            ++sharedResource;
+        }
+    }
+
+    if (sharedResourceTotalByteSize_ <= sharedResourceByteBudget_)
+    {
+        ReleaseUnusedSharedResourceNames();
+        return S_OK;
+    }
+
+    // Still over budget, so release the least recently used of the sized
+    // resources, sparing any used since the last retirement.
+    std::vector<std::pair<uint32_t, SharedResourceKey>> evictionCandidates;
+    for (auto const& sharedResource : sharedResources_)
+    {
+        if (sharedResource.second.byteSize > 0 && sharedResource.second.lastUsedGeneration != currentGeneration)
+        {
+            evictionCandidates.push_back({sharedResource.second.lastUsedGeneration, sharedResource.first});
+        }
+    }
+    std::sort(
+        evictionCandidates.begin(),
+        evictionCandidates.end(),
+        [](auto const& a, auto const& b) { return a.first < b.first; }
+        );
+
+    for (auto const& evictionCandidate : evictionCandidates)
+    {
+        if (sharedResourceTotalByteSize_ <= sharedResourceByteBudget_)
+            break;
+
+        auto match = sharedResources_.find(evictionCandidate.second);
+        sharedResourceTotalByteSize_ -= match->second.byteSize;
+        sharedResources_.erase(match);
+    }
+
+    ReleaseUnusedSharedResourceNames();
+    return S_OK;
+}
+
+
+namespace
+{
+    // Rough costs of font faces set without a size, for accounting only: the
+    // face object with its table lookups, plus cached metrics per glyph.
+    size_t constexpr g_estimatedFontFaceByteSize = 16384;
+    size_t constexpr g_estimatedFontFaceBytesPerGlyph = 16;
+}
+
+
+void DrawingCanvas::GetSharedResourceUsage(_Out_ std::vector<SharedResourceUsage>& usage)
+{
+    usage.clear();
+    usage.reserve(sharedResources_.size());
+    for (auto const& sharedResource : sharedResources_)
+    {
+        SharedResourceUsage resourceUsage = {
+            sharedResourceNames_[sharedResource.first.nameId],
+            sharedResource.first.typeUuid,
+            sharedResource.second.byteSize,
+            false
+        };
+
+        IUnknown* resource = sharedResource.second.resource;
+        if (resourceUsage.byteSize == 0 && resource != nullptr)
+        {
+            ComPtr<DrawingCanvas> drawingCanvas;
+            ComPtr<IDWriteFontFace> fontFace;
+            if (SUCCEEDED(resource->QueryInterface(__uuidof(DrawingCanvas), OUT reinterpret_cast<void**>(&drawingCanvas))))
+            {
+                resourceUsage.byteSize = drawingCanvas->GetRenderTargetByteSize();
+                resourceUsage.isEstimated = true;
+            }
+            else if (SUCCEEDED(resource->QueryInterface(__uuidof(IDWriteFontFace), OUT reinterpret_cast<void**>(&fontFace))))
+            {
+                resourceUsage.byteSize = g_estimatedFontFaceByteSize + fontFace->GetGlyphCount() * g_estimatedFontFaceBytesPerGlyph;
+                resourceUsage.isEstimated = true;
+            }
+        }
+        usage.push_back(resourceUsage);
+    }
+}
+
+
+size_t DrawingCanvas::TrimSharedResources(size_t byteSizeToRelease)
+{
+    std::vector<SharedResourceUsage> usage;
+    GetSharedResourceUsage(OUT usage);
+    std::sort(
+        usage.begin(),
+        usage.end(),
+        [](auto const& a, auto const& b) { return a.byteSize > b.byteSize; }
+        );
+
+    size_t releasedByteSize = 0;
+    for (auto const& resourceUsage : usage)
+    {
+        if (releasedByteSize >= byteSizeToRelease || resourceUsage.byteSize == 0)
+            break;
+
+        uint32_t nameId = GetSharedResourceNameId(resourceUsage.name.data(), /*shouldAdd*/false);
+        auto match = sharedResources_.find({resourceUsage.typeUuid, nameId});
+        if (match == sharedResources_.end())
+            continue;
+
+        releasedByteSize += resourceUsage.byteSize;
+        sharedResourceTotalByteSize_ -= match->second.byteSize;
+        sharedResources_.erase(match);
     }
 
-    return S_OK;
+    // The usage names viewed the interned names, so only free them now.
+    ReleaseUnusedSharedResourceNames();
+    return releasedByteSize;
 }
 
 
-HRESULT DrawingCanvas::ResizeRenderTargets(SIZE size)
+size_t DrawingCanvas::GetRenderTargetByteSize() const
 {
-    if (target_ == nullptr || targetD2D_ == nullptr)
+    size_t byteSize = 0;
+    if (target_ != nullptr)
     {
-        return E_NOT_VALID_STATE;
+        SIZE capacity = {};
+        target_->GetSize(OUT &capacity);
+        size_t const pixelByteSize = size_t(capacity.cx) * capacity.cy * sizeof(uint32_t);
+
+        // The hardware target has its own bitmap and a readback copy.
+        byteSize += pixelByteSize;
+        if (targetD2DHardware_ != nullptr)
+        {
+            byteSize += pixelByteSize * 2;
+        }
     }
 
-    target_->Resize(size.cx, size.cy);
-    RECT bindRect = {0,0,size.cx, size.cy};
-    targetD2D_->BindDC(target_->GetMemoryDC(), &bindRect);
+    byteSize += glyphAtlasCoverage_.capacity() * sizeof(uint32_t);
+    byteSize += glyphAtlasEntries_.size() * (sizeof(GlyphAtlasKey) + sizeof(GlyphAtlasEntry));
+    return byteSize;
+}
+
+
+HRESULT EncodeRawPixelsAsPngToStream(
+    IWICImagingFactory* wicFactory,
+    DrawingCanvas::RawPixels const& rawPixels,
+    IStream* stream
+    )
+{
+    if (wicFactory == nullptr || rawPixels.bitsPerPixel != 32 || rawPixels.width == 0 || rawPixels.height == 0)
+        return E_INVALIDARG;
+
+    ComPtr<IWICBitmap> bitmap;
+    ComPtr<IWICBitmapEncoder> encoder;
+    ComPtr<IWICBitmapFrameEncode> frame;
+
+    // GDI leaves the alpha channel undefined, so ignore it.
+    IFR(wicFactory->CreateBitmapFromMemory(
+        rawPixels.width,
+        rawPixels.height,
+        GUID_WICPixelFormat32bppBGR,
+        rawPixels.byteStride,
+        rawPixels.byteStride * (rawPixels.height - 1) + rawPixels.width * sizeof(uint32_t),
+        reinterpret_cast<BYTE*>(rawPixels.pixels),
+        OUT &bitmap
+        ));
+
+    IFR(wicFactory->CreateEncoder(GUID_ContainerFormatPng, nullptr, OUT &encoder));
+    IFR(encoder->Initialize(stream, WICBitmapEncoderNoCache));
+    IFR(encoder->CreateNewFrame(OUT &frame, nullptr));
+    IFR(frame->Initialize(nullptr));
+    IFR(frame->WriteSource(bitmap, nullptr)); // Converts to whatever the encoder supports.
+    IFR(frame->Commit());
+    IFR(encoder->Commit());
+
     return S_OK;
 }
 
 
-void DrawingCanvas::SwitchRenderingAPI(CurrentRenderingApi currentRenderingApi)
+DrawingCanvas::RawPixels DrawingCanvas::GetRawPixels()
 {
-    if (currentRenderingApi == currentRenderingApi_)
-        return;
+    DrawingCanvas::RawPixels rawPixels = {};
+    if (target_ == nullptr)
+        return rawPixels;
 
-    switch (currentRenderingApi_)
+    HDC memoryHdc = target_->GetMemoryDC();
+    if (memoryHdc == nullptr)
     {
-    case CurrentRenderingApiD2D:
-        if (targetD2D_ != nullptr)
-        {
-            targetD2D_->EndDraw();
-        }
-        break;
+        return rawPixels;
+    }
 
-    case CurrentRenderingApiGdi:
-    case CurrentRenderingApiGdiPlus:
-        GdiFlush();
-        break;
+    DIBSECTION destBitmapInfo = {};
 
-    default:
-        break; // No other API's currently have special Begin/End needs.
+    // Display the alpha channel in-place.
+    HBITMAP destBitmap = (HBITMAP)GetCurrentObject(memoryHdc, OBJ_BITMAP);
+    GetObject(destBitmap, sizeof(destBitmapInfo), &destBitmapInfo);
+
+    // Only the size in use, which may be less than the DIB's capacity.
+    rawPixels.width = std::min<uint32_t>(destBitmapInfo.dsBm.bmWidth, targetSize_.cx);
+    rawPixels.height = std::min<uint32_t>(destBitmapInfo.dsBm.bmHeight, targetSize_.cy);
+    rawPixels.byteStride = destBitmapInfo.dsBm.bmWidthBytes;
+    rawPixels.bitsPerPixel = destBitmapInfo.dsBm.bmBitsPixel;
+    rawPixels.pixels = destBitmapInfo.dsBm.bmBits;
+    if (rawPixels.pixels == nullptr)
+    {
+        rawPixels.width = 0;
+        rawPixels.height = 0;
     }
 
-    currentRenderingApi_ = currentRenderingApi;
+    return rawPixels;
+}
 
-    switch (currentRenderingApi)
-    {
-    case CurrentRenderingApiD2D:
-        if (targetD2D_ != nullptr)
-        {
-            targetD2D_->BeginDraw();
-        }
-        break;
 
-    default:
-        break; // No other API's currently have special Begin/End needs.
+void DrawingCanvas::SetGlyphAtlasEnabled(bool isEnabled)
+{
+    isGlyphAtlasEnabled_ = isEnabled;
+    if (!isEnabled)
+    {
+        ClearGlyphAtlas();
     }
 }
 
 
-void DrawingCanvas::SetDirectWriteRenderingParams(IDWriteRenderingParams* renderingParams)
+void DrawingCanvas::ClearGlyphAtlas()
 {
-    renderingParams_.Set(renderingParams);
+    glyphAtlasEntries_.clear();
+    glyphAtlasReferences_.clear();
+    glyphAtlasCoverage_.clear();
+}
 
-    if (targetD2D_ != nullptr)
+
+BitmapRenderTargetGlyphRunDrawer DrawingCanvas::GetGlyphRunDrawer()
+{
+    if (!isGlyphAtlasEnabled_)
+        return nullptr;
+
+    return [this](
+        float baselineOriginX,
+        float baselineOriginY,
+        DWRITE_MEASURING_MODE measuringMode,
+        DWRITE_GLYPH_RUN const& glyphRun,
+        IDWriteRenderingParams* renderingParams,
+        COLORREF textColor
+        ) -> HRESULT
     {
-        targetD2D_->SetTextRenderingParams(renderingParams_);
-    }
+        return DrawGlyphRunFromAtlas(baselineOriginX, baselineOriginY, measuringMode, glyphRun, renderingParams, textColor);
+    };
 }
 
 
-HRESULT DrawingCanvas::GetSharedResource(
-    UUID const& typeUuid,
-    _In_z_ char16_t const* name,
-    _COM_Outptr_ IUnknown** resource
+HRESULT DrawingCanvas::GetGlyphAtlasEntry(
+    GlyphAtlasKey const& key,
+    IDWriteRenderingParams* renderingParams,
+    _Out_ GlyphAtlasEntry const** entry
     )
 {
-    for (auto& sharedResource : sharedResources_)
+    *entry = nullptr;
+
+    auto match = glyphAtlasEntries_.find(key);
+    if (match != glyphAtlasEntries_.end())
+    {
+        *entry = &match->second;
+        return S_OK;
+    }
+
+    if (glyphAtlasCoverage_.size() > maximumGlyphAtlasPixels)
     {
-        if (sharedResource.typeUuid == typeUuid
-        &&  sharedResource.name.compare(name) == 0
-        &&  sharedResource.resource != nullptr)
+        ClearGlyphAtlas();
+    }
+
+    // Rasterize the lone glyph at its subpixel offset from the pixel origin.
+    float const glyphAdvance = 0;
+    DWRITE_GLYPH_RUN const singleGlyphRun = { key.fontFace, key.fontEmSize, 1, &key.glyphId, &glyphAdvance, nullptr, false, 0 };
+    DWRITE_RENDERING_MODE const renderingMode = DWRITE_RENDERING_MODE(key.renderingMode);
+
+    ComPtr<IDWriteGlyphRunAnalysis> glyphRunAnalysis;
+    IFR(dwriteFactory_->CreateGlyphRunAnalysis(
+        &singleGlyphRun,
+        1.0f, // pixelsPerDip
+        nullptr, // transform
+        renderingMode,
+        DWRITE_MEASURING_MODE(key.measuringMode),
+        float(key.subpixelPosition) / glyphAtlasSubpixelCount,
+        0.0f,
+        OUT &glyphRunAnalysis
+        ));
+
+    // Aliased analyses only produce 1x1 textures, and the others only 3x1.
+    DWRITE_TEXTURE_TYPE const textureType = (renderingMode == DWRITE_RENDERING_MODE_ALIASED) ? DWRITE_TEXTURE_ALIASED_1x1 : DWRITE_TEXTURE_CLEARTYPE_3x1;
+    uint32_t const bytesPerTexel = (textureType == DWRITE_TEXTURE_ALIASED_1x1) ? 1 : 3;
+    RECT bounds = {};
+    IFR(glyphRunAnalysis->GetAlphaTextureBounds(textureType, OUT &bounds));
+
+    GlyphAtlasEntry newEntry = {
+        bounds.left,
+        bounds.top,
+        uint32_t(std::max(bounds.right - bounds.left, 0L)),
+        uint32_t(std::max(bounds.bottom - bounds.top, 0L)),
+        glyphAtlasCoverage_.size()
+    };
+
+    uint32_t const pixelCount = newEntry.width * newEntry.height;
+    if (pixelCount > 0)
+    {
+        scratch_vector<uint8_t, false> texture(pixelCount * bytesPerTexel);
+        IFR(glyphRunAnalysis->CreateAlphaTexture(textureType, &bounds, OUT texture.data(), uint32_t(texture.size())));
+
+        // Bake the ClearType level and enhanced contrast for these params into
+        // the coverage. The blend itself is linear, without the render
+        // target's gamma correction, so edges may differ slightly from it.
+        float gamma, enhancedContrast, clearTypeLevel;
+        IFR(glyphRunAnalysis->GetAlphaBlendParams(renderingParams, OUT &gamma, OUT &enhancedContrast, OUT &clearTypeLevel));
+        DWRITE_PIXEL_GEOMETRY const pixelGeometry = renderingParams->GetPixelGeometry();
+        if (pixelGeometry == DWRITE_PIXEL_GEOMETRY_FLAT)
+        {
+            clearTypeLevel = 0;
+        }
+
+        std::array<uint8_t, 256> contrastTable;
+        for (uint32_t i = 0; i < 256; ++i)
         {
-            auto hr = sharedResource.resource->QueryInterface(typeUuid, OUT reinterpret_cast<void**>(resource));
-            if (*resource != nullptr)
+            float a = i / 255.0f;
+            a = a * (enhancedContrast + 1) / (a * enhancedContrast + 1);
+            contrastTable[i] = uint8_t(a * 255 + 0.5f);
+        }
+
+        glyphAtlasCoverage_.resize(newEntry.coverageOffset + pixelCount);
+        uint32_t* coverage = &glyphAtlasCoverage_[newEntry.coverageOffset];
+        for (uint32_t i = 0; i < pixelCount; ++i)
+        {
+            uint8_t const* texel = &texture[i * bytesPerTexel];
+            float red = texel[0];
+            float green = texel[bytesPerTexel / 2];
+            float blue = texel[bytesPerTexel - 1];
+            if (pixelGeometry == DWRITE_PIXEL_GEOMETRY_BGR)
             {
-                sharedResource.freshnessCount = std::max(sharedResource.freshnessCount, 1u);
+                std::swap(red, blue);
             }
-            return hr;
+
+            float const average = (red + green + blue) / 3;
+            auto adjust = [&](float channel) -> uint32_t
+            {
+                return contrastTable[uint8_t(average + (channel - average) * clearTypeLevel + 0.5f)];
+            };
+            coverage[i] = adjust(blue) | (adjust(green) << 8) | (adjust(red) << 16);
+        }
+    }
+
+    // Hold the face and params, since their pointers are part of the key.
+    for (IUnknown* reference : {static_cast<IUnknown*>(key.fontFace), static_cast<IUnknown*>(key.renderingParams)})
+    {
+        auto& heldReference = glyphAtlasReferences_[reference];
+        if (heldReference == nullptr)
+        {
+            heldReference = reference;
         }
     }
 
-    return E_NOT_SET;
+    *entry = &glyphAtlasEntries_.emplace(key, newEntry).first->second;
+    return S_OK;
 }
 
 
-HRESULT DrawingCanvas::SetSharedResource(
-    UUID const& typeUuid,
-    _In_z_ char16_t const* name,
-    IUnknown* resource
+HRESULT DrawingCanvas::DrawGlyphRunFromAtlas(
+    float baselineOriginX,
+    float baselineOriginY,
+    DWRITE_MEASURING_MODE measuringMode,
+    DWRITE_GLYPH_RUN const& glyphRun,
+    IDWriteRenderingParams* renderingParams,
+    COLORREF textColor
     )
 {
-    SharedResource* matchingSharedResource = nullptr;
-    for (auto& sharedResource : sharedResources_)
-    {
-        if (sharedResource.typeUuid == typeUuid && sharedResource.name.compare(name) == 0)
-        {
-            matchingSharedResource = &sharedResource;
-            break;
-        }
-    }
+    if (!isGlyphAtlasEnabled_ || target_ == nullptr || dwriteFactory_ == nullptr || renderingParams == nullptr || glyphRun.fontFace == nullptr)
+        return S_FALSE;
 
-    // No existing resource was found.
-    if (matchingSharedResource == nullptr)
-    {
-        if (resource == nullptr)
-            return S_OK; // Nothing was set. Return early.
+    // Vertical and RTL runs advance differently, so leave them to the render target.
+    if (glyphRun.isSideways || (glyphRun.bidiLevel & 1))
+        return S_FALSE;
+
+    // Only whole translations draw each glyph's coverage unchanged.
+    DWRITE_MATRIX transform;
+    IFR(target_->GetCurrentTransform(OUT &transform));
+    if (transform.m11 != 1 || transform.m12 != 0 || transform.m21 != 0 || transform.m22 != 1 || target_->GetPixelsPerDip() != 1)
+        return S_FALSE;
+
+    DrawingCanvas::RawPixels rawPixels = GetRawPixels();
+    if (rawPixels.bitsPerPixel != 32)
+        return S_FALSE;
 
-        // Allocate a new one at the end.
-        sharedResources_.resize(sharedResources_.size() + 1);
-        matchingSharedResource = &sharedResources_.back();
-        matchingSharedResource->typeUuid = typeUuid;
-        matchingSharedResource->name = name;
+    DWRITE_RENDERING_MODE renderingMode = renderingParams->GetRenderingMode();
+    if (renderingMode == DWRITE_RENDERING_MODE_DEFAULT)
+    {
+        IFR(glyphRun.fontFace->GetRecommendedRenderingMode(glyphRun.fontEmSize, 1.0f, measuringMode, renderingParams, OUT &renderingMode));
     }
+    if (renderingMode == DWRITE_RENDERING_MODE_OUTLINE)
+        return S_FALSE; // Outlines are filled as geometry rather than coverage.
 
-    // Increment the access freshness.
-    matchingSharedResource->freshnessCount = std::max(matchingSharedResource->freshnessCount, 1u);
-    matchingSharedResource->resource.Set(resource);
+    if (glyphRun.glyphCount == 0)
+        return S_OK;
 
-    return S_OK;
-}
+    // Only the natural modes place glyphs at fractional pixel positions.
+    bool const hasSubpixelPositions = (renderingMode == DWRITE_RENDERING_MODE_NATURAL || renderingMode == DWRITE_RENDERING_MODE_NATURAL_SYMMETRIC);
 
+    float const* glyphAdvances = glyphRun.glyphAdvances;
+    scratch_vector<float, false> glyphAdvancesBuffer((glyphAdvances == nullptr) ? glyphRun.glyphCount : 0);
+    if (glyphAdvances == nullptr)
+    {
+        IFR(GetFontFaceAdvances(
+            glyphRun.fontFace,
+            glyphRun.fontEmSize,
+            { glyphRun.glyphIndices, glyphRun.glyphCount },
+            measuringMode,
+            /*isSideways*/ false,
+            OUT glyphAdvancesBuffer.data_span()
+            ));
+        glyphAdvances = glyphAdvancesBuffer.data();
+    }
 
-HRESULT DrawingCanvas::ClearSharedResources()
-{
-    sharedResources_.clear();
-    return S_OK;
-}
+    // Flush any pending GDI drawing before writing to the pixels.
+    GdiFlush();
 
+    uint32_t const pixelColor = (GetRValue(textColor) << 16) | (GetGValue(textColor) << 8) | GetBValue(textColor);
+    GlyphAtlasKey key = { glyphRun.fontFace, renderingParams, glyphRun.fontEmSize, 0, uint8_t(renderingMode), uint8_t(measuringMode), 0 };
+    float penX = baselineOriginX + transform.dx;
+    float const baselineY = baselineOriginY + transform.dy;
 
-HRESULT DrawingCanvas::RetireStaleSharedResources()
-{
-    for (auto sharedResource = sharedResources_.begin(); sharedResource != sharedResources_.end(); )
+    for (uint32_t i = 0; i < glyphRun.glyphCount; ++i)
     {
-        if (sharedResource->freshnessCount == 0)
+        float glyphX = penX;
+        float glyphY = baselineY;
+        if (glyphRun.glyphOffsets != nullptr)
         {
-            sharedResource = sharedResources_.erase(sharedResource);
+            glyphX += glyphRun.glyphOffsets[i].advanceOffset;
+            glyphY -= glyphRun.glyphOffsets[i].ascenderOffset;
         }
-        else
+        penX += glyphAdvances[i];
+
+        float const pixelX = hasSubpixelPositions ? floorf(glyphX) : floorf(glyphX + 0.5f);
+        key.glyphId = glyphRun.glyphIndices[i];
+        key.subpixelPosition = hasSubpixelPositions
+            ? uint8_t(std::min(uint32_t((glyphX - pixelX) * glyphAtlasSubpixelCount), glyphAtlasSubpixelCount - 1))
+            : 0;
+
+        GlyphAtlasEntry const* entry;
+        IFR(GetGlyphAtlasEntry(key, renderingParams, OUT &entry));
+
+        // Clip the glyph to the pixels.
+        int32_t left = int32_t(pixelX) + entry->left;
+        int32_t top = int32_t(floorf(glyphY + 0.5f)) + entry->top;
+        int32_t width = int32_t(entry->width);
+        int32_t height = int32_t(entry->height);
+        int32_t sourceX = 0;
+        int32_t sourceY = 0;
+        if (left < 0) { width  += left; sourceX -= left; left = 0; }
+        if (top < 0)  { height += top;  sourceY -= top;  top = 0; }
+        width  = std::min(width,  int32_t(rawPixels.width)  - left);
+        height = std::min(height, int32_t(rawPixels.height) - top);
+        if (width <= 0 || height <= 0)
+            continue;
+
+        uint32_t const* coverageRow = &glyphAtlasCoverage_[entry->coverageOffset + sourceY * entry->width + sourceX];
+        uint32_t* pixelRow = AddBitmapByteOffset(reinterpret_cast<uint32_t*>(rawPixels.pixels), top * rawPixels.byteStride);
+        for (int32_t y = 0; y < height; ++y)
         {
-            sharedResource->freshnessCount--;
-            ++sharedResource;
+            BlendCoveragePixels(pixelRow + left, coverageRow, uint32_t(width), pixelColor);
+            coverageRow += entry->width;
+            pixelRow = AddBitmapByteOffset(pixelRow, rawPixels.byteStride);
         }
     }
+
     return S_OK;
 }
 
 
-DrawingCanvas::RawPixels DrawingCanvas::GetRawPixels()
+HRESULT DrawingCanvas::BlendCoverage(
+    RECT const& bounds,
+    array_ref<uint32_t const> coverage,
+    COLORREF color
+    )
 {
-    DrawingCanvas::RawPixels rawPixels = {};
-    if (target_ == nullptr)
-        return rawPixels;
+    int32_t const coverageWidth = bounds.right - bounds.left;
+    int32_t const coverageHeight = bounds.bottom - bounds.top;
+    if (coverageWidth <= 0 || coverageHeight <= 0)
+        return S_OK;
 
-    HDC memoryHdc = target_->GetMemoryDC();
-    if (memoryHdc == nullptr)
-    {
-        return rawPixels;
-    }
+    if (coverage.size() < size_t(coverageWidth) * coverageHeight)
+        return E_INVALIDARG;
 
-    DIBSECTION destBitmapInfo = {};
+    DrawingCanvas::RawPixels rawPixels = GetRawPixels();
+    if (rawPixels.bitsPerPixel != 32)
+        return S_FALSE;
+
+    // Clip the coverage to the pixels.
+    int32_t left = bounds.left;
+    int32_t top = bounds.top;
+    int32_t width = coverageWidth;
+    int32_t height = coverageHeight;
+    int32_t sourceX = 0;
+    int32_t sourceY = 0;
+    if (left < 0) { width  += left; sourceX -= left; left = 0; }
+    if (top < 0)  { height += top;  sourceY -= top;  top = 0; }
+    width  = std::min(width,  int32_t(rawPixels.width)  - left);
+    height = std::min(height, int32_t(rawPixels.height) - top);
+    if (width <= 0 || height <= 0)
+        return S_OK;
 
-    // Display the alpha channel in-place.
-    HBITMAP destBitmap = (HBITMAP)GetCurrentObject(memoryHdc, OBJ_BITMAP);
-    GetObject(destBitmap, sizeof(destBitmapInfo), &destBitmapInfo);
+    // Flush any pending GDI drawing before writing to the pixels.
+    GdiFlush();
 
-    rawPixels.width = destBitmapInfo.dsBm.bmWidth;
-    rawPixels.height = destBitmapInfo.dsBm.bmHeight;
-    rawPixels.byteStride = destBitmapInfo.dsBm.bmWidthBytes;
-    rawPixels.bitsPerPixel = destBitmapInfo.dsBm.bmBitsPixel;
-    rawPixels.pixels = destBitmapInfo.dsBm.bmBits;
-    if (rawPixels.pixels == nullptr)
+    uint32_t const pixelColor = (GetRValue(color) << 16) | (GetGValue(color) << 8) | GetBValue(color);
+    uint32_t const* coverageRow = &coverage[sourceY * coverageWidth + sourceX];
+    uint32_t* pixelRow = AddBitmapByteOffset(reinterpret_cast<uint32_t*>(rawPixels.pixels), top * rawPixels.byteStride);
+    for (int32_t y = 0; y < height; ++y)
     {
-        rawPixels.width = 0;
-        rawPixels.height = 0;
+        BlendCoveragePixels(pixelRow + left, coverageRow, uint32_t(width), pixelColor);
+        coverageRow += coverageWidth;
+        pixelRow = AddBitmapByteOffset(pixelRow, rawPixels.byteStride);
     }
 
-    return rawPixels;
+    return S_OK;
 }
 
 
@@ -600,18 +2073,47 @@ void DrawingCanvas::ClearBackground(uint32_t color)
     if (rawPixels.bitsPerPixel != 32)
         return;
 
-    uint8_t* destPixels = reinterpret_cast<uint8_t*>(rawPixels.pixels);
-    uint32_t* destRow   = reinterpret_cast<uint32_t*>(destPixels);
+    // Clear each scanline in-place.
+    ForEachScanlineBand(0, rawPixels.height, rawPixels.width, [&](uint32_t bandTop, uint32_t bandBottom)
+    {
+        uint32_t* destRow = PtrAddByteOffset(reinterpret_cast<uint32_t*>(rawPixels.pixels), bandTop * rawPixels.byteStride);
+        for (uint32_t y = bandTop; y < bandBottom; ++y)
+        {
+            FillPixels(destRow, rawPixels.width, color);
+            destRow = PtrAddByteOffset(destRow, rawPixels.byteStride);
+        }
+    });
+}
+
+
+void DrawingCanvas::ClearBackground(uint32_t color, RECT const& rect)
+{
+    DEBUG_ASSERT(target_ != nullptr); // should have called PaintPrepare
+
+    RawPixels rawPixels = GetRawPixels();
+    if (rawPixels.bitsPerPixel != 32)
+        return;
+
+    // Clip to the bitmap.
+    RECT bitmapRect = {0, 0, LONG(rawPixels.width), LONG(rawPixels.height)};
+    RECT clearRect;
+    if (!IntersectRect(OUT &clearRect, &rect, &bitmapRect))
+        return;
+
+    GdiFlush(); // Any pending GDI drawing must land before clearing beneath it.
+
+    uint32_t const clearWidth = uint32_t(clearRect.right - clearRect.left);
 
     // Clear each scanline in-place.
-    for (uint32_t y = 0; y < rawPixels.height; ++y)
+    ForEachScanlineBand(clearRect.top, clearRect.bottom, clearWidth, [&](uint32_t bandTop, uint32_t bandBottom)
     {
-        for (uint32_t x = 0; x < rawPixels.width; ++x)
+        uint32_t* destRow = PtrAddByteOffset(reinterpret_cast<uint32_t*>(rawPixels.pixels), bandTop * rawPixels.byteStride);
+        for (uint32_t y = bandTop; y < bandBottom; ++y)
         {
-            destRow[x] = color;
+            FillPixels(&destRow[clearRect.left], clearWidth, color);
+            destRow = PtrAddByteOffset(destRow, rawPixels.byteStride);
         }
-        destRow = PtrAddByteOffset(destRow, rawPixels.byteStride);
-    }
+    });
 }
 
 
@@ -623,20 +2125,16 @@ void DrawingCanvas::DrawAlphaChannel()
     if (rawPixels.bitsPerPixel != 32)
         return;
 
-    uint8_t* destPixels = reinterpret_cast<uint8_t*>(rawPixels.pixels);
-    uint32_t* destRow   = reinterpret_cast<uint32_t*>(destPixels);
-
     // Modify each scanline in-place.
-    for (uint32_t y = 0; y < rawPixels.height; ++y)
+    ForEachScanlineBand(0, rawPixels.height, rawPixels.width, [&](uint32_t bandTop, uint32_t bandBottom)
     {
-        for (uint32_t x = 0; x < rawPixels.width; ++x)
+        uint32_t* destRow = PtrAddByteOffset(reinterpret_cast<uint32_t*>(rawPixels.pixels), bandTop * rawPixels.byteStride);
+        for (uint32_t y = bandTop; y < bandBottom; ++y)
         {
-            // Duplicate the alpha channel in the other three color channels.
-            uint32_t alpha = (destRow[x] >> 24);
-            destRow[x] = (alpha<<0) | (alpha<<8) | (alpha<<16) | (alpha<<24);
+            DuplicateAlpha(destRow, rawPixels.width);
+            destRow = PtrAddByteOffset(destRow, rawPixels.byteStride);
         }
-        destRow = PtrAddByteOffset(destRow, rawPixels.byteStride);
-    }
+    });
 }
 
 
@@ -665,10 +2163,7 @@ void DrawingCanvas::DrawGrid(uint32_t color, uint32_t step)
             {
                 yLineMod = 0;
             }
-            for (uint32_t x = 0; x < rawPixels.width; ++x)
-            {
-                destRow[x] = pixelColor;
-            }
+            FillPixels(destRow, rawPixels.width, pixelColor);
         }
         // Segments of vertical line.
         uint32_t xLineMod = 0;
@@ -691,6 +2186,82 @@ void DrawingCanvas::DrawGrid(uint32_t color, uint32_t step)
 }
 
 
+void DrawingCanvas::DrawZoomedPixels(
+    RawPixels const& sourcePixels,
+    RECT const& destRect,
+    uint32_t zoom,
+    uint32_t gridColor
+    )
+{
+    DEBUG_ASSERT(target_ != nullptr); // should have called PaintPrepare
+
+    RawPixels rawPixels = GetRawPixels();
+    if (rawPixels.bitsPerPixel != 32 || sourcePixels.bitsPerPixel != 32 || zoom == 0)
+        return;
+
+    // Clip to the bitmap and to the enlarged source.
+    RECT bitmapRect = {0, 0, LONG(rawPixels.width), LONG(rawPixels.height)};
+    RECT zoomedRect = {
+        destRect.left,
+        destRect.top,
+        destRect.left + LONG(sourcePixels.width * zoom),
+        destRect.top + LONG(sourcePixels.height * zoom)
+    };
+    RECT clippedRect, drawRect;
+    if (!IntersectRect(OUT &clippedRect, &destRect, &bitmapRect)
+    ||  !IntersectRect(OUT &drawRect, &clippedRect, &zoomedRect))
+        return;
+
+    GdiFlush(); // Both the source and any pending drawing beneath must land first.
+
+    // The clipped left edge may fall partway into an enlarged pixel.
+    uint32_t const drawWidth = uint32_t(drawRect.right - drawRect.left);
+    uint32_t const zoomedLeft = uint32_t(drawRect.left - destRect.left);
+    uint32_t const sourceLeft = zoomedLeft / zoom;
+    uint32_t const sourceRight = (zoomedLeft + drawWidth + zoom - 1) / zoom;
+    uint32_t const partialPixelOffset = zoomedLeft - sourceLeft * zoom;
+    bool const hasGrid = (gridColor & 0xFF000000) && zoom > 1;
+
+    ForEachScanlineBand(drawRect.top, drawRect.bottom, drawWidth, [&](uint32_t bandTop, uint32_t bandBottom)
+    {
+        // Enlarge each source row once, then copy it to all its scanlines.
+        // Bands may run on other threads, each with its own arena.
+        scratch_vector<uint32_t, false> zoomedRow((sourceRight - sourceLeft) * zoom);
+        uint32_t zoomedSourceY = ~0u;
+
+        uint32_t* destRow = PtrAddByteOffset(reinterpret_cast<uint32_t*>(rawPixels.pixels), bandTop * rawPixels.byteStride);
+        for (uint32_t y = bandTop; y < bandBottom; ++y)
+        {
+            uint32_t const zoomedY = y - uint32_t(destRect.top);
+            uint32_t const sourceY = zoomedY / zoom;
+
+            if (hasGrid && zoomedY % zoom == zoom - 1)
+            {
+                FillPixels(&destRow[drawRect.left], drawWidth, gridColor);
+            }
+            else
+            {
+                if (sourceY != zoomedSourceY)
+                {
+                    auto* sourceRow = PtrAddByteOffset(reinterpret_cast<uint32_t const*>(sourcePixels.pixels), sourceY * sourcePixels.byteStride);
+                    ZoomPixels(zoomedRow.data(), &sourceRow[sourceLeft], sourceRight - sourceLeft, zoom);
+                    if (hasGrid)
+                    {
+                        for (uint32_t x = zoom - 1; x < zoomedRow.size(); x += zoom)
+                        {
+                            zoomedRow[x] = gridColor;
+                        }
+                    }
+                    zoomedSourceY = sourceY;
+                }
+                memcpy(&destRow[drawRect.left], &zoomedRow[partialPixelOffset], drawWidth * sizeof(uint32_t));
+            }
+            destRow = PtrAddByteOffset(destRow, rawPixels.byteStride);
+        }
+    });
+}
+
+
 namespace
 {
     // The often copy&pasted code for loading an
@@ -843,73 +2414,106 @@ namespace
         return S_OK;
     }
 
-    uint32_t GetSolidLineCount(
-        uint32_t* pixels,
+    // Find the bounding rectangle of all pixels differing from the top-left
+    // pixel's color, in a single pass over rows. After the first row with
+    // content, later rows only need their margins outside the edges found so
+    // far checked, so the interior is never read. An image of solid color
+    // yields an empty rectangle at the bottom right.
+    void GetContentBounds(
+        uint32_t const* pixels,
         size_t bytesPerRow,
         uint32_t width,
         uint32_t height,
-        uint32_t maxCount,
-        uint32_t direction, // 0-top, 1-bottom, 2-left, 3-right
+        _Out_ uint32_t& left,
+        _Out_ uint32_t& top,
+        _Out_ uint32_t& right,
+        _Out_ uint32_t& bottom,
         uint32_t mask = 0x00FFFFFF // default mask ignores alpha to only compare color channels
         )
     {
-        uint32_t* sPixel = pixels;
-        ptrdiff_t sDelta = bytesPerRow;
-        ptrdiff_t tDelta = sizeof(*pixels);
+        auto getRow = [=](uint32_t y) -> uint32_t const* { return PtrAddByteOffset(pixels, y * bytesPerRow); };
+        uint32_t const backgroundColor = pixels[0] & mask;
 
-        switch (direction)
+        // The first row with content also gives the initial left and right edges.
+        left = width;
+        right = width;
+        for (top = 0; top < height; ++top)
         {
-        default:
-        case 0: // top
-        case 2: // left
-            break;
-
-        case 1: // bottom
-            sPixel = PtrAddByteOffset(pixels, (height - 1) * bytesPerRow);
-            sDelta = -sDelta;
-            break;
-
-        case 3: // right
-            sPixel = pixels + width - 1;
-            tDelta = -tDelta;
-            break;
+            uint32_t const* row = getRow(top);
+            left = FindDifferentPixel(row, width, backgroundColor, mask);
+            if (left < width)
+            {
+                right = FindLastDifferentPixel(row, width, backgroundColor, mask);
+                break;
+            }
         }
-
-        // Get the first pixel color.
-        uint32_t pixelColor = *sPixel & mask;
-
-        // Swap s and t if checking vertical lines instead of horizontal.
-        uint32_t sMax = height;
-        uint32_t tMax = width;
-        if (direction & 2)
+        if (top >= height)
         {
-            std::swap(sMax, tMax);
-            std::swap(sDelta, tDelta);
+            bottom = height;
+            return;
         }
 
-        sMax = std::min(sMax, maxCount);
+        for (bottom = height; bottom > top + 1; --bottom)
+        {
+            if (FindDifferentPixel(getRow(bottom - 1), width, backgroundColor, mask) < width)
+                break;
+        }
 
-        uint32_t s = 0;
-        for ( ; s < sMax; ++s)
+        for (uint32_t y = top + 1; y < bottom; ++y)
         {
-            uint32_t* tPixel = sPixel;
-            for (uint32_t t = 0; t < tMax; ++t)
+            uint32_t const* row = getRow(y);
+            if (left > 0)
             {
-                if ((*tPixel & mask) != pixelColor)
-                    return s;
-
-                tPixel = PtrAddByteOffset(tPixel, tDelta);
+                left = FindDifferentPixel(row, left, backgroundColor, mask);
+            }
+            if (right < width)
+            {
+                right += FindLastDifferentPixel(row + right, width - right, backgroundColor, mask);
             }
-            sPixel = PtrAddByteOffset(sPixel, sDelta);
         }
+    }
+
 
-        return s;
+    // Encode the pixels as PNG into movable global memory, as the clipboard wants.
+    HRESULT EncodePngToGlobalMemory(
+        IWICImagingFactory* wicFactory,
+        uint8_t const* pixels,
+        uint32_t width,
+        uint32_t height,
+        size_t byteStride,
+        _Out_ HGLOBAL* pngHandle
+        )
+    {
+        *pngHandle = nullptr;
+
+        DrawingCanvas::RawPixels rawPixels = {};
+        rawPixels.pixels = const_cast<uint8_t*>(pixels);
+        rawPixels.width = width;
+        rawPixels.height = height;
+        rawPixels.bitsPerPixel = 32;
+        rawPixels.byteStride = static_cast<uint32_t>(byteStride);
+
+        // The stream leaves its memory alive on release, for the clipboard to own.
+        ComPtr<IStream> stream;
+        IFR(CreateStreamOnHGlobal(nullptr, /*fDeleteOnRelease*/ false, OUT &stream));
+        HGLOBAL streamHandle = nullptr;
+        IFR(GetHGlobalFromStream(stream, OUT &streamHandle));
+        auto freeStreamMemory = DismissableCleanup([=]() { GlobalFree(streamHandle); });
+
+        IFR(EncodeRawPixelsAsPngToStream(wicFactory, rawPixels, stream));
+
+        freeStreamMemory.Dismiss();
+        *pngHandle = streamHandle;
+
+        return S_OK;
     }
 
 
     bool CopyToClipboard(
         HWND hwnd,
         HDC hdc,
+        SIZE usedSize, // Only this much of the bitmap's top left is copied.
+        _In_opt_ IWICImagingFactory* wicFactory, // Also offers PNG if present.
         bool isUpsideDown = false,
         bool shouldTrimEdges = true,
         uint32_t padding = 0
@@ -932,8 +2536,8 @@ namespace
             return false;
         }
 
-        const uint32_t bitmapWidth  = sourceBitmapInfo.dsBm.bmWidth;
-        const uint32_t bitmapHeight = std::abs(sourceBitmapInfo.dsBm.bmHeight);
+        const uint32_t bitmapWidth  = std::min<uint32_t>(sourceBitmapInfo.dsBm.bmWidth, std::max(usedSize.cx, 0L));
+        const uint32_t bitmapHeight = std::min<uint32_t>(std::abs(sourceBitmapInfo.dsBm.bmHeight), std::max(usedSize.cy, 0L));
         uint32_t top    = 0;
         uint32_t left   = 0;
         uint32_t right = bitmapWidth;
@@ -942,11 +2546,8 @@ namespace
         if (shouldTrimEdges)
         {
             const size_t bytesPerRow = sourceBitmapInfo.dsBm.bmWidthBytes;
-            uint32_t* pixels = reinterpret_cast<uint32_t*>(sourceBitmapInfo.dsBm.bmBits);
-            top     = GetSolidLineCount(pixels, bytesPerRow, bitmapWidth, bitmapHeight, bitmapHeight, 0);
-            bottom -= GetSolidLineCount(pixels, bytesPerRow, bitmapWidth, bitmapHeight, bitmapHeight - top, 1);
-            left    = GetSolidLineCount(pixels, bytesPerRow, bitmapWidth, bitmapHeight, bitmapWidth, 2);
-            right  -= GetSolidLineCount(pixels, bytesPerRow, bitmapWidth, bitmapHeight, bitmapWidth - left, 3);
+            uint32_t const* pixels = reinterpret_cast<uint32_t const*>(sourceBitmapInfo.dsBm.bmBits);
+            GetContentBounds(pixels, bytesPerRow, bitmapWidth, bitmapHeight, OUT left, OUT top, OUT right, OUT bottom);
 
             top     = std::max(int32_t(top    - padding), 0);
             bottom  = std::min(int32_t(bottom + padding), int32_t(bitmapHeight));
@@ -1003,7 +2604,7 @@ namespace
                 header.bV5ProfileSize   = 0; // ignored
                 header.bV5Reserved      = 0; // ignored
 
-                if (isUpsideDown && !shouldTrimEdges)
+                if (isUpsideDown && !shouldTrimEdges && width == uint32_t(sourceBitmapInfo.dsBm.bmWidth))
                 {
                     // Header already copied.
 
@@ -1050,6 +2651,26 @@ namespace
                 {
                     GlobalFree(destHandle);
                 }
+
+                // Also offer PNG, which is far smaller for large canvases and
+                // is preferred by most paste targets. Upside down sources are
+                // rare enough to only get the DIB.
+                if (succeeded && wicFactory != nullptr && !isUpsideDown && width > 0 && height > 0)
+                {
+                    const size_t sourceByteStride = sourceBitmapInfo.dsBm.bmWidthBytes;
+                    uint8_t const* sourcePixels = reinterpret_cast<uint8_t const*>(sourceBitmapInfo.dsBm.bmBits)
+                                                + top * sourceByteStride
+                                                + left * singlePixelByteCount;
+                    HGLOBAL pngHandle = nullptr;
+                    if (SUCCEEDED(EncodePngToGlobalMemory(wicFactory, sourcePixels, width, height, sourceByteStride, OUT &pngHandle)))
+                    {
+                        static UINT const pngClipboardFormat = RegisterClipboardFormat(L"PNG");
+                        if (SetClipboardData(pngClipboardFormat, pngHandle) == nullptr)
+                        {
+                            GlobalFree(pngHandle);
+                        }
+                    }
+                }
             }
             CloseClipboard();
         }
@@ -1066,5 +2687,5 @@ bool DrawingCanvas::CopyToClipboard(HWND hwnd)
         return false;
     }
 
-    return ::CopyToClipboard(hwnd, target_->GetMemoryDC(), /*isUpsideDown*/false, /*shouldTrimEdges*/true, /*padding*/4);
+    return ::CopyToClipboard(hwnd, target_->GetMemoryDC(), targetSize_, GetWicFactoryWeakRef(), /*isUpsideDown*/false, /*shouldTrimEdges*/true, /*padding*/4);
 }
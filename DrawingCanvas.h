@@ -204,14 +204,113 @@ public:
         CurrentRenderingApiGdiPlus,
     };
 
-    struct SharedResource
+    struct SharedResourceKey
     {
         UUID typeUuid;              // Type of the resource.
-        std::u16string name;        // Distinct name if there can be multiple of the same type.
-        uint32_t freshnessCount;    // Resource may be released upon reaching 0.
+        uint32_t nameId;            // Interned name, distinct if there can be multiple of the same type.
+
+        bool operator==(SharedResourceKey const& other) const noexcept
+        {
+            return nameId == other.nameId && typeUuid == other.typeUuid;
+        }
+    };
+
+    struct SharedResourceKeyHasher
+    {
+        size_t operator()(SharedResourceKey const& key) const noexcept
+        {
+            uint32_t const* uuidWords = reinterpret_cast<uint32_t const*>(&key.typeUuid);
+            return size_t(uuidWords[0] ^ uuidWords[3]) * 0x9E3779B1u + key.nameId;
+        }
+    };
+
+    struct SharedResource
+    {
+        uint32_t lastUsedGeneration;// Generation when last gotten or set, for least recently used eviction.
+        size_t byteSize;            // Approximate memory cost, or 0 if negligible or unknown.
         ComPtr<IUnknown> resource;  // Pointer to generic resource.
     };
 
+    // Resources unused for this many calls to RetireStaleSharedResources are released.
+    static constexpr uint32_t maximumSharedResourceIdleGenerations = 1;
+
+    // Which factories a cloned canvas gets of its own, rather than sharing
+    // the original's. The rules for what may cross threads:
+    //
+    //  - A canvas, with its render targets, brushes, glyph atlas, and shared
+    //    resources, is used by only one thread at a time. Give each worker its
+    //    own canvas (see DrawingCanvasPool) rather than locking one.
+    //  - DWrite factories, font collections, font faces, and built text layouts
+    //    are free threaded and may be shared, so long as nothing modifies a
+    //    layout another thread is reading. Objects from different factories
+    //    should not be mixed, such as a face from an isolated factory in
+    //    another factory's layout.
+    //  - D2D resources stay with the thread of their single threaded factory.
+    //    Device independent ones (geometries, stroke styles) may cross threads
+    //    only if their factory is multithreaded, and device dependent ones
+    //    (brushes, bitmaps) never leave their render target. A multithreaded
+    //    factory serializes drawing across all its targets.
+    //  - GDI objects select into one DC at a time, and GDI+ objects are not
+    //    thread safe, so both stay with their canvas.
+    //  - The WIC factory is free threaded, but its bitmaps and streams are not.
+    enum FactoryIsolation
+    {
+        FactoryIsolationNone,               // Share every factory, for use on the same thread (or just one at a time).
+        FactoryIsolationPerThreadD2D,       // Own single threaded D2D factory, sharing DWrite and so the drawable objects' layouts and faces.
+        FactoryIsolationPerThread,          // Own isolated DWrite factory too, for independent jobs that load their own objects.
+        FactoryIsolationMultithreadedD2D,   // Share a multithreaded D2D factory, so cached geometries may cross threads.
+    };
+
+    // Rasterized glyph for the glyph atlas. The rendering params are part of
+    // the key because their contrast and pixel geometry are baked into the
+    // coverage.
+    struct GlyphAtlasKey
+    {
+        IDWriteFontFace* fontFace;
+        IDWriteRenderingParams* renderingParams;
+        float fontEmSize;
+        uint16_t glyphId;
+        uint8_t renderingMode;      // DWRITE_RENDERING_MODE
+        uint8_t measuringMode;      // DWRITE_MEASURING_MODE
+        uint8_t subpixelPosition;   // Horizontal offset within the pixel, in units of 1/glyphAtlasSubpixelCount.
+
+        bool operator==(GlyphAtlasKey const& other) const noexcept
+        {
+            return fontFace == other.fontFace
+                && renderingParams == other.renderingParams
+                && fontEmSize == other.fontEmSize
+                && glyphId == other.glyphId
+                && renderingMode == other.renderingMode
+                && measuringMode == other.measuringMode
+                && subpixelPosition == other.subpixelPosition;
+        }
+    };
+
+    struct GlyphAtlasKeyHasher
+    {
+        size_t operator()(GlyphAtlasKey const& key) const noexcept
+        {
+            size_t hash = reinterpret_cast<size_t>(key.fontFace) ^ (reinterpret_cast<size_t>(key.renderingParams) << 1);
+            hash = hash * 0x9E3779B1u + reinterpret_cast<uint32_t const&>(key.fontEmSize);
+            hash = hash * 0x9E3779B1u + (key.glyphId | (key.renderingMode << 16) | (key.measuringMode << 20) | (key.subpixelPosition << 24));
+            return hash;
+        }
+    };
+
+    struct GlyphAtlasEntry
+    {
+        int32_t left;               // Offset of the coverage from the pen position, in whole pixels.
+        int32_t top;
+        uint32_t width;
+        uint32_t height;
+        size_t coverageOffset;      // Index into glyphAtlasCoverage_.
+    };
+
+    static constexpr uint32_t glyphAtlasSubpixelCount = 4;
+
+    // The atlas is cleared once its coverage exceeds this many pixels.
+    static constexpr size_t maximumGlyphAtlasPixels = 4u << 20;
+
     ////////////////////////////////////////
     // Initialization/finalization
 
@@ -223,11 +322,11 @@ public:
 
     IDWriteFactory* GetDWriteFactoryWeakRef() { return dwriteFactory_; };
     ID2D1Factory* GetD2DFactoryWeakRef() { return d2dFactory_; };
-    IWICImagingFactory* GetWicFactoryWeakRef() { return wicFactory_; };
+    IWICImagingFactory* GetWicFactoryWeakRef(); // Created on first use, null if that fails.
     void SetDWriteFactory(IDWriteFactory* factory);
     void SetD2DFactory(ID2D1Factory* factory);
     void SetWicFactory(IWICImagingFactory* factory);
-    void Clone(_COM_Outptr_ DrawingCanvas** newDrawingCanvas);
+    void Clone(_COM_Outptr_ DrawingCanvas** newDrawingCanvas, FactoryIsolation factoryIsolation = FactoryIsolationNone);
 
     void UninitializeForRendering();
 
@@ -241,13 +340,54 @@ protected:
     ComPtr<IDWriteFactory>              dwriteFactory_;
     ComPtr<ID2D1Factory>                d2dFactory_;
     ComPtr<IWICImagingFactory>          wicFactory_;
+    DWRITE_FACTORY_TYPE                 dwriteFactoryType_ = DWRITE_FACTORY_TYPE_SHARED;    // For factories created on demand.
+    D2D1_FACTORY_TYPE                   d2dFactoryType_ = D2D1_FACTORY_TYPE_SINGLE_THREADED;
     ComPtr<IDWriteRenderingParams>      renderingParams_;
     ComPtr<IDWriteGdiInterop>           gdiInterop_;
-    GdiPlusStartupAutoResource          gdiplusToken_;
-    std::vector<SharedResource>         sharedResources_;
+
+    // Shared resources are indexed by type and interned name. Names without
+    // any resources left are freed as resources are retired or trimmed, since
+    // content keys like text hashes get a new name on every edit, and their
+    // ids are reused. The views in the name map point into the deque, which
+    // never moves them.
+    std::unordered_map<SharedResourceKey, SharedResource, SharedResourceKeyHasher> sharedResources_;
+    std::unordered_map<std::u16string_view, uint32_t> sharedResourceNameIds_;
+    std::deque<std::u16string>          sharedResourceNames_;
+    std::vector<uint32_t>               freeSharedResourceNameIds_;
+    uint32_t                            sharedResourceGeneration_ = 0;
+    size_t                              sharedResourceTotalByteSize_ = 0;
+    size_t                              sharedResourceByteBudget_ = SIZE_MAX;
 
     CurrentRenderingApi currentRenderingApi_ = CurrentRenderingApiAny;
 
+    // Per glyph coverage, packed as one BGR coverage value per pixel to match
+    // the DIB layout, and the faces and rendering params keyed by pointer,
+    // held so that their addresses can't be reused by other objects.
+    bool isGlyphAtlasEnabled_ = false;
+    std::unordered_map<GlyphAtlasKey, GlyphAtlasEntry, GlyphAtlasKeyHasher> glyphAtlasEntries_;
+    std::unordered_map<IUnknown*, ComPtr<IUnknown>> glyphAtlasReferences_;
+    std::vector<uint32_t> glyphAtlasCoverage_;
+
+    // Optional hardware Direct2D target, drawn on the GPU and synchronized
+    // with the DIB at each D2D session's start and end (see SetD2DHardwareEnabled).
+    bool isD2DHardwareEnabled_ = false;
+    bool isD2DBatchActive_ = false;
+    ComPtr<ID3D11Device>                d3dDevice_;
+    ComPtr<ID2D1DeviceContext>          targetD2DHardware_;
+    ComPtr<ID2D1Bitmap1>                targetD2DHardwareBitmap_;   // Render target bitmap of targetD2DHardware_.
+    ComPtr<ID2D1Bitmap1>                targetD2DReadbackBitmap_;   // CPU readable copy for the DIB.
+    ComPtr<ID2D1SolidColorBrush>        brushHardware_;             // Scratch brush belonging to targetD2DHardware_.
+
+    // One flag per tile of the canvas pixels, row by row, set once the tile
+    // is dirty (see InvalidateTiles). All are dirty after a resize.
+    std::vector<uint8_t>                dirtyTiles_;
+    SIZE                                tileGridSize_ = {};         // Tiles across and down.
+    SIZE                                tiledPixelSize_ = {};       // Canvas size the tiles cover.
+
+    // Size of the canvas in use, which may be less than the render target's
+    // capacity (see ResizeRenderTargets).
+    SIZE                                targetSize_ = {};
+
 public:
     virtual HRESULT STDMETHODCALLTYPE QueryInterface(IID const& iid, _Out_ void** object) throw() override
     {
@@ -267,8 +407,8 @@ public:
 
 public:
     IDWriteBitmapRenderTarget* GetDWriteBitmapRenderTargetWeakRef() { return target_; }
-    ID2D1DCRenderTarget* GetD2DRenderTargetWeakRef() { return targetD2D_; }
-    ID2D1SolidColorBrush* GetD2DBrushWeakRef() { return brush_; }
+    ID2D1RenderTarget* GetD2DRenderTargetWeakRef() { return (targetD2DHardware_ != nullptr) ? static_cast<ID2D1RenderTarget*>(targetD2DHardware_) : targetD2D_; }
+    ID2D1SolidColorBrush* GetD2DBrushWeakRef() { return (targetD2DHardware_ != nullptr) ? brushHardware_ : brush_; }
     HDC GetHDC() { return target_ == nullptr ? 0 : target_->GetMemoryDC(); }
     DrawingCanvas::RawPixels GetRawPixels();
 
@@ -276,10 +416,36 @@ public:
     void SetDirectWriteRenderingParams(IDWriteRenderingParams* renderingParams);
 
     HRESULT GetSharedResource(UUID const& typeUuid, _In_z_ char16_t const* name, _COM_Outptr_ IUnknown** resource);
-    HRESULT SetSharedResource(UUID const& typeUuid, _In_z_ char16_t const* name, IUnknown* resource);
-    HRESULT RetireStaleSharedResources();
+    HRESULT SetSharedResource(UUID const& typeUuid, _In_z_ char16_t const* name, IUnknown* resource, size_t byteSize = 0);
+    HRESULT RetireStaleSharedResources(); // Call once per paint to age and release unused resources.
     HRESULT ClearSharedResources();
 
+    // Once the total byte size of resources exceeds the budget, the least
+    // recently used are released early in RetireStaleSharedResources, except
+    // those used since the last retirement. Defaults to no limit.
+    void SetSharedResourceByteBudget(size_t byteBudget) { sharedResourceByteBudget_ = byteBudget; }
+    size_t GetSharedResourceTotalByteSize() const { return sharedResourceTotalByteSize_; }
+
+    // Memory accounting of each shared resource, for finding what holds the
+    // most on large sheets. Resources set without a size are estimated where
+    // the type is known (canvases and font faces), else reported as 0.
+    struct SharedResourceUsage
+    {
+        std::u16string_view name;
+        UUID typeUuid;
+        size_t byteSize;
+        bool isEstimated;           // Size was estimated here rather than given to SetSharedResource.
+    };
+    void GetSharedResourceUsage(_Out_ std::vector<SharedResourceUsage>& usage);
+
+    // Release the largest resources first until at least the given bytes are
+    // freed, or nothing sized remains. Returns the bytes released.
+    size_t TrimSharedResources(size_t byteSizeToRelease);
+
+    // Approximate memory of the render targets (at their capacity, including
+    // any hardware copies) and the glyph atlas.
+    size_t GetRenderTargetByteSize() const;
+
     template <typename T>
     HRESULT GetSharedResource(_In_z_ char16_t const* name, _COM_Outptr_ T** resource)
     {
@@ -293,21 +459,153 @@ public:
     //}
 
     template <typename T>
-    HRESULT SetSharedResource(_In_z_ char16_t const* name, T* resource)
+    HRESULT SetSharedResource(_In_z_ char16_t const* name, T* resource, size_t byteSize = 0)
     {
-        return SetSharedResource(__uuidof(T), name, resource);
+        return SetSharedResource(__uuidof(T), name, resource, byteSize);
     }
 
+protected:
+    uint32_t GetSharedResourceNameId(_In_z_ char16_t const* name, bool shouldAdd);
+    void ReleaseUnusedSharedResourceNames();
+
+public:
+    // With the glyph atlas enabled, glyph runs drawn to the DWrite bitmap
+    // render target reuse each glyph's coverage from a previous paint and are
+    // blended straight into the pixels rather than rasterized again. Runs the
+    // atlas can't reproduce (transformed, outline, vertical, or RTL) fall back
+    // to the render target.
+    void SetGlyphAtlasEnabled(bool isEnabled);
+    bool IsGlyphAtlasEnabled() const noexcept { return isGlyphAtlasEnabled_; }
+    void ClearGlyphAtlas();
+    BitmapRenderTargetGlyphRunDrawer GetGlyphRunDrawer(); // Empty unless the glyph atlas is enabled.
+
+    // Returns S_FALSE if the run is unsupported by the atlas.
+    HRESULT DrawGlyphRunFromAtlas(
+        float baselineOriginX,
+        float baselineOriginY,
+        DWRITE_MEASURING_MODE measuringMode,
+        DWRITE_GLYPH_RUN const& glyphRun,
+        IDWriteRenderingParams* renderingParams,
+        COLORREF textColor
+        );
+
+    // Blend per channel coverage (as the glyph atlas holds it) in the given
+    // color straight into the pixels, clipped to them. Returns S_FALSE if the
+    // pixels are not 32bpp.
+    HRESULT BlendCoverage(
+        RECT const& bounds,
+        array_ref<uint32_t const> coverage, // One value per pixel of bounds, row by row.
+        COLORREF color
+        );
+
+    // With hardware D2D enabled, D2D drawing goes to a D3D11 device context
+    // rather than the software DC render target. Since GDI and the DWrite
+    // bitmap render target still draw into the DIB, BeginDrawD2D uploads the
+    // DIB to the GPU target and EndDrawD2D reads it back, and so fewer longer
+    // D2D sessions are much cheaper than many short ones. If no hardware
+    // device is available, the DC render target is used as before.
+    void SetD2DHardwareEnabled(bool isEnabled);
+    bool IsD2DHardwareEnabled() const noexcept { return isD2DHardwareEnabled_; }
+    bool IsD2DHardwareActive() const noexcept { return targetD2DHardware_ != nullptr; }
+
+    // Use these rather than calling BeginDraw/EndDraw on the D2D render target.
+    // Within a batch, EndDrawD2D leaves the session open for the next D2D
+    // drawing, and it ends only once another API is switched to (or the
+    // batch ends), which saves a flush and readback per call.
+    void BeginDrawD2D();
+    HRESULT EndDrawD2D();
+    void BeginD2DBatch();
+    void EndD2DBatch();
+
+    // The canvas pixels are tracked in square tiles, each either valid,
+    // still holding what was last drawn there, or dirty. A paint then only
+    // needs to redraw the dirty tiles within its update rect, and the rest
+    // can be shown as is, such as when the window is uncovered or just a few
+    // objects changed. Drawing doesn't mark tiles itself, so the caller must
+    // invalidate whatever it changes or whatever the view no longer matches.
+    static constexpr uint32_t tileSize = 256;
+
+    void InvalidateTiles(_In_opt_ RECT const* rect = nullptr); // All tiles if null.
+    void ValidateTiles(RECT const& rect); // Only those wholly within the rect (or the canvas edge).
+
+    // Get the tile aligned bounds of the dirty tiles touching the rect,
+    // clipped to the canvas. Returns false if they are all valid.
+    bool GetDirtyTileRect(RECT const& rect, _Out_ RECT& dirtyRect) const;
+
+protected:
+    void ResetTiles(SIZE size);
+    bool GetTileRange(RECT const& rect, _Out_ RECT& tileRange) const;
+
+    void BeginD2DSession();
+    HRESULT EndD2DSession();
+    HRESULT CreateHardwareRenderTargets(SIZE size);
+    HRESULT CreateHardwareTargetBitmaps(SIZE size);
+    HRESULT ReallocateRenderTargets(SIZE capacity);
+    void ReleaseHardwareRenderTargets();
+
+    HRESULT GetGlyphAtlasEntry(
+        GlyphAtlasKey const& key,
+        IDWriteRenderingParams* renderingParams,
+        _Out_ GlyphAtlasEntry const** entry
+        );
+
+public:
+
     bool PaintPrepare(HDC displayHdc, RECT const& rect); // Create and bind render targets
     bool PaintFinish(HDC displayHdc, RECT const& rect); // Blit to given display HDC.
     void ClearBackground(uint32_t color);
+    void ClearBackground(uint32_t color, RECT const& rect); // Only within the rect.
     void DrawAlphaChannel();
     void DrawGrid(uint32_t color, uint32_t step);
 
+    // Enlarges the source pixels by an integer zoom into the destination rect,
+    // which is clipped to both bitmaps. If the grid color has any alpha, each
+    // enlarged pixel gets a grid line along its right and bottom edge.
+    void DrawZoomedPixels(RawPixels const& sourcePixels, RECT const& destRect, uint32_t zoom, uint32_t gridColor);
+
     bool CopyToClipboard(HWND hwnd);
 
     HRESULT CreateRenderTargetsOnDemand(_In_opt_ HDC templateHdc, SIZE size);
-    HRESULT ResizeRenderTargets(SIZE size);
+    static constexpr LONG renderTargetGranularity = 64; // Grown capacities are a multiple of this.
+    HRESULT ResizeRenderTargets(SIZE size); // Grows the capacity with slack, never shrinks.
+    HRESULT TrimRenderTargets(); // Shrinks the capacity to the size in use. Returns S_FALSE if already there.
+    SIZE GetRenderTargetSize() const noexcept { return targetSize_; }
     HRESULT InitializeRendering();
     void SwitchRenderingAPI(CurrentRenderingApi currentRenderingApi);
 };
+
+
+// Encode 32-bit pixels as PNG into the stream, ignoring alpha. Only the last
+// row's used pixels need be readable, so the pixels may be part of a larger bitmap.
+HRESULT EncodeRawPixelsAsPngToStream(
+    IWICImagingFactory* wicFactory,
+    DrawingCanvas::RawPixels const& rawPixels,
+    IStream* stream
+    );
+
+
+// Canvases for worker threads, each taken by one thread at a time and
+// returned for reuse by later tasks, so that their factories and render
+// targets outlive a single job. New canvases are cloned from the prototype
+// (or an empty canvas without one) with the given factory isolation.
+class DrawingCanvasPool
+{
+public:
+    DrawingCanvasPool(DrawingCanvas::FactoryIsolation factoryIsolation, _In_opt_ DrawingCanvas* prototype = nullptr);
+
+    // Take a free canvas, or create one if none are free.
+    HRESULT Acquire(_COM_Outptr_ DrawingCanvas** drawingCanvas);
+
+    // Give the canvas back once the thread is done drawing into it.
+    void Return(DrawingCanvas* drawingCanvas);
+
+    // Release all the free canvases.
+    void Clear();
+
+protected:
+    std::mutex mutex_;
+    std::vector<ComPtr<DrawingCanvas>> freeCanvases_;
+    ComPtr<DrawingCanvas> prototype_;
+    ComPtr<ID2D1Factory> multithreadedD2DFactory_; // Shared by all canvases with FactoryIsolationMultithreadedD2D.
+    DrawingCanvas::FactoryIsolation factoryIsolation_;
+};
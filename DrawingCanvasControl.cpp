@@ -3,6 +3,7 @@
 //              2015-06-24 Split into base class and Windows control.
 //----------------------------------------------------------------------------
 #include "precomp.h"
+#include "Tracing.h"
 
 MODULE(DrawingCanvasControl)
 
@@ -76,6 +77,25 @@ LRESULT CALLBACK DrawingCanvasControl::WindowProc(HWND hwnd, UINT message, WPARA
 
             if (FAILED(hr))
                 target_.Clear();
+
+            // Restarted on each WM_SIZE, so it only fires after the last one.
+            SetTimer(hwnd, TimerIdTrimRenderTargets, trimRenderTargetsDelay, nullptr);
+        }
+        break;
+
+    case WM_TIMER:
+        if (wParam == TimerIdTrimRenderTargets)
+        {
+            KillTimer(hwnd, TimerIdTrimRenderTargets);
+            if (target_ != nullptr)
+            {
+                // Any reallocation loses the pixels, so redraw them.
+                auto hr = TrimRenderTargets();
+                if (FAILED(hr))
+                    target_.Clear();
+                if (hr != S_FALSE)
+                    NeedRepaint();
+            }
         }
         break;
 
@@ -276,6 +296,13 @@ void DrawingCanvasControl::SendMouseNotification()
 
 void DrawingCanvasControl::Paint(HDC displayHdc, RECT const& rect)
 {
+    TRACE_LOGGING_ACTIVITY(activity, "Paint",
+        TraceLoggingInt32(rect.left, "Left"),
+        TraceLoggingInt32(rect.top, "Top"),
+        TraceLoggingInt32(rect.right, "Right"),
+        TraceLoggingInt32(rect.bottom, "Bottom")
+        );
+
     RECT clientRect = {};
     GetClientRect(hwnd_, OUT &clientRect);
     if (!DrawingCanvas::PaintPrepare(displayHdc, clientRect))
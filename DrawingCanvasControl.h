@@ -73,6 +73,13 @@ public:
         CommandIdResetView = 2,
     };
 
+    enum TimerId : uint32_t
+    {
+        TimerIdTrimRenderTargets = 1, // Shrinks the render targets once resizing is idle.
+    };
+
+    static constexpr uint32_t trimRenderTargetsDelay = 1000; // milliseconds
+
 protected:
     LRESULT CALLBACK WindowProc(
         HWND hWnd, 
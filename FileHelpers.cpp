@@ -19,55 +19,136 @@ EXPORT_END
 
 ////////////////////////////////////////
 
-HRESULT ReadTextFile(const char16_t* filename, OUT std::u16string& text) noexcept
+namespace
 {
-    unsigned long bytesRead;
-    std::vector<char> fileData;
+    // Decode in pieces this big, so each piece's pre-scan and conversion run
+    // while its pages are still in cache.
+    constexpr size_t g_textFileChunkSize = 1 << 20;
 
-    ////////////////////
-    // Open the file handle, and read the contents.
+    // Return the chunk end, backing up so no UTF-8 sequence is split.
+    size_t GetUtf8ChunkEnd(array_ref<char const> utf8text, size_t chunkStart) noexcept
+    {
+        size_t chunkEnd = std::min(chunkStart + g_textFileChunkSize, utf8text.size());
+        if (chunkEnd >= utf8text.size())
+            return chunkEnd;
 
-    HANDLE file = CreateFile(
-                    ToWChar(filename),
-                    GENERIC_READ,
-                    FILE_SHARE_READ,
-                    nullptr,
-                    OPEN_EXISTING,
-                    FILE_FLAG_SEQUENTIAL_SCAN,
-                    nullptr
-                    );
-    FileHandle scopedHandle(file);
+        // Continuation bytes are 10xxxxxx. Stop after three, since ill-formed
+        // runs of them are each replaced anyway.
+        for (size_t i = 0; i < 3 && chunkEnd > chunkStart + 1 && (uint8_t(utf8text[chunkEnd]) & 0xC0) == 0x80; ++i)
+        {
+            --chunkEnd;
+        }
+        return chunkEnd;
+    }
 
-    if (file == INVALID_HANDLE_VALUE)
+
+    HRESULT DecodeTextFileBytes(array_ref<uint8_t const> fileBytes, OUT std::u16string& text)
     {
-        return HRESULT_FROM_WIN32(GetLastError());
+        text.clear();
+
+        // UTF-16LE with byte order mark is copied directly.
+        if (fileBytes.size() >= 2 && fileBytes[0] == 0xFF && fileBytes[1] == 0xFE)
+        {
+            fileBytes.remove_prefix(2);
+            text.resize(fileBytes.size() / sizeof(char16_t));
+            memcpy(&text[0], fileBytes.data(), text.size() * sizeof(char16_t));
+            return S_OK;
+        }
+
+        // Otherwise UTF-8 or ASCII, skipping any byte order mark.
+        array_ref<char const> utf8text = fileBytes.reinterpret_as<char const>();
+        if (utf8text.size() >= 3 && memcmp(utf8text.data(), "\xEF\xBB\xBF", 3) == 0)
+        {
+            utf8text.remove_prefix(3);
+        }
+
+        // Pre-scan each chunk for its exact UTF-16 length, so the destination
+        // is allocated once at its final size rather than at the byte count.
+        std::vector<size_t> chunkUnitCounts;
+        size_t totalUnitCount = 0;
+        for (size_t chunkStart = 0; chunkStart < utf8text.size(); )
+        {
+            size_t const chunkEnd = GetUtf8ChunkEnd(utf8text, chunkStart);
+            size_t const unitCount = CountUtf8ToUtf16CodeUnits(utf8text.get_slice(chunkStart, chunkEnd));
+            chunkUnitCounts.push_back(unitCount);
+            totalUnitCount += unitCount;
+            chunkStart = chunkEnd;
+        }
+        text.resize(totalUnitCount);
+
+        // Convert each chunk directly into its slot of the destination.
+        size_t destOffset = 0;
+        size_t chunkIndex = 0;
+        std::u16string chunkText;
+        for (size_t chunkStart = 0; chunkStart < utf8text.size(); ++chunkIndex)
+        {
+            size_t const chunkEnd = GetUtf8ChunkEnd(utf8text, chunkStart);
+            auto chunk = utf8text.get_slice(chunkStart, chunkEnd);
+            size_t const unitCount = chunkUnitCounts[chunkIndex];
+            size_t bytesConverted = 0;
+            size_t charsConverted = ConvertTextUtf8ToUtf16(
+                chunk,
+                OUT array_ref<char16_t>(&text[destOffset], unitCount),
+                OUT &bytesConverted
+                );
+
+            if (bytesConverted < chunk.size() || charsConverted < unitCount)
+            {
+                // Ill-formed UTF-8 changes the length (U+FFFD per bad byte),
+                // so convert this chunk on its own and splice it in. Any byte
+                // order mark was already skipped, so a U+FEFF starting a later
+                // chunk is text and is kept.
+                chunkText.resize(chunk.size());
+                charsConverted = ConvertTextUtf8ToUtf16(chunk, OUT array_ref<char16_t>(&chunkText[0], chunkText.size()), nullptr);
+                chunkText.resize(charsConverted);
+                text.replace(destOffset, unitCount, chunkText);
+            }
+
+            destOffset += charsConverted;
+            chunkStart = chunkEnd;
+        }
+        assert(destOffset == text.size());
+
+        return S_OK;
     }
+}
+
+
+HRESULT ReadTextFile(const char16_t* filename, OUT std::u16string& text) noexcept
+{
+    text.clear();
+
+    // Map the file rather than reading it onto the heap, which for large
+    // corpora would temporarily need the file size on top of the text.
+    MappedFile mappedFile;
+    IFR(mappedFile.Open(filename));
 
-    const unsigned long fileSize = GetFileSize(file, nullptr);
     try
     {
-        fileData.resize(fileSize);
-        text.resize(fileSize);
+        return DecodeTextFileBytes(mappedFile.GetBytes(), OUT text);
     }
     catch (...)
-    {
-        return E_OUTOFMEMORY;
-    }
-
-    if (!ReadFile(file, OUT fileData.data(), fileSize, OUT &bytesRead, nullptr))
     {
         text.clear();
-        return HRESULT_FROM_WIN32(GetLastError());
+        return E_OUTOFMEMORY;
     }
+}
 
-    scopedHandle.Clear();
 
-    ////////////////////
-    // Convert UTF-8 to UTF-16. Note 'text' already has capacity at least
-    // equal to fileData. So no out-of-memory exceptions will occur.
+HRESULT ReadTextFile(const char16_t* filename, OUT std::shared_ptr<std::u16string const>& text) noexcept
+{
+    text.reset();
 
-    assert(text.size() >= fileData.size());
-    ConvertTextUtf8ToUtf16(fileData, OUT text);
+    try
+    {
+        auto newText = std::make_shared<std::u16string>();
+        IFR(ReadTextFile(filename, OUT *newText));
+        text = std::move(newText);
+    }
+    catch (...)
+    {
+        return E_OUTOFMEMORY;
+    }
 
     return S_OK;
 }
@@ -131,6 +212,110 @@ HRESULT WriteTextFile(
 }
 
 
+Utf8FileWriter::~Utf8FileWriter()
+{
+    Close();
+}
+
+
+HRESULT Utf8FileWriter::Open(_In_z_ const char16_t* filename) noexcept
+{
+    Close();
+
+    HANDLE file = CreateFile(
+                    ToWChar(filename),
+                    GENERIC_WRITE,
+                    0, // No FILE_SHARE_READ
+                    nullptr,
+                    CREATE_ALWAYS,
+                    FILE_FLAG_SEQUENTIAL_SCAN,
+                    nullptr
+                    );
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    file_.Set(file);
+
+    try
+    {
+        buffer_.reserve(bufferThreshold + bufferThreshold / 2);
+        buffer_.assign({char(0xEF),char(0xBB),char(0xBF)});
+    }
+    catch (...)
+    {
+        return E_OUTOFMEMORY;
+    }
+    hr_ = S_OK;
+
+    return S_OK;
+}
+
+
+HRESULT Utf8FileWriter::Write(array_ref<char16_t const> text) noexcept
+{
+    if (file_ == nullptr)
+        return E_NOT_VALID_STATE;
+
+    // Convert in slices no larger than the buffer, so one huge piece does not
+    // triple in memory. Slices never end between a surrogate pair.
+    while (!text.empty() && SUCCEEDED(hr_))
+    {
+        size_t sliceLength = std::min(text.size(), bufferThreshold);
+        if (sliceLength < text.size() && IsLeadingSurrogate(text[sliceLength - 1]))
+            --sliceLength;
+
+        try
+        {
+            AppendTextUtf16ToUtf8({text.data(), sliceLength}, IN OUT buffer_);
+        }
+        catch (...)
+        {
+            return E_OUTOFMEMORY;
+        }
+        text = {text.data() + sliceLength, text.size() - sliceLength};
+
+        if (buffer_.size() >= bufferThreshold)
+        {
+            IFR(Flush());
+        }
+    }
+
+    return hr_;
+}
+
+
+HRESULT Utf8FileWriter::Flush() noexcept
+{
+    if (file_ == nullptr || FAILED(hr_) || buffer_.empty())
+        return hr_;
+
+    unsigned long bytesWritten;
+    if (!WriteFile(file_, buffer_.data(), static_cast<unsigned long>(buffer_.size()), OUT &bytesWritten, nullptr))
+    {
+        hr_ = HRESULT_FROM_WIN32(GetLastError());
+    }
+    buffer_.clear();
+
+    return hr_;
+}
+
+
+HRESULT Utf8FileWriter::Close() noexcept
+{
+    if (file_ == nullptr)
+        return S_OK;
+
+    HRESULT hr = Flush();
+    file_.Clear();
+    buffer_.clear();
+    hr_ = S_OK;
+
+    return hr;
+}
+
+
 HRESULT ReadBinaryFile(const char16_t* filename, IN OUT std::vector<uint8_t>& fileData)
 {
     fileData.clear();
@@ -172,6 +357,207 @@ HRESULT ReadBinaryFile(const char16_t* filename, IN OUT std::vector<uint8_t>& fi
 }
 
 
+HRESULT MappedFile::Open(_In_z_ const char16_t* filename) noexcept
+{
+    Close();
+
+    HANDLE file = CreateFile(
+                    ToWChar(filename),
+                    GENERIC_READ,
+                    FILE_SHARE_DELETE | FILE_SHARE_READ,
+                    nullptr,
+                    OPEN_EXISTING,
+                    FILE_FLAG_RANDOM_ACCESS,
+                    nullptr
+                    );
+    FileHandle scopedHandle(file);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    FILETIME lastWriteTime;
+    if (!GetFileSizeEx(file, OUT &fileSize) || !GetFileTime(file, nullptr, nullptr, OUT &lastWriteTime))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // Zero length files cannot be mapped, but they are still valid (empty) files.
+    if (fileSize.QuadPart > 0)
+    {
+        // The view keeps the section alive after the section handle closes.
+        MemorySectionResource section(CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr));
+        if (section.IsNull())
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        view_.Set(MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0));
+        if (view_.IsNull())
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    fileSize_ = static_cast<size_t>(fileSize.QuadPart);
+    lastWriteTime_ = (uint64_t(lastWriteTime.dwHighDateTime) << 32) | lastWriteTime.dwLowDateTime;
+
+    return S_OK;
+}
+
+
+void MappedFile::Close() noexcept
+{
+    view_.Clear();
+    fileSize_ = 0;
+    lastWriteTime_ = 0;
+}
+
+
+namespace
+{
+    struct FileContentIdentityEntry
+    {
+        uint64_t size;
+        uint64_t lastWriteTime;
+        FileContentIdentity identity;
+    };
+
+    std::mutex g_fileContentIdentityMutex;
+    std::unordered_map<std::u16string, FileContentIdentityEntry> g_fileContentIdentities; // by path
+    std::map<FileContentIdentity, std::u16string> g_canonicalFilenames; // by content
+
+    HRESULT GetFileSizeAndLastWriteTime(_In_z_ const char16_t* filename, _Out_ uint64_t& size, _Out_ uint64_t& lastWriteTime) noexcept
+    {
+        size = 0;
+        lastWriteTime = 0;
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesEx(ToWChar(filename), GetFileExInfoStandard, OUT &attributes))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+        if (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            return HRESULT_FROM_WIN32(ERROR_DIRECTORY_NOT_SUPPORTED);
+        }
+        size = (uint64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        lastWriteTime = (uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+        return S_OK;
+    }
+
+    // Not cryptographic, just fast and well mixed enough that distinct fonts
+    // of equal size do not collide in practice. Reads whole words, folding
+    // in the tail bytes last.
+    uint64_t HashFileContent(array_ref<uint8_t const> bytes) noexcept
+    {
+        constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+        uint64_t hash = 0xCBF29CE484222325ull ^ bytes.size();
+
+        uint8_t const* p = bytes.data();
+        size_t const wordCount = bytes.size() / sizeof(uint64_t);
+        for (size_t i = 0; i < wordCount; ++i, p += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            hash = (hash ^ word) * multiplier;
+            hash ^= hash >> 29;
+        }
+
+        uint64_t tail = 0;
+        size_t const tailSize = bytes.size() % sizeof(uint64_t);
+        if (tailSize > 0)
+        {
+            memcpy(&tail, p, tailSize);
+        }
+        hash = (hash ^ tail) * multiplier;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+}
+
+
+HRESULT GetFileContentIdentity(
+    _In_z_ const char16_t* filename,
+    _Out_ FileContentIdentity& identity,
+    _Out_opt_ std::u16string* canonicalFilename
+    ) noexcept
+{
+    identity = {};
+
+    try
+    {
+        uint64_t size, lastWriteTime;
+        IFR(GetFileSizeAndLastWriteTime(filename, OUT size, OUT lastWriteTime));
+
+        std::u16string filenameKey(filename);
+        bool isKnown = false;
+        {
+            std::lock_guard<std::mutex> lock(g_fileContentIdentityMutex);
+            auto match = g_fileContentIdentities.find(filenameKey);
+            if (match != g_fileContentIdentities.end() && match->second.size == size && match->second.lastWriteTime == lastWriteTime)
+            {
+                identity = match->second.identity;
+                isKnown = true;
+            }
+        }
+
+        // Hash outside the lock, since large files take a while. Two threads
+        // hashing the same file just store the same result.
+        if (!isKnown)
+        {
+            MappedFile file;
+            IFR(file.Open(filename));
+            identity.hash = HashFileContent(file.GetBytes());
+            identity.size = file.GetBytes().size();
+            lastWriteTime = file.GetLastWriteTime();
+
+            std::lock_guard<std::mutex> lock(g_fileContentIdentityMutex);
+            g_fileContentIdentities[filenameKey] = {identity.size, lastWriteTime, identity};
+        }
+
+        if (canonicalFilename != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(g_fileContentIdentityMutex);
+            auto& canonical = g_canonicalFilenames[identity];
+
+            // Keep the earlier path only while its content is still what was
+            // hashed (re-checked by size and time), or else this path takes over.
+            if (!canonical.empty() && canonical != filenameKey)
+            {
+                auto match = g_fileContentIdentities.find(canonical);
+                uint64_t canonicalSize, canonicalLastWriteTime;
+                if (match == g_fileContentIdentities.end()
+                ||  FAILED(GetFileSizeAndLastWriteTime(canonical.c_str(), OUT canonicalSize, OUT canonicalLastWriteTime))
+                ||  match->second.size != canonicalSize
+                ||  match->second.lastWriteTime != canonicalLastWriteTime
+                ||  !(match->second.identity == identity))
+                {
+                    canonical.clear();
+                }
+            }
+            if (canonical.empty())
+            {
+                canonical = filenameKey;
+            }
+            *canonicalFilename = canonical;
+        }
+    }
+    catch (...)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+
 HRESULT WriteBinaryFile(
     _In_z_ const char16_t* filename,
     _In_reads_bytes_(fileDataSize) const void* fileData,
@@ -560,6 +946,24 @@ HRESULT EnumerateMatchingFiles(
     __in_z_opt char16_t const* originalFileMask,
     IN OUT std::u16string& fileNames // Append list of nul-delimited fileNames.
     )
+{
+    return EnumerateMatchingFiles(
+        fileDirectory,
+        originalFileMask,
+        [&](array_ref<char16_t const> newFileNames) -> bool
+        {
+            fileNames.append(newFileNames.data(), newFileNames.size());
+            return true;
+        }
+        );
+}
+
+
+HRESULT EnumerateMatchingFiles(
+    __in_z_opt const char16_t* fileDirectory,
+    __in_z_opt char16_t const* originalFileMask,
+    std::function<bool(array_ref<char16_t const> fileNames)> const& fileNamesCallback
+    )
 {
     if (fileDirectory == nullptr)
         fileDirectory = u"";
@@ -570,6 +974,7 @@ HRESULT EnumerateMatchingFiles(
     std::u16string fileMask;      // input file mask, combined with the file directory
     std::u16string filePath;      // current file path being enumerated
     std::u16string queueNames;// list of nul-terminated filenames
+    std::u16string fileNames;     // nul-terminated filenames found in the current directory
     std::vector<EnumerateMatchingFilesEntry> queue;
 
     size_t fileMaskOffset = 0;
@@ -639,6 +1044,14 @@ HRESULT EnumerateMatchingFiles(
             IN OUT queue
             );
 
+        // Hand over this directory's files before descending further.
+        if (!fileNames.empty())
+        {
+            if (!fileNamesCallback(fileNames))
+                return E_ABORT;
+            fileNames.clear();
+        }
+
         if (queue.empty())
             break;
 
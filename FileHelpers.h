@@ -19,7 +19,8 @@ import Common.AutoResource.Windows;
 #endif
 
 
-HRESULT ReadTextFile(const char16_t* filename, OUT std::u16string& text) noexcept; // Read UTF-8 or ASCII
+HRESULT ReadTextFile(const char16_t* filename, OUT std::u16string& text) noexcept; // Read UTF-8, ASCII, or UTF-16LE with BOM
+HRESULT ReadTextFile(const char16_t* filename, OUT std::shared_ptr<std::u16string const>& text) noexcept; // Same, as one immutable text to share
 HRESULT WriteTextFile(const char16_t* filename, array_ref<char16_t const> text) noexcept;
 HRESULT WriteTextFile(const char16_t* filename, __in_ecount(textLength) const char16_t* text, uint32_t textLength) noexcept; // Write as UTF-8
 HRESULT ReadBinaryFile(const char16_t* filename, OUT std::vector<uint8_t>& fileBytes);
@@ -27,6 +28,74 @@ HRESULT WriteBinaryFile(const char16_t* filename, const std::vector<uint8_t>& fi
 HRESULT WriteBinaryFile(const char16_t* filename, array_ref<uint8_t const> fileData);
 HRESULT WriteBinaryFile(_In_z_ const char16_t* filename, _In_reads_bytes_(fileDataSize) const void* fileData, uint32_t fileDataSize);
 
+// Read-only view of a whole file mapped into memory, so large fonts can be
+// paged in on demand rather than copied onto the heap. Empty files yield an
+// empty byte range.
+class MappedFile
+{
+public:
+    HRESULT Open(_In_z_ const char16_t* filename) noexcept;
+    void Close() noexcept;
+
+    array_ref<uint8_t const> GetBytes() const noexcept
+    {
+        return {reinterpret_cast<uint8_t const*>(view_.Get()), fileSize_};
+    }
+
+    uint64_t GetLastWriteTime() const noexcept { return lastWriteTime_; }
+
+private:
+    MemoryViewResource view_;
+    size_t fileSize_ = 0;
+    uint64_t lastWriteTime_ = 0; // FILETIME as 100ns units
+};
+
+// Identity of a file's bytes, so copies of one font under different paths
+// (system folder, project folder, extracted archives) can share what is
+// loaded from any one of them.
+struct FileContentIdentity
+{
+    uint64_t hash = 0;
+    uint64_t size = 0;
+
+    bool operator==(FileContentIdentity const& other) const noexcept { return hash == other.hash && size == other.size; }
+    bool operator<(FileContentIdentity const& other) const noexcept { return hash < other.hash || (hash == other.hash && size < other.size); }
+};
+
+// Hash the file's content, remembering it per path so the file is only read
+// again when its size or last write time change. Optionally returns the first
+// path seen with identical content (else the given path), so callers can load
+// every copy through one path. Safe to call from any thread.
+HRESULT GetFileContentIdentity(
+    _In_z_ const char16_t* filename,
+    _Out_ FileContentIdentity& identity,
+    _Out_opt_ std::u16string* canonicalFilename = nullptr
+    ) noexcept;
+
+// Sequential UTF-8 file output (with a byte order mark, like WriteTextFile),
+// converting each written piece into a bounded buffer that is written out
+// when full. So large text can be streamed without holding the whole UTF-16
+// text and its UTF-8 copy at once. Pieces should not split surrogate pairs.
+class Utf8FileWriter
+{
+public:
+    ~Utf8FileWriter();
+
+    HRESULT Open(_In_z_ const char16_t* filename) noexcept;
+    HRESULT Write(array_ref<char16_t const> text) noexcept;
+    HRESULT Flush() noexcept; // Write any buffered text to the file.
+    HRESULT Close() noexcept; // Flushes, returning any write failure.
+
+    bool IsOpen() const noexcept { return file_ != nullptr; }
+
+private:
+    static constexpr size_t bufferThreshold = 1 << 16;
+
+    FileHandle file_;
+    std::string buffer_;
+    HRESULT hr_ = S_OK; // First write failure, sticky until closed.
+};
+
 std::u16string GetActualFileName(array_ref<const char16_t> fileName);
 std::u16string GetFullFileName(array_ref<const char16_t> fileName);
 
@@ -37,6 +106,15 @@ HRESULT EnumerateMatchingFiles(
     IN OUT std::u16string& fileNames // Appended onto any existing names. It's safe for this to alias fileDirectory.
     );
 
+// Same, but passing the nul-separated filenames to the callback one directory
+// at a time as they are found, rather than after the whole tree is walked.
+// Returning false from the callback stops the enumeration with E_ABORT.
+HRESULT EnumerateMatchingFiles(
+    __in_z_opt const char16_t* fileDirectory,
+    __in_z_opt char16_t const* originalFileMask,
+    std::function<bool(array_ref<char16_t const> fileNames)> const& fileNamesCallback
+    );
+
 const char16_t* FindFileNameStart(array_ref<const char16_t> fileName);
 
 // Returns a pointer to the extension found or the end of the string if not found.
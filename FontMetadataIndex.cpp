@@ -0,0 +1,607 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Persistent index of font file names, properties, and
+//                  coverage, so reloading a font folder only reopens files
+//                  that changed since they were last read.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "FileHelpers.h"
+#include "Attributes.h"
+#include "TextTreeParser.h"
+
+
+MODULE(FontMetadataIndex)
+EXPORT_BEGIN
+    #include "FontMetadataIndex.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    char16_t const* g_fontMetadataIndexContent = u"TextLayoutSamplerFontIndex";
+
+    enum FontFileKey
+    {
+        FontFileKeyPath,
+        FontFileKeySize,
+        FontFileKeyModified,
+        FontFileKeyDWriteFamily,
+        FontFileKeyGdiFamily,
+        FontFileKeyDWriteWeight,
+        FontFileKeyDWriteStretch,
+        FontFileKeyDWriteSlope,
+        FontFileKeyGdiWeight,
+        FontFileKeyGdiSlope,
+        FontFileKeyFaces,
+        FontFileKeyTotal,
+    };
+
+    // Ordered like the enum, so that storing can index the names by key.
+    Attribute::PredefinedValue const g_fontFileKeys[] = {
+        {FontFileKeyPath,           u"path"},
+        {FontFileKeySize,           u"size"},
+        {FontFileKeyModified,       u"modified"},
+        {FontFileKeyDWriteFamily,   u"dwriteFamily"},
+        {FontFileKeyGdiFamily,      u"gdiFamily"},
+        {FontFileKeyDWriteWeight,   u"dwriteWeight"},
+        {FontFileKeyDWriteStretch,  u"dwriteStretch"},
+        {FontFileKeyDWriteSlope,    u"dwriteSlope"},
+        {FontFileKeyGdiWeight,      u"gdiWeight"},
+        {FontFileKeyGdiSlope,       u"gdiSlope"},
+        {FontFileKeyFaces,          u"faces"},
+    };
+    static_assert(countof(g_fontFileKeys) == FontFileKeyTotal, "Font file key names must match the enum.");
+
+    enum FontFaceKey
+    {
+        FontFaceKeyFamilyIndex,
+        FontFaceKeyFaceIndex,
+        FontFaceKeyFamily,
+        FontFaceKeyFace,
+        FontFaceKeyWin32Family,
+        FontFaceKeyWin32Face,
+        FontFaceKeyPreferredFamily,
+        FontFaceKeyPreferredFace,
+        FontFaceKeyFullName,
+        FontFaceKeyWeight,
+        FontFaceKeyStretch,
+        FontFaceKeyStyle,
+        FontFaceKeySimulations,
+        FontFaceKeyAxes,
+        FontFaceKeyCoverage,
+        FontFaceKeyTotal,
+    };
+
+    // Ordered like the enum, as above.
+    Attribute::PredefinedValue const g_fontFaceKeys[] = {
+        {FontFaceKeyFamilyIndex,    u"familyIndex"},
+        {FontFaceKeyFaceIndex,      u"faceIndex"},
+        {FontFaceKeyFamily,         u"family"},
+        {FontFaceKeyFace,           u"face"},
+        {FontFaceKeyWin32Family,    u"win32Family"},
+        {FontFaceKeyWin32Face,      u"win32Face"},
+        {FontFaceKeyPreferredFamily,u"preferredFamily"},
+        {FontFaceKeyPreferredFace,  u"preferredFace"},
+        {FontFaceKeyFullName,       u"full"},
+        {FontFaceKeyWeight,         u"weight"},
+        {FontFaceKeyStretch,        u"stretch"},
+        {FontFaceKeyStyle,          u"style"},
+        {FontFaceKeySimulations,    u"simulations"},
+        {FontFaceKeyAxes,           u"axes"},
+        {FontFaceKeyCoverage,       u"coverage"},
+    };
+    static_assert(countof(g_fontFaceKeys) == FontFaceKeyTotal, "Font face key names must match the enum.");
+
+
+    HRESULT GetFileSizeAndLastWriteTime(
+        _In_z_ char16_t const* filePath,
+        _Out_ uint64_t& fileSize,
+        _Out_ uint64_t& lastWriteTime
+        )
+    {
+        fileSize = 0;
+        lastWriteTime = 0;
+
+        // Only the directory entry is read, not the file itself.
+        WIN32_FILE_ATTRIBUTE_DATA fileAttributes;
+        if (!GetFileAttributesEx(ToWChar(filePath), GetFileExInfoStandard, OUT &fileAttributes))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        fileSize = (uint64_t(fileAttributes.nFileSizeHigh) << 32) | fileAttributes.nFileSizeLow;
+        lastWriteTime = (uint64_t(fileAttributes.ftLastWriteTime.dwHighDateTime) << 32) | fileAttributes.ftLastWriteTime.dwLowDateTime;
+        return S_OK;
+    }
+
+
+    void SetKeyValue(TextTree::NodePointer node, _In_z_ char16_t const* keyName, std::u16string const& value)
+    {
+        node.SetKeyValue(keyName, value.c_str(), static_cast<uint32_t>(value.size()));
+    }
+
+
+    void SetKeyValue(TextTree::NodePointer node, _In_z_ char16_t const* keyName, uint64_t value, bool isHexadecimal = false)
+    {
+        wchar_t buffer[24];
+        swprintf_s(buffer, isHexadecimal ? L"%016llX" : L"%llu", value);
+        node.SetKeyValue(keyName, ToChar16(buffer), static_cast<uint32_t>(wcslen(buffer)));
+    }
+
+
+    uint32_t ParseUint32(std::u16string const& text)
+    {
+        return wcstoul(ToWChar(text.c_str()), nullptr, 10);
+    }
+
+
+    // Axis values are written as space separated tag=value pairs, like "wght=400 wdth=100".
+    void GetAxisValuesText(array_ref<DWRITE_FONT_AXIS_VALUE const> axisValues, _Out_ std::u16string& text)
+    {
+        text.clear();
+        for (auto const& axisValue : axisValues)
+        {
+            wchar_t buffer[32];
+            uint32_t tag = axisValue.axisTag;
+            swprintf_s(buffer, L"%s%c%c%c%c=%g",
+                text.empty() ? L"" : L" ",
+                wchar_t(tag & 0xFF), wchar_t((tag >> 8) & 0xFF), wchar_t((tag >> 16) & 0xFF), wchar_t(tag >> 24),
+                axisValue.value
+                );
+            text.append(ToChar16(buffer));
+        }
+    }
+
+
+    void ParseAxisValuesText(std::u16string const& text, _Out_ std::vector<DWRITE_FONT_AXIS_VALUE>& axisValues)
+    {
+        axisValues.clear();
+        wchar_t const* p = ToWChar(text.c_str());
+        while (*p != '\0')
+        {
+            while (*p == ' ')
+                ++p;
+
+            if (wcslen(p) < 5 || p[4] != '=')
+                break;
+
+            DWRITE_FONT_AXIS_VALUE axisValue;
+            axisValue.axisTag = DWRITE_MAKE_FONT_AXIS_TAG(uint8_t(p[0]), uint8_t(p[1]), uint8_t(p[2]), uint8_t(p[3]));
+            wchar_t* valueEnd;
+            axisValue.value = wcstof(p + 5, OUT &valueEnd);
+            axisValues.push_back(axisValue);
+            p = valueEnd;
+        }
+    }
+
+
+    // Coverage is written as comma separated hexadecimal ranges, like "20-7E,A0-17F,2026".
+    void GetCharacterRangesText(array_ref<CharacterRange const> characterRanges, _Out_ std::u16string& text)
+    {
+        text.clear();
+        for (auto const& range : characterRanges)
+        {
+            wchar_t buffer[24];
+            auto const* separator = text.empty() ? L"" : L",";
+            if (range.first == range.last)
+                swprintf_s(buffer, L"%s%X", separator, range.first);
+            else
+                swprintf_s(buffer, L"%s%X-%X", separator, range.first, range.last);
+            text.append(ToChar16(buffer));
+        }
+    }
+
+
+    void ParseCharacterRangesText(std::u16string const& text, _Out_ std::vector<CharacterRange>& characterRanges)
+    {
+        characterRanges.clear();
+        wchar_t const* p = ToWChar(text.c_str());
+        while (*p != '\0')
+        {
+            wchar_t* numberEnd;
+            CharacterRange range;
+            range.first = wcstoul(p, OUT &numberEnd, 16);
+            range.last = range.first;
+            if (numberEnd == p)
+                break;
+
+            p = numberEnd;
+            if (*p == '-')
+            {
+                range.last = wcstoul(p + 1, OUT &numberEnd, 16);
+                p = numberEnd;
+            }
+            characterRanges.push_back(range);
+
+            if (*p == ',')
+                ++p;
+        }
+    }
+
+
+    void LoadFontFaceMetadata(TextTree::NodePointer faceNode, _Out_ FontFaceMetadata& face)
+    {
+        for (TextTree::NodePointer node = faceNode.begin(), nodeEnd = faceNode.end(); node != nodeEnd; ++node)
+        {
+            std::u16string text = node.GetText();
+            std::u16string value = node.GetSubvalue();
+
+            uint32_t key;
+            if (FAILED(Attribute::PredefinedValue::MapNameToValue(g_fontFaceKeys, text.c_str(), OUT key)))
+                continue;
+
+            switch (key)
+            {
+            case FontFaceKeyFamilyIndex:     face.familyIndex = ParseUint32(value); break;
+            case FontFaceKeyFaceIndex:       face.faceIndex = ParseUint32(value); break;
+            case FontFaceKeyFamily:          face.familyName = value; break;
+            case FontFaceKeyFace:            face.faceName = value; break;
+            case FontFaceKeyWin32Family:     face.win32FamilyName = value; break;
+            case FontFaceKeyWin32Face:       face.win32FaceName = value; break;
+            case FontFaceKeyPreferredFamily: face.preferredFamilyName = value; break;
+            case FontFaceKeyPreferredFace:   face.preferredFaceName = value; break;
+            case FontFaceKeyFullName:        face.fullName = value; break;
+            case FontFaceKeyWeight:          face.weight = DWRITE_FONT_WEIGHT(ParseUint32(value)); break;
+            case FontFaceKeyStretch:         face.stretch = DWRITE_FONT_STRETCH(ParseUint32(value)); break;
+            case FontFaceKeyStyle:           face.style = DWRITE_FONT_STYLE(ParseUint32(value)); break;
+            case FontFaceKeySimulations:     face.simulations = DWRITE_FONT_SIMULATIONS(ParseUint32(value)); break;
+            case FontFaceKeyAxes:            ParseAxisValuesText(value, OUT face.axisValues); break;
+            case FontFaceKeyCoverage:        ParseCharacterRangesText(value, OUT face.characterRanges); break;
+            }
+        }
+    }
+
+
+    void LoadFontFileMetadata(TextTree::NodePointer fontNode, _Out_ std::u16string& filePath, _Out_ FontFileMetadata& metadata)
+    {
+        for (TextTree::NodePointer node = fontNode.begin(), nodeEnd = fontNode.end(); node != nodeEnd; ++node)
+        {
+            std::u16string text = node.GetText();
+
+            uint32_t key;
+            if (FAILED(Attribute::PredefinedValue::MapNameToValue(g_fontFileKeys, text.c_str(), OUT key)))
+                continue;
+
+            if (key == FontFileKeyFaces)
+            {
+                for (TextTree::NodePointer faceNode = node.begin(), faceNodeEnd = node.end(); faceNode != faceNodeEnd; ++faceNode)
+                {
+                    metadata.faces.push_back({});
+                    LoadFontFaceMetadata(faceNode, OUT metadata.faces.back());
+                }
+                continue;
+            }
+
+            std::u16string value = node.GetSubvalue();
+            switch (key)
+            {
+            case FontFileKeyPath:           filePath = value; break;
+            case FontFileKeySize:           metadata.fileSize = _wcstoui64(ToWChar(value.c_str()), nullptr, 10); break;
+            case FontFileKeyModified:       metadata.lastWriteTime = _wcstoui64(ToWChar(value.c_str()), nullptr, 16); break;
+            case FontFileKeyDWriteFamily:   metadata.dwriteFamilyName = value; break;
+            case FontFileKeyGdiFamily:      metadata.gdiFamilyName = value; break;
+            case FontFileKeyDWriteWeight:   metadata.dwriteFontWeight = DWRITE_FONT_WEIGHT(ParseUint32(value)); break;
+            case FontFileKeyDWriteStretch:  metadata.dwriteFontStretch = DWRITE_FONT_STRETCH(ParseUint32(value)); break;
+            case FontFileKeyDWriteSlope:    metadata.dwriteFontSlope = DWRITE_FONT_STYLE(ParseUint32(value)); break;
+            case FontFileKeyGdiWeight:      metadata.gdiFontWeight = DWRITE_FONT_WEIGHT(ParseUint32(value)); break;
+            case FontFileKeyGdiSlope:       metadata.gdiFontSlope = DWRITE_FONT_STYLE(ParseUint32(value)); break;
+            }
+        }
+    }
+
+
+    void StoreFontFaceMetadata(FontFaceMetadata const& face, TextTree::NodePointer faceNode)
+    {
+        std::u16string text;
+
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyFamilyIndex].name, face.familyIndex);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyFaceIndex].name, face.faceIndex);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyFamily].name, face.familyName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyFace].name, face.faceName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyWin32Family].name, face.win32FamilyName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyWin32Face].name, face.win32FaceName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyPreferredFamily].name, face.preferredFamilyName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyPreferredFace].name, face.preferredFaceName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyFullName].name, face.fullName);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyWeight].name, face.weight);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyStretch].name, face.stretch);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyStyle].name, face.style);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeySimulations].name, face.simulations);
+        GetAxisValuesText(face.axisValues, OUT text);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyAxes].name, text);
+        GetCharacterRangesText(face.characterRanges, OUT text);
+        SetKeyValue(faceNode, g_fontFaceKeys[FontFaceKeyCoverage].name, text);
+    }
+
+
+    void StoreFontFileMetadata(std::u16string const& filePath, FontFileMetadata const& metadata, TextTree::NodePointer fontNode)
+    {
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyPath].name, filePath);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeySize].name, metadata.fileSize);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyModified].name, metadata.lastWriteTime, /*isHexadecimal*/ true);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyDWriteFamily].name, metadata.dwriteFamilyName);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyGdiFamily].name, metadata.gdiFamilyName);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyDWriteWeight].name, metadata.dwriteFontWeight);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyDWriteStretch].name, metadata.dwriteFontStretch);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyDWriteSlope].name, metadata.dwriteFontSlope);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyGdiWeight].name, metadata.gdiFontWeight);
+        SetKeyValue(fontNode, g_fontFileKeys[FontFileKeyGdiSlope].name, metadata.gdiFontSlope);
+
+        char16_t const* facesKeyName = g_fontFileKeys[FontFileKeyFaces].name;
+        auto facesNode = fontNode.AppendChild(TextTree::Node::TypeArray, facesKeyName, static_cast<uint32_t>(wcslen(ToWChar(facesKeyName))));
+        for (auto const& face : metadata.faces)
+        {
+            auto faceNode = facesNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
+            StoreFontFaceMetadata(face, faceNode);
+        }
+    }
+}
+
+
+HRESULT FontMetadataIndex::Load(_In_z_ char16_t const* indexFilePath)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    fontFiles_.clear();
+    isLoaded_ = true;
+    isChanged_ = false;
+
+    std::u16string inputText;
+    HRESULT hr = ReadTextFile(indexFilePath, OUT inputText);
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) || hr == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND))
+        return S_OK; // Nothing indexed yet.
+    IFR(hr);
+
+    TextTree data;
+    JsonexParser parser(inputText, JsonexParser::OptionsDefault);
+    parser.ReadNodes(IN OUT data);
+
+    // A corrupt index is discarded rather than half trusted, and the next
+    // save replaces it.
+    if (parser.GetErrorCount() > 0)
+    {
+        isChanged_ = true;
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    TextTree::NodePointer subroot = data.BeginFirstChild();
+    for (TextTree::NodePointer node = subroot.begin(), nodeEnd = subroot.end(); node != nodeEnd; ++node)
+    {
+        std::u16string text = node.GetText();
+        if (text == u"content")
+        {
+            if (node.GetSubvalue() != g_fontMetadataIndexContent)
+            {
+                fontFiles_.clear();
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            }
+        }
+        else if (text == u"fonts")
+        {
+            for (TextTree::NodePointer fontNode = node.begin(), fontNodeEnd = node.end(); fontNode != fontNodeEnd; ++fontNode)
+            {
+                std::u16string filePath;
+                FontFileMetadata metadata;
+                LoadFontFileMetadata(fontNode, OUT filePath, OUT metadata);
+                if (filePath.empty())
+                    continue;
+
+                // Drop entries for fonts since deleted or changed, so the index
+                // doesn't keep growing with every font ever loaded. The next
+                // save rewrites the index without them.
+                uint64_t fileSize, lastWriteTime;
+                if (FAILED(GetFileSizeAndLastWriteTime(filePath.c_str(), OUT fileSize, OUT lastWriteTime))
+                ||  metadata.fileSize != fileSize
+                ||  metadata.lastWriteTime != lastWriteTime)
+                {
+                    isChanged_ = true;
+                    continue;
+                }
+
+                fontFiles_[filePath] = std::move(metadata);
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+HRESULT FontMetadataIndex::Save(_In_z_ char16_t const* indexFilePath)
+{
+    if (!isChanged_)
+        return S_FALSE;
+
+    TextTree data;
+    data.Append(TextTree::Node::TypeRoot, 1, u"", 0);
+    TextTree::NodePointer root = data.begin();
+    TextTree::NodePointer subroot = root.AppendChild(TextTree::Node::TypeObject, u"", 0);
+
+    subroot.SetKeyValue(u"content", g_fontMetadataIndexContent, static_cast<uint32_t>(wcslen(ToWChar(g_fontMetadataIndexContent))));
+    auto fontsNode = subroot.AppendChild(TextTree::Node::TypeArray, u"fonts", uint32_t(countof(u"fonts") - 1));
+    for (auto const& fontFile : fontFiles_)
+    {
+        auto fontNode = fontsNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
+        StoreFontFileMetadata(fontFile.first, fontFile.second, fontNode);
+    }
+
+    // Create the containing folder on first use.
+    std::u16string directoryPath(indexFilePath, FindFileNameStart({indexFilePath, wcslen(ToWChar(indexFilePath))}));
+    if (!directoryPath.empty())
+    {
+        CreateDirectory(ToWChar(directoryPath.c_str()), nullptr);
+    }
+
+    JsonexWriter writer(JsonexWriter::OptionsDefault);
+    writer.WriteNodes(data);
+    array_ref<char16_t const> outputJson = writer.GetText();
+    IFR(WriteTextFile(indexFilePath, outputJson.data(), static_cast<uint32_t>(outputJson.size())));
+
+    isChanged_ = false;
+    return S_OK;
+}
+
+
+HRESULT FontMetadataIndex::GetFontFileMetadata(
+    IDWriteFactory* dwriteFactory,
+    _In_z_ char16_t const* filePath,
+    _Out_ FontFileMetadata const** metadata
+    )
+{
+    *metadata = nullptr;
+
+    uint64_t fileSize, lastWriteTime;
+    IFR(GetFileSizeAndLastWriteTime(filePath, OUT fileSize, OUT lastWriteTime));
+
+    std::u16string key(filePath);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto match = fontFiles_.find(key);
+        if (match != fontFiles_.end()
+        &&  match->second.fileSize == fileSize
+        &&  match->second.lastWriteTime == lastWriteTime)
+        {
+            *metadata = &match->second;
+            return S_OK;
+        }
+    }
+
+    FontFileMetadata newMetadata;
+    IFR(ReadFontFileMetadata(dwriteFactory, filePath, OUT newMetadata));
+
+    *metadata = &AddFontFileMetadata(filePath, std::move(newMetadata));
+
+    return S_OK;
+}
+
+
+bool FontMetadataIndex::FindCurrentFontFileMetadata(
+    _In_z_ char16_t const* filePath,
+    _Out_ FontFileMetadata& metadata
+    )
+{
+    uint64_t fileSize, lastWriteTime;
+    if (FAILED(GetFileSizeAndLastWriteTime(filePath, OUT fileSize, OUT lastWriteTime)))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto match = fontFiles_.find(filePath);
+    if (match == fontFiles_.end()
+    ||  match->second.fileSize != fileSize
+    ||  match->second.lastWriteTime != lastWriteTime)
+    {
+        return false;
+    }
+
+    metadata = match->second;
+    return true;
+}
+
+
+FontFileMetadata const& FontMetadataIndex::AddFontFileMetadata(
+    _In_z_ char16_t const* filePath,
+    FontFileMetadata&& metadata
+    )
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = fontFiles_[filePath];
+    entry = std::move(metadata);
+    isChanged_ = true;
+    return entry;
+}
+
+
+HRESULT FontMetadataIndex::ReadFontFileMetadata(
+    IDWriteFactory* dwriteFactory,
+    _In_z_ char16_t const* filePath,
+    _Out_ FontFileMetadata& metadata
+    )
+{
+    metadata = {};
+    IFR(GetFileSizeAndLastWriteTime(filePath, OUT metadata.fileSize, OUT metadata.lastWriteTime));
+
+    ComPtr<IDWriteGdiInterop> gdiInterop;
+    ComPtr<IDWriteFontCollection> fontCollection;
+    IFR(dwriteFactory->GetGdiInterop(OUT &gdiInterop));
+    IFR(CreateFontCollection(dwriteFactory, DWRITE_FONT_FAMILY_MODEL_WEIGHT_STRETCH_STYLE, ToWChar(filePath), IntLen(filePath), OUT &fontCollection));
+
+    std::u16string familyName;
+    FontCharacterRangesCache characterRangesCache; // Just for this file's faces.
+
+    for (uint32_t familyIndex = 0, familyCount = fontCollection->GetFontFamilyCount(); familyIndex < familyCount; ++familyIndex)
+    {
+        ComPtr<IDWriteFontFamily> fontFamily;
+        if (FAILED(fontCollection->GetFontFamily(familyIndex, OUT &fontFamily)))
+            continue;
+
+        GetFontFamilyName(fontFamily.Get(), nullptr, OUT familyName);
+
+        for (uint32_t faceIndex = 0, faceCount = fontFamily->GetFontCount(); faceIndex < faceCount; ++faceIndex)
+        {
+            ComPtr<IDWriteFont> font;
+            if (FAILED(fontFamily->GetFont(faceIndex, OUT &font)))
+                continue;
+
+            metadata.faces.push_back({});
+            FontFaceMetadata& face = metadata.faces.back();
+            face.familyIndex = familyIndex;
+            face.faceIndex = faceIndex;
+            face.familyName = familyName;
+            GetFontFaceName(font, nullptr, OUT face.faceName);
+            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_WIN32_FAMILY_NAMES, nullptr, OUT face.win32FamilyName);
+            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_WIN32_SUBFAMILY_NAMES, nullptr, OUT face.win32FaceName);
+            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_PREFERRED_FAMILY_NAMES, nullptr, OUT face.preferredFamilyName);
+            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_PREFERRED_SUBFAMILY_NAMES, nullptr, OUT face.preferredFaceName);
+            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_FULL_NAME, nullptr, OUT face.fullName);
+            face.weight = font->GetWeight();
+            face.stretch = font->GetStretch();
+            face.style = font->GetStyle();
+            face.simulations = font->GetSimulations();
+            GetFontAxisValues(font, OUT face.axisValues);
+
+            // Simulated faces share the coverage of their underlying face.
+            ComPtr<IDWriteFontFace> fontFace;
+            if (SUCCEEDED(font->CreateFontFace(OUT &fontFace)))
+            {
+                GetFontCharacterRanges(fontFace, /*getOnlyColorFontCharacters*/ false, &characterRangesCache, OUT face.characterRanges);
+            }
+        }
+    }
+
+    // Record the regular face of the first family, in both naming models.
+    ComPtr<IDWriteFontFamily> firstFontFamily;
+    ComPtr<IDWriteFont> firstFont;
+    IFR(fontCollection->GetFontFamily(/*index*/0, OUT &firstFontFamily));
+    IFR(firstFontFamily->GetFirstMatchingFont(DWRITE_FONT_WEIGHT_NORMAL, DWRITE_FONT_STRETCH_NORMAL, DWRITE_FONT_STYLE_NORMAL, OUT &firstFont));
+
+    metadata.dwriteFontWeight = firstFont->GetWeight();
+    metadata.dwriteFontStretch = firstFont->GetStretch();
+    metadata.dwriteFontSlope = firstFont->GetStyle();
+    metadata.gdiFontWeight = metadata.dwriteFontWeight;
+    metadata.gdiFontSlope = metadata.dwriteFontSlope;
+    GetFontFamilyName(firstFont, /*languageTag*/nullptr, OUT metadata.dwriteFamilyName);
+    metadata.gdiFamilyName = metadata.dwriteFamilyName;
+
+    LOGFONT logFont;
+    BOOL dummyBool;
+    if (SUCCEEDED(gdiInterop->ConvertFontToLOGFONT(firstFont, OUT &logFont, OUT &dummyBool)))
+    {
+        metadata.gdiFamilyName.assign(ToChar16(logFont.lfFaceName));
+        metadata.gdiFontWeight = static_cast<DWRITE_FONT_WEIGHT>(logFont.lfWeight);
+        metadata.gdiFontSlope = logFont.lfItalic ? DWRITE_FONT_STYLE_ITALIC : DWRITE_FONT_STYLE_NORMAL;
+    }
+
+    return S_OK;
+}
+
+
+std::u16string FontMetadataIndex::GetDefaultFilePath()
+{
+    wchar_t filePath[MAX_PATH];
+    uint32_t length = ExpandEnvironmentStrings(L"%LOCALAPPDATA%\\TextLayoutSampler\\FontMetadataIndex.TextLayoutSamplerFontIndex", OUT filePath, countof(filePath));
+    if (length == 0 || length > countof(filePath))
+        return std::u16string();
+
+    return std::u16string(ToChar16(filePath));
+}
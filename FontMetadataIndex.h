@@ -0,0 +1,113 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Persistent index of font file names, properties, and
+//                  coverage, so reloading a font folder only reopens files
+//                  that changed since they were last read.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import Common.ArrayRef;
+import Common.String;
+import DWritEx;
+#else
+#include "Common.ArrayRef.h"
+#include "Common.String.h"
+#include "DWritEx.h"
+#endif
+
+
+struct FontFaceMetadata
+{
+    uint32_t familyIndex;
+    uint32_t faceIndex;
+    std::u16string familyName;
+    std::u16string faceName;
+    std::u16string win32FamilyName;
+    std::u16string win32FaceName;
+    std::u16string preferredFamilyName;
+    std::u16string preferredFaceName;
+    std::u16string fullName;
+    DWRITE_FONT_WEIGHT weight;
+    DWRITE_FONT_STRETCH stretch;
+    DWRITE_FONT_STYLE style;
+    DWRITE_FONT_SIMULATIONS simulations;
+    std::vector<DWRITE_FONT_AXIS_VALUE> axisValues;
+    std::vector<CharacterRange> characterRanges;
+};
+
+
+struct FontFileMetadata
+{
+    // The file is only reread when either of these differ.
+    uint64_t fileSize = 0;
+    uint64_t lastWriteTime = 0;
+
+    std::vector<FontFaceMetadata> faces;
+
+    // Names and properties of the regular face of the first family, with
+    // both the DWrite and GDI naming models.
+    std::u16string dwriteFamilyName;
+    std::u16string gdiFamilyName;
+    DWRITE_FONT_WEIGHT dwriteFontWeight = DWRITE_FONT_WEIGHT_NORMAL;
+    DWRITE_FONT_STRETCH dwriteFontStretch = DWRITE_FONT_STRETCH_NORMAL;
+    DWRITE_FONT_STYLE dwriteFontSlope = DWRITE_FONT_STYLE_NORMAL;
+    DWRITE_FONT_WEIGHT gdiFontWeight = DWRITE_FONT_WEIGHT_NORMAL;
+    DWRITE_FONT_STYLE gdiFontSlope = DWRITE_FONT_STYLE_NORMAL;
+};
+
+
+class FontMetadataIndex
+{
+public:
+    // Read the index file, if any. A missing file is just an empty index.
+    // Entries whose font file is gone or has changed are dropped, and an
+    // unreadable index is discarded entirely, returning ERROR_BAD_FORMAT.
+    HRESULT Load(_In_z_ char16_t const* indexFilePath);
+
+    // Write the index file if anything changed since it was loaded.
+    HRESULT Save(_In_z_ char16_t const* indexFilePath);
+
+    // Return the font file's metadata, reading it from the font only if the
+    // index has no entry matching the file's current size and modified time.
+    // The pointer is valid until the next call.
+    HRESULT GetFontFileMetadata(
+        IDWriteFactory* dwriteFactory,
+        _In_z_ char16_t const* filePath,
+        _Out_ FontFileMetadata const** metadata
+        );
+
+    // Thread safe lookup for background readers, copying out the entry only
+    // if it matches the file's current size and modified time.
+    bool FindCurrentFontFileMetadata(
+        _In_z_ char16_t const* filePath,
+        _Out_ FontFileMetadata& metadata
+        );
+
+    // Store metadata already read elsewhere, like by a background reader.
+    // The reference is valid until the next call.
+    FontFileMetadata const& AddFontFileMetadata(
+        _In_z_ char16_t const* filePath,
+        FontFileMetadata&& metadata
+        );
+
+    static HRESULT ReadFontFileMetadata(
+        IDWriteFactory* dwriteFactory,
+        _In_z_ char16_t const* filePath,
+        _Out_ FontFileMetadata& metadata
+        );
+
+    bool IsLoaded() const noexcept { return isLoaded_; }
+
+    // Per user location, under the local application data folder.
+    static std::u16string GetDefaultFilePath();
+
+private:
+    // Guards fontFiles_ between the UI thread, which is the only writer, and
+    // background readers calling FindCurrentFontFileMetadata.
+    std::mutex mutex_;
+    std::unordered_map<std::u16string, FontFileMetadata> fontFiles_;
+    bool isLoaded_ = false;
+    bool isChanged_ = false;
+};
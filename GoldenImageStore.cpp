@@ -0,0 +1,399 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Baseline images of drawn objects for regression runs,
+//                  keyed by the object's attribute values and DWrite version.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "FileHelpers.h"
+#include "DWritEx.h"
+#include "TextTreeParser.h"
+
+
+MODULE(GoldenImageStore)
+EXPORT_BEGIN
+    #include "GoldenImageStore.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    char16_t const* g_goldenImageIndexContent = u"TextLayoutSamplerGoldenImages";
+    char16_t const* g_goldenImageIndexFileName = u"GoldenImages.TextLayoutSamplerSettings";
+
+    uint64_t const g_fnvOffsetBasis = 0xCBF29CE484222325;
+    uint64_t const g_fnvPrime = 0x100000001B3;
+
+    // Perceptual hash grid, one column wider than tall so that each of the
+    // 64 bits compares horizontally adjacent cells.
+    uint32_t const g_perceptualHashColumns = 9;
+    uint32_t const g_perceptualHashRows = 8;
+
+
+    uint64_t HashBytes(uint64_t hash, _In_reads_bytes_(byteCount) void const* data, size_t byteCount) noexcept
+    {
+        auto* bytes = reinterpret_cast<uint8_t const*>(data);
+        for (size_t i = 0; i < byteCount; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= g_fnvPrime;
+        }
+        return hash;
+    }
+
+
+    template <typename T>
+    uint64_t HashValue(uint64_t hash, T const& value) noexcept
+    {
+        return HashBytes(hash, &value, sizeof(value));
+    }
+
+
+    void SetKeyValue(TextTree::NodePointer node, _In_z_ char16_t const* keyName, uint64_t value, bool isHexadecimal = false)
+    {
+        wchar_t buffer[24];
+        swprintf_s(buffer, isHexadecimal ? L"%016llX" : L"%llu", value);
+        node.SetKeyValue(keyName, ToChar16(buffer), static_cast<uint32_t>(wcslen(buffer)));
+    }
+
+
+    void LoadGoldenImageEntry(TextTree::NodePointer entryNode, _Out_ uint64_t& key, _Out_ GoldenImageEntry& entry)
+    {
+        key = 0;
+        for (TextTree::NodePointer node = entryNode.begin(), nodeEnd = entryNode.end(); node != nodeEnd; ++node)
+        {
+            std::u16string text = node.GetText();
+            std::u16string value = node.GetSubvalue();
+            if (text == u"key")             key = _wcstoui64(ToWChar(value.c_str()), nullptr, 16);
+            else if (text == u"exact")      entry.exactHash = _wcstoui64(ToWChar(value.c_str()), nullptr, 16);
+            else if (text == u"perceptual") entry.perceptualHash = _wcstoui64(ToWChar(value.c_str()), nullptr, 16);
+            else if (text == u"width")      entry.width = wcstoul(ToWChar(value.c_str()), nullptr, 10);
+            else if (text == u"height")     entry.height = wcstoul(ToWChar(value.c_str()), nullptr, 10);
+        }
+    }
+
+
+    void StoreGoldenImageEntry(uint64_t key, GoldenImageEntry const& entry, TextTree::NodePointer entryNode)
+    {
+        SetKeyValue(entryNode, u"key", key, /*isHexadecimal*/ true);
+        SetKeyValue(entryNode, u"exact", entry.exactHash, /*isHexadecimal*/ true);
+        SetKeyValue(entryNode, u"perceptual", entry.perceptualHash, /*isHexadecimal*/ true);
+        SetKeyValue(entryNode, u"width", entry.width);
+        SetKeyValue(entryNode, u"height", entry.height);
+    }
+
+
+    uint32_t CountBits(uint64_t value) noexcept
+    {
+        uint32_t count = 0;
+        for (; value != 0; value &= value - 1)
+        {
+            ++count;
+        }
+        return count;
+    }
+}
+
+
+HRESULT GoldenImageStore::Load(_In_z_ char16_t const* directoryPath, bool shouldUpdateBaselines)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    directoryPath_ = directoryPath;
+    if (!directoryPath_.empty() && directoryPath_.back() != '\\' && directoryPath_.back() != '/')
+    {
+        directoryPath_.push_back('\\');
+    }
+    shouldUpdateBaselines_ = shouldUpdateBaselines;
+    entries_.clear();
+    isChanged_ = false;
+    newCount_ = 0;
+    unchangedCount_ = 0;
+    changedCount_ = 0;
+
+    // Objects draw with the process's DWrite, so a system update invalidates
+    // every baseline rather than reporting them all as changed.
+    dwriteVersion_ = 0;
+    HMODULE dwriteModule = GetModuleHandle(L"dwrite.dll");
+    if (dwriteModule != nullptr)
+    {
+        GetModuleFileVersion(dwriteModule, OUT dwriteVersion_);
+    }
+
+    std::u16string indexFilePath = directoryPath_ + g_goldenImageIndexFileName;
+    std::u16string inputText;
+    HRESULT hr = ReadTextFile(indexFilePath.c_str(), OUT inputText);
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) || hr == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND))
+        return S_OK; // No baselines yet.
+    IFR(hr);
+
+    TextTree data;
+    JsonexParser parser(inputText, JsonexParser::OptionsDefault);
+    parser.ReadNodes(IN OUT data);
+
+    TextTree::NodePointer subroot = data.BeginFirstChild();
+    for (TextTree::NodePointer node = subroot.begin(), nodeEnd = subroot.end(); node != nodeEnd; ++node)
+    {
+        std::u16string text = node.GetText();
+        if (text == u"content")
+        {
+            if (node.GetSubvalue() != g_goldenImageIndexContent)
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        }
+        else if (text == u"images")
+        {
+            for (TextTree::NodePointer entryNode = node.begin(), entryNodeEnd = node.end(); entryNode != entryNodeEnd; ++entryNode)
+            {
+                uint64_t key;
+                GoldenImageEntry entry;
+                LoadGoldenImageEntry(entryNode, OUT key, OUT entry);
+                if (key != 0)
+                {
+                    entries_[key] = entry;
+                }
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+HRESULT GoldenImageStore::Save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!isChanged_)
+        return S_FALSE;
+
+    TextTree data;
+    data.Append(TextTree::Node::TypeRoot, 1, u"", 0);
+    TextTree::NodePointer root = data.begin();
+    TextTree::NodePointer subroot = root.AppendChild(TextTree::Node::TypeObject, u"", 0);
+
+    subroot.SetKeyValue(u"content", g_goldenImageIndexContent, static_cast<uint32_t>(wcslen(ToWChar(g_goldenImageIndexContent))));
+    auto imagesNode = subroot.AppendChild(TextTree::Node::TypeArray, u"images", uint32_t(countof(u"images") - 1));
+    for (auto const& entry : entries_)
+    {
+        auto entryNode = imagesNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
+        StoreGoldenImageEntry(entry.first, entry.second, entryNode);
+    }
+
+    JsonexWriter writer(JsonexWriter::OptionsDefault);
+    writer.WriteNodes(data);
+    array_ref<char16_t const> outputJson = writer.GetText();
+    std::u16string indexFilePath = directoryPath_ + g_goldenImageIndexFileName;
+    IFR(WriteTextFile(indexFilePath.c_str(), outputJson.data(), static_cast<uint32_t>(outputJson.size())));
+
+    isChanged_ = false;
+    return S_OK;
+}
+
+
+uint64_t GoldenImageStore::GetObjectKey(DrawableObjectAndValues const& objectAndValues) const
+{
+    uint64_t hash = HashValue(g_fnvOffsetBasis, dwriteVersion_);
+
+    for (uint32_t id = 0; id < DrawableObjectAttributeTotal; ++id)
+    {
+        if (id == DrawableObjectAttributeLabel)
+            continue;
+
+        SharedString const& stringValue = objectAndValues.values_[id].stringValue;
+        if (stringValue.empty())
+            continue;
+
+        hash = HashValue(hash, id);
+        hash = HashBytes(hash, stringValue.data(), stringValue.size() * sizeof(char16_t));
+    }
+
+    // The path alone says nothing of the file's content, so include its
+    // size and modified time, as FontMetadataIndex does.
+    SharedString const& fontFilePath = objectAndValues.values_[DrawableObjectAttributeFontFilePath].stringValue;
+    WIN32_FILE_ATTRIBUTE_DATA fileAttributes;
+    if (!fontFilePath.empty() && GetFileAttributesEx(ToWChar(fontFilePath.c_str()), GetFileExInfoStandard, OUT &fileAttributes))
+    {
+        hash = HashValue(hash, fileAttributes.nFileSizeLow);
+        hash = HashValue(hash, fileAttributes.nFileSizeHigh);
+        hash = HashValue(hash, fileAttributes.ftLastWriteTime);
+    }
+
+    return (hash != 0) ? hash : 1; // 0 means no key in the index.
+}
+
+
+uint64_t GoldenImageStore::GetExactHash(DrawingCanvas::RawPixels const& rawPixels) noexcept
+{
+    uint64_t hash = HashValue(g_fnvOffsetBasis, rawPixels.width);
+    hash = HashValue(hash, rawPixels.height);
+
+    // Hash two pixels per step rather than each byte, ignoring alpha.
+    uint64_t const pixelPairMask = 0x00FFFFFF00FFFFFF;
+    for (uint32_t y = 0; y < rawPixels.height; ++y)
+    {
+        auto* row = PtrAddByteOffset(reinterpret_cast<uint32_t const*>(rawPixels.pixels), size_t(y) * rawPixels.byteStride);
+        uint32_t x = 0;
+        for (; x + 2 <= rawPixels.width; x += 2)
+        {
+            uint64_t pixelPair;
+            memcpy(&pixelPair, &row[x], sizeof(pixelPair));
+            hash = (hash ^ (pixelPair & pixelPairMask)) * g_fnvPrime;
+            hash ^= hash >> 29;
+        }
+        if (x < rawPixels.width)
+        {
+            hash = (hash ^ (row[x] & 0x00FFFFFF)) * g_fnvPrime;
+        }
+    }
+
+    return hash;
+}
+
+
+uint64_t GoldenImageStore::GetPerceptualHash(DrawingCanvas::RawPixels const& rawPixels) noexcept
+{
+    if (rawPixels.width == 0 || rawPixels.height == 0)
+        return 0;
+
+    // Average the luminance over each grid cell.
+    uint64_t cellSums[g_perceptualHashRows][g_perceptualHashColumns] = {};
+    uint32_t cellCounts[g_perceptualHashRows][g_perceptualHashColumns] = {};
+    for (uint32_t y = 0; y < rawPixels.height; ++y)
+    {
+        uint32_t const cellY = uint32_t(uint64_t(y) * g_perceptualHashRows / rawPixels.height);
+        auto* row = PtrAddByteOffset(reinterpret_cast<uint32_t const*>(rawPixels.pixels), size_t(y) * rawPixels.byteStride);
+        for (uint32_t x = 0; x < rawPixels.width; ++x)
+        {
+            uint32_t const cellX = uint32_t(uint64_t(x) * g_perceptualHashColumns / rawPixels.width);
+            uint32_t const pixel = row[x];
+            uint32_t const luminance = (((pixel >> 16) & 0xFF) * 77 + ((pixel >> 8) & 0xFF) * 150 + (pixel & 0xFF) * 29) >> 8;
+            cellSums[cellY][cellX] += luminance;
+            cellCounts[cellY][cellX]++;
+        }
+    }
+
+    // Set each bit where a cell is brighter than its right neighbor, which
+    // survives slight shifts in antialiasing better than the values would.
+    uint64_t hash = 0;
+    for (uint32_t cellY = 0; cellY < g_perceptualHashRows; ++cellY)
+    {
+        for (uint32_t cellX = 0; cellX + 1 < g_perceptualHashColumns; ++cellX)
+        {
+            uint64_t const left  = cellSums[cellY][cellX]     * std::max(cellCounts[cellY][cellX + 1], 1u);
+            uint64_t const right = cellSums[cellY][cellX + 1] * std::max(cellCounts[cellY][cellX], 1u);
+            hash = (hash << 1) | (left > right ? 1 : 0);
+        }
+    }
+
+    return hash;
+}
+
+
+void GoldenImageStore::GetImageFilePath(uint64_t objectKey, _Out_ std::u16string& imageFilePath) const
+{
+    GetFormattedString(OUT imageFilePath, u"%s%016llX.png", directoryPath_.c_str(), objectKey);
+}
+
+
+HRESULT GoldenImageStore::StoreBaseline(
+    IWICImagingFactory* wicFactory,
+    uint64_t objectKey,
+    DrawingCanvas::RawPixels const& rawPixels,
+    GoldenImageEntry const& entry
+    )
+{
+    std::u16string imageFilePath;
+    GetImageFilePath(objectKey, OUT imageFilePath);
+
+    // Hold the lock while writing, since identical objects in different
+    // settings files share a key and so the file.
+    std::lock_guard<std::mutex> lock(mutex_);
+    CreateDirectory(ToWChar(directoryPath_.c_str()), nullptr);
+    IFR(SaveRawPixelsAsPng(wicFactory, rawPixels, imageFilePath.c_str()));
+    entries_[objectKey] = entry;
+    isChanged_ = true;
+
+    return S_OK;
+}
+
+
+HRESULT GoldenImageStore::Check(
+    IWICImagingFactory* wicFactory,
+    uint64_t objectKey,
+    DrawingCanvas::RawPixels const& rawPixels,
+    _Out_ GoldenImageCheck& check
+    )
+{
+    check.result = GoldenImageCheck::ResultNew;
+    check.perceptualDistance = 0;
+    check.statistics = PixelDiffStatistics();
+    check.heatmap.Resize(0, 0);
+
+    GoldenImageEntry entry;
+    entry.exactHash = GetExactHash(rawPixels);
+    entry.width = rawPixels.width;
+    entry.height = rawPixels.height;
+
+    GoldenImageEntry baseline;
+    bool haveBaseline = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto match = entries_.find(objectKey);
+        if (match != entries_.end())
+        {
+            baseline = match->second;
+            haveBaseline = true;
+        }
+    }
+
+    if (haveBaseline
+    &&  baseline.exactHash == entry.exactHash
+    &&  baseline.width == entry.width
+    &&  baseline.height == entry.height)
+    {
+        check.result = GoldenImageCheck::ResultUnchanged;
+        ++unchangedCount_;
+        return S_OK;
+    }
+
+    // Only now is the perceptual hash worth computing.
+    entry.perceptualHash = GetPerceptualHash(rawPixels);
+
+    if (!haveBaseline)
+    {
+        ++newCount_;
+        if (shouldUpdateBaselines_)
+        {
+            IFR(StoreBaseline(wicFactory, objectKey, rawPixels, entry));
+        }
+        return S_OK;
+    }
+
+    check.result = GoldenImageCheck::ResultChanged;
+    check.perceptualDistance = CountBits(baseline.perceptualHash ^ entry.perceptualHash);
+    ++changedCount_;
+
+    std::u16string imageFilePath;
+    GetImageFilePath(objectKey, OUT imageFilePath);
+    PixelTile baselineTile;
+    IFR(LoadImageFileIntoPixelTile(wicFactory, imageFilePath.c_str(), OUT baselineTile));
+
+    check.heatmap.Resize(std::min(baselineTile.width, rawPixels.width), std::min(baselineTile.height, rawPixels.height));
+    DrawingCanvas::RawPixels heatmapPixels = check.heatmap.GetRawPixels();
+    ComparePixels(baselineTile.GetRawPixels(), rawPixels, OUT check.statistics, &heatmapPixels);
+
+    if (shouldUpdateBaselines_)
+    {
+        IFR(StoreBaseline(wicFactory, objectKey, rawPixels, entry));
+    }
+
+    return S_OK;
+}
+
+
+void GoldenImageStore::GetCounts(_Out_ uint32_t& newCount, _Out_ uint32_t& unchangedCount, _Out_ uint32_t& changedCount) const noexcept
+{
+    newCount = newCount_;
+    unchangedCount = unchangedCount_;
+    changedCount = changedCount_;
+}
@@ -0,0 +1,97 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Baseline images of drawn objects for regression runs,
+//                  keyed by the object's attribute values and DWrite version.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import Common.ArrayRef;
+import Common.String;
+import DrawingCanvas;
+import DrawableObjectAndValues;
+import PixelDiff;
+#else
+#include "Common.ArrayRef.h"
+#include "Common.String.h"
+#include "DrawingCanvas.h"
+#include "DrawableObjectAndValues.h"
+#include "PixelDiff.h"
+#endif
+
+
+struct GoldenImageEntry
+{
+    uint64_t exactHash = 0;         // Of the color channels and size, so equal hashes need no decoding.
+    uint64_t perceptualHash = 0;    // Difference hash of the downsampled luminance.
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+
+struct GoldenImageCheck
+{
+    enum Result
+    {
+        ResultNew,          // No baseline existed for the key.
+        ResultUnchanged,    // Exact hash matched, so nothing was decoded.
+        ResultChanged,      // The baseline was decoded and diffed.
+    };
+
+    Result result = ResultNew;
+    uint32_t perceptualDistance = 0; // Differing bits between the perceptual hashes, 0-64.
+    PixelDiffStatistics statistics;  // Only for ResultChanged.
+    PixelTile heatmap;               // Only for ResultChanged.
+};
+
+
+// A directory holding an index of baseline hashes, plus one PNG per baseline
+// named by its key. Checks are thread safe, so batch workers can share one.
+class GoldenImageStore
+{
+public:
+    // Read the index in the directory, if any. A missing one is just empty.
+    // When updating, new and changed images replace their baselines.
+    HRESULT Load(_In_z_ char16_t const* directoryPath, bool shouldUpdateBaselines);
+
+    // Write the index if any baselines were added or replaced.
+    HRESULT Save();
+
+    // Hash every attribute value that affects the drawn pixels (so not the
+    // label), the content version of any font file, and the DWrite version.
+    uint64_t GetObjectKey(DrawableObjectAndValues const& objectAndValues) const;
+
+    // Compare the drawn object against its baseline, by hash alone where the
+    // pixels match exactly.
+    HRESULT Check(
+        IWICImagingFactory* wicFactory,
+        uint64_t objectKey,
+        DrawingCanvas::RawPixels const& rawPixels,
+        _Out_ GoldenImageCheck& check
+        );
+
+    void GetCounts(_Out_ uint32_t& newCount, _Out_ uint32_t& unchangedCount, _Out_ uint32_t& changedCount) const noexcept;
+
+    bool IsUpdatingBaselines() const noexcept { return shouldUpdateBaselines_; }
+
+    static uint64_t GetExactHash(DrawingCanvas::RawPixels const& rawPixels) noexcept;
+    static uint64_t GetPerceptualHash(DrawingCanvas::RawPixels const& rawPixels) noexcept;
+
+private:
+    void GetImageFilePath(uint64_t objectKey, _Out_ std::u16string& imageFilePath) const;
+    HRESULT StoreBaseline(IWICImagingFactory* wicFactory, uint64_t objectKey, DrawingCanvas::RawPixels const& rawPixels, GoldenImageEntry const& entry);
+
+    std::u16string directoryPath_;
+    uint64_t dwriteVersion_ = 0;
+    bool shouldUpdateBaselines_ = false;
+
+    // Guards entries_ and isChanged_ between batch workers.
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, GoldenImageEntry> entries_;
+    bool isChanged_ = false;
+
+    std::atomic<uint32_t> newCount_{0};
+    std::atomic<uint32_t> unchangedCount_{0};
+    std::atomic<uint32_t> changedCount_{0};
+};
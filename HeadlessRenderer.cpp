@@ -0,0 +1,719 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Renders settings files to images without any window.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "FileHelpers.h"
+#include "PixelDiff.h"
+#include "GoldenImageStore.h"
+#include "Tracing.h"
+
+#pragma comment(lib, "Shell32.lib")
+
+
+MODULE(HeadlessRenderer)
+EXPORT_BEGIN
+    #include "HeadlessRenderer.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    float const g_imagePadding = 8;
+
+    HRESULT SaveCanvasAsPng(
+        DrawingCanvas& drawingCanvas,
+        _In_z_ char16_t const* imageFilePath
+        )
+    {
+        GdiFlush();
+        return SaveRawPixelsAsPng(drawingCanvas.GetWicFactoryWeakRef(), drawingCanvas.GetRawPixels(), imageFilePath);
+    }
+
+
+    // Compare every later object against the first, writing the statistics to
+    // the console and a heatmap beside the image for each object that differs.
+    HRESULT CompareObjectsToConsole(
+        array_ref<DrawableObjectAndValues const> drawableObjects,
+        _In_z_ char16_t const* imageFilePath,
+        DrawingCanvas& drawingCanvas
+        )
+    {
+        std::vector<PixelDiffStatistics> statistics;
+        std::vector<PixelTile> heatmaps;
+        IFR(CompareDrawableObjects(drawableObjects, drawingCanvas, OUT statistics, OUT &heatmaps, /*threadCount*/1));
+
+        std::u16string statisticsText;
+        std::u16string heatmapFilePath;
+        for (size_t i = 0, count = statistics.size(); i < count; ++i)
+        {
+            FormatPixelDiffStatistics(statistics[i], OUT statisticsText);
+            WriteConsoleLine(u"Compared object %u to 0: %s", uint32_t(i + 1), statisticsText.c_str());
+
+            if (statistics[i].changedPixelCount > 0)
+            {
+                GetFormattedString(OUT heatmapFilePath, u"%s.diff%u.png", imageFilePath, uint32_t(i + 1));
+                IFR(SaveRawPixelsAsPng(drawingCanvas.GetWicFactoryWeakRef(), heatmaps[i].GetRawPixels(), heatmapFilePath.c_str()));
+            }
+        }
+
+        return S_OK;
+    }
+
+
+    // Check each object against its baseline, writing the changed ones to
+    // the console with a heatmap beside the image.
+    HRESULT CheckObjectsAgainstBaselines(
+        array_ref<DrawableObjectAndValues const> drawableObjects,
+        _In_z_ char16_t const* imageFilePath,
+        DrawingCanvas& drawingCanvas,
+        GoldenImageStore& goldenImageStore
+        )
+    {
+        std::vector<PixelTile> tiles;
+        IFR(DrawObjectTiles(drawableObjects, drawingCanvas, OUT tiles));
+
+        IWICImagingFactory* wicFactory = drawingCanvas.GetWicFactoryWeakRef();
+        GoldenImageCheck check;
+        std::u16string statisticsText;
+        std::u16string heatmapFilePath;
+
+        for (size_t i = 0, count = tiles.size(); i < count; ++i)
+        {
+            if (tiles[i].pixels.empty())
+                continue; // Hidden or empty.
+
+            uint64_t objectKey = goldenImageStore.GetObjectKey(drawableObjects[i]);
+            IFR(goldenImageStore.Check(wicFactory, objectKey, tiles[i].GetRawPixels(), OUT check));
+
+            if (check.result == GoldenImageCheck::ResultNew)
+            {
+                WriteConsoleLine(u"New baseline object %u: %s", uint32_t(i), imageFilePath);
+            }
+            else if (check.result == GoldenImageCheck::ResultChanged)
+            {
+                FormatPixelDiffStatistics(check.statistics, OUT statisticsText);
+                WriteConsoleLine(u"Changed object %u (perceptual distance %u): %s: %s", uint32_t(i), check.perceptualDistance, imageFilePath, statisticsText.c_str());
+
+                if (check.statistics.changedPixelCount > 0)
+                {
+                    GetFormattedString(OUT heatmapFilePath, u"%s.baseline%u.png", imageFilePath, uint32_t(i));
+                    IFR(SaveRawPixelsAsPng(wicFactory, check.heatmap.GetRawPixels(), heatmapFilePath.c_str()));
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+
+    void GetImageFilePath(
+        std::u16string const& settingsFilePath,
+        _In_opt_z_ char16_t const* outputDirectory,
+        _Out_ std::u16string& imageFilePath
+        )
+    {
+        if (outputDirectory != nullptr && outputDirectory[0] != '\0')
+        {
+            imageFilePath.assign(outputDirectory);
+            if (imageFilePath.back() != '\\' && imageFilePath.back() != '/')
+            {
+                imageFilePath.push_back('\\');
+            }
+            imageFilePath.append(FindFileNameStart(settingsFilePath));
+        }
+        else
+        {
+            imageFilePath = settingsFilePath;
+        }
+        RemoveFileNameExtension(IN OUT imageFilePath);
+        imageFilePath.append(u".png");
+    }
+}
+
+
+namespace
+{
+    enum class SettingsFileType
+    {
+        None,
+        Text,
+        Binary,
+    };
+
+
+    SettingsFileType GetSettingsFileType(array_ref<const char16_t> fileName)
+    {
+        auto* filenameExtension = FindFileNameExtension(fileName);
+        if (_wcsicmp(ToWChar(filenameExtension), L"TextLayoutSamplerSettings") == 0)
+            return SettingsFileType::Text;
+        if (_wcsicmp(ToWChar(filenameExtension), L"TextLayoutSamplerBinarySettings") == 0)
+            return SettingsFileType::Binary;
+        return SettingsFileType::None;
+    }
+
+
+    bool IsBinarySettingsFileName(_In_z_ char16_t const* settingsFilePath)
+    {
+        return GetSettingsFileType({settingsFilePath, wcslen(ToWChar(settingsFilePath))}) == SettingsFileType::Binary;
+    }
+}
+
+
+bool IsSettingsFileName(array_ref<const char16_t> fileName)
+{
+    return GetSettingsFileType(fileName) != SettingsFileType::None;
+}
+
+
+HRESULT ReadSettingsFileNodes(
+    _In_z_ char16_t const* settingsFilePath,
+    _Inout_ TextTree& textTree,
+    uint32_t subtreeLevel,
+    TextTreeParser::SubtreeCallback const& subtreeCallback
+    )
+{
+    TRACE_LOGGING_ACTIVITY(activity, "LoadSettings", TraceLoggingWideString(ToWChar(settingsFilePath), "FilePath"));
+
+    if (IsBinarySettingsFileName(settingsFilePath))
+    {
+        // The binary form is already UTF-16 code units, so parse the view directly.
+        MappedFile mappedFile;
+        IFR(mappedFile.Open(settingsFilePath));
+        auto fileData = mappedFile.GetBytes();
+        if (fileData.size() / sizeof(char16_t) > UINT32_MAX)
+            return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+
+        BinaryTextTreeParser parser(
+            reinterpret_cast<char16_t const*>(fileData.data()),
+            static_cast<uint32_t>(fileData.size() / sizeof(char16_t)),
+            BinaryTextTreeParser::OptionsDefault
+            );
+        parser.ReadNodes(IN OUT textTree, subtreeLevel, subtreeCallback);
+        if (parser.GetErrorCount() > 0)
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+    else
+    {
+        std::u16string inputText;
+        IFR(ReadTextFile(settingsFilePath, OUT inputText));
+
+        JsonexParser parser(inputText, JsonexParser::OptionsDefault);
+        parser.ReadNodes(IN OUT textTree, subtreeLevel, subtreeCallback);
+        if (parser.GetErrorCount() > 0)
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    return S_OK;
+}
+
+
+// Write the file under a temporary name beside it, replacing the original
+// only once all of it was written. So a failure partway through serializing,
+// or the process ending, leaves the previous file intact rather than truncated.
+static HRESULT WriteFileThenReplace(
+    _In_z_ char16_t const* filePath,
+    std::function<HRESULT(_In_z_ char16_t const* temporaryFilePath)> const& writeFile
+    )
+{
+    std::u16string temporaryFilePath(filePath);
+    temporaryFilePath.append(u".tmp");
+
+    HRESULT hr = writeFile(temporaryFilePath.c_str());
+    if (SUCCEEDED(hr) && !MoveFileEx(ToWChar(temporaryFilePath.c_str()), ToWChar(filePath), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (FAILED(hr))
+    {
+        DeleteFile(ToWChar(temporaryFilePath.c_str()));
+    }
+    return hr;
+}
+
+
+HRESULT WriteSettingsFileNodes(
+    _In_z_ char16_t const* settingsFilePath,
+    TextTree const& textTree
+    )
+{
+    return WriteFileThenReplace(settingsFilePath, [&](char16_t const* temporaryFilePath) -> HRESULT
+    {
+        if (IsBinarySettingsFileName(settingsFilePath))
+        {
+            BinaryTextTreeWriter writer(BinaryTextTreeWriter::OptionsDefault);
+            IFR(writer.WriteNodes(textTree));
+            array_ref<char16_t const> outputData = writer.GetText();
+            IFR(WriteBinaryFile(temporaryFilePath, outputData.data(), static_cast<uint32_t>(outputData.size_in_bytes())));
+        }
+        else
+        {
+            Utf8FileWriter outputFile;
+            IFR(outputFile.Open(temporaryFilePath));
+
+            JsonexWriter writer(JsonexWriter::OptionsDefault);
+            writer.SetOutputFile(&outputFile);
+            IFR(writer.WriteNodes(textTree));
+            IFR(writer.Flush());
+            IFR(outputFile.Close());
+        }
+
+        return S_OK;
+    });
+}
+
+
+HRESULT StoreSettingsFile(
+    _In_z_ char16_t const* settingsFilePath,
+    array_ref<DrawableObjectAndValues> drawableObjects
+    )
+{
+    TRACE_LOGGING_ACTIVITY(activity, "StoreSettings",
+        TraceLoggingWideString(ToWChar(settingsFilePath), "FilePath"),
+        TraceLoggingUInt32(static_cast<uint32_t>(drawableObjects.size()), "ObjectCount")
+        );
+
+    if (IsBinarySettingsFileName(settingsFilePath))
+    {
+        TextTree data;
+        data.Append(TextTree::Node::TypeRoot, 1, u"", 0);
+        TextTree::NodePointer root = data.begin();
+        TextTree::NodePointer subroot = root.AppendChild(TextTree::Node::TypeObject, u"", 0);
+        subroot.SetKeyValue(u"content", u"TextLayoutSamplerSettings", uint32_t(countof(u"TextLayoutSamplerSettings"))-1);
+        DrawableObjectAndValues::Store(drawableObjects, subroot);
+
+        return WriteSettingsFileNodes(settingsFilePath, data);
+    }
+
+    // Write the same layout as the tree above, but straight to the file.
+    return WriteFileThenReplace(settingsFilePath, [&](char16_t const* temporaryFilePath) -> HRESULT
+    {
+        Utf8FileWriter outputFile;
+        IFR(outputFile.Open(temporaryFilePath));
+
+        JsonexWriter writer(JsonexWriter::OptionsDefault);
+        writer.SetOutputFile(&outputFile);
+        IFR(writer.BeginObject());
+        IFR(writer.BeginKey(u"content"));
+        IFR(writer.WriteNode(TextTree::Node::TypeValue, u"TextLayoutSamplerSettings", uint32_t(countof(u"TextLayoutSamplerSettings"))-1));
+        IFR(writer.EndScope());
+        IFR(DrawableObjectAndValues::Store(drawableObjects, writer));
+        IFR(writer.EndScope());
+        IFR(writer.Flush());
+        IFR(outputFile.Close());
+
+        return S_OK;
+    });
+}
+
+
+// Read the settings nodes with the given reader (from a file or text), loading the objects.
+static HRESULT LoadSettingsNodes(
+    std::function<HRESULT(TextTree&, uint32_t, TextTreeParser::SubtreeCallback const&)> const& readNodes,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+    )
+{
+    TextTree data;
+
+    Attribute::PredefinedValue recognizedSettings[] = {
+        {1,u"content"},
+        {2,u"objects"},
+        {3,u"values"},
+    };
+
+    // Load each object as it closes (see MainWindow::LoadDrawableObjectsSettings).
+    HRESULT hr = S_OK;
+    DrawableObjectAndValues sharedDrawableObject;
+    std::vector<SharedString> sharedValues;
+    uint32_t objectsNodeIndex = 0;
+    bool isFirstObject = true;
+
+    auto loadSetting = [&](TextTree& textTree, uint32_t parentNodeIndex, uint32_t nodeIndex) -> bool
+    {
+        std::u16string text;
+        textTree.GetText(parentNodeIndex, OUT text);
+
+        uint32_t settingEnumValue;
+        if (FAILED(Attribute::PredefinedValue::MapNameToValue({recognizedSettings, countof(recognizedSettings)}, text.c_str(), OUT settingEnumValue)))
+            return true;
+
+        switch (settingEnumValue)
+        {
+        case 1: // content
+            {
+                std::u16string value;
+                textTree.GetText(nodeIndex, OUT value);
+                if (value.compare(u"TextLayoutSamplerSettings") != 0)
+                {
+                    hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+                    return false;
+                }
+            }
+            break;
+        case 2: // objects
+            if (parentNodeIndex != objectsNodeIndex)
+            {
+                objectsNodeIndex = parentNodeIndex;
+                sharedDrawableObject = DrawableObjectAndValues();
+                isFirstObject = true;
+            }
+            DrawableObjectAndValues::LoadObject(TextTree::NodePointer(textTree, nodeIndex), isFirstObject, IN OUT sharedDrawableObject, sharedValues, IN OUT drawableObjects);
+            isFirstObject = false;
+            break;
+        case 3: // values
+            {
+                array_ref<char16_t const> value = textTree.GetTextView(textTree.GetNode(nodeIndex));
+                sharedValues.emplace_back();
+                sharedValues.back().assign(value.data(), value.size());
+            }
+            break;
+        }
+        return true;
+    };
+
+    // Values of the top level keys are at level 3 (see MainWindow::LoadDrawableObjectsSettings).
+    IFR(readNodes(IN OUT data, 3, loadSetting));
+    IFR(hr);
+
+    return S_OK;
+}
+
+
+HRESULT LoadSettingsFile(
+    _In_z_ char16_t const* settingsFilePath,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+    )
+{
+    auto readNodes = [=](TextTree& textTree, uint32_t subtreeLevel, TextTreeParser::SubtreeCallback const& subtreeCallback) -> HRESULT
+    {
+        return ReadSettingsFileNodes(settingsFilePath, IN OUT textTree, subtreeLevel, subtreeCallback);
+    };
+    return LoadSettingsNodes(readNodes, IN OUT drawableObjects);
+}
+
+
+HRESULT LoadSettingsText(
+    array_ref<char16_t const> settingsText,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+    )
+{
+    auto readNodes = [=](TextTree& textTree, uint32_t subtreeLevel, TextTreeParser::SubtreeCallback const& subtreeCallback) -> HRESULT
+    {
+        JsonexParser parser(settingsText, JsonexParser::OptionsDefault);
+        parser.ReadNodes(IN OUT textTree, subtreeLevel, subtreeCallback);
+        if (parser.GetErrorCount() > 0)
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        return S_OK;
+    };
+    return LoadSettingsNodes(readNodes, IN OUT drawableObjects);
+}
+
+
+void WriteConsoleLine(_In_z_ char16_t const* formatString, ...)
+{
+    HANDLE outputHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (outputHandle == nullptr || outputHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    // Format the whole line however long, such as a report row.
+    std::u16string line;
+    va_list argList;
+    va_start(argList, formatString);
+    GetFormattedString(OUT line, /*shouldConcatenate*/false, formatString, argList);
+    va_end(argList);
+    line.append(u"\r\n");
+
+    // Output redirected to a file or pipe (as when batch rendering) is not a
+    // console, and WriteConsoleW fails on it, so write it as UTF-8 instead.
+    DWORD consoleMode;
+    if (GetConsoleMode(outputHandle, OUT &consoleMode))
+    {
+        DWORD charsWritten;
+        WriteConsoleW(outputHandle, line.data(), static_cast<DWORD>(line.size()), OUT &charsWritten, nullptr);
+    }
+    else
+    {
+        std::string utf8line;
+        AppendTextUtf16ToUtf8(line, IN OUT utf8line);
+        DWORD bytesWritten;
+        WriteFile(outputHandle, utf8line.data(), static_cast<DWORD>(utf8line.size()), OUT &bytesWritten, nullptr);
+    }
+}
+
+
+HRESULT RenderSettingsFileToImage(
+    _In_z_ char16_t const* settingsFilePath,
+    _In_z_ char16_t const* imageFilePath,
+    DrawingCanvas& drawingCanvas,
+    DrawableObjectAndValues::DrawFlags drawFlags,
+    bool shouldCompareObjects,
+    _In_opt_ GoldenImageStore* goldenImageStore
+    )
+{
+    std::vector<DrawableObjectAndValues> drawableObjects;
+    IFR(LoadSettingsFile(settingsFilePath, IN OUT drawableObjects));
+    IFR(DrawObjectsToFittedCanvas(drawableObjects, drawingCanvas, drawFlags));
+
+    IFR(SaveCanvasAsPng(drawingCanvas, imageFilePath));
+
+    if (shouldCompareObjects)
+    {
+        IFR(CompareObjectsToConsole(drawableObjects, imageFilePath, drawingCanvas));
+    }
+
+    if (goldenImageStore != nullptr)
+    {
+        IFR(CheckObjectsAgainstBaselines(drawableObjects, imageFilePath, drawingCanvas, *goldenImageStore));
+    }
+
+    drawingCanvas.RetireStaleSharedResources();
+
+    return S_OK;
+}
+
+
+HRESULT DrawObjectsToFittedCanvas(
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    DrawableObjectAndValues::DrawFlags drawFlags
+    )
+{
+    // Arranging measures labels with the canvas HDC, so a minimal target is
+    // needed before the final size is known.
+    IFR(drawingCanvas.CreateRenderTargetsOnDemand(nullptr, {1,1}));
+    DrawableObjectAndValues::Arrange(drawableObjects, drawingCanvas);
+
+    // Fit the canvas to the union of all the objects, shifting any explicitly
+    // positioned at negative coordinates into view.
+    RECT imageRect = {};
+    for (auto& objectAndValues : drawableObjects)
+    {
+        if (!objectAndValues.IsVisible())
+            continue;
+
+        RECT drawnRect;
+        objectAndValues.GetDrawnRect(DrawingCanvas::g_identityMatrix, OUT drawnRect);
+        UnionRect(OUT &imageRect, &imageRect, &drawnRect);
+    }
+
+    DX_MATRIX_3X2F canvasTransform = DrawingCanvas::g_identityMatrix;
+    canvasTransform.dx = float(std::max(-imageRect.left, 0L));
+    canvasTransform.dy = float(std::max(-imageRect.top, 0L));
+    SIZE imageSize = {
+        LONG(imageRect.right  + canvasTransform.dx + g_imagePadding),
+        LONG(imageRect.bottom + canvasTransform.dy + g_imagePadding),
+    };
+    IFR(drawingCanvas.ResizeRenderTargets(imageSize));
+
+    drawingCanvas.ClearBackground(DrawableObject::defaultCanvasColor);
+    DrawableObjectAndValues::Draw(drawableObjects, drawingCanvas, canvasTransform, drawFlags);
+    drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+
+    return S_OK;
+}
+
+
+HRESULT RenderSettingsFilesToImages(
+    array_ref<std::u16string const> settingsFilePaths,
+    _In_opt_z_ char16_t const* outputDirectory,
+    uint32_t threadCount,
+    DrawingCanvas::FactoryIsolation factoryIsolation,
+    bool shouldCompareObjects,
+    _In_opt_ GoldenImageStore* goldenImageStore,
+    _Out_ uint32_t& failedFileCount
+    )
+{
+    failedFileCount = 0;
+
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threadCount = std::min(threadCount, uint32_t(settingsFilePaths.size()));
+
+    std::atomic<uint32_t> nextFileIndex(0);
+    std::atomic<uint32_t> failedFiles(0);
+    std::atomic<HRESULT> firstFailure(S_OK);
+
+    // Each worker takes a canvas, and so its own D2D factory (and DWrite
+    // factory if isolated), and takes the next unrendered file until none are
+    // left. The objects are drawn serially within each file, since the files
+    // already fill the cores.
+    DrawingCanvasPool drawingCanvasPool(factoryIsolation);
+    auto renderFiles = [&]()
+    {
+        ComPtr<DrawingCanvas> drawingCanvas;
+        HRESULT acquireHr = drawingCanvasPool.Acquire(OUT &drawingCanvas);
+        if (FAILED(acquireHr))
+        {
+            HRESULT noFailure = S_OK;
+            firstFailure.compare_exchange_strong(IN OUT noFailure, acquireHr);
+            return;
+        }
+        std::u16string imageFilePath;
+
+        for (;;)
+        {
+            uint32_t fileIndex = nextFileIndex++;
+            if (fileIndex >= settingsFilePaths.size())
+                break;
+
+            std::u16string const& settingsFilePath = settingsFilePaths[fileIndex];
+            GetImageFilePath(settingsFilePath, outputDirectory, OUT imageFilePath);
+
+            HRESULT hr = RenderSettingsFileToImage(settingsFilePath.c_str(), imageFilePath.c_str(), *drawingCanvas, DrawableObjectAndValues::DrawFlagsNone, shouldCompareObjects, goldenImageStore);
+            if (FAILED(hr))
+            {
+                ++failedFiles;
+                HRESULT noFailure = S_OK;
+                firstFailure.compare_exchange_strong(IN OUT noFailure, hr);
+                WriteConsoleLine(u"Failed %08X: %s", hr, settingsFilePath.c_str());
+            }
+            else
+            {
+                WriteConsoleLine(u"Rendered: %s", imageFilePath.c_str());
+            }
+        }
+
+        drawingCanvasPool.Return(drawingCanvas);
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(renderFiles);
+    }
+    renderFiles(); // This thread is worker 0.
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    failedFileCount = failedFiles;
+    return firstFailure;
+}
+
+
+int RunHeadlessRenderCommandLine(_In_z_ char16_t const* commandLine)
+{
+    // A GUI process has no console of its own, but batch scripts want to see
+    // which files failed.
+    AttachConsole(ATTACH_PARENT_PROCESS);
+
+    int argumentCount = 0;
+    wchar_t** arguments = CommandLineToArgvW(ToWChar(commandLine), OUT &argumentCount);
+    if (arguments == nullptr)
+    {
+        return 1;
+    }
+
+    std::u16string outputDirectory;
+    uint32_t threadCount = 0;
+    auto factoryIsolation = DrawingCanvas::FactoryIsolationPerThreadD2D;
+    bool shouldCompareObjects = false;
+    std::u16string baselineDirectory;
+    bool shouldUpdateBaselines = false;
+    std::u16string fileNames; // nul-separated
+    std::vector<std::u16string> settingsFilePaths;
+
+    for (int i = 0; i < argumentCount; ++i)
+    {
+        char16_t const* argument = ToChar16(arguments[i]);
+        if (_wcsicmp(ToWChar(argument), L"/render") == 0)
+        {
+            continue;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/out:", 5) == 0)
+        {
+            outputDirectory = argument + 5;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/threads:", 9) == 0)
+        {
+            threadCount = wcstoul(ToWChar(argument + 9), nullptr, 10);
+        }
+        else if (_wcsicmp(ToWChar(argument), L"/isolatefactories") == 0)
+        {
+            factoryIsolation = DrawingCanvas::FactoryIsolationPerThread;
+        }
+        else if (_wcsicmp(ToWChar(argument), L"/compare") == 0)
+        {
+            shouldCompareObjects = true;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/baseline:", 10) == 0)
+        {
+            baselineDirectory = argument + 10;
+        }
+        else if (_wcsicmp(ToWChar(argument), L"/updatebaseline") == 0)
+        {
+            shouldUpdateBaselines = true;
+        }
+        else if (argument[0] == '/')
+        {
+            WriteConsoleLine(u"Unknown command line option: %s", argument);
+            LocalFree(arguments);
+            return 1;
+        }
+        else if (FileContainsWildcard({argument, wcslen(arguments[i])}))
+        {
+            EnumerateMatchingFiles(nullptr, argument, IN OUT fileNames);
+        }
+        else
+        {
+            settingsFilePaths.push_back(argument);
+        }
+    }
+    LocalFree(arguments);
+
+    for (char16_t const* fileName = fileNames.c_str(), *fileNamesEnd = fileName + fileNames.size();
+        fileName < fileNamesEnd;
+        fileName += wcslen(ToWChar(fileName)) + 1)
+    {
+        settingsFilePaths.push_back(fileName);
+    }
+
+    if (settingsFilePaths.empty())
+    {
+        WriteConsoleLine(u"TextLayoutSampler.exe /render [/out:Directory] [/threads:N] [/isolatefactories] [/compare] [/baseline:Directory [/updatebaseline]] SomeFile.TextLayoutSamplerSettings ...");
+        return 1;
+    }
+
+    GoldenImageStore goldenImageStore;
+    GoldenImageStore* goldenImageStorePointer = nullptr;
+    if (!baselineDirectory.empty())
+    {
+        HRESULT hr = goldenImageStore.Load(baselineDirectory.c_str(), shouldUpdateBaselines);
+        if (FAILED(hr))
+        {
+            WriteConsoleLine(u"Failed %08X reading baselines: %s", hr, baselineDirectory.c_str());
+            return 1;
+        }
+        goldenImageStorePointer = &goldenImageStore;
+    }
+
+    uint32_t failedFileCount = 0;
+    RenderSettingsFilesToImages(settingsFilePaths, outputDirectory.c_str(), threadCount, factoryIsolation, shouldCompareObjects, goldenImageStorePointer, OUT failedFileCount);
+    WriteConsoleLine(u"%u of %u files rendered.", uint32_t(settingsFilePaths.size()) - failedFileCount, uint32_t(settingsFilePaths.size()));
+
+    uint32_t changedObjectCount = 0;
+    if (goldenImageStorePointer != nullptr)
+    {
+        uint32_t newObjectCount, unchangedObjectCount;
+        goldenImageStore.GetCounts(OUT newObjectCount, OUT unchangedObjectCount, OUT changedObjectCount);
+        WriteConsoleLine(u"%u unchanged, %u changed, %u new objects against baselines.", unchangedObjectCount, changedObjectCount, newObjectCount);
+
+        HRESULT hr = goldenImageStore.Save();
+        if (FAILED(hr))
+        {
+            WriteConsoleLine(u"Failed %08X writing baselines: %s", hr, baselineDirectory.c_str());
+            return 2;
+        }
+        if (shouldUpdateBaselines)
+        {
+            changedObjectCount = 0; // Accepted as the new baselines.
+        }
+    }
+
+    return failedFileCount > 0 ? 2 : (changedObjectCount > 0 ? 3 : 0);
+}
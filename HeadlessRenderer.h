@@ -0,0 +1,122 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Renders settings files to images without any window.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import Common.ArrayRef;
+import Common.String;
+import DrawingCanvas;
+import DrawableObjectAndValues;
+import GoldenImageStore;
+import TextTreeParser;
+#else
+#include "Common.ArrayRef.h"
+#include "Common.String.h"
+#include "DrawingCanvas.h"
+#include "DrawableObjectAndValues.h"
+#include "GoldenImageStore.h"
+#include "TextTreeParser.h"
+#endif
+
+
+// Whether the file name has either the text or binary settings extension.
+bool IsSettingsFileName(array_ref<const char16_t> fileName);
+
+// Read a settings file, choosing Jsonex or binary syntax by the file name
+// extension, and hand each subtree at the level to the callback as it
+// closes (see TextTreeParser::ReadNodes). Binary files are mapped and read
+// in place rather than loaded. Either syntax fails with ERROR_BAD_FORMAT if
+// the parser reports errors.
+HRESULT ReadSettingsFileNodes(
+    _In_z_ char16_t const* settingsFilePath,
+    _Inout_ TextTree& textTree,
+    uint32_t subtreeLevel,
+    TextTreeParser::SubtreeCallback const& subtreeCallback
+    );
+
+// Write the tree to a settings file, choosing the syntax by extension. The
+// file is written under a temporary name and replaced only on success.
+HRESULT WriteSettingsFileNodes(
+    _In_z_ char16_t const* settingsFilePath,
+    TextTree const& textTree
+    );
+
+// Load the drawable objects from a settings file, appending to any existing.
+HRESULT LoadSettingsFile(
+    _In_z_ char16_t const* settingsFilePath,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+    );
+
+// Load the drawable objects from Jsonex settings text, as in a settings file,
+// failing with ERROR_BAD_FORMAT if the text has syntax errors.
+HRESULT LoadSettingsText(
+    array_ref<char16_t const> settingsText,
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects
+    );
+
+// Store the drawable objects to a settings file. Jsonex is streamed to the
+// file as each object is written, while binary (whose node table precedes
+// the text) still builds the whole tree first. Either way, a failure leaves
+// any existing file unchanged.
+HRESULT StoreSettingsFile(
+    _In_z_ char16_t const* settingsFilePath,
+    array_ref<DrawableObjectAndValues> drawableObjects
+    );
+
+// Write a formatted line to the console the process was started from, if any,
+// or as UTF-8 to wherever standard output was redirected.
+void WriteConsoleLine(_In_z_ char16_t const* formatString, ...);
+
+// Load the settings file (as saved by StoreDrawableObjectsSettings), arrange
+// and draw all the objects onto the offscreen canvas, and save it as a PNG.
+// The canvas is resized to fit the objects, and it may be reused across calls
+// on the same thread, but it must not be shared between threads. Comparing
+// writes pixel statistics of each later object against the first to the
+// console, and a heatmap "<image>.diff<N>.png" for each that differs. With a
+// baseline store, each object is checked against (or becomes) its baseline,
+// writing "<image>.baseline<N>.png" heatmaps for those changed.
+HRESULT RenderSettingsFileToImage(
+    _In_z_ char16_t const* settingsFilePath,
+    _In_z_ char16_t const* imageFilePath,
+    DrawingCanvas& drawingCanvas,
+    DrawableObjectAndValues::DrawFlags drawFlags = DrawableObjectAndValues::DrawFlagsNone,
+    bool shouldCompareObjects = false,
+    _In_opt_ GoldenImageStore* goldenImageStore = nullptr
+    );
+
+// Arrange the objects, resize the canvas to fit them all, and draw them.
+HRESULT DrawObjectsToFittedCanvas(
+    _Inout_ std::vector<DrawableObjectAndValues>& drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    DrawableObjectAndValues::DrawFlags drawFlags = DrawableObjectAndValues::DrawFlagsNone
+    );
+
+// Render each settings file to a PNG of the same name, either beside the
+// settings file or in the output directory, using a canvas per thread with
+// the given factory isolation.
+// Returns the first failure, with the number of failed files.
+HRESULT RenderSettingsFilesToImages(
+    array_ref<std::u16string const> settingsFilePaths,
+    _In_opt_z_ char16_t const* outputDirectory, // Null or empty to write beside each settings file.
+    uint32_t threadCount, // 0 for the number of cores.
+    DrawingCanvas::FactoryIsolation factoryIsolation, // Usually FactoryIsolationPerThreadD2D, or FactoryIsolationPerThread to avoid DWrite cache contention.
+    bool shouldCompareObjects,
+    _In_opt_ GoldenImageStore* goldenImageStore, // Shared by all threads.
+    _Out_ uint32_t& failedFileCount
+    );
+
+// Run the /render command line, returning the process exit code.
+//
+//      /render [/out:Directory] [/threads:N] [/isolatefactories] [/compare] [/baseline:Directory [/updatebaseline]] SomeFile.TextLayoutSamplerSettings ...
+//
+// File names may contain wildcards. Progress and errors are written to the
+// parent console if there is one. With /isolatefactories, each thread uses
+// its own isolated DWrite factory rather than the shared one. With /compare, each later object in a file
+// is diffed against the first, as in RenderSettingsFileToImage. With
+// /baseline, objects are checked against the baselines in the directory, and
+// /updatebaseline stores new and changed ones. The exit code is 3 if any
+// object changed from its baseline without updating.
+int RunHeadlessRenderCommandLine(_In_z_ char16_t const* commandLine);
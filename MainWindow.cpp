@@ -36,6 +36,7 @@ todo:::
 #include "resource.h"
 #include "Application.macros.h"
 #include "WindowUtility.macros.h"
+#include "Tracing.h"
 #include "Common.FastVector.h"
 
 
@@ -44,6 +45,10 @@ todo:::
 MODULE(MainWindow)
 
 #include "MainWindow.h"
+#include "HeadlessRenderer.h"
+#include "RenderServer.h"
+#include "Benchmark.h"
+#include "PixelDiff.h"
 
 ////////////////////////////////////////
 
@@ -58,8 +63,9 @@ MODULE(MainWindow)
 HACCEL MainWindow::g_accelTable;
 int const g_smallMouseWheelStep = 20;
 
-char16_t const* g_openSaveFiltersList = u"All supported text layout sampler files\0" u"*.TextLayoutSamplerSettings;*.txt\0"
+char16_t const* g_openSaveFiltersList = u"All supported text layout sampler files\0" u"*.TextLayoutSamplerSettings;*.TextLayoutSamplerBinarySettings;*.txt\0"
                                         u"Layout Sampler Settings (*.TextLayoutSamplerSettings)\0" u"*.TextLayoutSamplerSettings\0"
+                                        u"Layout Sampler Binary Settings (*.TextLayoutSamplerBinarySettings)\0" u"*.TextLayoutSamplerBinarySettings\0"
                                         u"Text files (*.txt)\0" u"*.txt\0"
                                         u"All files (*)\0" u"*\0";
 
@@ -75,6 +81,8 @@ int APIENTRY wWinMain(
     )
 {
     Application::g_hModule = hInstance;
+    int64_t const startupStartTicks = GetPerformanceCounter();
+    TraceLoggingRegistration traceLoggingRegistration; // For headless rendering and benchmarks too.
 
     _wsetlocale(LC_ALL, L""); // Unicode, not ANSI!
     bool wantBlankCanvas = false;
@@ -93,9 +101,36 @@ int APIENTRY wWinMain(
         ||  _wcsicmp(ToWChar(trimmedCommandLine.c_str()), L"--help") == 0
             )
         {
-            MessageBox(nullptr, L"TextLayoutSampler.exe [SomeFile.TextLayoutSamplerSettings].", APPLICATION_TITLE, MB_OK);
+            MessageBox(nullptr, L"TextLayoutSampler.exe [SomeFile.TextLayoutSamplerSettings].\r\n"
+                                L"TextLayoutSampler.exe /render [/out:Directory] [/threads:N] [/compare] [/baseline:Directory [/updatebaseline]] SomeFile.TextLayoutSamplerSettings ...\r\n"
+                                L"TextLayoutSampler.exe /serve [/pipe:Name] [/threads:N] [/isolatefactories]\r\n"
+                                L"TextLayoutSampler.exe /replay [/out:Timings.csv] SomeFile.TextLayoutSamplerSession\r\n"
+                                L"TextLayoutSampler.exe /benchmark [/iterations:N] [/functions:A;B] [/fonts:A;B] [/sizes:12;18] [/text:Text] [/textfile:Corpus.txt] [/dwrite:DWrite.dll] [/out:Results.csv|json] [SomeFile.TextLayoutSamplerSettings ...]", APPLICATION_TITLE, MB_OK);
             return (int)0;
         }
+        else if (_wcsnicmp(ToWChar(trimmedCommandLine.c_str()), L"/render", 7) == 0
+             && (trimmedCommandLine.size() == 7 || trimmedCommandLine[7] == ' '))
+        {
+            // Headless batch rendering, without ever creating a window.
+            return RunHeadlessRenderCommandLine(trimmedCommandLine.c_str());
+        }
+        else if (_wcsnicmp(ToWChar(trimmedCommandLine.c_str()), L"/serve", 6) == 0
+             && (trimmedCommandLine.size() == 6 || trimmedCommandLine[6] == ' '))
+        {
+            // Long-lived headless rendering for regression harnesses.
+            return RunRenderServerCommandLine(trimmedCommandLine.c_str());
+        }
+        else if (_wcsnicmp(ToWChar(trimmedCommandLine.c_str()), L"/benchmark", 10) == 0
+             && (trimmedCommandLine.size() == 10 || trimmedCommandLine[10] == ' '))
+        {
+            return RunBenchmarkCommandLine(trimmedCommandLine.c_str());
+        }
+        else if (_wcsnicmp(ToWChar(trimmedCommandLine.c_str()), L"/replay", 7) == 0
+             && (trimmedCommandLine.size() == 7 || trimmedCommandLine[7] == ' '))
+        {
+            // Recorded sessions need the full window state, just not shown.
+            return MainWindow::RunSessionReplayCommandLine(trimmedCommandLine.c_str());
+        }
         else if (_wcsicmp(ToWChar(trimmedCommandLine.c_str()), L"/blank") == 0)
         {
             wantBlankCanvas = true;
@@ -119,6 +154,7 @@ int APIENTRY wWinMain(
     }
     ShowWindow(Application::g_mainHwnd, SW_SHOWNORMAL);
     SendMessage(Application::g_mainHwnd, WM_CHANGEUISTATE, UIS_CLEAR | UISF_HIDEACCEL | UISF_HIDEFOCUS, (LPARAM)nullptr); // Always shows the focus rectangle.
+    int64_t const windowEndTicks = GetPerformanceCounter();
 
     MainWindow& mainWindow = *MainWindow::GetClass(Application::g_mainHwnd);
 
@@ -130,6 +166,24 @@ int APIENTRY wWinMain(
     {
         mainWindow.InitializeDefaultDrawableObjects();
     }
+    int64_t const objectsEndTicks = GetPerformanceCounter();
+
+    // Paint now rather than whenever the queue empties, to time it. This
+    // creates the DWrite and D2D factories, and whatever back ends the
+    // objects on the first sheet use, but no others.
+    RedrawWindow(Application::g_mainHwnd, nullptr, nullptr, RDW_UPDATENOW | RDW_ALLCHILDREN);
+    int64_t const paintEndTicks = GetPerformanceCounter();
+
+    mainWindow.AppendLog(
+        u"Startup timings (ms): window %.3f, objects %.3f, first paint %.3f, total %.3f\r\n",
+        PerformanceCounterToMilliseconds(windowEndTicks - startupStartTicks),
+        PerformanceCounterToMilliseconds(objectsEndTicks - windowEndTicks),
+        PerformanceCounterToMilliseconds(paintEndTicks - objectsEndTicks),
+        PerformanceCounterToMilliseconds(paintEndTicks - startupStartTicks)
+        );
+
+    // Start the remaining back ends once the message queue goes idle.
+    SetTimer(Application::g_mainHwnd, IdcPrewarmRendering, 0, nullptr);
 
     while (GetMessage(&Application::g_msg, nullptr, 0, 0) > 0)
     {
@@ -250,12 +304,23 @@ MainWindow::DialogProcResult CALLBACK MainWindow::DialogProc(HWND hwnd, UINT mes
             KillTimer(hwnd, wParam);
             UpdateUi();
         }
-        #if 0
-        else if (wParam == IdcUpdateUi+1)// hack for debugging animating objects.
+        else if (wParam == IdcAnimateFrame)
         {
-            RepaintDrawableObjects();
+            AnimateDrawableObjects();
+        }
+        else if (wParam == IdcFlushLog)
+        {
+            FlushLog();
+        }
+        else if (wParam == IdcPrewarmRendering)
+        {
+            KillTimer(hwnd, wParam);
+            PrewarmRendering();
+        }
+        else if (wParam == IdcReadLoadedFontFiles)
+        {
+            ReadLoadedFontFiles();
         }
-        #endif
         else
         {
             return false;
@@ -390,6 +455,10 @@ INT_PTR MainWindow::InitializeMainDialog()
 
     Edit_LimitText(GetWindowFromId(hwnd_, IdcLog), 1048576);
 
+    // Texts can be megabytes, well beyond the default limit of what can be
+    // typed or pasted into the edit.
+    Edit_LimitText(GetWindowFromId(hwnd_, IdcEditText), 0);
+
     // Subclass the values edit box for a few reasons.
     // - Forward up/down arrow key presses to the listview under it.
     // - Dynamically change between multiline and single-line behavior for return keypress.
@@ -434,10 +503,6 @@ INT_PTR MainWindow::InitializeMainDialog()
     }
     SetFocus(GetWindowFromId(hwnd_, controlIdToSetFocusTo));
 
-#if 0 // hack for debugging animating objects.
-    SetTimer(hwnd_, IdcUpdateUi + 1, 10, nullptr);
-#endif
-
     return false; // do not permit user32 code to set focus
 }
 
@@ -490,6 +555,43 @@ namespace
 }
 
 
+namespace
+{
+    // Columns following the attributes in the drawable objects list, each a
+    // number read from the object, which a click on the header sorts by.
+    enum DrawableObjectStatistic : uint32_t
+    {
+        DrawableObjectStatisticUpdateTime,
+        DrawableObjectStatisticBoundsTime,
+        DrawableObjectStatisticDrawTime,
+        DrawableObjectStatisticCachedResourceTime,
+        DrawableObjectStatisticMemory,
+        DrawableObjectStatisticTotal,
+    };
+
+    char16_t const* g_drawableObjectStatisticNames[DrawableObjectStatisticTotal] = {
+        u"Update ms", u"Bounds ms", u"Draw ms", u"Cache ms", u"Memory KB"
+    };
+
+    double GetDrawableObjectStatistic(DrawableObjectAndValues const& drawableObject, uint32_t statisticIndex)
+    {
+        auto const& timings = drawableObject.timings_;
+        switch (statisticIndex)
+        {
+        case DrawableObjectStatisticUpdateTime: return PerformanceCounterToMilliseconds(timings.update.totalTicks);
+        case DrawableObjectStatisticBoundsTime: return PerformanceCounterToMilliseconds(timings.bounds.totalTicks);
+        case DrawableObjectStatisticDrawTime: return PerformanceCounterToMilliseconds(timings.draw.totalTicks);
+        case DrawableObjectStatisticCachedResourceTime:
+            return PerformanceCounterToMilliseconds(
+                timings.update.cachedResourceTicks + timings.bounds.cachedResourceTicks + timings.draw.cachedResourceTicks
+                );
+        case DrawableObjectStatisticMemory: return drawableObject.GetMemoryUsage().GetTotal() / 1024.0;
+        default: return 0;
+        }
+    }
+}
+
+
 void MainWindow::InitializeDrawableObjectsListView()
 {
     HWND listViewHwnd = GetWindowFromId(hwnd_, IdcDrawableObjectsList);
@@ -509,6 +611,15 @@ void MainWindow::InitializeDrawableObjectsListView()
         lc.pszText = const_cast<LPWSTR>(ToWChar(attribute.display));
         ListView_InsertColumn(listViewHwnd, lc.iSubItem, &lc);
     }
+
+    // Timing and memory columns follow the attributes.
+    for (uint32_t i = 0; i < DrawableObjectStatisticTotal; ++i)
+    {
+        lc.iSubItem = DrawableObjectAttributeTotal + i;
+        lc.cx = 70 * dpi / DPI_100;
+        lc.pszText = const_cast<LPWSTR>(ToWChar(g_drawableObjectStatisticNames[i]));
+        ListView_InsertColumn(listViewHwnd, lc.iSubItem, &lc);
+    }
 }
 
 
@@ -539,16 +650,16 @@ void MainWindow::FillAttributesListView()
     lw.mask |= LVIF_PARAM;
 
     uint32_t listIndices[countof(DrawableObject::attributeList)];
-    ListSubstringPrioritizer substringPrioritizer(attributeFilter_, static_cast<uint32_t>(countof(DrawableObject::attributeList)));
 
-    // Get the filtered list.
-    for (uint32_t i = 0; i < countof(DrawableObject::attributeList); ++i)
+    // Get the filtered list, folding the names just once.
+    if (attributesPrioritizer_.GetItemCount() == 0)
     {
-        auto& attribute = DrawableObject::attributeList[i];
-        auto weight = substringPrioritizer.GetStringWeight(ToChar16ArrayRef(attribute.display));
-        substringPrioritizer.SetItemWeight(i, weight);
+        attributesPrioritizer_.SetNames(
+            static_cast<uint32_t>(countof(DrawableObject::attributeList)),
+            [](uint32_t i) { return ToChar16ArrayRef(DrawableObject::attributeList[i].display); }
+            );
     }
-    auto clampedListIndices = substringPrioritizer.GetItemIndices(OUT listIndices, /*excludeMismatches*/true);
+    auto clampedListIndices = attributesPrioritizer_.Filter(attributeFilter_, OUT listIndices, /*excludeMismatches*/true);
 
     // Add matching items to the ListView.
     for (auto& index : clampedListIndices)
@@ -579,57 +690,750 @@ void MainWindow::InitializeAttributeValuesListView()
 
 void MainWindow::UpdateDrawableObjectsListView()
 {
-    std::u16string truncatedString;
-    ListViewWriter lw(GetWindowFromId(hwnd_, IdcDrawableObjectsList));
-    lw.DisableDrawing();
+    // The list is owner data, so it holds no text of its own, and only the
+    // visible rows are read back from drawableObjects_ (GetDrawableObjectsListViewItem).
+    // Any column sort is dropped once objects are added, removed, or replaced.
+    if (!IsDrawableObjectsListSorted())
+    {
+        drawableObjectsListOrder_.clear();
+    }
 
-    size_t itemCount = lw.GetItemCount();
-    size_t const totalDrawableObjects = drawableObjects_.size();
-    if (itemCount > totalDrawableObjects)
+    HWND listViewHwnd = GetWindowFromId(hwnd_, IdcDrawableObjectsList);
+    isRecursing_ = true; // Stop pointless LVN_ITEMCHANGED messages.
+    ListView_SetItemCountEx(listViewHwnd, int(drawableObjects_.size()), LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+    isRecursing_ = false;
+    InvalidateRect(listViewHwnd, nullptr, false);
+}
+
+
+void MainWindow::UpdateDrawableObjectsListViewTimings()
+{
+    // The timing columns are read along with the rest when repainted.
+    InvalidateRect(GetWindowFromId(hwnd_, IdcDrawableObjectsList), nullptr, false);
+}
+
+
+void MainWindow::GetDrawableObjectsListViewItem(_Inout_ LVITEM& item)
+{
+    if (!(item.mask & LVIF_TEXT) || item.cchTextMax <= 0)
+        return;
+
+    item.pszText[0] = '\0';
+    if (uint32_t(item.iItem) >= drawableObjects_.size())
+        return;
+
+    uint32_t const drawableObjectIndex = IsDrawableObjectsListSorted() ? drawableObjectsListOrder_[item.iItem] : uint32_t(item.iItem);
+    auto const& drawableObject = drawableObjects_[drawableObjectIndex];
+    uint32_t const column = uint32_t(item.iSubItem);
+    if (column < DrawableObjectAttributeTotal)
+    {
+        // Long values like text are just truncated to the row's buffer.
+        std::u16string const& text = drawableObject.values_[column].stringValue.str();
+        StringCchCopyN(OUT item.pszText, item.cchTextMax, ToWChar(text.c_str()), text.size());
+    }
+    else
+    {
+        // Timing and memory columns follow the attributes.
+        uint32_t const statisticIndex = column - DrawableObjectAttributeTotal;
+        if (statisticIndex < DrawableObjectStatisticTotal)
+        {
+            StringCchPrintf(
+                OUT item.pszText,
+                item.cchTextMax,
+                (statisticIndex == DrawableObjectStatisticMemory) ? L"%.1f" : L"%.3f",
+                GetDrawableObjectStatistic(drawableObject, statisticIndex)
+                );
+        }
+    }
+}
+
+
+void MainWindow::LogDrawableObjectTimings()
+{
+    AppendLog(u"Object timings (ms): update, bounds, draw, of which creating cached resources\r\n");
+    for (size_t i = 0, count = drawableObjects_.size(); i < count; ++i)
+    {
+        auto const& drawableObject = drawableObjects_[i];
+        auto const& timings = drawableObject.timings_;
+        AppendLog(
+            u"%3d: %8.3f %8.3f %8.3f %8.3f  %s\r\n",
+            uint32_t(i),
+            PerformanceCounterToMilliseconds(timings.update.totalTicks),
+            PerformanceCounterToMilliseconds(timings.bounds.totalTicks),
+            PerformanceCounterToMilliseconds(timings.draw.totalTicks),
+            PerformanceCounterToMilliseconds(
+                timings.update.cachedResourceTicks + timings.bounds.cachedResourceTicks + timings.draw.cachedResourceTicks
+                ),
+            drawableObject.label_.c_str()
+            );
+    }
+}
+
+
+void MainWindow::SortDrawableObjectsByStatistic(uint32_t statisticIndex)
+{
+    if (statisticIndex >= DrawableObjectStatisticTotal || drawableObjects_.size() < 2)
+        return;
+
+    // Read each statistic once, since memory walks all the object's values.
+    std::vector<std::pair<double, uint32_t>> sortKeys(drawableObjects_.size());
+    for (uint32_t i = 0, count = uint32_t(drawableObjects_.size()); i < count; ++i)
+    {
+        sortKeys[i] = {GetDrawableObjectStatistic(drawableObjects_[i], statisticIndex), i};
+    }
+    std::stable_sort(
+        sortKeys.begin(),
+        sortKeys.end(),
+        [](auto const& a, auto const& b) { return a.first > b.first; }
+        );
+
+    // Only the list rows are reordered, leaving the objects, their drawing
+    // order, and the saved settings as they were. Keep the same objects
+    // selected at their new rows.
+    std::vector<uint32_t> selectedIndices = GetListViewMatchingIndices(GetWindowFromId(hwnd_, IdcDrawableObjectsList), LVNI_SELECTED, /*returnAllIfNoMatch*/false);
+    RemapDrawableObjectsListViewIndices(IN OUT selectedIndices);
+
+    drawableObjectsListOrder_.resize(sortKeys.size());
+    for (size_t i = 0, count = sortKeys.size(); i < count; ++i)
+    {
+        drawableObjectsListOrder_[i] = sortKeys[i].second;
+    }
+    drawableObjectsListOrderGeneration_ = drawableObjectsGeneration_;
+
+    SelectDrawableObjectsListView(selectedIndices);
+    InvalidateRect(GetWindowFromId(hwnd_, IdcDrawableObjectsList), nullptr, false);
+}
+
+
+bool MainWindow::IsDrawableObjectsListSorted() const noexcept
+{
+    return !drawableObjectsListOrder_.empty()
+        && drawableObjectsListOrder_.size() == drawableObjects_.size()
+        && drawableObjectsListOrderGeneration_ == drawableObjectsGeneration_;
+}
+
+
+void MainWindow::RemapDrawableObjectsListViewIndices(_Inout_ std::vector<uint32_t>& indices)
+{
+    if (!IsDrawableObjectsListSorted())
+        return;
+
+    for (auto& index : indices)
+    {
+        index = (index < drawableObjectsListOrder_.size()) ? drawableObjectsListOrder_[index] : ~0u;
+    }
+
+    // Callers expect the ascending order the list view returns rows in.
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::find(indices.begin(), indices.end(), ~0u), indices.end());
+}
+
+
+int MainWindow::GetDrawableObjectsListViewRow(uint32_t drawableObjectIndex)
+{
+    if (!IsDrawableObjectsListSorted())
+        return int(drawableObjectIndex);
+
+    auto it = std::find(drawableObjectsListOrder_.begin(), drawableObjectsListOrder_.end(), drawableObjectIndex);
+    return (it != drawableObjectsListOrder_.end()) ? int(it - drawableObjectsListOrder_.begin()) : -1;
+}
+
+
+void MainWindow::LogMemoryUsage()
+{
+    DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
+
+    std::vector<DrawingCanvas::SharedResourceUsage> sharedResourceUsage;
+    drawingCanvas.GetSharedResourceUsage(OUT sharedResourceUsage);
+    std::sort(
+        sharedResourceUsage.begin(),
+        sharedResourceUsage.end(),
+        [](auto const& a, auto const& b) { return a.byteSize > b.byteSize; }
+        );
+
+    std::vector<std::pair<DrawableObjectAndValues::MemoryUsage, uint32_t>> objectUsage(drawableObjects_.size());
+    DrawableObjectAndValues::MemoryUsage objectTotals;
+    for (uint32_t i = 0, count = uint32_t(drawableObjects_.size()); i < count; ++i)
+    {
+        auto usage = drawableObjects_[i].GetMemoryUsage();
+        objectUsage[i] = {usage, i};
+        objectTotals.drawableObject += usage.drawableObject;
+        objectTotals.cachedPixels += usage.cachedPixels;
+    }
+    std::sort(
+        objectUsage.begin(),
+        objectUsage.end(),
+        [](auto const& a, auto const& b) { return a.first.GetTotal() > b.first.GetTotal(); }
+        );
+
+    size_t sharedResourceTotal = 0;
+    for (auto const& usage : sharedResourceUsage)
+    {
+        sharedResourceTotal += usage.byteSize;
+    }
+
+    // Values shared between objects count once in the total.
+    objectTotals.values = DrawableObjectAndValues::GetValuesByteSize(drawableObjects_);
+
+    AppendLog(u"Memory usage (KB), largest first:\r\n");
+    AppendLog(
+        u"  %10.1f  canvas render targets and glyph atlas\r\n"
+        u"  %10.1f  shared resources (%d)\r\n"
+        u"  %10.1f  object caches\r\n"
+        u"  %10.1f  object cached pixels\r\n"
+        u"  %10.1f  attribute values, shared buffers counted once\r\n",
+        drawingCanvas.GetRenderTargetByteSize() / 1024.0,
+        sharedResourceTotal / 1024.0,
+        uint32_t(sharedResourceUsage.size()),
+        objectTotals.drawableObject / 1024.0,
+        objectTotals.cachedPixels / 1024.0,
+        objectTotals.values / 1024.0
+        );
+
+    AppendLog(u"Shared resources (KB):\r\n");
+    for (auto const& usage : sharedResourceUsage)
+    {
+        std::u16string name(usage.name);
+        AppendLog(u"  %10.1f%s %s\r\n", usage.byteSize / 1024.0, usage.isEstimated ? u"~" : u" ", name.c_str());
+    }
+
+    AppendLog(u"Objects (KB): total, caches, cached pixels, attribute values\r\n");
+    for (auto const& usage : objectUsage)
+    {
+        AppendLog(
+            u"%3d: %10.1f %10.1f %10.1f %10.1f  %s\r\n",
+            usage.second,
+            usage.first.GetTotal() / 1024.0,
+            usage.first.drawableObject / 1024.0,
+            usage.first.cachedPixels / 1024.0,
+            usage.first.values / 1024.0,
+            drawableObjects_[usage.second].label_.c_str()
+            );
+    }
+}
+
+
+void MainWindow::TrimCaches()
+{
+    DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
+
+    // Candidates are each object's caches and pixels, and each sized shared
+    // resource, both sorted largest first. Release from whichever list has
+    // the larger next entry until half the total is freed, so that the few
+    // big consumers go and the many small ones (mostly fonts) stay.
+    std::vector<std::pair<size_t, uint32_t>> objectByteSizes;
+    size_t totalByteSize = 0;
+    for (uint32_t i = 0, count = uint32_t(drawableObjects_.size()); i < count; ++i)
+    {
+        auto usage = drawableObjects_[i].GetMemoryUsage();
+        size_t const byteSize = usage.drawableObject + usage.cachedPixels;
+        if (byteSize > 0)
+        {
+            objectByteSizes.push_back({byteSize, i});
+            totalByteSize += byteSize;
+        }
+    }
+    std::sort(
+        objectByteSizes.begin(),
+        objectByteSizes.end(),
+        [](auto const& a, auto const& b) { return a.first > b.first; }
+        );
+
+    std::vector<DrawingCanvas::SharedResourceUsage> sharedResourceUsage;
+    drawingCanvas.GetSharedResourceUsage(OUT sharedResourceUsage);
+    std::sort(
+        sharedResourceUsage.begin(),
+        sharedResourceUsage.end(),
+        [](auto const& a, auto const& b) { return a.byteSize > b.byteSize; }
+        );
+    for (auto const& usage : sharedResourceUsage)
+    {
+        totalByteSize += usage.byteSize;
+    }
+
+    size_t releasedByteSize = 0;
+    uint32_t releasedObjectCount = 0;
+    uint32_t releasedResourceCount = 0;
+    auto objectByteSize = objectByteSizes.begin();
+    auto resourceUsage = sharedResourceUsage.begin();
+    while (releasedByteSize < totalByteSize / 2)
+    {
+        size_t const nextObjectByteSize = (objectByteSize != objectByteSizes.end()) ? objectByteSize->first : 0;
+        size_t const nextResourceByteSize = (resourceUsage != sharedResourceUsage.end()) ? resourceUsage->byteSize : 0;
+        if (nextObjectByteSize == 0 && nextResourceByteSize == 0)
+            break;
+
+        if (nextObjectByteSize >= nextResourceByteSize)
+        {
+            drawableObjects_[objectByteSize->second].ReleaseCaches();
+            releasedByteSize += nextObjectByteSize;
+            ++releasedObjectCount;
+            ++objectByteSize;
+        }
+        else
+        {
+            // The canvas releases its largest first too, which is this one.
+            releasedByteSize += drawingCanvas.TrimSharedResources(1);
+            ++releasedResourceCount;
+            ++resourceUsage;
+        }
+    }
+    drawingCanvas.TrimRenderTargets();
+
+    AppendLog(
+        u"Released %.1f KB of %.1f KB cached, from %d objects and %d shared resources\r\n",
+        releasedByteSize / 1024.0,
+        totalByteSize / 1024.0,
+        releasedObjectCount,
+        releasedResourceCount
+        );
+    DeferUpdateUi(NeededUiUpdateDrawableObjectsTimings);
+}
+
+
+void MainWindow::CompareDrawableObjectsPixels()
+{
+    std::vector<uint32_t> drawableObjectIndices = GetSelectedDrawableObjectIndices();
+    if (drawableObjectIndices.size() < 2)
+    {
+        ShowMessageAndAppendLog(u"Select at least two drawable objects in the list first.");
+        return;
+    }
+
+    std::vector<DrawableObjectAndValues> drawableObjects;
+    drawableObjects.reserve(drawableObjectIndices.size());
+    for (auto index : drawableObjectIndices)
     {
-        lw.DeleteAllItems();
-        itemCount = 0;
+        drawableObjects.push_back(drawableObjects_[index]);
     }
-    lw.ReserveItemCount(int(totalDrawableObjects));
 
-    for (auto const& drawableObject : drawableObjects_)
+    // Use a separate offscreen canvas so the visible one keeps its size and caches.
+    ComPtr<DrawingCanvas> drawingCanvas(new DrawingCanvas());
+    std::vector<PixelDiffStatistics> statistics;
+    HRESULT hr = CompareDrawableObjects(drawableObjects, *drawingCanvas, OUT statistics);
+    if (FAILED(hr))
+    {
+        ShowMessageAndAppendLog(u"Failed to compare drawable objects, 0x%08X", hr);
+        return;
+    }
+
+    AppendLog(u"Pixels compared to object %d:\r\n", drawableObjectIndices[0]);
+    std::u16string statisticsText;
+    for (size_t i = 0, count = statistics.size(); i < count; ++i)
+    {
+        FormatPixelDiffStatistics(statistics[i], OUT statisticsText);
+        AppendLog(u"%3d: %s\r\n", drawableObjectIndices[i + 1], statisticsText.c_str());
+    }
+}
+
+
+namespace
+{
+    float constexpr g_animationPeriodSeconds = 4.0f; // One full oscillation or rotation.
+}
+
+
+void MainWindow::FrameTimings::Clear()
+{
+    updateMilliseconds.clear();
+    drawMilliseconds.clear();
+    frameMilliseconds.clear();
+    nextFrameIndex = 0;
+    frameCount = 0;
+    lastPaintTicks = 0;
+    pendingUpdateMilliseconds = 0;
+}
+
+
+void MainWindow::FrameTimings::AddFrame(float newDrawMilliseconds, int64_t paintTicks)
+{
+    // The first paint has no previous one to measure the interval from.
+    float const newFrameMilliseconds = (lastPaintTicks != 0)
+        ? float(PerformanceCounterToMilliseconds(paintTicks - lastPaintTicks))
+        : 0.0f;
+    lastPaintTicks = paintTicks;
+
+    if (drawMilliseconds.size() < maximumFrameCount)
     {
-        if (lw.iItem >= int(itemCount))
+        updateMilliseconds.push_back(pendingUpdateMilliseconds);
+        drawMilliseconds.push_back(newDrawMilliseconds);
+        frameMilliseconds.push_back(newFrameMilliseconds);
+    }
+    else
+    {
+        updateMilliseconds[nextFrameIndex] = pendingUpdateMilliseconds;
+        drawMilliseconds[nextFrameIndex] = newDrawMilliseconds;
+        frameMilliseconds[nextFrameIndex] = newFrameMilliseconds;
+    }
+    nextFrameIndex = (nextFrameIndex + 1) % maximumFrameCount;
+    pendingUpdateMilliseconds = 0;
+    ++frameCount;
+}
+
+
+float MainWindow::FrameTimings::GetPercentile(array_ref<float const> values, float fraction)
+{
+    if (values.empty())
+        return 0;
+
+    // Select a copy, since the ring buffer order must be kept.
+    std::vector<float> sortedValues(values.begin(), values.end());
+    size_t const index = std::min(size_t(fraction * (sortedValues.size() - 1) + 0.5f), sortedValues.size() - 1);
+    std::nth_element(sortedValues.begin(), sortedValues.begin() + index, sortedValues.end());
+    return sortedValues[index];
+}
+
+
+void MainWindow::StartAnimatingDrawableObjects(DrawableObjectAttribute attributeIndex)
+{
+    StopAnimatingDrawableObjects();
+
+    std::vector<uint32_t> drawableObjectIndices = GetSelectedDrawableObjectIndices();
+    for (auto objectIndex : drawableObjectIndices)
+    {
+        auto& drawableObject = drawableObjects_[objectIndex];
+        AnimatedDrawableObject animatedObject = {objectIndex, drawableObject.values_[attributeIndex]};
+
+        switch (attributeIndex)
+        {
+        case DrawableObjectAttributeFontSize:
+        case DrawableObjectAttributeAxisValues:
+        case DrawableObjectAttributeTransform:
+            {
+                auto values = drawableObject.GetValues<float>(attributeIndex);
+                animatedObject.baseValues.assign(values.begin(), values.end());
+            }
+            break;
+
+        case DrawableObjectAttributePixelZoom:
+            animatedObject.baseValues.push_back(float(std::max(drawableObject.GetTypedValue<DrawableObjectAttributePixelZoom>(1), 1u)));
+            break;
+        }
+
+        // Fill in the attribute defaults for objects that leave them empty.
+        // Objects without any axis values have nothing to vary.
+        if (attributeIndex == DrawableObjectAttributeFontSize && animatedObject.baseValues.empty())
+        {
+            animatedObject.baseValues.push_back(DrawableObject::defaultFontSize);
+        }
+        else if (attributeIndex == DrawableObjectAttributeTransform && animatedObject.baseValues.size() < 6)
         {
-            isRecursing_ = true; // Stop pointless LVN_ITEMCHANGED messages.
-            lw.InsertItem(u"");
-            isRecursing_ = false;
-            ++itemCount;
+            auto const& identity = DrawableObject::identityTransform.m;
+            animatedObject.baseValues.assign(std::begin(identity), std::end(identity));
         }
-    
-        for (uint32_t i = 0; i < DrawableObjectAttributeTotal; ++i)
+        else if (animatedObject.baseValues.empty())
         {
-            auto* text = &drawableObject.values_[i].stringValue;
-            if (text->size() > 256)
+            continue;
+        }
+
+        animatedObjects_.push_back(std::move(animatedObject));
+    }
+
+    if (animatedObjects_.empty())
+    {
+        ShowMessageAndAppendLog(u"None of the selected drawable objects have %s values to animate.", DrawableObject::attributeList[attributeIndex].name);
+        return;
+    }
+
+    animatedAttribute_ = attributeIndex;
+    animatedObjectsTotal_ = drawableObjects_.size();
+    animationStartTicks_ = GetPerformanceCounter();
+    frameTimings_.Clear();
+
+    // Just request the minimum timer interval, since painting naturally
+    // throttles it. The WM_TIMER message is not posted again until the
+    // last one is processed, and repaints happen before it when the queue
+    // is otherwise empty.
+    SetTimer(hwnd_, IdcAnimateFrame, USER_TIMER_MINIMUM, nullptr);
+}
+
+
+void MainWindow::SaveUndoSnapshot(_In_opt_ std::vector<uint32_t> const* coalescingKey)
+{
+    if (coalescingKey != nullptr && !undoSnapshots_.empty() && *coalescingKey == undoCoalescingKey_)
+        return;
+
+    // Snapshots share the attribute values and drawable objects, so this
+    // copies no text and keeps the cached fonts and layouts alive.
+    SaveUndoSnapshot(DrawableObjectAndValues::TakeSnapshot(drawableObjects_));
+    if (coalescingKey != nullptr)
+        undoCoalescingKey_ = *coalescingKey;
+}
+
+
+void MainWindow::SaveUndoSnapshot(DrawableObjectAndValues::Snapshot snapshot)
+{
+    if (undoSnapshots_.size() >= maximumUndoSnapshots)
+    {
+        undoSnapshots_.erase(undoSnapshots_.begin());
+    }
+
+    undoSnapshots_.push_back(std::move(snapshot));
+    redoSnapshots_.clear();
+    undoCoalescingKey_.clear();
+}
+
+
+void MainWindow::RestoreUndoSnapshot(bool isRedo)
+{
+    auto& sourceSnapshots = isRedo ? redoSnapshots_ : undoSnapshots_;
+    auto& oppositeSnapshots = isRedo ? undoSnapshots_ : redoSnapshots_;
+    if (sourceSnapshots.empty())
+    {
+        AppendLog(isRedo ? u"Nothing to redo.\r\n" : u"Nothing to undo.\r\n");
+        return;
+    }
+
+    StopAnimatingDrawableObjects(/*restoreValues*/false);
+
+    DrawableObjectAndValues::Snapshot snapshot = std::move(sourceSnapshots.back());
+    sourceSnapshots.pop_back();
+    oppositeSnapshots.push_back(DrawableObjectAndValues::TakeSnapshot(drawableObjects_));
+    undoCoalescingKey_.clear();
+
+    // Only objects changed since the snapshot are replaced and updated.
+    uint32_t restoredCount = DrawableObjectAndValues::RestoreSnapshot(snapshot, IN OUT drawableObjects_);
+    drawableObjectsListOrder_.clear(); // The rows may now be other objects.
+    AppendLog(u"%s restored %d of %d drawable objects.\r\n", isRedo ? u"Redo" : u"Undo", restoredCount, uint32_t(drawableObjects_.size()));
+
+    DeferUpdateUi(
+        NeededUiUpdateDrawableObjectsListView |
+        NeededUiUpdateAttributesListView |
+        NeededUiUpdateAttributeValuesListView |
+        NeededUiUpdateAttributeValuesEdit |
+        NeededUiUpdateAttributeValuesSlider |
+        NeededUiUpdateDrawableObjectsCanvas |
+        NeededUiUpdateTextEdit
+        );
+}
+
+
+void MainWindow::StopAnimatingDrawableObjects(bool restoreValues)
+{
+    if (animatedAttribute_ == DrawableObjectAttributeTotal)
+        return;
+
+    KillTimer(hwnd_, IdcAnimateFrame);
+
+    if (restoreValues)
+    {
+        std::vector<uint32_t> drawableObjectIndices;
+        drawableObjectIndices.reserve(animatedObjects_.size());
+        for (auto const& animatedObject : animatedObjects_)
+        {
+            drawableObjects_[animatedObject.objectIndex].Set(animatedAttribute_, animatedObject.originalValue);
+            drawableObjectIndices.push_back(animatedObject.objectIndex);
+        }
+        DrawableObjectAndValues::Update(drawableObjects_, drawableObjectIndices);
+    }
+
+    AppendLog(
+        u"Animated %s over %d frames, draw p50 %.3f ms, p95 %.3f ms\r\n",
+        DrawableObject::attributeList[animatedAttribute_].name,
+        frameTimings_.frameCount,
+        FrameTimings::GetPercentile(frameTimings_.drawMilliseconds, 0.50f),
+        FrameTimings::GetPercentile(frameTimings_.drawMilliseconds, 0.95f)
+        );
+
+    animatedAttribute_ = DrawableObjectAttributeTotal;
+    animatedObjects_.clear();
+    frameTimingOverlayRect_ = {};
+
+    // Repaint everything to erase the overlay too.
+    RepaintDrawableObjects(/*onlyChangedObjects*/false);
+    DeferUpdateUi(NeededUiUpdateAttributeValuesListView | NeededUiUpdateAttributeValuesEdit | NeededUiUpdateAttributeValuesSlider);
+}
+
+
+void MainWindow::AnimateDrawableObjects()
+{
+    // The stored indices are stale once objects are added or removed, so
+    // just leave the objects as they are.
+    if (animatedAttribute_ == DrawableObjectAttributeTotal || drawableObjects_.size() != animatedObjectsTotal_)
+    {
+        StopAnimatingDrawableObjects(/*restoreValues*/false);
+        return;
+    }
+
+    int64_t const updateStartTicks = GetPerformanceCounter();
+    float const seconds = float(PerformanceCounterToMilliseconds(updateStartTicks - animationStartTicks_) / 1000.0);
+    float const angle = fmod(seconds / g_animationPeriodSeconds, 1.0f) * float(M_PI * 2);
+    float const wave = sin(angle); // -1 to 1
+
+    char16_t buffer[1000];
+    std::vector<uint32_t> drawableObjectIndices;
+    drawableObjectIndices.reserve(animatedObjects_.size());
+
+    for (auto const& animatedObject : animatedObjects_)
+    {
+        auto const& baseValues = animatedObject.baseValues;
+        buffer[0] = '\0';
+
+        switch (animatedAttribute_)
+        {
+        case DrawableObjectAttributeFontSize:
+            StringCchPrintf(OUT ToWChar(buffer), countof(buffer), L"%.2f", baseValues[0] * (1 + wave * 0.5f));
+            break;
+
+        case DrawableObjectAttributeAxisValues:
             {
-                truncatedString.assign(text->c_str(), 256);
-                text = &truncatedString;
+                // Vary each axis by half its value either way, which stays in
+                // range for the common axes (weight, width, optical size).
+                // Axes at zero, like slant, are unchanged.
+                size_t bufferLength = 0;
+                for (float value : baseValues)
+                {
+                    size_t remainingLength = countof(buffer) - bufferLength;
+                    StringCchPrintf(OUT ToWChar(buffer + bufferLength), remainingLength, L"%s%.2f", bufferLength > 0 ? L" " : L"", value * (1 + wave * 0.5f));
+                    bufferLength += wcsnlen(ToWChar(buffer + bufferLength), remainingLength);
+                }
+            }
+            break;
+
+        case DrawableObjectAttributeTransform:
+            {
+                // Rotate around the origin before the object's own transform.
+                DX_MATRIX_3X2F baseTransform;
+                std::copy(baseValues.begin(), baseValues.begin() + 6, std::begin(baseTransform.m));
+                DX_MATRIX_3X2F rotation = {cos(angle), sin(angle), -sin(angle), cos(angle), 0, 0};
+                DX_MATRIX_3X2F transform = CombineMatrix(rotation, baseTransform);
+                StringCchPrintf(
+                    OUT ToWChar(buffer),
+                    countof(buffer),
+                    L"%.4f %.4f %.4f %.4f %.2f %.2f",
+                    transform.xx, transform.xy, transform.yx, transform.yy, transform.dx, transform.dy
+                    );
             }
-            isRecursing_ = true; // Stop pointless LVN_ITEMCHANGED messages.
-            lw.SetItemText(i, text->c_str());
-            isRecursing_ = false;
+            break;
+
+        case DrawableObjectAttributePixelZoom:
+            // Step from the original zoom up to 8 times it and back.
+            StringCchPrintf(OUT ToWChar(buffer), countof(buffer), L"%u", uint32_t(baseValues[0]) * (1 + uint32_t((1 - cos(angle)) * 3.5f + 0.5f)));
+            break;
         }
-        lw.AdvanceItem();
+
+        drawableObjects_[animatedObject.objectIndex].Set(animatedAttribute_, buffer);
+        drawableObjectIndices.push_back(animatedObject.objectIndex);
     }
-    lw.EnableDrawing();
-    InvalidateRect(lw.hwnd, nullptr, false);
+    DrawableObjectAndValues::Update(drawableObjects_, drawableObjectIndices);
+
+    frameTimings_.pendingUpdateMilliseconds = float(PerformanceCounterToMilliseconds(GetPerformanceCounter() - updateStartTicks));
+
+    RepaintDrawableObjects();
+    InvalidateRect(GetWindowFromId(hwnd_, IdcDrawingCanvas), &frameTimingOverlayRect_, false);
+}
+
+
+void MainWindow::DrawFrameTimingOverlay(DrawingCanvasControl& drawingCanvas)
+{
+    HDC hdc = drawingCanvas.GetHDC();
+    if (hdc == nullptr)
+        return;
+
+    auto const& frameMilliseconds = frameTimings_.frameMilliseconds;
+    float const averageFrameMilliseconds = frameMilliseconds.empty()
+        ? 0.0f
+        : std::accumulate(frameMilliseconds.begin(), frameMilliseconds.end(), 0.0f) / frameMilliseconds.size();
+
+    struct
+    {
+        char16_t const* name;
+        std::vector<float> const& values;
+    } const rows[] = {
+        {u"update", frameTimings_.updateMilliseconds},
+        {u"draw  ", frameTimings_.drawMilliseconds},
+        {u"frame ", frameTimings_.frameMilliseconds},
+    };
+
+    // The most recent entry is just before the next one to overwrite.
+    uint32_t const lastFrameIndex = (frameTimings_.nextFrameIndex + FrameTimings::maximumFrameCount - 1) % FrameTimings::maximumFrameCount;
+
+    std::u16string text;
+    char16_t buffer[200];
+    StringCchPrintf(
+        OUT ToWChar(buffer),
+        countof(buffer),
+        L"Animating %s, frame %u, %.1f fps\n"
+        L"(ms)     last    p50    p95    p99",
+        DrawableObject::attributeList[animatedAttribute_].name,
+        frameTimings_.frameCount,
+        averageFrameMilliseconds > 0 ? 1000.0f / averageFrameMilliseconds : 0.0f
+        );
+    text.append(buffer);
+
+    for (auto const& row : rows)
+    {
+        StringCchPrintf(
+            OUT ToWChar(buffer),
+            countof(buffer),
+            L"\n%s %6.2f %6.2f %6.2f %6.2f",
+            row.name,
+            lastFrameIndex < row.values.size() ? row.values[lastFrameIndex] : 0.0f,
+            FrameTimings::GetPercentile(row.values, 0.50f),
+            FrameTimings::GetPercentile(row.values, 0.95f),
+            FrameTimings::GetPercentile(row.values, 0.99f)
+            );
+        text.append(buffer);
+    }
+
+    // Draw in the corner of the canvas, unaffected by the view transform,
+    // directly onto the pixels after the objects.
+    HFONT previousFont = SelectFont(hdc, GetStockObject(ANSI_FIXED_FONT));
+    RECT textRect = {};
+    DrawText(hdc, ToWChar(text.c_str()), int(text.size()), IN OUT &textRect, DT_CALCRECT | DT_NOPREFIX);
+    OffsetRect(IN OUT &textRect, 8, 8);
+
+    RECT backgroundRect = textRect;
+    InflateRect(IN OUT &backgroundRect, 4, 4);
+    FillRect(hdc, &backgroundRect, GetStockBrush(BLACK_BRUSH));
+    COLORREF previousTextColor = SetTextColor(hdc, RGB(255, 255, 255));
+    int previousBkMode = SetBkMode(hdc, TRANSPARENT);
+    DrawText(hdc, ToWChar(text.c_str()), int(text.size()), IN OUT &textRect, DT_NOPREFIX | DT_NOCLIP);
+    SetBkMode(hdc, previousBkMode);
+    SetTextColor(hdc, previousTextColor);
+    SelectFont(hdc, previousFont);
+
+    // Keep the largest extent, so the next frame also erases any wider text
+    // from this one, and have the objects beneath redrawn then.
+    UnionRect(OUT &frameTimingOverlayRect_, &frameTimingOverlayRect_, &backgroundRect);
+    drawingCanvas.InvalidateTiles(&frameTimingOverlayRect_);
 }
 
 
 void MainWindow::DeferUpdateUi(NeededUiUpdate neededUiUpdate)
 {
-    neededUiUpdate_ |= neededUiUpdate;
-    SetTimer(hwnd_, IdcUpdateUi, 50, nullptr);
+    // Arm the timer only for the first change of a burst, rather than pushing
+    // it back each time, so steady typing still updates every couple of frames
+    // instead of waiting for a pause. Everything in between is coalesced.
+    bool const isUpdatePending = (neededUiUpdate_ != NeededUiUpdateNone);
+    neededUiUpdate_ |= neededUiUpdate;
+    if (!isUpdatePending)
+    {
+        SetTimer(hwnd_, IdcUpdateUi, 33, nullptr);
+    }
+}
+
+
+void MainWindow::ReadPendingEdits()
+{
+    if (neededUiUpdate_ & NeededUiReadTextEdit)
+    {
+        neededUiUpdate_ &= ~NeededUiReadTextEdit;
+        ReadTextEdit();
+    }
+    if (neededUiUpdate_ & NeededUiReadAttributeValuesEdit)
+    {
+        neededUiUpdate_ &= ~NeededUiReadAttributeValuesEdit;
+        ReadAttributeValueEdit();
+    }
 }
 
 
 void MainWindow::UpdateUi()
 {
+    // Apply typed text first, since the other updates reflect it.
+    ReadPendingEdits();
+
     auto neededUiUpdate = neededUiUpdate_;
     neededUiUpdate_ = NeededUiUpdateNone;
 
@@ -665,6 +1469,10 @@ void MainWindow::UpdateUi()
     {
         UpdateTextEdit();
     }
+    if ((neededUiUpdate & NeededUiUpdateDrawableObjectsTimings) && !(neededUiUpdate & NeededUiUpdateDrawableObjectsListView))
+    {
+        UpdateDrawableObjectsListViewTimings();
+    }
 }
 
 
@@ -707,18 +1515,22 @@ void MainWindow::UpdateAttributesListView()
 
 void MainWindow::UpdateAttributeValuesListView()
 {
-    ListViewWriter lw(GetWindowFromId(hwnd_, IdcAttributeValuesList));
-    lw.DisableDrawing();
-    lw.DeleteAllItems();
-
+    // The list is owner data, with rows read back through the order here
+    // (GetAttributeValuesListViewItem), since there may be thousands of
+    // values, such as the installed font families.
+    HWND listViewHwnd = GetWindowFromId(hwnd_, IdcAttributeValuesList);
     std::u16string stringValueBuffer;
+    auto& orderedIndices = attributeValuesListOrder_;
+    orderedIndices.clear();
+    attributeValuesListIndex_ = selectedAttributeIndex_;
+    int selectedItem = -1; // Keep track of which value to select, if any.
 
     // Nop if selectedAttributeIndex_ invalid (no attribute selected).
     if (selectedAttributeIndex_ < DrawableObjectAttributeTotal)
     {
         Attribute const& attribute = DrawableObject::attributeList[selectedAttributeIndex_];
         uint32_t const predefinedValuesCount = static_cast<uint32_t>(attribute.predefinedValues.size());
-        fast_vector<uint32_t, 20, false> orderedIndices(predefinedValuesCount);
+        orderedIndices.resize(predefinedValuesCount);
 
         if (attribute.semantic == Attribute::SemanticLongText || !isTypingAttributeValueToFilter_)
         {
@@ -728,18 +1540,24 @@ void MainWindow::UpdateAttributeValuesListView()
         else
         {
             // For single line, reorder the list by best match typed so far
-            // (if recently editing the value).
-            attribute.GetPredefinedValueIndices(selectedAttributeValue_.c_str(), OUT orderedIndices);
+            // (if recently editing the value). Keep the names folded while
+            // the same attribute is being edited.
+            if (attributeValuesPrioritizerIndex_ != selectedAttributeIndex_)
+            {
+                attributeValuesPrioritizer_.SetNames(
+                    predefinedValuesCount,
+                    [&](uint32_t i) { return ToChar16ArrayRef(attribute.predefinedValues[i].GetName()); }
+                    );
+                attributeValuesPrioritizerIndex_ = selectedAttributeIndex_;
+            }
+            attributeValuesPrioritizer_.Filter(selectedAttributeValue_, OUT orderedIndices, /*excludeMismatches*/false);
         }
         isTypingAttributeValueToFilter_ = false; // Reset once used.
 
-        int selectedItem = -1; // Keep track of which value to select, if any.
-
-        for (uint32_t i = 0; i < predefinedValuesCount; ++i)
+        // Keep track of the selection if the strings exactly matched.
+        for (uint32_t i = 0; i < predefinedValuesCount && !selectedAttributeValue_.empty(); ++i)
         {
-            // Get the name and value for each column.
             uint32_t valueIndex = orderedIndices[i];
-            auto& valueMapping = attribute.predefinedValues[valueIndex];
             auto* name = attribute.GetPredefinedValueName(valueIndex);
             auto* stringValue = attribute.GetPredefinedValue(
                 valueIndex,
@@ -747,40 +1565,65 @@ void MainWindow::UpdateAttributeValuesListView()
                 OUT stringValueBuffer
                 );
 
-            // Add entry.
-            lw.lParam = valueIndex;
-            lw.mask |= LVIF_PARAM; // Use the lparam to keep track of attribute value index, regardless of order.
-            lw.InsertItem(name != nullptr ? name : u"");
-            lw.mask &= ~LVIF_PARAM;
-            if (stringValue != nullptr)
-            {
-                lw.SetItemText(/*column*/1, stringValue);
-            }
-            lw.AdvanceItem();
-
-            // Keep track of the selection if the strings exactly matched.
-            if (!selectedAttributeValue_.empty())
+            if (_wcsicmp(ToWChar(name), ToWChar(selectedAttributeValue_.c_str())) == 0
+            || (stringValue != nullptr && _wcsicmp(ToWChar(stringValue), ToWChar(selectedAttributeValue_.c_str())) == 0))
             {
-                if (_wcsicmp(ToWChar(name), ToWChar(selectedAttributeValue_.c_str())) == 0
-                || (stringValue != nullptr && _wcsicmp(ToWChar(stringValue), ToWChar(selectedAttributeValue_.c_str())) == 0))
-                {
-                    selectedItem = i;
-                }
+                selectedItem = i;
             }
         }
+    }
 
-        if (selectedItem != -1)
-        {
-            isRecursing_ = true;
-            lw.SelectAndFocusItem(selectedItem);
-            lw.iItem = selectedItem;
-            lw.EnsureVisible();
-            isRecursing_ = false;
-        }
+    // Since rows hold no state of their own, clear the old selection before
+    // the rows change meaning.
+    isRecursing_ = true;
+    ListView_SetItemState(listViewHwnd, -1, 0, LVIS_FOCUSED | LVIS_SELECTED);
+    ListView_SetItemCountEx(listViewHwnd, int(orderedIndices.size()), 0);
+    if (selectedItem != -1)
+    {
+        ListView_SetItemState(listViewHwnd, selectedItem, LVIS_FOCUSED | LVIS_SELECTED, LVIS_FOCUSED | LVIS_SELECTED);
+        ListView_EnsureVisible(listViewHwnd, selectedItem, false);
     }
+    isRecursing_ = false;
 
-    lw.EnableDrawing();
-    InvalidateRect(lw.hwnd, nullptr, false);
+    InvalidateRect(listViewHwnd, nullptr, false);
+}
+
+
+void MainWindow::GetAttributeValuesListViewItem(_Inout_ LVITEM& item)
+{
+    if (uint32_t(item.iItem) >= attributeValuesListOrder_.size() || attributeValuesListIndex_ >= DrawableObjectAttributeTotal)
+        return;
+
+    Attribute const& attribute = DrawableObject::attributeList[attributeValuesListIndex_];
+    uint32_t const valueIndex = attributeValuesListOrder_[item.iItem];
+    if (item.mask & LVIF_PARAM)
+    {
+        item.lParam = valueIndex;
+    }
+
+    if (!(item.mask & LVIF_TEXT) || item.cchTextMax <= 0)
+        return;
+
+    // Get the name or value for the column.
+    std::u16string stringValueBuffer;
+    char16_t const* text = (item.iSubItem == 0)
+        ? attribute.GetPredefinedValueName(valueIndex)
+        : attribute.GetPredefinedValue(
+            valueIndex,
+            attribute.GetPredefinedValueFlagsString | attribute.GetPredefinedValueFlagsInteger,
+            OUT stringValueBuffer
+            );
+    StringCchCopy(OUT item.pszText, item.cchTextMax, ToWChar(text != nullptr ? text : u""));
+}
+
+
+void MainWindow::RemapAttributeValuesListViewIndices(_Inout_ array_ref<uint32_t> indices)
+{
+    // Rows beyond the list map past any predefined value, which callers skip.
+    for (auto& index : indices)
+    {
+        index = (index < attributeValuesListOrder_.size()) ? attributeValuesListOrder_[index] : ~0u;
+    }
 }
 
 
@@ -887,17 +1730,25 @@ void MainWindow::UpdateTextEdit()
     fast_vector<uint32_t, 30, false> drawableObjectIndices(drawableObjects_.size());
     std::iota(OUT drawableObjectIndices.begin(), OUT drawableObjectIndices.end(), 0);
 
-    char16_t const* stringValue = DrawableObjectAndValues::GetStringValue(
+    SharedString sharedText = DrawableObjectAndValues::GetSharedStringValue(
                                         drawableObjects_,
                                         drawableObjectIndices,
-                                        DrawableObjectAttributeText,
-                                        u""
+                                        DrawableObjectAttributeText
                                         );
 
+    // Resetting the edit to megabytes of text takes a while, so leave it be
+    // when it already shows the objects' text, as when it was typed there.
+    // Objects given the typed text hold the very same buffer, comparing
+    // without reading the text.
+    if (sharedText == textEditText_)
+        return;
+    textEditText_ = sharedText;
+
+    char16_t const* stringValue = sharedText.c_str();
     std::u16string text;
     if (textEscapeMode_ != TextEscapeModeNone)
     {
-        text.assign(stringValue);
+        text.assign(stringValue, sharedText.size());
         EscapeText(IN OUT text);
         stringValue = text.c_str();
     }
@@ -929,9 +1780,34 @@ void MainWindow::UpdateAttributeValuesSlider()
 }
 
 
-void MainWindow::RepaintDrawableObjects()
+void MainWindow::RepaintDrawableObjects(bool onlyChangedObjects)
 {
-    InvalidateRect(GetWindowFromId(hwnd_, IdcDrawingCanvas), nullptr, false);
+    HWND canvasHwnd = GetWindowFromId(hwnd_, IdcDrawingCanvas);
+    DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(canvasHwnd);
+
+    // Invalidate just the objects that changed since the last paint, unless
+    // objects were added, removed, or the list replaced (which leaves no record
+    // of where they were) or nothing has been painted yet.
+    if (onlyChangedObjects
+    &&  drawableObjects_.size() == drawnObjectCount_
+    &&  drawableObjectsGeneration_ == drawnObjectsGeneration_
+    &&  drawingCanvas.GetHDC() != nullptr)
+    {
+        DX_MATRIX_3X2F matrix;
+        drawingCanvas.CalculateViewMatrix(OUT matrix);
+        DrawableObjectAndValues::Arrange(drawableObjects_, drawingCanvas, &drawableObjectsIndex_);
+
+        RECT invalidatedRect;
+        if (DrawableObjectAndValues::GetInvalidatedRect(drawableObjects_, matrix, OUT invalidatedRect))
+        {
+            InvalidateRect(canvasHwnd, &invalidatedRect, false);
+        }
+        return;
+    }
+
+    // Whatever changed left no record, so nothing drawn before can be kept.
+    drawingCanvas.InvalidateTiles();
+    InvalidateRect(canvasHwnd, nullptr, false);
 }
 
 
@@ -942,6 +1818,7 @@ void MainWindow::DeleteDrawableObjectsListViewSelected()
         LVNI_SELECTED,
         /*returnAllIfNoMatch*/false
         );
+    RemapDrawableObjectsListViewIndices(IN OUT drawableObjectIndices);
 
     if (drawableObjectIndices.empty())
     {
@@ -952,16 +1829,25 @@ void MainWindow::DeleteDrawableObjectsListViewSelected()
     if (drawableObjectIndices.empty())
         return;
 
-    auto drawableObjectsTotal = drawableObjects_.size();
-    // Erase from back to front.
-    for (size_t i = drawableObjectIndices.size(); i > 0; --i)
+    // Compact the kept objects in one pass, rather than erasing each selected
+    // one and so shifting the whole tail per object. The list view returns
+    // the selected indices in ascending order.
+    size_t const drawableObjectsTotal = drawableObjects_.size();
+    size_t keptObjectCount = 0;
+    for (size_t objectIndex = 0, selectionIndex = 0; objectIndex < drawableObjectsTotal; ++objectIndex)
     {
-        auto index = drawableObjectIndices[i - 1];
-        if (index >= drawableObjectsTotal)
+        if (selectionIndex < drawableObjectIndices.size() && drawableObjectIndices[selectionIndex] == objectIndex)
+        {
+            ++selectionIndex;
             continue;
-
-        drawableObjects_.erase(drawableObjects_.begin() + index);
+        }
+        if (keptObjectCount != objectIndex)
+        {
+            drawableObjects_[keptObjectCount] = std::move(drawableObjects_[objectIndex]);
+        }
+        ++keptObjectCount;
     }
+    drawableObjects_.erase(drawableObjects_.begin() + keptObjectCount, drawableObjects_.end());
 
     DeferUpdateUi(
         NeededUiUpdateDrawableObjectsListView |
@@ -986,6 +1872,20 @@ namespace
 }
 
 
+void MainWindow::PrewarmRendering()
+{
+    // Each back end otherwise starts on first use, so the first object drawn
+    // with WIC (color bitmap glyphs, PNG copies) or GDI+ doesn't stall.
+    int64_t const startTicks = GetPerformanceCounter();
+
+    DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
+    drawingCanvas.GetWicFactoryWeakRef();
+    prewarmedGdiPlusStartup_.EnsureCached();
+
+    AppendLog(u"Prewarmed WIC and GDI+ (ms): %.3f\r\n", PerformanceCounterToMilliseconds(GetPerformanceCounter() - startTicks));
+}
+
+
 void MainWindow::InitializeDefaultDrawableObjects()
 {
     ////////////////////
@@ -1002,6 +1902,7 @@ void MainWindow::InitializeDefaultDrawableObjects()
     };
     drawableObjects_.clear();
     drawableObjects_.resize(countof(functionNames));
+    ++drawableObjectsGeneration_;
 
     for (size_t i = 0; i < countof(functionNames); ++i)
     {
@@ -1030,6 +1931,7 @@ void MainWindow::CreateDrawableObjectsListViewSelected()
     auto attributeValuesListView = GetWindowFromId(hwnd_, IdcAttributeValuesList);
     std::vector<uint32_t> drawableObjectIndices = GetListViewMatchingIndices(drawableObjectsListView, LVNI_SELECTED, /*returnAllIfNoMatch*/false);
     std::vector<uint32_t> attributeValueIndices = GetListViewMatchingIndices(attributeValuesListView, LVNI_SELECTED, /*returnAllIfNoMatch*/false);
+    RemapDrawableObjectsListViewIndices(IN OUT drawableObjectIndices);
 
     // Create a default object or duplicate a selected one.
     size_t const originalDrawableObjectsCount = drawableObjects_.size();
@@ -1063,8 +1965,8 @@ void MainWindow::CreateDrawableObjectsListViewSelected()
     // Create permutations based on selected attributes.
     if (attributeValueIndices.size() > 1 && selectedAttributeIndex_ < countof(DrawableObject::attributeList))
     {
-        // Remap listview indices to attribute value indices, using lparam.
-        ListViewRemapIndicesToLparam(attributeValuesListView, IN OUT attributeValueIndices);
+        // Remap listview indices to attribute value indices.
+        RemapAttributeValuesListViewIndices(IN OUT attributeValueIndices);
 
         // Apply attribute all value permutations, for each attribute, and each new object.
         auto const& attribute = DrawableObject::attributeList[selectedAttributeIndex_];
@@ -1119,9 +2021,19 @@ void MainWindow::ShiftSelectedDrawableObjects(int32_t shiftDirection /* down = p
     auto drawableObjectsListView = GetWindowFromId(hwnd_, IdcDrawableObjectsList);
     size_t const drawableObjectsCount = drawableObjects_.size();
     std::vector<uint32_t> drawableObjectIndices = GetListViewMatchingIndices(drawableObjectsListView, LVNI_SELECTED, /*returnAllIfNoMatch*/false);
+    RemapDrawableObjectsListViewIndices(IN OUT drawableObjectIndices);
     if (drawableObjectIndices.empty())
         return; // Nop
 
+    // Shifting moves objects in their own order, so first show that order,
+    // keeping the same objects selected.
+    if (IsDrawableObjectsListSorted())
+    {
+        drawableObjectsListOrder_.clear();
+        SelectDrawableObjectsListView(drawableObjectIndices);
+        InvalidateRect(drawableObjectsListView, nullptr, false);
+    }
+
     int32_t iDelta = (/*if shifting up*/ shiftDirection < 0) ? /*swap down*/1 : /*swap up*/ -1;
     uint32_t begin = 0, end = uint32_t(drawableObjectIndices.size()); // if shifting up
 
@@ -1173,6 +2085,8 @@ void MainWindow::ShiftSelectedDrawableObjects(int32_t shiftDirection /* down = p
 MainWindow::DialogProcResult CALLBACK MainWindow::OnDragAndDrop(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
     std::u16string fileName;
+    std::vector<std::u16string> fontFilePaths;
+    bool hasFontFolder = false;
     HDROP hDrop = (HDROP)wParam;
     HRESULT hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
 
@@ -1192,8 +2106,16 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnDragAndDrop(HWND hwnd, UINT
         if (DragQueryFile(hDrop, i, ToWChar(fileNameRef.data()), fileNameSize + 1))
         {
             auto* filenameExtension = FindFileNameExtension(fileName);
+            DWORD fileAttributes = GetFileAttributes(ToWChar(fileName.c_str()));
 
-            if (_wcsicmp(ToWChar(filenameExtension), L"TextLayoutSamplerSettings") == 0)
+            if (fileAttributes != INVALID_FILE_ATTRIBUTES && (fileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                // Folders are searched for fonts in the background, after the drop.
+                fontFilePaths.push_back(fileName);
+                hasFontFolder = true;
+                hr = S_OK;
+            }
+            else if (IsSettingsFileName(fileName))
             {
                 hr = LoadDrawableObjectsSettings(fileName.data(), clearExistingItems, /*merge*/false);
             }
@@ -1207,7 +2129,8 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnDragAndDrop(HWND hwnd, UINT
                 ||   _wcsicmp(ToWChar(filenameExtension), L"ttc") == 0
                 ||   _wcsicmp(ToWChar(filenameExtension), L"otc") == 0)
             {
-                hr = LoadFontFileIntoDrawableObjects(fileName.data());
+                fontFilePaths.push_back(fileName);
+                hr = S_OK;
             }
             else
             {
@@ -1222,6 +2145,22 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnDragAndDrop(HWND hwnd, UINT
     }
     DragFinish(hDrop);
 
+    // A single font file still applies to the selected objects right away,
+    // whereas many files or any folders each get a new object as read.
+    if (SUCCEEDED(hr) && !fontFilePaths.empty())
+    {
+        if (fontFilePaths.size() == 1 && !hasFontFolder)
+        {
+            fileName = fontFilePaths.front();
+            hr = LoadFontFileIntoDrawableObjects(fileName.c_str());
+        }
+        else
+        {
+            hr = StartLoadingFontFiles(std::move(fontFilePaths));
+        }
+    }
+    SaveFontMetadataIndex();
+
     if (hr == HRESULT_FROM_WIN32(ERROR_BAD_FORMAT))
         ShowMessageAndAppendLog(u"Unknown file format '%s' (TextLayoutSamplerSettings, txt, ttf, otf, tte, ttc, otc), 0x%08X", fileName.c_str(), hr);
     else if (FAILED(hr))
@@ -1234,6 +2173,7 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnDragAndDrop(HWND hwnd, UINT
 std::vector<uint32_t> MainWindow::GetSelectedDrawableObjectIndices()
 {
     auto selectedIndices = GetListViewMatchingIndices(GetWindowFromId(hwnd_, IdcDrawableObjectsList), LVNI_SELECTED,  /*returnAllIfNoMatch*/true);
+    RemapDrawableObjectsListViewIndices(IN OUT selectedIndices);
 
     // Return all the indices if none are selected, or if none exist in the list control
     // due to the drawableObjects_ array being sized before the IdcDrawableObjectsList control
@@ -1417,37 +2357,20 @@ HRESULT SetFontFamilyNameProperties(LOGFONT const& logFont, _Out_ MainWindow::Fo
 
 
 HRESULT SetFontFamilyNameProperties(
-    IDWriteFont* font,
+    FontFileMetadata const& fontFileMetadata,
     _In_z_ char16_t const* filePath,
     _Out_ MainWindow::FontFamilyNameProperties& fontFamilyNameProperties
 )
 {
-    LOGFONT logFont;
-    ComPtr<IDWriteFactory> dwriteFactory;
-    ComPtr<IDWriteGdiInterop> gdiInterop;
-    BOOL dummyBool;
-
-    // todo: Move much of this into DWritEx.cpp.
-    IFR(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory), reinterpret_cast<IUnknown**>(OUT &dwriteFactory)));
-    IFR(dwriteFactory->GetGdiInterop(OUT &gdiInterop));
     fontFamilyNameProperties.filePath = filePath;
-    fontFamilyNameProperties.dwriteFontWeight = font->GetWeight();
-    fontFamilyNameProperties.dwriteFontStretch = font->GetStretch();
-    fontFamilyNameProperties.dwriteFontSlope = font->GetStyle();
-    fontFamilyNameProperties.gdiFontWeight = fontFamilyNameProperties.dwriteFontWeight;
-    fontFamilyNameProperties.gdiFontSlope = fontFamilyNameProperties.dwriteFontSlope;
-    fontFamilyNameProperties.gdiFontStretch = fontFamilyNameProperties.dwriteFontStretch;
-
-    GetFontFamilyName(font, /*languageTag*/nullptr, OUT fontFamilyNameProperties.dwriteFamilyName);
-    fontFamilyNameProperties.gdiFamilyName.assign(fontFamilyNameProperties.dwriteFamilyName);
-
-    if (SUCCEEDED(gdiInterop->ConvertFontToLOGFONT(font, OUT &logFont, OUT &dummyBool)))
-    {
-        fontFamilyNameProperties.gdiFamilyName.assign(ToChar16(logFont.lfFaceName));
-        fontFamilyNameProperties.gdiFontWeight = static_cast<DWRITE_FONT_WEIGHT>(logFont.lfWeight);
-        fontFamilyNameProperties.gdiFontSlope = logFont.lfItalic ? DWRITE_FONT_STYLE_ITALIC : DWRITE_FONT_STYLE_NORMAL;
-        fontFamilyNameProperties.gdiFontStretch = DWRITE_FONT_STRETCH_NORMAL;
-    }
+    fontFamilyNameProperties.dwriteFontWeight = fontFileMetadata.dwriteFontWeight;
+    fontFamilyNameProperties.dwriteFontStretch = fontFileMetadata.dwriteFontStretch;
+    fontFamilyNameProperties.dwriteFontSlope = fontFileMetadata.dwriteFontSlope;
+    fontFamilyNameProperties.dwriteFamilyName = fontFileMetadata.dwriteFamilyName;
+    fontFamilyNameProperties.gdiFamilyName = fontFileMetadata.gdiFamilyName;
+    fontFamilyNameProperties.gdiFontWeight = fontFileMetadata.gdiFontWeight;
+    fontFamilyNameProperties.gdiFontSlope = fontFileMetadata.gdiFontSlope;
+    fontFamilyNameProperties.gdiFontStretch = DWRITE_FONT_STRETCH_NORMAL;
 
     return S_OK;
 }
@@ -1457,6 +2380,15 @@ HRESULT MainWindow::UpdateDrawableObjectsFromFontFamilyNameProperties(FontFamily
 {
     // Set the family name and face properties of every selected drawable object.
     std::vector<uint32_t> selectedDrawableObjectIndices = GetSelectedDrawableObjectIndices();
+    return UpdateDrawableObjectsFromFontFamilyNameProperties(fontFamilyNameProperties, selectedDrawableObjectIndices);
+}
+
+
+HRESULT MainWindow::UpdateDrawableObjectsFromFontFamilyNameProperties(
+    FontFamilyNameProperties const& fontFamilyNameProperties,
+    array_ref<uint32_t const> selectedDrawableObjectIndices
+    )
+{
     std::wstring fontSizeString = std::to_wstring(fontFamilyNameProperties.fontSize);
     RemoveTrailingZeroes(IN OUT reinterpret_cast<std::u16string&>(fontSizeString));
 
@@ -1564,129 +2496,432 @@ HRESULT MainWindow::SelectFontFamily()
                             | CF_APPLY // Show the Apply button so you can change the font before closing the dialog.
                             ;
 
-    // Show the common font dialog box.
-    if (!::ChooseFont(IN OUT &chooseFont))
-    {
-        // Check whether error or the user canceled.
-        auto errorCode = CommDlgExtendedError();
-        return errorCode == 0 ? S_FALSE : HRESULT_FROM_WIN32(errorCode);
+    // Show the common font dialog box.
+    if (!::ChooseFont(IN OUT &chooseFont))
+    {
+        // Check whether error or the user canceled.
+        auto errorCode = CommDlgExtendedError();
+        return errorCode == 0 ? S_FALSE : HRESULT_FROM_WIN32(errorCode);
+    }
+
+    // No need to update anything here because the ChooseFontHookProc callback already did.
+    return S_OK;
+}
+
+
+#if 0
+STDMETHODIMP MainWindow::ChooseColor(IN OUT uint32_t& color)
+{
+    static COLORREF customColors[16] = {};
+    CHOOSECOLOR colorOptions = {};
+    colorOptions.lStructSize = sizeof(colorOptions);
+    colorOptions.hwndOwner = hwnd_;
+    colorOptions.rgbResult = color & 0x00FFFFFF;
+    colorOptions.lpCustColors = customColors;
+    colorOptions.Flags = CC_ANYCOLOR|CC_FULLOPEN|CC_RGBINIT;
+
+    if (!::ChooseColor(&colorOptions))
+    {
+        // Check whether error or the user canceled.
+        return CommDlgExtendedError() == 0 ? S_FALSE : E_FAIL;
+    }
+
+    color = 0xFF000000 | colorOptions.rgbResult;
+    return S_OK;
+}
+#endif
+
+
+HRESULT MainWindow::SelectFontFile()
+{
+    std::u16string filePath;
+    auto const* filters = u"Fonts (*.ttf *.otf)\0" u"*.ttf;*.otf;*.cff;*.ttc;*.otc;*.tte\0"
+                          u"All files (*)\0" u"*\0";
+
+    if (!GetOpenFileName(hwnd_, filters, OUT filePath, u"Open font file"))
+        return S_FALSE;
+
+    HRESULT hr = LoadFontFileIntoDrawableObjects(filePath.c_str());
+    SaveFontMetadataIndex();
+    return hr;
+}
+
+
+HRESULT MainWindow::LoadFontFileIntoDrawableObjects(_In_z_ char16_t const* filePath)
+{
+    EnsureAtLeastOneDrawableObject();
+
+    // Update the path for every selected drawable object.
+    std::vector<uint32_t> const drawableObjectIndices = GetSelectedDrawableObjectIndices();
+    DrawableObjectAndValues::Set(drawableObjects_, drawableObjectIndices, DrawableObjectAttributeFontFilePath, filePath);
+
+    SessionRecording::Step* step = sessionRecording_.AddStep(SessionRecording::StepTypeLoadFontFile, drawableObjectIndices);
+    if (step != nullptr)
+        step->value = filePath;
+
+    ComPtr<IDWriteFactory> dwriteFactory;
+    IFR(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory), reinterpret_cast<IUnknown**>(OUT &dwriteFactory)));
+
+    // Names come from the persistent index, which only reopens the font if
+    // it changed since last indexed.
+    EnsureFontMetadataIndexLoaded();
+
+    FontFileMetadata const* fontFileMetadata;
+    IFR(fontMetadataIndex_.GetFontFileMetadata(dwriteFactory, filePath, OUT &fontFileMetadata));
+
+    // Print all the found faces.
+    for (auto const& face : fontFileMetadata->faces)
+    {
+        uint32_t characterCount = 0;
+        for (auto const& range : face.characterRanges)
+        {
+            characterCount += range.last - range.first + 1;
+        }
+
+        AppendLog(u"%d:%d = wws:'%s'|'%s',  pref:'%s'|'%s',  win32:'%s'|'%s',  full:'%s'%s wght=%d wdth=%d ital=%d slnt=%d chars=%d\r\n",
+            face.familyIndex,
+            face.faceIndex,
+            face.familyName.c_str(),
+            face.faceName.c_str(),
+            face.preferredFamilyName.c_str(),
+            face.preferredFaceName.c_str(),
+            face.win32FamilyName.c_str(),
+            face.win32FaceName.c_str(),
+            face.fullName.c_str(),
+            face.simulations != DWRITE_FONT_SIMULATIONS_NONE ? u",  simulated" : u"",
+            face.weight,
+            face.stretch,
+            (face.style == DWRITE_FONT_STYLE_ITALIC) ? 1 : 0,
+            (face.style == DWRITE_FONT_STYLE_OBLIQUE) ? -20 : 0,
+            characterCount
+        );
+    }
+
+    MainWindow::FontFamilyNameProperties fontFamilyNameProperties = {};
+    SetFontFamilyNameProperties(*fontFileMetadata, filePath, OUT fontFamilyNameProperties);
+    return UpdateDrawableObjectsFromFontFamilyNameProperties(fontFamilyNameProperties);
+}
+
+
+void MainWindow::EnsureFontMetadataIndexLoaded()
+{
+    if (fontMetadataIndex_.IsLoaded())
+        return;
+
+    std::u16string indexFilePath = FontMetadataIndex::GetDefaultFilePath();
+    if (FAILED(fontMetadataIndex_.Load(indexFilePath.c_str())))
+    {
+        AppendLog(u"Could not read font metadata index '%s'. Starting a new one.\r\n", indexFilePath.c_str());
+    }
+}
+
+
+HRESULT MainWindow::SaveFontMetadataIndex()
+{
+    if (!fontMetadataIndex_.IsLoaded())
+        return S_FALSE;
+
+    std::u16string indexFilePath = FontMetadataIndex::GetDefaultFilePath();
+    HRESULT hr = fontMetadataIndex_.Save(indexFilePath.c_str());
+    if (FAILED(hr))
+    {
+        AppendLog(u"Could not write font metadata index '%s', 0x%08X\r\n", indexFilePath.c_str(), hr);
+    }
+
+    return hr;
+}
+
+
+namespace
+{
+    bool IsFontFileName(array_ref<char16_t const> fileName)
+    {
+        auto* fileNameExtension = FindFileNameExtension(fileName);
+        return fileNameExtension > fileName.data()
+            && fileNameExtension[-1] == '.'
+            && IsKnownFontFileExtension(ToWChar(fileNameExtension - 1));
+    }
+
+
+    // Check the sfnt version or collection tag too, since the extension alone
+    // can lie, reading only the first few bytes.
+    bool HasFontFileHeader(_In_z_ char16_t const* filePath)
+    {
+        HANDLE file = CreateFile(
+            ToWChar(filePath),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr
+            );
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        FileHandle scopedHandle(file);
+        uint8_t header[4];
+        unsigned long bytesRead = 0;
+        if (!ReadFile(file, OUT header, sizeof(header), OUT &bytesRead, nullptr) || bytesRead != sizeof(header))
+            return false;
+
+        uint32_t const tag = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) | header[3];
+        return tag == 0x00010000    // TrueType
+            || tag == 0x4F54544F    // 'OTTO' CFF
+            || tag == 0x74727565    // 'true' Apple TrueType
+            || tag == 0x74746366;   // 'ttcf' collection
+    }
+}
+
+
+// Dropped font files and folders being read in the background, so that a
+// large folder (or a slow network share) doesn't freeze the window. One
+// thread walks the folders and streams each directory's font files to a
+// pool of readers, which check the header and read the font metadata, or
+// copy it from the index if still current. The UI thread collects the fonts
+// read so far on a timer and appends a drawable object for each.
+struct MainWindow::FontLoadJob
+{
+    struct LoadedFontFile
+    {
+        std::u16string filePath;
+        FontFileMetadata metadata;
+        bool isNewlyRead; // Else copied from the index.
+    };
+
+    std::vector<std::u16string> rootPaths;
+    DrawableObjectAndValues templateObject; // Copied for each loaded font.
+
+    std::atomic<bool> isCanceled{false};
+    std::atomic<uint32_t> enumeratedFileCount{0};
+    std::atomic<uint32_t> readFileCount{0};
+    std::atomic<uint32_t> skippedFileCount{0};
+    std::atomic<uint32_t> runningThreadCount{0};
+
+    std::mutex mutex;
+    std::condition_variable pendingFilePathsChanged;
+    std::deque<std::u16string> pendingFilePaths; // Enumerated but not yet read.
+    bool isEnumerated = false;
+    std::vector<LoadedFontFile> loadedFontFiles; // Read, awaiting the UI thread.
+
+    std::vector<std::thread> threads;
+
+    void EnumerateFiles()
+    {
+        auto addFileNames = [&](array_ref<char16_t const> fileNames) -> bool
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (char16_t const* fileName = fileNames.data(), *fileNamesEnd = fileNames.data_end();
+                    fileName < fileNamesEnd;
+                    fileName += wcslen(ToWChar(fileName)) + 1)
+                {
+                    array_ref<char16_t const> fileNameRef(fileName, wcslen(ToWChar(fileName)));
+                    if (IsFontFileName(fileNameRef))
+                    {
+                        pendingFilePaths.emplace_back(fileNameRef.data(), fileNameRef.size());
+                        ++enumeratedFileCount;
+                    }
+                }
+            }
+            pendingFilePathsChanged.notify_all();
+            return !isCanceled;
+        };
+
+        for (auto const& rootPath : rootPaths)
+        {
+            if (isCanceled)
+                break;
+
+            DWORD fileAttributes = GetFileAttributes(ToWChar(rootPath.c_str()));
+            if (fileAttributes != INVALID_FILE_ATTRIBUTES && (fileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                EnumerateMatchingFiles(rootPath.c_str(), u"**\\*", addFileNames);
+            }
+            else
+            {
+                addFileNames({rootPath.c_str(), rootPath.size() + 1});
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isEnumerated = true;
+            --runningThreadCount;
+        }
+        pendingFilePathsChanged.notify_all();
+    }
+
+    void ReadFiles(FontMetadataIndex& fontMetadataIndex)
+    {
+        // An isolated factory per reader avoids contending on (and racing
+        // the loader registration of) the shared one.
+        ComPtr<IDWriteFactory> dwriteFactory;
+        DWriteCreateFactory(DWRITE_FACTORY_TYPE_ISOLATED, __uuidof(IDWriteFactory), reinterpret_cast<IUnknown**>(OUT &dwriteFactory));
+
+        for (;;)
+        {
+            LoadedFontFile loadedFontFile = {};
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                pendingFilePathsChanged.wait(lock, [&] { return isCanceled || isEnumerated || !pendingFilePaths.empty(); });
+                if (isCanceled || pendingFilePaths.empty())
+                    break;
+
+                loadedFontFile.filePath = std::move(pendingFilePaths.front());
+                pendingFilePaths.pop_front();
+            }
+
+            char16_t const* filePath = loadedFontFile.filePath.c_str();
+            HRESULT hr = HasFontFileHeader(filePath) ? S_OK : HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            if (SUCCEEDED(hr) && !fontMetadataIndex.FindCurrentFontFileMetadata(filePath, OUT loadedFontFile.metadata))
+            {
+                hr = (dwriteFactory == nullptr) ? E_FAIL : FontMetadataIndex::ReadFontFileMetadata(dwriteFactory, filePath, OUT loadedFontFile.metadata);
+                loadedFontFile.isNewlyRead = true;
+            }
+            if (SUCCEEDED(hr) && loadedFontFile.metadata.faces.empty())
+            {
+                hr = DWRITE_E_FILEFORMAT;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ++readFileCount;
+            if (FAILED(hr))
+            {
+                ++skippedFileCount;
+                continue;
+            }
+            loadedFontFiles.push_back(std::move(loadedFontFile));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        --runningThreadCount;
     }
 
-    // No need to update anything here because the ChooseFontHookProc callback already did.
-    return S_OK;
-}
+    void Cancel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isCanceled = true;
+        }
+        pendingFilePathsChanged.notify_all();
+
+        for (auto& thread : threads)
+        {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+};
 
 
-#if 0
-STDMETHODIMP MainWindow::ChooseColor(IN OUT uint32_t& color)
+HRESULT MainWindow::StartLoadingFontFiles(std::vector<std::u16string>&& filePaths)
 {
-    static COLORREF customColors[16] = {};
-    CHOOSECOLOR colorOptions = {};
-    colorOptions.lStructSize = sizeof(colorOptions);
-    colorOptions.hwndOwner = hwnd_;
-    colorOptions.rgbResult = color & 0x00FFFFFF;
-    colorOptions.lpCustColors = customColors;
-    colorOptions.Flags = CC_ANYCOLOR|CC_FULLOPEN|CC_RGBINIT;
-
-    if (!::ChooseColor(&colorOptions))
+    // Only one batch at a time, keeping whatever the previous one read.
+    if (fontLoadJob_ != nullptr)
     {
-        // Check whether error or the user canceled.
-        return CommDlgExtendedError() == 0 ? S_FALSE : E_FAIL;
+        CancelLoadingFontFiles();
     }
 
-    color = 0xFF000000 | colorOptions.rgbResult;
-    return S_OK;
-}
-#endif
+    EnsureAtLeastOneDrawableObject();
+    EnsureFontMetadataIndexLoaded();
 
+    auto job = std::make_shared<FontLoadJob>();
+    job->rootPaths = std::move(filePaths);
 
-HRESULT MainWindow::SelectFontFile()
-{
-    std::u16string filePath;
-    auto const* filters = u"Fonts (*.ttf *.otf)\0" u"*.ttf;*.otf;*.cff;*.ttc;*.otc;*.tte\0"
-                          u"All files (*)\0" u"*\0";
+    std::vector<uint32_t> const selectedDrawableObjectIndices = GetSelectedDrawableObjectIndices();
+    job->templateObject = drawableObjects_[selectedDrawableObjectIndices.empty() ? 0 : selectedDrawableObjectIndices.front()];
 
-    if (!GetOpenFileName(hwnd_, filters, OUT filePath, u"Open font file"))
-        return S_FALSE;
+    SessionRecording::Step* step = sessionRecording_.AddStep(SessionRecording::StepTypeLoadFontFiles, selectedDrawableObjectIndices);
+    if (step != nullptr)
+        step->filePaths = job->rootPaths;
+
+    // Readers mostly wait on file I/O, so use at least a few even on small machines.
+    uint32_t const readerCount = std::max(std::thread::hardware_concurrency(), 4u);
+    job->runningThreadCount = readerCount + 1;
+
+    FontLoadJob* jobPointer = job.get();
+    FontMetadataIndex* fontMetadataIndex = &fontMetadataIndex_;
+    job->threads.emplace_back([jobPointer]() { jobPointer->EnumerateFiles(); });
+    for (uint32_t i = 0; i < readerCount; ++i)
+    {
+        job->threads.emplace_back([jobPointer, fontMetadataIndex]() { jobPointer->ReadFiles(*fontMetadataIndex); });
+    }
+
+    fontLoadJob_ = std::move(job);
+    SetTimer(hwnd_, IdcReadLoadedFontFiles, 100, nullptr);
+    AppendLog(u"Loading font files in the background. Use 'Cancel loading font files' in the actions menu to stop.\r\n");
 
-    return LoadFontFileIntoDrawableObjects(filePath.c_str());
+    return S_OK;
 }
 
 
-HRESULT MainWindow::LoadFontFileIntoDrawableObjects(_In_z_ char16_t const* filePath)
+void MainWindow::ReadLoadedFontFiles()
 {
-    EnsureAtLeastOneDrawableObject();
-
-    // Update the path for every selected drawable object.
-    std::vector<uint32_t> const drawableObjectIndices = GetSelectedDrawableObjectIndices();
-    DrawableObjectAndValues::Set(drawableObjects_, drawableObjectIndices, DrawableObjectAttributeFontFilePath, filePath);
+    // The timer may outlive a job already finished by cancellation.
+    if (fontLoadJob_ == nullptr)
+    {
+        KillTimer(hwnd_, IdcReadLoadedFontFiles);
+        return;
+    }
 
-    ComPtr<IDWriteFactory> dwriteFactory;
-    ComPtr<IDWriteGdiInterop> gdiInterop;
-    ComPtr<IDWriteFontCollection> fontCollection;
+    FontLoadJob& job = *fontLoadJob_;
+    std::vector<FontLoadJob::LoadedFontFile> loadedFontFiles;
+    bool isFinished;
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        loadedFontFiles.swap(job.loadedFontFiles);
+        isFinished = (job.runningThreadCount == 0);
+    }
 
-    IFR(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory), reinterpret_cast<IUnknown**>(OUT &dwriteFactory)));
-    IFR(dwriteFactory->GetGdiInterop(OUT &gdiInterop));
+    for (auto& loadedFontFile : loadedFontFiles)
+    {
+        char16_t const* filePath = loadedFontFile.filePath.c_str();
+        FontFileMetadata const* fontFileMetadata = &loadedFontFile.metadata;
+        if (loadedFontFile.isNewlyRead)
+        {
+            fontFileMetadata = &fontMetadataIndex_.AddFontFileMetadata(filePath, std::move(loadedFontFile.metadata));
+        }
 
-    // Get the name of the first font in the collection.
+        uint32_t const drawableObjectIndex = uint32_t(drawableObjects_.size());
+        drawableObjects_.push_back(job.templateObject);
+        drawableObjects_.back().Invalidate();
 
-    IFR(CreateFontCollection(dwriteFactory, DWRITE_FONT_FAMILY_MODEL_WEIGHT_STRETCH_STYLE, ToWChar(filePath), IntLen(filePath), OUT &fontCollection));
+        MainWindow::FontFamilyNameProperties fontFamilyNameProperties = {};
+        SetFontFamilyNameProperties(*fontFileMetadata, filePath, OUT fontFamilyNameProperties);
+        UpdateDrawableObjectsFromFontFamilyNameProperties(fontFamilyNameProperties, {&drawableObjectIndex, 1});
+    }
 
-    std::u16string familyName, faceName, win32FamilyName, win32FaceName, preferredFamilyName, preferredFaceName, fullName;
-    std::vector<DWRITE_FONT_AXIS_VALUE> fontAxisValues;
+    uint32_t const readFileCount = job.readFileCount;
+    uint32_t const skippedFileCount = job.skippedFileCount;
 
-    // Print all the found faces.
-    for (uint32_t familyIndex = 0, familyCount = fontCollection->GetFontFamilyCount(); familyIndex < familyCount; ++familyIndex)
+    if (!isFinished)
     {
-        ComPtr<IDWriteFontFamily> fontFamily;
-        if (FAILED(fontCollection->GetFontFamily(familyIndex, OUT &fontFamily)))
-            continue;
+        wchar_t title[512];
+        _snwprintf_s(title, std::size(title), _TRUNCATE, L"Loading font files %u of %u found - " BUILD_TITLE_STRING, readFileCount, uint32_t(job.enumeratedFileCount));
+        SetWindowText(hwnd_, title);
+        return;
+    }
 
-        GetFontFamilyName(fontFamily.Get(), nullptr, OUT familyName);
+    job.Cancel(); // Just joins the finished threads.
+    bool const wasCanceled = job.isCanceled;
+    fontLoadJob_ = nullptr;
 
-        for (uint32_t faceIndex = 0, faceCount = fontFamily->GetFontCount(); faceIndex < faceCount; ++faceIndex)
-        {
-            ComPtr<IDWriteFont> font;
-            if (FAILED(fontFamily->GetFont(faceIndex, OUT &font))/* || innerFont->GetSimulations() != DWRITE_FONT_SIMULATIONS_NONE*/)
-                continue;
+    KillTimer(hwnd_, IdcReadLoadedFontFiles);
+    SetWindowText(hwnd_, BUILD_TITLE_STRING);
+    SaveFontMetadataIndex();
 
-            GetFontFaceName(font, nullptr, OUT faceName);
-            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_WIN32_FAMILY_NAMES, nullptr, OUT win32FamilyName);
-            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_WIN32_SUBFAMILY_NAMES, nullptr, OUT win32FaceName);
-            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_PREFERRED_FAMILY_NAMES, nullptr, OUT preferredFamilyName);
-            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_PREFERRED_SUBFAMILY_NAMES, nullptr, OUT preferredFaceName);
-            GetInformationalString(font, DWRITE_INFORMATIONAL_STRING_FULL_NAME, nullptr, OUT fullName);
-            DWRITE_FONT_SIMULATIONS fontSimulations = font->GetSimulations();
-            GetFontAxisValues(font, OUT fontAxisValues);
-
-            DWRITE_FONT_STYLE fontStyle = font->GetStyle();
-            AppendLog(u"%d:%d = wws:'%s'|'%s',  pref:'%s'|'%s',  win32:'%s'|'%s',  full:'%s'%s wght=%d wdth=%d ital=%d slnt=%d\r\n",
-                familyIndex,
-                faceIndex,
-                familyName.c_str(),
-                faceName.c_str(),
-                preferredFamilyName.c_str(),
-                preferredFaceName.c_str(),
-                win32FamilyName.c_str(),
-                win32FaceName.c_str(),
-                fullName.c_str(),
-                fontSimulations != DWRITE_FONT_SIMULATIONS_NONE ? u",  simulated" : u"",
-                font->GetWeight(),
-                font->GetStretch(),
-                (fontStyle == DWRITE_FONT_STYLE_ITALIC) ? 1 : 0,
-                (fontStyle == DWRITE_FONT_STYLE_OBLIQUE) ? -20 : 0
-            );
-        }
-    }
+    AppendLog(u"Loaded %d font files, skipped %d%s.\r\n", readFileCount - skippedFileCount, skippedFileCount, wasCanceled ? u" (canceled)" : u"");
+}
 
-    ComPtr<IDWriteFontFamily> firstFontFamily;
-    ComPtr<IDWriteFont> firstFont;
-    IFR(fontCollection->GetFontFamily(/*index*/0, OUT &firstFontFamily));
-    IFR(firstFontFamily->GetFirstMatchingFont(DWRITE_FONT_WEIGHT_NORMAL, DWRITE_FONT_STRETCH_NORMAL, DWRITE_FONT_STYLE_NORMAL, OUT &firstFont));
 
-    MainWindow::FontFamilyNameProperties fontFamilyNameProperties = {};
-    SetFontFamilyNameProperties(firstFont, filePath, OUT fontFamilyNameProperties);
-    return UpdateDrawableObjectsFromFontFamilyNameProperties(fontFamilyNameProperties);
+void MainWindow::CancelLoadingFontFiles()
+{
+    if (fontLoadJob_ == nullptr)
+        return;
+
+    fontLoadJob_->Cancel();
+    ReadLoadedFontFiles();
 }
 
 
@@ -1701,7 +2936,7 @@ HRESULT MainWindow::LoadDrawableObjectsSettings(bool clearExistingItems, bool me
     HRESULT hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
     auto* filenameExtension = FindFileNameExtension(filePath);
 
-    if (_wcsicmp(ToWChar(filenameExtension), L"TextLayoutSamplerSettings") == 0)
+    if (IsSettingsFileName(filePath))
     {
         hr = LoadDrawableObjectsSettings(filePath.c_str(), clearExistingItems, merge);
     }
@@ -1722,13 +2957,24 @@ HRESULT MainWindow::LoadDrawableObjectsSettings(bool clearExistingItems, bool me
 HRESULT MainWindow::LoadDrawableObjectsSettings(_In_z_ char16_t const* filePath, bool clearExistingItems, bool merge)
 {
     TextTree data;
-    std::u16string inputText;
 
     AppendLog(u"Reading settings file '%s'\r\n", filePath);
 
     // todo: Store the base path so that relative resources like font files can be found regardless of the current path.
     previousSettingsFilePath_ = filePath;
 
+    // Only a successful load is undoable. A failed one restores the objects
+    // from this, rather than leaving them partly loaded.
+    DrawableObjectAndValues::Snapshot undoSnapshot = DrawableObjectAndValues::TakeSnapshot(drawableObjects_);
+
+    SessionRecording::Step* step = sessionRecording_.AddStep(SessionRecording::StepTypeLoadSettings, {});
+    if (step != nullptr)
+    {
+        step->value = filePath;
+        step->clearExistingItems = clearExistingItems;
+        step->merge = merge;
+    }
+
     DeferUpdateUi(
         NeededUiUpdateDrawableObjectsListView |
         NeededUiUpdateAttributesListView |
@@ -1739,70 +2985,112 @@ HRESULT MainWindow::LoadDrawableObjectsSettings(_In_z_ char16_t const* filePath,
         NeededUiUpdateTextEdit
         );
 
-    // Read file and parse.
-    IFR(ReadTextFile(filePath, OUT inputText));
-
-    JsonexParser parser(inputText, JsonexParser::OptionsDefault);
-    parser.ReadNodes(IN OUT data);
-
     if (clearExistingItems)
     {
         drawableObjects_.clear();
     }
-
-    TextTree::NodePointer subroot = data.BeginFirstChild();
+    ++drawableObjectsGeneration_; // Loaded objects may even match the previous count.
 
     Attribute::PredefinedValue recognizedSettings[] = {
         {1,u"content"},
         {2,u"objects"},
+        {3,u"values"},
     };
 
-    for (TextTree::NodePointer node = subroot.begin(), nodeEnd = subroot.end(); node != nodeEnd; ++node)
+    // Rather than parse the whole file into a tree first, load each setting
+    // value and drawable object as soon as it closes, discarding it after.
+    // So the tree only keeps the current object, however large the file.
+    HRESULT hr = S_OK;
+    DrawableObjectAndValues sharedDrawableObject;
+    std::vector<DrawableObjectAndValues> mergedDrawableObjects;
+    std::vector<SharedString> sharedValues; // Long values repeated across objects, listed before them.
+    uint32_t objectsNodeIndex = 0; // Parent of the current objects list, or zero if none yet.
+    bool isFirstObject = true;
+
+    auto loadSetting = [&](TextTree& textTree, uint32_t parentNodeIndex, uint32_t nodeIndex) -> bool
     {
-        std::u16string text = node.GetText();
-        std::u16string value = node.GetSubvalue();
+        std::u16string text;
+        textTree.GetText(parentNodeIndex, OUT text);
 
         uint32_t settingEnumValue;
         if (FAILED(Attribute::PredefinedValue::MapNameToValue({recognizedSettings, countof(recognizedSettings)}, text.c_str(), OUT settingEnumValue)))
-            continue;
+            return true;
 
         switch (settingEnumValue)
         {
         case 1: // content
-            if (value.compare(u"TextLayoutSamplerSettings") != 0)
             {
-                AppendLog(u"File did not contain expected content. '%s' != TextLayoutSamplerSettings\r\n", value.c_str());
-                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+                std::u16string value;
+                textTree.GetText(nodeIndex, OUT value);
+                if (value.compare(u"TextLayoutSamplerSettings") != 0)
+                {
+                    AppendLog(u"File did not contain expected content. '%s' != TextLayoutSamplerSettings\r\n", value.c_str());
+                    hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+                    return false;
+                }
             }
             break;
         case 2: // objects
-            if (merge)
+            // Each objects list starts with its own shared object.
+            if (parentNodeIndex != objectsNodeIndex)
             {
-                std::vector<DrawableObjectAndValues> drawableObjects;
-                DrawableObjectAndValues::Load(node, OUT drawableObjects);
-                if (!drawableObjects.empty())
-                {
-                    DrawableObjectAndValues::Merge(*drawableObjects.data(), IN OUT drawableObjects_);
-                }
+                objectsNodeIndex = parentNodeIndex;
+                sharedDrawableObject = DrawableObjectAndValues();
+                isFirstObject = true;
             }
-            else
+            DrawableObjectAndValues::LoadObject(
+                TextTree::NodePointer(textTree, nodeIndex),
+                isFirstObject,
+                IN OUT sharedDrawableObject,
+                sharedValues,
+                IN OUT merge ? mergedDrawableObjects : drawableObjects_
+                );
+            isFirstObject = false;
+            break;
+        case 3: // values
             {
-                DrawableObjectAndValues::Load(node, IN OUT drawableObjects_);
+                array_ref<char16_t const> value = textTree.GetTextView(textTree.GetNode(nodeIndex));
+                sharedValues.emplace_back();
+                sharedValues.back().assign(value.data(), value.size());
             }
             break;
         }
+        return true;
+    };
+
+    // Read file and parse. The top level keys are children of the unnamed
+    // outer object (level 1), and so their values are at level 3, which
+    // gives the callback each key as the parent of its value.
+    HRESULT readHr = ReadSettingsFileNodes(filePath, IN OUT data, 3, loadSetting);
+    if (SUCCEEDED(readHr))
+        readHr = hr;
+    if (FAILED(readHr))
+    {
+        DrawableObjectAndValues::RestoreSnapshot(undoSnapshot, IN OUT drawableObjects_);
+        return readHr;
+    }
+
+    if (merge && !mergedDrawableObjects.empty())
+    {
+        DrawableObjectAndValues::Merge(*mergedDrawableObjects.data(), IN OUT drawableObjects_);
     }
 
+    SaveUndoSnapshot(std::move(undoSnapshot));
+
     return S_OK;
 }
 
 
 HRESULT MainWindow::LoadTextFileIntoDrawableObjects(_In_z_ char16_t const* filePath)
 {
-    std::u16string inputText;
+    std::shared_ptr<std::u16string const> inputText;
 
     AppendLog(u"Reading text file '%s'\r\n", filePath);
 
+    SessionRecording::Step* step = sessionRecording_.AddStep(SessionRecording::StepTypeLoadTextFile, {});
+    if (step != nullptr)
+        step->value = filePath;
+
     DeferUpdateUi(
         NeededUiUpdateDrawableObjectsListView |
         NeededUiUpdateAttributesListView |
@@ -1823,9 +3111,16 @@ HRESULT MainWindow::LoadTextFileIntoDrawableObjects(_In_z_ char16_t const* fileP
         InitializeDefaultDrawableObjectAndValues(drawableObject);
     }
 
+    // Read once and share the one text across all objects, parsing it only
+    // for the first, since a corpus may be hundreds of megabytes.
+    SharedString sharedText(std::move(inputText));
+    drawableObjects_[0].Set(DrawableObjectAttributeText, sharedText);
     for (auto& drawableObject : drawableObjects_)
     {
-        drawableObject.Set(DrawableObjectAttributeText, inputText.c_str());
+        if (&drawableObject != &drawableObjects_[0])
+        {
+            drawableObject.Set(DrawableObjectAttributeText, drawableObjects_[0].values_[DrawableObjectAttributeText]);
+        }
         drawableObject.Update();
     }
 
@@ -1961,12 +3256,13 @@ HRESULT MainWindow::SaveUnpackedWoffFontFile()
     if (!GetSaveFileName(hwnd_, saveFilters, u"otf", saveFilePath.c_str(), OUT saveFilePath, u"Save unpacked OpenType font file"))
         return S_FALSE;
 
-    std::vector<uint8_t> fileData;
+    MappedFile mappedFile;
     IFR(ShowMessageIfError(
         u"Could not read WOFF file (error = %08X) '%s'",
-        ReadBinaryFile(openFilePath.c_str(), OUT fileData),
+        mappedFile.Open(openFilePath.c_str()),
         openFilePath.c_str()
         ));
+    auto fileData = mappedFile.GetBytes();
 
     DWRITE_CONTAINER_TYPE containerType = dwriteFactory->AnalyzeContainerType(fileData.data(), static_cast<uint32_t>(fileData.size()));
     if (containerType == DWRITE_CONTAINER_TYPE_UNKNOWN)
@@ -1994,6 +3290,143 @@ HRESULT MainWindow::SaveUnpackedWoffFontFile()
 }
 
 
+namespace
+{
+    // Unpacks a single WOFF/WOFF2 file beside the original, choosing .otf or
+    // .ttf from the unpacked sfnt version. The unpacked stream is written
+    // straight from its one fragment rather than copied into a scratch buffer.
+    HRESULT UnpackWoffFontFileBeside(
+        IDWriteFactory5* dwriteFactory,
+        _In_z_ char16_t const* openFilePath,
+        _Out_ std::u16string& saveFilePath
+        )
+    {
+        saveFilePath.clear();
+
+        MappedFile mappedFile;
+        IFR(mappedFile.Open(openFilePath));
+        auto fileData = mappedFile.GetBytes();
+
+        DWRITE_CONTAINER_TYPE containerType = dwriteFactory->AnalyzeContainerType(fileData.data(), static_cast<uint32_t>(fileData.size()));
+        if (containerType == DWRITE_CONTAINER_TYPE_UNKNOWN)
+            return DWRITE_E_FILEFORMAT;
+
+        ComPtr<IDWriteFontFileStream> fontFileStream;
+        IFR(dwriteFactory->UnpackFontFile(
+            containerType,
+            fileData.data(),
+            static_cast<uint32_t>(fileData.size()),
+            OUT &fontFileStream
+            ));
+
+        void const* fragment = nullptr;
+        void* fragmentContext = nullptr;
+        uint64_t fileSize = 0;
+
+        auto fragmentCleanup = DeferCleanup([&] { fontFileStream->ReleaseFileFragment(fragmentContext); });
+        IFR(fontFileStream->GetFileSize(OUT &fileSize));
+        IFR(fontFileStream->ReadFileFragment(OUT &fragment, 0, fileSize, OUT &fragmentContext));
+
+        // CFF outlines use the 'OTTO' sfnt version; anything else is TrueType.
+        bool const isCff = fileSize >= 4 && memcmp(fragment, "OTTO", 4) == 0;
+        saveFilePath = openFilePath;
+        RemoveFileNameExtension(IN OUT saveFilePath);
+        saveFilePath.append(isCff ? u".otf" : u".ttf");
+
+        return WriteBinaryFile(saveFilePath.c_str(), fragment, static_cast<uint32_t>(fileSize));
+    }
+}
+
+
+HRESULT MainWindow::SaveUnpackedWoffFontFiles()
+{
+    std::u16string openFilePath;
+    auto const* openFilters = u"Fonts (*.woff *.woff2)\0" u"*.woff;*.woff2\0"
+                              u"All files (*)\0" u"*\0";
+
+    ComPtr<IDWriteFactory5> dwriteFactory;
+
+    IFR(ShowMessageIfError(
+        u"Operating system does not not support IDWriteFactory5. TextLayoutSampler uses DWrite to unpack WOFF files. Error = 0x%08X",
+        DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory5), reinterpret_cast<IUnknown**>(OUT &dwriteFactory))
+    ));
+
+    if (!GetOpenFileName(hwnd_, openFilters, OUT openFilePath, u"Open any WOFF font file in the folder to unpack"))
+        return S_FALSE;
+
+    // Enumerate every WOFF file in the chosen file's folder (not subfolders).
+    std::u16string folderPath(openFilePath.c_str(), FindFileNameStart(openFilePath) - openFilePath.c_str());
+    std::u16string fileNames;
+    IFR(ShowMessageIfError(
+        u"Could not enumerate WOFF files (error = %08X) in '%s'",
+        EnumerateMatchingFiles(folderPath.c_str(), u"*.woff;*.woff2", IN OUT fileNames),
+        folderPath.c_str()
+        ));
+
+    std::vector<char16_t const*> openFilePaths;
+    for (char16_t const* fileName = fileNames.c_str(), *fileNamesEnd = fileName + fileNames.size();
+        fileName < fileNamesEnd;
+        fileName += wcslen(ToWChar(fileName)) + 1)
+    {
+        openFilePaths.push_back(fileName);
+    }
+    if (openFilePaths.empty())
+    {
+        ShowMessageAndAppendLog(u"No WOFF files found in '%s'.", folderPath.c_str());
+        return S_FALSE;
+    }
+
+    // Each file is independent, so spread them across workers that pull the
+    // next index. Results are stored per file and logged afterwards on this
+    // thread, since the log edit belongs to the UI thread.
+    std::vector<std::u16string> saveFilePaths(openFilePaths.size());
+    std::vector<HRESULT> results(openFilePaths.size(), S_OK);
+    std::atomic<uint32_t> nextFileIndex(0);
+
+    auto unpackFiles = [&]()
+    {
+        for (;;)
+        {
+            uint32_t fileIndex = nextFileIndex++;
+            if (fileIndex >= openFilePaths.size())
+                break;
+
+            results[fileIndex] = UnpackWoffFontFileBeside(dwriteFactory, openFilePaths[fileIndex], OUT saveFilePaths[fileIndex]);
+        }
+    };
+
+    uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), uint32_t(openFilePaths.size()));
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(unpackFiles);
+    }
+    unpackFiles(); // This thread is worker 0.
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    uint32_t failedFileCount = 0;
+    for (size_t i = 0, ci = openFilePaths.size(); i < ci; ++i)
+    {
+        if (FAILED(results[i]))
+        {
+            ++failedFileCount;
+            AppendLog(u"Could not unpack WOFF file (error = 0x%08X) '%s'.\r\n", results[i], openFilePaths[i]);
+        }
+        else
+        {
+            AppendLog(u"Wrote unpacked font to file '%s'.\r\n", saveFilePaths[i].c_str());
+        }
+    }
+    AppendLog(u"Unpacked %d of %d WOFF files in '%s'.\r\n", uint32_t(openFilePaths.size()) - failedFileCount, uint32_t(openFilePaths.size()), folderPath.c_str());
+
+    return failedFileCount > 0 ? DWRITE_E_FILEFORMAT : S_OK;
+}
+
+
 HRESULT MainWindow::GetAllFontCharacters(bool copyToClipboardInstead, bool getOnlyColorFontCharacters)
 {
     uint32_t selectedDrawableObjectIndex;
@@ -2037,6 +3470,7 @@ HRESULT MainWindow::ExportFontGlyphData()
 {
     std::u16string filePath;
     auto const* filters = u"Font glyph files\0" u"*.svg;*.png;*.tiff;*.tif;*.jpeg;*.jpg\0"
+                          u"Zip archive of glyph files (*.zip)\0" u"*.zip\0"
                           u"All files (*)\0" u"*\0";
 
     // Get the first selected drawable item.
@@ -2100,46 +3534,56 @@ void MainWindow::SetWindowTranslucency(uint32_t alpha)
 
 HRESULT MainWindow::AutofitDrawableObjects(bool useMaximumWidth, bool useMaximumHeight)
 {
-    // Autofit all the selected objects to their actual contents, looping through and asking each
-    // for its bounds, the updating its properties.
+    // Autofit all the selected objects to their actual contents, measuring them all
+    // first, then updating the properties of just those whose size changed.
 
     std::vector<uint32_t> drawableObjectIndices = GetSelectedDrawableObjectIndices();
-    auto const drawableObjectsTotal = drawableObjects_.size();
     DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
 
-    std::vector<D2D_SIZE_F> sizes(drawableObjects_.size());
-    float maximumWidth = 0, maximumHeight = 0;
+    // The first pass gets the sizes of all the objects. Unchanged objects reuse
+    // their arranged measurements, and the others are measured in parallel.
+    std::vector<D2D_RECT_F> contentBounds;
+    IFR(DrawableObjectAndValues::MeasureContent(drawableObjects_, drawableObjectIndices, drawingCanvas, OUT contentBounds));
 
-    // The first pass gets the sizes of all the objects.
-    for (auto drawableObjectIndex : drawableObjectIndices)
+    std::vector<D2D_SIZE_F> sizes(drawableObjectIndices.size());
+    float maximumWidth = 0, maximumHeight = 0;
+    for (size_t i = 0, ci = drawableObjectIndices.size(); i < ci; ++i)
     {
-        auto& drawableObject = drawableObjects_[drawableObjectIndex];
-
-        D2D_RECT_F layoutBounds, contentBounds;
-        if (SUCCEEDED(drawableObject.drawableObject_->GetBounds(drawableObject, drawingCanvas, OUT layoutBounds, OUT contentBounds)))
-        {
-            PixelAlignRect(IN OUT contentBounds);
-            auto& size    = sizes[drawableObjectIndex];
-            size.width    = contentBounds.right - contentBounds.left;
-            size.height   = contentBounds.bottom - contentBounds.top;
-            maximumWidth  = std::max(maximumWidth, size.width);
-            maximumHeight = std::max(maximumHeight, size.height);
-        }
+        PixelAlignRect(IN OUT contentBounds[i]);
+        auto& size    = sizes[i];
+        size.width    = contentBounds[i].right - contentBounds[i].left;
+        size.height   = contentBounds[i].bottom - contentBounds[i].top;
+        maximumWidth  = std::max(maximumWidth, size.width);
+        maximumHeight = std::max(maximumHeight, size.height);
     }
 
     // The second pass updates them, considering whether to maximize them to the largest object found.
-    for (auto drawableObjectIndex : drawableObjectIndices)
+    // Objects already at their fitted size are left alone, keeping their cached layouts and pixels.
+    std::vector<uint32_t> changedDrawableObjectIndices;
+    for (size_t i = 0, ci = drawableObjectIndices.size(); i < ci; ++i)
     {
-        auto& drawableObject = drawableObjects_[drawableObjectIndex];
-        D2D_SIZE_F& size = sizes[drawableObjectIndex];
+        auto& drawableObject = drawableObjects_[drawableObjectIndices[i]];
+        D2D_SIZE_F const& size = sizes[i];
         if (size.width > 0 && size.height > 0)
         {
-            drawableObject.Set(DrawableObjectAttributeWidth,  uint32_t(useMaximumWidth  ? std::max(maximumWidth,  size.width)  : size.width));
-            drawableObject.Set(DrawableObjectAttributeHeight, uint32_t(useMaximumHeight ? std::max(maximumHeight, size.height) : size.height));
-            drawableObject.Update();
+            uint32_t width  = uint32_t(useMaximumWidth  ? std::max(maximumWidth,  size.width)  : size.width);
+            uint32_t height = uint32_t(useMaximumHeight ? std::max(maximumHeight, size.height) : size.height);
+            if (drawableObject.GetValue(DrawableObjectAttributeWidth,  DrawableObject::defaultWidth)  == float(width)
+            &&  drawableObject.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight) == float(height))
+            {
+                continue;
+            }
+            drawableObject.Set(DrawableObjectAttributeWidth,  width);
+            drawableObject.Set(DrawableObjectAttributeHeight, height);
+            changedDrawableObjectIndices.push_back(drawableObjectIndices[i]);
         }
     }
 
+    if (changedDrawableObjectIndices.empty())
+        return S_OK;
+
+    DrawableObjectAndValues::Update(drawableObjects_, changedDrawableObjectIndices);
+
     DeferUpdateUi(
         NeededUiUpdateDrawableObjectsListView |
         NeededUiUpdateAttributesListView |
@@ -2157,16 +3601,29 @@ HRESULT MainWindow::AutofitDrawableObjects(bool useMaximumWidth, bool useMaximum
 HRESULT MainWindow::SetNoLineWrapOnDrawableObjects()
 {
     // Reduce all selected drawable objects to 1x1, and set no wrapping.
+    // Objects already reduced are skipped, so their caches survive.
     std::vector<uint32_t> drawableObjectIndices = GetSelectedDrawableObjectIndices();
+    std::vector<uint32_t> changedDrawableObjectIndices;
     for (auto drawableObjectIndex : drawableObjectIndices)
     {
         auto& drawableObject = drawableObjects_[drawableObjectIndex];
+        if (drawableObject.GetValue(DrawableObjectAttributeLineWrappingMode, LineWrappingModeWordCharacter) == LineWrappingModeNone
+        &&  drawableObject.GetValue(DrawableObjectAttributeWidth,  DrawableObject::defaultWidth)  == 1.0f
+        &&  drawableObject.GetValue(DrawableObjectAttributeHeight, DrawableObject::defaultHeight) == 1.0f)
+        {
+            continue;
+        }
         drawableObject.Set(DrawableObjectAttributeLineWrappingMode, LineWrappingModeNone);
         drawableObject.Set(DrawableObjectAttributeWidth,  1);
         drawableObject.Set(DrawableObjectAttributeHeight, 1);
-        drawableObject.Update();
+        changedDrawableObjectIndices.push_back(drawableObjectIndex);
     }
 
+    if (changedDrawableObjectIndices.empty())
+        return S_OK;
+
+    DrawableObjectAndValues::Update(drawableObjects_, changedDrawableObjectIndices);
+
     DeferUpdateUi(
         NeededUiUpdateDrawableObjectsListView |
         NeededUiUpdateAttributesListView |
@@ -2191,7 +3648,7 @@ HRESULT MainWindow::StoreDrawableObjectsSettings()
     HRESULT hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
     auto* filenameExtension = FindFileNameExtension(filePath);
 
-    if (_wcsicmp(ToWChar(filenameExtension), L"TextLayoutSamplerSettings") == 0)
+    if (IsSettingsFileName(filePath))
     {
         hr = StoreDrawableObjectsSettings(filePath.c_str());
     }
@@ -2219,26 +3676,12 @@ HRESULT MainWindow::StoreDrawableObjectsSettings()
 
 HRESULT MainWindow::StoreDrawableObjectsSettings(_In_z_ char16_t const* filePath)
 {
-    TextTree data;
     AppendLog(u"Writing settings file '%s'\r\n", filePath);
 
     previousSettingsFilePath_ = filePath;
 
-    // Create the text tree root node and outermost object.
-    data.Append(TextTree::Node::TypeRoot, 1, u"", 0);
-    TextTree::NodePointer root = data.begin();
-    TextTree::NodePointer subroot = root.AppendChild(TextTree::Node::TypeObject, u"", 0);
-
-    // Write all the objects.
-    subroot.SetKeyValue(u"content", u"TextLayoutSamplerSettings", uint32_t(countof(u"TextLayoutSamplerSettings"))-1);
-    auto objectsNode = subroot.AppendChild(TextTree::Node::TypeArray, u"objects", uint32_t(countof(u"objects")-1));
-    DrawableObjectAndValues::Store(drawableObjects_, objectsNode);
-
-    // Serialize and write the file.
-    JsonexWriter writer(JsonexWriter::OptionsDefault);
-    writer.WriteNodes(data);
-    array_ref<char16_t const> outputJson = writer.GetText();
-    IFR(WriteTextFile(filePath, outputJson.data(), static_cast<uint32_t>(outputJson.size())));
+    // Write all the objects, as Jsonex or binary by extension.
+    IFR(StoreSettingsFile(filePath, drawableObjects_));
 
     return S_OK;
 }
@@ -2250,6 +3693,43 @@ void MainWindow::ReadAttributeFilterEdit()
 }
 
 
+void MainWindow::ReadTextEdit()
+{
+    // Get updated text from edit control, unescaping if needed.
+    std::u16string text;
+    GetWindowText(GetWindowFromId(hwnd_, IdcEditText), OUT text);
+
+    switch (textEscapeMode_)
+    {
+    case TextEscapeModeNone: break;
+    case TextEscapeModeCppUcn: text = textEditUnescaper_.Update(text, &UnescapeCppUniversalCharacterNames); break;
+    case TextEscapeModeHtmlNcr: text = textEditUnescaper_.Update(text, &UnescapeHtmlNamedCharacterReferences); break;
+    }
+
+    // Setting the edit's text can notify a change too, which reads back just
+    // what the edit was given. Skip relaying out every object for that.
+    if (text == textEditText_.str())
+        return;
+
+    // Objects all share the one buffer, which UpdateTextEdit recognizes.
+    std::vector<uint32_t> drawableObjectIndices = GetSelectedDrawableObjectIndices();
+    textEditText_ = SharedString(std::make_shared<std::u16string const>(std::move(text)));
+
+    SessionRecording::Step* step = sessionRecording_.AddStep(SessionRecording::StepTypeSetText, drawableObjectIndices);
+    if (step != nullptr)
+        step->value = textEditText_.str();
+
+    SetDrawableObjectsText(drawableObjectIndices, textEditText_);
+}
+
+
+void MainWindow::SetDrawableObjectsText(array_ref<uint32_t const> drawableObjectIndices, SharedString const& text)
+{
+    DrawableObjectAndValues::Set(drawableObjects_, drawableObjectIndices, DrawableObjectAttributeText, text);
+    DrawableObjectAndValues::Update(drawableObjects_, drawableObjectIndices);
+}
+
+
 void MainWindow::ReadAttributeValueEdit()
 {
     GetWindowText(GetWindowFromId(hwnd_, IdcAttributeValuesEdit), OUT selectedAttributeValue_);
@@ -2269,6 +3749,30 @@ void MainWindow::UpdateDrawableObjectValuesUsing(std::u16string const& newString
     if (drawableObjectIndices.empty() || attributeIndices.empty())
         return;
 
+    SessionRecording::Step* step = sessionRecording_.AddStep(SessionRecording::StepTypeSetValues, drawableObjectIndices);
+    if (step != nullptr)
+    {
+        step->attributeIndices = attributeIndices;
+        step->value = newStringValue;
+    }
+
+    SetDrawableObjectValues(attributeIndices, drawableObjectIndices, newStringValue);
+}
+
+
+void MainWindow::SetDrawableObjectValues(
+    array_ref<uint32_t const> attributeIndices,
+    array_ref<uint32_t const> drawableObjectIndices,
+    std::u16string const& newStringValue
+    )
+{
+    // Typing into the value edit sets the values on every keystroke, which
+    // should all undo together while editing the same attributes and objects.
+    std::vector<uint32_t> coalescingKey(attributeIndices.begin(), attributeIndices.end());
+    coalescingKey.push_back(DrawableObjectAttributeTotal); // Separator
+    coalescingKey.insert(coalescingKey.end(), drawableObjectIndices.begin(), drawableObjectIndices.end());
+    SaveUndoSnapshot(&coalescingKey);
+
     // Check each attribute in the dialog.
     for (auto attributeIndex : attributeIndices)
     {
@@ -2331,11 +3835,22 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnCommand(HWND hwnd, int id, H
         AppendLog(L"Message=%d, id=%d, ctl=%08X, notify=%d\r\n", WM_COMMAND, id, hwndControl, codeNotify);
     #endif
 
+    // Apply any typed text still awaiting the deferred update before acting
+    // on other controls, which may change the selection it was typed for.
+    if (codeNotify != EN_CHANGE)
+    {
+        ReadPendingEdits();
+    }
+
     // Parse the menu selections:
     switch (id)
     {
     case IDCANCEL:
     case IDCLOSE:
+        if (fontLoadJob_ != nullptr)
+        {
+            fontLoadJob_->Cancel(); // The readers use the metadata index, so stop them first.
+        }
         drawableObjects_.clear(); // Clear these before the canvas in case of any dependencies.
         DestroyWindow(hwnd);
         PostQuitMessage(0);
@@ -2378,17 +3893,9 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnCommand(HWND hwnd, int id, H
         switch (codeNotify)
         {
         case EN_CHANGE:
-            {
-                // Get updated text from edit control, unescaping if needed.
-                std::u16string text;
-                std::vector<uint32_t> drawableObjectIndices = GetSelectedDrawableObjectIndices();
-                GetWindowText(GetWindowFromId(hwnd_, IdcEditText), OUT text);
-                UnescapeText(IN OUT text);
-                DrawableObjectAndValues::Set(drawableObjects_, drawableObjectIndices, DrawableObjectAttributeText, text.c_str());
-                DrawableObjectAndValues::Update(drawableObjects_, drawableObjectIndices);
-
-                DeferUpdateUi(NeededUiUpdateDrawableObjectsCanvas);
-            }
+            // Read the text once the keystrokes settle, rather than updating
+            // the objects for every single one.
+            DeferUpdateUi(NeededUiReadTextEdit | NeededUiUpdateDrawableObjectsCanvas);
             break;
 
         default:
@@ -2401,8 +3908,8 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnCommand(HWND hwnd, int id, H
         {
         case EN_CHANGE:
             {
-                // Reflect the user-typed value into the other list views.
-                ReadAttributeValueEdit();
+                // Reflect the user-typed value into the other list views, once
+                // the keystrokes settle.
 
                 // Update the values list if single line edit to reprioritize values.
                 // Avoid doing so for multi-line text controls which are long and won't
@@ -2412,6 +3919,7 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnCommand(HWND hwnd, int id, H
                     isTypingAttributeValueToFilter_ = true;
 
                 DeferUpdateUi(
+                    NeededUiReadAttributeValuesEdit |
                     NeededUiUpdateDrawableObjectsListView |
                     NeededUiUpdateDrawableObjectsCanvas |
                     NeededUiUpdateAttributesListView |
@@ -2543,6 +4051,30 @@ void MainWindow::OnHorizontalOrVerticalScroll(HWND hwnd, int barType, UINT code,
 }
 
 
+namespace
+{
+    // Whether the notification acts on the selection or its values, and so
+    // needs any typed text applied first. Frequent ones like NM_CUSTOMDRAW and
+    // LVN_GETDISPINFO only read, and the deferred update repaints after edits.
+    bool DoesNotificationConsumeEdits(UINT code) noexcept
+    {
+        switch (code)
+        {
+        case LVN_ITEMCHANGED:
+        case LVN_ODSTATECHANGED:
+        case LVN_COLUMNCLICK:
+        case LVN_KEYDOWN:
+        case LVN_ITEMACTIVATE:
+        case NM_RETURN:
+        case NM_CLICK:
+        case NM_DBLCLK:
+            return true;
+        }
+        return false;
+    }
+}
+
+
 MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int controlId, NMHDR* notifyMessageHeader)
 {
     NMHDR& nmh = *notifyMessageHeader;
@@ -2551,6 +4083,12 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int
     AppendLog(L"time=%d notify hwnd=%08X, controlId=%08X, code=%08X\r\n", GetTickCount(), hwnd, controlId, notifyMessageHeader->code);
     #endif
 
+    // As in OnCommand, apply typed text before acting on the selection.
+    if (DoesNotificationConsumeEdits(nmh.code))
+    {
+        ReadPendingEdits();
+    }
+
     switch (controlId)
     {
     case IdcDrawableObjectsList:
@@ -2568,6 +4106,33 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int
             }
             break;
 
+        case LVN_ODSTATECHANGED:
+            {
+                // Owner data lists report range selections (shift click) as one change.
+                NMLVODSTATECHANGE const& stateChange = reinterpret_cast<NMLVODSTATECHANGE&>(nmh);
+                if ((stateChange.uNewState ^ stateChange.uOldState) & LVIS_SELECTED)
+                {
+                    DeferUpdateUi(NeededUiUpdateAttributesListView | NeededUiUpdateAttributeValuesListView | NeededUiUpdateAttributeValuesSlider | NeededUiUpdateAttributeValuesEdit);
+                }
+            }
+            break;
+
+        case LVN_GETDISPINFO:
+            GetDrawableObjectsListViewItem(reinterpret_cast<NMLVDISPINFO&>(nmh).item);
+            break;
+
+        case LVN_COLUMNCLICK:
+            {
+                // Only the timing and memory columns sort, since reordering by
+                // attribute would mostly scramble deliberately arranged sheets.
+                NMLISTVIEW const& nm = reinterpret_cast<NMLISTVIEW&>(nmh);
+                if (uint32_t(nm.iSubItem) < DrawableObjectAttributeTotal)
+                    return false;
+
+                SortDrawableObjectsByStatistic(uint32_t(nm.iSubItem) - DrawableObjectAttributeTotal);
+            }
+            break;
+
         case NM_RETURN:
             SetFocus(GetWindowFromId(hwnd, IdcAttributesList));
             break;
@@ -2723,7 +4288,7 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int
                 if (int32_t(attributeValueIndex) < 0)
                     break;
 
-                ListViewRemapIndicesToLparam(nm.hdr.hwndFrom, IN OUT wrap_single_array_ref(attributeValueIndex));
+                RemapAttributeValuesListViewIndices(IN OUT wrap_single_array_ref(attributeValueIndex));
 
                 auto const& attribute = DrawableObject::attributeList[selectedAttributeIndex_];
                 if (attributeValueIndex >= attribute.predefinedValues.size())
@@ -2765,6 +4330,10 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int
             HandleSysListViewEmptyText((LPARAM)notifyMessageHeader, u"No predefined values for this attribute.");
             return DialogProcResult(true, 1);
 
+        case LVN_GETDISPINFO:
+            GetAttributeValuesListViewItem(reinterpret_cast<NMLVDISPINFO&>(nmh).item);
+            break;
+
         default:
             return false;
         } // nmh.code
@@ -2779,14 +4348,10 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int
                 NMCLICK const& click = reinterpret_cast<NMCLICK&>(nmh);
                 DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
                 D2D_POINT_2F point = drawingCanvas.RemapPoint({float(click.pt.x), float(click.pt.y)}, /*fromCanvasToWorld*/true);
-                for (size_t drawableObjectIndex = 0; drawableObjectIndex < drawableObjects_.size(); ++drawableObjectIndex)
+                uint32_t drawableObjectIndex = drawableObjectsIndex_.HitTest(drawableObjects_, point.x, point.y);
+                if (drawableObjectIndex != ~0u)
                 {
-                    auto const& drawableObject = drawableObjects_[drawableObjectIndex];
-                    if (drawableObject.IsPointInside(point.x, point.y))
-                    {
-                        ListView_SelectSingleVisibleItem(GetWindowFromId(hwnd_, IdcDrawableObjectsList), int(drawableObjectIndex));
-                        break;
-                    }
+                    ListView_SelectSingleVisibleItem(GetWindowFromId(hwnd_, IdcDrawableObjectsList), GetDrawableObjectsListViewRow(drawableObjectIndex));
                 }
             }
             break;
@@ -2796,21 +4361,62 @@ MainWindow::DialogProcResult CALLBACK MainWindow::OnNotification(HWND hwnd, int
                 switch (customDraw.dwDrawStage)
                 {
                 case CDDS_PREERASE:
-                    {
-                        DrawingCanvas& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
-                        drawingCanvas.ClearBackground(DrawableObject::defaultCanvasColor);
-                    }
+                    // The background is cleared after arranging, in CDDS_POSTERASE,
+                    // once the update rect is expanded to whole objects.
                     //return {true, CDRF_DOERASE};
                     return {true, CDRF_SKIPDEFAULT};
 
                 case CDDS_POSTERASE:
                     {
+                        int64_t const paintStartTicks = GetPerformanceCounter();
                         DX_MATRIX_3X2F matrix;
                         DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
                         drawingCanvas.CalculateViewMatrix(OUT matrix);
-                        DrawableObjectAndValues::Arrange(drawableObjects_, drawingCanvas);
-                        DrawableObjectAndValues::Draw(drawableObjects_, drawingCanvas, matrix);
+                        DrawableObjectAndValues::Arrange(drawableObjects_, drawingCanvas, &drawableObjectsIndex_);
+
+                        // Any change of view dirties every tile, and changed
+                        // objects dirty the tiles where they were and are now.
+                        if (memcmp(&matrix, &tiledViewMatrix_, sizeof(matrix)) != 0)
+                        {
+                            drawingCanvas.InvalidateTiles();
+                            tiledViewMatrix_ = matrix;
+                        }
+                        RECT invalidatedRect;
+                        if (DrawableObjectAndValues::GetInvalidatedRect(drawableObjects_, matrix, OUT invalidatedRect))
+                        {
+                            drawingCanvas.InvalidateTiles(&invalidatedRect);
+                        }
+
+                        // Only redraw the objects within the dirty tiles of the
+                        // update rect. The valid tiles still hold their pixels
+                        // from the last paint, and are just shown again.
+                        RECT updateRect;
+                        if (drawingCanvas.GetDirtyTileRect(customDraw.rc, OUT updateRect))
+                        {
+                            DrawableObjectAndValues::ExpandInvalidatedRect(drawableObjects_, matrix, IN OUT updateRect);
+                            drawingCanvas.ClearBackground(DrawableObject::defaultCanvasColor, updateRect);
+                            DrawableObjectAndValues::Draw(drawableObjects_, drawingCanvas, matrix, drawFlags_, &updateRect);
+                            drawingCanvas.ValidateTiles(updateRect);
+                        }
+                        drawnObjectCount_ = drawableObjects_.size();
+                        drawnObjectsGeneration_ = drawableObjectsGeneration_;
                         drawingCanvas.RetireStaleSharedResources();
+
+                        if (animatedAttribute_ != DrawableObjectAttributeTotal)
+                        {
+                            int64_t const paintEndTicks = GetPerformanceCounter();
+                            frameTimings_.AddFrame(float(PerformanceCounterToMilliseconds(paintEndTicks - paintStartTicks)), paintEndTicks);
+                            DrawFrameTimingOverlay(drawingCanvas);
+                        }
+
+                        // Only refresh the timings if drawing recorded any, else
+                        // every paint would schedule another refresh.
+                        uint32_t const timingsGeneration = DrawableObjectAndValues::GetTimingsGeneration();
+                        if (timingsGeneration != shownTimingsGeneration_)
+                        {
+                            shownTimingsGeneration_ = timingsGeneration;
+                            DeferUpdateUi(NeededUiUpdateDrawableObjectsTimings);
+                        }
                     }
                     return {true, CDRF_DODEFAULT};
 
@@ -3002,6 +4608,8 @@ void MainWindow::OnAssortedActions(HWND anchorControl)
     TrackPopupMenu_Item constexpr static items[] = {
         {IdcSaveSelectedFontFile, u"Save font file..."},
         {IdcSaveUnpackedWoffFontFile, u"Save unpacked WOFF font file..."},
+        {IdcSaveUnpackedWoffFontFiles, u"Save unpacked WOFF font files in folder..."},
+        {IdcCancelLoadingFontFiles, u"Cancel loading font files"},
         {IdcExportGlyphImageData, u"Export all glyph image data..." },
         { 0, u"-" },
         {IdcGetAllFontCharacters, u"Get all font characters"},
@@ -3014,14 +4622,116 @@ void MainWindow::OnAssortedActions(HWND anchorControl)
         {0, u"-"},
         {IdcSetWindowTranslucent, u"Make window translucent"},
         {IdcSetWindowOpaque, u"Make window opaque"},
+        {0, u"-"},
+        {IdcDrawInParallel, u"Draw objects in parallel"},
+        {IdcDrawSerially, u"Draw objects serially"},
+        {IdcCachePixels, u"Cache drawn object pixels"},
+        {IdcDontCachePixels, u"Don't cache drawn object pixels"},
+        {IdcUseGlyphAtlas, u"Use glyph atlas for DWrite bitmap drawing"},
+        {IdcDontUseGlyphAtlas, u"Don't use glyph atlas"},
+        {IdcUseD2DHardware, u"Draw D2D objects with the GPU"},
+        {IdcDontUseD2DHardware, u"Draw D2D objects in software"},
+        {0, u"-"},
+        {IdcLogDrawingTimings, u"Log drawing timings"},
+        {IdcLogMemoryUsage, u"Log memory usage"},
+        {IdcTrimCaches, u"Trim caches, releasing the largest"},
+        {IdcStreamLogToFile, u"Stream log to file..."},
+        {IdcStopStreamingLog, u"Stop streaming log to file"},
+        {IdcComparePixels, u"Compare pixels of selected objects to the first"},
+        {0, u"-"},
+        {IdcStartRecordingSession, u"Start recording session"},
+        {IdcStopRecordingSession, u"Stop recording and save session..."},
+        {IdcReplaySession, u"Replay session..."},
+        {0, u"-"},
+        {IdcAnimateFontSize, u"Animate font size of selected objects"},
+        {IdcAnimateAxisValues, u"Animate axis values of selected objects"},
+        {IdcAnimateTransformAngle, u"Animate transform angle of selected objects"},
+        {IdcAnimatePixelZoom, u"Animate pixel zoom of selected objects"},
+        {IdcStopAnimating, u"Stop animating"},
+        {0, u"-"},
+        {IdcUndo, u"Undo last load or edit of drawable objects"},
+        {IdcRedo, u"Redo"},
     };
 
     int menuId = TrackPopupMenu(make_array_ref(items, countof(items)), anchorControl, hwnd_);
+    ExecuteAssortedAction(menuId);
+}
+
+
+namespace
+{
+    struct ReplayableAssortedAction
+    {
+        int menuId;
+        char16_t const* name; // Saved in session files, so never rename one.
+    };
+
+    // Actions prompting for files, playing out over later frames, or about
+    // the recording itself are absent, since replay cannot reproduce them.
+    ReplayableAssortedAction constexpr g_replayableAssortedActions[] = {
+        {IdcGetAllFontCharacters, u"getAllFontCharacters"},
+        {IdcGetAllColorFontCharacters, u"getAllColorFontCharacters"},
+        {IdcCopyAllFontCharacters, u"copyAllFontCharacters"},
+        {IdcAutofitDrawableObjects, u"autofitObjects"},
+        {IdcAutofitDrawableObjectsUniformly, u"autofitObjectsUniformly"},
+        {IdcSetNoLineWrapOnDrawableObjects, u"setNoLineWrap"},
+        {IdcDrawInParallel, u"drawInParallel"},
+        {IdcDrawSerially, u"drawSerially"},
+        {IdcCachePixels, u"cachePixels"},
+        {IdcDontCachePixels, u"dontCachePixels"},
+        {IdcUseGlyphAtlas, u"useGlyphAtlas"},
+        {IdcDontUseGlyphAtlas, u"dontUseGlyphAtlas"},
+        {IdcUseD2DHardware, u"useD2DHardware"},
+        {IdcDontUseD2DHardware, u"dontUseD2DHardware"},
+        {IdcLogDrawingTimings, u"logDrawingTimings"},
+        {IdcLogMemoryUsage, u"logMemoryUsage"},
+        {IdcTrimCaches, u"trimCaches"},
+        {IdcComparePixels, u"comparePixels"},
+        {IdcUndo, u"undo"},
+        {IdcRedo, u"redo"},
+    };
+
+
+    // Returns null if the action is not recorded.
+    char16_t const* GetReplayableAssortedActionName(int menuId) noexcept
+    {
+        for (auto const& action : g_replayableAssortedActions)
+        {
+            if (action.menuId == menuId)
+                return action.name;
+        }
+        return nullptr;
+    }
+
+
+    // Returns 0 for unknown names, such as from a newer build.
+    int GetReplayableAssortedActionId(std::u16string const& name) noexcept
+    {
+        for (auto const& action : g_replayableAssortedActions)
+        {
+            if (name == action.name)
+                return action.menuId;
+        }
+        return 0;
+    }
+}
+
+
+void MainWindow::ExecuteAssortedAction(int menuId)
+{
+    char16_t const* actionName = GetReplayableAssortedActionName(menuId);
+    if (sessionRecording_.IsRecording() && actionName != nullptr)
+    {
+        std::vector<uint32_t> const drawableObjectIndices = GetSelectedDrawableObjectIndices();
+        sessionRecording_.AddStep(SessionRecording::StepTypeAction, drawableObjectIndices)->actionName = actionName;
+    }
 
     switch (menuId)
     {
     case IdcSaveSelectedFontFile: SaveSelectedFontFile(); break;
     case IdcSaveUnpackedWoffFontFile: SaveUnpackedWoffFontFile(); break;
+    case IdcSaveUnpackedWoffFontFiles: SaveUnpackedWoffFontFiles(); break;
+    case IdcCancelLoadingFontFiles: CancelLoadingFontFiles(); break;
     case IdcGetAllFontCharacters: GetAllFontCharacters(/*copyToClipboardInstead*/false, /*getOnlyColorFontCharacters*/ false); break;
     case IdcGetAllColorFontCharacters: GetAllFontCharacters(/*copyToClipboardInstead*/false, /*getOnlyColorFontCharacters*/ true); break;
     case IdcCopyAllFontCharacters: GetAllFontCharacters(/*copyToClipboardInstead*/true, /*getOnlyColorFontCharacters*/ false); break;
@@ -3031,7 +4741,341 @@ void MainWindow::OnAssortedActions(HWND anchorControl)
     case IdcSetNoLineWrapOnDrawableObjects: SetNoLineWrapOnDrawableObjects(); break;
     case IdcSetWindowTranslucent: SetWindowTranslucency(128); break;
     case IdcSetWindowOpaque: SetWindowTranslucency(255); break;
+    case IdcDrawInParallel: drawFlags_ |= DrawableObjectAndValues::DrawFlagsParallel; RepaintDrawableObjects(/*onlyChangedObjects*/false); break;
+    case IdcDrawSerially: drawFlags_ &= ~DrawableObjectAndValues::DrawFlagsParallel; RepaintDrawableObjects(/*onlyChangedObjects*/false); break;
+    case IdcCachePixels: drawFlags_ |= DrawableObjectAndValues::DrawFlagsCachePixels; RepaintDrawableObjects(/*onlyChangedObjects*/false); break;
+    case IdcDontCachePixels:
+        drawFlags_ &= ~DrawableObjectAndValues::DrawFlagsCachePixels;
+        for (auto& drawableObject : drawableObjects_)
+        {
+            drawableObject.cachedPixels_.Clear();
+        }
+        RepaintDrawableObjects(/*onlyChangedObjects*/false);
+        break;
+    case IdcUseGlyphAtlas:
+    case IdcDontUseGlyphAtlas:
+        if (menuId == IdcUseGlyphAtlas)
+            drawFlags_ |= DrawableObjectAndValues::DrawFlagsGlyphAtlas;
+        else
+            drawFlags_ &= ~DrawableObjectAndValues::DrawFlagsGlyphAtlas;
+
+        // Cached pixels were drawn the other way.
+        for (auto& drawableObject : drawableObjects_)
+        {
+            drawableObject.cachedPixels_.Clear();
+        }
+        RepaintDrawableObjects(/*onlyChangedObjects*/false);
+        break;
+    case IdcUseD2DHardware:
+    case IdcDontUseD2DHardware:
+        {
+            DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(GetWindowFromId(hwnd_, IdcDrawingCanvas));
+            drawingCanvas.SetD2DHardwareEnabled(menuId == IdcUseD2DHardware);
+            for (auto& drawableObject : drawableObjects_)
+            {
+                drawableObject.cachedPixels_.Clear();
+            }
+            RepaintDrawableObjects(/*onlyChangedObjects*/false);
+        }
+        break;
+    case IdcLogDrawingTimings: LogDrawableObjectTimings(); break;
+    case IdcLogMemoryUsage: LogMemoryUsage(); break;
+    case IdcTrimCaches: TrimCaches(); break;
+    case IdcStreamLogToFile: StreamLogToFile(); break;
+    case IdcStopStreamingLog: StopStreamingLog(); break;
+    case IdcComparePixels: CompareDrawableObjectsPixels(); break;
+    case IdcAnimateFontSize: StartAnimatingDrawableObjects(DrawableObjectAttributeFontSize); break;
+    case IdcAnimateAxisValues: StartAnimatingDrawableObjects(DrawableObjectAttributeAxisValues); break;
+    case IdcAnimateTransformAngle: StartAnimatingDrawableObjects(DrawableObjectAttributeTransform); break;
+    case IdcAnimatePixelZoom: StartAnimatingDrawableObjects(DrawableObjectAttributePixelZoom); break;
+    case IdcStopAnimating: StopAnimatingDrawableObjects(); break;
+    case IdcUndo: RestoreUndoSnapshot(/*isRedo*/false); break;
+    case IdcRedo: RestoreUndoSnapshot(/*isRedo*/true); break;
+    case IdcStartRecordingSession: StartRecordingSession(); break;
+    case IdcStopRecordingSession: StopRecordingSession(); break;
+    case IdcReplaySession: ReplaySession(); break;
+    }
+}
+
+
+void MainWindow::StartRecordingSession()
+{
+    sessionRecording_.Start();
+    AppendLog(u"Recording session. Use 'Stop recording and save session' in the actions menu to finish.\r\n");
+}
+
+
+HRESULT MainWindow::StopRecordingSession()
+{
+    if (!sessionRecording_.IsRecording())
+        return S_FALSE;
+
+    sessionRecording_.Stop();
+    AppendLog(u"Stopped recording session, %u steps.\r\n", uint32_t(sessionRecording_.GetSteps().size()));
+
+    std::u16string filePath;
+    if (!GetSaveFileName(hwnd_, u"Layout Sampler Session (*.TextLayoutSamplerSession)\0" u"*.TextLayoutSamplerSession\0" u"All files (*)\0" u"*\0", u"TextLayoutSamplerSession", u"", OUT filePath, u"Save recorded session"))
+        return S_OK;
+
+    return ShowMessageIfError(u"Could not save session file '%s'.", sessionRecording_.Save(filePath.c_str()), filePath.c_str());
+}
+
+
+HRESULT MainWindow::ReplaySession()
+{
+    std::u16string filePath;
+    if (!GetOpenFileName(hwnd_, u"Layout Sampler Session (*.TextLayoutSamplerSession)\0" u"*.TextLayoutSamplerSession\0" u"All files (*)\0" u"*\0", OUT filePath, u"Replay recorded session"))
+        return S_OK;
+
+    return ShowMessageIfError(u"Could not replay session file '%s'.", ReplaySession(filePath.c_str()), filePath.c_str());
+}
+
+
+HRESULT MainWindow::ReplaySession(_In_z_ char16_t const* filePath, _Out_opt_ std::u16string* timingsCsv)
+{
+    if (sessionRecording_.IsRecording())
+    {
+        // Replaying would record every step all over again.
+        sessionRecording_.Stop();
+        AppendLog(u"Stopped recording session to replay one.\r\n");
+    }
+
+    SessionRecording session;
+    IFR(session.Load(filePath));
+    array_ref<SessionRecording::Step const> steps = session.GetSteps();
+    AppendLog(u"Replaying session '%s', %u steps.\r\n", filePath, uint32_t(steps.size()));
+
+    // Steps run back to back, without the pauses between them when recorded,
+    // each timed from its execution through the canvas paint it causes.
+    if (timingsCsv != nullptr)
+    {
+        timingsCsv->assign(u"step,type,recordedMilliseconds,replayMilliseconds,hresult\r\n");
+    }
+    HRESULT firstFailure = S_OK;
+    double totalMilliseconds = 0;
+
+    for (uint32_t stepIndex = 0, stepCount = uint32_t(steps.size()); stepIndex < stepCount; ++stepIndex)
+    {
+        SessionRecording::Step const& step = steps[stepIndex];
+        int64_t const stepStartTicks = GetPerformanceCounter();
+
+        HRESULT hr = ExecuteSessionStep(step);
+        if (FAILED(hr) && SUCCEEDED(firstFailure))
+        {
+            firstFailure = hr;
+        }
+        DeferUpdateUi(
+            NeededUiUpdateDrawableObjectsListView |
+            NeededUiUpdateDrawableObjectsCanvas |
+            NeededUiUpdateAttributesListView |
+            NeededUiUpdateAttributeValuesListView |
+            NeededUiUpdateAttributeValuesSlider |
+            NeededUiUpdateAttributeValuesEdit |
+            NeededUiUpdateTextEdit
+            );
+        UpdateUi();
+        PaintDrawableObjectsNow();
+
+        double const stepMilliseconds = PerformanceCounterToMilliseconds(GetPerformanceCounter() - stepStartTicks);
+        totalMilliseconds += stepMilliseconds;
+
+        char16_t const* stepTypeName = SessionRecording::GetStepTypeName(step.type);
+        AppendLog(u"Step %u %s: %.3f ms%s\r\n", stepIndex, stepTypeName, stepMilliseconds, FAILED(hr) ? u" (failed)" : u"");
+
+        if (timingsCsv != nullptr)
+        {
+            wchar_t buffer[100];
+            swprintf_s(buffer, L"%u,%s,%.3f,%.3f,%08X\r\n", stepIndex, ToWChar(stepTypeName), step.milliseconds, stepMilliseconds, hr);
+            timingsCsv->append(ToChar16(buffer));
+        }
+    }
+
+    float const recordedMilliseconds = steps.empty() ? 0.0f : steps.back().milliseconds;
+    AppendLog(u"Replayed %u steps in %.3f ms, recorded over %.3f ms.\r\n", uint32_t(steps.size()), totalMilliseconds, recordedMilliseconds);
+
+    return firstFailure;
+}
+
+
+HRESULT MainWindow::ExecuteSessionStep(SessionRecording::Step const& step)
+{
+    // The objects may differ from when recorded, such as fewer after loading
+    // a changed settings file, so drop indices that no longer exist.
+    std::vector<uint32_t> drawableObjectIndices = step.objectIndices;
+    auto const drawableObjectsTotal = drawableObjects_.size();
+    drawableObjectIndices.erase(std::remove_if(drawableObjectIndices.begin(), drawableObjectIndices.end(), [=](auto i) {return i >= drawableObjectsTotal; }), drawableObjectIndices.end());
+
+    // Actions and font loads read the selection themselves.
+    SelectDrawableObjectsListView(drawableObjectIndices);
+
+    HRESULT hr = S_OK;
+    switch (step.type)
+    {
+    case SessionRecording::StepTypeAction:
+        {
+            int const menuId = GetReplayableAssortedActionId(step.actionName);
+            if (menuId != 0)
+            {
+                ExecuteAssortedAction(menuId);
+            }
+        }
+        break;
+
+    case SessionRecording::StepTypeSetValues:
+        if (!drawableObjectIndices.empty() && !step.attributeIndices.empty())
+        {
+            SetDrawableObjectValues(step.attributeIndices, drawableObjectIndices, step.value);
+        }
+        break;
+
+    case SessionRecording::StepTypeSetText:
+        SetDrawableObjectsText(drawableObjectIndices, SharedString(std::make_shared<std::u16string const>(step.value)));
+        break;
+
+    case SessionRecording::StepTypeLoadSettings:
+        hr = LoadDrawableObjectsSettings(step.value.c_str(), step.clearExistingItems, step.merge);
+        break;
+
+    case SessionRecording::StepTypeLoadTextFile:
+        hr = LoadTextFileIntoDrawableObjects(step.value.c_str());
+        break;
+
+    case SessionRecording::StepTypeLoadFontFile:
+        hr = LoadFontFileIntoDrawableObjects(step.value.c_str());
+        break;
+
+    case SessionRecording::StepTypeLoadFontFiles:
+        {
+            std::vector<std::u16string> filePaths = step.filePaths;
+            hr = StartLoadingFontFiles(std::move(filePaths));
+
+            // Wait for the whole batch rather than the timer, so the step's
+            // time covers reading every file.
+            while (fontLoadJob_ != nullptr)
+            {
+                Sleep(1);
+                ReadLoadedFontFiles();
+            }
+        }
+        break;
+    }
+
+    return hr;
+}
+
+
+void MainWindow::SelectDrawableObjectsListView(array_ref<uint32_t const> drawableObjectIndices)
+{
+    HWND listViewHwnd = GetWindowFromId(hwnd_, IdcDrawableObjectsList);
+
+    isRecursing_ = true;
+    ListView_SetItemState(listViewHwnd, -1, 0, LVIS_FOCUSED | LVIS_SELECTED);
+    for (auto drawableObjectIndex : drawableObjectIndices)
+    {
+        int const row = GetDrawableObjectsListViewRow(drawableObjectIndex);
+        if (row >= 0)
+        {
+            ListView_SetItemState(listViewHwnd, row, LVIS_SELECTED, LVIS_SELECTED);
+        }
+    }
+    isRecursing_ = false;
+}
+
+
+void MainWindow::PaintDrawableObjectsNow()
+{
+    // A hidden window never receives WM_PAINT, so paint through a window DC,
+    // which the canvas back buffer still draws into normally.
+    HWND canvasHwnd = GetWindowFromId(hwnd_, IdcDrawingCanvas);
+    DrawingCanvasControl& drawingCanvas = *DrawingCanvasControl::GetClass(canvasHwnd);
+
+    RECT clientRect = {};
+    GetClientRect(canvasHwnd, OUT &clientRect);
+    HDC hdc = GetDC(canvasHwnd);
+    drawingCanvas.Paint(hdc, clientRect);
+    ReleaseDC(canvasHwnd, hdc);
+    ValidateRect(canvasHwnd, nullptr);
+}
+
+
+int MainWindow::RunSessionReplayCommandLine(_In_z_ char16_t const* commandLine)
+{
+    AttachConsole(ATTACH_PARENT_PROCESS);
+
+    int argumentCount = 0;
+    wchar_t** arguments = CommandLineToArgvW(ToWChar(commandLine), OUT &argumentCount);
+    if (arguments == nullptr)
+    {
+        return 1;
+    }
+
+    std::u16string timingsFilePath;
+    std::u16string sessionFilePath;
+
+    for (int i = 0; i < argumentCount; ++i)
+    {
+        char16_t const* argument = ToChar16(arguments[i]);
+        if (_wcsicmp(ToWChar(argument), L"/replay") == 0)
+        {
+            continue;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/out:", 5) == 0)
+        {
+            timingsFilePath = argument + 5;
+        }
+        else if (argument[0] == '/')
+        {
+            WriteConsoleLine(u"Unknown command line option: %s", argument);
+            LocalFree(arguments);
+            return 1;
+        }
+        else
+        {
+            sessionFilePath = argument;
+        }
+    }
+    LocalFree(arguments);
+
+    if (sessionFilePath.empty())
+    {
+        WriteConsoleLine(u"TextLayoutSampler.exe /replay [/out:Timings.csv] SomeFile.TextLayoutSamplerSession");
+        return 1;
+    }
+
+    Application::g_mainHwnd = MainWindow::Create();
+    if (Application::g_mainHwnd == nullptr)
+    {
+        WriteConsoleLine(u"Could not create main window.");
+        return 1;
+    }
+    MainWindow& mainWindow = *MainWindow::GetClass(Application::g_mainHwnd);
+
+    // Starts from no objects, like /blank, so only the session's loads count.
+    std::u16string timingsCsv;
+    int64_t const replayStartTicks = GetPerformanceCounter();
+    HRESULT hr = mainWindow.ReplaySession(sessionFilePath.c_str(), OUT &timingsCsv);
+    double const replayMilliseconds = PerformanceCounterToMilliseconds(GetPerformanceCounter() - replayStartTicks);
+
+    if (!timingsFilePath.empty())
+    {
+        HRESULT writeHr = WriteTextFile(timingsFilePath.c_str(), timingsCsv.data(), static_cast<uint32_t>(timingsCsv.size()));
+        if (FAILED(writeHr))
+            WriteConsoleLine(u"Failed %08X writing timings: %s", writeHr, timingsFilePath.c_str());
+    }
+    else
+    {
+        // Each row on its own, since console lines are bounded.
+        for (size_t lineStart = 0, lineEnd; lineStart < timingsCsv.size(); lineStart = lineEnd + 2)
+        {
+            lineEnd = timingsCsv.find(u"\r\n", lineStart);
+            timingsCsv[lineEnd] = '\0';
+            WriteConsoleLine(u"%s", &timingsCsv[lineStart]);
+        }
     }
+    WriteConsoleLine(u"Replayed '%s' in %.3f ms, %08X.", sessionFilePath.c_str(), replayMilliseconds, hr);
+
+    DestroyWindow(Application::g_mainHwnd);
+    return SUCCEEDED(hr) ? 0 : 1;
 }
 
 
@@ -3105,6 +5149,19 @@ void MainWindow::EscapeText(IN OUT std::u16string& text)
 }
 
 
+namespace
+{
+    // The log already has CRLF line ends, so it goes out as UTF-8 bytes rather
+    // than through a text mode stream, which would double each CR.
+    void WriteLogFileText(FILE* file, _In_z_ char16_t const* text)
+    {
+        std::string utf8Text;
+        AppendTextUtf16ToUtf8({text, wcslen(ToWChar(text))}, IN OUT utf8Text);
+        fwrite(utf8Text.data(), 1, utf8Text.size(), file);
+    }
+}
+
+
 void MainWindow::AppendLogCached(char16_t const* logMessage, ...)
 {
     va_list argList;
@@ -3119,17 +5176,111 @@ void MainWindow::AppendLogCached(char16_t const* logMessage, ...)
 
 void MainWindow::AppendLogUnformatted(char16_t const* logMessage)
 {
-    HWND hwndLog = GetWindowFromId(hwnd_, IdcLog);
-
     if (!cachedLog_.empty())
     {
         cachedLog_ += logMessage;
         logMessage = cachedLog_.data();
     }
-    uint32_t previousTextLength = Edit_GetTextLength(hwndLog);
-    Edit_SetSel(hwndLog, previousTextLength, previousTextLength);
-    Edit_ReplaceSel(hwndLog, logMessage);
+    logText_ += logMessage;
+    if (logFile_ != nullptr)
+    {
+        WriteLogFileText(logFile_, logMessage);
+    }
     cachedLog_.clear();
+
+    // Long loops may log without ever pumping messages for the timer, so
+    // flush directly if due, else shortly after.
+    if (PerformanceCounterToMilliseconds(GetPerformanceCounter() - logFlushTicks_) >= logFlushInterval)
+    {
+        FlushLog();
+    }
+    else if (!isLogFlushPending_)
+    {
+        SetTimer(hwnd_, IdcFlushLog, logFlushInterval, nullptr);
+        isLogFlushPending_ = true;
+    }
+}
+
+
+void MainWindow::FlushLog()
+{
+    if (isLogFlushPending_)
+    {
+        KillTimer(hwnd_, IdcFlushLog);
+        isLogFlushPending_ = false;
+    }
+    logFlushTicks_ = GetPerformanceCounter();
+
+    if (logFile_ != nullptr)
+    {
+        fflush(logFile_);
+    }
+
+    // Trim well below the maximum, at a line start, so trimming (and with
+    // it rewriting the whole control) is rare.
+    if (logText_.size() > maximumLogLength)
+    {
+        size_t trimLength = logText_.size() - maximumLogLength * 3 / 4;
+        size_t lineEnd = logText_.find(u'\n', trimLength);
+        if (lineEnd != std::u16string::npos)
+            trimLength = lineEnd + 1;
+        logText_.erase(0, trimLength);
+        logShownLength_ = 0;
+    }
+
+    if (logShownLength_ >= logText_.size() && logShownLength_ != 0)
+        return;
+
+    HWND hwndLog = GetWindowFromId(hwnd_, IdcLog);
+    if (logShownLength_ == 0)
+    {
+        SetWindowText(hwndLog, ToWChar(logText_.c_str()));
+        uint32_t textLength = Edit_GetTextLength(hwndLog);
+        Edit_SetSel(hwndLog, textLength, textLength);
+        Edit_ScrollCaret(hwndLog);
+    }
+    else
+    {
+        uint32_t previousTextLength = Edit_GetTextLength(hwndLog);
+        Edit_SetSel(hwndLog, previousTextLength, previousTextLength);
+        Edit_ReplaceSel(hwndLog, ToWChar(logText_.c_str() + logShownLength_));
+    }
+    logShownLength_ = logText_.size();
+}
+
+
+HRESULT MainWindow::StreamLogToFile()
+{
+    std::u16string filePath;
+    if (!GetSaveFileName(hwnd_, u"Text files (*.txt)\0" u"*.txt\0" u"All files (*)\0" u"*\0", u"txt", u"TextLayoutSamplerLog.txt", OUT filePath, u"Stream log to file"))
+        return S_OK;
+
+    StopStreamingLog();
+
+    FILE* file = nullptr;
+    if (_wfopen_s(OUT &file, ToWChar(filePath.c_str()), L"wb") != 0 || file == nullptr)
+    {
+        ShowMessageAndAppendLog(u"Could not open log file '%s'.", filePath.c_str());
+        return E_FAIL;
+    }
+    logFile_.Set(file);
+
+    // Start with the byte order mark and everything logged so far, then every
+    // message as it comes.
+    fwrite("\xEF\xBB\xBF", 1, 3, logFile_);
+    WriteLogFileText(logFile_, logText_.c_str());
+    AppendLog(u"Streaming log to file '%s'.\r\n", filePath.c_str());
+    return S_OK;
+}
+
+
+void MainWindow::StopStreamingLog()
+{
+    if (logFile_ != nullptr)
+    {
+        AppendLog(u"Stopped streaming log to file.\r\n");
+        logFile_.Clear();
+    }
 }
 
 
@@ -3190,4 +5341,6 @@ void MainWindow::ClearLog()
     Edit_SetText(hwndLog, L"");
 
     std::u16string().swap(cachedLog_);
+    std::u16string().swap(logText_);
+    logShownLength_ = 0;
 }
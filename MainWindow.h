@@ -17,6 +17,8 @@ import DrawableObject;
 import Application;
 import DrawableObjectAndValues;
 import TextTreeParser; // for DrawableObjectAndValues
+import FontMetadataIndex;
+import SessionRecording;
 #else
 #include "Common.ArrayRef.h"
 #include "Common.String.h"
@@ -30,6 +32,8 @@ import TextTreeParser; // for DrawableObjectAndValues
 #include "Application.h"
 #include "DrawableObjectAndValues.h"
 #include "TextTreeParser.h"
+#include "FontMetadataIndex.h"
+#include "SessionRecording.h"
 #endif
 
 
@@ -78,6 +82,9 @@ public:
         NeededUiUpdateAttributeValuesSlider = 32,
         NeededUiUpdateAttributeValuesEdit = 64,
         NeededUiUpdateTextEdit = 128,
+        NeededUiUpdateDrawableObjectsTimings = 256,
+        NeededUiReadTextEdit = 512,             // Apply typed text to the objects, once per burst of keystrokes.
+        NeededUiReadAttributeValuesEdit = 1024, // Likewise for the typed attribute value.
     };
 
     enum SettingsVisibility
@@ -97,15 +104,51 @@ public:
     };
 
     struct FontFamilyNameProperties;
+    struct FontLoadJob;
+
+    // Object whose attribute is animated each frame, with the value to restore after.
+    struct AnimatedDrawableObject
+    {
+        uint32_t objectIndex;
+        AttributeValue originalValue;
+        std::vector<float> baseValues; // Parsed original values, which the animation oscillates around.
+    };
+
+    // Recent per frame costs while animating, for the frame timing overlay.
+    struct FrameTimings
+    {
+        static constexpr uint32_t maximumFrameCount = 240; // A few seconds worth at typical rates.
+
+        std::vector<float> updateMilliseconds;  // Setting the animated values and updating the objects.
+        std::vector<float> drawMilliseconds;    // Arranging and drawing within the canvas paint.
+        std::vector<float> frameMilliseconds;   // Interval between successive paints.
+        uint32_t nextFrameIndex = 0;            // Oldest entry to overwrite once full.
+        uint32_t frameCount = 0;                // Total painted since the animation started.
+        int64_t lastPaintTicks = 0;
+        float pendingUpdateMilliseconds = 0;    // Update cost of the frame not yet painted.
+
+        void Clear();
+        void AddFrame(float drawMilliseconds, int64_t paintTicks);
+
+        // Value at the given fraction (0 to 1) of the sorted samples, or 0 if none.
+        static float GetPercentile(array_ref<float const> values, float fraction);
+    };
 
     void InitializeDefaultDrawableObjects();
+    void PrewarmRendering(); // Start the back ends not yet used, once idle after startup.
     HRESULT LoadTextFileIntoDrawableObjects(_In_z_ char16_t const* filePath);
     HRESULT StoreTextFileFromDrawableObjects(_In_z_ char16_t const* filePath);
     HRESULT LoadFontFileIntoDrawableObjects(_In_z_ char16_t const* filePath);
+    HRESULT StartLoadingFontFiles(std::vector<std::u16string>&& filePaths); // Files or folders, read in the background.
+    void    ReadLoadedFontFiles(); // Append objects for fonts read so far, finishing once all are read.
+    void    CancelLoadingFontFiles();
+    void    EnsureFontMetadataIndexLoaded();
+    HRESULT SaveFontMetadataIndex();
     HRESULT LoadDrawableObjectsSettings(_In_z_ char16_t const* filePath, bool clearExistingItems = true, bool merge = false);
     HRESULT StoreDrawableObjectsSettings(_In_z_ char16_t const* filePath);
     HRESULT SaveSelectedFontFile();
     HRESULT SaveUnpackedWoffFontFile();
+    HRESULT SaveUnpackedWoffFontFiles();
     HRESULT ExportFontGlyphData();
     void    SetWindowTranslucency(uint32_t alpha);
     HRESULT AutofitDrawableObjects(bool useMaximumWidth, bool useMaximumHeight);
@@ -114,6 +157,9 @@ public:
     HRESULT GetAllFontCharacters(bool copyToClipboardInstead, bool getOnlyColorFontCharacters);
     HRESULT GetLogFontFromDrawableObjects(_Out_ LOGFONT& logFont);
     HRESULT UpdateDrawableObjectsFromFontFamilyNameProperties(FontFamilyNameProperties const& fontFamilyNameProperties);
+    HRESULT UpdateDrawableObjectsFromFontFamilyNameProperties(FontFamilyNameProperties const& fontFamilyNameProperties, array_ref<uint32_t const> drawableObjectIndices);
+    HRESULT ReplaySession(_In_z_ char16_t const* filePath, _Out_opt_ std::u16string* timingsCsv = nullptr); // One row per step.
+    static int RunSessionReplayCommandLine(_In_z_ char16_t const* commandLine); // Replays in a window never shown.
 
 protected:
     MainWindow::DialogProcResult CALLBACK DialogProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
@@ -127,6 +173,23 @@ protected:
     void UpdateUi();
     void DeferUpdateUi(NeededUiUpdate neededUiUpdate = NeededUiUpdateNone);
     void UpdateDrawableObjectsListView();
+    void UpdateDrawableObjectsListViewTimings();
+    void GetDrawableObjectsListViewItem(_Inout_ LVITEM& item); // For the owner data LVN_GETDISPINFO.
+    void LogDrawableObjectTimings();
+    void SortDrawableObjectsByStatistic(uint32_t statisticIndex); // Largest first, for a column after the attributes.
+    bool IsDrawableObjectsListSorted() const noexcept;
+    void RemapDrawableObjectsListViewIndices(_Inout_ std::vector<uint32_t>& indices); // Rows to object indices, ascending.
+    int GetDrawableObjectsListViewRow(uint32_t drawableObjectIndex);
+    void LogMemoryUsage();
+    void TrimCaches(); // Release the largest object and canvas caches, about half in all.
+    void CompareDrawableObjectsPixels();
+    void StartAnimatingDrawableObjects(DrawableObjectAttribute attributeIndex);
+    void StopAnimatingDrawableObjects(bool restoreValues = true);
+    void SaveUndoSnapshot(_In_opt_ std::vector<uint32_t> const* coalescingKey = nullptr);
+    void SaveUndoSnapshot(DrawableObjectAndValues::Snapshot snapshot); // One taken earlier, such as before an operation that may fail.
+    void RestoreUndoSnapshot(bool isRedo);
+    void AnimateDrawableObjects(); // Advance one frame.
+    void DrawFrameTimingOverlay(DrawingCanvasControl& drawingCanvas);
     void DeleteDrawableObjectsListViewSelected();
     void CreateDrawableObjectsListViewSelected();
     void EnsureAtLeastOneDrawableObject();
@@ -135,14 +198,20 @@ protected:
     HRESULT StoreDrawableObjectsSettings();
     void UpdateAttributesListView();
     void UpdateAttributeValuesListView();
+    void GetAttributeValuesListViewItem(_Inout_ LVITEM& item); // For the owner data LVN_GETDISPINFO.
+    void RemapAttributeValuesListViewIndices(_Inout_ array_ref<uint32_t> indices); // Rows to predefined value indices.
     void UpdateAttributeValuesEdit();
     void UpdateAttributeValuesSlider();
     void UpdateTextEdit();
     void ReadAttributeFilterEdit();
     void ReadAttributeValueEdit();
+    void ReadTextEdit();
+    void ReadPendingEdits(); // Apply typed text still awaiting the deferred UI update.
     void ChangeSettingsVisibility(SettingsVisibility settingsVisibility);
     void UpdateDrawableObjectValuesUsing(std::u16string const& newValueString);
-    void RepaintDrawableObjects();
+    void SetDrawableObjectValues(array_ref<uint32_t const> attributeIndices, array_ref<uint32_t const> drawableObjectIndices, std::u16string const& newValueString);
+    void SetDrawableObjectsText(array_ref<uint32_t const> drawableObjectIndices, SharedString const& text);
+    void RepaintDrawableObjects(bool onlyChangedObjects = true);
     void Resize(int id);
     HRESULT SelectFontFile();
     HRESULT SelectFontFamily();
@@ -162,6 +231,9 @@ public:
     HRESULT ShowMessageIfError(char16_t const* logMessage, HRESULT hr, ...);
 
     void ClearLog();
+    void FlushLog(); // Show any log text pending for the log control.
+    HRESULT StreamLogToFile(); // Prompts for the file, also writing the log so far.
+    void StopStreamingLog();
 
 ////////////////////////////////////////
 // Internal functions.
@@ -173,6 +245,13 @@ protected:
     MainWindow::DialogProcResult CALLBACK OnDragAndDrop(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
     void OnHorizontalOrVerticalScroll(HWND hwnd, int barType, UINT code, int smallStep);
     void OnAssortedActions(HWND anchorControl);
+    void ExecuteAssortedAction(int menuId);
+    void StartRecordingSession();
+    HRESULT StopRecordingSession(); // Prompts for the file to save the steps.
+    HRESULT ReplaySession(); // Prompts for the file.
+    HRESULT ExecuteSessionStep(SessionRecording::Step const& step);
+    void SelectDrawableObjectsListView(array_ref<uint32_t const> drawableObjectIndices);
+    void PaintDrawableObjectsNow(); // Paint the canvas immediately, even if the window is hidden.
     void OnTextEscapeMode(HWND anchorControl);
     void SetTextEscapeMode(TextEscapeMode textEscapeMode);
     void UnescapeText(IN OUT std::u16string& text);
@@ -185,6 +264,17 @@ protected:
     HWND hwnd_;
     static HACCEL g_accelTable;
     std::u16string cachedLog_;
+
+    // Log text, shown in the log control at most once per flush interval
+    // rather than per message, since each edit control update costs more as
+    // its text grows. Oldest lines are trimmed once past the maximum.
+    static constexpr size_t maximumLogLength = 256 * 1024;
+    static constexpr uint32_t logFlushInterval = 16; // milliseconds
+    std::u16string logText_;
+    size_t logShownLength_ = 0;     // Prefix of logText_ already in the control. Zero to rewrite it all.
+    int64_t logFlushTicks_ = 0;
+    bool isLogFlushPending_ = false;
+    CstdioFileHandle logFile_;      // Receives every message as well, if streaming.
     bool isRecursing_ = false;
     bool isTypingAttributeValueToFilter_ = false; // Was recently typing a character into the value edit field.
     NeededUiUpdate neededUiUpdate_ = NeededUiUpdateNone;
@@ -192,10 +282,44 @@ protected:
     SettingsVisibility settingsVisibility_ = SettingsVisibilityLight;
     std::u16string attributeFilter_;
     std::u16string selectedAttributeValue_;
+    ListSubstringPrioritizer attributesPrioritizer_; // Attribute display names, refiltered per keystroke.
+    ListSubstringPrioritizer attributeValuesPrioritizer_; // Predefined value names of attributeValuesPrioritizerIndex_.
+    DrawableObjectAttribute attributeValuesPrioritizerIndex_ = DrawableObjectAttributeTotal;
+    std::vector<uint32_t> attributeValuesListOrder_; // Predefined value index of each attribute values list row.
+    DrawableObjectAttribute attributeValuesListIndex_ = DrawableObjectAttributeTotal; // Attribute whose values are listed.
     std::u16string previousSettingsFilePath_;
     TextEscapeMode textEscapeMode_ = TextEscapeModeNone;
+    IncrementalUnescaper textEditUnescaper_; // Reunescapes only the edited lines per keystroke.
+    SharedString textEditText_; // Unescaped text the edit shows, shared with the objects it was read into.
+    DrawableObjectAndValues::DrawFlags drawFlags_ = DrawableObjectAndValues::DrawFlagsNone;
+    size_t drawnObjectCount_ = 0; // Object count as of the last paint, for partial repaints.
+    uint32_t drawableObjectsGeneration_ = 0; // Bumped whenever the object list is replaced, whatever its new count.
+    uint32_t drawnObjectsGeneration_ = 0; // Generation as of the last paint.
+    uint32_t shownTimingsGeneration_ = 0; // DrawableObjectAndValues::GetTimingsGeneration as of the last timings refresh.
+    std::vector<uint32_t> drawableObjectsListOrder_; // Object index of each drawable objects list row, if sorted by a column.
+    uint32_t drawableObjectsListOrderGeneration_ = 0; // drawableObjectsGeneration_ the order was sorted for.
+    DX_MATRIX_3X2F tiledViewMatrix_ = {}; // View the canvas tiles were drawn with.
 
     std::vector<DrawableObjectAndValues> drawableObjects_;
+    DrawableObjectAndValues::SpatialIndex drawableObjectsIndex_; // Rebuilt with each Arrange, for hit testing.
+    FontMetadataIndex fontMetadataIndex_; // Loaded on first font file use.
+    std::shared_ptr<FontLoadJob> fontLoadJob_; // Dropped font files and folders still being read.
+
+    DrawableObjectAttribute animatedAttribute_ = DrawableObjectAttributeTotal; // Total if not animating.
+    std::vector<AnimatedDrawableObject> animatedObjects_;
+    size_t animatedObjectsTotal_ = 0; // Object count when the animation started, since indices go stale after.
+    int64_t animationStartTicks_ = 0;
+    FrameTimings frameTimings_;
+    RECT frameTimingOverlayRect_ = {}; // Where the overlay was last drawn, in canvas pixels.
+    CachedGdiPlusStartup prewarmedGdiPlusStartup_; // Keeps GDI+ started after PrewarmRendering.
+
+    // Object lists before each load, merge, or attribute edit, newest last.
+    static constexpr size_t maximumUndoSnapshots = 32;
+    std::vector<DrawableObjectAndValues::Snapshot> undoSnapshots_;
+    std::vector<DrawableObjectAndValues::Snapshot> redoSnapshots_;
+    std::vector<uint32_t> undoCoalescingKey_; // Edited attributes and objects of the newest undo snapshot.
+
+    SessionRecording sessionRecording_; // Actions since recording started, to replay as a benchmark.
 
 };
 
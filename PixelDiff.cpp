@@ -0,0 +1,446 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Pixel comparison of drawn objects, for comparing APIs.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+
+#include <intrin.h>
+#include <emmintrin.h>
+
+MODULE(PixelDiff)
+EXPORT_BEGIN
+    #include "PixelDiff.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    uint32_t const g_pixelColorMask = 0x00FFFFFF; // GDI leaves alpha undefined.
+
+    // Rows are compared in spans of this many pixels, so the 32-bit squared
+    // error lanes (up to 2 x 2 x 255^2 per vector) are flushed before overflow.
+    uint32_t const g_pixelSpanLength = 8192;
+
+    // Bit counts of each 4-bit pixel change mask.
+    uint8_t const g_maskBitCounts[16] = {0,1,1,2, 1,2,2,3, 1,2,2,3, 2,3,3,4};
+
+    struct RowDiff
+    {
+        uint32_t changedPixelCount = 0;
+        uint32_t firstChangedPixel = UINT32_MAX;
+        uint32_t lastChangedPixel = 0; // One past.
+        uint32_t maximumDelta = 0;
+        uint64_t squaredErrorSum = 0;
+    };
+
+
+    inline uint32_t GetChannelDeltas(uint32_t firstPixel, uint32_t secondPixel, _Out_ uint32_t& squaredErrorSum) noexcept
+    {
+        int32_t const blue  = int32_t((firstPixel >>  0) & 0xFF) - int32_t((secondPixel >>  0) & 0xFF);
+        int32_t const green = int32_t((firstPixel >>  8) & 0xFF) - int32_t((secondPixel >>  8) & 0xFF);
+        int32_t const red   = int32_t((firstPixel >> 16) & 0xFF) - int32_t((secondPixel >> 16) & 0xFF);
+        squaredErrorSum = uint32_t(blue * blue + green * green + red * red);
+        return std::max(std::max(std::abs(blue), std::abs(green)), std::abs(red));
+    }
+
+
+    void CompareRowSpan(
+        _In_reads_(count) uint32_t const* firstRow,
+        _In_reads_(count) uint32_t const* secondRow,
+        uint32_t offset,
+        uint32_t count,
+        _Inout_ RowDiff& rowDiff
+        )
+    {
+        __m128i const colorMask = _mm_set1_epi32(g_pixelColorMask);
+        __m128i const zero = _mm_setzero_si128();
+        __m128i maximumDeltas = zero;
+        __m128i squaredErrorSums = zero;
+
+        uint32_t x = 0;
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i const first = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(&firstRow[x])), colorMask);
+            __m128i const second = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(&secondRow[x])), colorMask);
+            __m128i const deltas = _mm_or_si128(_mm_subs_epu8(first, second), _mm_subs_epu8(second, first));
+            uint32_t const changedBits = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(deltas, zero))) & 0xF;
+            if (changedBits == 0)
+                continue;
+
+            unsigned long firstBit, lastBit;
+            _BitScanForward(OUT &firstBit, changedBits);
+            _BitScanReverse(OUT &lastBit, changedBits);
+            rowDiff.firstChangedPixel = std::min(rowDiff.firstChangedPixel, offset + x + firstBit);
+            rowDiff.lastChangedPixel = offset + x + lastBit + 1;
+            rowDiff.changedPixelCount += g_maskBitCounts[changedBits];
+
+            maximumDeltas = _mm_max_epu8(maximumDeltas, deltas);
+            __m128i const lowDeltas = _mm_unpacklo_epi8(deltas, zero);
+            __m128i const highDeltas = _mm_unpackhi_epi8(deltas, zero);
+            squaredErrorSums = _mm_add_epi32(squaredErrorSums, _mm_add_epi32(_mm_madd_epi16(lowDeltas, lowDeltas), _mm_madd_epi16(highDeltas, highDeltas)));
+        }
+
+        alignas(16) uint8_t deltaBytes[16];
+        alignas(16) uint32_t sumLanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(deltaBytes), maximumDeltas);
+        _mm_store_si128(reinterpret_cast<__m128i*>(sumLanes), squaredErrorSums);
+        for (uint8_t delta : deltaBytes)
+        {
+            rowDiff.maximumDelta = std::max(rowDiff.maximumDelta, uint32_t(delta));
+        }
+        rowDiff.squaredErrorSum += uint64_t(sumLanes[0]) + sumLanes[1] + sumLanes[2] + sumLanes[3];
+
+        for (; x < count; ++x)
+        {
+            uint32_t squaredErrorSum;
+            uint32_t const delta = GetChannelDeltas(firstRow[x], secondRow[x], OUT squaredErrorSum);
+            if (delta == 0)
+                continue;
+
+            rowDiff.firstChangedPixel = std::min(rowDiff.firstChangedPixel, offset + x);
+            rowDiff.lastChangedPixel = offset + x + 1;
+            rowDiff.changedPixelCount++;
+            rowDiff.maximumDelta = std::max(rowDiff.maximumDelta, delta);
+            rowDiff.squaredErrorSum += squaredErrorSum;
+        }
+    }
+
+
+    void WriteHeatmapRow(
+        _In_reads_(count) uint32_t const* firstRow,
+        _In_reads_(count) uint32_t const* secondRow,
+        uint32_t count,
+        bool hasChanges,
+        _Out_writes_(count) uint32_t* heatmapRow
+        )
+    {
+        for (uint32_t x = 0; x < count; ++x)
+        {
+            // Fade the first image most of the way to white.
+            uint32_t pixel = ((firstRow[x] >> 2) & 0x003F3F3F) + 0xFFC0C0C0;
+            if (hasChanges)
+            {
+                uint32_t squaredErrorSum;
+                uint32_t const delta = GetChannelDeltas(firstRow[x], secondRow[x], OUT squaredErrorSum);
+                if (delta > 0)
+                {
+                    // Pale red for slight differences, down to pure red for large.
+                    uint32_t const paleness = 0xC0 - std::min(delta * 2, 0xC0u);
+                    pixel = 0xFFFF0000 | (paleness << 8) | paleness;
+                }
+            }
+            heatmapRow[x] = pixel;
+        }
+    }
+}
+
+
+void PixelTile::Resize(uint32_t newWidth, uint32_t newHeight)
+{
+    pixels.resize(size_t(newWidth) * newHeight);
+    width = newWidth;
+    height = newHeight;
+}
+
+
+DrawingCanvas::RawPixels PixelTile::GetRawPixels()
+{
+    return DrawingCanvas::RawPixels{pixels.data(), width, height, 32, width * sizeof(uint32_t)};
+}
+
+
+void ComparePixels(
+    DrawingCanvas::RawPixels const& firstPixels,
+    DrawingCanvas::RawPixels const& secondPixels,
+    _Out_ PixelDiffStatistics& statistics,
+    _In_opt_ DrawingCanvas::RawPixels const* heatmapPixels
+    )
+{
+    statistics = PixelDiffStatistics();
+    if (firstPixels.bitsPerPixel != 32 || secondPixels.bitsPerPixel != 32)
+        return;
+
+    uint32_t const width = std::min(firstPixels.width, secondPixels.width);
+    uint32_t const height = std::min(firstPixels.height, secondPixels.height);
+    statistics.width = width;
+    statistics.height = height;
+    statistics.haveDifferentSizes = (firstPixels.width != secondPixels.width || firstPixels.height != secondPixels.height);
+
+    if (heatmapPixels != nullptr && (heatmapPixels->bitsPerPixel != 32 || heatmapPixels->width < width || heatmapPixels->height < height))
+    {
+        heatmapPixels = nullptr;
+    }
+
+    uint64_t squaredErrorSum = 0;
+    RECT changedBounds = {LONG(width), LONG(height), 0, 0};
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        auto* firstRow = PtrAddByteOffset(reinterpret_cast<uint32_t const*>(firstPixels.pixels), size_t(y) * firstPixels.byteStride);
+        auto* secondRow = PtrAddByteOffset(reinterpret_cast<uint32_t const*>(secondPixels.pixels), size_t(y) * secondPixels.byteStride);
+
+        RowDiff rowDiff;
+        for (uint32_t x = 0; x < width; x += g_pixelSpanLength)
+        {
+            CompareRowSpan(firstRow + x, secondRow + x, x, std::min(width - x, g_pixelSpanLength), IN OUT rowDiff);
+        }
+
+        if (rowDiff.changedPixelCount > 0)
+        {
+            statistics.changedPixelCount += rowDiff.changedPixelCount;
+            statistics.maximumDelta = std::max(statistics.maximumDelta, rowDiff.maximumDelta);
+            squaredErrorSum += rowDiff.squaredErrorSum;
+            changedBounds.left   = std::min(changedBounds.left,   LONG(rowDiff.firstChangedPixel));
+            changedBounds.right  = std::max(changedBounds.right,  LONG(rowDiff.lastChangedPixel));
+            changedBounds.top    = std::min(changedBounds.top,    LONG(y));
+            changedBounds.bottom = LONG(y + 1);
+        }
+
+        if (heatmapPixels != nullptr)
+        {
+            auto* heatmapRow = PtrAddByteOffset(reinterpret_cast<uint32_t*>(heatmapPixels->pixels), size_t(y) * heatmapPixels->byteStride);
+            WriteHeatmapRow(firstRow, secondRow, width, rowDiff.changedPixelCount > 0, OUT heatmapRow);
+        }
+    }
+
+    if (statistics.changedPixelCount > 0)
+    {
+        statistics.changedBounds = changedBounds;
+    }
+
+    size_t const channelCount = size_t(width) * height * 3;
+    statistics.meanSquaredError = (channelCount > 0) ? double(squaredErrorSum) / channelCount : 0.0;
+    statistics.psnr = (squaredErrorSum > 0)
+                    ? 10.0 * log10(255.0 * 255.0 / statistics.meanSquaredError)
+                    : std::numeric_limits<double>::infinity();
+}
+
+
+HRESULT DrawObjectTiles(
+    array_ref<DrawableObjectAndValues const> drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    _Out_ std::vector<PixelTile>& tiles
+    )
+{
+    tiles.clear();
+    tiles.resize(drawableObjects.size());
+
+    // Arranging measures labels with the canvas HDC, so a minimal target is
+    // needed first (as in RenderSettingsFileToImage).
+    IFR(drawingCanvas.CreateRenderTargetsOnDemand(nullptr, {1,1}));
+
+    for (size_t i = 0, objectCount = drawableObjects.size(); i < objectCount; ++i)
+    {
+        // Copy the values, but draw with a fresh object created for this canvas.
+        DrawableObjectAndValues objectAndValues = drawableObjects[i];
+        objectAndValues.Invalidate();
+        objectAndValues.Update();
+        array_ref<DrawableObjectAndValues> singleObject(&objectAndValues, 1);
+        DrawableObjectAndValues::Arrange(singleObject, drawingCanvas);
+
+        D2D_RECT_F const& objectRect = objectAndValues.objectRect_;
+        uint32_t const width  = uint32_t(std::max(ceil(objectRect.right - objectRect.left), 0.0f));
+        uint32_t const height = uint32_t(std::max(ceil(objectRect.bottom - objectRect.top), 0.0f));
+        if (width == 0 || height == 0 || !objectAndValues.IsVisible())
+            continue;
+
+        // Shift the object rectangle to the origin, leaving the label off the tile.
+        DX_MATRIX_3X2F canvasTransform = DrawingCanvas::g_identityMatrix;
+        canvasTransform.dx = -floor(objectRect.left);
+        canvasTransform.dy = -floor(objectRect.top);
+        IFR(drawingCanvas.ResizeRenderTargets({LONG(width), LONG(height)}));
+
+        drawingCanvas.ClearBackground(DrawableObject::defaultCanvasColor);
+        DrawableObjectAndValues::Draw(singleObject, drawingCanvas, canvasTransform);
+        drawingCanvas.SwitchRenderingAPI(DrawingCanvas::CurrentRenderingApiAny);
+        GdiFlush();
+
+        DrawingCanvas::RawPixels canvasPixels = drawingCanvas.GetRawPixels();
+        if (canvasPixels.bitsPerPixel != 32)
+            return E_NOT_VALID_STATE;
+
+        PixelTile& tile = tiles[i];
+        tile.Resize(std::min(width, canvasPixels.width), std::min(height, canvasPixels.height));
+        auto* sourceRow = reinterpret_cast<uint32_t const*>(canvasPixels.pixels);
+        for (uint32_t y = 0; y < tile.height; ++y)
+        {
+            memcpy(&tile.pixels[size_t(y) * tile.width], sourceRow, tile.width * sizeof(uint32_t));
+            sourceRow = PtrAddByteOffset(sourceRow, canvasPixels.byteStride);
+        }
+    }
+
+    drawingCanvas.RetireStaleSharedResources();
+
+    return S_OK;
+}
+
+
+HRESULT CompareDrawableObjects(
+    array_ref<DrawableObjectAndValues const> drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    _Out_ std::vector<PixelDiffStatistics>& statistics,
+    _Out_opt_ std::vector<PixelTile>* heatmaps,
+    uint32_t threadCount
+    )
+{
+    statistics.clear();
+    if (heatmaps != nullptr)
+        heatmaps->clear();
+
+    if (drawableObjects.size() < 2)
+        return S_OK;
+
+    std::vector<PixelTile> tiles;
+    IFR(DrawObjectTiles(drawableObjects, drawingCanvas, OUT tiles));
+
+    statistics.resize(tiles.size() - 1);
+    if (heatmaps != nullptr)
+        heatmaps->resize(tiles.size() - 1);
+
+    // The tiles are independent, so compare them across threads.
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threadCount = std::min(threadCount, uint32_t(tiles.size() - 1));
+
+    std::atomic<uint32_t> nextTileIndex(1);
+    auto compareTiles = [&]()
+    {
+        for (;;)
+        {
+            uint32_t tileIndex = nextTileIndex++;
+            if (tileIndex >= tiles.size())
+                break;
+
+            DrawingCanvas::RawPixels heatmapPixels = {};
+            DrawingCanvas::RawPixels* heatmapPixelsPointer = nullptr;
+            if (heatmaps != nullptr)
+            {
+                PixelTile& heatmap = (*heatmaps)[tileIndex - 1];
+                heatmap.Resize(std::min(tiles[0].width, tiles[tileIndex].width), std::min(tiles[0].height, tiles[tileIndex].height));
+                heatmapPixels = heatmap.GetRawPixels();
+                heatmapPixelsPointer = &heatmapPixels;
+            }
+            ComparePixels(tiles[0].GetRawPixels(), tiles[tileIndex].GetRawPixels(), OUT statistics[tileIndex - 1], heatmapPixelsPointer);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(compareTiles);
+    }
+    compareTiles(); // This thread is worker 0.
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    return S_OK;
+}
+
+
+HRESULT SaveRawPixelsAsPng(
+    IWICImagingFactory* wicFactory,
+    DrawingCanvas::RawPixels const& rawPixels,
+    _In_z_ char16_t const* imageFilePath
+    )
+{
+    if (wicFactory == nullptr || rawPixels.bitsPerPixel != 32)
+        return E_NOT_VALID_STATE;
+
+    ComPtr<IWICStream> stream;
+    IFR(wicFactory->CreateStream(OUT &stream));
+    IFR(stream->InitializeFromFilename(ToWChar(imageFilePath), GENERIC_WRITE));
+    return EncodeRawPixelsAsPngToStream(wicFactory, rawPixels, stream);
+}
+
+
+HRESULT EncodeRawPixelsAsPng(
+    IWICImagingFactory* wicFactory,
+    DrawingCanvas::RawPixels const& rawPixels,
+    _Out_ std::vector<uint8_t>& imageData
+    )
+{
+    imageData.clear();
+    if (wicFactory == nullptr || rawPixels.bitsPerPixel != 32)
+        return E_NOT_VALID_STATE;
+
+    ComPtr<IStream> memoryStream;
+    IFR(CreateStreamOnHGlobal(nullptr, /*fDeleteOnRelease*/true, OUT &memoryStream));
+    IFR(EncodeRawPixelsAsPngToStream(wicFactory, rawPixels, memoryStream));
+
+    // The HGLOBAL may be larger than what was written, so read just the stream size.
+    STATSTG streamStatistics = {};
+    IFR(memoryStream->Stat(OUT &streamStatistics, STATFLAG_NONAME));
+    if (streamStatistics.cbSize.QuadPart > UINT32_MAX)
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+
+    imageData.resize(static_cast<size_t>(streamStatistics.cbSize.QuadPart));
+    ULONG bytesRead = 0;
+    IFR(memoryStream->Seek({}, STREAM_SEEK_SET, nullptr));
+    IFR(memoryStream->Read(imageData.data(), static_cast<ULONG>(imageData.size()), OUT &bytesRead));
+    imageData.resize(bytesRead);
+
+    return S_OK;
+}
+
+HRESULT LoadImageFileIntoPixelTile(
+    IWICImagingFactory* wicFactory,
+    _In_z_ char16_t const* imageFilePath,
+    _Out_ PixelTile& tile
+    )
+{
+    tile.Resize(0, 0);
+    if (wicFactory == nullptr)
+        return E_NOT_VALID_STATE;
+
+    ComPtr<IWICBitmapDecoder> decoder;
+    ComPtr<IWICBitmapFrameDecode> frame;
+    ComPtr<IWICFormatConverter> converter;
+
+    IFR(wicFactory->CreateDecoderFromFilename(ToWChar(imageFilePath), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, OUT &decoder));
+    IFR(decoder->GetFrame(0, OUT &frame));
+    IFR(wicFactory->CreateFormatConverter(OUT &converter));
+    IFR(converter->Initialize(frame, GUID_WICPixelFormat32bppBGR, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom));
+
+    UINT width, height;
+    IFR(converter->GetSize(OUT &width, OUT &height));
+    tile.Resize(width, height);
+    uint32_t const byteStride = width * sizeof(uint32_t);
+    IFR(converter->CopyPixels(nullptr, byteStride, byteStride * height, OUT reinterpret_cast<BYTE*>(tile.pixels.data())));
+
+    return S_OK;
+}
+
+
+void FormatPixelDiffStatistics(PixelDiffStatistics const& statistics, _Out_ std::u16string& text)
+{
+    if (statistics.IsIdentical())
+    {
+        GetFormattedString(OUT text, u"identical (%ux%u)", statistics.width, statistics.height);
+        return;
+    }
+
+    uint64_t const pixelCount = uint64_t(statistics.width) * statistics.height;
+    GetFormattedString(
+        OUT text,
+        u"%llu of %llu pixels changed (%.2f%%), max delta %u, PSNR %.2f dB, bounds (%d,%d)-(%d,%d)",
+        statistics.changedPixelCount,
+        pixelCount,
+        (pixelCount > 0) ? 100.0 * double(statistics.changedPixelCount) / double(pixelCount) : 0.0,
+        statistics.maximumDelta,
+        statistics.psnr,
+        statistics.changedBounds.left,
+        statistics.changedBounds.top,
+        statistics.changedBounds.right,
+        statistics.changedBounds.bottom
+        );
+    if (statistics.haveDifferentSizes)
+    {
+        text += u", sizes differ";
+    }
+}
@@ -0,0 +1,103 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Pixel comparison of drawn objects, for comparing APIs.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import Common.ArrayRef;
+import Common.String;
+import DrawingCanvas;
+import DrawableObjectAndValues;
+#else
+#include "Common.ArrayRef.h"
+#include "Common.String.h"
+#include "DrawingCanvas.h"
+#include "DrawableObjectAndValues.h"
+#endif
+
+
+// Statistics from comparing two images aligned at their top left corners.
+// Only the color channels are compared, since GDI leaves alpha undefined.
+struct PixelDiffStatistics
+{
+    uint32_t width = 0;             // Compared area, which is the overlap of both images.
+    uint32_t height = 0;
+    bool haveDifferentSizes = false;
+    uint64_t changedPixelCount = 0; // Pixels with any color channel different.
+    uint32_t maximumDelta = 0;      // Largest difference of any one channel, 0-255.
+    double meanSquaredError = 0;    // Per channel.
+    double psnr = 0;                // Peak signal to noise ratio in decibels, infinite if identical.
+    RECT changedBounds = {};        // Bounding box of the changed pixels, empty if none.
+
+    bool IsIdentical() const noexcept { return changedPixelCount == 0 && !haveDifferentSizes; }
+};
+
+// Image owned in memory, such as an object drawn alone.
+struct PixelTile
+{
+    std::vector<uint32_t> pixels;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    void Resize(uint32_t newWidth, uint32_t newHeight);
+    DrawingCanvas::RawPixels GetRawPixels();
+};
+
+// Compare the two 32-bit images over their overlap. If a heatmap is given,
+// which must be at least the overlap size, unchanged pixels are written as a
+// faded copy of the first image and changed ones in red, deeper with larger
+// differences.
+void ComparePixels(
+    DrawingCanvas::RawPixels const& firstPixels,
+    DrawingCanvas::RawPixels const& secondPixels,
+    _Out_ PixelDiffStatistics& statistics,
+    _In_opt_ DrawingCanvas::RawPixels const* heatmapPixels = nullptr
+    );
+
+// Draw each object alone into its own tile, with the object rectangle's top
+// left at the tile origin so that tiles of objects with identical output
+// match pixel for pixel. Labels are excluded. The canvas is resized as needed
+// and may be reused, but the objects are copied so theirs are left untouched.
+HRESULT DrawObjectTiles(
+    array_ref<DrawableObjectAndValues const> drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    _Out_ std::vector<PixelTile>& tiles
+    );
+
+// Draw the objects into tiles and compare each later object against the
+// first, returning one statistics entry per later object (and optionally one
+// heatmap each). Drawing is serial on the canvas, while the comparisons run
+// across the given number of threads (1 when the caller is already a worker).
+HRESULT CompareDrawableObjects(
+    array_ref<DrawableObjectAndValues const> drawableObjects,
+    DrawingCanvas& drawingCanvas,
+    _Out_ std::vector<PixelDiffStatistics>& statistics,
+    _Out_opt_ std::vector<PixelTile>* heatmaps = nullptr,
+    uint32_t threadCount = 0 // 0 for the number of cores.
+    );
+
+// Write 32-bit pixels as a PNG, ignoring alpha.
+HRESULT SaveRawPixelsAsPng(
+    IWICImagingFactory* wicFactory,
+    DrawingCanvas::RawPixels const& rawPixels,
+    _In_z_ char16_t const* imageFilePath
+    );
+
+// Encode 32-bit pixels as PNG file data in memory, ignoring alpha.
+HRESULT EncodeRawPixelsAsPng(
+    IWICImagingFactory* wicFactory,
+    DrawingCanvas::RawPixels const& rawPixels,
+    _Out_ std::vector<uint8_t>& imageData
+    );
+
+// Decode any WIC supported image, such as one saved by SaveRawPixelsAsPng.
+HRESULT LoadImageFileIntoPixelTile(
+    IWICImagingFactory* wicFactory,
+    _In_z_ char16_t const* imageFilePath,
+    _Out_ PixelTile& tile
+    );
+
+// Describe the statistics in one line for the log or console.
+void FormatPixelDiffStatistics(PixelDiffStatistics const& statistics, _Out_ std::u16string& text);
@@ -0,0 +1,468 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Reference scanline rasterizer for glyph outlines, as a
+//                  reproducible baseline to compare the DWrite, D2D, and GDI
+//                  rasterizers' antialiasing and throughput against.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+
+#include <intrin.h>
+#include <emmintrin.h>
+
+MODULE(PolygonRasterizer)
+EXPORT_BEGIN
+    #include "PolygonRasterizer.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    // Flattened curves stay within this distance of the true curve, in pixels.
+    float const g_bezierTolerance = 1.0f / 16;
+    uint32_t const g_maximumBezierSegments = 256;
+
+    // Keeps fixed point coordinates and their differences within 32 bits.
+    float const g_maximumCoordinate = float(1 << 20);
+
+    inline D2D_POINT_2F TransformPoint(DX_MATRIX_3X2F const& transform, D2D_POINT_2F point) noexcept
+    {
+        return {
+            point.x * transform.xx + point.y * transform.yx + transform.dx,
+            point.x * transform.xy + point.y * transform.yy + transform.dy
+        };
+    }
+
+    inline int32_t RoundToInt(float value) noexcept
+    {
+        return int32_t(floorf(value + 0.5f));
+    }
+
+    // Distribute the signed area of one edge's span across a row. The span
+    // runs from xa to xb within the row (either way), and the area is its
+    // height times the edge direction. Each cell receives the change in
+    // coverage from the previous cell, so the last cell takes whatever the
+    // rounding of the others left over, and the row always sums to the
+    // exact area.
+    void DepositArea(_Inout_ int32_t* cells, float xa, float xb, int32_t area) noexcept
+    {
+        float const xLeft = std::min(xa, xb);
+        float const xRight = std::max(xa, xb);
+        int32_t const cellLeft = int32_t(xLeft); // Always non-negative, so this is the floor.
+        int32_t deposited = 0;
+
+        auto deposit = [&](int32_t cellIndex, float fraction)
+        {
+            int32_t const cellArea = RoundToInt(float(area) * fraction);
+            cells[cellIndex] += cellArea;
+            deposited += cellArea;
+        };
+
+        if (xRight <= float(cellLeft + 1))
+        {
+            // Within a single pixel, the area splits by the span's midpoint.
+            float const middle = (xLeft + xRight) * 0.5f - float(cellLeft);
+            deposit(cellLeft, 1 - middle);
+            cells[cellLeft + 1] += area - deposited;
+            return;
+        }
+
+        // Across several pixels, the first and last pixels hold triangles,
+        // and those between grow linearly.
+        int32_t const cellRight = int32_t(ceilf(xRight));
+        float const inverseWidth = 1 / (xRight - xLeft);
+        float const leftFraction = xLeft - float(cellLeft);
+        float const rightFraction = xRight - float(cellRight) + 1;
+        float const leftArea = 0.5f * inverseWidth * (1 - leftFraction) * (1 - leftFraction);
+        float const rightArea = 0.5f * inverseWidth * rightFraction * rightFraction;
+
+        deposit(cellLeft, leftArea);
+        if (cellRight == cellLeft + 2)
+        {
+            deposit(cellLeft + 1, 1 - leftArea - rightArea);
+        }
+        else
+        {
+            float const secondArea = inverseWidth * (1.5f - leftFraction);
+            deposit(cellLeft + 1, secondArea - leftArea);
+            for (int32_t cellIndex = cellLeft + 2; cellIndex < cellRight - 1; ++cellIndex)
+            {
+                deposit(cellIndex, inverseWidth);
+            }
+            float const lastArea = secondArea + float(cellRight - cellLeft - 3) * inverseWidth;
+            deposit(cellRight - 1, 1 - lastArea - rightArea);
+        }
+        cells[cellRight] += area - deposited;
+    }
+
+    // Convert the accumulated winding area to 8-bit coverage.
+    inline uint32_t GetCoverage(int32_t accumulatedArea, bool isAlternate) noexcept
+    {
+        int32_t coverage;
+        if (isAlternate)
+        {
+            // Fold the winding count modulo two, rising from 0 to 1 and falling back.
+            coverage = accumulatedArea & (PolygonRasterizer::coverageOne * 2 - 1);
+            coverage = std::min(coverage, PolygonRasterizer::coverageOne * 2 - coverage);
+        }
+        else
+        {
+            coverage = std::min(abs(accumulatedArea), PolygonRasterizer::coverageOne);
+        }
+        uint32_t const alpha = uint32_t(coverage * 255 + PolygonRasterizer::coverageOne / 2) >> PolygonRasterizer::coverageShift;
+        return alpha | (alpha << 8) | (alpha << 16);
+    }
+
+    inline __m128i MinEpi32(__m128i a, __m128i b) noexcept
+    {
+        // SSE2 lacks _mm_min_epi32.
+        __m128i const isGreater = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(isGreater, b), _mm_andnot_si128(isGreater, a));
+    }
+}
+
+
+// Forwards a glyph run's outline into the rasterizer, offset to the baseline
+// origin. It lives on the stack for the duration of GetGlyphRunOutline, so
+// the reference count is unused.
+class PolygonRasterizerGeometrySink : public ID2D1SimplifiedGeometrySink
+{
+public:
+    PolygonRasterizerGeometrySink(PolygonRasterizer& rasterizer, float originX, float originY) noexcept
+    :   rasterizer_(rasterizer),
+        originX_(originX),
+        originY_(originY)
+    { }
+
+    IFACEMETHODIMP QueryInterface(IID const& iid, __out void** object) override
+    {
+        COM_BASE_RETURN_INTERFACE(iid, ID2D1SimplifiedGeometrySink, object);
+        COM_BASE_RETURN_INTERFACE(iid, IUnknown, object);
+        COM_BASE_RETURN_NO_INTERFACE(object);
+    }
+
+    IFACEMETHODIMP_(ULONG) AddRef() override
+    {
+        return 1;
+    }
+
+    IFACEMETHODIMP_(ULONG) Release() override
+    {
+        return 1;
+    }
+
+    IFACEMETHODIMP_(void) SetFillMode(D2D1_FILL_MODE fillMode) override
+    {
+        rasterizer_.SetFillMode(fillMode);
+    }
+
+    IFACEMETHODIMP_(void) SetSegmentFlags(D2D1_PATH_SEGMENT vertexFlags) override
+    { }
+
+    IFACEMETHODIMP_(void) BeginFigure(D2D1_POINT_2F startPoint, D2D1_FIGURE_BEGIN figureBegin) override
+    {
+        rasterizer_.BeginFigure(Offset(startPoint));
+    }
+
+    IFACEMETHODIMP_(void) AddLines(_In_reads_(pointsCount) D2D1_POINT_2F const* points, UINT32 pointsCount) override
+    {
+        for (uint32_t i = 0; i < pointsCount; ++i)
+        {
+            rasterizer_.AddLine(Offset(points[i]));
+        }
+    }
+
+    IFACEMETHODIMP_(void) AddBeziers(_In_reads_(beziersCount) D2D1_BEZIER_SEGMENT const* beziers, UINT32 beziersCount) override
+    {
+        for (uint32_t i = 0; i < beziersCount; ++i)
+        {
+            rasterizer_.AddBezier(Offset(beziers[i].point1), Offset(beziers[i].point2), Offset(beziers[i].point3));
+        }
+    }
+
+    IFACEMETHODIMP_(void) EndFigure(D2D1_FIGURE_END figureEnd) override
+    {
+        rasterizer_.EndFigure();
+    }
+
+    IFACEMETHODIMP Close() override
+    {
+        return S_OK;
+    }
+
+protected:
+    D2D_POINT_2F Offset(D2D_POINT_2F point) const noexcept
+    {
+        return { point.x + originX_, point.y + originY_ };
+    }
+
+    PolygonRasterizer& rasterizer_;
+    float originX_;
+    float originY_;
+};
+
+
+void PolygonRasterizer::Reset(RECT const& clipRect)
+{
+    edges_.clear();
+    clipRect_ = clipRect;
+    edgeBounds_ = {};
+    isInFigure_ = false;
+}
+
+
+PolygonRasterizer::PointI PolygonRasterizer::SnapPoint(D2D_POINT_2F point) const noexcept
+{
+    float const x = std::min(std::max(point.x, -g_maximumCoordinate), g_maximumCoordinate);
+    float const y = std::min(std::max(point.y, -g_maximumCoordinate), g_maximumCoordinate);
+    return { RoundToInt(x * subpixelOne), RoundToInt(y * subpixelOne) };
+}
+
+
+void PolygonRasterizer::AddEdge(PointI point)
+{
+    // Horizontal edges cover no area.
+    if (point.y != figureEnd_.y)
+    {
+        if (edges_.empty())
+        {
+            edgeBounds_ = { figureEnd_.x, figureEnd_.y, figureEnd_.x, figureEnd_.y };
+        }
+        edgeBounds_.left   = std::min(edgeBounds_.left,   LONG(std::min(point.x, figureEnd_.x)));
+        edgeBounds_.top    = std::min(edgeBounds_.top,    LONG(std::min(point.y, figureEnd_.y)));
+        edgeBounds_.right  = std::max(edgeBounds_.right,  LONG(std::max(point.x, figureEnd_.x)));
+        edgeBounds_.bottom = std::max(edgeBounds_.bottom, LONG(std::max(point.y, figureEnd_.y)));
+        edges_.push_back({ figureEnd_.x, figureEnd_.y, point.x, point.y });
+    }
+    figureEnd_ = point;
+}
+
+
+void PolygonRasterizer::BeginFigure(D2D_POINT_2F point)
+{
+    EndFigure();
+    currentPoint_ = TransformPoint(transform_, point);
+    figureStart_ = SnapPoint(currentPoint_);
+    figureEnd_ = figureStart_;
+    isInFigure_ = true;
+}
+
+
+void PolygonRasterizer::AddLine(D2D_POINT_2F point)
+{
+    if (!isInFigure_)
+        return BeginFigure(point);
+
+    currentPoint_ = TransformPoint(transform_, point);
+    AddEdge(SnapPoint(currentPoint_));
+}
+
+
+void PolygonRasterizer::AddBezier(D2D_POINT_2F point1, D2D_POINT_2F point2, D2D_POINT_2F point3)
+{
+    if (!isInFigure_)
+        return BeginFigure(point3);
+
+    // Flatten in device space, since Beziers are affine invariant. A chord of
+    // each of n segments deviates from the curve by at most 3/4 * d / n^2,
+    // where d is the largest second difference of the control points.
+    D2D_POINT_2F const p0 = currentPoint_;
+    D2D_POINT_2F const p1 = TransformPoint(transform_, point1);
+    D2D_POINT_2F const p2 = TransformPoint(transform_, point2);
+    D2D_POINT_2F const p3 = TransformPoint(transform_, point3);
+
+    float const ddx1 = p0.x - 2 * p1.x + p2.x, ddy1 = p0.y - 2 * p1.y + p2.y;
+    float const ddx2 = p1.x - 2 * p2.x + p3.x, ddy2 = p1.y - 2 * p2.y + p3.y;
+    float const dd = sqrtf(std::max(ddx1 * ddx1 + ddy1 * ddy1, ddx2 * ddx2 + ddy2 * ddy2));
+    float const segmentsNeeded = ceilf(sqrtf(0.75f * dd / g_bezierTolerance));
+    uint32_t const segmentCount = (segmentsNeeded >= g_maximumBezierSegments) ? g_maximumBezierSegments : std::max(uint32_t(segmentsNeeded), 1u);
+
+    for (uint32_t i = 1; i < segmentCount; ++i)
+    {
+        float const t = float(i) / segmentCount;
+        float const s = 1 - t;
+        float const a = s * s * s, b = 3 * s * s * t, c = 3 * s * t * t, d = t * t * t;
+        D2D_POINT_2F const point = {
+            a * p0.x + b * p1.x + c * p2.x + d * p3.x,
+            a * p0.y + b * p1.y + c * p2.y + d * p3.y
+        };
+        AddEdge(SnapPoint(point));
+    }
+    currentPoint_ = p3;
+    AddEdge(SnapPoint(p3));
+}
+
+
+void PolygonRasterizer::EndFigure()
+{
+    if (!isInFigure_)
+        return;
+
+    AddEdge(figureStart_);
+    isInFigure_ = false;
+}
+
+
+HRESULT PolygonRasterizer::AddGlyphRun(
+    float baselineOriginX,
+    float baselineOriginY,
+    DWRITE_GLYPH_RUN const& glyphRun
+    )
+{
+    if (glyphRun.fontFace == nullptr)
+        return E_INVALIDARG;
+
+    if (glyphRun.glyphCount == 0)
+        return S_OK;
+
+    PolygonRasterizerGeometrySink geometrySink(*this, baselineOriginX, baselineOriginY);
+    HRESULT hr = glyphRun.fontFace->GetGlyphRunOutline(
+        glyphRun.fontEmSize,
+        glyphRun.glyphIndices,
+        glyphRun.glyphAdvances,
+        glyphRun.glyphOffsets,
+        glyphRun.glyphCount,
+        glyphRun.isSideways,
+        (glyphRun.bidiLevel & 1) != 0,
+        &geometrySink
+        );
+    EndFigure();
+
+    return hr;
+}
+
+
+void PolygonRasterizer::AccumulateEdge(Edge const& edge, int32_t* accumulation, int32_t width, int32_t height) const
+{
+    // Walk the edge downward, with its original direction as the area's sign.
+    int32_t x0 = edge.x0, y0 = edge.y0, x1 = edge.x1, y1 = edge.y1;
+    int32_t direction = 1;
+    if (y0 > y1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        direction = -1;
+    }
+
+    int32_t const rowBegin = std::max(y0 >> subpixelShift, 0);
+    int32_t const rowEnd = std::min((y1 + subpixelOne - 1) >> subpixelShift, height);
+    double const inverseSlope = double(x1 - x0) / double(y1 - y0);
+    float const maximumX = float(width);
+    size_t const stride = size_t(width) + 2;
+
+    for (int32_t row = rowBegin; row < rowEnd; ++row)
+    {
+        int32_t const ya = std::max(y0, row << subpixelShift);
+        int32_t const yb = std::min(y1, (row + 1) << subpixelShift);
+        if (ya >= yb)
+            continue;
+
+        // Exact, since both ends lie on the subpixel grid.
+        int32_t const area = direction * ((yb - ya) << (coverageShift - subpixelShift));
+
+        // Left of the clip, the edge still covers every pixel to its right,
+        // as if it ran along the left side. Right of it, the area lands in
+        // the extra cells past the row's end, which are never resolved.
+        float xa = float((x0 + (ya - y0) * inverseSlope) / subpixelOne);
+        float xb = float((x0 + (yb - y0) * inverseSlope) / subpixelOne);
+        xa = std::min(std::max(xa, 0.0f), maximumX);
+        xb = std::min(std::max(xb, 0.0f), maximumX);
+
+        DepositArea(accumulation + row * stride, xa, xb, area);
+    }
+}
+
+
+void PolygonRasterizer::ResolveRow(int32_t const* accumulation, uint32_t width, _Out_writes_(width) uint32_t* coverage) const
+{
+    bool const isAlternate = (fillMode_ == D2D1_FILL_MODE_ALTERNATE);
+    __m128i const one = _mm_set1_epi32(coverageOne);
+    __m128i const two = _mm_set1_epi32(coverageOne * 2);
+    __m128i const twoMask = _mm_set1_epi32(coverageOne * 2 - 1);
+    __m128i const half = _mm_set1_epi32(coverageOne / 2);
+    __m128i total = _mm_setzero_si128(); // Running sum in every lane.
+
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        // Prefix sum of the four cells, plus the sum of all before them.
+        __m128i areas = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&accumulation[x]));
+        areas = _mm_add_epi32(areas, _mm_slli_si128(areas, 4));
+        areas = _mm_add_epi32(areas, _mm_slli_si128(areas, 8));
+        areas = _mm_add_epi32(areas, total);
+        total = _mm_shuffle_epi32(areas, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m128i alphas;
+        if (isAlternate)
+        {
+            alphas = _mm_and_si128(areas, twoMask);
+            alphas = MinEpi32(alphas, _mm_sub_epi32(two, alphas));
+        }
+        else
+        {
+            __m128i const sign = _mm_srai_epi32(areas, 31);
+            alphas = _mm_sub_epi32(_mm_xor_si128(areas, sign), sign);
+            alphas = MinEpi32(alphas, one);
+        }
+
+        // (alpha * 255 + half) >> 16, without SSE4's 32-bit multiply.
+        alphas = _mm_sub_epi32(_mm_slli_epi32(alphas, 8), alphas);
+        alphas = _mm_srli_epi32(_mm_add_epi32(alphas, half), coverageShift);
+        alphas = _mm_or_si128(alphas, _mm_or_si128(_mm_slli_epi32(alphas, 8), _mm_slli_epi32(alphas, 16)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&coverage[x]), alphas);
+    }
+
+    int32_t accumulatedArea = _mm_cvtsi128_si32(total);
+    for (; x < width; ++x)
+    {
+        accumulatedArea += accumulation[x];
+        coverage[x] = GetCoverage(accumulatedArea, isAlternate);
+    }
+}
+
+
+void PolygonRasterizer::Rasterize(
+    _Out_ RECT& bounds,
+    _Out_ std::vector<uint32_t>& coverage
+    )
+{
+    EndFigure();
+    bounds = {};
+    coverage.clear();
+
+    if (edges_.empty())
+        return;
+
+    // Only pixels any edge touches can have coverage. Edges left of the clip
+    // still contribute, but those above, below, or right of it do not.
+    RECT pixelBounds = {
+        std::max(LONG(edgeBounds_.left >> subpixelShift), clipRect_.left),
+        std::max(LONG(edgeBounds_.top >> subpixelShift), clipRect_.top),
+        std::min(LONG((edgeBounds_.right + subpixelOne - 1) >> subpixelShift), clipRect_.right),
+        std::min(LONG((edgeBounds_.bottom + subpixelOne - 1) >> subpixelShift), clipRect_.bottom),
+    };
+    if (pixelBounds.right <= pixelBounds.left || pixelBounds.bottom <= pixelBounds.top)
+        return;
+
+    int32_t const width = pixelBounds.right - pixelBounds.left;
+    int32_t const height = pixelBounds.bottom - pixelBounds.top;
+    size_t const stride = size_t(width) + 2; // Spans ending on the right edge deposit one and two cells past it.
+
+    accumulation_.assign(stride * height, 0);
+    coverage.resize(size_t(width) * height);
+
+    int32_t const originX = pixelBounds.left << subpixelShift;
+    int32_t const originY = pixelBounds.top << subpixelShift;
+    for (auto const& edge : edges_)
+    {
+        Edge const relativeEdge = { edge.x0 - originX, edge.y0 - originY, edge.x1 - originX, edge.y1 - originY };
+        AccumulateEdge(relativeEdge, accumulation_.data(), width, height);
+    }
+
+    for (int32_t row = 0; row < height; ++row)
+    {
+        ResolveRow(&accumulation_[row * stride], uint32_t(width), &coverage[row * size_t(width)]);
+    }
+
+    bounds = pixelBounds;
+}
@@ -1,18 +1,174 @@
 ﻿//----------------------------------------------------------------------------
 //  Author:     Dwayne Robinson
 //  History:    2016-10-26 Created
+//              2026-10-14 Batches of files, wildcards, folders, and file lists
 //----------------------------------------------------------------------------
 
 #include <Windows.h>
+#include <shellapi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
 
 #pragma comment(linker, "/SUBSYSTEM:WINDOWS")
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #pragma comment(lib, "Gdi32.lib")
+#pragma comment(lib, "Shell32.lib")
+#pragma comment(lib, "User32.lib")
 
 
 ////////////////////////////////////////
 
 
+wchar_t const* g_usageText =
+    L"Usage:\r\n\r\n"
+    L"RemoveFontResource.exe [/add] [/quiet] PathAndFileName.ttf | Folder | *.otf | @FileList.txt ...\r\n\r\n"
+    L"Removes (or with /add, adds) each font file. Folders include their subfolders,\r\n"
+    L"and file lists name one path per line. WM_FONTCHANGE is broadcast once at the end.\r\n"
+    L"/quiet shows no dialogs, only writing to the console if started from one.";
+
+bool g_isQuiet = false;
+bool g_hasConsole = false;
+
+
+void WriteConsoleLine(wchar_t const* text)
+{
+    if (!g_hasConsole)
+        return;
+
+    HANDLE consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD charsWritten;
+    WriteConsoleW(consoleHandle, text, static_cast<DWORD>(wcslen(text)), &charsWritten, nullptr);
+    WriteConsoleW(consoleHandle, L"\r\n", 2, &charsWritten, nullptr);
+}
+
+
+bool IsFontFileName(wchar_t const* fileName)
+{
+    wchar_t const* extension = wcsrchr(fileName, '.');
+    if (extension == nullptr)
+        return false;
+
+    wchar_t const* fontExtensions[] = {L".ttf", L".otf", L".ttc", L".otc", L".tte", L".fon", L".fnt", L".fot"};
+    for (auto* fontExtension : fontExtensions)
+    {
+        if (_wcsicmp(extension, fontExtension) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+// Append every font file in the folder and its subfolders.
+void AddFolderFileNames(std::wstring const& folderPath, std::vector<std::wstring>& fileNames)
+{
+    std::wstring mask = folderPath + L"\\*";
+    WIN32_FIND_DATAW findData;
+    HANDLE findHandle = FindFirstFileW(mask.c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0)
+            continue;
+
+        std::wstring path = folderPath + L"\\" + findData.cFileName;
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            AddFolderFileNames(path, fileNames);
+        else if (IsFontFileName(findData.cFileName))
+            fileNames.push_back(std::move(path));
+    } while (FindNextFileW(findHandle, &findData));
+
+    FindClose(findHandle);
+}
+
+
+// Append the files matching a path, which may be a folder or contain wildcards.
+void AddMatchingFileNames(std::wstring path, std::vector<std::wstring>& fileNames)
+{
+    while (!path.empty() && (path.back() == '\\' || path.back() == '/'))
+        path.pop_back();
+    if (path.empty())
+        return;
+
+    DWORD fileAttributes = GetFileAttributesW(path.c_str());
+    if (fileAttributes != INVALID_FILE_ATTRIBUTES && (fileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        AddFolderFileNames(path, fileNames);
+        return;
+    }
+    if (path.find_first_of(L"*?") == std::wstring::npos)
+    {
+        fileNames.push_back(path); // Even if missing, a font may still be loaded under the old name.
+        return;
+    }
+
+    size_t const fileNameStart = path.find_last_of(L"\\/:") + 1; // npos + 1 = 0
+    WIN32_FIND_DATAW findData;
+    HANDLE findHandle = FindFirstFileW(path.c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            fileNames.push_back(path.substr(0, fileNameStart) + findData.cFileName);
+    } while (FindNextFileW(findHandle, &findData));
+
+    FindClose(findHandle);
+}
+
+
+// Read a list of paths, one per line, as UTF-16 with a byte order mark or
+// else UTF-8. Each line may itself be a folder or wildcard.
+bool AddListedFileNames(wchar_t const* listFileName, std::vector<std::wstring>& fileNames)
+{
+    HANDLE fileHandle = CreateFileW(listFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    std::string bytes(GetFileSize(fileHandle, nullptr), '\0');
+    DWORD bytesRead = 0;
+    bool const isRead = bytes.empty() || ReadFile(fileHandle, &bytes[0], static_cast<DWORD>(bytes.size()), &bytesRead, nullptr);
+    CloseHandle(fileHandle);
+    if (!isRead)
+        return false;
+    bytes.resize(bytesRead);
+
+    std::wstring text;
+    if (bytes.size() >= 2 && uint8_t(bytes[0]) == 0xFF && uint8_t(bytes[1]) == 0xFE)
+    {
+        text.assign(reinterpret_cast<wchar_t const*>(bytes.data() + 2), (bytes.size() - 2) / sizeof(wchar_t));
+    }
+    else
+    {
+        size_t const bomSize = (bytes.compare(0, 3, "\xEF\xBB\xBF") == 0) ? 3 : 0;
+        int const utf8Size = int(bytes.size() - bomSize);
+        text.resize(MultiByteToWideChar(CP_UTF8, 0, bytes.data() + bomSize, utf8Size, nullptr, 0));
+        if (!text.empty())
+            MultiByteToWideChar(CP_UTF8, 0, bytes.data() + bomSize, utf8Size, &text[0], int(text.size()));
+    }
+
+    for (size_t lineStart = 0; lineStart < text.size();)
+    {
+        size_t lineEnd = text.find_first_of(L"\r\n", lineStart);
+        if (lineEnd == std::wstring::npos)
+            lineEnd = text.size();
+
+        std::wstring line = text.substr(lineStart, lineEnd - lineStart);
+        line.erase(0, line.find_first_not_of(L" \t\""));
+        line.erase(line.find_last_not_of(L" \t\"") + 1);
+        if (!line.empty() && line[0] != ';')
+            AddMatchingFileNames(line, fileNames);
+
+        lineStart = lineEnd + 1;
+    }
+    return true;
+}
+
+
 int APIENTRY wWinMain(
     __in HINSTANCE      hInstance, 
     __in_opt HINSTANCE  hPrevInstance,
@@ -20,14 +176,115 @@ int APIENTRY wWinMain(
     __in int            nCmdShow
     )
 {
+    g_hasConsole = AttachConsole(ATTACH_PARENT_PROCESS) != FALSE;
+
     auto commandLineLength = wcslen(commandLine);
     if (commandLineLength == 0 || (commandLineLength == 1 && commandLine[0] == ' '))
     {
-        MessageBox(nullptr, L"Usage:\r\n\r\n" L"RemoveFontResource.exe PathAndFileName.ttf", L"RemoveFontResource", MB_OK);
+        MessageBox(nullptr, g_usageText, L"RemoveFontResource", MB_OK);
         return (int)-1;
     }
 
-    RemoveFontResource(commandLine);
-    MessageBox(nullptr, commandLine, L"Called RemoveFontResource", MB_OK);
-    return 0;
+    ////////////////////
+    // Gather every file first, so the fonts can all change before one broadcast.
+
+    bool shouldAdd = false;
+    std::vector<std::wstring> fileNames;
+
+    // An unquoted path with spaces still works as the whole command line, like before.
+    DWORD const commandLineAttributes = GetFileAttributesW(commandLine);
+    if (commandLineAttributes != INVALID_FILE_ATTRIBUTES && !(commandLineAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        fileNames.push_back(commandLine);
+    }
+    else
+    {
+        int argumentCount = 0;
+        wchar_t** arguments = CommandLineToArgvW(commandLine, &argumentCount);
+        if (arguments == nullptr)
+            return (int)-1;
+
+        for (int i = 0; i < argumentCount; ++i)
+        {
+            wchar_t const* argument = arguments[i];
+            if (_wcsicmp(argument, L"/add") == 0)
+            {
+                shouldAdd = true;
+            }
+            else if (_wcsicmp(argument, L"/quiet") == 0)
+            {
+                g_isQuiet = true;
+            }
+            else if (argument[0] == '/')
+            {
+                WriteConsoleLine(g_usageText);
+                if (!g_isQuiet)
+                    MessageBox(nullptr, g_usageText, L"RemoveFontResource", MB_OK);
+                LocalFree(arguments);
+                return (int)-1;
+            }
+            else if (argument[0] == '@')
+            {
+                if (!AddListedFileNames(argument + 1, fileNames))
+                {
+                    std::wstring message = std::wstring(L"Could not read file list: ") + (argument + 1);
+                    WriteConsoleLine(message.c_str());
+                }
+            }
+            else
+            {
+                AddMatchingFileNames(argument, fileNames);
+            }
+        }
+        LocalFree(arguments);
+    }
+
+    ////////////////////
+    // Add or remove each font, without broadcasting per font.
+
+    uint32_t changedCount = 0;
+    uint32_t failedCount = 0;
+    for (auto const& fileName : fileNames)
+    {
+        bool succeeded;
+        if (shouldAdd)
+        {
+            succeeded = AddFontResourceExW(fileName.c_str(), 0, nullptr) > 0;
+        }
+        else
+        {
+            // Each add counts separately, so remove until none remain
+            // (bounded, in case the removal never reports failure).
+            uint32_t removalCount = 0;
+            while (removalCount < 256 && RemoveFontResourceExW(fileName.c_str(), 0, nullptr))
+            {
+                ++removalCount;
+            }
+            succeeded = removalCount > 0;
+        }
+
+        if (succeeded)
+            ++changedCount;
+        else
+            ++failedCount;
+
+        std::wstring message = std::wstring(succeeded ? L"" : L"Failed: ") + fileName;
+        WriteConsoleLine(message.c_str());
+    }
+
+    if (changedCount > 0)
+    {
+        // Hung top level windows would otherwise stall the broadcast.
+        SendMessageTimeoutW(HWND_BROADCAST, WM_FONTCHANGE, 0, 0, SMTO_ABORTIFHUNG, 1000, nullptr);
+    }
+
+    wchar_t summary[200];
+    swprintf_s(summary, L"%s %u font files, %u failed.", shouldAdd ? L"Added" : L"Removed", changedCount, failedCount);
+    WriteConsoleLine(summary);
+    if (!g_isQuiet)
+    {
+        MessageBox(nullptr, summary, shouldAdd ? L"Called AddFontResourceEx" : L"Called RemoveFontResourceEx", MB_OK);
+    }
+
+    return int(failedCount);
 }
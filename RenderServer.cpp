@@ -0,0 +1,418 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Long-lived render server answering settings documents
+//                  sent over a named pipe with images, bounds, and timings.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "HeadlessRenderer.h"
+#include "PixelDiff.h"
+#include "TextTreeParser.h"
+#include "Tracing.h"
+
+#pragma comment(lib, "Shell32.lib")
+
+
+MODULE(RenderServer)
+EXPORT_BEGIN
+    #include "RenderServer.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    char16_t const* g_defaultRenderServerPipeName = u"\\\\.\\pipe\\TextLayoutSampler";
+    DWORD const g_pipeBufferSize = 1 << 16;
+
+    // Retiring the canvas shared resources after every request would release
+    // the fonts of any test not immediately repeated, so only age them after
+    // this many requests on the worker.
+    uint32_t const g_requestsPerSharedResourceRetirement = 64;
+
+
+    HRESULT WriteNumberKey(JsonexWriter& writer, _In_z_ char16_t const* key, double value)
+    {
+        wchar_t buffer[32];
+        swprintf_s(buffer, L"%.3f", value);
+        IFR(writer.BeginKey(key));
+        IFR(writer.WriteValueNumber(ToChar16(buffer)));
+        return writer.EndScope();
+    }
+
+
+    HRESULT WriteIntegerKey(JsonexWriter& writer, _In_z_ char16_t const* key, int64_t value)
+    {
+        wchar_t buffer[24];
+        swprintf_s(buffer, L"%lld", value);
+        IFR(writer.BeginKey(key));
+        IFR(writer.WriteValueNumber(ToChar16(buffer)));
+        return writer.EndScope();
+    }
+
+
+    // As hex text, the way HRESULTs are usually read and searched for.
+    HRESULT WriteHresultKey(JsonexWriter& writer, _In_z_ char16_t const* key, HRESULT value)
+    {
+        wchar_t buffer[12];
+        swprintf_s(buffer, L"0x%08X", static_cast<uint32_t>(value));
+        IFR(writer.BeginKey(key));
+        IFR(writer.WriteValueString(ToChar16(buffer)));
+        return writer.EndScope();
+    }
+
+
+    HRESULT WriteRectKey(JsonexWriter& writer, _In_z_ char16_t const* key, D2D_RECT_F const& rect)
+    {
+        wchar_t buffer[32];
+        IFR(writer.BeginArray(key));
+        for (float value : {rect.left, rect.top, rect.right, rect.bottom})
+        {
+            swprintf_s(buffer, L"%g", value);
+            IFR(writer.WriteValueNumber(ToChar16(buffer)));
+        }
+        return writer.EndScope();
+    }
+
+
+    HRESULT WriteTimingKey(JsonexWriter& writer, _In_z_ char16_t const* key, DrawableObjectAndValues::Timing const& timing)
+    {
+        IFR(writer.BeginObject(key));
+        IFR(WriteNumberKey(writer, u"total", PerformanceCounterToMilliseconds(timing.totalTicks)));
+        IFR(WriteNumberKey(writer, u"cachedResources", PerformanceCounterToMilliseconds(timing.cachedResourceTicks)));
+        return writer.EndScope();
+    }
+
+
+    struct RenderRequestTimings
+    {
+        int64_t loadTicks = 0;
+        int64_t drawTicks = 0;
+        int64_t encodeTicks = 0;
+    };
+
+
+    HRESULT FormatRenderMetrics(
+        HRESULT renderHr,
+        SIZE imageSize,
+        RenderRequestTimings const& timings,
+        array_ref<DrawableObjectAndValues const> drawableObjects,
+        _Out_ std::string& metricsText
+        )
+    {
+        metricsText.clear();
+        JsonexWriter writer(JsonexWriter::OptionsDefault);
+
+        IFR(writer.BeginObject());
+        IFR(WriteHresultKey(writer, u"hresult", renderHr));
+        IFR(WriteIntegerKey(writer, u"width", imageSize.cx));
+        IFR(WriteIntegerKey(writer, u"height", imageSize.cy));
+        IFR(writer.BeginObject(u"timings"));
+        IFR(WriteNumberKey(writer, u"load", PerformanceCounterToMilliseconds(timings.loadTicks)));
+        IFR(WriteNumberKey(writer, u"draw", PerformanceCounterToMilliseconds(timings.drawTicks)));
+        IFR(WriteNumberKey(writer, u"encode", PerformanceCounterToMilliseconds(timings.encodeTicks)));
+        IFR(writer.EndScope());
+
+        IFR(writer.BeginArray(u"objects"));
+        for (auto const& objectAndValues : drawableObjects)
+        {
+            IFR(writer.BeginObject());
+            IFR(WriteIntegerKey(writer, u"visible", objectAndValues.IsVisible()));
+            IFR(WriteRectKey(writer, u"layoutBounds", objectAndValues.layoutBounds_));
+            IFR(WriteRectKey(writer, u"contentBounds", objectAndValues.contentBounds_));
+            IFR(WriteRectKey(writer, u"objectRect", objectAndValues.objectRect_));
+            IFR(WriteTimingKey(writer, u"update", objectAndValues.timings_.update));
+            IFR(WriteTimingKey(writer, u"bounds", objectAndValues.timings_.bounds));
+            IFR(WriteTimingKey(writer, u"draw", objectAndValues.timings_.draw));
+            IFR(writer.EndScope());
+        }
+        IFR(writer.EndScope());
+        IFR(writer.EndScope());
+
+        AppendTextUtf16ToUtf8(writer.GetText(), IN OUT metricsText);
+        return S_OK;
+    }
+
+
+    // Render one request into the response message. The response is complete
+    // even if rendering failed, carrying the failure in its header.
+    void RenderRequest(
+        array_ref<char const> requestText,
+        DrawingCanvas& drawingCanvas,
+        _Out_ std::vector<uint8_t>& response
+        )
+    {
+        TRACE_LOGGING_ACTIVITY(activity, "RenderServerRequest", TraceLoggingUInt32(static_cast<uint32_t>(requestText.size()), "RequestByteCount"));
+
+        RenderRequestTimings timings;
+        std::vector<DrawableObjectAndValues> drawableObjects;
+        std::vector<uint8_t> imageData;
+        SIZE imageSize = {};
+
+        int64_t const loadStartTicks = GetPerformanceCounter();
+        std::u16string settingsText;
+        ConvertTextUtf8ToUtf16(requestText, OUT settingsText);
+        HRESULT hr = LoadSettingsText(settingsText, IN OUT drawableObjects);
+
+        int64_t const drawStartTicks = GetPerformanceCounter();
+        if (SUCCEEDED(hr))
+        {
+            hr = DrawObjectsToFittedCanvas(drawableObjects, drawingCanvas);
+        }
+
+        int64_t const encodeStartTicks = GetPerformanceCounter();
+        if (SUCCEEDED(hr))
+        {
+            GdiFlush();
+            auto const& rawPixels = drawingCanvas.GetRawPixels();
+            imageSize = {LONG(rawPixels.width), LONG(rawPixels.height)};
+            hr = EncodeRawPixelsAsPng(drawingCanvas.GetWicFactoryWeakRef(), rawPixels, OUT imageData);
+        }
+        int64_t const endTicks = GetPerformanceCounter();
+
+        timings.loadTicks = drawStartTicks - loadStartTicks;
+        timings.drawTicks = encodeStartTicks - drawStartTicks;
+        timings.encodeTicks = endTicks - encodeStartTicks;
+
+        std::string metricsText;
+        FormatRenderMetrics(hr, imageSize, timings, drawableObjects, OUT metricsText);
+        if (FAILED(hr))
+        {
+            imageData.clear();
+        }
+
+        RenderServerResponseHeader header;
+        header.hresult = hr;
+        header.metricsByteCount = static_cast<uint32_t>(metricsText.size());
+        header.imageByteCount = static_cast<uint32_t>(imageData.size());
+
+        response.resize(sizeof(header) + metricsText.size() + imageData.size());
+        memcpy(response.data(), &header, sizeof(header));
+        memcpy(response.data() + sizeof(header), metricsText.data(), metricsText.size());
+        memcpy(response.data() + sizeof(header) + metricsText.size(), imageData.data(), imageData.size());
+    }
+
+
+    // Read a whole message, however many reads it takes.
+    HRESULT ReadPipeMessage(HANDLE pipe, _Out_ std::string& message)
+    {
+        message.clear();
+        for (;;)
+        {
+            size_t const previousSize = message.size();
+            message.resize(previousSize + g_pipeBufferSize);
+            DWORD bytesRead = 0;
+            BOOL succeeded = ReadFile(pipe, &message[previousSize], g_pipeBufferSize, OUT &bytesRead, nullptr);
+            message.resize(previousSize + bytesRead);
+
+            if (succeeded)
+                return S_OK;
+
+            DWORD error = GetLastError();
+            if (error != ERROR_MORE_DATA)
+                return HRESULT_FROM_WIN32(error);
+        }
+    }
+
+
+    // Create a pipe instance. The first instance claims the name, failing if
+    // another server (or any other process) already has a pipe by that name,
+    // rather than quietly splitting the clients with it.
+    HRESULT CreateRenderPipe(_In_z_ char16_t const* pipeName, bool isFirstInstance, _Out_ HANDLE* pipe)
+    {
+        *pipe = CreateNamedPipe(
+            ToWChar(pipeName),
+            PIPE_ACCESS_DUPLEX | (isFirstInstance ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES,
+            g_pipeBufferSize,
+            g_pipeBufferSize,
+            0, // default timeout
+            nullptr // default security, the creator and local system
+            );
+
+        if (*pipe == INVALID_HANDLE_VALUE)
+        {
+            *pipe = nullptr;
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        return S_OK;
+    }
+
+
+    // Answer each client connected to the pipe instance in turn, drawing into
+    // the same canvas throughout, until stopped. Stopping cancels whichever
+    // connect, read, or write the worker is blocked in.
+    HRESULT ServeRenderClients(HANDLE pipe, std::atomic<bool> const& isStopping, DrawingCanvas& drawingCanvas)
+    {
+        std::string request;
+        std::vector<uint8_t> response;
+        uint32_t requestCount = 0;
+
+        while (!isStopping)
+        {
+            if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+            {
+                return HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            // Answer requests until the client disconnects.
+            while (SUCCEEDED(ReadPipeMessage(pipe, OUT request)))
+            {
+                RenderRequest(request, drawingCanvas, OUT response);
+
+                DWORD bytesWritten = 0;
+                if (!WriteFile(pipe, response.data(), static_cast<DWORD>(response.size()), OUT &bytesWritten, nullptr))
+                    break;
+
+                if (++requestCount % g_requestsPerSharedResourceRetirement == 0)
+                {
+                    drawingCanvas.RetireStaleSharedResources();
+                }
+            }
+
+            FlushFileBuffers(pipe);
+            DisconnectNamedPipe(pipe);
+        }
+
+        return HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED);
+    }
+}
+
+
+HRESULT RunRenderServer(
+    _In_z_ char16_t const* pipeName,
+    uint32_t threadCount,
+    DrawingCanvas::FactoryIsolation factoryIsolation
+    )
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Claim the name before any worker starts, so the other instances never
+    // race the first one.
+    HANDLE firstPipe;
+    IFR(CreateRenderPipe(pipeName, /*isFirstInstance*/ true, OUT &firstPipe));
+    FileHandle scopedFirstPipe(firstPipe);
+
+    FileHandle stopEvent(CreateEvent(nullptr, /*bManualReset*/ TRUE, /*bInitialState*/ FALSE, nullptr));
+    if (stopEvent == nullptr)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    std::atomic<HRESULT> firstFailure(S_OK);
+    std::atomic<bool> isStopping(false);
+
+    // Each worker holds its canvas (and so its D2D factory, and DWrite factory
+    // if isolated) until the server ends, like the /render workers but across
+    // requests rather than files.
+    DrawingCanvasPool drawingCanvasPool(factoryIsolation);
+    auto serveClients = [&](uint32_t workerIndex)
+    {
+        HANDLE pipe = firstPipe;
+        FileHandle scopedPipe;
+        HRESULT hr = S_OK;
+        if (workerIndex > 0)
+        {
+            hr = CreateRenderPipe(pipeName, /*isFirstInstance*/ false, OUT &pipe);
+            scopedPipe.Set(pipe);
+        }
+
+        ComPtr<DrawingCanvas> drawingCanvas;
+        if (SUCCEEDED(hr))
+        {
+            hr = drawingCanvasPool.Acquire(OUT &drawingCanvas);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = ServeRenderClients(pipe, isStopping, *drawingCanvas);
+            drawingCanvasPool.Return(drawingCanvas);
+        }
+
+        // Serving only ends on failure, or when another worker failed.
+        HRESULT noFailure = S_OK;
+        firstFailure.compare_exchange_strong(IN OUT noFailure, hr);
+        if (FAILED(hr) && hr != HRESULT_FROM_WIN32(ERROR_OPERATION_ABORTED))
+        {
+            WriteConsoleLine(u"Render server worker failed %08X: %s", hr, pipeName);
+        }
+
+        isStopping = true;
+        SetEvent(stopEvent);
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(serveClients, i);
+    }
+
+    // Once any worker ends, stop the rest. A worker may be between blocking
+    // calls when cancelled, so keep cancelling until it exits.
+    WaitForSingleObject(stopEvent, INFINITE);
+    for (auto& thread : threads)
+    {
+        HANDLE threadHandle = thread.native_handle();
+        while (WaitForSingleObject(threadHandle, 10) == WAIT_TIMEOUT)
+        {
+            CancelSynchronousIo(threadHandle);
+        }
+        thread.join();
+    }
+
+    return firstFailure;
+}
+
+
+int RunRenderServerCommandLine(_In_z_ char16_t const* commandLine)
+{
+    AttachConsole(ATTACH_PARENT_PROCESS);
+
+    int argumentCount = 0;
+    wchar_t** arguments = CommandLineToArgvW(ToWChar(commandLine), OUT &argumentCount);
+    if (arguments == nullptr)
+    {
+        return 1;
+    }
+
+    std::u16string pipeName = g_defaultRenderServerPipeName;
+    uint32_t threadCount = 0;
+    auto factoryIsolation = DrawingCanvas::FactoryIsolationPerThreadD2D;
+
+    for (int i = 0; i < argumentCount; ++i)
+    {
+        char16_t const* argument = ToChar16(arguments[i]);
+        if (_wcsicmp(ToWChar(argument), L"/serve") == 0)
+        {
+            continue;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/pipe:", 6) == 0)
+        {
+            pipeName = argument + 6;
+        }
+        else if (_wcsnicmp(ToWChar(argument), L"/threads:", 9) == 0)
+        {
+            threadCount = wcstoul(ToWChar(argument + 9), nullptr, 10);
+        }
+        else if (_wcsicmp(ToWChar(argument), L"/isolatefactories") == 0)
+        {
+            factoryIsolation = DrawingCanvas::FactoryIsolationPerThread;
+        }
+        else
+        {
+            WriteConsoleLine(u"Unknown command line option: %s", argument);
+            WriteConsoleLine(u"TextLayoutSampler.exe /serve [/pipe:Name] [/threads:N] [/isolatefactories]");
+            LocalFree(arguments);
+            return 1;
+        }
+    }
+    LocalFree(arguments);
+
+    WriteConsoleLine(u"Serving render requests: %s", pipeName.c_str());
+    HRESULT hr = RunRenderServer(pipeName.c_str(), threadCount, factoryIsolation);
+
+    return FAILED(hr) ? 2 : 0;
+}
@@ -0,0 +1,54 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    Long-lived render server answering settings documents
+//                  sent over a named pipe with images, bounds, and timings.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import DrawingCanvas;
+#else
+#include "DrawingCanvas.h"
+#endif
+
+
+// Each request is one pipe message holding a settings document as UTF-8
+// Jsonex text, the same as a .TextLayoutSamplerSettings file. Each response
+// is one message: this header, then the metrics as UTF-8 Jsonex text, then
+// the PNG file data (empty if the render failed).
+//
+// The metrics hold the HRESULT (as a "0x%08X" string), the image size, the load, draw, and encode
+// times in milliseconds, and per object the layout and content bounds (from
+// GetBounds), the drawn object rectangle, and the Update, GetBounds, and Draw
+// times.
+struct RenderServerResponseHeader
+{
+    static constexpr uint32_t signatureValue = 0x52534C54; // "TLSR" in the little-endian bytes.
+
+    uint32_t signature = signatureValue;
+    HRESULT hresult = S_OK;
+    uint32_t metricsByteCount = 0;
+    uint32_t imageByteCount = 0;
+};
+
+
+// Serve render requests on the named pipe until the process is ended or a
+// worker fails, with one worker per pipe instance. Fails if another server
+// already owns the pipe name. Each worker keeps its canvas for the life of
+// the server, so the font faces, collections, and glyph caches shared through
+// it stay warm across requests. The drawable objects, with their formats and
+// layouts, are still created anew from each request's settings.
+HRESULT RunRenderServer(
+    _In_z_ char16_t const* pipeName, // Such as \\.\pipe\TextLayoutSampler
+    uint32_t threadCount, // 0 for the number of cores.
+    DrawingCanvas::FactoryIsolation factoryIsolation
+    );
+
+// Run the /serve command line, returning the process exit code.
+//
+//      /serve [/pipe:Name] [/threads:N] [/isolatefactories]
+//
+// The pipe name defaults to \\.\pipe\TextLayoutSampler. Relative font file
+// paths in requests resolve against the server's current directory.
+int RunRenderServerCommandLine(_In_z_ char16_t const* commandLine);
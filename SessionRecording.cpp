@@ -0,0 +1,250 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    High level actions of an interactive session, timestamped,
+//                  so the same session can be replayed later as a benchmark.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "FileHelpers.h"
+#include "TextTreeParser.h"
+
+
+MODULE(SessionRecording)
+EXPORT_BEGIN
+    #include "SessionRecording.h"
+EXPORT_END
+
+////////////////////////////////////////
+
+namespace
+{
+    char16_t const* g_sessionRecordingContent = u"TextLayoutSamplerSession";
+
+    char16_t const* g_stepTypeNames[] = {
+        u"none",
+        u"action",
+        u"setValues",
+        u"setText",
+        u"loadSettings",
+        u"loadTextFile",
+        u"loadFontFile",
+        u"loadFontFiles",
+    };
+    static_assert(countof(g_stepTypeNames) == SessionRecording::StepTypeTotal, "Step type names are missing.");
+
+
+    void SetKeyValue(TextTree::NodePointer node, _In_z_ char16_t const* keyName, std::u16string const& value)
+    {
+        node.SetKeyValue(keyName, value.c_str(), static_cast<uint32_t>(value.size()));
+    }
+
+
+    // Space separated, which keeps long selections on one line.
+    void SetKeyValue(TextTree::NodePointer node, _In_z_ char16_t const* keyName, array_ref<uint32_t const> values)
+    {
+        std::u16string text;
+        wchar_t buffer[12];
+        for (auto value : values)
+        {
+            swprintf_s(buffer, L"%u", value);
+            if (!text.empty())
+                text.push_back(' ');
+            text.append(ToChar16(buffer));
+        }
+        SetKeyValue(node, keyName, text);
+    }
+
+
+    void GetIndices(std::u16string const& text, _Out_ std::vector<uint32_t>& values)
+    {
+        values.clear();
+        wchar_t const* p = ToWChar(text.c_str());
+        for (;;)
+        {
+            wchar_t* end;
+            uint32_t value = wcstoul(p, OUT &end, 10);
+            if (end == p)
+                break;
+            values.push_back(value);
+            p = end;
+        }
+    }
+
+
+    void LoadStep(TextTree::NodePointer stepNode, _Out_ SessionRecording::Step& step)
+    {
+        step = {};
+        for (TextTree::NodePointer node = stepNode.begin(), nodeEnd = stepNode.end(); node != nodeEnd; ++node)
+        {
+            std::u16string text = node.GetText();
+            if (text == u"type")
+            {
+                std::u16string value = node.GetSubvalue();
+                for (uint32_t i = 0; i < SessionRecording::StepTypeTotal; ++i)
+                {
+                    if (value == g_stepTypeNames[i])
+                        step.type = SessionRecording::StepType(i);
+                }
+            }
+            else if (text == u"time")       step.milliseconds = float(wcstod(ToWChar(node.GetSubvalue().c_str()), nullptr));
+            else if (text == u"action")     step.actionName = node.GetSubvalue();
+            else if (text == u"clear")      step.clearExistingItems = (node.GetSubvalue() == u"1");
+            else if (text == u"merge")      step.merge = (node.GetSubvalue() == u"1");
+            else if (text == u"objects")    GetIndices(node.GetSubvalue(), OUT step.objectIndices);
+            else if (text == u"attributes") GetIndices(node.GetSubvalue(), OUT step.attributeIndices);
+            else if (text == u"value")      step.value = node.GetSubvalue();
+            else if (text == u"paths")
+            {
+                for (TextTree::NodePointer pathNode = node.begin(), pathNodeEnd = node.end(); pathNode != pathNodeEnd; ++pathNode)
+                {
+                    step.filePaths.push_back(pathNode.GetText());
+                }
+            }
+        }
+    }
+
+
+    void StoreStep(SessionRecording::Step const& step, TextTree::NodePointer stepNode)
+    {
+        wchar_t buffer[24];
+        SetKeyValue(stepNode, u"type", SessionRecording::GetStepTypeName(step.type));
+        swprintf_s(buffer, L"%.3f", step.milliseconds);
+        SetKeyValue(stepNode, u"time", ToChar16(buffer));
+        SetKeyValue(stepNode, u"objects", step.objectIndices);
+
+        switch (step.type)
+        {
+        case SessionRecording::StepTypeAction:
+            SetKeyValue(stepNode, u"action", step.actionName);
+            break;
+
+        case SessionRecording::StepTypeSetValues:
+            SetKeyValue(stepNode, u"attributes", step.attributeIndices);
+            SetKeyValue(stepNode, u"value", step.value);
+            break;
+
+        case SessionRecording::StepTypeLoadSettings:
+            SetKeyValue(stepNode, u"clear", step.clearExistingItems ? u"1" : u"0");
+            SetKeyValue(stepNode, u"merge", step.merge ? u"1" : u"0");
+            SetKeyValue(stepNode, u"value", step.value);
+            break;
+
+        case SessionRecording::StepTypeSetText:
+        case SessionRecording::StepTypeLoadTextFile:
+        case SessionRecording::StepTypeLoadFontFile:
+            SetKeyValue(stepNode, u"value", step.value);
+            break;
+
+        case SessionRecording::StepTypeLoadFontFiles:
+            {
+                auto pathsNode = stepNode.AppendChild(TextTree::Node::TypeArray, u"paths", uint32_t(countof(u"paths") - 1));
+                for (auto const& filePath : step.filePaths)
+                {
+                    pathsNode.AppendChild(TextTree::Node::TypeString, filePath.c_str(), static_cast<uint32_t>(filePath.size()));
+                }
+            }
+            break;
+        }
+    }
+}
+
+
+void SessionRecording::Start()
+{
+    steps_.clear();
+    startTicks_ = GetPerformanceCounter();
+    isRecording_ = true;
+}
+
+
+SessionRecording::Step* SessionRecording::AddStep(StepType type, array_ref<uint32_t const> objectIndices)
+{
+    if (!isRecording_)
+        return nullptr;
+
+    steps_.emplace_back();
+    Step& step = steps_.back();
+    step.type = type;
+    step.milliseconds = float(PerformanceCounterToMilliseconds(GetPerformanceCounter() - startTicks_));
+    step.objectIndices.assign(objectIndices.begin(), objectIndices.end());
+    return &step;
+}
+
+
+char16_t const* SessionRecording::GetStepTypeName(StepType type) noexcept
+{
+    return (type < StepTypeTotal) ? g_stepTypeNames[type] : g_stepTypeNames[StepTypeNone];
+}
+
+
+HRESULT SessionRecording::Load(_In_z_ char16_t const* filePath)
+{
+    steps_.clear();
+    isRecording_ = false;
+
+    std::u16string inputText;
+    IFR(ReadTextFile(filePath, OUT inputText));
+
+    TextTree data;
+    JsonexParser parser(inputText, JsonexParser::OptionsDefault);
+    parser.ReadNodes(IN OUT data);
+    if (parser.GetErrorCount() > 0)
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+
+    // Replay only a file identifying itself as a session, not just any file
+    // that happens to parse.
+    bool hasContent = false;
+    std::vector<Step> steps;
+    TextTree::NodePointer subroot = data.BeginFirstChild();
+    for (TextTree::NodePointer node = subroot.begin(), nodeEnd = subroot.end(); node != nodeEnd; ++node)
+    {
+        std::u16string text = node.GetText();
+        if (text == u"content")
+        {
+            if (node.GetSubvalue() != g_sessionRecordingContent)
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            hasContent = true;
+        }
+        else if (text == u"steps")
+        {
+            for (TextTree::NodePointer stepNode = node.begin(), stepNodeEnd = node.end(); stepNode != stepNodeEnd; ++stepNode)
+            {
+                Step step;
+                LoadStep(stepNode, OUT step);
+                if (step.type != StepTypeNone)
+                {
+                    steps.push_back(std::move(step));
+                }
+            }
+        }
+    }
+
+    if (!hasContent)
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+
+    steps_ = std::move(steps);
+    return S_OK;
+}
+
+
+HRESULT SessionRecording::Save(_In_z_ char16_t const* filePath) const
+{
+    TextTree data;
+    data.Append(TextTree::Node::TypeRoot, 1, u"", 0);
+    TextTree::NodePointer root = data.begin();
+    TextTree::NodePointer subroot = root.AppendChild(TextTree::Node::TypeObject, u"", 0);
+
+    SetKeyValue(subroot, u"content", g_sessionRecordingContent);
+    auto stepsNode = subroot.AppendChild(TextTree::Node::TypeArray, u"steps", uint32_t(countof(u"steps") - 1));
+    for (auto const& step : steps_)
+    {
+        auto stepNode = stepsNode.AppendChild(TextTree::Node::TypeObject, u"", 0);
+        StoreStep(step, stepNode);
+    }
+
+    JsonexWriter writer(JsonexWriter::OptionsDefault);
+    writer.WriteNodes(data);
+    array_ref<char16_t const> outputJson = writer.GetText();
+    IFR(WriteTextFile(filePath, outputJson.data(), static_cast<uint32_t>(outputJson.size())));
+
+    return S_OK;
+}
@@ -0,0 +1,68 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    High level actions of an interactive session, timestamped,
+//                  so the same session can be replayed later as a benchmark.
+//----------------------------------------------------------------------------
+#pragma once
+
+
+#if USE_CPP_MODULES
+import Common.ArrayRef;
+import Common.String;
+#else
+#include "Common.ArrayRef.h"
+#include "Common.String.h"
+#endif
+
+
+// Records what the user did rather than how (no mouse or keyboard input), so
+// replay does not depend on window layout, list filtering, or dialogs.
+class SessionRecording
+{
+public:
+    enum StepType : uint32_t
+    {
+        StepTypeNone,
+        StepTypeAction,         // Command from the assorted actions menu.
+        StepTypeSetValues,      // Attribute value typed or chosen for the objects.
+        StepTypeSetText,        // Text typed into the text edit, already unescaped.
+        StepTypeLoadSettings,   // Settings file loaded, appended, or merged.
+        StepTypeLoadTextFile,   // Text file read into the objects.
+        StepTypeLoadFontFile,   // Single font file applied to the objects.
+        StepTypeLoadFontFiles,  // Font files and folders read in the background, one object each.
+        StepTypeTotal,
+    };
+
+    struct Step
+    {
+        StepType type = StepTypeNone;
+        float milliseconds = 0;                 // Since recording started.
+        std::u16string actionName;              // StepTypeAction, stable across builds unlike command ids.
+        bool clearExistingItems = false;        // StepTypeLoadSettings
+        bool merge = false;                     // StepTypeLoadSettings
+        std::vector<uint32_t> objectIndices;    // Selected objects when recorded.
+        std::vector<uint32_t> attributeIndices; // StepTypeSetValues
+        std::u16string value;                   // New value, text, or file path.
+        std::vector<std::u16string> filePaths;  // StepTypeLoadFontFiles
+    };
+
+public:
+    void Start();
+    void Stop() noexcept { isRecording_ = false; }
+    bool IsRecording() const noexcept { return isRecording_; }
+
+    // Append a step stamped with the time since Start, or null if not recording.
+    Step* AddStep(StepType type, array_ref<uint32_t const> objectIndices);
+
+    array_ref<Step const> GetSteps() const noexcept { return steps_; }
+
+    HRESULT Load(_In_z_ char16_t const* filePath);
+    HRESULT Save(_In_z_ char16_t const* filePath) const;
+
+    static char16_t const* GetStepTypeName(StepType type) noexcept;
+
+private:
+    std::vector<Step> steps_;
+    int64_t startTicks_ = 0;
+    bool isRecording_ = false;
+};
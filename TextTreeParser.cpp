@@ -12,6 +12,7 @@ import Common.ArrayRef;
 #include "Common.String.h"
 #include "Common.ArrayRef.h"
 #endif
+#include "FileHelpers.h"
 
 MODULE(TextTreeParser)
 EXPORT_BEGIN
@@ -231,6 +232,28 @@ std::u16string TextTree::NodePointer::GetSubvalue() const
 }
 
 
+array_ref<char16_t const> TextTree::NodePointer::GetTextView() const
+{
+    if (!IsValid())
+        return {};
+
+    return textTree_.GetTextView(textTree_.GetNode(nodeIndex_));
+}
+
+
+array_ref<char16_t const> TextTree::NodePointer::GetSubvalueView() const
+{
+    array_ref<char16_t const> text;
+
+    if (IsValid())
+    {
+        textTree_.GetSingleSubvalue(nodeIndex_, OUT text);
+    }
+
+    return text;
+}
+
+
 std::u16string TextTree::NodePointer::GetSubvalue(const std::u16string& defaultText) const
 {
     // wstring helper just forwards along.
@@ -314,10 +337,61 @@ TextTree::iterator TextTree::BeginFirstChild()
 void TextTree::Clear()
 {
     // Reset the tree and release all memory.
-    nodes_.clear();
-    nodes_.shrink_to_fit();
-    nodesText_.clear();
-    nodesText_.shrink_to_fit();
+    nodes_.free();
+    textChunks_.clear();
+    textChunks_.shrink_to_fit();
+    InvalidateKeyIndex();
+}
+
+
+TextTree::TextChunk& TextTree::GetAppendableTextChunk(uint32_t reserveLength)
+{
+    if (!textChunks_.empty())
+    {
+        auto& lastChunk = textChunks_.back();
+        if (lastChunk.text.capacity() - lastChunk.text.size() >= reserveLength)
+            return lastChunk;
+    }
+
+    // Seal the last chunk (it is never appended to again) and start another
+    // just after it.
+    uint32_t base = textChunks_.empty() ? 0 : textChunks_.back().base + static_cast<uint32_t>(textChunks_.back().text.size());
+    textChunks_.push_back({base, std::u16string()});
+    auto& newChunk = textChunks_.back();
+    newChunk.text.reserve(std::max(reserveLength, textChunkSize));
+    return newChunk;
+}
+
+
+uint32_t TextTree::AppendText(__in_ecount(textLength) const char16_t* text, uint32_t textLength)
+{
+    auto& chunk = GetAppendableTextChunk(textLength);
+    uint32_t start = chunk.base + static_cast<uint32_t>(chunk.text.size());
+    chunk.text.append(text, textLength);
+    return start;
+}
+
+
+const char16_t* TextTree::GetTextPointer(uint32_t start) const noexcept
+{
+    if (textChunks_.empty())
+        return u"";
+
+    // Most reads are of recently appended text, or of a tree parsed into a single chunk.
+    auto const* chunk = &textChunks_.back();
+    if (start < chunk->base)
+    {
+        auto match = std::upper_bound(
+            textChunks_.begin(),
+            textChunks_.end(),
+            start,
+            [](uint32_t value, TextChunk const& textChunk) { return value < textChunk.base; }
+            );
+        chunk = &*(match - 1);
+    }
+
+    assert(start - chunk->base <= chunk->text.size());
+    return chunk->text.data() + (start - chunk->base);
 }
 
 
@@ -353,14 +427,14 @@ const char16_t* TextTree::GetText(const Node& node, __out uint32_t& textLength)
 {
     assert(size_t(&node - nodes_.data()) < nodes_.size());
     textLength = node.length;
-    return nodesText_.data() + node.start;
+    return GetTextPointer(node.start);
 }
 
 
 void TextTree::GetText(const Node& node, OUT std::u16string& text) const
 {
     assert(size_t(&node - nodes_.data()) < nodes_.size());
-    auto textPointer = &nodesText_[node.start];
+    auto textPointer = GetTextPointer(node.start);
     text.assign(textPointer, textPointer + node.length);
 }
 
@@ -368,11 +442,18 @@ void TextTree::GetText(const Node& node, OUT std::u16string& text) const
 void TextTree::GetText(uint32_t nodeIndex, OUT std::u16string& text) const
 {
     auto& node = GetNode(nodeIndex);
-    auto textPointer = &nodesText_[node.start];
+    auto textPointer = GetTextPointer(node.start);
     text.assign(textPointer, textPointer + node.length);
 }
 
 
+array_ref<char16_t const> TextTree::GetTextView(const Node& node) const noexcept
+{
+    assert(size_t(&node - nodes_.data()) < nodes_.size());
+    return {GetTextPointer(node.start), node.length};
+}
+
+
 void TextTree::SetText(__inout Node& node, const std::u16string& text)
 {
     SetText(node, text.c_str(), static_cast<uint32_t>(text.size()));
@@ -382,9 +463,8 @@ void TextTree::SetText(__inout Node& node, const std::u16string& text)
 void TextTree::SetText(__inout Node& node, __in_ecount(textLength) const char16_t* text, uint32_t textLength)
 {
     assert(size_t(&node - nodes_.data()) < nodes_.size());
-    const uint32_t start  = static_cast<uint32_t>(nodesText_.size());
-    nodesText_.append(text, textLength);
-    node.start = start;
+    InvalidateKeyIndex();
+    node.start = AppendText(text, textLength);
     node.length = textLength;
 }
 
@@ -584,6 +664,35 @@ bool TextTree::Find(
     const auto nodesCount = nodes_.size();
     auto nodeIndex = firstNodeIndex;
 
+    if (firstNodeIndexIsParent && shouldIndexKeys_)
+    {
+        if (!isKeyIndexBuilt_)
+        {
+            BuildKeyIndex();
+        }
+
+        // Candidates may include hash collisions, so confirm each, and return the first match.
+        bool haveMatch = false;
+        auto candidates = keyIndex_.equal_range(GetKeyIndexHash(firstNodeIndex, text, textLength));
+        for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+        {
+            auto candidateNodeIndex = candidate->second;
+            auto& node = nodes_[candidateNodeIndex];
+            uint32_t currentTextLength = 0;
+            auto currentText = GetText(node, OUT currentTextLength);
+
+            if (currentTextLength == textLength
+            &&  _wcsnicmp(ToWChar(text), ToWChar(currentText), currentTextLength) == 0
+            &&  (expectedType == TextTree::Node::TypeNone || node.type == expectedType || node.GetGenericType() == expectedType)
+            &&  (!haveMatch || candidateNodeIndex < matchingNodeIndex))
+            {
+                matchingNodeIndex = candidateNodeIndex;
+                haveMatch = true;
+            }
+        }
+        return haveMatch;
+    }
+
     if (firstNodeIndexIsParent && !AdvanceChildNode(IN OUT nodeIndex))
     {
         return false;
@@ -617,6 +726,68 @@ bool TextTree::Find(
 }
 
 
+uint64_t TextTree::GetKeyIndexHash(
+    uint32_t parentNodeIndex,
+    __in_ecount(textLength) char16_t const* text,
+    uint32_t textLength
+    ) noexcept
+{
+    // FNV-1a over the lowercase text, folding at least everything _wcsnicmp would.
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < textLength; ++i)
+    {
+        hash = (hash ^ towlower(text[i])) * 16777619u;
+    }
+    return (uint64_t(parentNodeIndex) << 32) | hash;
+}
+
+
+void TextTree::BuildKeyIndex() const
+{
+    keyIndex_.clear();
+    keyIndex_.reserve(nodes_.size());
+
+    // The parent of each node is the closest preceding node at a lower level.
+    std::vector<uint32_t> ancestorNodeIndices;
+    for (uint32_t nodeIndex = 0, nodesCount = static_cast<uint32_t>(nodes_.size()); nodeIndex < nodesCount; ++nodeIndex)
+    {
+        auto& node = nodes_[nodeIndex];
+        while (!ancestorNodeIndices.empty() && nodes_[ancestorNodeIndices.back()].level >= node.level)
+        {
+            ancestorNodeIndices.pop_back();
+        }
+
+        if (!ancestorNodeIndices.empty())
+        {
+            uint32_t textLength = 0;
+            auto text = GetText(node, OUT textLength);
+            keyIndex_.insert({GetKeyIndexHash(ancestorNodeIndices.back(), text, textLength), nodeIndex});
+        }
+
+        ancestorNodeIndices.push_back(nodeIndex);
+    }
+
+    isKeyIndexBuilt_ = true;
+}
+
+
+void TextTree::InvalidateKeyIndex() noexcept
+{
+    // Node indices shift on insertion and deletion, so rather than patch
+    // the index, fall back to scanning until explicitly reindexed.
+    shouldIndexKeys_ = false;
+    isKeyIndexBuilt_ = false;
+    keyIndex_.clear();
+}
+
+
+void TextTree::IndexKeys()
+{
+    shouldIndexKeys_ = true;
+    BuildKeyIndex();
+}
+
+
 bool TextTree::FindKey(
     uint32_t parentNodeIndex,
     __in_z char16_t const* keyName,
@@ -639,10 +810,36 @@ bool TextTree::GetSingleSubvalue(
     OUT std::u16string& text
     ) const
 {
-    // Reads the subvalue of a key, expecting exactly one.
+    array_ref<char16_t const> textView;
+    bool haveSubvalue = GetSingleSubvalue(keyNodeIndex, OUT textView);
+    text.assign(textView.data(), textView.size());
+    return haveSubvalue;
+}
+
+
+bool TextTree::GetSingleSubvalue(
+    uint32_t keyNodeIndex,
+    OUT array_ref<char16_t const>& text
+    ) const
+{
     // A missing value or multiple values return false with empty text.
+    text = {};
 
-    text.clear();
+    uint32_t valueNodeIndex;
+    if (!FindSingleSubvalue(keyNodeIndex, OUT valueNodeIndex))
+        return false;
+
+    text = GetTextView(GetNode(valueNodeIndex));
+    return true;
+}
+
+
+bool TextTree::FindSingleSubvalue(
+    uint32_t keyNodeIndex,
+    OUT uint32_t& valueNodeIndex
+    ) const
+{
+    // Finds the subvalue of a key, expecting exactly one.
 
     const auto nodesCount = nodes_.size();
     auto nodeIndex = keyNodeIndex;
@@ -685,10 +882,7 @@ bool TextTree::GetSingleSubvalue(
         return false;
     }
 
-    const Node& valueNode = GetNode(nodeIndex);
-    auto textPointer = &nodesText_[valueNode.start];
-    text.assign(textPointer, textPointer + valueNode.length);
-
+    valueNodeIndex = nodeIndex;
     return true;
 }
 
@@ -758,6 +952,7 @@ bool TextTree::SetSubvalue(
     // Presume the key node is actually a key. It would be weird to set a
     // value underneath something like a comment or another value.
     assert(keyNode.GetGenericType() == Node::TypeKey);
+    InvalidateKeyIndex();
 
     // Delete existing subvalues.
 
@@ -778,11 +973,10 @@ bool TextTree::SetSubvalue(
     // Add the new node, either inserting or overwriting the old value.
 
     TextTree::Node node = {};
-    node.start = static_cast<uint32_t>(nodesText_.size());
+    node.start = AppendText(valueText, valueTextLength);
     node.length = valueTextLength;
     node.type = type;
     node.level = childNodeLevel;
-    nodesText_.append(valueText, valueTextLength);
 
     if (nodeIndex == firstChildNodeIndex)
     {
@@ -859,12 +1053,13 @@ bool TextTree::SetKeyValue(
 
 void TextTree::Append(TextTree::Node::Type type, uint32_t level, __in_ecount(textLength) char16_t const* text, uint32_t textLength)
 {
+    InvalidateKeyIndex();
+
     TextTree::Node node = {};
-    node.start = static_cast<uint32_t>(nodesText_.size());
+    node.start = AppendText(text, textLength);
     node.length = textLength;
     node.type = type;
     node.level = level;
-    nodesText_.append(text, textLength);
     nodes_.push_back(node);
 }
 
@@ -874,6 +1069,8 @@ bool TextTree::Delete(uint32_t nodeIndex, bool shouldRemove)
     if (nodeIndex >= nodes_.size())
         return false;
 
+    InvalidateKeyIndex();
+
     // Children are also deleted, so determine how many to erase.
     auto endIndex = nodeIndex + 1;
     const auto& node = nodes_[nodeIndex];
@@ -957,12 +1154,13 @@ bool TextTree::Insert(
             return false; // todo: debate whether the call should be false if count not reached
     }
 
+    InvalidateKeyIndex();
+
     TextTree::Node node = {};
-    node.start = static_cast<uint32_t>(nodesText_.size());
+    node.start = AppendText(text, textLength);
     node.length = textLength;
     node.type = type;
     node.level = newNodeLevel;
-    nodesText_.append(text, textLength);
     nodes_.insert(nodes_.begin() + nodeIndex, node);
     newNodeIndex = nodeIndex;
 
@@ -1174,11 +1372,107 @@ bool TextTreeParser::ReadNodes(__inout TextTree& textTree)
         ++treeLevel_;
     }
 
-    while (ReadNode(OUT node, OUT textTree.nodesText_))
+    // Decoded text is never longer than the source (escapes only shrink),
+    // so reserve one chunk up front for all of it plus each node's nul,
+    // letting the parser append without ever reallocating.
+    uint32_t chunkBase = 0;
+    uint32_t remainingTextLength = textLength_ - std::min(textIndex_, textLength_);
+    auto& textChunk = textTree.GetAppendableTextChunk(remainingTextLength + remainingTextLength / 2 + 1);
+    std::u16string& nodesText = textChunk.text;
+    chunkBase = textChunk.base;
+
+    while (ReadNode(OUT node, OUT nodesText))
     {
+        node.start += chunkBase;
         textTree.nodes_.push_back(node);
-        textTree.nodesText_.push_back('\0'); // Add explicit nul just because it makes the life easier of callers later.
+        nodesText.push_back('\0'); // Add explicit nul just because it makes the life easier of callers later.
     }
+
+    // The finished tree is indexed on its first key search.
+    textTree.InvalidateKeyIndex();
+    textTree.shouldIndexKeys_ = true;
+
+    return true;
+}
+
+
+bool TextTreeParser::ReadNodes(
+    __inout TextTree& textTree,
+    uint32_t subtreeLevel,
+    SubtreeCallback const& subtreeCallback
+    )
+{
+    assert(subtreeLevel > 0); // The root never closes.
+
+    TextTree::Node node = {};
+    if (textTree.empty())
+    {
+        node.type = TextTree::Node::TypeRoot;
+        textTree.nodes_.push_back(node);
+        ++treeLevel_;
+    }
+
+    // Only one subtree is held at a time, so rather than reserve for the
+    // whole source, let the chunk grow, and reuse it for each subtree.
+    // Nothing else appends to the tree meanwhile, so the chunk stays last.
+    auto& textChunk = textTree.GetAppendableTextChunk(TextTree::textChunkSize);
+    std::u16string& nodesText = textChunk.text;
+    const uint32_t chunkBase = textChunk.base;
+    textTree.InvalidateKeyIndex();
+
+    const uint32_t noSubtree = UINT32_MAX;
+    uint32_t subtreeNodeIndex = noSubtree;
+
+    // Hand the completed subtree over, and then truncate it away.
+    auto flushSubtree = [&]() -> bool
+    {
+        bool shouldContinue = subtreeCallback(textTree, subtreeNodeIndex - 1, subtreeNodeIndex);
+        nodesText.resize(textTree.nodes_[subtreeNodeIndex].start - chunkBase);
+        textTree.nodes_.resize(subtreeNodeIndex);
+        subtreeNodeIndex = noSubtree;
+        return shouldContinue;
+    };
+
+    while (ReadNode(OUT node, OUT nodesText))
+    {
+        // Seeing any node no deeper than the pending subtree means it closed.
+        if (subtreeNodeIndex != noSubtree && node.level <= subtreeLevel)
+        {
+            // Lift the new node's text out before the truncation overwrites it.
+            std::u16string nodeText(nodesText, node.start, node.length);
+            if (!flushSubtree())
+            {
+                return false;
+            }
+            node.start = static_cast<uint32_t>(nodesText.size());
+            nodesText.append(nodeText);
+        }
+
+        if (node.level == subtreeLevel)
+        {
+            subtreeNodeIndex = static_cast<uint32_t>(textTree.nodes_.size());
+        }
+
+        // Unnamed nodes (like a Jsonex object in an array) report a start of
+        // zero, but truncating at a subtree must not reach back into the text
+        // of its ancestors, so start them at the end instead.
+        if (node.length == 0)
+        {
+            node.start = static_cast<uint32_t>(nodesText.size());
+        }
+
+        node.start += chunkBase;
+        textTree.nodes_.push_back(node);
+        nodesText.push_back('\0');
+    }
+
+    if (subtreeNodeIndex != noSubtree && !flushSubtree())
+    {
+        return false;
+    }
+
+    textTree.shouldIndexKeys_ = true;
+
     return true;
 }
 
@@ -1996,6 +2290,112 @@ bool IniParser::ReadNode(
 }
 
 
+namespace
+{
+    uint32_t ReadBinaryUint32(__in_ecount(2) char16_t const* text) noexcept
+    {
+        return text[0] | (uint32_t(text[1]) << 16);
+    }
+
+    void AppendBinaryUint32(__inout std::u16string& text, uint32_t value)
+    {
+        text.push_back(char16_t(value));
+        text.push_back(char16_t(value >> 16));
+    }
+}
+
+
+BinaryTextTreeParser::BinaryTextTreeParser(
+    __in_ecount(textLength) const char16_t* text,
+    uint32_t textLength,
+    Options options
+    )
+    :   Base(text, textLength, options)
+{
+    // Base already called ResetDerived, but through its own vtable.
+    ResetDerived();
+}
+
+
+void BinaryTextTreeParser::ResetDerived()
+{
+    nodeCount_ = 0;
+    nodeIndex_ = 0;
+    poolLength_ = 0;
+    previousLevel_ = 0;
+    textIndex_ = 0; // No byte order mark to skip.
+    if (textLength_ == 0)
+        return;
+
+    if (textLength_ < headerLength
+    ||  ReadBinaryUint32(&text_[0]) != magic
+    ||  ReadBinaryUint32(&text_[2]) != version)
+    {
+        ReportError(0, u"Data is not a recognized version of the binary format.");
+        textIndex_ = textLength_;
+        return;
+    }
+
+    uint64_t nodeCount = ReadBinaryUint32(&text_[4]);
+    uint64_t poolLength = ReadBinaryUint32(&text_[6]);
+    if (headerLength + nodeCount * nodeLength + poolLength > textLength_)
+    {
+        ReportError(0, u"Data is shorter than its node table and text pool.");
+        textIndex_ = textLength_;
+        return;
+    }
+
+    nodeCount_ = uint32_t(nodeCount);
+    poolLength_ = uint32_t(poolLength);
+    textIndex_ = headerLength;
+}
+
+
+bool BinaryTextTreeParser::ReadNode(
+    __out TextTree::Node& node,
+    __inout std::u16string& nodeText
+    )
+{
+    while (nodeIndex_ < nodeCount_)
+    {
+        char16_t const* nodeData = &text_[headerLength + nodeIndex_ * nodeLength];
+        char16_t const* pool = &text_[headerLength + nodeCount_ * nodeLength];
+        ++nodeIndex_;
+
+        TextTree::Node storedNode;
+        storedNode.type   = TextTree::Node::Type(ReadBinaryUint32(&nodeData[0]));
+        storedNode.level  = ReadBinaryUint32(&nodeData[2]);
+        storedNode.start  = ReadBinaryUint32(&nodeData[4]);
+        storedNode.length = ReadBinaryUint32(&nodeData[6]);
+
+        // The reader supplies its own root.
+        if (storedNode.type == TextTree::Node::TypeRoot)
+            continue;
+
+        // A node may be at most one level deeper than the previous, so the
+        // tree remains well formed even if the data was tampered with.
+        if (storedNode.level == 0
+        ||  storedNode.level > previousLevel_ + 1
+        ||  storedNode.start > poolLength_
+        ||  storedNode.length > poolLength_ - storedNode.start)
+        {
+            ReportError(headerLength + (nodeIndex_ - 1) * nodeLength, u"Node is out of range.");
+            break;
+        }
+        previousLevel_ = storedNode.level;
+
+        node = storedNode;
+        node.start = static_cast<uint32_t>(nodeText.size());
+        nodeText.append(pool + storedNode.start, storedNode.length);
+        treeLevel_ = (node.GetGenericType() == TextTree::Node::TypeKey) ? node.level + 1 : node.level;
+        return true;
+    }
+
+    textIndex_ = textLength_;
+    return false;
+}
+
+
 TextTreeWriter::TextTreeWriter(Options options)
     :   options_(options)
 {
@@ -2043,6 +2443,40 @@ void TextTreeWriter::GetText(OUT std::u16string& text) const
 }
 
 
+void TextTreeWriter::SetOutputFile(_In_opt_ Utf8FileWriter* outputFile) noexcept
+{
+    outputFile_ = outputFile;
+}
+
+
+HRESULT TextTreeWriter::Flush()
+{
+    if (outputFile_ == nullptr || text_.empty())
+        return S_OK;
+
+    hasWrittenText_ = true;
+    HRESULT hr = outputFile_->Write(text_);
+    text_.clear();
+
+    return hr;
+}
+
+
+HRESULT TextTreeWriter::WritePendingText()
+{
+    if (text_.size() < pendingTextThreshold)
+        return S_OK;
+
+    return Flush();
+}
+
+
+bool TextTreeWriter::IsTextEmpty() const noexcept
+{
+    return text_.empty() && !hasWrittenText_;
+}
+
+
 uint32_t TextTreeWriter::GetTextLength(
     __in_ecount_opt(textLength) const char16_t* text,
     uint32_t textLength
@@ -2205,7 +2639,7 @@ HRESULT JsonexWriter::WriteNode(
     }
     if (wantNewLine)
     {
-        if (!text_.empty()) // Write new line, but never start the text file with a leading return (would be a pointless blank line).
+        if (!IsTextEmpty()) // Write new line, but never start the text file with a leading return (would be a pointless blank line).
             text_.append(u"\r\n");
 
         WriteIndentation();
@@ -2268,7 +2702,7 @@ HRESULT JsonexWriter::WriteNode(
         break;
     }
 
-    return S_OK;
+    return WritePendingText();
 }
 
 
@@ -2415,7 +2849,7 @@ HRESULT JsonexWriter::ExitNode()
         text_.push_back(closingPunctuation);
     }
 
-    return S_OK;
+    return WritePendingText();
 }
 
 
@@ -2635,7 +3069,7 @@ HRESULT XmlWriter::WriteNode(
                 wantNewLine = (nodeStack_[nodeLevel_ - 1].type != TextTree::Node::TypeAttribute);
             }
         }
-        if (wantNewLine && !text_.empty()) // Never start with a leading return.
+        if (wantNewLine && !IsTextEmpty()) // Never start with a leading return.
         {
             text_.append(u"\r\n");
             const size_t spacesToIndent = nodeLevel_ * spacesPerIndent_;
@@ -2662,11 +3096,15 @@ HRESULT XmlWriter::WriteNode(
         break;
 
     case TextTree::Node::TypeElement:
-        text_.push_back('<');
-        nodeStack_.back().start = static_cast<uint32_t>(text_.size());
-        nodeStack_.back().length = textLength;
-        WriteStringInternal(text, textLength, type);
-        isInsideOpeningTag_ = true;
+        {
+            text_.push_back('<');
+            size_t const nameStart = text_.size();
+            WriteStringInternal(text, textLength, type);
+            nodeStack_.back().start = static_cast<uint32_t>(elementNames_.size());
+            nodeStack_.back().length = static_cast<uint32_t>(text_.size() - nameStart);
+            elementNames_.append(text_, nameStart, std::u16string::npos);
+            isInsideOpeningTag_ = true;
+        }
         break;
 
     case TextTree::Node::TypeAttribute:
@@ -2683,7 +3121,7 @@ HRESULT XmlWriter::WriteNode(
 
     previousType_ = type;
 
-    return S_OK;
+    return WritePendingText();
 }
 
 
@@ -2774,13 +3212,17 @@ HRESULT XmlWriter::ExitNode()
             spaceBuffer_.assign(spacesToIndent, ' ');
             text_.append(spaceBuffer_);
             text_.append(u"</");
-            text_.append(&text_[node.start], node.length);
+            text_.append(elementNames_, node.start, node.length);
             text_.append(u">");
+            if (node.type == TextTree::Node::TypeElement)
+            {
+                elementNames_.resize(node.start); // Any names of children were already closed.
+            }
         }
         break;
     }
 
-    return S_OK;
+    return WritePendingText();
 }
 
 
@@ -2873,8 +3315,155 @@ HRESULT XmlWriter::EndScope()
 }
 
 
+BinaryTextTreeWriter::BinaryTextTreeWriter(Options options)
+    :   Base(options)
+{
+}
+
+
+HRESULT BinaryTextTreeWriter::WriteNodes(const TextTree& textTree)
+{
+    nodes_.clear();
+    pool_.clear();
+    nodeLevel_ = 1; // Below the root.
+
+    IFR(Base::WriteNodes(textTree));
+
+    // The node table term is the only one large enough to overflow.
+    if (nodes_.size() > (UINT32_MAX - BinaryTextTreeParser::headerLength - pool_.size()) / BinaryTextTreeParser::nodeLength)
+        return HRESULT_FROM_WIN32(ERROR_BUFFER_OVERFLOW);
+
+    text_.reserve(text_.size() + BinaryTextTreeParser::headerLength + nodes_.size() * BinaryTextTreeParser::nodeLength + pool_.size());
+    AppendBinaryUint32(IN OUT text_, BinaryTextTreeParser::magic);
+    AppendBinaryUint32(IN OUT text_, BinaryTextTreeParser::version);
+    AppendBinaryUint32(IN OUT text_, static_cast<uint32_t>(nodes_.size()));
+    AppendBinaryUint32(IN OUT text_, static_cast<uint32_t>(pool_.size()));
+
+    for (auto& node : nodes_)
+    {
+        AppendBinaryUint32(IN OUT text_, node.type);
+        AppendBinaryUint32(IN OUT text_, node.level);
+        AppendBinaryUint32(IN OUT text_, node.start);
+        AppendBinaryUint32(IN OUT text_, node.length);
+    }
+    text_.append(pool_);
+
+    nodes_.clear();
+    pool_.clear();
+
+    return S_OK;
+}
+
+
+HRESULT BinaryTextTreeWriter::WriteNode(
+    TextTree::Node::Type type,
+    __in_ecount(textLength) const char16_t* text,
+    uint32_t textLength
+    )
+{
+    if (textLength == 0xFFFFFFFF)
+        textLength = GetTextLength(text, textLength);
+
+    if (pool_.size() + textLength + 1 > UINT32_MAX)
+        return HRESULT_FROM_WIN32(ERROR_BUFFER_OVERFLOW);
+
+    TextTree::Node node;
+    node.type = type;
+    node.level = nodeLevel_;
+    node.start = static_cast<uint32_t>(pool_.size());
+    node.length = textLength;
+    nodes_.push_back(node);
+
+    if (textLength > 0)
+    {
+        pool_.append(text, textLength);
+    }
+    pool_.push_back('\0');
+
+    return S_OK;
+}
+
+
+HRESULT BinaryTextTreeWriter::EnterNode()
+{
+    ++nodeLevel_;
+    return S_OK;
+}
+
+
+HRESULT BinaryTextTreeWriter::ExitNode()
+{
+    if (nodeLevel_ <= 1)
+        return E_UNEXPECTED;
+
+    --nodeLevel_;
+    return S_OK;
+}
+
+
+// Save a settings shaped tree in both syntaxes and stream it back a subtree
+// at a time, as settings loading does, checking each subtree's parent key
+// and that the ancestors' text survives truncating the previous subtree.
+void RunSubtreeRoundTripTests()
+{
+    TextTree data;
+    data.Append(TextTree::Node::TypeRoot, 1, u"", 0);
+    TextTree::NodePointer root = data.begin();
+    TextTree::NodePointer subroot = root.AppendChild(TextTree::Node::TypeObject, u"", 0);
+    subroot.SetKeyValue(u"content", u"TextLayoutSamplerSettings", uint32_t(countof(u"TextLayoutSamplerSettings")) - 1);
+    TextTree::NodePointer values = subroot.AppendChild(TextTree::Node::TypeArray, u"values", uint32_t(countof(u"values")) - 1);
+    values.AppendChild(TextTree::Node::TypeValue, u"shared", 6);
+    TextTree::NodePointer objects = subroot.AppendChild(TextTree::Node::TypeArray, u"objects", uint32_t(countof(u"objects")) - 1);
+    objects.AppendChild(TextTree::Node::TypeObject, u"", 0).SetKeyValue(u"text", u"first", 5);
+    objects.AppendChild(TextTree::Node::TypeObject, u"", 0).SetKeyValue(u"text", u"second", 6);
+
+    char16_t const* expected[][2] = {
+        {u"content", u"TextLayoutSamplerSettings"},
+        {u"values", u"shared"},
+        {u"objects", u"first"},
+        {u"objects", u"second"},
+    };
+
+    auto checkSubtrees = [&](TextTreeParser& parser)
+    {
+        TextTree textTree;
+        uint32_t subtreeCount = 0;
+        auto checkSubtree = [&](TextTree& tree, uint32_t parentNodeIndex, uint32_t nodeIndex) -> bool
+        {
+            std::u16string parentText, text;
+            tree.GetText(parentNodeIndex, OUT parentText);
+            TextTree::NodePointer node(tree, nodeIndex);
+            text = (node.GetText().empty()) ? node.begin().GetSubvalue() : node.GetText();
+
+            assert(subtreeCount < countof(expected));
+            assert(parentText == expected[subtreeCount][0]);
+            assert(text == expected[subtreeCount][1]);
+            ++subtreeCount;
+            return true;
+        };
+        parser.ReadNodes(IN OUT textTree, 3, checkSubtree);
+        assert(parser.GetErrorCount() == 0);
+        assert(subtreeCount == countof(expected));
+    };
+
+    JsonexWriter jsonexWriter(JsonexWriter::OptionsDefault);
+    jsonexWriter.WriteNodes(data);
+    array_ref<char16_t const> jsonexText = jsonexWriter.GetText();
+    JsonexParser jsonexParser(jsonexText.data(), static_cast<uint32_t>(jsonexText.size()), JsonexParser::OptionsDefault);
+    checkSubtrees(jsonexParser);
+
+    BinaryTextTreeWriter binaryWriter(BinaryTextTreeWriter::OptionsDefault);
+    binaryWriter.WriteNodes(data);
+    array_ref<char16_t const> binaryData = binaryWriter.GetText();
+    BinaryTextTreeParser binaryParser(binaryData.data(), static_cast<uint32_t>(binaryData.size()), BinaryTextTreeParser::OptionsDefault);
+    checkSubtrees(binaryParser);
+}
+
+
 HRESULT RunTests()
 {
+    RunSubtreeRoundTripTests();
+
     const char16_t* testString = u"thistest=foo bar(stuff:boo cat[1 2]) singleitem singleitem2";
 
     // Read all nodes into a text tree.
@@ -6,7 +6,14 @@
 #pragma once
 
 
+#if USE_CPP_MODULES
+import Common.FastVector;
+#else
+#include "Common.FastVector.h"
+#endif
+
 class TextTreeParser;
+class Utf8FileWriter;
 
 
 // Tree of text nodes, applicable most heirarchical text file formats
@@ -29,6 +36,7 @@ public:
         SyntaxBibTeX, // No support
         SyntaxCommaSeparatedValue, // No support
         SyntaxBibTex, // No support
+        SyntaxBinary, // Read/write support
     };
 
     struct Node
@@ -129,6 +137,11 @@ public:
 
         std::u16string GetText() const; // Returns empty string if it does not exist.
         std::u16string GetSubvalue() const; // Returns empty string if it does not exist.
+
+        // Zero-copy forms of the above, valid until the tree is modified. They are not nul-terminated!
+        array_ref<char16_t const> GetTextView() const;
+        array_ref<char16_t const> GetSubvalueView() const;
+
         std::u16string GetSubvalue(const std::u16string& defaultText) const; // Supply a default value if the value is not found.
         std::u16string GetSubvalue(__in_ecount(defaultTextLength) const char16_t* defaultText, uint32_t defaultTextLength) const;
 
@@ -179,6 +192,9 @@ public:
     // The node must be one from this tree, retrieved via GetNode.
     void GetText(const Node& node, OUT std::u16string& text) const;
 
+    // Returns a weak view of the node's text, valid until the tree is modified.
+    array_ref<char16_t const> GetTextView(const Node& node) const noexcept;
+
     // Gets the text at the given index.
     void GetText(uint32_t nodeIndex, OUT std::u16string& text) const;
 
@@ -257,6 +273,13 @@ public:
         __out uint32_t& matchingNodeIndex // remains unchanged if no match
         ) const;
 
+    // Index every node by its parent and case folded name, so that searches
+    // of a parent's immediate children (Find with firstNodeIndexIsParent,
+    // FindKey, GetKeyValue) take constant time instead of scanning. Parsed
+    // trees are indexed lazily on the first search. Any modification drops
+    // the index and reverts to scanning until this is called again.
+    void IndexKeys();
+
     // Find the node matching the given key name.
     // Returns false if not found, or if the node is not a key.
     bool FindKey(
@@ -291,6 +314,12 @@ public:
         OUT std::u16string& text
         ) const;
 
+    // Zero-copy form of the above, valid until the tree is modified.
+    bool GetSingleSubvalue(
+        uint32_t keyNodeIndex,
+        OUT array_ref<char16_t const>& text
+        ) const;
+
     // Get the value of a named key, starting from firstNodeIndex (a sibling at the same level).
     //
     // Returns:
@@ -361,8 +390,41 @@ public:
     bool SkipRootNode(__inout uint32_t& nodeIndex) const;
 
 private:
-    std::vector<Node> nodes_;
-    std::u16string nodesText_;  // Holds decoded text for cases for numeric codes: \u03A3 or &#931; or &#x03A3.
+    // Node text lives in an arena of chunks that are only ever appended to,
+    // so node offsets stay stable and adding text never moves existing text.
+    // Each chunk covers [base, base + text.size()) of one offset space, and
+    // only the last chunk grows. Holds decoded text for cases for numeric
+    // codes: \u03A3 or &#931; or &#x03A3.
+    struct TextChunk
+    {
+        uint32_t base;
+        std::u16string text;
+    };
+
+    static constexpr uint32_t textChunkSize = 65536; // Code units per new chunk, unless the text is longer.
+
+    // Return the last chunk, starting a new one if reserveLength more code
+    // units would not fit without reallocating.
+    TextChunk& GetAppendableTextChunk(uint32_t reserveLength);
+
+    // Appends the text to the arena, returning its offset.
+    uint32_t AppendText(__in_ecount(textLength) const char16_t* text, uint32_t textLength);
+
+    const char16_t* GetTextPointer(uint32_t start) const noexcept;
+
+    bool FindSingleSubvalue(uint32_t keyNodeIndex, OUT uint32_t& valueNodeIndex) const;
+
+    static uint64_t GetKeyIndexHash(uint32_t parentNodeIndex, __in_ecount(textLength) char16_t const* text, uint32_t textLength) noexcept;
+    void BuildKeyIndex() const;
+    void InvalidateKeyIndex() noexcept;
+
+    fast_vector<Node> nodes_; // Relocated with memmove on insertion and deletion.
+    std::deque<TextChunk> textChunks_;
+
+    // Parent index and folded name hash to node index, only valid while isKeyIndexBuilt_.
+    mutable std::unordered_multimap<uint64_t, uint32_t> keyIndex_;
+    mutable bool isKeyIndexBuilt_ = false;
+    bool shouldIndexKeys_ = false;
 };
 
 
@@ -446,6 +508,22 @@ public:
     // Reads the entire string into the text tree's nodes.
     bool ReadNodes(__inout TextTree& textTree);
 
+    // Called once each node at the subtree level closes, with the tree holding
+    // that node (at nodeIndex) and all its descendants, plus its ancestors
+    // (parent at nodeIndex - 1). The callback must not modify the tree.
+    // Return false to stop reading.
+    using SubtreeCallback = std::function<bool(TextTree& textTree, uint32_t parentNodeIndex, uint32_t nodeIndex)>;
+
+    // Streaming form of ReadNodes, which hands each subtree at the given
+    // level to the callback as soon as it closes and then discards it, so
+    // the tree only ever holds one subtree plus its ancestors rather than
+    // the whole file. Returns false if the callback stopped reading early.
+    bool ReadNodes(
+        __inout TextTree& textTree,
+        uint32_t subtreeLevel,
+        SubtreeCallback const& subtreeCallback
+        );
+
     // Get the level (depth) of the current node.
     //
     // Given <Parent><Child></Child></Parent>
@@ -586,7 +664,7 @@ protected:
     virtual void ResetDerived();
 
 protected:
-    std::vector<TextTree::Node> nodeStack_;
+    fast_vector<TextTree::Node, 32> nodeStack_; // Rarely deeper, so no heap.
 };
 
 
@@ -650,6 +728,59 @@ protected:
 };
 
 
+class BinaryTextTreeParser : public TextTreeParser
+{
+    // Reads the compact form written by BinaryTextTreeWriter, which stores
+    // the nodes as-is rather than as syntax, so reading needs no parsing.
+    // The data is treated as an array of UTF-16 code units (so a mapped file
+    // can be passed directly), little-endian, laid out as:
+    //
+    //      uint32_t magic          'TLTB'
+    //      uint32_t version        1
+    //      uint32_t nodeCount
+    //      uint32_t textLength     Code units in the text pool.
+    //      Node nodes[nodeCount]   uint32_t type, level, start, length.
+    //      char16_t text[textLength]
+    //
+    // Node text is nul-terminated in the pool, though the length excludes it.
+
+    using Base = TextTreeParser;
+
+public:
+    static constexpr uint32_t magic = 0x42544C54; // "TLTB" little-endian
+    static constexpr uint32_t version = 1;
+    static constexpr uint32_t headerLength = 8; // Code units
+    static constexpr uint32_t nodeLength = 8; // Code units
+
+    BinaryTextTreeParser() {}
+
+    BinaryTextTreeParser(
+        __in_ecount(textLength) const char16_t* text,
+        uint32_t textLength,
+        Options options
+        );
+
+    template<typename ContiguousSequenceContainer>
+    inline BinaryTextTreeParser(const ContiguousSequenceContainer& text, Options options)
+        :   BinaryTextTreeParser(&(*std::begin(text)), static_cast<uint32_t>(std::end(text) - std::begin(text)), options)
+    {}
+
+    virtual bool ReadNode(
+        __out TextTree::Node& node,
+        __inout std::u16string& nodeText
+        );
+
+protected:
+    virtual void ResetDerived();
+
+protected:
+    uint32_t nodeCount_ = 0;
+    uint32_t nodeIndex_ = 0;
+    uint32_t poolLength_ = 0;
+    uint32_t previousLevel_ = 0;
+};
+
+
 class TextTreeWriter // Base class
 {
 public:
@@ -685,6 +816,14 @@ public:
     // Reads the text into the string.
     void GetText(OUT std::u16string& text) const;
 
+    // Stream the text to the file as it is written, rather than retaining all
+    // of it (for the Jsonex and XML writers, not binary). GetText then returns
+    // just the pending part, and Flush must follow the last node.
+    void SetOutputFile(_In_opt_ Utf8FileWriter* outputFile) noexcept;
+
+    // Write any pending text to the output file.
+    HRESULT Flush();
+
     virtual HRESULT EnterNode();
 
     virtual HRESULT ExitNode();
@@ -696,10 +835,22 @@ public:
         uint32_t textLength = 0xFFFFFFFF
         ) noexcept;
 
+protected:
+    // Called after each node to pass the pending text to any output file once
+    // it passes the threshold.
+    HRESULT WritePendingText();
+
+    // Nothing written yet, counting text already passed to the output file.
+    bool IsTextEmpty() const noexcept;
+
+    static constexpr size_t pendingTextThreshold = 1 << 15;
+
 protected:
     std::u16string text_; // Starts empty and grows with each written node.
     uint32_t nodeLevel_ = 0; // Current heirarchy level
     Options options_ = OptionsDefault;
+    Utf8FileWriter* outputFile_ = nullptr; // Weak pointer, optional
+    bool hasWrittenText_ = false; // Some text already went to the output file.
 };
 
 
@@ -834,5 +985,34 @@ protected:
     bool isInsideOpeningTag_;
     TextTree::Node::Type previousType_;
     std::u16string spaceBuffer_;
-    std::vector<TextTree::Node> nodeStack_;
+    std::u16string elementNames_; // Escaped names of open elements, for closing tags, since text_ may be flushed.
+    fast_vector<TextTree::Node, 32> nodeStack_; // Rarely deeper, so no heap.
+};
+
+
+class BinaryTextTreeWriter : public TextTreeWriter
+{
+    // Writes the layout described in BinaryTextTreeParser. Since the node
+    // table precedes the text pool, nodes are collected until WriteNodes
+    // finishes, and only then is the text (the binary data) complete.
+public:
+    using Base = TextTreeWriter;
+
+    BinaryTextTreeWriter(Options options);
+
+    HRESULT WriteNodes(const TextTree& textTree);
+
+    virtual HRESULT WriteNode(
+        TextTree::Node::Type type,
+        __in_ecount(textLength) const char16_t* text,
+        uint32_t textLength
+        );
+
+    virtual HRESULT EnterNode();
+
+    virtual HRESULT ExitNode();
+
+protected:
+    fast_vector<TextTree::Node> nodes_;
+    std::u16string pool_;
 };
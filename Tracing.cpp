@@ -0,0 +1,27 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    TraceLogging (ETW) provider for the app's own work.
+//----------------------------------------------------------------------------
+#include "precomp.h"
+#include "Tracing.h"
+
+#pragma comment(lib, "Advapi32.lib") // EventRegister
+
+
+TRACELOGGING_DEFINE_PROVIDER(
+    g_traceLoggingProvider,
+    "TextLayoutSampler",
+    (0x4e4d6709, 0xaac1, 0x46eb, 0x89, 0x84, 0x78, 0x8e, 0x53, 0xfb, 0xb7, 0xbc)
+    );
+
+
+TraceLoggingRegistration::TraceLoggingRegistration() noexcept
+{
+    TraceLoggingRegister(g_traceLoggingProvider); // Failure just leaves the events disabled.
+}
+
+
+TraceLoggingRegistration::~TraceLoggingRegistration()
+{
+    TraceLoggingUnregister(g_traceLoggingProvider);
+}
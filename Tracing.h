@@ -0,0 +1,38 @@
+//----------------------------------------------------------------------------
+//  History:        2026-10-14 Created
+//  Description:    TraceLogging (ETW) provider for the app's own work, like
+//                  painting, arranging, drawing, settings I/O, and font
+//                  loads, to correlate with DWrite, D2D, and GDI in WPA.
+//----------------------------------------------------------------------------
+#pragma once
+
+// Plain header rather than a module, since the TraceLogging macros are
+// expanded at each call site, needing the event names as literals.
+
+// Provider "TextLayoutSampler" {4E4D6709-AAC1-46EB-8984-788E53FBB7BC}.
+// Record it alongside the DWrite providers, for example with:
+//      xperf -start AppSession -on 4E4D6709-AAC1-46EB-8984-788E53FBB7BC
+TRACELOGGING_DECLARE_PROVIDER(g_traceLoggingProvider);
+
+// Registers the provider for the object's lifetime, which is all of wWinMain.
+// Until then, and whenever no session listens, each event costs just a test.
+class TraceLoggingRegistration
+{
+public:
+    TraceLoggingRegistration() noexcept;
+    ~TraceLoggingRegistration();
+};
+
+// Activity over the rest of the enclosing scope, with a start event of the
+// given name and fields, and a stop event on leaving the scope. Events the
+// same thread writes meanwhile, including nested activities and those of
+// DWrite, are tagged with its activity id, so WPA can group them by it.
+using TraceLoggingScopedActivity = TraceLoggingThreadActivity<g_traceLoggingProvider>;
+
+#define TRACE_LOGGING_ACTIVITY(activity, eventName, ...) \
+    TraceLoggingScopedActivity activity; \
+    TraceLoggingWriteStart(activity, eventName, __VA_ARGS__)
+
+// Single event, such as a cache hit or miss, within any current activity.
+#define TRACE_LOGGING_EVENT(eventName, ...) \
+    TraceLoggingWrite(g_traceLoggingProvider, eventName, TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), __VA_ARGS__)
@@ -71,7 +71,15 @@
 #include <string>
 #include <functional>
 #include <map>
+#include <unordered_map>
+#include <deque>
+#include <string_view>
 #include <array>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 //////////////////////////////
 // Windows Header Files:
@@ -133,11 +141,15 @@
 #include <DxgiFormat.h>
 #include <DxgiType.h>
 #include <Dxgi.h>
+#include <D3D11.h>
 
 #include <WinCodec.h>
 
 #include <usp10.h>
 
+#include <TraceLoggingProvider.h>
+#include <TraceLoggingActivity.h>
+
 #define min std::min
 #define max std::max
 #include <gdiplus.h>